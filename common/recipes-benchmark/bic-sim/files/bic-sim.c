@@ -0,0 +1,737 @@
+/*
+ * bic-sim: Software BIC endpoint behind the ipmbd IPC socket
+ *
+ * Copyright 2021-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * bic-sim listens on the same UNIX socket ipmbd serves for a bus
+ * (/tmp/ipmb_socket_<bus>), so lib_ipmb_handle() users such as libbic talk to
+ * it unmodified. Requests are answered from a JSON model with a configurable
+ * service latency, and responses can be dropped or answered with NODE_BUSY
+ * to exercise the callers' retry paths.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <ctype.h>
+#include <time.h>
+#include <signal.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <jansson.h>
+#include <openbmc/ipmi.h>
+#include <openbmc/ipmb.h>
+#include <openbmc/ipc.h>
+
+#define DEFAULT_BUS         1
+#define MAX_ACTIVE          16
+#define MAX_SNR_NUM         0xFF
+#define MAX_SDR_RECS        256
+#define MAX_SDR_LEN         64
+#define MAX_FRU_SIZE        4096
+#define MAX_CANNED_CMDS     64
+#define MAX_CANNED_LEN      128
+#define MAX_FW_COMPS        32
+
+// ipmb response header: rqSA, netFn/LUN, hdrCksum, rsSA, rqSeq/LUN, cmd, cc
+#define IPMB_RES_HDR_LEN    7
+
+// fby3 BIC OEM Get All Sensor Reading, see bic_xfer.h of the fby3 libbic
+#define BIC_CMD_OEM_GET_ALL_SNR_READING 0x6C
+
+// Get All Sensor Reading page size, in sensor records
+#define SNR_SNAPSHOT_PAGE   40
+
+static const uint8_t iana_id[3] = {0x9C, 0x9C, 0x00};
+
+struct canned_cmd {
+  uint8_t netfn;
+  uint8_t cmd;
+  uint8_t cc;
+  uint8_t len;
+  uint8_t data[MAX_CANNED_LEN];
+};
+
+struct fw_comp {
+  uint32_t bytes;
+  uint32_t cksum;
+};
+
+struct sim_model {
+  // service behaviour
+  uint32_t latency_us;
+  uint32_t jitter_us;
+  uint32_t fw_latency_us;
+  uint32_t drop_pct;
+  uint32_t busy_pct;
+
+  uint8_t dev_id[15];
+  uint8_t dev_id_len;
+
+  bool snr_present[MAX_SNR_NUM + 1];
+  uint8_t snr_value[MAX_SNR_NUM + 1];
+  bool snapshot_supported;
+
+  uint8_t sdr[MAX_SDR_RECS][MAX_SDR_LEN];
+  uint8_t sdr_len[MAX_SDR_RECS];
+  int sdr_cnt;
+
+  pthread_mutex_t fru_lock;
+  uint8_t fru[MAX_FRU_SIZE];
+  uint16_t fru_size;
+
+  struct canned_cmd canned[MAX_CANNED_CMDS];
+  int canned_cnt;
+
+  pthread_mutex_t fw_lock;
+  struct fw_comp fw[MAX_FW_COMPS];
+};
+
+struct sim_stats {
+  pthread_mutex_t lock;
+  unsigned int seed;
+  uint64_t requests;
+  uint64_t dropped;
+  uint64_t busy;
+  uint64_t invalid;
+};
+
+static struct sim_model g_model = {
+  .dev_id = {0x20, 0x81, 0x01, 0x02, 0x02, 0xBF, 0x9C, 0x9C, 0x00, 0x00, 0x00},
+  .dev_id_len = 11,
+  .snapshot_supported = true,
+  .fru_lock = PTHREAD_MUTEX_INITIALIZER,
+  .fw_lock = PTHREAD_MUTEX_INITIALIZER,
+};
+static struct sim_stats g_stats = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+static int verbose = 0;
+static volatile sig_atomic_t dump_stats = 0;
+
+static int
+parse_hex(const char *str, uint8_t *buf, size_t max) {
+  size_t len = 0;
+  char byte[3] = {0};
+
+  while (*str) {
+    if (isspace((unsigned char)*str) || *str == ':') {
+      str++;
+      continue;
+    }
+    if (!isxdigit((unsigned char)str[0]) || !isxdigit((unsigned char)str[1]) || len >= max) {
+      return -1;
+    }
+    byte[0] = str[0];
+    byte[1] = str[1];
+    buf[len++] = (uint8_t)strtoul(byte, NULL, 16);
+    str += 2;
+  }
+  return (int)len;
+}
+
+static int
+json_get_u32(json_t *obj, const char *key, uint32_t *val) {
+  json_t *tmp = json_object_get(obj, key);
+
+  if (!tmp) {
+    return 0;
+  }
+  if (!json_is_integer(tmp) || json_integer_value(tmp) < 0) {
+    fprintf(stderr, "model: \"%s\" must be a non-negative integer\n", key);
+    return -1;
+  }
+  *val = (uint32_t)json_integer_value(tmp);
+  return 0;
+}
+
+static int
+load_model(const char *path, struct sim_model *m) {
+  json_error_t error;
+  json_t *root, *tmp, *val;
+  const char *key;
+  size_t i;
+  int len, ret = -1;
+
+  root = json_load_file(path, 0, &error);
+  if (!root) {
+    fprintf(stderr, "%s:%d: %s\n", path, error.line, error.text);
+    return -1;
+  }
+
+  if (json_get_u32(root, "latency_us", &m->latency_us) ||
+      json_get_u32(root, "jitter_us", &m->jitter_us) ||
+      json_get_u32(root, "drop_pct", &m->drop_pct) ||
+      json_get_u32(root, "busy_pct", &m->busy_pct)) {
+    goto bail;
+  }
+
+  tmp = json_object_get(root, "dev_id");
+  if (tmp && json_is_string(tmp)) {
+    if ((len = parse_hex(json_string_value(tmp), m->dev_id, sizeof(m->dev_id))) < 0) {
+      fprintf(stderr, "model: invalid dev_id\n");
+      goto bail;
+    }
+    m->dev_id_len = len;
+  }
+
+  tmp = json_object_get(root, "sensor_snapshot");
+  if (tmp && json_is_boolean(tmp)) {
+    m->snapshot_supported = json_is_true(tmp);
+  }
+
+  // "sensors": { "0x01": 45, ... } raw readings by sensor number
+  tmp = json_object_get(root, "sensors");
+  if (tmp && json_is_object(tmp)) {
+    json_object_foreach(tmp, key, val) {
+      unsigned long num = strtoul(key, NULL, 0);
+      if (num > MAX_SNR_NUM || !json_is_integer(val)) {
+        fprintf(stderr, "model: invalid sensor %s\n", key);
+        goto bail;
+      }
+      m->snr_present[num] = true;
+      m->snr_value[num] = (uint8_t)json_integer_value(val);
+    }
+  }
+
+  // "sdr": [ "hex record", ... ]
+  tmp = json_object_get(root, "sdr");
+  if (tmp && json_is_array(tmp)) {
+    json_array_foreach(tmp, i, val) {
+      if (i >= MAX_SDR_RECS || !json_is_string(val) ||
+          (len = parse_hex(json_string_value(val), m->sdr[i], MAX_SDR_LEN)) <= 0) {
+        fprintf(stderr, "model: invalid sdr record %zu\n", i);
+        goto bail;
+      }
+      m->sdr_len[i] = len;
+      m->sdr_cnt++;
+    }
+  }
+
+  tmp = json_object_get(root, "fru");
+  if (tmp && json_is_string(tmp)) {
+    if ((len = parse_hex(json_string_value(tmp), m->fru, sizeof(m->fru))) < 0) {
+      fprintf(stderr, "model: invalid fru\n");
+      goto bail;
+    }
+    m->fru_size = len;
+  }
+
+  tmp = json_object_get(root, "fw_update");
+  if (tmp && json_is_object(tmp)) {
+    if (json_get_u32(tmp, "latency_us", &m->fw_latency_us)) {
+      goto bail;
+    }
+  }
+
+  // "commands": [ { "netfn": 0x38, "cmd": 0x0B, "cc": 0, "resp": "hex" }, ... ]
+  tmp = json_object_get(root, "commands");
+  if (tmp && json_is_array(tmp)) {
+    json_array_foreach(tmp, i, val) {
+      struct canned_cmd *c;
+      uint32_t netfn = 0, cmd = 0, cc = 0;
+      json_t *resp;
+
+      if (m->canned_cnt >= MAX_CANNED_CMDS) {
+        fprintf(stderr, "model: too many commands\n");
+        goto bail;
+      }
+      c = &m->canned[m->canned_cnt];
+      if (json_get_u32(val, "netfn", &netfn) || json_get_u32(val, "cmd", &cmd) ||
+          json_get_u32(val, "cc", &cc)) {
+        goto bail;
+      }
+      c->netfn = netfn;
+      c->cmd = cmd;
+      c->cc = cc;
+      resp = json_object_get(val, "resp");
+      if (resp && json_is_string(resp)) {
+        if ((len = parse_hex(json_string_value(resp), c->data, sizeof(c->data))) < 0) {
+          fprintf(stderr, "model: invalid resp of command %zu\n", i);
+          goto bail;
+        }
+        c->len = len;
+      }
+      m->canned_cnt++;
+    }
+  }
+  ret = 0;
+
+bail:
+  json_decref(root);
+  return ret;
+}
+
+// Every connection runs on its own thread, so share one locked PRNG state.
+static unsigned int
+sim_rand(void) {
+  unsigned int r;
+
+  pthread_mutex_lock(&g_stats.lock);
+  r = rand_r(&g_stats.seed);
+  pthread_mutex_unlock(&g_stats.lock);
+  return r;
+}
+
+static void
+sim_delay(uint32_t base_us, uint32_t jitter_us) {
+  struct timespec ts;
+  uint64_t us = base_us;
+
+  if (jitter_us) {
+    us += sim_rand() % (jitter_us + 1);
+  }
+  if (us == 0) {
+    return;
+  }
+  ts.tv_sec = us / 1000000;
+  ts.tv_nsec = (us % 1000000) * 1000;
+  while (nanosleep(&ts, &ts) == -1 && errno == EINTR);
+}
+
+static uint8_t
+calc_cksum(const uint8_t *buf, size_t len) {
+  uint8_t sum = 0;
+
+  while (len--) {
+    sum += *buf++;
+  }
+  return ZERO_CKSUM_CONST - sum;
+}
+
+static bool
+has_iana(const uint8_t *data, size_t len) {
+  return len >= 3 && !memcmp(data, iana_id, 3);
+}
+
+/*
+ * Fill the response payload (after the completion code) for one request.
+ * Returns the completion code; *len is the payload length.
+ */
+static uint8_t
+handle_cmd(uint8_t netfn, uint8_t cmd, const uint8_t *req, size_t req_len,
+           uint8_t *res, size_t *len) {
+  struct sim_model *m = &g_model;
+  int i;
+
+  *len = 0;
+
+  for (i = 0; i < m->canned_cnt; i++) {
+    if (m->canned[i].netfn == netfn && m->canned[i].cmd == cmd) {
+      memcpy(res, m->canned[i].data, m->canned[i].len);
+      *len = m->canned[i].len;
+      return m->canned[i].cc;
+    }
+  }
+
+  switch (netfn) {
+    case NETFN_APP_REQ:
+      if (cmd == CMD_APP_GET_DEVICE_ID) {
+        memcpy(res, m->dev_id, m->dev_id_len);
+        *len = m->dev_id_len;
+        return CC_SUCCESS;
+      }
+      break;
+
+    case NETFN_SENSOR_REQ:
+      if (cmd == CMD_SENSOR_GET_SENSOR_READING) {
+        if (req_len < 1) {
+          return CC_INVALID_LENGTH;
+        }
+        if (!m->snr_present[req[0]]) {
+          return CC_PARAM_OUT_OF_RANGE;
+        }
+        res[0] = m->snr_value[req[0]];
+        res[1] = 0xC0;  // event messages and scanning enabled
+        res[2] = 0x00;
+        res[3] = 0x00;
+        *len = 4;
+        return CC_SUCCESS;
+      }
+      break;
+
+    case NETFN_STORAGE_REQ:
+      switch (cmd) {
+        case CMD_STORAGE_GET_FRUID_INFO:
+          pthread_mutex_lock(&m->fru_lock);
+          res[0] = m->fru_size & 0xFF;
+          res[1] = m->fru_size >> 8;
+          pthread_mutex_unlock(&m->fru_lock);
+          res[2] = 0x00;
+          *len = 3;
+          return CC_SUCCESS;
+
+        case CMD_STORAGE_READ_FRUID_DATA: {
+          uint16_t offset, count;
+
+          if (req_len < 4) {
+            return CC_INVALID_LENGTH;
+          }
+          offset = req[1] | (req[2] << 8);
+          count = req[3];
+          pthread_mutex_lock(&m->fru_lock);
+          if (offset > m->fru_size) {
+            pthread_mutex_unlock(&m->fru_lock);
+            return CC_PARAM_OUT_OF_RANGE;
+          }
+          if (count > m->fru_size - offset) {
+            count = m->fru_size - offset;
+          }
+          res[0] = count;
+          memcpy(&res[1], &m->fru[offset], count);
+          pthread_mutex_unlock(&m->fru_lock);
+          *len = count + 1;
+          return CC_SUCCESS;
+        }
+
+        case CMD_STORAGE_WRITE_FRUID_DATA: {
+          uint16_t offset;
+          size_t count;
+
+          if (req_len < 3) {
+            return CC_INVALID_LENGTH;
+          }
+          offset = req[1] | (req[2] << 8);
+          count = req_len - 3;
+          if (offset + count > sizeof(m->fru)) {
+            return CC_PARAM_OUT_OF_RANGE;
+          }
+          pthread_mutex_lock(&m->fru_lock);
+          memcpy(&m->fru[offset], &req[3], count);
+          if (offset + count > m->fru_size) {
+            m->fru_size = offset + count;
+          }
+          pthread_mutex_unlock(&m->fru_lock);
+          res[0] = count;
+          *len = 1;
+          return CC_SUCCESS;
+        }
+
+        case CMD_STORAGE_RSV_SDR:
+          res[0] = 0x01;
+          res[1] = 0x00;
+          *len = 2;
+          return CC_SUCCESS;
+
+        case CMD_STORAGE_GET_SDR: {
+          uint16_t rec_id, next;
+          uint8_t offset, count;
+
+          if (req_len < 6) {
+            return CC_INVALID_LENGTH;
+          }
+          rec_id = req[2] | (req[3] << 8);
+          offset = req[4];
+          count = req[5];
+          if (rec_id >= m->sdr_cnt || offset > m->sdr_len[rec_id]) {
+            return CC_PARAM_OUT_OF_RANGE;
+          }
+          if (count > m->sdr_len[rec_id] - offset) {
+            count = m->sdr_len[rec_id] - offset;
+          }
+          next = (rec_id + 1 < m->sdr_cnt) ? rec_id + 1 : 0xFFFF;
+          res[0] = next & 0xFF;
+          res[1] = next >> 8;
+          memcpy(&res[2], &m->sdr[rec_id][offset], count);
+          *len = count + 2;
+          return CC_SUCCESS;
+        }
+      }
+      break;
+
+    case NETFN_OEM_1S_REQ:
+      if (!has_iana(req, req_len)) {
+        return CC_INVALID_DATA_FIELD;
+      }
+      memcpy(res, iana_id, 3);
+      *len = 3;
+
+      switch (cmd) {
+        case BIC_CMD_OEM_GET_ALL_SNR_READING: {
+          int snr, cnt = 0;
+
+          if (!m->snapshot_supported) {
+            return CC_INVALID_CMD;
+          }
+          if (req_len < 4) {
+            return CC_INVALID_LENGTH;
+          }
+          res[3] = 0;  // no more pages
+          res[4] = 0;
+          *len = 5;
+          for (snr = req[3]; snr <= MAX_SNR_NUM; snr++) {
+            if (!m->snr_present[snr]) {
+              continue;
+            }
+            if (cnt == SNR_SNAPSHOT_PAGE) {
+              res[3] = 1;
+              res[4] = snr;
+              break;
+            }
+            res[(*len)++] = snr;
+            res[(*len)++] = m->snr_value[snr];
+            res[(*len)++] = 0xC0;
+            res[(*len)++] = 0x00;
+            res[(*len)++] = 0x00;
+            cnt++;
+          }
+          return CC_SUCCESS;
+        }
+
+        case CMD_OEM_1S_UPDATE_FW: {
+          uint8_t comp;
+          uint16_t dlen;
+          uint32_t sum = 0;
+          size_t hdr = 10, j;
+
+          if (req_len < hdr) {
+            return CC_INVALID_LENGTH;
+          }
+          comp = req[3] & 0x7F;
+          dlen = req[8] | (req[9] << 8);
+          if (req_len == hdr + 4 + dlen) {
+            hdr += 4;  // carries the total image size
+          } else if (req_len != hdr + dlen) {
+            return CC_INVALID_LENGTH;
+          }
+          if (comp >= MAX_FW_COMPS) {
+            return CC_PARAM_OUT_OF_RANGE;
+          }
+          for (j = 0; j < dlen; j++) {
+            sum += req[hdr + j];
+          }
+          pthread_mutex_lock(&m->fw_lock);
+          m->fw[comp].bytes += dlen;
+          m->fw[comp].cksum += sum;
+          pthread_mutex_unlock(&m->fw_lock);
+          return CC_SUCCESS;
+        }
+
+        case CMD_OEM_1S_GET_FW_CKSUM: {
+          uint8_t comp;
+
+          if (req_len < 4) {
+            return CC_INVALID_LENGTH;
+          }
+          comp = req[3] & 0x7F;
+          if (comp >= MAX_FW_COMPS) {
+            return CC_PARAM_OUT_OF_RANGE;
+          }
+          pthread_mutex_lock(&m->fw_lock);
+          memcpy(&res[3], &m->fw[comp].cksum, 4);
+          pthread_mutex_unlock(&m->fw_lock);
+          *len = 7;
+          return CC_SUCCESS;
+        }
+
+        case CMD_OEM_1S_ENABLE_BIC_UPDATE:
+        case CMD_OEM_1S_BIC_UPDATE_MODE:
+          return CC_SUCCESS;
+      }
+      *len = 0;
+      break;
+  }
+
+  return CC_INVALID_CMD;
+}
+
+static void
+stats_inc(uint64_t *cnt) {
+  pthread_mutex_lock(&g_stats.lock);
+  (*cnt)++;
+  pthread_mutex_unlock(&g_stats.lock);
+}
+
+static int
+conn_handler(client_t *cli) {
+  uint8_t req_buf[MAX_IPMB_REQ_LEN];
+  uint8_t res_buf[MAX_IPMB_RES_LEN];
+  size_t req_len = sizeof(req_buf);
+  size_t data_len = 0;
+  ipmb_req_t *req = (ipmb_req_t *)req_buf;
+  ipmb_res_t *res = (ipmb_res_t *)res_buf;
+  uint8_t netfn;
+  bool fw_cmd;
+
+  if (ipc_recv_req(cli, req_buf, &req_len, TIMEOUT_IPMB)) {
+    return -1;
+  }
+  stats_inc(&g_stats.requests);
+
+  // ipmbd answers pings itself without touching the bus
+  if (req_len == IPMB_PING_LEN) {
+    return ipc_send_resp(cli, req_buf, req_len);
+  }
+
+  if (req_len < MIN_IPMB_REQ_LEN) {
+    stats_inc(&g_stats.invalid);
+    return -1;
+  }
+
+  netfn = req->netfn_lun >> LUN_OFFSET;
+  fw_cmd = (netfn == NETFN_OEM_1S_REQ && req->cmd == CMD_OEM_1S_UPDATE_FW);
+  sim_delay(fw_cmd && g_model.fw_latency_us ? g_model.fw_latency_us : g_model.latency_us,
+            g_model.jitter_us);
+
+  // a dropped response looks like an IPMB timeout to the caller
+  if (g_model.drop_pct && (sim_rand() % 100) < g_model.drop_pct) {
+    stats_inc(&g_stats.dropped);
+    return -1;
+  }
+
+  res->req_slave_addr = BMC_SLAVE_ADDR << 1;
+  res->netfn_lun = (netfn + 1) << LUN_OFFSET;
+  res->hdr_cksum = calc_cksum(res_buf, 2);
+  res->res_slave_addr = req->res_slave_addr;
+  res->seq_lun = req->seq_lun;
+  res->cmd = req->cmd;
+
+  if (g_model.busy_pct && (sim_rand() % 100) < g_model.busy_pct) {
+    stats_inc(&g_stats.busy);
+    res->cc = CC_NODE_BUSY;
+  } else {
+    // request data sits between the header and the trailing checksum
+    res->cc = handle_cmd(netfn, req->cmd, req->data, req_len - MIN_IPMB_REQ_LEN,
+                         res->data, &data_len);
+  }
+  if (verbose) {
+    printf("netfn 0x%02x cmd 0x%02x: cc 0x%02x, %zu bytes\n", netfn, req->cmd, res->cc, data_len);
+  }
+
+  res_buf[IPMB_RES_HDR_LEN + data_len] =
+    calc_cksum(&res_buf[IPMB_DATA_OFFSET], IPMB_RES_HDR_LEN - IPMB_DATA_OFFSET + data_len);
+
+  return ipc_send_resp(cli, res_buf, IPMB_RES_HDR_LEN + data_len + 1);
+}
+
+// stdio isn't async-signal-safe, the counters are printed by main()
+static void
+request_stats(int sig) {
+  (void)sig;
+  dump_stats = 1;
+}
+
+static void
+print_stats(void) {
+  struct sim_stats st;
+
+  pthread_mutex_lock(&g_stats.lock);
+  st = g_stats;
+  pthread_mutex_unlock(&g_stats.lock);
+  fprintf(stderr, "requests %llu dropped %llu busy %llu invalid %llu\n",
+          (unsigned long long)st.requests, (unsigned long long)st.dropped,
+          (unsigned long long)st.busy, (unsigned long long)st.invalid);
+}
+
+static void
+usage(const char *prog) {
+  fprintf(stderr,
+      "Usage: %s [-v] [-b bus] [-l latency_us] [-j jitter_us] [-d drop_pct] [-B busy_pct] [model.json]\n"
+      "\t-b: IPMB bus to serve, replaces ipmbd on /tmp/%s_<bus> (default %d)\n"
+      "\t-l: service latency per request in microseconds\n"
+      "\t-j: uniform random jitter added to the latency\n"
+      "\t-d: percentage of requests to leave unanswered\n"
+      "\t-B: percentage of requests to answer with NODE_BUSY\n"
+      "\tSIGUSR1 prints the request counters\n",
+      prog, SOCK_PATH_IPMB, DEFAULT_BUS);
+  exit(1);
+}
+
+int
+main(int argc, char **argv) {
+  char sock_path[64];
+  pthread_t waiter;
+  sigset_t usr1, old;
+  int bus = DEFAULT_BUS;
+  long latency = -1, jitter = -1, drop = -1, busy = -1;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "vb:l:j:d:B:")) != -1) {
+    switch (opt) {
+      case 'v':
+        verbose = 1;
+        break;
+      case 'b':
+        bus = atoi(optarg);
+        break;
+      case 'l':
+        latency = strtol(optarg, NULL, 0);
+        break;
+      case 'j':
+        jitter = strtol(optarg, NULL, 0);
+        break;
+      case 'd':
+        drop = strtol(optarg, NULL, 0);
+        break;
+      case 'B':
+        busy = strtol(optarg, NULL, 0);
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+
+  if (optind < argc && load_model(argv[optind], &g_model)) {
+    return 1;
+  }
+
+  // command line overrides the model
+  if (latency >= 0)
+    g_model.latency_us = latency;
+  if (jitter >= 0)
+    g_model.jitter_us = jitter;
+  if (drop >= 0)
+    g_model.drop_pct = drop;
+  if (busy >= 0)
+    g_model.busy_pct = busy;
+  if (g_model.drop_pct > 100 || g_model.busy_pct > 100) {
+    usage(argv[0]);
+  }
+
+  g_stats.seed = (unsigned int)time(NULL) ^ (unsigned int)getpid();
+  signal(SIGUSR1, request_stats);
+
+  // only the main thread takes SIGUSR1, the service threads inherit the mask
+  sigemptyset(&usr1);
+  sigaddset(&usr1, SIGUSR1);
+  pthread_sigmask(SIG_BLOCK, &usr1, &old);
+
+  snprintf(sock_path, sizeof(sock_path), "%s_%d", SOCK_PATH_IPMB, bus);
+  if (ipc_start_svc(sock_path, conn_handler, MAX_ACTIVE, NULL, &waiter)) {
+    fprintf(stderr, "failed to start service on /tmp/%s\n", sock_path);
+    return 1;
+  }
+  printf("bic-sim: serving /tmp/%s, latency %uus jitter %uus drop %u%% busy %u%%\n",
+         sock_path, g_model.latency_us, g_model.jitter_us, g_model.drop_pct, g_model.busy_pct);
+  fflush(stdout);
+
+  // the service threads never exit
+  for (;;) {
+    sigsuspend(&old);
+    if (dump_stats) {
+      dump_stats = 0;
+      print_stats();
+    }
+  }
+}
@@ -0,0 +1,81 @@
+#!/usr/bin/python3
+#
+# Copyright 2021-present Facebook. All Rights Reserved.
+#
+# Run every ipmb-bench command against an IPMB endpoint and print one JSON
+# document with the results. By default a bic-sim instance is started on an
+# unused bus; pass --bus to measure a real ipmbd instead. Real BICs only get
+# the read-only standard IPMI commands unless --oem is given as well, since
+# the OEM codes may mean something else to their firmware.
+#
+import argparse
+import json
+import subprocess
+import sys
+import time
+
+STD_COMMANDS = ["devid", "sensor", "sdr", "fru"]
+OEM_COMMANDS = ["snapshot", "fwcksum"]
+
+
+def run_bench(bus, cmd, iterations, threads):
+    out = subprocess.run(
+        [
+            "/usr/local/bin/ipmb-bench",
+            "-b", str(bus),
+            "-c", cmd,
+            "-n", str(iterations),
+            "-t", str(threads),
+            "-j",
+        ],
+        stdout=subprocess.PIPE,
+        check=False,
+    )
+    return json.loads(out.stdout.decode())
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--bus", type=int, help="benchmark an existing ipmbd")
+    parser.add_argument(
+        "--oem",
+        action="store_true",
+        help="also send the OEM commands to the BIC behind --bus",
+    )
+    parser.add_argument("--sim-bus", type=int, default=15)
+    parser.add_argument("--model", default="/etc/bic-sim-model.json")
+    parser.add_argument("--iterations", type=int, default=1000)
+    parser.add_argument("--threads", type=int, nargs="+", default=[1, 4])
+    args = parser.parse_args()
+
+    sim = None
+    bus = args.bus
+    if bus is None:
+        bus = args.sim_bus
+        sim = subprocess.Popen(
+            ["/usr/local/bin/bic-sim", "-b", str(bus), args.model],
+            stdout=subprocess.DEVNULL,
+        )
+        time.sleep(1)
+
+    commands = STD_COMMANDS
+    if sim or args.oem:
+        commands = STD_COMMANDS + OEM_COMMANDS
+
+    results = []
+    try:
+        for cmd in commands:
+            for threads in args.threads:
+                results.append(run_bench(bus, cmd, args.iterations, threads))
+    finally:
+        if sim:
+            sim.terminate()
+            sim.wait()
+
+    json.dump({"endpoint": "bic-sim" if sim else "ipmbd", "results": results},
+              sys.stdout, indent=2)
+    print()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,243 @@
+/*
+ * ipmb-bench: IPMB round-trip throughput and latency benchmark
+ *
+ * Copyright 2021-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * Drives lib_ipmb_handle(), the transport under libbic's bic_ipmb_wrapper(),
+ * with the same request frames libbic builds. Point it at a real ipmbd to
+ * measure the daemon and the bus, or at bic-sim to measure the library and
+ * IPC overhead alone.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <openbmc/ipmi.h>
+#include <openbmc/ipmb.h>
+
+#define DEFAULT_BUS     1
+#define DEFAULT_ITER    1000
+
+// fby3 BIC OEM Get All Sensor Reading, see bic_xfer.h of the fby3 libbic
+#define BIC_CMD_OEM_GET_ALL_SNR_READING 0x6C
+
+struct bench_cmd {
+  const char *name;
+  uint8_t netfn;
+  uint8_t cmd;
+  uint8_t data[8];
+  uint8_t len;
+};
+
+static const struct bench_cmd bench_cmds[] = {
+  {"devid", NETFN_APP_REQ, CMD_APP_GET_DEVICE_ID, {0}, 0},
+  {"sensor", NETFN_SENSOR_REQ, CMD_SENSOR_GET_SENSOR_READING, {0x01}, 1},
+  {"snapshot", NETFN_OEM_1S_REQ, BIC_CMD_OEM_GET_ALL_SNR_READING, {0x9C, 0x9C, 0x00, 0x00}, 4},
+  {"sdr", NETFN_STORAGE_REQ, CMD_STORAGE_GET_SDR, {0x01, 0x00, 0x00, 0x00, 0x00, 0x1A}, 6},
+  {"fru", NETFN_STORAGE_REQ, CMD_STORAGE_READ_FRUID_DATA, {0x00, 0x00, 0x00, 0x20}, 4},
+  {"fwcksum", NETFN_OEM_1S_REQ, CMD_OEM_1S_GET_FW_CKSUM, {0x9C, 0x9C, 0x00, 0x00}, 4},
+};
+
+struct worker {
+  pthread_t tid;
+  uint8_t bus;
+  const struct bench_cmd *cmd;
+  int iter;
+  uint64_t *lat_ns;
+  int ok;
+  int fail;
+};
+
+static uint64_t
+now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Build the request the way bic_ipmb_wrapper() does
+static int
+build_req(const struct bench_cmd *c, uint8_t *buf) {
+  ipmb_req_t *req = (ipmb_req_t *)buf;
+  int len;
+
+  req->res_slave_addr = BRIDGE_SLAVE_ADDR << 1;
+  req->netfn_lun = c->netfn << LUN_OFFSET;
+  req->hdr_cksum = ZERO_CKSUM_CONST - (req->res_slave_addr + req->netfn_lun);
+  req->req_slave_addr = BMC_SLAVE_ADDR << 1;
+  req->seq_lun = 0x00;
+  req->cmd = c->cmd;
+  memcpy(req->data, c->data, c->len);
+
+  // ipmbd fills in the sequence number and the data checksum
+  len = MIN_IPMB_REQ_LEN + c->len;
+  buf[len - 1] = 0;
+  return len;
+}
+
+static void *
+worker_thread(void *arg) {
+  struct worker *w = (struct worker *)arg;
+  uint8_t tbuf[MAX_IPMB_REQ_LEN] = {0};
+  uint8_t rbuf[MAX_IPMB_RES_LEN] = {0};
+  uint8_t rlen;
+  uint64_t start;
+  int i, tlen;
+
+  for (i = 0; i < w->iter; i++) {
+    // ipmbd rewrites the header in place, so rebuild every time
+    tlen = build_req(w->cmd, tbuf);
+    rlen = 0;
+    start = now_ns();
+    lib_ipmb_handle(w->bus, tbuf, tlen, rbuf, &rlen);
+    w->lat_ns[i] = now_ns() - start;
+
+    if (rlen >= MIN_IPMB_RES_LEN && ((ipmb_res_t *)rbuf)->cc == CC_SUCCESS) {
+      w->ok++;
+    } else {
+      w->fail++;
+    }
+  }
+  return NULL;
+}
+
+static int
+cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+static void
+usage(const char *prog) {
+  size_t i;
+
+  fprintf(stderr,
+      "Usage: %s [-b bus] [-n iterations] [-t threads] [-c command] [-j]\n"
+      "\t-b: IPMB bus (default %d)\n"
+      "\t-n: requests per thread (default %d)\n"
+      "\t-t: concurrent client threads (default 1)\n"
+      "\t-j: print the result as JSON\n"
+      "\tcommands:",
+      prog, DEFAULT_BUS, DEFAULT_ITER);
+  for (i = 0; i < sizeof(bench_cmds)/sizeof(bench_cmds[0]); i++) {
+    fprintf(stderr, " %s", bench_cmds[i].name);
+  }
+  fprintf(stderr, "\n");
+  exit(1);
+}
+
+int
+main(int argc, char **argv) {
+  const struct bench_cmd *cmd = &bench_cmds[0];
+  struct worker *workers;
+  uint64_t *lat, start, elapsed;
+  int bus = DEFAULT_BUS, iter = DEFAULT_ITER, threads = 1;
+  int ok = 0, fail = 0, total, i;
+  bool json = false;
+  double rps, p50, p99, max;
+  size_t n;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "b:n:t:c:j")) != -1) {
+    switch (opt) {
+      case 'b':
+        bus = atoi(optarg);
+        break;
+      case 'n':
+        iter = atoi(optarg);
+        break;
+      case 't':
+        threads = atoi(optarg);
+        break;
+      case 'c':
+        cmd = NULL;
+        for (n = 0; n < sizeof(bench_cmds)/sizeof(bench_cmds[0]); n++) {
+          if (!strcmp(optarg, bench_cmds[n].name)) {
+            cmd = &bench_cmds[n];
+          }
+        }
+        if (!cmd) {
+          usage(argv[0]);
+        }
+        break;
+      case 'j':
+        json = true;
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (iter <= 0 || threads <= 0 || bus < 0 || bus > 0xFF) {
+    usage(argv[0]);
+  }
+
+  total = iter * threads;
+  lat = calloc(total, sizeof(*lat));
+  workers = calloc(threads, sizeof(*workers));
+  if (!lat || !workers) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+
+  start = now_ns();
+  for (i = 0; i < threads; i++) {
+    workers[i].bus = bus;
+    workers[i].cmd = cmd;
+    workers[i].iter = iter;
+    workers[i].lat_ns = &lat[i * iter];
+    if (pthread_create(&workers[i].tid, NULL, worker_thread, &workers[i])) {
+      fprintf(stderr, "failed to create worker %d\n", i);
+      return 1;
+    }
+  }
+  for (i = 0; i < threads; i++) {
+    pthread_join(workers[i].tid, NULL);
+    ok += workers[i].ok;
+    fail += workers[i].fail;
+  }
+  elapsed = now_ns() - start;
+
+  qsort(lat, total, sizeof(*lat), cmp_u64);
+  rps = total / (elapsed / 1e9);
+  p50 = lat[total / 2] / 1e3;
+  p99 = lat[(total * 99) / 100 < total ? (total * 99) / 100 : total - 1] / 1e3;
+  max = lat[total - 1] / 1e3;
+
+  if (json) {
+    printf("{\"command\": \"%s\", \"bus\": %d, \"threads\": %d, \"requests\": %d, "
+           "\"ok\": %d, \"failed\": %d, \"requests_per_sec\": %.1f, "
+           "\"p50_us\": %.1f, \"p99_us\": %.1f, \"max_us\": %.1f}\n",
+           cmd->name, bus, threads, total, ok, fail, rps, p50, p99, max);
+  } else {
+    printf("%-10s bus %d, %d thread(s), %d requests (%d failed)\n", cmd->name, bus, threads, total, fail);
+    printf("  %.1f requests/s, p50 %.1f us, p99 %.1f us, max %.1f us\n", rps, p50, p99, max);
+  }
+
+  free(workers);
+  free(lat);
+  return fail ? 2 : 0;
+}
@@ -0,0 +1,454 @@
+/*
+ * Copyright 2021-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * Microbenchmarks of the libraries most daemons depend on.
+ *
+ * Every benchmark reports ops/s, p50/p99 latency and the system calls
+ * of one operation, counted by running it again in a child traced with
+ * ptrace. Results are printed as JSON, so runs of different releases
+ * can be compared.
+ *
+ * Built with -D__TEST__ (make host) the libraries are compiled from the
+ * tree and use their test paths, so it also runs on a Linux dev host.
+ */
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <openbmc/fruid.h>
+#include <openbmc/ipc.h>
+#include <openbmc/kv.h>
+#include <openbmc/pal.h>
+#include <openbmc/pal_sensors.h>
+#include "selstream.hpp"
+
+#define DEFAULT_ITERATIONS 2000
+#define SYSCALL_ITERATIONS 100
+
+// A sensor nobody else uses, so the benchmark does not disturb sensord.
+#define BENCH_FRU          AGGREGATE_SENSOR_FRU_ID
+#define BENCH_SENSOR       0xfe
+#define BENCH_ENDPOINT     "lib_bench"
+#define BENCH_SEL_LINES    500
+
+#ifndef __TEST__
+#define BENCH_FRU_BIN      "/tmp/lib-bench-fru.bin"
+#else
+#define BENCH_FRU_BIN      "./test/lib-bench-fru.bin"
+
+// Only the FRU names are needed from the platform.
+extern "C" int pal_get_fru_name(uint8_t fru, char* name) {
+  sprintf(name, "fru%u", fru);
+  return 0;
+}
+#endif
+
+using nlohmann::json;
+
+struct Bench {
+  std::string name;
+  // Iterations relative to -n, for operations which are slow or wear
+  // out the flash.
+  int divisor;
+  std::function<int()> op;
+  std::function<void()> setup;
+  std::function<void()> teardown;
+};
+
+static int64_t nowNs() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void runSetup(const Bench& b) {
+  if (b.setup)
+    b.setup();
+}
+
+static void runTeardown(const Bench& b) {
+  if (b.teardown)
+    b.teardown();
+}
+
+/*
+ * System calls of n operations, counted in a child which stops itself
+ * before and after the loop. Threads started by the setup, such as the
+ * IPC service, are not traced, so only the caller's side is counted.
+ * The first stop, which waits for the tracer, is consumed by the first
+ * waitpid(), so counting runs from the next marker to the one after.
+ * Returns -1 if the child cannot be traced.
+ */
+static long countSyscalls(const Bench& b, int n) {
+  int status, sig = 0, marks = 0;
+  bool entry = true;
+  long count = 0;
+  pid_t pid;
+
+  fflush(NULL);
+  pid = fork();
+  if (pid < 0)
+    return -1;
+  if (pid == 0) {
+    if (ptrace(PTRACE_TRACEME, 0, nullptr, nullptr) < 0)
+      _exit(1);
+    raise(SIGSTOP);
+    runSetup(b);
+    b.op();
+    raise(SIGSTOP);
+    for (int i = 0; i < n; i++)
+      b.op();
+    raise(SIGSTOP);
+    runTeardown(b);
+    _exit(0);
+  }
+
+  if (waitpid(pid, &status, 0) < 0 || !WIFSTOPPED(status)) {
+    kill(pid, SIGKILL);
+    waitpid(pid, &status, 0);
+    return -1;
+  }
+  ptrace(PTRACE_SETOPTIONS, pid, nullptr,
+         (void*)(PTRACE_O_TRACESYSGOOD | PTRACE_O_EXITKILL));
+
+  while (ptrace(PTRACE_SYSCALL, pid, nullptr, (void*)(long)sig) == 0) {
+    if (waitpid(pid, &status, 0) < 0 || !WIFSTOPPED(status))
+      break;
+    sig = 0;
+    if (WSTOPSIG(status) == (SIGTRAP | 0x80)) {
+      // Stops alternate between entry and exit
+      if (entry && marks == 1)
+        count++;
+      entry = !entry;
+    } else if (WSTOPSIG(status) == SIGSTOP) {
+      marks++;
+    } else {
+      sig = WSTOPSIG(status);
+    }
+  }
+  if (waitpid(pid, &status, WNOHANG) == 0) {
+    kill(pid, SIGKILL);
+    waitpid(pid, &status, 0);
+  }
+  return marks >= 2 ? count : -1;
+}
+
+static json runBench(const Bench& b, int iterations, long markerSyscalls) {
+  std::vector<int64_t> lat;
+  int64_t start, t;
+  int errors = 0;
+  json j;
+
+  iterations = std::max(iterations / b.divisor, 10);
+  lat.reserve(iterations);
+
+  runSetup(b);
+  for (int i = 0; i < std::min(iterations / 10, 100); i++)
+    b.op();
+  start = nowNs();
+  for (int i = 0; i < iterations; i++) {
+    t = nowNs();
+    if (b.op())
+      errors++;
+    lat.push_back(nowNs() - t);
+  }
+  t = nowNs() - start;
+  runTeardown(b);
+
+  std::sort(lat.begin(), lat.end());
+  j["name"] = b.name;
+  j["iterations"] = iterations;
+  j["errors"] = errors;
+  j["ops_per_sec"] = iterations * 1e9 / t;
+  j["p50_us"] = lat[lat.size() / 2] / 1000.0;
+  j["p99_us"] = lat[std::min(lat.size() - 1, lat.size() * 99 / 100)] / 1000.0;
+
+  if (markerSyscalls >= 0) {
+    int n = std::max(SYSCALL_ITERATIONS / b.divisor, 1);
+    long count = countSyscalls(b, n);
+    if (count >= 0)
+      j["syscalls_per_op"] = (double)std::max(count - markerSyscalls, 0L) / n;
+  }
+  return j;
+}
+
+static char kvValue[MAX_VALUE_LEN];
+
+// kv skips writes of an unchanged persistent value, so alternate.
+static int kvSet(unsigned int flags) {
+  static int n;
+
+  return kv_set("lib_bench_key", (n++ & 1) ? "12345.67" : "76543.21", 0, flags);
+}
+static std::string selLog;
+
+static int echoHandler(client_t* cli) {
+  uint8_t buf[64];
+  size_t len = sizeof(buf);
+
+  if (ipc_recv_req(cli, buf, &len, 1))
+    return -1;
+  return ipc_send_resp(cli, buf, len);
+}
+
+static int ipcRoundTrip() {
+  uint8_t req[16] = {1, 2, 3, 4}, resp[64];
+  size_t len = sizeof(resp);
+
+  return ipc_send_req(BENCH_ENDPOINT, req, sizeof(req), resp, &len, 2);
+}
+
+// The FRU image of fruid-bench: chassis, board and product areas.
+static void setChksum(uint8_t* area, int len) {
+  uint8_t sum = 0;
+
+  for (int i = 0; i < len - 1; i++)
+    sum += area[i];
+  area[len - 1] = ~sum + 1;
+}
+
+static int addArea(uint8_t* area, int hdrLen, int fields) {
+  int idx = hdrLen, len;
+
+  area[0] = FRUID_FORMAT_VER;
+  for (int i = 0; i < fields; i++) {
+    len = snprintf((char*)&area[idx + 1], 32, "FIELD-%02d-0123456789", i);
+    area[idx] = (TYPE_ASCII_8BIT << 6) | len;
+    idx += len + 1;
+  }
+  area[idx++] = 0xC1;
+  len = (idx + 1 + 7) & ~7;
+  area[1] = len / FRUID_AREA_LEN_MULTIPLIER;
+  setChksum(area, len);
+  return len;
+}
+
+static void writeFruImage() {
+  uint8_t img[1024] = {0};
+  int off = 8;
+
+  img[0] = FRUID_FORMAT_VER;
+  img[2] = off / FRUID_OFFSET_MULTIPLIER;
+  img[off + 2] = 0x17;
+  off += addArea(img + off, 3, 2 + 4);
+  img[3] = off / FRUID_OFFSET_MULTIPLIER;
+  off += addArea(img + off, 6, 5 + 4);
+  img[4] = off / FRUID_OFFSET_MULTIPLIER;
+  off += addArea(img + off, 3, 7 + 4);
+  setChksum(img, 8);
+
+  std::ofstream(BENCH_FRU_BIN, std::ios::binary).write((char*)img, off);
+}
+
+static int fruidParse() {
+  fruid_info_t fruid;
+  int ret = fruid_parse(BENCH_FRU_BIN, &fruid);
+
+  if (ret == 0)
+    free_fruid_info(&fruid);
+  return ret;
+}
+
+static void buildSelLog() {
+  std::ostringstream os;
+
+  for (int i = 0; i < BENCH_SEL_LINES; i++) {
+    switch (i % 3) {
+      case 0:
+        os << " 2021 May 18 10:18:40 bmc-oob. user.crit fbtp-v2021.20.0: "
+              "healthd: BMC Reboot detected - caused by reboot command\n";
+        break;
+      case 1:
+        os << " 2021 Apr  6 15:00:40 bmc-oob. user.crit fbtp-v2021.20.0: "
+              "sensord: ASSERT: Upper Non Critical threshold - raised - "
+              "FRU: 1, num: 0xC0 curr_val: 8988.00 RPM, thresh_val: 8500.00 "
+              "RPM, snr: MB_FAN0_TACH\n";
+        break;
+      default:
+        os << " 2021 May 18 10:18:38 bmc-oob. user.crit fbtp-v2021.20.0: "
+              "ncsid: FRU: 2 NIC AEN Supported: 0x7, AEN Enable Mask=0x7\n";
+        break;
+    }
+  }
+  selLog = os.str();
+}
+
+static int selParse(OutputFormat fmt) {
+  std::istringstream is(selLog);
+  std::ostringstream os;
+  SELStream stream(fmt);
+
+  stream.start(is, os, {SELFormat::FRU_ALL}, "", "");
+  stream.flush(os);
+  return os.str().empty();
+}
+
+static std::vector<Bench> benches() {
+  float val = 25.0;
+
+  return {
+      {"kv_set_cache", 1,
+       [] { return kvSet(0); }, nullptr,
+       [] { kv_del("lib_bench_key", 0); }},
+      {"kv_get_cache", 1,
+       [] { return kv_get("lib_bench_key", kvValue, nullptr, 0); },
+       [] { kv_set("lib_bench_key", "12345.67", 0, 0); },
+       [] { kv_del("lib_bench_key", 0); }},
+      {"kv_set_persist", 10,
+       [] { return kvSet(KV_FPERSIST); }, nullptr,
+       [] { kv_del("lib_bench_key", KV_FPERSIST); }},
+      {"kv_get_persist", 1,
+       [] { return kv_get("lib_bench_key", kvValue, nullptr, KV_FPERSIST); },
+       [] { kv_set("lib_bench_key", "12345.67", 0, KV_FPERSIST); },
+       [] { kv_del("lib_bench_key", KV_FPERSIST); }},
+      {"ipc_send_req", 1, ipcRoundTrip,
+       [] { ipc_start_svc(BENCH_ENDPOINT, echoHandler, 1, nullptr, nullptr); },
+       nullptr},
+      {"sensor_cache_write", 1,
+       [val]() mutable {
+         val = val < 80 ? val + 0.25 : 25.0;
+         return sensor_cache_write(BENCH_FRU, BENCH_SENSOR, true, val);
+       },
+       nullptr, nullptr},
+      {"sensor_cache_read", 1,
+       [] {
+         float v;
+         return sensor_cache_read(BENCH_FRU, BENCH_SENSOR, &v);
+       },
+       nullptr, nullptr},
+      {"sensor_read_history_1h", 1,
+       [] {
+         float min, avg, max;
+         return sensor_read_history(
+             BENCH_FRU, BENCH_SENSOR, &min, &avg, &max, time(NULL) - 3600);
+       },
+       nullptr, nullptr},
+      {"sensor_read_history_24h", 1,
+       [] {
+         float min, avg, max;
+         return sensor_read_history(
+             BENCH_FRU, BENCH_SENSOR, &min, &avg, &max, time(NULL) - 86400);
+       },
+       nullptr, [] { sensor_clear_history(BENCH_FRU, BENCH_SENSOR); }},
+      {"fruid_parse", 1, fruidParse, writeFruImage,
+       [] { unlink(BENCH_FRU_BIN); }},
+      {"selstream_parse_" + std::to_string(BENCH_SEL_LINES), 50,
+       [] { return selParse(FORMAT_PRINT); }, buildSelLog, nullptr},
+      {"selstream_json_" + std::to_string(BENCH_SEL_LINES), 50,
+       [] { return selParse(FORMAT_JSON); }, buildSelLog, nullptr},
+  };
+}
+
+static void usage(const char* prog) {
+  printf("Usage: %s [-n iterations] [-f filter] [-S] [-o file]\n", prog);
+  printf("  -n  iterations of each benchmark (default %d)\n", DEFAULT_ITERATIONS);
+  printf("  -f  only run benchmarks whose name contains filter\n");
+  printf("  -S  do not count system calls\n");
+  printf("  -o  write the JSON to file instead of stdout\n");
+}
+
+int main(int argc, char** argv) {
+  int iterations = DEFAULT_ITERATIONS;
+  bool syscalls = true;
+  std::string filter, out;
+  struct utsname uts;
+  long marker = -1;
+  json res;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:f:So:h")) != -1) {
+    switch (opt) {
+      case 'n':
+        iterations = atoi(optarg);
+        break;
+      case 'f':
+        filter = optarg;
+        break;
+      case 'S':
+        syscalls = false;
+        break;
+      case 'o':
+        out = optarg;
+        break;
+      default:
+        usage(argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+  if (iterations <= 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  // The stops around the loop cost a few system calls themselves.
+  if (syscalls) {
+    marker = countSyscalls({"", 1, [] { return 0; }, nullptr, nullptr}, 1);
+    if (marker < 0)
+      std::cerr << "Cannot trace, not counting system calls" << std::endl;
+  }
+  // An operation of exactly one system call must count as one.
+  if (marker >= 0) {
+    long count = countSyscalls(
+        {"", 1, [] { return (int)syscall(SYS_getppid) < 0; }, nullptr, nullptr},
+        SYSCALL_ITERATIONS);
+    if (count - marker != SYSCALL_ITERATIONS) {
+      std::cerr << "Counted " << count - marker << " system calls of "
+                << SYSCALL_ITERATIONS << " getppid(), not counting system calls"
+                << std::endl;
+      marker = -1;
+    }
+  }
+
+  uname(&uts);
+  res["version"] = 1;
+  res["time"] = time(NULL);
+  res["kernel"] = uts.release;
+  res["machine"] = uts.machine;
+#ifdef __TEST__
+  res["host"] = true;
+#endif
+  res["benchmarks"] = json::array();
+  for (const auto& b : benches()) {
+    if (!filter.empty() && b.name.find(filter) == std::string::npos)
+      continue;
+    res["benchmarks"].push_back(runBench(b, iterations, marker));
+  }
+
+  if (out.empty()) {
+    std::cout << res.dump(2) << std::endl;
+  } else if (!(std::ofstream(out) << res.dump(2) << std::endl)) {
+    std::cerr << "Cannot write " << out << std::endl;
+    return 1;
+  }
+  return 0;
+}
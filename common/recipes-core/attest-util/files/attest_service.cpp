@@ -0,0 +1,92 @@
+#include "attest_service.hpp"
+#include <future>
+#include "mctp_transport.hpp"
+#include "utils.hpp"
+
+#define RAW_TIMEOUT_MS 6000
+
+shared_ptr<SpdmEngine> AttestService::engine(uint8_t bus) {
+  std::lock_guard<std::mutex> guard(lock_);
+  auto it = engines_.find(bus);
+
+  if (it != engines_.end())
+    return it->second;
+
+  // Not remembered on failure, the next request tries again.
+  auto transport = MctpSmbusTransport::create(bus);
+  if (transport == nullptr)
+    return nullptr;
+  auto eng = std::make_shared<SpdmEngine>(std::move(transport), cache_);
+  engines_[bus] = eng;
+  return eng;
+}
+
+static nlohmann::json resultToJson(uint8_t bus, const AttestResult& res) {
+  nlohmann::json out;
+
+  out["bus"] = bus;
+  out["eid"] = res.eid;
+  out["status"] = res.status;
+  if (res.measurements.empty())
+    return out;
+
+  out["spdmVersion"] =
+      std::to_string(res.version >> 4) + "." + std::to_string(res.version & 0xf);
+  out["vca"] = encodeBase64(res.vca);
+  if (res.certChain) {
+    out["digest"] = encodeBase64(res.digest);
+    out["certChain"] = encodeBase64(*res.certChain);
+    out["certCached"] = res.certCached;
+  }
+  out["measurements"] = encodeBase64(res.measurements);
+  return out;
+}
+
+nlohmann::json AttestService::measure(
+    const vector<AttestTarget>& targets,
+    const AttestOptions& opt) {
+  std::map<uint8_t, vector<uint8_t>> eids;
+  std::map<uint8_t, std::future<vector<AttestResult>>> rounds;
+  std::map<uint8_t, vector<AttestResult>> results;
+  std::map<uint8_t, size_t> next;
+  nlohmann::json out = nlohmann::json::array();
+
+  for (const auto& t : targets)
+    eids[t.bus].push_back(t.eid);
+
+  for (const auto& bus : eids) {
+    auto eng = engine(bus.first);
+    if (eng == nullptr)
+      continue;
+    rounds[bus.first] = std::async(std::launch::async, [eng, &bus, &opt]() {
+      return eng->attest(bus.second, opt);
+    });
+  }
+  for (auto& round : rounds)
+    results[round.first] = round.second.get();
+
+  for (const auto& t : targets) {
+    auto it = results.find(t.bus);
+    if (it == results.end()) {
+      AttestResult res;
+      res.eid = t.eid;
+      res.status = "MCTP binding failed";
+      out.push_back(resultToJson(t.bus, res));
+    } else {
+      out.push_back(resultToJson(t.bus, it->second[next[t.bus]++]));
+    }
+  }
+  return out;
+}
+
+bool AttestService::raw(
+    uint8_t bus,
+    uint8_t eid,
+    const vector<uint8_t>& req,
+    vector<uint8_t>& rsp) {
+  auto eng = engine(bus);
+
+  if (eng == nullptr)
+    return false;
+  return eng->exchange(eid, req, rsp, RAW_TIMEOUT_MS);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include "nlohmann/json.hpp"
+#include "spdm_engine.hpp"
+
+struct AttestTarget {
+  uint8_t bus;
+  uint8_t eid;
+};
+
+/**
+ * One SPDM engine per bus, created on first use and kept open together
+ * with the certificate chain cache. attestd holds one of these for its
+ * lifetime; attest-util builds a short lived one when attestd is not
+ * running.
+ */
+class AttestService {
+ public:
+  /**
+   * Measure all targets. The buses are worked on in parallel and the
+   * endpoints of a bus are interleaved. Returns one JSON object per target,
+   * in the same order.
+   */
+  nlohmann::json measure(
+      const vector<AttestTarget>& targets,
+      const AttestOptions& opt);
+
+  /** Exchange one caller built SPDM message with an endpoint. */
+  bool raw(uint8_t bus, uint8_t eid, const vector<uint8_t>& req,
+           vector<uint8_t>& rsp);
+
+ private:
+  shared_ptr<SpdmEngine> engine(uint8_t bus);
+
+  std::mutex lock_;
+  std::map<uint8_t, shared_ptr<SpdmEngine>> engines_;
+  shared_ptr<CertCache> cache_ = std::make_shared<CertCache>();
+};
@@ -0,0 +1,165 @@
+/*
+ *
+ * Copyright 2021-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * attestd keeps the MCTP bindings and SPDM connections used by attest-util
+ * open, along with the certificate chains the endpoints have sent, so that
+ * attesting the whole platform does not set up a binding and negotiate
+ * again for every message.
+ */
+#include <signal.h>
+#include <string.h>
+#include <syslog.h>
+#include <deque>
+#include <map>
+#include <openbmc/ipc.h>
+#include "attest_service.hpp"
+#include "attestd_ipc.hpp"
+
+#define MAX_REQUESTS 4
+#define MAX_RESULTS 16
+
+static AttestService service;
+
+// Results waiting to be fetched in chunks, the oldest are dropped first.
+static std::mutex resultsLock;
+static std::map<uint32_t, shared_ptr<const vector<uint8_t>>> results;
+static std::deque<uint32_t> resultOrder;
+static uint32_t nextId = 1;
+
+static uint32_t storeResult(shared_ptr<const vector<uint8_t>> data) {
+  std::lock_guard<std::mutex> guard(resultsLock);
+  uint32_t id = nextId++;
+
+  results[id] = std::move(data);
+  resultOrder.push_back(id);
+  if (resultOrder.size() > MAX_RESULTS) {
+    results.erase(resultOrder.front());
+    resultOrder.pop_front();
+  }
+  return id;
+}
+
+static shared_ptr<const vector<uint8_t>> findResult(uint32_t id) {
+  std::lock_guard<std::mutex> guard(resultsLock);
+  auto it = results.find(id);
+  return it == results.end() ? nullptr : it->second;
+}
+
+static int sendResult(
+    client_t* cli,
+    uint8_t status,
+    uint32_t id,
+    const shared_ptr<const vector<uint8_t>>& data,
+    uint32_t offset) {
+  vector<uint8_t> resp(sizeof(attest_resp_hdr));
+  auto hdr = reinterpret_cast<attest_resp_hdr*>(resp.data());
+  size_t len = 0;
+
+  memset(hdr, 0, sizeof(*hdr));
+  hdr->status = status;
+  hdr->id = id;
+  if (data) {
+    hdr->total = data->size();
+    if (offset < data->size())
+      len = std::min<size_t>(data->size() - offset, ATTEST_CHUNK);
+    hdr->len = len;
+    resp.insert(resp.end(), data->begin() + offset,
+                data->begin() + offset + len);
+  }
+  return ipc_send_resp(cli, resp.data(), resp.size());
+}
+
+static int handleMeasure(client_t* cli, const attest_req_hdr* hdr,
+                         const uint8_t* payload, size_t len) {
+  vector<AttestTarget> targets;
+  AttestOptions opt;
+
+  opt.slot = hdr->slot;
+  if (hdr->flags & ATTEST_FLAG_SIGNATURE) {
+    if (len < SPDM_NONCE_LEN)
+      return sendResult(cli, ATTEST_ERR_INVALID, 0, nullptr, 0);
+    opt.signature = true;
+    opt.nonce.assign(payload, payload + SPDM_NONCE_LEN);
+    payload += SPDM_NONCE_LEN;
+    len -= SPDM_NONCE_LEN;
+  }
+  if (len == 0 || len % 2)
+    return sendResult(cli, ATTEST_ERR_INVALID, 0, nullptr, 0);
+  for (size_t i = 0; i < len; i += 2)
+    targets.push_back({payload[i], payload[i + 1]});
+
+  string json = service.measure(targets, opt).dump();
+  auto data = std::make_shared<const vector<uint8_t>>(json.begin(), json.end());
+  return sendResult(cli, ATTEST_OK, storeResult(data), data, 0);
+}
+
+static int handleRaw(client_t* cli, const attest_req_hdr* hdr,
+                     const uint8_t* payload, size_t len) {
+  auto rsp = std::make_shared<vector<uint8_t>>();
+
+  if (len < 2)
+    return sendResult(cli, ATTEST_ERR_INVALID, 0, nullptr, 0);
+  vector<uint8_t> req(payload + 1, payload + len);
+  if (!service.raw(hdr->bus, payload[0], req, *rsp))
+    return sendResult(cli, ATTEST_ERR_FAILED, 0, nullptr, 0);
+  return sendResult(cli, ATTEST_OK, storeResult(rsp), rsp, 0);
+}
+
+static int connHandler(client_t* cli) {
+  vector<uint8_t> req(ATTESTD_MAX_MSG);
+  size_t len = req.size();
+  auto hdr = reinterpret_cast<const attest_req_hdr*>(req.data());
+
+  if (ipc_recv_req(cli, req.data(), &len, 1) || len < sizeof(*hdr))
+    return -1;
+
+  const uint8_t* payload = req.data() + sizeof(*hdr);
+  len -= sizeof(*hdr);
+
+  switch (hdr->cmd) {
+    case ATTEST_CMD_MEASURE:
+      return handleMeasure(cli, hdr, payload, len);
+    case ATTEST_CMD_RAW:
+      return handleRaw(cli, hdr, payload, len);
+    case ATTEST_CMD_FETCH: {
+      auto data = findResult(hdr->id);
+      return sendResult(cli, data ? ATTEST_OK : ATTEST_ERR_EXPIRED, hdr->id,
+                        data, hdr->offset);
+    }
+    default:
+      return sendResult(cli, ATTEST_ERR_INVALID, 0, nullptr, 0);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  pthread_t tid;
+
+  openlog("attestd", LOG_CONS, LOG_DAEMON);
+  signal(SIGPIPE, SIG_IGN);
+
+  if (ipc_start_svc(ATTESTD_ENDPOINT, connHandler, MAX_REQUESTS, nullptr,
+                    &tid)) {
+    syslog(LOG_CRIT, "Cannot start the attestation service");
+    return -1;
+  }
+  syslog(LOG_INFO, "attestd started");
+  pthread_join(tid, nullptr);
+  return 0;
+}
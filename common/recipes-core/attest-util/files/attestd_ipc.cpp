@@ -0,0 +1,33 @@
+#include "attestd_ipc.hpp"
+#include <openbmc/ipc.h>
+
+int attestdRequest(vector<uint8_t>& req, vector<uint8_t>& result) {
+  vector<uint8_t> resp(ATTESTD_MAX_MSG);
+  auto hdr = reinterpret_cast<attest_resp_hdr*>(resp.data());
+  attest_req_hdr fetch = {ATTEST_CMD_FETCH, 0, 0, 0, 0, 0};
+  uint8_t* reqBuf = req.data();
+  size_t reqLen = req.size();
+  size_t len;
+
+  result.clear();
+  do {
+    len = resp.size();
+    if (ipc_send_req(ATTESTD_ENDPOINT, reqBuf, reqLen, resp.data(), &len,
+                     ATTESTD_TIMEOUT) ||
+        len < sizeof(*hdr) || len < sizeof(*hdr) + hdr->len)
+      return -1;
+    if (hdr->status != ATTEST_OK)
+      return hdr->status;
+    if (hdr->len == 0 && result.size() < hdr->total)
+      return ATTEST_ERR_FAILED;
+    result.insert(result.end(), resp.begin() + sizeof(*hdr),
+                  resp.begin() + sizeof(*hdr) + hdr->len);
+
+    fetch.id = hdr->id;
+    fetch.offset = result.size();
+    reqBuf = reinterpret_cast<uint8_t*>(&fetch);
+    reqLen = sizeof(fetch);
+  } while (result.size() < hdr->total);
+
+  return ATTEST_OK;
+}
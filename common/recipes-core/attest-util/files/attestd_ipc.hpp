@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+using std::vector;
+
+/*
+ * Protocol between attest-util and attestd, which keeps the MCTP bindings
+ * and SPDM connections open between requests. Results larger than one IPC
+ * message are read in chunks with ATTEST_CMD_FETCH.
+ */
+#define ATTESTD_ENDPOINT "attestd"
+#define ATTESTD_TIMEOUT 60 // seconds, a round may fetch certificate chains
+#define ATTESTD_MAX_MSG 4096
+
+enum : uint8_t {
+  ATTEST_CMD_MEASURE = 1, // [nonce] {bus, eid}..., result is JSON
+  ATTEST_CMD_RAW,         // eid, SPDM message, result is the response
+  ATTEST_CMD_FETCH,       // next chunk of result id at offset
+};
+
+enum : uint8_t {
+  ATTEST_OK = 0,
+  ATTEST_ERR_INVALID,
+  ATTEST_ERR_EXPIRED,
+  ATTEST_ERR_FAILED,
+};
+
+#define ATTEST_FLAG_SIGNATURE 0x1
+
+struct attest_req_hdr {
+  uint8_t cmd;
+  uint8_t bus;      // ATTEST_CMD_RAW
+  uint8_t flags;    // ATTEST_FLAG_*, ATTEST_CMD_MEASURE
+  uint8_t slot;     // certificate slot, ATTEST_CMD_MEASURE
+  uint32_t id;      // ATTEST_CMD_FETCH
+  uint32_t offset;  // ATTEST_CMD_FETCH
+} __attribute__((packed));
+
+struct attest_resp_hdr {
+  uint8_t status;
+  uint8_t rsvd;
+  uint16_t len;     // bytes of result following the header
+  uint32_t id;
+  uint32_t total;   // size of the whole result
+} __attribute__((packed));
+
+#define ATTEST_CHUNK (ATTESTD_MAX_MSG - sizeof(attest_resp_hdr))
+
+/**
+ * Send a request to attestd and read back the whole result. Returns
+ * ATTEST_OK, one of the ATTEST_ERR_* codes, or -1 if attestd is not
+ * running, in which case callers talk to the endpoint themselves.
+ */
+int attestdRequest(vector<uint8_t>& req, vector<uint8_t>& result);
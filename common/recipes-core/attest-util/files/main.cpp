@@ -20,6 +20,7 @@
 #include <iostream>
 #include <memory>
 #include "CLI/CLI.hpp"
+#include "message_types/measure.hpp"
 #include "message_types/spdm.hpp"
 #include "utils.hpp"
 
@@ -49,6 +50,7 @@ int main(int argc, char* argv[]) {
 
   // Add supported payloads here.
   addNewMessageType<SpdmMessage>(app);
+  addNewMessageType<MeasureMessage>(app);
 
   // This does the actual parsing and calls the callbacks.
   CLI11_PARSE(app, argc, argv);
@@ -0,0 +1,83 @@
+#include "mctp_transport.hpp"
+#include <chrono>
+#include <openbmc/pal.h>
+#include <openbmc/obmc-mctp.h>
+
+#define DEFAULT_EID 0x8
+
+unique_ptr<MctpSmbusTransport> MctpSmbusTransport::create(uint8_t bus) {
+  uint16_t addr = 0;
+  obmc_mctp_binding* binding;
+
+  pal_get_bmc_ipmb_slave_addr(&addr, bus);
+  binding = obmc_mctp_smbus_init(bus, addr, NIC_SLAVE_ADDR, DEFAULT_EID,
+                                 SPDM_MAX_PAYLOAD);
+  if (binding == nullptr)
+    return nullptr;
+  return unique_ptr<MctpSmbusTransport>(new MctpSmbusTransport(binding));
+}
+
+MctpSmbusTransport::MctpSmbusTransport(obmc_mctp_binding* binding)
+    : binding_(binding) {
+  mctp_set_rx_all(binding_->mctp, rxHandler, this);
+}
+
+MctpSmbusTransport::~MctpSmbusTransport() {
+  obmc_mctp_smbus_free(binding_);
+}
+
+void MctpSmbusTransport::rxHandler(
+    uint8_t eid,
+    void* data,
+    void* msg,
+    size_t len,
+    bool tagOwner,
+    uint8_t tag,
+    void* prv) {
+  auto self = static_cast<MctpSmbusTransport*>(data);
+  auto bytes = static_cast<uint8_t*>(msg);
+
+  // Requests from the endpoints are not ours to answer.
+  if (tagOwner)
+    return;
+  self->received_.push_back({eid, tag, vector<uint8_t>(bytes, bytes + len)});
+}
+
+bool MctpSmbusTransport::send(
+    uint8_t eid,
+    uint8_t tag,
+    const uint8_t* msg,
+    size_t len) {
+  return obmc_mctp_smbus_send(binding_, eid, tag | MCTP_HDR_FLAG_TO,
+                              const_cast<uint8_t*>(msg), len) == 0;
+}
+
+bool MctpSmbusTransport::receive(
+    uint8_t& eid,
+    uint8_t& tag,
+    vector<uint8_t>& msg,
+    int timeoutMs) {
+  auto deadline = std::chrono::steady_clock::now() +
+      std::chrono::milliseconds(timeoutMs);
+  auto smbus = static_cast<mctp_binding_smbus*>(binding_->prot);
+
+  while (received_.empty()) {
+    if (mctp_smbus_read(smbus) < 0)
+      return false;
+    if (!received_.empty())
+      break;
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now());
+    if (left.count() <= 0)
+      return false;
+    // Sleeps until the slave queue has a packet.
+    obmc_mctp_smbus_wait(binding_, left.count());
+  }
+
+  Message& next = received_.front();
+  eid = next.eid;
+  tag = next.tag;
+  msg = std::move(next.data);
+  received_.pop_front();
+  return true;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <deque>
+#include "spdm_engine.hpp"
+
+struct obmc_mctp_binding;
+
+/**
+ * SPDM over an MCTP SMBus binding which stays open for the life of the
+ * object, instead of one binding per message as send_spdm_cmd() does.
+ */
+class MctpSmbusTransport : public SpdmTransport {
+ public:
+  static unique_ptr<MctpSmbusTransport> create(uint8_t bus);
+  ~MctpSmbusTransport() override;
+
+  bool send(uint8_t eid, uint8_t tag, const uint8_t* msg, size_t len) override;
+  bool receive(uint8_t& eid, uint8_t& tag, vector<uint8_t>& msg,
+               int timeoutMs) override;
+
+ private:
+  struct Message {
+    uint8_t eid;
+    uint8_t tag;
+    vector<uint8_t> data;
+  };
+
+  explicit MctpSmbusTransport(obmc_mctp_binding* binding);
+  static void rxHandler(uint8_t eid, void* data, void* msg, size_t len,
+                        bool tagOwner, uint8_t tag, void* prv);
+
+  obmc_mctp_binding* binding_;
+  std::deque<Message> received_;
+};
@@ -0,0 +1,93 @@
+#include "measure.hpp"
+#include <iostream>
+#include "attest_service.hpp"
+#include "attestd_ipc.hpp"
+
+CLI::App* MeasureMessage::setupSubcommand(
+    CLI::App& app,
+    shared_ptr<SubcommandOptions> opt) {
+  auto sub = app.add_subcommand(
+      "measure",
+      "Collects the SPDM measurements and certificate chains of several "
+      "devices at once.");
+
+  // Endpoints as EID, or BUS:EID for endpoints which are not on --bus.
+  sub->add_option("-e,--eid", opt->devices, "Endpoint ID, or bus:eid")
+      ->required();
+  sub->add_option("-b,--bus", opt->bus, "Default bus of the endpoints");
+  sub->add_option("-s,--slot", opt->slot, "Certificate slot");
+
+  // Signed measurements are requested when a nonce is given.
+  sub->add_option(
+      "-n,--nonce", opt->nonce, "32 byte nonce encoded as a base64 string");
+
+  sub->add_flag("-v, --verbose", opt->debugOutput, "Enable verbose output");
+
+  return sub;
+}
+
+static bool parseTargets(
+    MeasureMessage::SubcommandOptions const& opt,
+    vector<AttestTarget>& targets) {
+  for (const auto& dev : opt.devices) {
+    unsigned int bus = opt.bus, eid;
+    char extra;
+
+    if (sscanf(dev.c_str(), "%u:%u%c", &bus, &eid, &extra) != 2) {
+      bus = opt.bus;
+      if (sscanf(dev.c_str(), "%u%c", &eid, &extra) != 1)
+        return false;
+    }
+    if (bus > 0xff || eid > 0xff)
+      return false;
+    targets.push_back({(uint8_t)bus, (uint8_t)eid});
+  }
+  return true;
+}
+
+void MeasureMessage::sendMessage(SubcommandOptions const& opt) {
+  nlohmann::json jsonResponse;
+  vector<AttestTarget> targets;
+  AttestOptions attestOpt;
+  vector<uint8_t> result;
+  vector<uint8_t> req;
+
+  jsonResponse["version"] = VERSION;
+  jsonResponse["status"] = "Success";
+
+  if (!parseTargets(opt, targets))
+    throw CLI::ValidationError("--eid", "expected EID or BUS:EID");
+
+  attest_req_hdr hdr = {ATTEST_CMD_MEASURE, 0, 0, opt.slot, 0, 0};
+  attestOpt.slot = opt.slot;
+  if (opt.nonce.length() != 0) {
+    attestOpt.signature = true;
+    attestOpt.nonce = decodeBase64(opt.nonce);
+    if (attestOpt.nonce.size() != SPDM_NONCE_LEN)
+      throw CLI::ValidationError("--nonce", "expected 32 bytes");
+    hdr.flags |= ATTEST_FLAG_SIGNATURE;
+  }
+
+  req.insert(req.end(), (uint8_t*)&hdr, (uint8_t*)&hdr + sizeof(hdr));
+  req.insert(req.end(), attestOpt.nonce.begin(), attestOpt.nonce.end());
+  for (const auto& t : targets) {
+    req.push_back(t.bus);
+    req.push_back(t.eid);
+  }
+
+  int ret = req.size() <= ATTESTD_MAX_MSG ? attestdRequest(req, result) : -1;
+  if (ret == ATTEST_OK) {
+    if (opt.debugOutput == true)
+      std::cout << "Measured through attestd" << std::endl;
+    jsonResponse["endpoints"] =
+        nlohmann::json::parse(result.begin(), result.end(), nullptr, false);
+  } else if (ret < 0) {
+    // Not running, same engine in this process.
+    AttestService service;
+    jsonResponse["endpoints"] = service.measure(targets, attestOpt);
+  } else {
+    jsonResponse["status"] = "attestd error " + std::to_string(ret);
+  }
+
+  std::cout << jsonResponse.dump() << std::endl;
+}
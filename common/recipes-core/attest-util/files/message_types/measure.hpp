@@ -0,0 +1,35 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "CLI/CLI.hpp"
+#include "utils.hpp"
+
+using std::shared_ptr;
+
+class MeasureMessage {
+ public:
+  // Input parameters for measuring a set of endpoints.
+  struct SubcommandOptions {
+    std::vector<std::string> devices;
+    uint8_t bus = 8;
+    uint8_t slot = 0;
+    std::string nonce = "";
+    bool debugOutput = false;
+  };
+
+  /**
+   * Setup the accepted subcommand options for collecting the measurements
+   * of several endpoints in one go.
+   */
+  static CLI::App* setupSubcommand(
+      CLI::App& app,
+      shared_ptr<SubcommandOptions> opt);
+
+  /**
+   * Collects the measurements and certificate chains through attestd, or
+   * directly when attestd is not running.
+   */
+  static void sendMessage(SubcommandOptions const& opt);
+};
@@ -4,9 +4,11 @@
 #include <unordered_map>
 #include <openbmc/pal.h>
 #include <openbmc/obmc-mctp.h>
+#include "attestd_ipc.hpp"
 
 #define DEFAULT_EID 0x8
 #define MAX_PAYLOAD_SIZE 4099 // including Message Header and body
+#define SPDM_BUS 8
 
 /**
  *  These are the supported output types of the responses.
@@ -15,7 +17,7 @@
  *  CLI11 automatically checks to make sure the option passed in
  *  is present in this list and handles the error if it isn't.
  */
-typedef void (*OutputFunctionType)(std::string, std::string);
+typedef void (*OutputFunctionType)(const std::string&, const std::string&);
 static const std::unordered_map<std::string, OutputFunctionType>
     acceptedOutputs = {
         {"raw", handleResponseRaw},
@@ -53,12 +55,37 @@ CLI::App* SpdmMessage::setupSubcommand(
 }
 
 // SPDM payload must start with 0x05 according to spec.
-static bool isPayloadValid(vector<uint8_t> payload) {
+static bool isPayloadValid(const vector<uint8_t>& payload) {
   if (payload.size() == 0 || payload[0] != 0x05)
     return false;
   return true;
 }
 
+/*
+ * Go through attestd when it is running, it already has a binding open
+ * and is the only reader of the bus. Returns false if it is not running.
+ */
+static bool sendThroughAttestd(uint8_t bus, uint8_t eid,
+                               const vector<uint8_t>& message,
+                               vector<uint8_t>& response) {
+  attest_req_hdr hdr = {ATTEST_CMD_RAW, bus, 0, 0, 0, 0};
+  vector<uint8_t> req;
+
+  if (sizeof(hdr) + 1 + message.size() > ATTESTD_MAX_MSG)
+    return false;
+  req.reserve(sizeof(hdr) + 1 + message.size());
+  req.insert(req.end(), (uint8_t*)&hdr, (uint8_t*)&hdr + sizeof(hdr));
+  req.push_back(eid);
+  req.insert(req.end(), message.begin(), message.end());
+
+  int ret = attestdRequest(req, response);
+  if (ret < 0)
+    return false;
+  if (ret != ATTEST_OK)
+    response.clear();
+  return true;
+}
+
 vector<uint8_t> sendSpdmMessage(uint8_t bus, uint8_t eid, vector<uint8_t> &message, bool debugOutput) {
   uint8_t rbuf[MAX_PAYLOAD_SIZE] = {0};
   uint16_t addr = 0;
@@ -93,7 +120,7 @@ void SpdmMessage::sendMessage(SubcommandOptions const& opt) {
   string errorMessage = "";
   string encodedMessage;
   vector<uint8_t> returnMessage;
-
+  size_t headerLen = 3;
 
   if (opt.inputFileName.length() != 0) {
     // Read in file. (Existence already checked)
@@ -122,14 +149,19 @@ void SpdmMessage::sendMessage(SubcommandOptions const& opt) {
     if(opt.debugOutput == true)
       std::cout << "Message is valid SPDM message!" << std::endl;
 
-    // send message over MCTP
-    returnMessage = sendSpdmMessage(8, opt.device, message, opt.debugOutput);
+    if (sendThroughAttestd(SPDM_BUS, opt.device, message, returnMessage)) {
+      if (opt.debugOutput == true)
+        std::cout << "Sent through attestd" << std::endl;
+      headerLen = 0;
+    } else {
+      // send message over MCTP
+      returnMessage = sendSpdmMessage(SPDM_BUS, opt.device, message, opt.debugOutput);
+    }
 
-    if(returnMessage.size() > 0) {
-      // Remove the MCTP header.
-      returnMessage.erase(returnMessage.begin(), returnMessage.begin()+3);
-      // Re-encode response to base64
-      encodedResponse = encodeBase64(returnMessage);
+    if(returnMessage.size() > headerLen) {
+      // Re-encode response to base64, without the MCTP header.
+      encodedResponse = encodeBase64(returnMessage.data() + headerLen,
+                                     returnMessage.size() - headerLen);
       errorMessage = "Success";
     } else {
       errorMessage = "Empty Response";
@@ -0,0 +1,435 @@
+#include "spdm_engine.hpp"
+#include <algorithm>
+#include <cstdio>
+
+#define SPDM_MSG_TYPE 0x05
+#define SPDM_VERSION_10 0x10
+#define SPDM_VERSION_11 0x11
+
+// Request codes, the response code is the request code without bit 7.
+#define SPDM_GET_DIGESTS 0x81
+#define SPDM_GET_CERTIFICATE 0x82
+#define SPDM_GET_VERSION 0x84
+#define SPDM_GET_MEASUREMENTS 0xe0
+#define SPDM_GET_CAPABILITIES 0xe1
+#define SPDM_NEGOTIATE_ALGORITHMS 0xe3
+#define SPDM_ERROR 0x7f
+
+#define SPDM_ERR_BUSY 0x03
+#define SPDM_ERR_UNEXPECTED_REQUEST 0x04
+#define SPDM_ERR_REQUEST_RESYNC 0x43
+
+#define SPDM_CAP_CERT (1 << 1)
+#define SPDM_MEAS_CAP(flags) (((flags) >> 3) & 0x3)
+#define SPDM_MEAS_CAP_SIG 2
+
+// Everything we can take, the endpoint picks one of them.
+#define SPDM_BASE_ASYM_ALGO 0x000001ff
+#define SPDM_BASE_HASH_ALGO 0x0000003f
+
+#define CERT_PORTION 0x400
+#define MAX_RETRIES 2
+#define MAX_BUSY 3
+#define BUSY_BACKOFF std::chrono::milliseconds(100)
+
+using Clock = std::chrono::steady_clock;
+
+enum class Step {
+  Version,
+  Capabilities,
+  Algorithms,
+  Digests,
+  Certificate,
+  Measurements,
+  Done,
+};
+
+struct SpdmEngine::Job {
+  AttestResult* result;
+  Session* session;
+  Step step = Step::Version;
+  vector<uint8_t> request;
+  vector<uint8_t> chain;
+  bool outstanding = false;
+  uint8_t tag = 0;
+  int retries = 0;
+  int busy = 0;
+  int resyncs = 0;
+  Clock::time_point deadline;
+  Clock::time_point notBefore;
+};
+
+static uint16_t get16(const uint8_t* p) {
+  return p[0] | (p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t* p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void put16(vector<uint8_t>& v, uint16_t val) {
+  v.push_back(val & 0xff);
+  v.push_back(val >> 8);
+}
+
+static void put32(vector<uint8_t>& v, uint32_t val) {
+  put16(v, val & 0xffff);
+  put16(v, val >> 16);
+}
+
+static string hexByte(uint8_t val) {
+  char buf[8];
+  snprintf(buf, sizeof(buf), "0x%02x", val);
+  return buf;
+}
+
+// Digest size of the BaseHashSel the endpoint answered with.
+static size_t hashSize(uint32_t baseHash) {
+  if (baseHash & ((1 << 0) | (1 << 3)))   // SHA-256, SHA3-256
+    return 32;
+  if (baseHash & ((1 << 1) | (1 << 4)))   // SHA-384, SHA3-384
+    return 48;
+  if (baseHash & ((1 << 2) | (1 << 5)))   // SHA-512, SHA3-512
+    return 64;
+  return 0;
+}
+
+// Where a round starts for an endpoint we are already connected to.
+static Step connectedStep(uint32_t capFlags) {
+  return (capFlags & SPDM_CAP_CERT) ? Step::Digests : Step::Measurements;
+}
+
+shared_ptr<const vector<uint8_t>> CertCache::find(
+    const vector<uint8_t>& digest) {
+  std::lock_guard<std::mutex> guard(lock_);
+  auto it = chains_.find(digest);
+  return it == chains_.end() ? nullptr : it->second;
+}
+
+void CertCache::insert(
+    const vector<uint8_t>& digest,
+    shared_ptr<const vector<uint8_t>> chain) {
+  std::lock_guard<std::mutex> guard(lock_);
+  if (chains_.find(digest) == chains_.end()) {
+    order_.push_back(digest);
+    if (order_.size() > maxEntries_) {
+      chains_.erase(order_.front());
+      order_.pop_front();
+    }
+  }
+  chains_[digest] = std::move(chain);
+}
+
+size_t CertCache::size() {
+  std::lock_guard<std::mutex> guard(lock_);
+  return chains_.size();
+}
+
+SpdmEngine::SpdmEngine(
+    unique_ptr<SpdmTransport> transport,
+    shared_ptr<CertCache> cache)
+    : transport_(std::move(transport)), cache_(std::move(cache)) {}
+
+void SpdmEngine::reset(uint8_t eid) {
+  std::lock_guard<std::mutex> guard(lock_);
+  sessions_.erase(eid);
+}
+
+void SpdmEngine::fail(Job& job, const string& why) {
+  job.result->status = why;
+  job.step = Step::Done;
+  job.outstanding = false;
+  // We no longer know what state the endpoint is in.
+  *job.session = Session();
+}
+
+void SpdmEngine::buildRequest(Job& job, const AttestOptions& opt) {
+  const Session& s = *job.session;
+  uint8_t ver = s.version ? s.version : SPDM_VERSION_10;
+  vector<uint8_t>& r = job.request;
+
+  switch (job.step) {
+    case Step::Version:
+      r = {SPDM_MSG_TYPE, SPDM_VERSION_10, SPDM_GET_VERSION, 0, 0};
+      break;
+    case Step::Capabilities:
+      r = {SPDM_MSG_TYPE, ver, SPDM_GET_CAPABILITIES, 0, 0};
+      // 1.1 adds CTExponent and the requester flags, we have neither.
+      if (ver >= SPDM_VERSION_11)
+        r.insert(r.end(), 8, 0);
+      break;
+    case Step::Algorithms:
+      r = {SPDM_MSG_TYPE, ver, SPDM_NEGOTIATE_ALGORITHMS, 0, 0};
+      put16(r, 32);  // request length
+      r.push_back(0x01);  // DMTF measurement specification
+      r.push_back(0);
+      put32(r, SPDM_BASE_ASYM_ALGO);
+      put32(r, SPDM_BASE_HASH_ALGO);
+      // Reserved, no extended algorithms.
+      r.insert(r.end(), 16, 0);
+      break;
+    case Step::Digests:
+      r = {SPDM_MSG_TYPE, ver, SPDM_GET_DIGESTS, 0, 0};
+      break;
+    case Step::Certificate:
+      r = {SPDM_MSG_TYPE, ver, SPDM_GET_CERTIFICATE, opt.slot, 0};
+      put16(r, job.chain.size());
+      put16(r, CERT_PORTION);
+      break;
+    case Step::Measurements:
+      if (SPDM_MEAS_CAP(s.capFlags) == 0)
+        return fail(job, "Measurements not supported");
+      if (opt.signature && SPDM_MEAS_CAP(s.capFlags) != SPDM_MEAS_CAP_SIG)
+        return fail(job, "Signed measurements not supported");
+      r = {SPDM_MSG_TYPE, ver, SPDM_GET_MEASUREMENTS,
+           (uint8_t)(opt.signature ? 1 : 0), opt.operation};
+      if (opt.signature) {
+        r.insert(r.end(), opt.nonce.begin(), opt.nonce.end());
+        if (ver >= SPDM_VERSION_11)
+          r.push_back(opt.slot);
+      }
+      break;
+    case Step::Done:
+      break;
+  }
+}
+
+void SpdmEngine::handleResponse(
+    Job& job,
+    const vector<uint8_t>& msg,
+    const AttestOptions& opt) {
+  Session& s = *job.session;
+  AttestResult& res = *job.result;
+
+  if (msg.size() < 5 || msg[0] != SPDM_MSG_TYPE)
+    return fail(job, "Malformed response");
+
+  if (msg[2] == SPDM_ERROR) {
+    uint8_t err = msg[3];
+
+    if (err == SPDM_ERR_BUSY && ++job.busy <= MAX_BUSY) {
+      job.notBefore = Clock::now() + BUSY_BACKOFF;
+      return;
+    }
+    // The endpoint dropped the connection, e.g. because it was reset.
+    // Negotiate again, but only once per round.
+    if ((err == SPDM_ERR_REQUEST_RESYNC ||
+         err == SPDM_ERR_UNEXPECTED_REQUEST) &&
+        job.step > Step::Algorithms && job.resyncs++ == 0) {
+      s = Session();
+      job.chain.clear();
+      job.step = Step::Version;
+      return;
+    }
+    return fail(job, "SPDM error " + hexByte(err));
+  }
+  if (msg[2] != (job.request[2] & 0x7f))
+    return fail(job, "Unexpected response " + hexByte(msg[2]));
+
+  switch (job.step) {
+    case Step::Version: {
+      size_t count = msg.size() >= 7 ? msg[6] : 0;
+      uint8_t best = 0;
+
+      if (msg.size() < 7 + count * 2)
+        return fail(job, "Malformed response");
+      for (size_t i = 0; i < count; i++) {
+        uint8_t v = msg[7 + i * 2 + 1];  // major/minor of the entry
+        if (v == SPDM_VERSION_10 || v == SPDM_VERSION_11)
+          best = std::max(best, v);
+      }
+      if (best == 0)
+        return fail(job, "Unsupported SPDM version");
+      s.version = best;
+      s.vca.assign(job.request.begin() + 1, job.request.end());
+      s.vca.insert(s.vca.end(), msg.begin() + 1, msg.end());
+      job.step = Step::Capabilities;
+      break;
+    }
+    case Step::Capabilities:
+      if (msg.size() < 13)
+        return fail(job, "Malformed response");
+      s.capFlags = get32(&msg[9]);
+      s.vca.insert(s.vca.end(), job.request.begin() + 1, job.request.end());
+      s.vca.insert(s.vca.end(), msg.begin() + 1, msg.end());
+      job.step = Step::Algorithms;
+      break;
+    case Step::Algorithms:
+      if (msg.size() < 21)
+        return fail(job, "Malformed response");
+      s.hashSize = hashSize(get32(&msg[17]));
+      if (s.hashSize == 0)
+        return fail(job, "Unsupported hash algorithm");
+      s.vca.insert(s.vca.end(), job.request.begin() + 1, job.request.end());
+      s.vca.insert(s.vca.end(), msg.begin() + 1, msg.end());
+      s.connected = true;
+      job.step = connectedStep(s.capFlags);
+      break;
+    case Step::Digests: {
+      uint8_t mask = msg[4];
+      size_t index, off;
+
+      if (opt.slot > 7 || !(mask & (1 << opt.slot)))
+        return fail(job, "No certificate in slot " + std::to_string(opt.slot));
+      if (msg.size() < 5 + __builtin_popcount(mask) * s.hashSize)
+        return fail(job, "Malformed response");
+      index = __builtin_popcount(mask & ((1 << opt.slot) - 1));
+      off = 5 + index * s.hashSize;
+      res.digest.assign(msg.begin() + off, msg.begin() + off + s.hashSize);
+      res.certChain = cache_->find(res.digest);
+      if (res.certChain) {
+        res.certCached = true;
+        job.step = Step::Measurements;
+      } else {
+        job.chain.clear();
+        job.step = Step::Certificate;
+      }
+      break;
+    }
+    case Step::Certificate: {
+      size_t portion, remainder;
+
+      if (msg.size() < 9)
+        return fail(job, "Malformed response");
+      portion = get16(&msg[5]);
+      remainder = get16(&msg[7]);
+      if (msg.size() < 9 + portion || (portion == 0 && remainder != 0))
+        return fail(job, "Malformed response");
+      if (job.chain.size() + portion + remainder > SPDM_MAX_CERT_CHAIN)
+        return fail(job, "Certificate chain too large");
+      job.chain.insert(job.chain.end(), msg.begin() + 9,
+                       msg.begin() + 9 + portion);
+      if (remainder == 0) {
+        res.certChain =
+            std::make_shared<const vector<uint8_t>>(std::move(job.chain));
+        cache_->insert(res.digest, res.certChain);
+        job.chain.clear();
+        job.step = Step::Measurements;
+      }
+      break;
+    }
+    case Step::Measurements:
+      res.measurements = msg;
+      res.version = s.version;
+      res.vca = s.vca;
+      job.step = Step::Done;
+      break;
+    case Step::Done:
+      break;
+  }
+}
+
+vector<AttestResult> SpdmEngine::attest(
+    const vector<uint8_t>& eids,
+    const AttestOptions& opt) {
+  std::lock_guard<std::mutex> guard(lock_);
+  vector<AttestResult> results(eids.size());
+  vector<Job> jobs(eids.size());
+  auto timeout = std::chrono::milliseconds(opt.timeoutMs);
+
+  for (size_t i = 0; i < eids.size(); i++) {
+    Job& job = jobs[i];
+
+    results[i].eid = eids[i];
+    job.result = &results[i];
+    if (std::count(eids.begin(), eids.begin() + i, eids[i])) {
+      // Responses are matched by EID, so only one request per endpoint.
+      results[i].status = "Duplicate endpoint";
+      job.step = Step::Done;
+      continue;
+    }
+    job.session = &sessions_[eids[i]];
+    if (opt.signature && opt.nonce.size() != SPDM_NONCE_LEN) {
+      results[i].status = "Invalid nonce";
+      job.step = Step::Done;
+      continue;
+    }
+    job.step = job.session->connected ? connectedStep(job.session->capFlags)
+                                      : Step::Version;
+  }
+
+  while (true) {
+    Clock::time_point now = Clock::now();
+    Clock::time_point wake = now + timeout;
+    bool pending = false;
+    uint8_t eid, tag;
+    vector<uint8_t> msg;
+
+    // Every endpoint without a request in flight gets its next one.
+    for (Job& job : jobs) {
+      if (job.step == Step::Done)
+        continue;
+      if (!job.outstanding && now >= job.notBefore) {
+        buildRequest(job, opt);
+        if (job.step == Step::Done)
+          continue;
+        job.tag = nextTag_;
+        nextTag_ = (nextTag_ + 1) & 0x7;
+        if (!transport_->send(job.result->eid, job.tag, job.request.data(),
+                              job.request.size())) {
+          fail(job, "Send failed");
+          continue;
+        }
+        job.outstanding = true;
+        job.deadline = now + timeout;
+      }
+      pending = true;
+      wake = std::min(wake, job.outstanding ? job.deadline : job.notBefore);
+    }
+    if (!pending)
+      break;
+
+    int waitMs = std::max<int64_t>(0,
+        std::chrono::duration_cast<std::chrono::milliseconds>(wake - now)
+            .count());
+    if (transport_->receive(eid, tag, msg, waitMs)) {
+      for (Job& job : jobs) {
+        if (job.step == Step::Done || job.result->eid != eid)
+          continue;
+        // Anything else is a late answer to a request we gave up on.
+        if (job.outstanding && job.tag == tag) {
+          job.outstanding = false;
+          handleResponse(job, msg, opt);
+        }
+        break;
+      }
+    }
+
+    now = Clock::now();
+    for (Job& job : jobs) {
+      if (job.outstanding && now >= job.deadline) {
+        job.outstanding = false;
+        if (++job.retries > MAX_RETRIES)
+          fail(job, "Timeout");
+      }
+    }
+  }
+  return results;
+}
+
+bool SpdmEngine::exchange(
+    uint8_t eid,
+    const vector<uint8_t>& req,
+    vector<uint8_t>& rsp,
+    int timeoutMs) {
+  std::lock_guard<std::mutex> guard(lock_);
+  Clock::time_point deadline =
+      Clock::now() + std::chrono::milliseconds(timeoutMs);
+  uint8_t tag = nextTag_;
+  uint8_t rxEid, rxTag;
+
+  nextTag_ = (nextTag_ + 1) & 0x7;
+  sessions_.erase(eid);
+  if (!transport_->send(eid, tag, req.data(), req.size()))
+    return false;
+
+  while (true) {
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - Clock::now());
+    if (left.count() < 0 ||
+        !transport_->receive(rxEid, rxTag, rsp, left.count()))
+      return false;
+    if (rxEid == eid && rxTag == tag)
+      return true;
+  }
+}
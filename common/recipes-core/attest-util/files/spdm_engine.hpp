@@ -0,0 +1,130 @@
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using std::shared_ptr;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+#define SPDM_NONCE_LEN 32
+#define SPDM_MAX_CERT_CHAIN (64 * 1024)
+
+/**
+ * Moves SPDM messages to and from the endpoints behind one MCTP binding.
+ * Messages start with the MCTP message type (0x05). Several requests, one
+ * per endpoint, can be outstanding at a time; responses are told apart by
+ * their source EID.
+ */
+class SpdmTransport {
+ public:
+  virtual ~SpdmTransport() = default;
+
+  virtual bool send(uint8_t eid, uint8_t tag, const uint8_t* msg, size_t len) = 0;
+
+  /**
+   * Wait up to timeoutMs for the next response from any endpoint. Returns
+   * false if nothing arrived in time.
+   */
+  virtual bool receive(uint8_t& eid, uint8_t& tag, vector<uint8_t>& msg,
+                       int timeoutMs) = 0;
+};
+
+/**
+ * Certificate chains keyed by the digest the endpoint reports for them in
+ * its DIGESTS response. Endpoints of the same model share chains, and a
+ * chain is only transferred again once its digest changes.
+ */
+class CertCache {
+ public:
+  explicit CertCache(size_t maxEntries = 64) : maxEntries_(maxEntries) {}
+
+  shared_ptr<const vector<uint8_t>> find(const vector<uint8_t>& digest);
+  void insert(const vector<uint8_t>& digest,
+              shared_ptr<const vector<uint8_t>> chain);
+  size_t size();
+
+ private:
+  std::mutex lock_;
+  size_t maxEntries_;
+  std::map<vector<uint8_t>, shared_ptr<const vector<uint8_t>>> chains_;
+  std::deque<vector<uint8_t>> order_;
+};
+
+struct AttestOptions {
+  uint8_t slot = 0;
+  uint8_t operation = 0xff;   // all measurement blocks
+  bool signature = false;     // ask for signed measurements
+  vector<uint8_t> nonce;      // SPDM_NONCE_LEN bytes when signing
+  int timeoutMs = 6000;       // per request
+};
+
+struct AttestResult {
+  uint8_t eid = 0;
+  string status = "Success";
+  uint8_t version = 0;
+  bool certCached = false;
+  // GET_VERSION, GET_CAPABILITIES and NEGOTIATE_ALGORITHMS requests and
+  // responses as they were exchanged, needed to check the signature.
+  vector<uint8_t> vca;
+  vector<uint8_t> digest;
+  shared_ptr<const vector<uint8_t>> certChain;
+  // The MEASUREMENTS response, starting with the MCTP message type.
+  vector<uint8_t> measurements;
+};
+
+/**
+ * Keeps the SPDM connections to the endpoints of one binding. The version,
+ * capabilities and algorithms are negotiated once and reused until the
+ * endpoint asks for a resync or stops answering. Requests to different
+ * endpoints are interleaved, so a round of attestation takes about as long
+ * as the slowest endpoint instead of the sum of all of them.
+ */
+class SpdmEngine {
+ public:
+  SpdmEngine(unique_ptr<SpdmTransport> transport, shared_ptr<CertCache> cache);
+
+  /** Attest all given endpoints at once, results in the same order. */
+  vector<AttestResult> attest(const vector<uint8_t>& eids,
+                              const AttestOptions& opt);
+
+  /**
+   * Send a caller built request and wait for the response. The endpoint
+   * is renegotiated on the next attest() since the request may have
+   * changed its connection state.
+   */
+  bool exchange(uint8_t eid, const vector<uint8_t>& req, vector<uint8_t>& rsp,
+                int timeoutMs);
+
+  /** Forget the negotiated state of an endpoint. */
+  void reset(uint8_t eid);
+
+ private:
+  struct Session {
+    bool connected = false;
+    uint8_t version = 0;
+    uint32_t capFlags = 0;
+    size_t hashSize = 0;
+    vector<uint8_t> vca;
+  };
+
+  struct Job;
+
+  void buildRequest(Job& job, const AttestOptions& opt);
+  void handleResponse(Job& job, const vector<uint8_t>& msg,
+                      const AttestOptions& opt);
+  void fail(Job& job, const string& why);
+
+  std::mutex lock_;
+  unique_ptr<SpdmTransport> transport_;
+  shared_ptr<CertCache> cache_;
+  std::map<uint8_t, Session> sessions_;
+  uint8_t nextTag_ = 0;
+};
@@ -0,0 +1,247 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <deque>
+#include <map>
+#include "spdm_engine.hpp"
+
+using namespace std;
+using namespace testing;
+
+/*
+ * Endpoints which answer every request straight away. Responses are only
+ * handed out when the engine asks for one, so the number of requests in
+ * flight shows whether the endpoints are worked on at the same time.
+ */
+struct FakeEndpoint {
+  uint8_t version = 0x11;
+  uint32_t capFlags = (1 << 1) | (2 << 3); // certificate, signed measurements
+  vector<uint8_t> chain;
+  vector<uint8_t> digest;
+  bool connected = false;
+  bool resyncOnce = false;
+  bool silent = false;
+  map<uint8_t, int> requests;
+};
+
+class FakeTransport : public SpdmTransport {
+ public:
+  explicit FakeTransport(map<uint8_t, FakeEndpoint>* eps) : eps_(eps) {}
+
+  bool send(uint8_t eid, uint8_t tag, const uint8_t* msg, size_t len)
+      override {
+    vector<uint8_t> req(msg, msg + len);
+    auto it = eps_->find(eid);
+
+    EXPECT_EQ(req[0], 0x05);
+    if (it == eps_->end())
+      return true;
+    FakeEndpoint& ep = it->second;
+    ep.requests[req[2]]++;
+    if (ep.silent)
+      return true;
+    queue_.push_back({eid, tag, answer(ep, req)});
+    maxInFlight = max(maxInFlight, queue_.size());
+    return true;
+  }
+
+  bool receive(uint8_t& eid, uint8_t& tag, vector<uint8_t>& msg,
+               int timeoutMs) override {
+    if (queue_.empty())
+      return false;
+    eid = get<0>(queue_.front());
+    tag = get<1>(queue_.front());
+    msg = get<2>(queue_.front());
+    queue_.pop_front();
+    return true;
+  }
+
+  size_t maxInFlight = 0;
+
+ private:
+  vector<uint8_t> error(uint8_t ver, uint8_t code) {
+    return {0x05, ver, 0x7f, code, 0};
+  }
+
+  vector<uint8_t> answer(FakeEndpoint& ep, const vector<uint8_t>& req) {
+    uint8_t code = req[2];
+    vector<uint8_t> rsp = {0x05, req[1], (uint8_t)(code & 0x7f), 0, 0};
+
+    if (code != 0x84 && !ep.connected && code != 0xe1 && code != 0xe3)
+      return error(req[1], 0x04);
+    if (code == 0xe0 && ep.resyncOnce) {
+      ep.resyncOnce = false;
+      ep.connected = false;
+      return error(req[1], 0x43);
+    }
+
+    switch (code) {
+      case 0x84: // GET_VERSION
+        ep.connected = false;
+        rsp.insert(rsp.end(), {0, 2, 0x00, 0x10, 0x00, ep.version});
+        break;
+      case 0xe1: // GET_CAPABILITIES
+        rsp.insert(rsp.end(), {0, 0, 0, 0});
+        for (int i = 0; i < 4; i++)
+          rsp.push_back(ep.capFlags >> (i * 8));
+        break;
+      case 0xe3: // NEGOTIATE_ALGORITHMS, SHA-384
+        rsp.resize(37, 0);
+        rsp[17] = 0x02;
+        ep.connected = true;
+        break;
+      case 0x81: // GET_DIGESTS, slot 0 only
+        rsp[4] = 0x01;
+        rsp.insert(rsp.end(), ep.digest.begin(), ep.digest.end());
+        break;
+      case 0x82: { // GET_CERTIFICATE
+        size_t off = req[5] | (req[6] << 8);
+        size_t len = req[7] | (req[8] << 8);
+        len = min(len, ep.chain.size() - off);
+        size_t rest = ep.chain.size() - off - len;
+        rsp[3] = req[3];
+        rsp.insert(rsp.end(), {(uint8_t)(len & 0xff), (uint8_t)(len >> 8),
+                               (uint8_t)(rest & 0xff), (uint8_t)(rest >> 8)});
+        rsp.insert(rsp.end(), ep.chain.begin() + off,
+                   ep.chain.begin() + off + len);
+        break;
+      }
+      case 0xe0: // GET_MEASUREMENTS
+        rsp.push_back(req[4]);
+        break;
+    }
+    return rsp;
+  }
+
+  map<uint8_t, FakeEndpoint>* eps_;
+  deque<tuple<uint8_t, uint8_t, vector<uint8_t>>> queue_;
+};
+
+class SpdmEngineTest : public ::testing::Test {
+ protected:
+  void SetUp() {
+    for (uint8_t eid = 1; eid <= 3; eid++) {
+      eps[eid].chain.assign(3000, eid);
+      eps[eid].digest.assign(48, eid);
+    }
+    auto t = make_unique<FakeTransport>(&eps);
+    transport = t.get();
+    cache = make_shared<CertCache>();
+    engine = make_unique<SpdmEngine>(move(t), cache);
+    opt.signature = true;
+    opt.nonce.assign(SPDM_NONCE_LEN, 0xa5);
+    opt.timeoutMs = 10;
+  }
+
+  map<uint8_t, FakeEndpoint> eps;
+  FakeTransport* transport;
+  shared_ptr<CertCache> cache;
+  unique_ptr<SpdmEngine> engine;
+  AttestOptions opt;
+};
+
+TEST_F(SpdmEngineTest, Attest_All_Endpoints_Interleaved) {
+  auto results = engine->attest({1, 2, 3}, opt);
+
+  ASSERT_EQ(results.size(), 3u);
+  for (auto& res : results) {
+    EXPECT_EQ(res.status, "Success");
+    EXPECT_EQ(res.version, 0x11);
+    EXPECT_FALSE(res.certCached);
+    ASSERT_TRUE(res.certChain != nullptr);
+    EXPECT_EQ(*res.certChain, eps[res.eid].chain);
+    EXPECT_EQ(res.digest, eps[res.eid].digest);
+    EXPECT_EQ(res.measurements[2], 0x60);
+    // GET_VERSION, GET_CAPABILITIES and NEGOTIATE_ALGORITHMS, both ways.
+    EXPECT_EQ(res.vca[0], 0x10);
+    EXPECT_EQ(res.vca[1], 0x84);
+  }
+  EXPECT_EQ(transport->maxInFlight, 3u);
+  EXPECT_EQ(eps[1].requests[0x82], 3);
+  EXPECT_EQ(cache->size(), 3u);
+}
+
+TEST_F(SpdmEngineTest, Second_Round_Reuses_Session_And_Chain) {
+  engine->attest({1, 2}, opt);
+  auto results = engine->attest({1, 2}, opt);
+
+  for (auto& res : results) {
+    EXPECT_EQ(res.status, "Success");
+    EXPECT_TRUE(res.certCached);
+    EXPECT_EQ(*res.certChain, eps[res.eid].chain);
+    EXPECT_EQ(eps[res.eid].requests[0x84], 1);
+    EXPECT_EQ(eps[res.eid].requests[0x82], 3);
+    EXPECT_EQ(eps[res.eid].requests[0xe0], 2);
+    EXPECT_FALSE(res.vca.empty());
+  }
+}
+
+TEST_F(SpdmEngineTest, Changed_Digest_Fetches_Chain_Again) {
+  engine->attest({1, 2}, opt);
+  eps[2].chain.assign(1500, 0x42);
+  eps[2].digest.assign(48, 0x42);
+  auto results = engine->attest({1, 2}, opt);
+
+  EXPECT_TRUE(results[0].certCached);
+  EXPECT_FALSE(results[1].certCached);
+  EXPECT_EQ(*results[1].certChain, eps[2].chain);
+  EXPECT_EQ(eps[1].requests[0x82], 3);
+  EXPECT_EQ(eps[2].requests[0x82], 5);
+}
+
+TEST_F(SpdmEngineTest, Shared_Chain_Fetched_Once) {
+  eps[2].chain = eps[1].chain;
+  eps[2].digest = eps[1].digest;
+  engine->attest({1}, opt);
+  auto results = engine->attest({2}, opt);
+
+  EXPECT_TRUE(results[0].certCached);
+  EXPECT_EQ(eps[2].requests[0x82], 0);
+}
+
+TEST_F(SpdmEngineTest, Resync_Renegotiates) {
+  engine->attest({1}, opt);
+  eps[1].resyncOnce = true;
+  auto results = engine->attest({1}, opt);
+
+  EXPECT_EQ(results[0].status, "Success");
+  EXPECT_EQ(eps[1].requests[0x84], 2);
+}
+
+TEST_F(SpdmEngineTest, Silent_Endpoint_Does_Not_Hold_Up_Others) {
+  eps[2].silent = true;
+  auto results = engine->attest({1, 2, 3}, opt);
+
+  EXPECT_EQ(results[0].status, "Success");
+  EXPECT_EQ(results[1].status, "Timeout");
+  EXPECT_EQ(results[2].status, "Success");
+  // First try and two retries.
+  EXPECT_EQ(eps[2].requests[0x84], 3);
+}
+
+TEST_F(SpdmEngineTest, Unsigned_Measurements_Without_Signing_Capability) {
+  eps[1].capFlags = (1 << 1) | (1 << 3);
+  auto results = engine->attest({1}, opt);
+  EXPECT_EQ(results[0].status, "Signed measurements not supported");
+
+  opt.signature = false;
+  opt.nonce.clear();
+  results = engine->attest({1}, opt);
+  EXPECT_EQ(results[0].status, "Success");
+}
+
+TEST_F(SpdmEngineTest, Duplicate_Endpoint_Rejected) {
+  auto results = engine->attest({1, 1}, opt);
+
+  EXPECT_EQ(results[0].status, "Success");
+  EXPECT_EQ(results[1].status, "Duplicate endpoint");
+}
+
+TEST_F(SpdmEngineTest, Cache_Evicts_Oldest) {
+  CertCache small(2);
+
+  for (uint8_t i = 0; i < 3; i++)
+    small.insert({i}, make_shared<const vector<uint8_t>>(1, i));
+  EXPECT_EQ(small.size(), 2u);
+  EXPECT_EQ(small.find({0}), nullptr);
+  EXPECT_EQ((*small.find({2}))[0], 2);
+}
@@ -1,15 +1,16 @@
 #include <utils.hpp>
 #include <iostream>
 #include <iomanip>
+#include <array>
 #include "nlohmann/json.hpp"
 
-void handleResponseRaw(string response, string error) {
+void handleResponseRaw(const string& response, const string& error) {
   std::cout << response << std::endl;
   if (error != "Success")
     std::cerr << error << std::endl;
 }
 
-void handleResponseJson(string response, string error) {
+void handleResponseJson(const string& response, const string& error) {
   nlohmann::json jsonResponse;
 
   jsonResponse["version"] = VERSION;
@@ -24,97 +25,78 @@ static const string characterSet =
     "abcdefghijklmnopqrstuvwxyz"
     "0123456789+/";
 
-static inline void decodeChunk(
-    vector<uint8_t>& characters,
-    vector<uint8_t>& decodedBytes,
-    int end) {
-  vector<uint8_t> values(3, 0);
-
-  for (int i = 0; i < (int)characters.size(); ++i)
-    characters[i] = characterSet.find(characters[i]);
-
-  values[0] = (characters[0] << 2) + ((characters[1] & 0x30) >> 4);
-  values[1] = ((characters[1] & 0xf) << 4) + ((characters[2] & 0x3c) >> 2);
-  values[2] = characters[2] = ((characters[2] & 0x3) << 6) + characters[3];
-
-  for (int i = 0; i < end; i++) {
-    decodedBytes.push_back(values[i]);
-  }
-}
-
-vector<uint8_t> decodeBase64(string& encodedString) {
-  vector<uint8_t> characters(4, 0);
+vector<uint8_t> decodeBase64(const string& encodedString) {
+  static const auto values = [] {
+    std::array<uint8_t, 256> table;
+    table.fill(0x3f);
+    for (size_t i = 0; i < characterSet.size(); i++)
+      table[(uint8_t)characterSet[i]] = i;
+    return table;
+  }();
   vector<uint8_t> decodedBytes;
-  int i = 0;
+  uint32_t bits = 0;
+  int count = 0;
 
+  decodedBytes.reserve(encodedString.size() / 4 * 3);
   for (char nextChar : encodedString) {
     if (nextChar == '=')
       break;
 
-    characters[i] = nextChar;
-
-    if (i == 3) {
-      decodeChunk(characters, decodedBytes, i);
-      i = 0;
-    } else {
-      ++i;
+    bits = (bits << 6) | values[(uint8_t)nextChar];
+    if (++count == 4) {
+      decodedBytes.push_back(bits >> 16);
+      decodedBytes.push_back(bits >> 8);
+      decodedBytes.push_back(bits);
+      bits = 0;
+      count = 0;
     }
   }
 
-  if (i) {
-    for (int j = i; j < 4; j++)
-      characters[j] = 0;
-
-    decodeChunk(characters, decodedBytes, i - 1);
+  // Two or three characters left over carry one or two bytes.
+  if (count == 2) {
+    decodedBytes.push_back(bits >> 4);
+  } else if (count == 3) {
+    decodedBytes.push_back(bits >> 10);
+    decodedBytes.push_back(bits >> 2);
   }
 
   return decodedBytes;
 }
 
-static inline string accumulateBytes(const vector<uint8_t>& temp, int end) {
-  vector<uint8_t> accumulator(4, 0);
-  string encoded;
-
-  accumulator[0] = (temp[0] & 0xfc) >> 2;
-  accumulator[1] = ((temp[0] & 0x03) << 4) + ((temp[1] & 0xf0) >> 4);
-  accumulator[2] = ((temp[1] & 0x0f) << 2) + ((temp[2] & 0xc0) >> 6);
-  accumulator[3] = temp[2] & 0x3f;
-
-  for (int i = 0; i < end; ++i)
-    encoded += characterSet[accumulator[i]];
-
-  return encoded;
-}
-
-string encodeBase64(vector<uint8_t>& bytes) {
+string encodeBase64(const uint8_t* bytes, size_t len) {
   string encodedBytes;
-  int i = 0;
-  vector<uint8_t> temp(3, 0);
+  uint32_t bits;
+  size_t i;
 
-  // Handle 24 bits at a time
-  for (uint8_t nextByte : bytes) {
-    temp[i++] = nextByte;
+  encodedBytes.reserve((len + 2) / 3 * 4);
 
-    if (i == 3) {
-      encodedBytes += accumulateBytes(temp, 4);
-      i = 0;
-    }
+  // Handle 24 bits at a time
+  for (i = 0; i + 3 <= len; i += 3) {
+    bits = (bytes[i] << 16) | (bytes[i + 1] << 8) | bytes[i + 2];
+    encodedBytes += characterSet[bits >> 18];
+    encodedBytes += characterSet[(bits >> 12) & 0x3f];
+    encodedBytes += characterSet[(bits >> 6) & 0x3f];
+    encodedBytes += characterSet[bits & 0x3f];
   }
 
   // Handle the case that the number of input bits is not divisible by 24
-  if (i != 0) {
-    for (int j = i; j < (int)temp.size(); j++)
-      temp[j] = '\0';
-
-    encodedBytes += accumulateBytes(temp, i + 1);
-
-    for (; i < (int)temp.size(); ++i)
-      encodedBytes += '=';
+  if (i < len) {
+    bits = bytes[i] << 16;
+    if (i + 1 < len)
+      bits |= bytes[i + 1] << 8;
+    encodedBytes += characterSet[bits >> 18];
+    encodedBytes += characterSet[(bits >> 12) & 0x3f];
+    encodedBytes += i + 1 < len ? characterSet[(bits >> 6) & 0x3f] : '=';
+    encodedBytes += '=';
   }
 
   return encodedBytes;
 }
 
+string encodeBase64(const vector<uint8_t>& bytes) {
+  return encodeBase64(bytes.data(), bytes.size());
+}
+
 
 void printHexValues(uint8_t *values, int size) {
   for(int index = 0; index < size; ++index) {
@@ -23,9 +23,16 @@
 #include <unistd.h>
 #include <stdint.h>
 #include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <thread>
+#include <vector>
 #include <jansson.h>
 #include <openbmc/kv.h>
 #include <openbmc/ipmi.h>
+#include <openbmc/pal.h>
+#include <openbmc/inventory.h>
 #include "dimm-util.h"
 
 // #define DEBUG_DIMM_UTIL
@@ -85,6 +92,31 @@ int fru_id_all = 0;
 int fru_id_min = 0;
 int fru_id_max = 0;
 
+// SPD contents of one DIMM. The same layout is kept in SPD_CACHE_DIR
+// so that later invocations do not go over the SPD bus again.
+#define SPD_CACHE_MAGIC 0x31445053  // "SPD1"
+struct dimm_spd {
+  uint32_t magic;
+  uint8_t  serial[LEN_SERIAL];
+  uint8_t  valid[SPD_PAGES][SPD_PAGE_SIZE];
+  uint8_t  data[SPD_PAGES][SPD_PAGE_SIZE];
+};
+
+// part of the SPD needed by a command
+struct spd_region {
+  uint8_t  page;
+  uint8_t  offset;
+  uint16_t len;
+};
+
+static struct dimm_spd spd_info[MAX_CPU_NUM][MAX_DIMM_PER_CPU];
+static uint8_t spd_present[MAX_CPU_NUM][MAX_DIMM_PER_CPU];
+
+// cleared once block reads turn out not to work on this platform,
+// shared by the per-CPU reader threads
+static std::atomic<bool> spd_block_read(true);
+static bool use_cache = false;
+
 static
 const char * dimm_type_string(uint8_t id)
 {
@@ -128,6 +160,16 @@ util_read_spd_byte(uint8_t fru_id, uint8_t cpu, uint8_t dimm, uint8_t offset)
   return -1;
 }
 
+// read up to SPD_BLOCK_MAX bytes off SPD bus in one transaction,
+// input:  fru_id/cpu/dimm/offset/len
+// returns ERR_NOT_SUPPORTED if the platform can only read single bytes
+int __attribute__((weak))
+util_read_spd_block(uint8_t fru_id, uint8_t cpu, uint8_t dimm, uint8_t offset,
+                    uint8_t len, uint8_t *buf)
+{
+  return ERR_NOT_SUPPORTED;
+}
+
 // allows each platform to populate cpu num, dimm num, num frus
 int __attribute__((weak))
 plat_init()
@@ -152,43 +194,186 @@ get_dimm_label(uint8_t cpu, uint8_t dimm)
 //            0 to disable this check
 //
 // output returned in buf
+// if valid is not NULL, valid[i] is set to 1 for each byte actually read
 // also returns a special flag  "present"
 //         1 - if buf contains non zero
 //         0 - if all data in buf are 0
+//
+// data is read SPD_BLOCK_MAX bytes at a time when the platform provides
+// util_read_spd_block(), and byte by byte otherwise
 static int
 util_read_spd_with_retry(uint8_t fru_id, uint8_t cpu, uint8_t dimm, uint16_t offset, uint16_t len,
-                  uint16_t early_exit_cnt, uint8_t *buf, uint8_t *present) {
-  uint16_t j, fail_cnt = 0;
+                  uint16_t early_exit_cnt, uint8_t *buf, uint8_t *valid,
+                  uint8_t *present) {
+  uint16_t j, k, n, fail_cnt = 0;
   uint8_t retry = 0;
+  uint8_t chunk_present;
   int value = 0;
+  int ret = -1;
 
   *present = 0;
-  for (j = 0; j < len; ++j) {
-    retry = 0;
-    while (retry < MAX_RETRY) {
-      value = util_read_spd_byte(fru_id, cpu, dimm, offset + j);
-      if (value >= 0)
-        break;
-      retry++;
+  for (j = 0; j < len; j += n) {
+    n = (len - j) < SPD_BLOCK_MAX ? (len - j) : SPD_BLOCK_MAX;
+    if (spd_block_read) {
+      for (retry = 0; retry < MAX_RETRY; retry++) {
+        ret = util_read_spd_block(fru_id, cpu, dimm, offset + j, n, buf + j);
+        if (ret == 0 || ret == ERR_NOT_SUPPORTED)
+          break;
+      }
+      if (ret == 0) {
+        if (valid)
+          memset(valid + j, 1, n);
+        *present = 1;
+        continue;
+      }
+      if (ret == ERR_NOT_SUPPORTED)
+        spd_block_read = false;
     }
-    if (value >= 0) {
-      buf[j] = value;
-      *present = 1;
-    } else {
-      // only consider early exit if it's non-0
-      if (early_exit_cnt) {
-        fail_cnt ++;
-        if (fail_cnt == early_exit_cnt) {
-          *present = 0;
-          return -1;
+
+    chunk_present = 0;
+    for (k = j; k < j + n; ++k) {
+      retry = 0;
+      while (retry < MAX_RETRY) {
+        value = util_read_spd_byte(fru_id, cpu, dimm, offset + k);
+        if (value >= 0)
+          break;
+        retry++;
+      }
+      if (value >= 0) {
+        buf[k] = value;
+        if (valid)
+          valid[k] = 1;
+        *present = 1;
+        chunk_present = 1;
+      } else {
+        // only consider early exit if it's non-0
+        if (early_exit_cnt) {
+          fail_cnt ++;
+          if (fail_cnt == early_exit_cnt) {
+            *present = 0;
+            return -1;
+          }
         }
       }
     }
+    // the DIMM answers single byte reads but not block reads, so stop
+    // wasting transactions on the latter
+    if (chunk_present && spd_block_read)
+      spd_block_read = false;
   }
 
   return 0;
 }
 
+static void
+spd_cache_path(char *path, size_t len, uint8_t fru_id, uint8_t cpu, uint8_t dimm) {
+  snprintf(path, len, SPD_CACHE_DIR "/fru%d_cpu%d_dimm%d", fru_id, cpu, dimm);
+}
+
+static bool
+spd_cache_load(uint8_t fru_id, uint8_t cpu, uint8_t dimm, struct dimm_spd *spd) {
+  char path[128];
+  FILE *fp;
+  bool ok;
+
+  spd_cache_path(path, sizeof(path), fru_id, cpu, dimm);
+  fp = fopen(path, "rb");
+  if (fp == NULL)
+    return false;
+  ok = fread(spd, sizeof(*spd), 1, fp) == 1 && spd->magic == SPD_CACHE_MAGIC;
+  fclose(fp);
+  return ok;
+}
+
+static void
+spd_cache_store(uint8_t fru_id, uint8_t cpu, uint8_t dimm, const struct dimm_spd *spd) {
+  char path[128], tmp[136];
+  FILE *fp;
+
+  if (mkdir("/tmp/cache_store", 0755) != 0 && errno != EEXIST)
+    return;
+  if (mkdir(SPD_CACHE_DIR, 0755) != 0 && errno != EEXIST)
+    return;
+  spd_cache_path(path, sizeof(path), fru_id, cpu, dimm);
+  snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+  fp = fopen(tmp, "wb");
+  if (fp == NULL)
+    return;
+  if (fwrite(spd, sizeof(*spd), 1, fp) != 1) {
+    fclose(fp);
+    remove(tmp);
+    return;
+  }
+  fclose(fp);
+  rename(tmp, path);
+}
+
+static void
+spd_cache_remove(uint8_t fru_id, uint8_t cpu, uint8_t dimm) {
+  char path[128];
+
+  spd_cache_path(path, sizeof(path), fru_id, cpu, dimm);
+  remove(path);
+}
+
+// fill spd with the requested regions of one DIMM
+//
+// The serial number is always read from the DIMM. It tells whether the
+// slot is populated, and cached contents are only used if they were
+// taken from a DIMM with the same serial number. Everything else comes
+// from the cache when possible, so that repeated queries cost a single
+// short read per DIMM.
+static void
+read_dimm_spd(uint8_t fru_id, uint8_t cpu, uint8_t dimm,
+              const struct spd_region *regions, size_t num_regions,
+              struct dimm_spd *spd, uint8_t *present) {
+  uint8_t serial[LEN_SERIAL] = {0};
+  uint8_t region_present = 0;
+  bool dirty = false;
+  int page = 1;
+  size_t r;
+
+  util_set_EE_page(fru_id, cpu, dimm, 1);
+  util_read_spd_with_retry(fru_id, cpu, dimm, OFFSET_SERIAL, LEN_SERIAL,
+    LEN_SERIAL, serial, NULL, present);
+  if (!*present) {
+    memset(spd, 0, sizeof(*spd));
+    spd_cache_remove(fru_id, cpu, dimm);
+    return;
+  }
+
+  if (!spd_cache_load(fru_id, cpu, dimm, spd) ||
+      memcmp(spd->serial, serial, LEN_SERIAL) != 0) {
+    memset(spd, 0, sizeof(*spd));
+    spd->magic = SPD_CACHE_MAGIC;
+    memcpy(spd->serial, serial, LEN_SERIAL);
+    memcpy(&spd->data[1][OFFSET_SERIAL], serial, LEN_SERIAL);
+    memset(&spd->valid[1][OFFSET_SERIAL], 1, LEN_SERIAL);
+    dirty = true;
+  }
+
+  // only the bytes that were actually read are marked valid, so a
+  // partially read region is completed on the next run
+  for (r = 0; r < num_regions; r++) {
+    const struct spd_region *reg = &regions[r];
+
+    if (memchr(&spd->valid[reg->page][reg->offset], 0, reg->len) == NULL)
+      continue;
+    if (page != reg->page) {
+      util_set_EE_page(fru_id, cpu, dimm, reg->page);
+      page = reg->page;
+    }
+    util_read_spd_with_retry(fru_id, cpu, dimm, reg->offset, reg->len, 0,
+      &spd->data[reg->page][reg->offset], &spd->valid[reg->page][reg->offset],
+      &region_present);
+    if (region_present)
+      dirty = true;
+  }
+
+  if (dirty)
+    spd_cache_store(fru_id, cpu, dimm, spd);
+}
+
 
 // convert system dimm number to  (cpu, dimm) pair
 //     eg.   on a 2-socket system with 24 dimms (0-23)
@@ -218,10 +403,40 @@ set_dimm_loop(uint8_t dimm, uint8_t *startCPU, uint8_t *endCPU,
               dimm, *startCPU, *endCPU, *startDimm, *endDimm);
 }
 
+// read the given SPD regions of all selected DIMMs into spd_info
+//
+// DIMMs of one CPU share the SMBus segment and the EEPROM page select,
+// so they are read one after another, but the CPUs are read in parallel.
+static void
+read_spd_all(uint8_t fru_id, uint8_t dimm, const struct spd_region *regions,
+             size_t num_regions) {
+  uint8_t startCPU, endCPU, startDimm, endDimm;
+  std::vector<std::thread> threads;
+
+  set_dimm_loop(dimm, &startCPU, &endCPU, &startDimm, &endDimm);
+  auto read_cpu = [=](uint8_t cpu) {
+    for (uint8_t i = startDimm; i < endDimm; ++i) {
+      read_dimm_spd(fru_id, cpu, i, regions, num_regions,
+        &spd_info[cpu][i], &spd_present[cpu][i]);
+    }
+  };
+
+  if (endCPU - startCPU == 1) {
+    read_cpu(startCPU);
+    return;
+  }
+  for (uint8_t cpu = startCPU; cpu < endCPU; cpu++) {
+    threads.emplace_back(read_cpu, cpu);
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+}
+
 static int
 util_get_serial(uint8_t fru_id, uint8_t dimm, bool json) {
   uint8_t i, j, cpu, startCPU, endCPU, startDimm, endDimm, dimm_present = 0;
-  uint8_t dimm_serial[MAX_CPU_NUM][MAX_DIMM_PER_CPU][LEN_SERIAL] = {0};
+  uint8_t *dimm_serial;
   json_t *config_arr = NULL;
   char   sn[LEN_SERIAL_STRING] = {0};
 
@@ -233,16 +448,16 @@ util_get_serial(uint8_t fru_id, uint8_t dimm, bool json) {
     printf("FRU: %s\n", fru_name[fru_id - 1]);
   }
 
+  read_spd_all(fru_id, dimm, NULL, 0);
   set_dimm_loop(dimm, &startCPU, &endCPU, &startDimm, &endDimm);
   for (cpu = startCPU; cpu < endCPU; cpu++) {
     for (i = startDimm; i < endDimm; ++i) {
-      util_set_EE_page(fru_id, cpu, i, 1);
-      util_read_spd_with_retry(fru_id, cpu, i, OFFSET_SERIAL, LEN_SERIAL, 0,
-        dimm_serial[cpu][i], &dimm_present);
+      dimm_present = spd_present[cpu][i];
+      dimm_serial = &spd_info[cpu][i].data[1][OFFSET_SERIAL];
 
       if (dimm_present)
           for (j = 0; j < LEN_SERIAL; ++j)
-            snprintf(sn + (2 * j), LEN_SERIAL_STRING - (2 * j), "%02X", dimm_serial[cpu][i][j]);
+            snprintf(sn + (2 * j), LEN_SERIAL_STRING - (2 * j), "%02X", dimm_serial[j]);
 
       if (json) {
         json_t *sn_obj = json_object();
@@ -285,8 +500,11 @@ err_exit:
 
 static int
 util_get_part(uint8_t fru_id, uint8_t dimm, bool json) {
+  static const struct spd_region regions[] = {
+    {1, OFFSET_PART_NUMBER, LEN_PART_NUMBER},
+  };
   uint8_t i, j, cpu, startCPU, endCPU, startDimm, endDimm, dimm_present = 0;
-  uint8_t dimm_part[MAX_CPU_NUM][MAX_DIMM_PER_CPU][LEN_PART_NUMBER] = {0};
+  uint8_t *dimm_part;
   json_t *config_arr = NULL;
   char   pn[LEN_PN_STRING] = {0};
 
@@ -298,16 +516,16 @@ util_get_part(uint8_t fru_id, uint8_t dimm, bool json) {
     printf("FRU: %s\n", fru_name[fru_id - 1]);
   }
 
+  read_spd_all(fru_id, dimm, regions, ARRAY_SIZE(regions));
   set_dimm_loop(dimm, &startCPU, &endCPU, &startDimm, &endDimm);
   for (cpu = startCPU; cpu < endCPU; cpu++) {
     for (i = startDimm; i < endDimm; ++i) {
-      util_set_EE_page(fru_id, cpu, i, 1);
-      util_read_spd_with_retry(fru_id, cpu, i, OFFSET_PART_NUMBER, LEN_PART_NUMBER,
-        MAX_FAIL_CNT, dimm_part[cpu][i], &dimm_present);
+      dimm_present = spd_present[cpu][i];
+      dimm_part = &spd_info[cpu][i].data[1][OFFSET_PART_NUMBER];
 
       if (dimm_present)
           for (j = 0; j < LEN_PART_NUMBER; ++j)
-            snprintf(pn + j, LEN_PN_STRING - j, "%c", dimm_part[cpu][i][j]);
+            snprintf(pn + j, LEN_PN_STRING - j, "%c", dimm_part[j]);
 
       if (json) {
         json_t *part_obj = json_object();
@@ -350,21 +568,23 @@ err_exit:
 
 static int
 util_get_raw_dump(uint8_t fru_id, uint8_t dimm, bool json) {
-  uint8_t i, page, cpu, startCPU, endCPU, startDimm, endDimm, dimm_present = 0;
+  static const struct spd_region regions[] = {
+    {0, DEFAULT_DUMP_OFFSET, DEFAULT_DUMP_LEN},
+    {1, DEFAULT_DUMP_OFFSET, DEFAULT_DUMP_LEN},
+  };
+  uint8_t i, page, cpu, startCPU, endCPU, startDimm, endDimm;
   uint16_t j = 0;
   uint16_t offset = DEFAULT_DUMP_OFFSET;
-  uint8_t buf[DEFAULT_DUMP_LEN] = {0};
+  uint8_t *buf;
 
   printf("Fru: %s\n", fru_name[fru_id - 1]);
+  read_spd_all(fru_id, dimm, regions, ARRAY_SIZE(regions));
   set_dimm_loop(dimm, &startCPU, &endCPU, &startDimm, &endDimm);
   for (cpu = startCPU; cpu < endCPU; cpu++) {
     for (i = startDimm; i < endDimm; ++i) {
       printf("DIMM %s \n", get_dimm_label(cpu,i));
       for (page = 0; page < 2; page++) {
-        memset(buf, 0, DEFAULT_DUMP_LEN);
-        util_set_EE_page(fru_id, cpu, i, page);
-        util_read_spd_with_retry(fru_id, cpu, i, DEFAULT_DUMP_OFFSET, DEFAULT_DUMP_LEN,
-          0, buf, &dimm_present);
+        buf = &spd_info[cpu][i].data[page][DEFAULT_DUMP_OFFSET];
         printf("%03x: ", offset + (page * 0x100));
         for (j = 0; j < DEFAULT_DUMP_LEN; ++j) {
           printf("%02x ", buf[j]);
@@ -482,8 +702,12 @@ util_get_config(uint8_t fru_id, uint8_t dimm, bool json) {
 #define SERIAL_OFFSET 5
 #define PN_OFFSET 9
 #define BUF_SIZE 64
+  static const struct spd_region regions[] = {
+    {0, P0_OFFSET, P0_LEN},
+    {1, P1_OFFSET, P1_LEN},
+  };
   uint8_t i, j, cpu, startCPU, endCPU, startDimm, endDimm, dimm_present = 0;
-  uint8_t buf[BUF_SIZE] = {0};
+  uint8_t *buf;
   json_t *config_arr = NULL;
   char   pn[LEN_PN_STRING] = {0};
   char   sn[LEN_SERIAL_STRING] = {0};
@@ -501,33 +725,29 @@ util_get_config(uint8_t fru_id, uint8_t dimm, bool json) {
     printf("FRU: %s\n", fru_name[fru_id - 1]);
   }
 
+  read_spd_all(fru_id, dimm, regions, ARRAY_SIZE(regions));
   set_dimm_loop(dimm, &startCPU, &endCPU, &startDimm, &endDimm);
   for (cpu = startCPU; cpu < endCPU; cpu++) {
     for (i = startDimm; i < endDimm; ++i) {
-      util_set_EE_page(fru_id, cpu, i, 0);
-      // read page 0 to get type, speed, capacity
-      memset(buf, 0, BUF_SIZE);
-      util_read_spd_with_retry(fru_id, cpu, i, P0_OFFSET, P0_LEN, 0, buf, &dimm_present);
+      dimm_present = spd_present[cpu][i];
       if (dimm_present) {
+        // page 0 has type, speed, capacity
+        buf = &spd_info[cpu][i].data[0][P0_OFFSET];
         dimm_type = buf[TYPE_OFFSET];
         mincycle  = buf[MIN_CYCLE_TIME_OFFSET];
         util_get_size(size, BUF_SIZE, buf);
 
-        // read page 1 to get pn, sn, manufacturer, manufacturer week
-        util_set_EE_page(fru_id, cpu, i, 1);
-        memset(buf, 0, BUF_SIZE);
-        util_read_spd_with_retry(fru_id, cpu, i, P1_OFFSET, P1_LEN, 0, buf, &dimm_present);
-        if (dimm_present) {
-            for (j = 0; j < LEN_PART_NUMBER; ++j) {
-              snprintf(pn + j, LEN_PN_STRING - j, "%c", buf[PN_OFFSET + j]);
-            }
-            for (j = 0; j < LEN_SERIAL; ++j) {
-              snprintf(sn + (2 * j), LEN_SERIAL_STRING - (2 * j), "%02X", buf[SERIAL_OFFSET + j]);
-            }
-            snprintf(manu, BUF_SIZE, "%s", manu_string(buf[MANUFACTURER_OFFSET]));
-            snprintf(week, BUF_SIZE, "20%02x Week%02x",
-                      buf[DATE_OFFSET], buf[DATE_OFFSET + 1]);
+        // page 1 has pn, sn, manufacturer, manufacturer week
+        buf = &spd_info[cpu][i].data[1][P1_OFFSET];
+        for (j = 0; j < LEN_PART_NUMBER; ++j) {
+          snprintf(pn + j, LEN_PN_STRING - j, "%c", buf[PN_OFFSET + j]);
+        }
+        for (j = 0; j < LEN_SERIAL; ++j) {
+          snprintf(sn + (2 * j), LEN_SERIAL_STRING - (2 * j), "%02X", buf[SERIAL_OFFSET + j]);
         }
+        snprintf(manu, BUF_SIZE, "%s", manu_string(buf[MANUFACTURER_OFFSET]));
+        snprintf(week, BUF_SIZE, "20%02x Week%02x",
+                  buf[DATE_OFFSET], buf[DATE_OFFSET + 1]);
       }
 
      if (json) {
@@ -583,6 +803,39 @@ err_exit:
   return -1;
 }
 
+// Print the --config output of all DIMMs kept by inventoryd
+static int
+print_cached_config(uint8_t fru_id, bool json) {
+  inv_record_t rec;
+  uint8_t fru;
+  char *str;
+  int i;
+
+  if (pal_get_fru_id((char *)fru_name[fru_id - 1], &fru)) {
+    return -1;
+  }
+  if (json) {
+    if (inventory_get_json(fru, INV_DIMM, &str)) {
+      return -1;
+    }
+    printf("%s\n", str);
+    free(str);
+    return 0;
+  }
+  if (inventory_get(fru, INV_DIMM, &rec)) {
+    return -1;
+  }
+  for (i = 0; i < rec.count; i++) {
+    if (rec.entries[i].value) {
+      printf("%s: %s\n", rec.entries[i].key, rec.entries[i].value);
+    } else {
+      printf("%s\n", rec.entries[i].key);
+    }
+  }
+  inventory_free(&rec);
+  return 0;
+}
+
 static int parse_dimm_label(char *label, uint8_t *dimmNum)
 {
   // dimm label to dimm number look up
@@ -678,6 +931,11 @@ parse_arg_and_exec(int argc, char **argv, uint8_t fru_id,
   }
 
   for (i = fru_start; i < fru_end; ++i) {
+    // Fall back to reading the SPDs when inventoryd has nothing
+    if (use_cache && pF == &util_get_config && dimm == total_dimms &&
+        print_cached_config(i, json) == 0) {
+      continue;
+    }
     if (force == false) {
       ret = util_check_me_status(i);
       if (ret == 0) {
@@ -726,6 +984,7 @@ print_usage_help(void) {
         printf("%2s, ", get_dimm_label(i, j));
   printf("   --json    - output in JSON format\n");
   printf("   --force   - skips ME status check\n");
+  printf("   --cached  - print the --config data kept by inventoryd\n");
 }
 
 static int
@@ -761,6 +1020,18 @@ main(int argc, char **argv) {
     return ret;
   }
 
+  // --cached may come anywhere, take it out before parsing the options
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--cached")) {
+      use_cache = true;
+      for (int j = i; j < argc; j++) {
+        argv[j] = argv[j + 1];
+      }
+      argc--;
+      break;
+    }
+  }
+
   if (argc < 3)
     goto err_exit;
 
@@ -37,6 +37,12 @@
 #define MAX_FAIL_CNT LEN_SERIAL
 
 #define ERR_INVALID_SYNTAX -2
+#define ERR_NOT_SUPPORTED  -3
+
+#define SPD_PAGES       2
+#define SPD_PAGE_SIZE   0x100
+#define SPD_BLOCK_MAX   16  // max bytes per util_read_spd_block() call
+#define SPD_CACHE_DIR   "/tmp/cache_store/dimm_spd"
 
 #define INTEL_ID_LEN  3
 #define MANU_INTEL_0  0x57
@@ -76,6 +82,8 @@ int get_package_rank(uint8_t data);
 int util_check_me_status(uint8_t fru_id);
 int util_set_EE_page(uint8_t fru_id, uint8_t cpu, uint8_t dimm, uint8_t page_num);
 int util_read_spd_byte(uint8_t fru_id, uint8_t cpu, uint8_t dimm, uint8_t offset);
+int util_read_spd_block(uint8_t fru_id, uint8_t cpu, uint8_t dimm, uint8_t offset,
+                        uint8_t len, uint8_t *buf);
 int plat_init();
 const char * get_dimm_label(uint8_t cpu, uint8_t dimm);
 
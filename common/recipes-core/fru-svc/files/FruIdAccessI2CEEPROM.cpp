@@ -21,6 +21,7 @@
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <stdlib.h>
 #include <glog/logging.h>
 #include <openbmc/fruid.h>
@@ -42,82 +43,64 @@ std::vector<std::pair<std::string, std::string>> FruIdAccessI2CEEPROM::getFruIdI
 
     if (size >= FRUID_SIZE) {
       unsigned char fruIdData[FRUID_SIZE] = {0};
-      fruid_info_t fruid;
+      // The view keeps all strings in its own arena, nothing to free
+      std::unique_ptr<fruid_view_t> fruid(new fruid_view_t);
+      auto addField = [&fruIdInfoList](const std::string &name,
+                                       const fruid_field_t &field) {
+        if (field.str != nullptr) {
+          fruIdInfoList.push_back({name, std::string(field.str)});
+        }
+      };
+      auto addCustom = [&addField](const std::string &area,
+                                   const fruid_field_t *custom) {
+        for (int i = 0; i < 4; i++) {
+          addField(area + " Custom Data " + std::to_string(i + 1), custom[i]);
+        }
+      };
 
       //Get binary data from eepromFile
       eepromFile.seekg (0, std::ios::beg);
       eepromFile.read ((char*)fruIdData, FRUID_SIZE);
 
       // parse fruId from eepromFile dump
-      fruid_parse_eeprom(fruIdData, FRUID_SIZE, &fruid);
-
-      //decode struct fruid and stored it in map
-      if (fruid.chassis.flag == 1) {
-        fruIdInfoList.push_back({"Chassis Type", std::string(fruid.chassis.type_str)});
-        fruIdInfoList.push_back({"Chassis Part Number", std::string(fruid.chassis.part)});
-        fruIdInfoList.push_back({"Chassis Serial Number", std::string(fruid.chassis.serial)});
-        if (fruid.chassis.custom1 != nullptr) {
-          fruIdInfoList.push_back({"Chassis Custom Data 1", std::string(fruid.chassis.custom1)});
-        }
-        if (fruid.chassis.custom2 != nullptr) {
-          fruIdInfoList.push_back({"Chassis Custom Data 2", std::string(fruid.chassis.custom2)});
-        }
-        if (fruid.chassis.custom3 != nullptr) {
-          fruIdInfoList.push_back({"Chassis Custom Data 3", std::string(fruid.chassis.custom3)});
-        }
-        if (fruid.chassis.custom4 != nullptr) {
-          fruIdInfoList.push_back({"Chassis Custom Data 4", std::string(fruid.chassis.custom4)});
-        }
+      if (fruid_parse_view(fruIdData, FRUID_SIZE, fruid.get()) != 0) {
+        LOG(ERROR) << "Unable to parse FRUID from " << eepromPath_;
+        return fruIdInfoList;
+      }
+
+      //decode fruid view and stored it in map
+      if (fruid->chassis.flag == 1) {
+        fruIdInfoList.push_back({"Chassis Type", std::string(fruid->chassis.type_str)});
+        addField("Chassis Part Number", fruid->chassis.part);
+        addField("Chassis Serial Number", fruid->chassis.serial);
+        addCustom("Chassis", fruid->chassis.custom);
       }
       else {
         LOG(INFO) << "Chassis Info not set";
       }
 
-      if (fruid.board.flag == 1) {
-        fruIdInfoList.push_back({"Board Mfg Date", std::string(fruid.board.mfg_time_str)});
-        fruIdInfoList.push_back({"Board Manufacturer", std::string(fruid.board.mfg)});
-        fruIdInfoList.push_back({"Board Product", std::string(fruid.board.name)});
-        fruIdInfoList.push_back({"Board Serial", std::string(fruid.board.serial)});
-        fruIdInfoList.push_back({"Board Part Number", std::string(fruid.board.part)});
-        fruIdInfoList.push_back({"Board Fru Id", std::string(fruid.board.fruid)});
-        if (fruid.board.custom1 != nullptr) {
-          fruIdInfoList.push_back({"Board Custom Data 1", std::string(fruid.board.custom1)});
-        }
-        if (fruid.board.custom2 != nullptr) {
-          fruIdInfoList.push_back({"Board Custom Data 2", std::string(fruid.board.custom2)});
-        }
-        if (fruid.board.custom3 != nullptr) {
-          fruIdInfoList.push_back({"Board Custom Data 3", std::string(fruid.board.custom3)});
-        }
-        if (fruid.board.custom4 != nullptr) {
-          fruIdInfoList.push_back({"Board Custom Data 4", std::string(fruid.board.custom4)});
-        }
-
+      if (fruid->board.flag == 1) {
+        addField("Board Mfg Date", fruid->board.mfg_time_str);
+        addField("Board Manufacturer", fruid->board.mfg);
+        addField("Board Product", fruid->board.name);
+        addField("Board Serial", fruid->board.serial);
+        addField("Board Part Number", fruid->board.part);
+        addField("Board Fru Id", fruid->board.fruid);
+        addCustom("Board", fruid->board.custom);
       }
       else {
         LOG(INFO) << "Board Info not set";
       }
 
-      if (fruid.product.flag == 1) {
-        fruIdInfoList.push_back({"Product Manufacturer", std::string(fruid.product.mfg)});
-        fruIdInfoList.push_back({"Product Name", std::string(fruid.product.name)});
-        fruIdInfoList.push_back({"Product Part Number", std::string(fruid.product.part)});
-        fruIdInfoList.push_back({"Product Version", std::string(fruid.product.version)});
-        fruIdInfoList.push_back({"Product Serial", std::string(fruid.product.serial)});
-        fruIdInfoList.push_back({"Product Asset Tag", std::string(fruid.product.asset_tag)});
-        fruIdInfoList.push_back({"Product Fru Id", std::string(fruid.product.fruid)});
-        if (fruid.product.custom1 != nullptr) {
-          fruIdInfoList.push_back({"Product Custom Data 1", std::string(fruid.product.custom1)});
-        }
-        if (fruid.product.custom2 != nullptr) {
-          fruIdInfoList.push_back({"Product Custom Data 2", std::string(fruid.product.custom2)});
-        }
-        if (fruid.product.custom3 != nullptr) {
-          fruIdInfoList.push_back({"Product Custom Data 3", std::string(fruid.product.custom3)});
-        }
-        if (fruid.product.custom4 != nullptr) {
-          fruIdInfoList.push_back({"Product Custom Data 4", std::string(fruid.product.custom4)});
-        }
+      if (fruid->product.flag == 1) {
+        addField("Product Manufacturer", fruid->product.mfg);
+        addField("Product Name", fruid->product.name);
+        addField("Product Part Number", fruid->product.part);
+        addField("Product Version", fruid->product.version);
+        addField("Product Serial", fruid->product.serial);
+        addField("Product Asset Tag", fruid->product.asset_tag);
+        addField("Product Fru Id", fruid->product.fruid);
+        addCustom("Product", fruid->product.custom);
       }
       else {
         LOG(INFO) << "Product Info not set";
@@ -25,6 +25,7 @@
 #include <string.h>
 #include <openbmc/fruid.h>
 #include <openbmc/pal.h>
+#include <openbmc/inventory.h>
 #include <jansson.h>
 #include <getopt.h>
 
@@ -46,6 +47,7 @@ static char pal_fru_list_print_t[1024] = {0};
 static char pal_fru_list_rw_t[1024] = {0};
 static char pal_dev_list_print_t[1024] = {0};
 static char pal_dev_list_rw_t[1024] = {0};
+static bool use_cache = false;
 
 #ifdef CONFIG_FBY3_CWC
 #define EXP_FRU_FIRST 32
@@ -497,6 +499,39 @@ print_json_fruid_info(fruid_info_t *fruid, const char *name,json_t *fru_array)
   json_array_append_new(fru_array, fru_object);
 }
 
+/* Print the FRUID kept by inventoryd, the fields are the ones printed above */
+static int
+print_cached_fruid_info(uint8_t fru, const char *name, unsigned char print_format, json_t *fru_array)
+{
+  inv_record_t rec;
+  json_t *fru_object;
+  int i;
+
+  if (inventory_get(fru, INV_FRUID, &rec)) {
+    return -1;
+  }
+
+  if (print_format == JSON_FORMAT) {
+    fru_object = json_object();
+    json_object_set_new(fru_object, "FRU Information", json_string(name));
+    for (i = 0; i < rec.count; i++) {
+      json_object_set_new(fru_object, rec.entries[i].key,
+        json_string(rec.entries[i].value ? rec.entries[i].value : ""));
+    }
+    json_array_append_new(fru_array, fru_object);
+  } else {
+    printf("%-27s: %s", "\nFRU Information", name);
+    printf("%-27s: %s", "\n---------------", "------------------");
+    for (i = 0; i < rec.count; i++) {
+      printf("\n%-26s: %s", rec.entries[i].key,
+        rec.entries[i].value ? rec.entries[i].value : "");
+    }
+    printf("\n");
+  }
+  inventory_free(&rec);
+  return 0;
+}
+
 /* Populate and print fruid_info by parsing the fru's binary dump */
 int get_fruid_info(uint8_t fru, char *path, char* name, unsigned char print_format,json_t *fru_array) {
   int ret = 0;
@@ -530,7 +565,7 @@ print_usage() {
   if ((pal_dev_list_print_t != NULL && strlen(pal_dev_list_print_t) != 0) ||
       (pal_dev_list_rw_t != NULL && strlen(pal_dev_list_rw_t) != 0)) {
     // dev_list is not empty
-    printf("Usage: fruid-util [ %s ] [ %s ] [--json]\n"
+    printf("Usage: fruid-util [ %s ] [ %s ] [--json] [--cached]\n"
       "Usage: fruid-util [ %s ] [ %s ] [--dump | --write ] <file>\n",
       pal_fru_list_print_t, pal_dev_list_print_t, pal_fru_list_rw_t, pal_dev_list_rw_t);
     printf("Usage: fruid-util [ %s ] [ %s ] --modify --<field> <data> <file>\n",
@@ -580,7 +615,7 @@ print_usage() {
            "                 PCD5 (Product Custom Data 5)\n"
            "                 PCD6 (Product Custom Data 6)\n");
   } else {
-    printf("Usage: fruid-util [ %s ] [--json]\n"
+    printf("Usage: fruid-util [ %s ] [--json] [--cached]\n"
       "Usage: fruid-util [ %s ] [--dump | --write ] <file>\n",
       pal_fru_list_print_t, pal_fru_list_rw_t);
     printf("Usage: fruid-util [ %s ] --modify <field> <data> <file>\n",
@@ -761,6 +796,13 @@ int print_fru(int fru, char * device, bool allow_absent, unsigned char print_for
     goto error;
   }
 
+  // Anything but the cached FRUID itself is read from the device
+  if (use_cache && device == NULL &&
+      print_cached_fruid_info(fru, name, print_format, fru_array) == 0) {
+    json_decref(fru_object);
+    return 0;
+  }
+
   ret = pal_is_fru_prsnt(fru, &status);
   if (ret < 0) {
     sprintf(error_mesg,"pal_is_fru_prsnt failed for fru: %d\n", fru);
@@ -1175,6 +1217,18 @@ int main(int argc, char * argv[]) {
 #endif
   create_fru_lists();
 
+  // --cached may come anywhere, take it out before the positional checks
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--cached") == 0) {
+      use_cache = true;
+      for (int j = i; j < argc; j++) {
+        argv[j] = argv[j+1];
+      }
+      argc--;
+      break;
+    }
+  }
+
   struct option opts[] = {
     {"help", 0, NULL, 'h'},
     {"dump", 1, NULL, 'd'},
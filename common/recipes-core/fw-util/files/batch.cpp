@@ -0,0 +1,362 @@
+/*
+ * batch.cpp
+ *
+ * Copyright 2021-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include <cstdio>
+#include <cerrno>
+#include <unistd.h>
+#include <syslog.h>
+#include "batch.h"
+
+using namespace std;
+
+extern std::atomic<bool> quit_process;
+
+// While a batch runs, everything a job's thread prints through stdio or
+// iostreams is collected per line and printed with the job's FRU and
+// component in front, so the progress of parallel updates can be told apart.
+// Threads without a job, like the scheduler, print unchanged.
+static thread_local string job_prefix;
+static thread_local string job_line[2];
+static mutex print_lock;
+
+static void write_all(int fd, const char *buf, size_t len)
+{
+  while (len > 0) {
+    ssize_t n = write(fd, buf, len);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return;
+    }
+    buf += n;
+    len -= n;
+  }
+}
+
+class PrefixedOutput : public streambuf {
+  int fd;
+  FILE *file;
+  public:
+    PrefixedOutput(int _fd) : fd(_fd), file(nullptr) {}
+    ~PrefixedOutput() {
+      if (file)
+        fclose(file);
+    }
+    void print(const char *buf, size_t len) {
+      if (job_prefix.empty()) {
+        lock_guard<mutex> lk(print_lock);
+        write_all(fd, buf, len);
+        return;
+      }
+      string &line = job_line[fd == STDERR_FILENO];
+      size_t pos;
+      line.append(buf, len);
+      while ((pos = line.find('\n')) != string::npos) {
+        string out = job_prefix + line.substr(0, pos + 1);
+        lock_guard<mutex> lk(print_lock);
+        write_all(fd, out.data(), out.size());
+        line.erase(0, pos + 1);
+      }
+    }
+    // print what is left of the current thread's last line
+    void flush_line() {
+      string &line = job_line[fd == STDERR_FILENO];
+      if (!line.empty())
+        print("\n", 1);
+    }
+    // an unbuffered stdio stream on top of this one
+    FILE *stdio() {
+      if (!file) {
+        cookie_io_functions_t io = {nullptr, cookie_write, nullptr, nullptr};
+        file = fopencookie(this, "w", io);
+        if (file)
+          setvbuf(file, nullptr, _IONBF, 0);
+      }
+      return file;
+    }
+  protected:
+    int_type overflow(int_type c) override {
+      if (c != traits_type::eof()) {
+        char ch = c;
+        print(&ch, 1);
+      }
+      return c;
+    }
+    streamsize xsputn(const char *s, streamsize n) override {
+      print(s, n);
+      return n;
+    }
+  private:
+    static ssize_t cookie_write(void *cookie, const char *buf, size_t len) {
+      static_cast<PrefixedOutput *>(cookie)->print(buf, len);
+      return len;
+    }
+};
+
+static PrefixedOutput prefixed_out(STDOUT_FILENO);
+static PrefixedOutput prefixed_err(STDERR_FILENO);
+
+void BatchUpdater::add(Component *c, const string &image, bool force,
+    const vector<string> &extra_resources)
+{
+  Job job;
+  job.comp = c;
+  job.image = image;
+  job.force = force;
+  job.resources = c->update_resources();
+  for (auto &r : extra_resources) {
+    if (find(job.resources.begin(), job.resources.end(), r) == job.resources.end())
+      job.resources.push_back(r);
+  }
+  job.state = JOB_PENDING;
+  job.ret = FW_STATUS_FAILURE;
+  jobs.push_back(job);
+}
+
+bool BatchUpdater::load_plan(const json &plan)
+{
+  try {
+    if (plan.contains("max_jobs")) {
+      set_max_jobs(plan["max_jobs"].get<size_t>());
+    }
+    if (plan.contains("limits")) {
+      for (auto &el : plan["limits"].items()) {
+        set_limit(el.key(), el.value().get<int>());
+      }
+    }
+    for (auto &u : plan.at("updates")) {
+      string fru = u.at("fru").get<string>();
+      string comp = u.at("component").get<string>();
+      string image = u.at("image").get<string>();
+      bool force = u.value("force", false);
+      vector<string> res;
+      if (u.contains("resources")) {
+        res = u["resources"].get<vector<string>>();
+      }
+      Component *c = Component::find_component(fru, comp);
+      if (c == nullptr) {
+        cerr << "Plan: unknown component " << fru << " : " << comp << endl;
+        return false;
+      }
+      ifstream f(image);
+      if (!f.good()) {
+        cerr << "Plan: cannot access: " << image << endl;
+        return false;
+      }
+      add(c, image, force, res);
+    }
+  } catch (json::exception &e) {
+    cerr << "Plan: " << e.what() << endl;
+    return false;
+  }
+  if (jobs.empty()) {
+    cerr << "Plan: no updates" << endl;
+    return false;
+  }
+  return true;
+}
+
+bool BatchUpdater::can_start(const Job &job)
+{
+  if (max_jobs > 0 && running >= max_jobs)
+    return false;
+  for (auto &r : job.resources) {
+    auto it = limits.find(r);
+    int limit = it == limits.end() ? 1 : max(it->second, 1);
+    if (in_use[r] >= limit)
+      return false;
+  }
+  return true;
+}
+
+void BatchUpdater::acquire(const Job &job)
+{
+  for (auto &r : job.resources)
+    in_use[r]++;
+  running++;
+}
+
+void BatchUpdater::release(const Job &job)
+{
+  for (auto &r : job.resources)
+    in_use[r]--;
+  running--;
+}
+
+void BatchUpdater::report(const Job &job, const char *what)
+{
+  out << "[" << finished << "/" << jobs.size() << "] "
+      << job.comp->fru() << " : " << job.comp->component() << " " << what;
+  if (job.state != JOB_RUNNING && job.state != JOB_SKIPPED) {
+    auto secs = chrono::duration_cast<chrono::seconds>(job.end - job.start);
+    out << " (" << secs.count() << "s)";
+  }
+  out << endl;
+}
+
+void BatchUpdater::run_job(Job &job)
+{
+  Component *c = job.comp;
+  int ret;
+
+  job_prefix = "[" + c->fru() + ":" + c->component() + "] ";
+  if (c->is_sled_cycle_initiated() || c->is_update_ongoing()) {
+    ret = FW_STATUS_FAILURE;
+  } else {
+    c->set_update_ongoing(60 * 10);
+    if (job.image == "-") {
+      ret = c->update(0, job.force);
+    } else if (job.force) {
+      ret = c->fupdate(job.image);
+    } else {
+      ret = c->update(job.image);
+    }
+    c->set_update_ongoing(0);
+    if (ret == FW_STATUS_SUCCESS) {
+      c->update_finish();
+    }
+  }
+  prefixed_out.flush_line();
+  prefixed_err.flush_line();
+  job_prefix.clear();
+
+  lock_guard<mutex> lk(lock);
+  job.ret = ret;
+  job.end = chrono::steady_clock::now();
+  release(job);
+  finished++;
+  if (ret == FW_STATUS_SUCCESS) {
+    job.state = JOB_SUCCEEDED;
+    report(job, "succeeded");
+  } else if (ret == FW_STATUS_NOT_SUPPORTED) {
+    job.state = JOB_NOT_SUPPORTED;
+    report(job, "not supported");
+  } else {
+    job.state = JOB_FAILED;
+    report(job, "failed");
+  }
+  syslog(LOG_INFO, "fw-util: batch update of %s : %s returned %d",
+      c->fru().c_str(), c->component().c_str(), ret);
+  cv.notify_all();
+}
+
+int BatchUpdater::run()
+{
+  vector<thread> threads;
+  FILE *saved_stdout = stdout, *saved_stderr = stderr;
+  streambuf *saved_cout, *saved_cerr;
+
+  fflush(stdout);
+  fflush(stderr);
+  cout.flush();
+  saved_cout = cout.rdbuf(&prefixed_out);
+  saved_cerr = cerr.rdbuf(&prefixed_err);
+  if (prefixed_out.stdio() && prefixed_err.stdio()) {
+    stdout = prefixed_out.stdio();
+    stderr = prefixed_err.stdio();
+  }
+
+  unique_lock<mutex> lk(lock);
+
+  while (finished < jobs.size()) {
+    bool quit = quit_process.load();
+    for (auto &job : jobs) {
+      if (job.state != JOB_PENDING)
+        continue;
+      if (quit) {
+        job.state = JOB_SKIPPED;
+        finished++;
+        report(job, "skipped");
+        continue;
+      }
+      if (!can_start(job))
+        continue;
+      acquire(job);
+      job.state = JOB_RUNNING;
+      job.start = chrono::steady_clock::now();
+      report(job, "started");
+      threads.emplace_back(&BatchUpdater::run_job, this, ref(job));
+    }
+    if (finished == jobs.size())
+      break;
+    // Wake up periodically so that a termination request stops
+    // further jobs from being started.
+    cv.wait_for(lk, chrono::seconds(1));
+  }
+  lk.unlock();
+
+  for (auto &t : threads)
+    t.join();
+
+  stdout = saved_stdout;
+  stderr = saved_stderr;
+  cout.rdbuf(saved_cout);
+  cerr.rdbuf(saved_cerr);
+
+  print_summary();
+  for (auto &job : jobs) {
+    if (job.state != JOB_SUCCEEDED)
+      return -1;
+  }
+  return 0;
+}
+
+void BatchUpdater::print_summary()
+{
+  static const map<job_state, string> names = {
+    {JOB_PENDING, "pending"},
+    {JOB_RUNNING, "running"},
+    {JOB_SUCCEEDED, "succeeded"},
+    {JOB_FAILED, "failed"},
+    {JOB_NOT_SUPPORTED, "not supported"},
+    {JOB_SKIPPED, "skipped"},
+  };
+  map<string, vector<const Job *>, partialLexCompare> by_fru;
+  size_t ok = 0;
+
+  for (auto &job : jobs) {
+    by_fru[job.comp->fru()].push_back(&job);
+    if (job.state == JOB_SUCCEEDED)
+      ok++;
+  }
+
+  out << endl;
+  out << left << setw(10) << "FRU" << " : " << setw(12) << "COMPONENT"
+      << " : " << setw(13) << "RESULT" << " : TIME" << endl;
+  out << "---------- : ------------ : ------------- : ----" << endl;
+  for (auto &fkv : by_fru) {
+    for (auto job : fkv.second) {
+      out << left << setw(10) << fkv.first << " : " << setw(12)
+          << job->comp->component() << " : " << setw(13) << names.at(job->state)
+          << " : ";
+      if (job->state == JOB_PENDING || job->state == JOB_SKIPPED) {
+        out << "-";
+      } else {
+        out << chrono::duration_cast<chrono::seconds>(job->end - job->start).count() << "s";
+      }
+      out << endl;
+    }
+  }
+  out << ok << " of " << jobs.size() << " updates succeeded" << endl;
+}
@@ -0,0 +1,69 @@
+#ifndef _BATCH_H_
+#define _BATCH_H_
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <iostream>
+#include "fw-util.h"
+
+// Runs updates of several components in parallel. Two jobs may run at
+// the same time only if none of the resources they report through
+// Component::update_resources() is already held by as many jobs as its
+// limit allows. Resources without an explicit limit are exclusive.
+class BatchUpdater {
+  public:
+    enum job_state {
+      JOB_PENDING,
+      JOB_RUNNING,
+      JOB_SUCCEEDED,
+      JOB_FAILED,
+      JOB_NOT_SUPPORTED,
+      JOB_SKIPPED,
+    };
+    struct Job {
+      Component *comp;
+      std::string image;
+      bool force;
+      std::vector<std::string> resources;
+      job_state state;
+      int ret;
+      std::chrono::steady_clock::time_point start;
+      std::chrono::steady_clock::time_point end;
+    };
+  private:
+    std::ostream &out;
+    std::vector<Job> jobs;
+    std::map<std::string, int> limits;
+    std::map<std::string, int> in_use;
+    size_t max_jobs;
+    size_t running;
+    size_t finished;
+    std::mutex lock;
+    std::condition_variable cv;
+
+    bool can_start(const Job &job);
+    void acquire(const Job &job);
+    void release(const Job &job);
+    void run_job(Job &job);
+    void report(const Job &job, const char *what);
+  public:
+    BatchUpdater(std::ostream &o = std::cout) :
+      out(o), max_jobs(0), running(0), finished(0) {}
+    // Cap on concurrent jobs, 0 means no cap other than the resources.
+    void set_max_jobs(size_t n) { max_jobs = n; }
+    void set_limit(const std::string &resource, int n) { limits[resource] = n; }
+    void add(Component *c, const std::string &image, bool force = false,
+        const std::vector<std::string> &extra_resources = {});
+    // Load a JSON plan. Returns false and prints the reason on a bad plan.
+    bool load_plan(const json &plan);
+    const std::vector<Job> &get_jobs() const { return jobs; }
+    // Run all jobs and print the per-FRU summary. Returns 0 only if every
+    // job succeeded.
+    int run();
+    void print_summary();
+};
+
+#endif
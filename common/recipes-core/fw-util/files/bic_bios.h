@@ -10,6 +10,9 @@ class BiosComponent : public Component {
   public:
     BiosComponent(std::string fru, std::string comp, uint8_t _slot_id)
       : Component(fru, comp), slot_id(_slot_id), server(_slot_id, fru) {}
+    std::vector<std::string> update_resources() override {
+      return server.update_resources();
+    }
     int update(std::string image);
     int fupdate(std::string image);
     int print_version();
@@ -9,6 +9,9 @@ class BicFwComponent : public Component {
   public:
     BicFwComponent(std::string fru, std::string comp, uint8_t _slot_id)
       : Component(fru, comp), slot_id(_slot_id), server(_slot_id, fru) {}
+    std::vector<std::string> update_resources() override {
+      return server.update_resources();
+    }
     int update(std::string image);
     int fupdate(std::string image);
     int print_version();
@@ -20,6 +23,9 @@ class BicFwBlComponent : public Component {
   public:
     BicFwBlComponent(std::string fru, std::string comp, uint8_t _slot_id)
       : Component(fru, comp), slot_id(_slot_id), server(_slot_id, fru) {}
+    std::vector<std::string> update_resources() override {
+      return server.update_resources();
+    }
     int update(std::string image);
     int print_version();
 };
@@ -31,11 +31,13 @@
 #include <syslog.h>
 #include <atomic>
 #include <openbmc/pal.h>
+#include <openbmc/inventory.h>
 #ifdef __TEST__
 #include <gtest/gtest.h>
 #endif
 #include "fw-util.h"
 #include "scheduler.h"
+#include "batch.h"
 using namespace std;
 
 std::atomic<bool> quit_process(false);
@@ -141,6 +143,13 @@ bool AliasComponent::is_update_ongoing()
   return _target_comp->is_update_ongoing();
 }
 
+vector<string> AliasComponent::update_resources()
+{
+  if (!setup())
+    return Component::update_resources();
+  return _target_comp->update_resources();
+}
+
 void fw_util_sig_handler(int signo)
 {
   quit_process.store(true);
@@ -200,12 +209,15 @@ bool if_skip_cwc_comp(string &comp_name, string fru_name)
 void usage()
 {
   cout << "USAGE: " << exec_name << " all|FRU --version [all|COMPONENT]" << endl;
+  cout << "       " << exec_name << " all|FRU --version --cached" << endl;
   cout << "       " << exec_name << " FRU --update [--]COMPONENT IMAGE_PATH" << endl;
   cout << "       " << exec_name << " FRU --force --update [--]COMPONENT IMAGE_PATH" << endl;
   cout << "       " << exec_name << " FRU --dump [--]COMPONENT IMAGE_PATH" << endl;
   cout << "       " << exec_name << " FRU --update COMPONENT IMAGE_PATH --schedule now" << endl;
   cout << "       " << exec_name << " all --show-schedule" << endl;
   cout << "       " << exec_name << " all --delete-schedule TASK_ID" << endl;
+  cout << "       " << exec_name << " all [--force] --update COMPONENT IMAGE_PATH" << endl;
+  cout << "       " << exec_name << " all --update-plan PLAN_JSON" << endl;
 #ifdef CONFIG_FBY3_CWC
   print_cwc_usage();
 #endif
@@ -319,10 +331,32 @@ bool if_cwc_option_skipped(string fru2, string component, string comp_name)
 }
 #endif
 
+// Print the --version output of a FRU kept by inventoryd
+static bool print_cached_version(const string &fru)
+{
+  inv_record_t rec;
+  uint8_t fru_id;
+
+  if (pal_get_fru_id((char *)fru.c_str(), &fru_id) ||
+      inventory_get(fru_id, INV_FW, &rec)) {
+    return false;
+  }
+  for (int i = 0; i < rec.count; i++) {
+    cout << rec.entries[i].key;
+    if (rec.entries[i].value) {
+      cout << ": " << rec.entries[i].value;
+    }
+    cout << endl;
+  }
+  inventory_free(&rec);
+  return true;
+}
+
 int main(int argc, char *argv[])
 {
   int ret = 0;
   int find_comp = 0;
+  bool use_cache = false;
   struct sigaction sa;
 
   Component::fru_list_setup();
@@ -336,6 +370,16 @@ int main(int argc, char *argv[])
   return RUN_ALL_TESTS();
 #endif
   exec_name = argv[0];
+  for (int i = 1; i < argc; i++) {
+    if (string(argv[i]) == "--cached") {
+      use_cache = true;
+      for (int j = i; j < argc; j++) {
+        argv[j] = argv[j + 1];
+      }
+      argc--;
+      break;
+    }
+  }
   if (argc < 3) {
     usage();
     return -1;
@@ -349,8 +393,10 @@ int main(int argc, char *argv[])
   string time("");
   string task_id("");
   json json_array(nullptr);
+  json plan;
   bool add_task = false;
   Scheduler tasker;
+  BatchUpdater batch;
 #ifdef CONFIG_FBY3_CWC
   string fru2("");
 #endif
@@ -449,6 +495,26 @@ int main(int argc, char *argv[])
       cerr << "Upgrading all components not supported" << endl;
       return -1;
     }
+  } else if (action == "--update-plan") {
+    if (fru != "all" || argc != 4) {
+      usage();
+      return -1;
+    }
+    image.assign(argv[3]);
+    ifstream f(image);
+    if (!f.good()) {
+      cerr << "Cannot access: " << image << endl;
+      return -1;
+    }
+    try {
+      f >> plan;
+    } catch (json::exception &e) {
+      cerr << "Invalid update plan: " << e.what() << endl;
+      return -1;
+    }
+    if (!batch.load_plan(plan)) {
+      return -1;
+    }
   } else if (action == "--version") {
     if(argc > 4) {
       usage();
@@ -483,9 +549,44 @@ int main(int argc, char *argv[])
   sigaction(SIGINT, &sa, NULL);
   sigaction(SIGTERM, &sa, NULL);
   sigaction(SIGPIPE, &sa, NULL); // for ssh terminate
+
+  // Updating one component across all FRUs, or following a plan, runs
+  // the independent updates in parallel.
+  if (fru == "all" && !add_task &&
+      (action == "--update" || action == "--force" || action == "--update-plan")) {
+    if (action != "--update-plan") {
+      if (image == "-") {
+        cerr << "Batch update cannot read the image from stdin" << endl;
+        return -1;
+      }
+      for (auto fkv : *Component::fru_list) {
+        auto it = fkv.second.find(component);
+        if (it == fkv.second.end()) {
+          continue;
+        }
+        Component *c = it->second;
+        // The target of the alias is updated in its own FRU.
+        if (c->is_alias() && component == c->alias_component()) {
+          continue;
+        }
+        batch.add(c, image, action == "--force");
+      }
+      if (batch.get_jobs().empty()) {
+        usage();
+        return -1;
+      }
+    }
+    return batch.run();
+  }
   //print the fw version or do the fw update when the fru and the comp are found
   for (auto fkv : *Component::fru_list) {
     if (fru == "all" || fru == fkv.first) {
+      // FRUs inventoryd has nothing for are read below
+      if (use_cache && action == "--version" && component == "all" &&
+          print_cached_version(fkv.first)) {
+        find_comp = 1;
+        continue;
+      }
       for (auto ckv : fkv.second) {
         string comp_name = ckv.first;
         if (component == "all" || component == comp_name) {
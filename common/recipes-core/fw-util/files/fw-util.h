@@ -4,6 +4,7 @@
 #include <iostream>
 #include <algorithm>
 #include <map>
+#include <vector>
 #include <atomic>
 #include <regex>
 #include "system_intf.h"
@@ -102,6 +103,15 @@ class Component {
     virtual bool is_sled_cycle_initiated() {
       return sys().is_sled_cycle_initiated();
     }
+    // Resources held while this component is being updated. Batch updates
+    // never run more jobs on a resource than its limit allows. By default
+    // a component also holds "transport", so updates which don't say how
+    // they reach the device (e.g. through the same BIC or IPMB bus) run
+    // one at a time. Components which know their bus or flash device
+    // override this and list it instead, to run in parallel.
+    virtual std::vector<std::string> update_resources() {
+      return {"fru:" + _fru, "transport"};
+    }
 };
 
 class AliasComponent : public Component {
@@ -121,6 +131,7 @@ class AliasComponent : public Component {
 
     void set_update_ongoing(int timeout);
     bool is_update_ongoing();
+    std::vector<std::string> update_resources();
 };
 
 #endif
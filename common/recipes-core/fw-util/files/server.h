@@ -1,6 +1,9 @@
 #ifndef _SERVER_H_
 #define _SERVER_H_
 
+#include <string>
+#include <vector>
+
 class Server {
   private:
     uint8_t _slot_id;
@@ -9,6 +12,12 @@ class Server {
     Server(uint8_t slot_id, std::string fru) : _slot_id(slot_id), fru_name(fru) {}
     // Throws exception if not
     void ready();
+    // Batch update resources of a component reached through the BIC of
+    // this server. Updates of one slot share its IPMB bus and run one at a
+    // time, while different slots are updated in parallel.
+    std::vector<std::string> update_resources() {
+      return {"fru:" + fru_name, "ipmb:slot" + std::to_string(_slot_id)};
+    }
 };
 
 #endif
@@ -8,6 +8,7 @@
 #include <sys/mman.h>
 #include <openbmc/pal.h>
 #include <openbmc/vbs.h>
+#include <openbmc/inventory.h>
 #include "fw-util.h"
 
 #define PAGE_SIZE                     0x1000
@@ -115,6 +116,10 @@ uint8_t System::get_fru_id(string &name)
 void System::set_update_ongoing(uint8_t fru_id, int timeo)
 {
   pal_set_fw_update_ongoing(fru_id, timeo);
+  // The update is over, let inventoryd read the versions again
+  if (timeo == 0) {
+    inventory_refresh(fru_id);
+  }
 }
 
 bool System::is_update_ongoing(uint8_t fru_id)
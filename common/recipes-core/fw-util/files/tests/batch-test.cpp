@@ -0,0 +1,273 @@
+#include "fw-util.h"
+#include "batch.h"
+#include "server.h"
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+#include <sstream>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+class SlowComponent : public Component {
+  vector<string> res;
+  public:
+    static mutex lock;
+    static map<string, int> active;
+    static map<string, int> peak;
+    static int total_active;
+    static int total_peak;
+    int ret;
+
+    SlowComponent(string fru, string comp, vector<string> r, int rv = 0)
+      : Component(fru, comp), res(r), ret(rv) {}
+    vector<string> update_resources() override {
+      return res;
+    }
+    int update(string image) override {
+      {
+        lock_guard<mutex> lk(lock);
+        for (auto &r : res) {
+          active[r]++;
+          peak[r] = max(peak[r], active[r]);
+        }
+        total_active++;
+        total_peak = max(total_peak, total_active);
+      }
+      this_thread::sleep_for(chrono::milliseconds(50));
+      {
+        lock_guard<mutex> lk(lock);
+        for (auto &r : res)
+          active[r]--;
+        total_active--;
+      }
+      return ret;
+    }
+    static void reset() {
+      active.clear();
+      peak.clear();
+      total_active = total_peak = 0;
+    }
+};
+
+mutex SlowComponent::lock;
+map<string, int> SlowComponent::active;
+map<string, int> SlowComponent::peak;
+int SlowComponent::total_active = 0;
+int SlowComponent::total_peak = 0;
+
+TEST(BatchTest, IndependentFrusRunInParallel) {
+  SlowComponent::reset();
+  SlowComponent a("bslot1", "bic", {"fru:bslot1"});
+  SlowComponent b("bslot2", "bic", {"fru:bslot2"});
+  SlowComponent c("bslot3", "bic", {"fru:bslot3"});
+  stringstream out;
+  BatchUpdater batch(out);
+  batch.add(&a, "image");
+  batch.add(&b, "image");
+  batch.add(&c, "image");
+  EXPECT_EQ(0, batch.run());
+  EXPECT_EQ(3, SlowComponent::total_peak);
+  for (auto &job : batch.get_jobs()) {
+    EXPECT_EQ(BatchUpdater::JOB_SUCCEEDED, job.state);
+  }
+  EXPECT_NE(string::npos, out.str().find("3 of 3 updates succeeded"));
+}
+
+TEST(BatchTest, SharedResourceIsLimited) {
+  SlowComponent::reset();
+  SlowComponent a("bslot1", "bios", {"fru:bslot1", "bus:1"});
+  SlowComponent b("bslot2", "bios", {"fru:bslot2", "bus:1"});
+  SlowComponent c("bslot3", "bios", {"fru:bslot3", "bus:1"});
+  SlowComponent d("bslot4", "bios", {"fru:bslot4", "bus:2"});
+  stringstream out;
+  BatchUpdater batch(out);
+  batch.set_limit("bus:1", 2);
+  batch.add(&a, "image");
+  batch.add(&b, "image");
+  batch.add(&c, "image");
+  batch.add(&d, "image");
+  EXPECT_EQ(0, batch.run());
+  EXPECT_EQ(2, SlowComponent::peak["bus:1"]);
+  EXPECT_EQ(1, SlowComponent::peak["bus:2"]);
+}
+
+class DefaultComponent : public Component {
+  public:
+    DefaultComponent(string fru, string comp) : Component(fru, comp) {}
+    int update(string image) override {
+      {
+        lock_guard<mutex> lk(SlowComponent::lock);
+        SlowComponent::total_active++;
+        SlowComponent::total_peak =
+          max(SlowComponent::total_peak, SlowComponent::total_active);
+      }
+      this_thread::sleep_for(chrono::milliseconds(50));
+      lock_guard<mutex> lk(SlowComponent::lock);
+      SlowComponent::total_active--;
+      return 0;
+    }
+};
+
+TEST(BatchTest, DefaultResourcesRunOneAtATime) {
+  SlowComponent::reset();
+  DefaultComponent a("dslot1", "bios");
+  DefaultComponent b("dslot2", "bios");
+  SlowComponent c("dslot3", "vr", {"i2c:3"});
+  stringstream out;
+  BatchUpdater batch(out);
+  batch.add(&a, "image");
+  batch.add(&b, "image");
+  batch.add(&c, "image");
+  EXPECT_EQ(0, batch.run());
+  // a and b share the transport, c only holds its bus
+  EXPECT_EQ(2, SlowComponent::total_peak);
+}
+
+TEST(BatchTest, SlotsRunInParallel) {
+  SlowComponent::reset();
+  Server s1(1, "bslot1"), s2(2, "bslot2");
+  SlowComponent a("bslot1", "bic", s1.update_resources());
+  SlowComponent b("bslot1", "bios", s1.update_resources());
+  SlowComponent c("bslot2", "bic", s2.update_resources());
+  SlowComponent d("bslot2", "bios", s2.update_resources());
+  stringstream out;
+  BatchUpdater batch(out);
+  batch.add(&a, "image");
+  batch.add(&b, "image");
+  batch.add(&c, "image");
+  batch.add(&d, "image");
+  EXPECT_EQ(0, batch.run());
+  // one update per slot at a time, both slots at once
+  EXPECT_EQ(1, SlowComponent::peak["ipmb:slot1"]);
+  EXPECT_EQ(1, SlowComponent::peak["ipmb:slot2"]);
+  EXPECT_EQ(2, SlowComponent::total_peak);
+}
+
+class PrintComponent : public Component {
+  public:
+    PrintComponent(string fru, string comp) : Component(fru, comp) {}
+    vector<string> update_resources() override {
+      return {"fru:" + fru()};
+    }
+    int update(string image) override {
+      printf("%s: half", component().c_str());
+      this_thread::sleep_for(chrono::milliseconds(20));
+      printf(" done\n");
+      cout << component() << ": verified" << endl;
+      cerr << component() << ": no error" << endl;
+      printf("%s: unterminated", component().c_str());
+      return 0;
+    }
+};
+
+static string read_file(const string &path) {
+  ifstream f(path);
+  stringstream ss;
+  ss << f.rdbuf();
+  return ss.str();
+}
+
+TEST(BatchTest, OutputIsPrefixed) {
+  PrintComponent a("pslot1", "bic");
+  PrintComponent b("pslot2", "bic");
+  string out_path("/tmp/fw-util-batch-test.out");
+  string err_path("/tmp/fw-util-batch-test.err");
+  stringstream out;
+  BatchUpdater batch(out);
+  batch.add(&a, "image");
+  batch.add(&b, "image");
+
+  fflush(stdout);
+  fflush(stderr);
+  int saved_out = dup(STDOUT_FILENO), saved_err = dup(STDERR_FILENO);
+  int out_fd = open(out_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  int err_fd = open(err_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  dup2(out_fd, STDOUT_FILENO);
+  dup2(err_fd, STDERR_FILENO);
+  int ret = batch.run();
+  fflush(stdout);
+  fflush(stderr);
+  dup2(saved_out, STDOUT_FILENO);
+  dup2(saved_err, STDERR_FILENO);
+  close(out_fd);
+  close(err_fd);
+  close(saved_out);
+  close(saved_err);
+
+  EXPECT_EQ(0, ret);
+  string printed = read_file(out_path), errors = read_file(err_path);
+  for (string slot : {"pslot1", "pslot2"}) {
+    string prefix = "[" + slot + ":bic] ";
+    EXPECT_NE(string::npos, printed.find(prefix + "bic: half done\n")) << printed;
+    EXPECT_NE(string::npos, printed.find(prefix + "bic: verified\n")) << printed;
+    EXPECT_NE(string::npos, printed.find(prefix + "bic: unterminated\n")) << printed;
+    EXPECT_NE(string::npos, errors.find(prefix + "bic: no error\n")) << errors;
+  }
+  remove(out_path.c_str());
+  remove(err_path.c_str());
+}
+
+TEST(BatchTest, MaxJobs) {
+  SlowComponent::reset();
+  SlowComponent a("bslot1", "cpld", {"fru:bslot1"});
+  SlowComponent b("bslot2", "cpld", {"fru:bslot2"});
+  SlowComponent c("bslot3", "cpld", {"fru:bslot3"});
+  stringstream out;
+  BatchUpdater batch(out);
+  batch.set_max_jobs(1);
+  batch.add(&a, "image");
+  batch.add(&b, "image");
+  batch.add(&c, "image");
+  EXPECT_EQ(0, batch.run());
+  EXPECT_EQ(1, SlowComponent::total_peak);
+}
+
+TEST(BatchTest, FailureIsReported) {
+  SlowComponent::reset();
+  SlowComponent a("bslot1", "vr", {"fru:bslot1"});
+  SlowComponent b("bslot2", "vr", {"fru:bslot2"}, FW_STATUS_FAILURE);
+  SlowComponent c("bslot3", "vr", {"fru:bslot3"}, FW_STATUS_NOT_SUPPORTED);
+  stringstream out;
+  BatchUpdater batch(out);
+  batch.add(&a, "image");
+  batch.add(&b, "image");
+  batch.add(&c, "image");
+  EXPECT_NE(0, batch.run());
+  auto &jobs = batch.get_jobs();
+  EXPECT_EQ(BatchUpdater::JOB_SUCCEEDED, jobs[0].state);
+  EXPECT_EQ(BatchUpdater::JOB_FAILED, jobs[1].state);
+  EXPECT_EQ(BatchUpdater::JOB_NOT_SUPPORTED, jobs[2].state);
+  EXPECT_NE(string::npos, out.str().find("1 of 3 updates succeeded"));
+}
+
+TEST(BatchTest, Plan) {
+  SlowComponent::reset();
+  SlowComponent a("bslot1", "bic", {"fru:bslot1"});
+  SlowComponent b("bslot2", "bic", {"fru:bslot2"});
+  string image("/tmp/fw-util-batch-test.bin");
+  ofstream(image) << "data";
+  json plan = {
+    {"max_jobs", 2},
+    {"limits", {{"bus:5", 1}}},
+    {"updates", {
+      {{"fru", "bslot1"}, {"component", "bic"}, {"image", image}, {"resources", {"bus:5"}}},
+      {{"fru", "bslot2"}, {"component", "bic"}, {"image", image}, {"resources", {"bus:5"}}},
+    }},
+  };
+  stringstream out;
+  BatchUpdater batch(out);
+  EXPECT_TRUE(batch.load_plan(plan));
+  EXPECT_EQ(2u, batch.get_jobs().size());
+  EXPECT_EQ(0, batch.run());
+  EXPECT_EQ(1, SlowComponent::total_peak);
+
+  json bad = {{"updates", {{{"fru", "nofru"}, {"component", "bic"}, {"image", image}}}}};
+  BatchUpdater batch2(out);
+  EXPECT_FALSE(batch2.load_plan(bad));
+  remove(image.c_str());
+}
@@ -94,3 +94,18 @@ int VrComponent::update(string image) {
 int VrComponent::fupdate(string image) {
   return update(image, 1);
 }
+
+// VRs on different buses can be programmed at the same time, so only the
+// bus is held during an update, not the whole FRU.
+vector<string> VrComponent::update_resources() {
+  int bus = -1;
+
+  if (vr_probe() == 0) {
+    bus = vr_fw_bus(dev_name.c_str());
+    vr_remove();
+  }
+  if (bus < 0) {
+    return Component::update_resources();
+  }
+  return {"i2c:" + to_string(bus)};
+}
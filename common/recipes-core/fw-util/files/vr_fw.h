@@ -13,6 +13,7 @@ class VrComponent : public Component {
     int print_version();
     int update(std::string image);
     int fupdate(std::string image);
+    std::vector<std::string> update_resources();
 };
 
 #endif
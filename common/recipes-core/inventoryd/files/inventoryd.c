@@ -0,0 +1,603 @@
+/*
+ * Copyright 2021-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * inventoryd gathers the FRUID, DIMM and firmware version data of every
+ * FRU once, with one worker per FRU up to MAX_WORKERS, and answers
+ * inventory_get() from memory afterwards.
+ *
+ * The FRUID is parsed with libfruid from pal_get_fruid_path(). DIMM and
+ * firmware versions come from dimm-util and fw-util, since the platform
+ * specific readers (SPD access, fw-util components) live in those tools.
+ *
+ * A FRU is gathered again when its presence or power state changes,
+ * when inventory_refresh() is called (fw-util does after an update), on
+ * SIGHUP and every refresh interval. When a DIMM or version read fails
+ * while the FRU is still present, e.g. because the host is off, the
+ * last good data is kept.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <signal.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <jansson.h>
+#include <openbmc/kv.h>
+#include <openbmc/pal.h>
+#include <openbmc/fruid.h>
+#include <openbmc/ipc.h>
+#include <openbmc/inventory.h>
+
+#define MAX_WORKERS       4
+#define MAX_REQUESTS      8
+#define POLL_INTERVAL     5       /* seconds */
+#define DEFAULT_REFRESH   3600    /* seconds */
+
+#define FW_UTIL   "/usr/local/bin/fw-util"
+#define DIMM_UTIL "/usr/local/bin/dimm-util"
+
+#define KIND_MASK(k)  (1 << (k))
+#define ALL_KINDS     (KIND_MASK(INV_KINDS) - 1)
+/* Data which depends on the host being powered */
+#define POWER_KINDS   (KIND_MASK(INV_DIMM) | KIND_MASK(INV_FW))
+
+#define FIELD_LEN(x)  (x & ~(0x03 << 6))
+#define STATE_UNKNOWN 0xff
+
+typedef struct {
+  uint8_t status;     /* INV_OK, INV_ERR_PENDING or INV_ERR_ABSENT */
+  uint32_t gen;
+  time_t ts;
+  uint8_t *bin;
+  size_t bin_len;
+  char *json;
+  size_t json_len;
+} inv_data_t;
+
+typedef struct {
+  bool valid;
+  char name[32];
+  unsigned int caps;
+  uint8_t prsnt;
+  uint32_t prsnt_gen; /* bumped on every presence change */
+  uint8_t power;
+  uint8_t queued;     /* KIND_MASK() of the records to gather */
+  uint8_t deferred;   /* waiting for a firmware update to finish */
+  bool busy;
+  inv_data_t data[INV_KINDS];
+} inv_fru_t;
+
+static const char *kind_name[INV_KINDS] = {"fruid", "dimm", "fw"};
+
+static inv_fru_t frus[MAX_NUM_FRUS + 1];
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_cond = PTHREAD_COND_INITIALIZER;
+static uint32_t next_gen = 1;
+static int refresh_interval = DEFAULT_REFRESH;
+static volatile sig_atomic_t refresh_all;
+
+static time_t now_sec(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec;
+}
+
+/* Called with lock held */
+static void queue_fru(uint8_t fru, uint8_t kinds)
+{
+  if (!frus[fru].valid || frus[fru].prsnt == 0 || kinds == 0)
+    return;
+  frus[fru].queued |= kinds;
+  pthread_cond_signal(&work_cond);
+}
+
+static void queue_all(uint8_t kinds)
+{
+  int fru;
+
+  pthread_mutex_lock(&lock);
+  for (fru = 1; fru <= MAX_NUM_FRUS; fru++)
+    queue_fru(fru, kinds);
+  pthread_mutex_unlock(&lock);
+}
+
+/* Called with lock held */
+static void data_clear(inv_data_t *d, uint8_t status)
+{
+  free(d->bin);
+  free(d->json);
+  d->bin = NULL;
+  d->json = NULL;
+  d->bin_len = d->json_len = 0;
+  d->status = status;
+  d->gen = next_gen++;
+  d->ts = now_sec();
+}
+
+static char *record_json(const char *name, uint8_t kind, const inv_builder_t *b)
+{
+  inv_record_t rec;
+  json_t *obj, *arr, *pair;
+  char *str;
+  int i;
+
+  if (inventory_decode(b->buf, b->len, &rec))
+    return NULL;
+  obj = json_object();
+  arr = json_array();
+  json_object_set_new(obj, "fru", json_string(name));
+  json_object_set_new(obj, "kind", json_string(kind_name[kind]));
+  for (i = 0; i < rec.count; i++) {
+    pair = json_array();
+    json_array_append_new(pair, json_string(rec.entries[i].key));
+    if (rec.entries[i].value)
+      json_array_append_new(pair, json_string(rec.entries[i].value));
+    json_array_append_new(arr, pair);
+  }
+  json_object_set_new(obj, "entries", arr);
+  str = json_dumps(obj, JSON_COMPACT);
+  json_decref(obj);
+  inventory_free(&rec);
+  return str;
+}
+
+/*
+ * Takes the ownership of the builder buffer, unless the FRU was removed
+ * or replaced since prsnt_gen was taken; the data is dropped then.
+ */
+static void store(uint8_t fru, uint8_t kind, uint32_t prsnt_gen, inv_builder_t *b)
+{
+  char *json = record_json(frus[fru].name, kind, b);
+  inv_data_t *d = &frus[fru].data[kind];
+
+  pthread_mutex_lock(&lock);
+  if (frus[fru].prsnt != 1 || frus[fru].prsnt_gen != prsnt_gen) {
+    pthread_mutex_unlock(&lock);
+    free(json);
+    return;
+  }
+  data_clear(d, INV_OK);
+  d->bin = b->buf;
+  d->bin_len = b->len;
+  d->json = json;
+  d->json_len = json ? strlen(json) : 0;
+  pthread_mutex_unlock(&lock);
+  b->buf = NULL;
+}
+
+/* Keep the previous data if there is any */
+static void store_failed(uint8_t fru, uint8_t kind, uint32_t prsnt_gen)
+{
+  inv_data_t *d = &frus[fru].data[kind];
+
+  pthread_mutex_lock(&lock);
+  if (frus[fru].prsnt_gen == prsnt_gen && d->status != INV_OK)
+    data_clear(d, INV_ERR_ABSENT);
+  pthread_mutex_unlock(&lock);
+}
+
+static void add_field(inv_builder_t *b, const char *key, uint8_t type_len, const char *val)
+{
+  if (val != NULL && FIELD_LEN(type_len) > 0)
+    inv_builder_add(b, key, val);
+}
+
+static void add_custom(inv_builder_t *b, const char *area, int n, uint8_t type_len, const char *val)
+{
+  char key[32];
+
+  snprintf(key, sizeof(key), "%s Custom Data %d", area, n);
+  add_field(b, key, type_len, val);
+}
+
+static void add_int(inv_builder_t *b, const char *key, uint32_t val)
+{
+  char str[16];
+
+  snprintf(str, sizeof(str), "%u", val);
+  inv_builder_add(b, key, str);
+}
+
+/* Same fields and labels as fruid-util */
+static int gather_fruid(uint8_t fru, inv_builder_t *b)
+{
+  char path[128] = {0};
+  fruid_info_t f;
+
+  if (!(frus[fru].caps & FRU_CAPABILITY_FRUID_READ) ||
+      pal_get_fruid_path(fru, path) < 0 || fruid_parse(path, &f))
+    return -1;
+
+  if (f.chassis.flag) {
+    inv_builder_add(b, "Chassis Type", f.chassis.type_str);
+    add_field(b, "Chassis Part Number", f.chassis.part_type_len, f.chassis.part);
+    add_field(b, "Chassis Serial Number", f.chassis.serial_type_len, f.chassis.serial);
+    add_custom(b, "Chassis", 1, f.chassis.custom1_type_len, f.chassis.custom1);
+    add_custom(b, "Chassis", 2, f.chassis.custom2_type_len, f.chassis.custom2);
+    add_custom(b, "Chassis", 3, f.chassis.custom3_type_len, f.chassis.custom3);
+    add_custom(b, "Chassis", 4, f.chassis.custom4_type_len, f.chassis.custom4);
+    add_custom(b, "Chassis", 5, f.chassis.custom5_type_len, f.chassis.custom5);
+    add_custom(b, "Chassis", 6, f.chassis.custom6_type_len, f.chassis.custom6);
+  }
+  if (f.board.flag) {
+    inv_builder_add(b, "Board Mfg Date", f.board.mfg_time_str);
+    add_field(b, "Board Mfg", f.board.mfg_type_len, f.board.mfg);
+    add_field(b, "Board Product", f.board.name_type_len, f.board.name);
+    add_field(b, "Board Serial", f.board.serial_type_len, f.board.serial);
+    add_field(b, "Board Part Number", f.board.part_type_len, f.board.part);
+    add_field(b, "Board FRU ID", f.board.fruid_type_len, f.board.fruid);
+    add_custom(b, "Board", 1, f.board.custom1_type_len, f.board.custom1);
+    add_custom(b, "Board", 2, f.board.custom2_type_len, f.board.custom2);
+    add_custom(b, "Board", 3, f.board.custom3_type_len, f.board.custom3);
+    add_custom(b, "Board", 4, f.board.custom4_type_len, f.board.custom4);
+    add_custom(b, "Board", 5, f.board.custom5_type_len, f.board.custom5);
+    add_custom(b, "Board", 6, f.board.custom6_type_len, f.board.custom6);
+  }
+  if (f.product.flag) {
+    add_field(b, "Product Manufacturer", f.product.mfg_type_len, f.product.mfg);
+    add_field(b, "Product Name", f.product.name_type_len, f.product.name);
+    add_field(b, "Product Part Number", f.product.part_type_len, f.product.part);
+    add_field(b, "Product Version", f.product.version_type_len, f.product.version);
+    add_field(b, "Product Serial", f.product.serial_type_len, f.product.serial);
+    add_field(b, "Product Asset Tag", f.product.asset_tag_type_len, f.product.asset_tag);
+    add_field(b, "Product FRU ID", f.product.fruid_type_len, f.product.fruid);
+    add_custom(b, "Product", 1, f.product.custom1_type_len, f.product.custom1);
+    add_custom(b, "Product", 2, f.product.custom2_type_len, f.product.custom2);
+    add_custom(b, "Product", 3, f.product.custom3_type_len, f.product.custom3);
+    add_custom(b, "Product", 4, f.product.custom4_type_len, f.product.custom4);
+    add_custom(b, "Product", 5, f.product.custom5_type_len, f.product.custom5);
+    add_custom(b, "Product", 6, f.product.custom6_type_len, f.product.custom6);
+  }
+  if (f.multirecord_smart_fan.flag) {
+    add_int(b, "Smart Fan Manufacturer ID", f.multirecord_smart_fan.manufacturer_id);
+    inv_builder_add(b, "Smart Fan Version", f.multirecord_smart_fan.smart_fan_ver);
+    inv_builder_add(b, "Smart Fan FW Version", f.multirecord_smart_fan.fw_ver);
+    inv_builder_add(b, "Smart Fan Mfg Date", f.multirecord_smart_fan.mfg_time_str);
+    if (strlen(f.multirecord_smart_fan.mfg_line) != 0)
+      inv_builder_add(b, "Smart Fan Mfg Line", f.multirecord_smart_fan.mfg_line);
+    if (strlen(f.multirecord_smart_fan.clei_code) != 0)
+      inv_builder_add(b, "Smart Fan CLEI Code", f.multirecord_smart_fan.clei_code);
+    add_int(b, "Smart Fan Voltage (mV)", f.multirecord_smart_fan.voltage);
+    add_int(b, "Smart Fan Current (mA)", f.multirecord_smart_fan.current);
+    add_int(b, "Smart Fan Front RPM", f.multirecord_smart_fan.rpm_front);
+    add_int(b, "Smart Fan Rear RPM", f.multirecord_smart_fan.rpm_rear);
+  }
+  free_fruid_info(&f);
+  return 0;
+}
+
+/* Run a utility and keep its output, one entry per line */
+static int gather_tool(const char *tool, const char *name, const char *args, inv_builder_t *b)
+{
+  char cmd[128];
+  char *line = NULL;
+  size_t size = 0;
+  FILE *fp;
+  int status;
+
+  if (access(tool, X_OK))
+    return -1;
+  snprintf(cmd, sizeof(cmd), "%s %s %s 2>/dev/null", tool, name, args);
+  fp = popen(cmd, "r");
+  if (fp == NULL)
+    return -1;
+  while (getline(&line, &size, fp) > 0)
+    inv_builder_add_line(b, line);
+  free(line);
+  status = pclose(fp);
+  if (status == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    return -1;
+  return b->count > 0 ? 0 : -1;
+}
+
+static void gather(uint8_t fru, uint8_t kinds, uint32_t prsnt_gen)
+{
+  inv_fru_t *f = &frus[fru];
+  inv_builder_t b;
+  uint8_t kind;
+  int ret;
+
+  /* Don't race fw-util, the poller queues these again afterwards */
+  if ((kinds & POWER_KINDS) && pal_is_fw_update_ongoing(fru)) {
+    pthread_mutex_lock(&lock);
+    f->deferred |= kinds & POWER_KINDS;
+    pthread_mutex_unlock(&lock);
+    kinds &= ~POWER_KINDS;
+  }
+
+  for (kind = 0; kind < INV_KINDS; kind++) {
+    if (!(kinds & KIND_MASK(kind)))
+      continue;
+    if (inv_builder_init(&b, fru, kind))
+      continue;
+    switch (kind) {
+      case INV_FRUID:
+        ret = gather_fruid(fru, &b);
+        break;
+      case INV_DIMM:
+        ret = (f->caps & FRU_CAPABILITY_SERVER) ?
+          gather_tool(DIMM_UTIL, f->name, "--config", &b) : -1;
+        break;
+      default:
+        ret = gather_tool(FW_UTIL, f->name, "--version", &b);
+        break;
+    }
+    if (ret == 0)
+      store(fru, kind, prsnt_gen, &b);
+    else
+      store_failed(fru, kind, prsnt_gen);
+    inv_builder_free(&b);
+  }
+}
+
+static void *worker(void *arg)
+{
+  uint8_t fru, kinds;
+  uint32_t prsnt_gen;
+
+  pthread_mutex_lock(&lock);
+  while (1) {
+    for (fru = 1; fru <= MAX_NUM_FRUS; fru++) {
+      if (frus[fru].queued && !frus[fru].busy)
+        break;
+    }
+    if (fru > MAX_NUM_FRUS) {
+      pthread_cond_wait(&work_cond, &lock);
+      continue;
+    }
+    kinds = frus[fru].queued;
+    frus[fru].queued = 0;
+    frus[fru].busy = true;
+    prsnt_gen = frus[fru].prsnt_gen;
+    pthread_mutex_unlock(&lock);
+
+    gather(fru, kinds, prsnt_gen);
+
+    pthread_mutex_lock(&lock);
+    frus[fru].busy = false;
+    if (frus[fru].queued)
+      pthread_cond_signal(&work_cond);
+  }
+  return NULL;
+}
+
+/*
+ * The power state last recorded by power-util and the platform gpiod, a
+ * key-value read. pal_get_server_power() can be an IPMB request to the
+ * BIC (fby2), which is too much to send every few seconds per slot; it
+ * is only used on platforms which don't record the state.
+ */
+static int get_power(uint8_t fru, uint8_t *power)
+{
+  char state[MAX_VALUE_LEN] = {0};
+  uint8_t status;
+
+  if (pal_get_last_pwr_state(fru, state) == 0 && state[0] != '\0') {
+    *power = !strcmp(state, "on");
+    return 0;
+  }
+  if (pal_get_server_power(fru, &status))
+    return -1;
+  *power = (status == SERVER_POWER_ON);
+  return 0;
+}
+
+/*
+ * Presence and power changes are what invalidates the inventory, so the
+ * states are polled here. There is no common event source to subscribe
+ * to instead: the platforms learn about them in their own gpiod or
+ * hotplug scripts, several of which poll GPIOs themselves, and a host
+ * can power off without the BMC asking it to. Reading the states is
+ * cheap compared to the FRUID, SPD and version reads, which only happen
+ * on a change. Tools which cause a change can call inventory_refresh()
+ * to skip the wait.
+ */
+static void poll_events(void)
+{
+  uint8_t fru, prsnt, power, kinds, kind;
+
+  for (fru = 1; fru <= MAX_NUM_FRUS; fru++) {
+    inv_fru_t *f = &frus[fru];
+
+    if (!f->valid)
+      continue;
+    kinds = 0;
+    if (pal_is_fru_prsnt(fru, &prsnt))
+      prsnt = f->prsnt == STATE_UNKNOWN ? 1 : f->prsnt;
+    if (prsnt != f->prsnt) {
+      pthread_mutex_lock(&lock);
+      for (kind = 0; kind < INV_KINDS; kind++)
+        data_clear(&f->data[kind], prsnt ? INV_ERR_PENDING : INV_ERR_ABSENT);
+      if (f->prsnt != STATE_UNKNOWN)
+        syslog(LOG_INFO, "%s %s", f->name, prsnt ? "inserted" : "removed");
+      f->prsnt = prsnt;
+      f->prsnt_gen++;
+      f->deferred = 0;
+      pthread_mutex_unlock(&lock);
+      kinds = prsnt ? ALL_KINDS : 0;
+    }
+    /* Leave the BIC alone during an update, the change is seen after it */
+    if (f->prsnt == 1 && (f->caps & FRU_CAPABILITY_POWER_STATUS) &&
+        !pal_is_fw_update_ongoing(fru) &&
+        get_power(fru, &power) == 0 && power != f->power) {
+      if (f->power != STATE_UNKNOWN)
+        kinds |= POWER_KINDS;
+      f->power = power;
+    }
+    pthread_mutex_lock(&lock);
+    if (f->deferred && !pal_is_fw_update_ongoing(fru)) {
+      kinds |= f->deferred;
+      f->deferred = 0;
+    }
+    queue_fru(fru, kinds);
+    pthread_mutex_unlock(&lock);
+  }
+}
+
+static int send_resp(client_t *cli, uint8_t status, const inv_data_t *d,
+                     const uint8_t *data, size_t total, uint32_t offset)
+{
+  uint8_t resp[INV_MAX_RESP];
+  inv_resp_hdr_t *hdr = (inv_resp_hdr_t *)resp;
+  size_t n = 0;
+
+  memset(hdr, 0, sizeof(*hdr));
+  hdr->status = status;
+  if (d != NULL && status == INV_OK) {
+    if (offset < total) {
+      n = total - offset;
+      if (n > INV_CHUNK)
+        n = INV_CHUNK;
+      memcpy(resp + sizeof(*hdr), data + offset, n);
+    }
+    hdr->len = n;
+    hdr->total = total;
+    hdr->gen = d->gen;
+    hdr->age = now_sec() - d->ts;
+  }
+  return ipc_send_resp(cli, resp, sizeof(*hdr) + n);
+}
+
+static int conn_handler(client_t *cli)
+{
+  inv_req_t req;
+  size_t len = sizeof(req);
+  inv_data_t *d;
+  int ret;
+
+  if (ipc_recv_req(cli, (uint8_t *)&req, &len, INVENTORY_TIMEOUT) ||
+      len != sizeof(req))
+    return -1;
+
+  if (req.cmd == INV_CMD_REFRESH) {
+    if (req.fru == 0) {
+      queue_all(ALL_KINDS);
+    } else if (req.fru > MAX_NUM_FRUS || !frus[req.fru].valid) {
+      return send_resp(cli, INV_ERR_INVALID, NULL, NULL, 0, 0);
+    } else {
+      pthread_mutex_lock(&lock);
+      queue_fru(req.fru, ALL_KINDS);
+      pthread_mutex_unlock(&lock);
+    }
+    return send_resp(cli, INV_OK, NULL, NULL, 0, 0);
+  }
+
+  if (req.cmd != INV_CMD_GET || req.fru == 0 || req.fru > MAX_NUM_FRUS ||
+      !frus[req.fru].valid || req.kind >= INV_KINDS)
+    return send_resp(cli, INV_ERR_INVALID, NULL, NULL, 0, 0);
+
+  pthread_mutex_lock(&lock);
+  d = &frus[req.fru].data[req.kind];
+  if (d->status != INV_OK)
+    ret = send_resp(cli, d->status, NULL, NULL, 0, 0);
+  else if (req.fmt == INV_FMT_JSON)
+    ret = send_resp(cli, d->json ? INV_OK : INV_ERR_ABSENT, d,
+                    (uint8_t *)d->json, d->json_len, req.offset);
+  else
+    ret = send_resp(cli, INV_OK, d, d->bin, d->bin_len, req.offset);
+  pthread_mutex_unlock(&lock);
+  return ret;
+}
+
+static void sig_handler(int sig)
+{
+  refresh_all = 1;
+}
+
+static void init_frus(void)
+{
+  uint8_t fru, kind;
+
+  for (fru = 1; fru <= MAX_NUM_FRUS; fru++) {
+    inv_fru_t *f = &frus[fru];
+
+    if (pal_get_fru_name(fru, f->name) || pal_get_fru_capability(fru, &f->caps))
+      continue;
+    f->valid = true;
+    f->prsnt = STATE_UNKNOWN;
+    f->power = STATE_UNKNOWN;
+    for (kind = 0; kind < INV_KINDS; kind++)
+      f->data[kind].status = INV_ERR_PENDING;
+  }
+}
+
+static void
+print_usage(const char *name) {
+  printf("Usage: %s [-r <refresh interval in seconds>]\n", name);
+}
+
+int
+main(int argc, char **argv) {
+  pthread_t tid;
+  time_t last_refresh;
+  int i, c;
+
+  while ((c = getopt(argc, argv, "r:h")) != -1) {
+    switch (c) {
+      case 'r':
+        refresh_interval = atoi(optarg);
+        break;
+      default:
+        print_usage(argv[0]);
+        return c == 'h' ? 0 : -1;
+    }
+  }
+
+  openlog("inventoryd", LOG_CONS, LOG_DAEMON);
+  signal(SIGHUP, sig_handler);
+  signal(SIGPIPE, SIG_IGN);
+
+  init_frus();
+  for (i = 0; i < MAX_WORKERS; i++) {
+    if (pthread_create(&tid, NULL, worker, NULL)) {
+      syslog(LOG_CRIT, "Cannot create the inventory workers");
+      return -1;
+    }
+    pthread_detach(tid);
+  }
+
+  /* The first poll finds every present FRU and gathers it */
+  poll_events();
+  last_refresh = now_sec();
+
+  if (ipc_start_svc(INVENTORY_ENDPOINT, conn_handler, MAX_REQUESTS, NULL, NULL)) {
+    syslog(LOG_CRIT, "Cannot start the inventory service");
+    return -1;
+  }
+
+  while (1) {
+    sleep(POLL_INTERVAL);
+    poll_events();
+    if (refresh_all ||
+        (refresh_interval > 0 && now_sec() - last_refresh >= refresh_interval)) {
+      refresh_all = 0;
+      last_refresh = now_sec();
+      queue_all(ALL_KINDS);
+    }
+  }
+  return 0;
+}
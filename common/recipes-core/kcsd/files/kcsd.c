@@ -52,6 +52,7 @@
 #include <pthread.h>
 #include <sys/un.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -61,6 +62,8 @@
 #include <signal.h>
 #include <time.h>
 #include <getopt.h>
+#include <poll.h>
+#include <limits.h>
 
 #include <openbmc/ipmi.h>
 #include <openbmc/libgpio.h>
@@ -70,6 +73,15 @@
 #define DEFAULT_BMC_READY_GPIO_SHADOW  "BMC_READY_N"
 static gpio_desc_t *bmc_ready_n = NULL;
 static int kcs_fd = -1;
+static uint8_t kcs_channel_num = 2;
+
+/*
+ * The upstream ipmi-kcs driver wakes up poll() as soon as the host
+ * latches a request, so kcsd sleeps in poll() until there is work.
+ * The legacy ast-kcs driver (kernel 4.1) has no poll support and must
+ * still be sampled every 10 milliseconds.
+ */
+static bool kcs_legacy = false;
 
 #define TOUCH(path)            \
 do {                           \
@@ -78,6 +90,24 @@ do {                           \
     close(_fd);                \
 } while (0)
 
+/*
+ * kcsd liveness is published in shared memory "/kcsd_<channel>", so
+ * it costs a couple of stores per request instead of a file create.
+ * Readers should compare "seq" before and after reading the record.
+ */
+#define KCSD_SHM_NAME  "/kcsd_%u"
+#define KCS_TOUCH_FILE "/tmp/kcs_touch"
+
+typedef struct {
+  uint32_t seq;          /* odd while the record is being updated */
+  uint32_t pid;
+  uint64_t req_count;
+  uint64_t last_req_sec; /* CLOCK_REALTIME of the last host request */
+  uint64_t last_req_nsec;
+} kcsd_liveness_t;
+
+static kcsd_liveness_t *liveness = NULL;
+
 #define FRU_SERVER 0x1  //payload id for FRU_SERVER
 
 static const uint8_t default_add_sel_resp[5] = {0x2c, 0x44, 0x00, 0x00, 0x00};
@@ -158,6 +188,61 @@ static bool is_add_sel_req(uint8_t *buff)
          (buff[1] == CMD_STORAGE_ADD_SEL);
 }
 
+static void liveness_init(void)
+{
+  char name[NAME_MAX];
+  void *ptr;
+  int fd;
+
+  snprintf(name, sizeof(name), KCSD_SHM_NAME, kcs_channel_num);
+  fd = shm_open(name, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  if (fd < 0) {
+    OBMC_ERROR(errno, "failed to open shm %s", name);
+    return;
+  }
+  if (ftruncate(fd, sizeof(kcsd_liveness_t)) != 0) {
+    OBMC_ERROR(errno, "failed to truncate shm %s", name);
+    close(fd);
+    return;
+  }
+  ptr = mmap(NULL, sizeof(kcsd_liveness_t), PROT_READ | PROT_WRITE,
+             MAP_SHARED, fd, 0);
+  close(fd);
+  if (ptr == MAP_FAILED) {
+    OBMC_ERROR(errno, "failed to mmap shm %s", name);
+    return;
+  }
+  liveness = ptr;
+  memset(liveness, 0, sizeof(*liveness));
+  liveness->pid = getpid();
+}
+
+/*
+ * Record a host request. /tmp/kcs_touch is still maintained for the
+ * platform libraries that stat() it, but since its mtime only has one
+ * second resolution for them, it is recreated at most once per second.
+ */
+static void liveness_update(void)
+{
+  static time_t last_touch = 0;
+  struct timespec now;
+
+  clock_gettime(CLOCK_REALTIME, &now);
+  if (liveness) {
+    __atomic_store_n(&liveness->seq, liveness->seq + 1, __ATOMIC_RELAXED);
+    // Keep the data stores below from becoming visible before the odd seq.
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    liveness->req_count++;
+    liveness->last_req_sec = now.tv_sec;
+    liveness->last_req_nsec = now.tv_nsec;
+    __atomic_store_n(&liveness->seq, liveness->seq + 1, __ATOMIC_RELEASE);
+  }
+  if (now.tv_sec != last_touch) {
+    TOUCH(KCS_TOUCH_FILE);
+    last_touch = now.tv_sec;
+  }
+}
+
 static void set_bmc_ready(bool ready)
 {
   /* Active low */
@@ -227,10 +312,17 @@ static void *handle_add_sel(void *unused)
 }
 
 static void *kcs_thread(void *unused) {
-  struct timespec req;
-  struct timespec rem;
-  unsigned char req_len;
+  struct pollfd pfd = {
+    .fd = kcs_fd,
+    .events = POLLIN,
+  };
+  struct timespec req = {
+    .tv_sec = 0,
+    .tv_nsec = 10000000, //10mSec
+  };
+  ssize_t req_len;
   unsigned short res_len;
+  int ret;
   uint8_t req_buf[256];
   uint8_t res_buf[300];
 
@@ -246,14 +338,23 @@ static void *kcs_thread(void *unused) {
 
   set_bmc_ready(true);
 
-  // Setup wait time
-  req.tv_sec = 0;
-  req.tv_nsec = 10000000;//10mSec
-
   while (1) {
+    if (!kcs_legacy) {
+      ret = poll(&pfd, 1, -1);
+      if (ret < 0) {
+        if (errno != EINTR) {
+          OBMC_ERROR(errno, "failed to poll kcs device");
+          sleep(1);
+        }
+        continue;
+      }
+    }
+
     req_len = read(kcs_fd, req_buf, sizeof(req_buf));
     if (req_len <= 0) {
-      nanosleep(&req, &rem);
+      if (kcs_legacy) {
+        nanosleep(&req, NULL);
+      }
       continue;
     }
 
@@ -264,11 +365,11 @@ static void *kcs_thread(void *unused) {
     for(i=0; i < req_len; i++) {
       snprintf(cmd, sizeof(cmd), "%s %02x", cmd, req_buf[i]);
     }
-    OBMC_WARN("[ %ld.%ld ] KCS Req: %s, len=%d",
+    OBMC_WARN("[ %ld.%ld ] KCS Req: %s, len=%zd",
               req_tv.tv_sec, req_tv.tv_nsec, cmd, req_len);
 #endif
 
-    TOUCH("/tmp/kcs_touch");
+    liveness_update();
 
     if ( true == is_add_sel_req(req_buf)) {
       KCSD_VERBOSE("kcs_dev: new SEL entry received");
@@ -296,7 +397,10 @@ static void *kcs_thread(void *unused) {
       lib_ipmi_handle(req_buf, req_len + 1, res_buf, &res_len);
     }
 
-    res_len = write(kcs_fd, res_buf, res_len);
+    if (write(kcs_fd, res_buf, res_len) != res_len) {
+      OBMC_ERROR(errno, "failed to write kcs response (netfn=0x%02x, cmd=0x%02x)",
+                 res_buf[0], res_buf[1]);
+    }
 
 #ifdef DEBUG
     memset(cmd, 0, 200);
@@ -324,7 +428,7 @@ static int kcs_open_new(uint8_t channel)
 
   channel++; /* convert to 1-based channel number */
   snprintf(path, sizeof(path), "/dev/ipmi-kcs%d", channel);
-  fd = open(path, O_RDWR);
+  fd = open(path, O_RDWR | O_NONBLOCK);
   if (fd < 0) {
     OBMC_ERROR(errno, "failed to open kcs device %s", path);
   } else {
@@ -354,6 +458,7 @@ static int kcs_open_legacy(uint8_t channel)
     OBMC_ERROR(errno, "failed to open kcs device %s", path);
   } else {
     OBMC_INFO("opened kcs device %s, fd=%d", path, fd);
+    kcs_legacy = true;
   }
 
   return fd;
@@ -382,7 +487,6 @@ main(int argc, char * const argv[]) {
   int ret;
   pthread_t kcs_tid;
   pthread_t add_sel_tid;
-  uint8_t kcs_channel_num = 2;
   const char *bmc_ready_n_shadow = DEFAULT_BMC_READY_GPIO_SHADOW;
   struct option long_opts[] = {
     {"help",       no_argument, NULL, 'h'},
@@ -445,6 +549,8 @@ main(int argc, char * const argv[]) {
     }
   }
 
+  liveness_init();
+
   sleep(1);
 
   KCSD_VERBOSE("creating kcs_dev thread");
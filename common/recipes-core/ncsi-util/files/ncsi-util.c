@@ -379,6 +379,9 @@ static int pldm_update_fw(char *path, int pldm_bufsize, uint8_t ch)
 
 
 
+  // Components are updated one at a time: UpdateComponent, then the FD
+  // requests the data of that component until it applied it
+  int pldmCmd = 0;
   for (i=0; i<pkgHdr->componentImageCnt; ++i) {
     memset(&pldmReq, 0, sizeof(pldm_cmd_req));
     pldmCreateUpdateComponentCmd(pkgHdr, i, &pldmReq);
@@ -393,48 +396,14 @@ static int pldm_update_fw(char *path, int pldm_bufsize, uint8_t ch)
       ret = -1;
       goto free_exit;
     }
-  }
 
-  // FW data transfer
-  int loopCount = 0;
-  int idleCnt = 0;
-  int pldmCmd = 0;
-  setPldmTimeout(CMD_UPDATE_COMPONENT, &waitTOsec);
-  while (idleCnt < (waitTOsec * 1000 /SLEEP_TIME_MS) ) {
-//    printf("\n04 QueryPendingNcPldmRequestOp, loop=%d\n", loopCount);
-    ret = create_ncsi_ctrl_pkt(nl_msg, ch, NCSI_QUERY_PENDING_NC_PLDM_REQ, 0, NULL);
-    if (ret) {
-      goto free_exit;
-    }
-    nl_resp = send_nl_msg_retry(nl_msg);
-    if (!nl_resp) {
-      ret = -1;
-      goto free_exit;
-    }
-    print_pldm_cmd_status(nl_resp);
-
-    pldmCmd = ncsiGetPldmCmd(nl_resp, &pldmReq);
-    free(nl_resp);
-    nl_resp = NULL;
-    if (pldmCmd == -1) {
-  //    printf("No pending command, loop %d\n", idleCnt);
-      msleep(SLEEP_TIME_MS); // wait some time and try again
-      idleCnt++;
-      continue;
-    } else {
-      idleCnt = 0;
-    }
-
-    if ( (pldmCmd == CMD_REQUEST_FIRMWARE_DATA) ||
-         (pldmCmd == CMD_TRANSFER_COMPLETE) ||
-         (pldmCmd == CMD_VERIFY_COMPLETE) ||
-         (pldmCmd == CMD_APPLY_COMPLETE)) {
-      setPldmTimeout(pldmCmd, &waitTOsec);
-      loopCount++;
-      waitcycle = 0;
-      pldmCmdStatus = pldmFwUpdateCmdHandler(pkgHdr, &pldmReq, pldmRes);
-      ret = create_ncsi_ctrl_pkt(nl_msg, ch, NCSI_SEND_NC_PLDM_REPLY,
-                                 pldmRes->resp_size, pldmRes->common);
+    // FW data transfer
+    int loopCount = 0;
+    int idleCnt = 0;
+    setPldmTimeout(CMD_UPDATE_COMPONENT, &waitTOsec);
+    while (idleCnt < (waitTOsec * 1000 /SLEEP_TIME_MS) ) {
+  //    printf("\n04 QueryPendingNcPldmRequestOp, loop=%d\n", loopCount);
+      ret = create_ncsi_ctrl_pkt(nl_msg, ch, NCSI_QUERY_PENDING_NC_PLDM_REQ, 0, NULL);
       if (ret) {
         goto free_exit;
       }
@@ -443,21 +412,57 @@ static int pldm_update_fw(char *path, int pldm_bufsize, uint8_t ch)
         ret = -1;
         goto free_exit;
       }
-      //print_ncsi_resp(nl_resp);
+      print_pldm_cmd_status(nl_resp);
+
+      pldmCmd = ncsiGetPldmCmd(nl_resp, &pldmReq);
       free(nl_resp);
       nl_resp = NULL;
-      if ((pldmCmd == CMD_APPLY_COMPLETE) || (pldmCmdStatus == -1))
-        break;
-      if (nl_conf == 0) // Linux 4.1
-        msleep(10); // add dealy to reduce retry sending request to NIC
-    } else {
-      printf("unknown PLDM cmd 0x%x\n", pldmCmd);
-      waitcycle++;
-      if (waitcycle >= MAX_WAIT_CYCLE) {
-        printf("max wait cycle exceeded, exit\n");
-        break;
+      if (pldmCmd == -1) {
+    //    printf("No pending command, loop %d\n", idleCnt);
+        msleep(SLEEP_TIME_MS); // wait some time and try again
+        idleCnt++;
+        continue;
+      } else {
+        idleCnt = 0;
+      }
+
+      if ( (pldmCmd == CMD_REQUEST_FIRMWARE_DATA) ||
+           (pldmCmd == CMD_TRANSFER_COMPLETE) ||
+           (pldmCmd == CMD_VERIFY_COMPLETE) ||
+           (pldmCmd == CMD_APPLY_COMPLETE)) {
+        setPldmTimeout(pldmCmd, &waitTOsec);
+        loopCount++;
+        waitcycle = 0;
+        pldmCmdStatus = pldmFwUpdateCmdHandler(pkgHdr, &pldmReq, pldmRes);
+        ret = create_ncsi_ctrl_pkt(nl_msg, ch, NCSI_SEND_NC_PLDM_REPLY,
+                                   pldmRes->resp_size, pldmRes->common);
+        if (ret) {
+          goto free_exit;
+        }
+        nl_resp = send_nl_msg_retry(nl_msg);
+        if (!nl_resp) {
+          ret = -1;
+          goto free_exit;
+        }
+        //print_ncsi_resp(nl_resp);
+        free(nl_resp);
+        nl_resp = NULL;
+        if ((pldmCmd == CMD_APPLY_COMPLETE) || (pldmCmdStatus == -1))
+          break;
+        if (nl_conf == 0) // Linux 4.1
+          msleep(10); // add dealy to reduce retry sending request to NIC
+      } else {
+        printf("unknown PLDM cmd 0x%x\n", pldmCmd);
+        waitcycle++;
+        if (waitcycle >= MAX_WAIT_CYCLE) {
+          printf("max wait cycle exceeded, exit\n");
+          break;
+        }
       }
     }
+
+    if (pldmCmdStatus || (pldmCmd != CMD_APPLY_COMPLETE))
+      break;
   }
 
   // only activate FW if update loop exists with good status
@@ -48,6 +48,7 @@ print_usage(const char *name, const char psu_num) {
     }
   }
   printf("> --update <file_path>\n");
+  printf("Usage: %s all --update <file_path>\n", name);
 
   printf("Usage: %s <", name);
   for (i = 0; i < psu_num; i++)
@@ -83,6 +84,33 @@ char get_psu_id(const char *name, const char psu_num)
   return ret;
 }
 
+/* Update all present PSUs, the ones on different buses in parallel */
+static int
+update_all_psus(const char *file_path, const char *vendor, const char psu_num) {
+  uint8_t nums[psu_num];
+  uint8_t i, prsnt = 0;
+  int count = 0, ret;
+
+  for (i = 0; i < psu_num; i++) {
+    if (is_psu_prsnt(i, &prsnt) == 0 && prsnt) {
+      nums[count++] = i;
+    }
+  }
+  if (count == 0) {
+    printf("No PSU is present!\n");
+    return 0;
+  }
+
+  ret = do_update_psus(nums, count, file_path, vendor, NULL);
+  if (ret) {
+    syslog(LOG_WARNING, "PSU update fail!");
+    printf("PSU update fail!\n");
+  } else {
+    syslog(LOG_WARNING, "PSU update success!");
+  }
+  return ret;
+}
+
 int
 main(int argc, const char *argv[]) {
   uint8_t psu_slot = 0, prsnt = 0;
@@ -94,8 +122,13 @@ main(int argc, const char *argv[]) {
     return -1;
   }
 
-  psu_slot = get_psu_id(argv[1], PSU_NUM);
-  if (psu_slot < 0) {
+  if (strcmp(argv[1], "all")) {
+    psu_slot = get_psu_id(argv[1], PSU_NUM);
+    if (psu_slot < 0) {
+      print_usage(argv[0], PSU_NUM);
+      return -1;
+    }
+  } else if (strcmp(argv[2], "--update") || argv[3] == NULL) {
     print_usage(argv[0], PSU_NUM);
     return -1;
   }
@@ -111,6 +144,10 @@ main(int argc, const char *argv[]) {
     exit(EXIT_FAILURE);
   }
 
+  if (!strcmp(argv[1], "all")) {
+    return update_all_psus(argv[3], argv[4], PSU_NUM);
+  }
+
   ret = is_psu_prsnt(psu_slot, &prsnt);
   if (ret) {
     printf("Get PSU%d present error!\n", psu_slot + 1);
@@ -25,9 +25,11 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <poll.h>
 #include <sys/ioctl.h>
 #include <sched.h>
 #include <pthread.h>
+#include <linux/serial.h>
 
 
 int verbose = 0;
@@ -57,6 +59,57 @@ int timespec_sub(struct timespec *start,
   return 0;
 }
 
+static void timespec_add_us(struct timespec *ts, long us)
+{
+  ts->tv_sec += us / 1000000;
+  ts->tv_nsec += (us % 1000000) * 1000;
+  if (ts->tv_nsec >= 1000000000) {
+    ts->tv_nsec -= 1000000000;
+    ts->tv_sec++;
+  }
+}
+
+static int baud_to_int(speed_t baudrate) {
+  int val = atoi(baud_to_str(baudrate));
+  return val > 0 ? val : 19200;
+}
+
+/*
+ * Time on the wire of len characters: start bit, 8 data bits, parity
+ * and stop bit each.
+ */
+static long char_time_us(speed_t baudrate, size_t len) {
+  return (long)len * 11 * 1000000 / baud_to_int(baudrate);
+}
+
+/*
+ * Let the UART driver drive the transceiver direction: RTS is switched
+ * for the transmission and back once the last bit is out, and the
+ * receiver is off meanwhile, so the request is not read back. The RTS
+ * levels are the ones rackmond always used. Returns 0 only if the driver
+ * took these settings.
+ */
+int modbus_rs485_enable(int fd) {
+  struct serial_rs485 conf;
+
+  memset(&conf, 0, sizeof(conf));
+  conf.flags = SER_RS485_ENABLED | SER_RS485_RTS_AFTER_SEND;
+  if (ioctl(fd, TIOCSRS485, &conf) < 0) {
+    return -1;
+  }
+  return modbus_rs485_enabled(fd) ? 0 : -1;
+}
+
+bool modbus_rs485_enabled(int fd) {
+  struct serial_rs485 conf;
+
+  if (ioctl(fd, TIOCGRS485, &conf) < 0) {
+    return false;
+  }
+  return (conf.flags & SER_RS485_ENABLED) &&
+         !(conf.flags & SER_RS485_RX_DURING_TX);
+}
+
 int waitfd(int fd) {
   int loops = 0;
   while(1) {
@@ -129,17 +182,13 @@ size_t read_wait(int fd, char* dst, size_t maxlen, int mdelay_us, const char *ca
     FD_SET(fd, &fdset);
     timeout.tv_sec = 0;
     timeout.tv_usec = mdelay_us;
-    CHECK_LATENCY_START();
     rv = select(fd + 1, &fdset, NULL, NULL, &timeout);
-    CHECK_LATENCY_END("rackmond::%s::modbuscmd::read_wait::select", caller);
     if(rv == -1) {
       perror("select()");
     } else if (rv == 0) {
       break;
     }
-    CHECK_LATENCY_START();
     read_size = read(fd, read_buf, 16);
-    CHECK_LATENCY_END("rackmond::%s::modbuscmd::read_wait::read", caller);
     if(read_size < 0) {
       if(errno == EAGAIN) continue;
       fprintf(stderr, "read error: %s\n", strerror(errno));
@@ -239,23 +288,153 @@ double ts_diff (struct timespec* begin, struct timespec* end) {
     - (1000.0 * (begin->tv_sec) + (1e-6 * begin->tv_nsec));
 }
 
+void modbus_latency_record(modbus_latency_hist *h, long us) {
+  int b = 0;
+
+  while (b < MODBUS_LATENCY_BUCKETS - 1 && us >= (1000L << b)) {
+    b++;
+  }
+  h->count[b]++;
+  h->total_us += us;
+  if (us > h->max_us) {
+    h->max_us = us;
+  }
+}
+
+/*
+ * Length of the response frame, as far as it is known from its first
+ * bytes: exception responses are always 5 bytes, read responses carry
+ * their byte count. Otherwise trust the caller.
+ */
+static size_t frame_len(modbus_req *req, const char *buf, size_t pos) {
+  size_t len = req->expected_len;
+
+  if (pos >= 2 && (buf[1] & 0x80)) {
+    len = 5;
+  } else if (pos >= 3 && buf[1] == MODBUS_READ_HOLDING_REGISTERS &&
+             buf[1] == req->modbus_cmd[1]) {
+    len = 5 + (uint8_t)buf[2];
+  }
+  return len < req->dest_limit ? len : req->dest_limit;
+}
+
+/*
+ * Read one response frame into req->dest_buf. The first byte has to come
+ * within first_us, the frame ends at its known length or when the line
+ * has been quiet for gap_us. Bytes before the slave address, such as the
+ * noise of a direction switch, are dropped. If sent is given, an echo of
+ * it at the start is dropped as well and the response waited for again.
+ */
+static size_t read_frame(modbus_req *req, const char *sent, size_t sent_len,
+                         long first_us, long gap_us, const char *caller) {
+  struct pollfd pfd = { .fd = req->tty_fd, .events = POLLIN };
+  struct timespec now, deadline, left;
+  size_t want = frame_len(req, req->dest_buf, 0);
+  size_t pos = 0, skip;
+  ssize_t n;
+
+  if (sent && want < sent_len) {
+    want = sent_len;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  timespec_add_us(&deadline, first_us);
+  while (pos < want) {
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (timespec_sub(&now, &deadline, &left) < 0) {
+      break;
+    }
+    n = ppoll(&pfd, 1, &left, NULL);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      OBMC_ERROR(errno, "%s: poll failed", caller);
+      break;
+    } else if (n == 0) {
+      break;
+    }
+    n = read(req->tty_fd, req->dest_buf + pos, want - pos);
+    if (n < 0) {
+      if (errno == EAGAIN || errno == EINTR) {
+        continue;
+      }
+      OBMC_ERROR(errno, "%s: read failed", caller);
+      break;
+    }
+    if (pos == 0) {
+      for (skip = 0; skip < (size_t)n && req->dest_buf[skip] != req->modbus_cmd[0]; skip++);
+      if (skip > 0) {
+        dbg("[*] dropped %zu bytes before the response\n", skip);
+        memmove(req->dest_buf, req->dest_buf + skip, n - skip);
+        n -= skip;
+      }
+    }
+    pos += n;
+    if (sent && memcmp(req->dest_buf, sent, pos < sent_len ? pos : sent_len)) {
+      sent = NULL;
+    } else if (sent && pos >= sent_len) {
+      dbg("[*] dropped the echo of the request\n");
+      memmove(req->dest_buf, req->dest_buf + sent_len, pos - sent_len);
+      pos -= sent_len;
+      req->echoed = true;
+      sent = NULL;
+      if (pos == 0) {
+        want = frame_len(req, req->dest_buf, 0);
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        timespec_add_us(&deadline, first_us);
+        continue;
+      }
+    }
+    if (pos > 0) {
+      want = frame_len(req, req->dest_buf, pos);
+      if (sent && want < sent_len) {
+        want = sent_len;
+      }
+      clock_gettime(CLOCK_MONOTONIC, &deadline);
+      timespec_add_us(&deadline, gap_us);
+    }
+  }
+  return pos;
+}
+
 static long success = 0;
 static long crcfail = 0;
 static long timeout = 0;
 static long stat_wait = 0;
 
 int modbuscmd(modbus_req *req, speed_t baudrate, const char *caller) {
+    static int tty_fd = -1;
+    static speed_t tty_baudrate;
     int error = 0;
     struct termios tio;
     char modbus_cmd[req->cmd_len + 2];
     size_t cmd_len = req->cmd_len;
-    int waitloops;
+    long tx_us, gap_us;
+    int waitloops = 0;
+    bool rx_on;
+
+    memcpy(modbus_cmd, req->modbus_cmd, cmd_len);
+    append_modbus_crc16(modbus_cmd, &cmd_len);
+
+    /*
+     * With RS485 mode in the driver the receiver may stay on, but the
+     * request could still be read back. Responses which cannot be the
+     * request are checked for that, the others only go without
+     * switching CREAD once the driver has shown it gates the receiver.
+     */
+    req->echo_checked = req->rs485 && cmd_len <= req->dest_limit &&
+        req->modbus_cmd[1] != MODBUS_WRITE_HOLDING_REGISTER_SINGLE;
+    req->echoed = false;
+    rx_on = req->rs485 && (req->rx_gated || req->echo_checked);
+    tx_us = char_time_us(baudrate, cmd_len);
+    gap_us = char_time_us(baudrate, 4);
+    if (gap_us < MODBUS_T35_MIN_US) {
+      gap_us = MODBUS_T35_MIN_US;
+    }
+    gap_us += MODBUS_RX_LATENCY_US;
 
-    if (verbose)
-      OBMC_INFO("[*] Setting TTY flags!\n");
     memset(&tio, 0, sizeof(tio));
-    // CREAD should be left *off* until we've confirmed THRE
-    // to avoid catching false character starts
     cfsetspeed(&tio,baudrate);
     tio.c_cflag |= PARENB;
     tio.c_cflag |= CLOCAL;
@@ -263,10 +442,26 @@ int modbuscmd(modbus_req *req, speed_t baudrate, const char *caller) {
     tio.c_iflag |= INPCK;
     tio.c_cc[VMIN] = 1;
     tio.c_cc[VTIME] = 0;
-    ERR_EXIT(tcsetattr(req->tty_fd,TCSANOW,&tio));
-
-    memcpy(modbus_cmd, req->modbus_cmd, cmd_len);
-    append_modbus_crc16(modbus_cmd, &cmd_len);
+    if (rx_on) {
+      // The driver should keep the receiver off while we transmit
+      tio.c_cflag |= CREAD;
+      if (tty_fd != req->tty_fd || tty_baudrate != baudrate) {
+        if (verbose)
+          OBMC_INFO("[*] Setting TTY flags!\n");
+        ERR_EXIT(tcsetattr(req->tty_fd,TCSANOW,&tio));
+        tty_fd = req->tty_fd;
+        tty_baudrate = baudrate;
+      }
+    } else {
+      // CREAD should be left *off* until we've confirmed THRE
+      // to avoid catching false character starts
+      if (verbose)
+        OBMC_INFO("[*] Setting TTY flags!\n");
+      ERR_EXIT(tcsetattr(req->tty_fd,TCSANOW,&tio));
+      tty_fd = -1;
+    }
+    // Whatever is left of an earlier, late response
+    tcflush(req->tty_fd, TCIFLUSH);
 
     // print command as sent
     if (verbose)  {
@@ -277,43 +472,54 @@ int modbuscmd(modbus_req *req, speed_t baudrate, const char *caller) {
 
     dbg("[*] Writing!\n");
 
-    // hoped adding the ioctl to do the switching would have alleviated the
-    // need to do SCHED_FIFO, but we still get preempted between the write and
-    // ioctl syscalls w/o it often enough to break f/w updates.
-    struct sched_param sp;
-    sp.sched_priority = 50;
-    int policy = SCHED_FIFO;
-    error = pthread_setschedparam(pthread_self(), policy, &sp);
-    if (error != 0) {
-        OBMC_ERROR(error, "failed to set schedparm to SCHED_FIFO");
-        goto cleanup;
-    }
     struct timespec write_begin;
     struct timespec wait_begin;
     struct timespec wait_end;
     struct timespec read_end;
+    struct sched_param sp;
+    int policy;
+
+    if (!rx_on) {
+      // hoped adding the ioctl to do the switching would have alleviated the
+      // need to do SCHED_FIFO, but we still get preempted between the write and
+      // ioctl syscalls w/o it often enough to break f/w updates.
+      sp.sched_priority = 50;
+      policy = SCHED_FIFO;
+      error = pthread_setschedparam(pthread_self(), policy, &sp);
+      if (error != 0) {
+          OBMC_ERROR(error, "failed to set schedparm to SCHED_FIFO");
+          goto cleanup;
+      }
+    }
     clock_gettime(CLOCK_MONOTONIC_RAW, &write_begin);
-    CHECK_LATENCY_START();
     if (write(req->tty_fd, modbus_cmd, cmd_len) < 0) {
       OBMC_ERROR(errno, "ERROR: could not write modbus cmd");
     }
-    CHECK_LATENCY_END("rackmond::%s::modbuscmd::write modbus write %d bytes", caller, cmd_len);
     clock_gettime(CLOCK_MONOTONIC_RAW, &wait_begin);
 
-    CHECK_LATENCY_START();
-    waitloops = waitfd(req->tty_fd);
-    CHECK_LATENCY_END("rackmond::%s::modbuscmd::waitfd modbus wait LSR", caller);
-
-    clock_gettime(CLOCK_MONOTONIC_RAW, &wait_end);
-    sp.sched_priority = 0;
-    // Enable UART read
-    tio.c_cflag |= CREAD;
-    ERR_EXIT(tcsetattr(req->tty_fd,TCSANOW,&tio));
-    policy = SCHED_OTHER;
-    error = pthread_setschedparam(pthread_self(), policy, &sp);
-    if (error != 0) {
-        OBMC_ERROR(error, "failed to set schedparm to SCHED_OTHER");
-        goto cleanup;
+    if (rx_on) {
+      wait_end = wait_begin;
+    } else {
+      // Sleep through most of the transmission, so only the last
+      // character is left to wait for
+      struct timespec tx = { .tv_sec = 0, .tv_nsec = 0 };
+      timespec_add_us(&tx, tx_us - char_time_us(baudrate, 1));
+      nanosleep(&tx, NULL);
+      waitloops = waitfd(req->tty_fd);
+
+      clock_gettime(CLOCK_MONOTONIC_RAW, &wait_end);
+      sp.sched_priority = 0;
+      // Enable UART read
+      tio.c_cflag |= CREAD;
+      ERR_EXIT(tcsetattr(req->tty_fd,TCSANOW,&tio));
+      policy = SCHED_OTHER;
+      error = pthread_setschedparam(pthread_self(), policy, &sp);
+      if (error != 0) {
+          OBMC_ERROR(error, "failed to set schedparm to SCHED_OTHER");
+          goto cleanup;
+      }
+      // the transmission is over already
+      tx_us = 0;
     }
 
     dbg("[*] waitfd loops: %d\n", waitloops);
@@ -327,9 +533,11 @@ int modbuscmd(modbus_req *req, speed_t baudrate, const char *caller) {
     if(req->expected_len > req->dest_limit) {
       return -1;
     }
-    mb_pos = read_wait(req->tty_fd, req->dest_buf, req->expected_len, req->timeout, caller);
+    mb_pos = read_frame(req, req->echo_checked ? modbus_cmd : NULL, cmd_len,
+                        tx_us + req->timeout, gap_us, caller);
     clock_gettime(CLOCK_MONOTONIC_RAW, &read_end);
     req->dest_len = mb_pos;
+    req->latency_us = (long)(ts_diff(&write_begin, &read_end) * 1000);
     if(mb_pos >= 4) {
       uint16_t crc = modbus_crc16(req->dest_buf, mb_pos - 2);
       dbg("Modbus response CRC: %04X\n ", crc);
@@ -19,6 +19,7 @@
 #ifndef MODBUS_H_
 #define MODBUS_H_
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -44,6 +45,23 @@
 #define MODBUS_WRITE_HOLDING_REGISTER_SINGLE 6
 #define MODBUS_WRITE_HOLDING_REGISTER_MULTIPLE 16
 
+/*
+ * Silence which ends a frame: 3.5 characters, but at least 1750us at
+ * higher baud rates. Bytes reach us in bursts on top of that, delayed by
+ * the UART FIFO timeout, the tty layer and, with USB adapters, the
+ * adapter latency timer (16ms on FTDI).
+ */
+#define MODBUS_T35_MIN_US 1750
+#define MODBUS_RX_LATENCY_US 20000
+
+/*
+ * Accepting RS485 mode does not prove the driver turns the receiver off
+ * during transmission. Until this many responses came without an echo of
+ * the request, commands whose response may equal the request still
+ * switch CREAD.
+ */
+#define MODBUS_RX_GATED_PROOF 16
+
 #ifndef ARRAY_SIZE
 #define ARRAY_SIZE(_a) (sizeof(_a) / sizeof((_a)[0]))
 #endif
@@ -88,8 +106,29 @@ typedef struct _modbus_req {
   size_t dest_limit;
   size_t dest_len;
   int scan;
+  // the tty driver switches the transceiver direction (TIOCSRS485)
+  bool rs485;
+  // the driver was seen to keep the receiver off while we transmit
+  bool rx_gated;
+  // out: whether the response was checked for, and started with, an echo
+  // of the request
+  bool echo_checked;
+  bool echoed;
+  // out: from the start of the write to the end of the response
+  long latency_us;
 } modbus_req;
 
+/*
+ * Transaction latency, bucket i counts latencies below 2^i ms, the last
+ * one everything above.
+ */
+#define MODBUS_LATENCY_BUCKETS 12
+typedef struct {
+  uint32_t count[MODBUS_LATENCY_BUCKETS];
+  uint64_t total_us;
+  uint32_t max_us;
+} modbus_latency_hist;
+
 #define timespec_to_ms(_t) (((_t)->tv_sec * 1000) + ((_t)->tv_nsec / 1000000))
 #define timespec_to_us(_t) (((_t)->tv_sec * 1000000) + ((_t)->tv_nsec / 1000))
 
@@ -166,7 +205,11 @@ const char* baud_to_str(speed_t baudrate);
 // Read until maxlen bytes or no bytes in mdelay_us microseconds
 size_t read_wait(int fd, char* dst, size_t maxlen, int mdelay_us, const char *caller);
 
+int modbus_rs485_enable(int fd);
+bool modbus_rs485_enabled(int fd);
+
 int modbuscmd(modbus_req *req, speed_t baudrate, const char *caller);
+void modbus_latency_record(modbus_latency_hist *h, long us);
 uint16_t modbus_crc16(char* buffer, size_t length);
 const char* modbus_strerror(int mb_err);
 
@@ -3,7 +3,6 @@
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
-#include <linux/serial.h>
 #include <poll.h>
 #include <pthread.h>
 #include <sched.h>
@@ -116,6 +115,14 @@ typedef struct {
 #define dev_lock(_d)   mutex_lock_helper(&((_d)->lock), "dev_lock")
 #define dev_unlock(_d) mutex_unlock_helper(&((_d)->lock), "dev_lock")
   int tty_fd;
+  // the tty driver switches the transceiver direction
+  bool rs485;
+  // responses checked for, and found without, an echo of the request
+  unsigned int echo_free;
+  // end of the last transaction, for the inter-command delay
+  struct timespec idle_since;
+  // successful transactions, by slave address
+  modbus_latency_hist latency[256];
 } rs485_dev_t;
 
 typedef struct {
@@ -465,7 +472,6 @@ static int modbus_command(rs485_dev_t* dev, int timeout, char* cmd_buf,
   req.expected_len = (exp_resp_len != 0 ? exp_resp_len : resp_size);
   req.scan = scanning;
 
-
   if (dev_lock(dev) != 0) {
     return -1;
   }
@@ -473,17 +479,30 @@ static int modbus_command(rs485_dev_t* dev, int timeout, char* cmd_buf,
   max_retry = psu_retry_limit(psu, (int)cmd_buf[0]);
 
   for (int retry = 0; retry < max_retry; retry++) {
-    CHECK_LATENCY_START();
+    // Only sleep what is left of the delay since the bus went idle
+    if (delay != 0) {
+      struct timespec ready = dev->idle_since;
+      ready.tv_sec += delay / 1000000;
+      ready.tv_nsec += (delay % 1000000) * 1000;
+      if (ready.tv_nsec >= 1000000000) {
+        ready.tv_nsec -= 1000000000;
+        ready.tv_sec++;
+      }
+      while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ready, NULL) == EINTR);
+    }
+    req.rs485 = dev->rs485;
+    req.rx_gated = dev->echo_free >= MODBUS_RX_GATED_PROOF;
     error = modbuscmd(&req, baudrate, caller);
-    CHECK_LATENCY_END(
-        "rackmond::%s::modbuscmd cmd=(%#x,%#x,%#x,%#x,%#x,%#x), cmd_len=%lu, resp_len=%lu",
-        caller,
-        cmd_buf[0], cmd_buf[1],
-        cmd_size > 2 ? cmd_buf[2] : 0,
-        cmd_size > 3 ? cmd_buf[3] : 0,
-        cmd_size > 4 ? cmd_buf[4] : 0,
-        cmd_size > 5 ? cmd_buf[5] : 0,
-        (unsigned long)req.cmd_len, (unsigned long)req.expected_len);
+    clock_gettime(CLOCK_MONOTONIC, &dev->idle_since);
+
+    if (req.echoed) {
+      OBMC_WARN("%s: the request was read back, switching the receiver "
+                "from userspace", rackmon_io->dev_path);
+      dev->rs485 = false;
+    } else if (req.echo_checked && error >= 0 &&
+               dev->echo_free < MODBUS_RX_GATED_PROOF) {
+      dev->echo_free++;
+    }
 
     /* If this is an active PSU, then record the errors we see
      * communicating to this PSU */
@@ -495,10 +514,8 @@ static int modbus_command(rs485_dev_t* dev, int timeout, char* cmd_buf,
       }
     }
 
-    if (delay != 0) {
-      usleep(delay);
-    }
     if (error >= 0) {
+      modbus_latency_record(&dev->latency[(uint8_t)cmd_buf[0]], req.latency_us);
       break;
     }
   }
@@ -1012,8 +1029,7 @@ static int alloc_monitoring_datas(void) {
 
 static int uart_rs485_open(struct rackmon_io_handler *handler)
 {
-  int fd, ret;
-  struct serial_rs485 rs485conf;
+  int fd;
 
   fd = open(handler->dev_path, O_RDWR | O_NOCTTY);
   if (fd < 0) {
@@ -1022,23 +1038,12 @@ static int uart_rs485_open(struct rackmon_io_handler *handler)
   }
 
   /*
-   * NOTE: "SER_RS485_RTS_AFTER_SEND" and "SER_RS485_RX_DURING_TX" flags
-   * are not handled in kernel 4.1, but they are required in the latest
-   * kernel.
+   * Without direction control in the driver, modbuscmd() switches the
+   * receiver itself and times the transmission.
    */
-  memset(&rs485conf, 0, sizeof(rs485conf));
-  rs485conf.flags = SER_RS485_ENABLED;
-  rs485conf.flags |= (SER_RS485_RTS_AFTER_SEND | SER_RS485_RX_DURING_TX);
-
-  ret = ioctl(fd, TIOCSRS485, &rs485conf);
-  if (ret < 0) {
-    int saved_errno = errno;
-
-    OBMC_ERROR(errno, "failed to turn on RS485 mode");
-    close(fd);  /* ignore errors */
-    errno = saved_errno;
-
-    return -1;
+  if (modbus_rs485_enable(fd) != 0) {
+    OBMC_WARN("no RS485 mode on %s, switching direction in userspace",
+              handler->dev_path);
   }
 
   return fd;
@@ -1059,6 +1064,78 @@ static struct rackmon_io_handler uart_rs485_io = {
  */
 struct rackmon_io_handler *rackmon_io = &uart_rs485_io;
 
+/*
+ * The latency histograms are kept across restarts, so they cover more
+ * than the last run.
+ */
+#define LATENCY_STORE_MAGIC 0x524d4c48
+
+typedef struct {
+  uint32_t magic;
+  uint32_t size;
+  modbus_latency_hist latency[256];
+} latency_store_t;
+
+static void latency_load(rs485_dev_t *dev)
+{
+  latency_store_t *store;
+  FILE *fp;
+
+  fp = fopen(RACKMON_LATENCY_STORE, "rb");
+  if (fp == NULL) {
+    return;
+  }
+  store = malloc(sizeof(*store));
+  if (store != NULL &&
+      fread(store, sizeof(*store), 1, fp) == 1 &&
+      store->magic == LATENCY_STORE_MAGIC &&
+      store->size == sizeof(*store)) {
+    memcpy(dev->latency, store->latency, sizeof(dev->latency));
+  } else {
+    OBMC_WARN("ignoring invalid %s", RACKMON_LATENCY_STORE);
+  }
+  free(store);
+  fclose(fp);
+}
+
+static void latency_save(rs485_dev_t *dev)
+{
+  const char *tmp = RACKMON_LATENCY_STORE ".tmp";
+  latency_store_t *store;
+  FILE *fp;
+  int ret = -1;
+
+  store = malloc(sizeof(*store));
+  if (store == NULL) {
+    return;
+  }
+  store->magic = LATENCY_STORE_MAGIC;
+  store->size = sizeof(*store);
+  if (dev_lock(dev) != 0) {
+    free(store);
+    return;
+  }
+  memcpy(store->latency, dev->latency, sizeof(store->latency));
+  dev_unlock(dev);
+
+  fp = fopen(tmp, "wb");
+  if (fp != NULL) {
+    if (fwrite(store, sizeof(*store), 1, fp) == 1 && fflush(fp) == 0 &&
+        fsync(fileno(fp)) == 0) {
+      ret = 0;
+    }
+    fclose(fp);
+  }
+  if (ret == 0 && rename(tmp, RACKMON_LATENCY_STORE) != 0) {
+    ret = -1;
+  }
+  if (ret != 0) {
+    OBMC_ERROR(errno, "failed to save %s", RACKMON_LATENCY_STORE);
+    unlink(tmp);
+  }
+  free(store);
+}
+
 static void rs485_device_cleanup(rs485_dev_t *dev)
 {
   if (dev->tty_fd >= 0) {
@@ -1074,6 +1151,9 @@ static int rs485_device_init(const char* tty_dev, rs485_dev_t *dev) {
   dev->tty_fd = rackmon_io->open(rackmon_io);
   if (dev->tty_fd < 0)
     return -1;
+  dev->rs485 = modbus_rs485_enabled(dev->tty_fd);
+  OBMC_INFO("%s: %s direction control", rackmon_io->dev_path,
+            dev->rs485 ? "kernel RS485" : "userspace");
 
   ret = pthread_mutex_init(&dev->lock, NULL);
   if (ret != 0) {
@@ -1083,6 +1163,7 @@ static int rs485_device_init(const char* tty_dev, rs485_dev_t *dev) {
     errno = ret;
     return -1;
   }
+  latency_load(dev);
 
   return 0;
 }
@@ -1334,6 +1415,7 @@ void* monitoring_loop(void* arg)
       OBMC_INFO("Updating timestamp\n");
       update_all_psu_timestamp();
       timestamp_at = now.tv_sec + PSU_TIMESTAMP_UPDATE_INTERVAL;
+      latency_save(&rackmond_config.rs485);
     }
 
     /*
@@ -1453,6 +1535,50 @@ cleanup:
   return error;
 }
 
+static bool get_latency(uint8_t addr, modbus_latency_hist *h)
+{
+  uint32_t n = 0;
+  int i;
+
+  if (dev_lock(&rackmond_config.rs485) != 0) {
+    return false;
+  }
+  *h = rackmond_config.rs485.latency[addr];
+  dev_unlock(&rackmond_config.rs485);
+
+  for (i = 0; i < MODBUS_LATENCY_BUCKETS; i++) {
+    n += h->count[i];
+  }
+  return n != 0;
+}
+
+static void print_latency(write_buf_t *wb, uint8_t addr)
+{
+  modbus_latency_hist h;
+  uint64_t n = 0;
+  int i;
+
+  if (!get_latency(addr, &h)) {
+    return;
+  }
+  for (i = 0; i < MODBUS_LATENCY_BUCKETS; i++) {
+    n += h.count[i];
+  }
+  buf_printf(wb, "  latency: avg %llu us, max %u us, histogram",
+             (unsigned long long)(h.total_us / n), h.max_us);
+  for (i = 0; i < MODBUS_LATENCY_BUCKETS; i++) {
+    if (h.count[i] == 0) {
+      continue;
+    }
+    if (i == MODBUS_LATENCY_BUCKETS - 1) {
+      buf_printf(wb, " >=%dms:%u", 1 << (i - 1), h.count[i]);
+    } else {
+      buf_printf(wb, " <%dms:%u", 1 << i, h.count[i]);
+    }
+  }
+  buf_printf(wb, "\n");
+}
+
 static int run_cmd_dump_status(rackmond_command* cmd, write_buf_t *wb)
 {
   if (global_lock() != 0) {
@@ -1483,6 +1609,7 @@ static int run_cmd_dump_status(rackmond_command* cmd, write_buf_t *wb)
         buf_printf(wb, " (in timeout mode for the next %d seconds)", until - now);
       }
       buf_printf(wb, "\n");
+      print_latency(wb, rackmond_config.stored_data[i]->addr);
     }
 
     buf_printf(wb, "Active on last scan: ");
@@ -1533,9 +1660,20 @@ static int run_cmd_dump_json(rackmond_command* cmd, write_buf_t *wb)
            data_pos < MAX_ACTIVE_ADDRS) {
       psu_datastore_t *pdata = rackmond_config.stored_data[data_pos];
 
+      modbus_latency_hist h;
+
       buf_printf(wb, "{\"addr\":%d,\"crc_fails\":%d,\"timeouts\":%d,"
-                 "\"now\":%d,\"ranges\":[",
+                 "\"now\":%d,",
                  pdata->addr, pdata->crc_errors, pdata->timeout_errors, now);
+      if (get_latency(pdata->addr, &h)) {
+        buf_printf(wb, "\"latency\":{\"total_us\":%llu,\"max_us\":%u,"
+                   "\"hist\":[", (unsigned long long)h.total_us, h.max_us);
+        for (c = 0; c < MODBUS_LATENCY_BUCKETS; c++) {
+          buf_printf(wb, c ? ",%u" : "%u", h.count[c]);
+        }
+        buf_write(wb, "]},", 3);
+      }
+      buf_write(wb, "\"ranges\":[", 10);
 
       for (i = 0; i < rackmond_config.config->num_intervals; i++) {
         uint32_t time;
@@ -1956,6 +2094,7 @@ exit_sock:
   pthread_cancel(monitoring_tid);     /* ignore errors */
   pthread_join(monitoring_tid, NULL); /* ignore errors */
 exit_thread:
+  latency_save(&rackmond_config.rs485);
   rs485_device_cleanup(&rackmond_config.rs485);
 exit_rs485:
   rackmon_plat_cleanup();
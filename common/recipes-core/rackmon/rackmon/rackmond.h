@@ -9,6 +9,7 @@
 
 #define RACKMON_IPC_SOCKET "/var/run/rackmond.sock"
 #define RACKMON_STAT_STORE "/var/log/psu-status.log"
+#define RACKMON_LATENCY_STORE "/mnt/data/rackmond-latency.bin"
 
 //would've been nice to have thrift
 
@@ -34,6 +34,7 @@
 #include <openbmc/sdr.h>
 #include <openbmc/pal.h>
 #include <openbmc/pal_sensors.h>
+#include <openbmc/pal-flags.h>
 #include <openbmc/aggregate-sensor.h>
 #include <openbmc/kv.h>
 
@@ -515,6 +516,7 @@ snr_monitor(void *arg) {
   thresh_sensor_t *snr;
   uint32_t snr_poll_interval[MAX_SENSOR_NUM + 1] = {0};
   uint8_t snr_read_fail[MAX_SENSOR_NUM + 1] = {0};
+  char fwupd_key[MAX_KEY_LEN];
 #ifdef CONFIG_FBY3_CWC
   uint8_t fruNb = fru >= MAX_NUM_FRUS ? IDX_TO_NB(fru) : fru;
   uint8_t slot = fru >= MAX_NUM_FRUS ? FRU_SLOT1 : fru;
@@ -554,9 +556,14 @@ snr_monitor(void *arg) {
   // set flag to notice BMC sensord snr_monitor  is ready
   kv_set("flag_sensord_monitor", "1", 0, 0);
 
+  snprintf(fwupd_key, sizeof(fwupd_key), "fru%u_fwupd", slot);
   while(1) {
     if (pal_is_fw_update_ongoing(slot)) {
-      sleep(STOP_PERIOD);
+      // Resume as soon as the fru's update ends; updates platforms flag
+      // some other way are still looked at every STOP_PERIOD
+      if (pal_flag_is_set(fwupd_key, PAL_FLAG_DEADLINE) != 1 ||
+          pal_flag_wait(fwupd_key, PAL_FLAG_DEADLINE, false, STOP_PERIOD * 1000) < 0)
+        sleep(STOP_PERIOD);
       continue;
     }
 
@@ -0,0 +1,149 @@
+/*
+ * Copyright 2021-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <syslog.h>
+#include "sensor-jobs.h"
+
+static int64_t
+deadline_left_ms(const struct timespec *deadline) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t)(deadline->tv_sec - now.tv_sec) * 1000 +
+         (deadline->tv_nsec - now.tv_nsec) / 1000000;
+}
+
+int
+job_pool_init(job_pool_t *pool, int max_jobs) {
+  pthread_condattr_t cond_attr;
+
+  pool->jobs = (job_t **)calloc(max_jobs, sizeof(job_t *));
+  if (pool->jobs == NULL) {
+    return -1;
+  }
+  pool->size = max_jobs;
+  pool->count = 0;
+  pool->next = 0;
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_condattr_init(&cond_attr);
+  pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&pool->cond, &cond_attr);
+  pthread_condattr_destroy(&cond_attr);
+  return 0;
+}
+
+int
+job_pool_add(job_pool_t *pool, job_t *job) {
+  int ret = -1;
+
+  job->started = job->done = job->abandoned = false;
+  pthread_mutex_lock(&pool->lock);
+  if (pool->count < pool->size) {
+    pool->jobs[pool->count++] = job;
+    ret = 0;
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return ret;
+}
+
+static void *
+job_worker(void *arg) {
+  job_pool_t *pool = (job_pool_t *)arg;
+  job_t *job;
+  int ret;
+
+  pthread_detach(pthread_self());
+
+  pthread_mutex_lock(&pool->lock);
+  while (pool->next < pool->count) {
+    job = pool->jobs[pool->next++];
+    clock_gettime(CLOCK_MONOTONIC, &job->deadline);
+    job->deadline.tv_sec += job->timeout;
+    job->started = true;
+    // The caller may be waiting for this job to start its timeout
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    ret = job->run(job);
+
+    pthread_mutex_lock(&pool->lock);
+    job->ret = ret;
+    job->done = true;
+    pthread_cond_broadcast(&pool->cond);
+    // Someone else took over while we were stuck
+    if (job->abandoned) {
+      break;
+    }
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  return NULL;
+}
+
+static int
+start_worker(job_pool_t *pool) {
+  pthread_t tid;
+  int err;
+
+  err = pthread_create(&tid, NULL, job_worker, pool);
+  if (err != 0) {
+    syslog(LOG_WARNING, "sensor-util: pthread_create failed, errno:%d", err);
+    return -1;
+  }
+  return 0;
+}
+
+int
+job_pool_start(job_pool_t *pool, int max_workers) {
+  int i, workers = 0;
+
+  for (i = 0; i < pool->count && i < max_workers; i++) {
+    if (start_worker(pool) == 0) {
+      workers++;
+    }
+  }
+  return workers > 0 ? workers : -1;
+}
+
+int
+job_pool_wait(job_pool_t *pool, job_t *job) {
+  bool abandoned;
+
+  pthread_mutex_lock(&pool->lock);
+  while (!job->done) {
+    if (!job->started) {
+      pthread_cond_wait(&pool->cond, &pool->lock);
+      continue;
+    }
+    if (deadline_left_ms(&job->deadline) <= 0) {
+      job->abandoned = true;
+      break;
+    }
+    pthread_cond_timedwait(&pool->cond, &pool->lock, &job->deadline);
+  }
+  abandoned = job->abandoned;
+  pthread_mutex_unlock(&pool->lock);
+
+  if (abandoned) {
+    // The worker still owns the job, give its queue to a new one
+    return start_worker(pool) < 0 ? -1 : 1;
+  }
+  return 0;
+}
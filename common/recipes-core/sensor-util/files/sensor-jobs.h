@@ -0,0 +1,62 @@
+/*
+ * Copyright 2021-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef __SENSOR_JOBS_H__
+#define __SENSOR_JOBS_H__
+
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+
+/*
+ * A small pool of workers which run jobs in the order they were added,
+ * while the caller collects them in the same order with job_pool_wait().
+ * Every job gets its own timeout, counted from when a worker picks it
+ * up. A job still running after its timeout is abandoned: its worker
+ * keeps it, and a new worker takes its place.
+ */
+typedef struct job {
+  int (*run)(struct job *);
+  int timeout;                // seconds
+  int ret;
+
+  // Protected by the pool lock
+  bool started;
+  bool done;
+  bool abandoned;
+  struct timespec deadline;   // CLOCK_MONOTONIC, set when started
+} job_t;
+
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  job_t **jobs;
+  int size;
+  int count;
+  int next;
+} job_pool_t;
+
+// The pool must outlive abandoned jobs, so it is usually static
+int job_pool_init(job_pool_t *pool, int max_jobs);
+int job_pool_add(job_pool_t *pool, job_t *job);
+// Returns the number of workers started, or -1
+int job_pool_start(job_pool_t *pool, int max_workers);
+// Returns 0 once the job is done, 1 if it was abandoned, -1 on error
+int job_pool_wait(job_pool_t *pool, job_t *job);
+
+#endif
@@ -30,12 +30,12 @@
 #include <getopt.h>
 #include <time.h>
 #include <pthread.h>
-#include <signal.h>
 #include <jansson.h>
 #include <openbmc/pal.h>
 #include <openbmc/sdr.h>
 #include <openbmc/pal_sensors.h>
 #include <openbmc/aggregate-sensor.h>
+#include "sensor-jobs.h"
 
 #define STATUS_OK   "ok"
 #define STATUS_NS   "ns"
@@ -58,10 +58,13 @@
   static const char * pal_fru_list_sensor_history_t =  pal_fru_list;
 #endif /* CUSTOM_FRU_LIST */
 
-static pthread_mutex_t timer = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t done = PTHREAD_COND_INITIALIZER;
-static pthread_condattr_t done_attr;
-static bool done_flag = false;
+// FRUs are read by a small pool of workers, output is kept in FRU order.
+#ifndef MAX_SENSOR_UTIL_WORKERS
+#define MAX_SENSOR_UTIL_WORKERS 4
+#endif
+#define MAX_SENSOR_UTIL_JOBS    (MAX_NUM_FRUS + 4)
+
+static job_pool_t sensor_jobs;
 #ifdef CONFIG_FBY3_CWC
 #define FRU_CWC 31
 #define FRU_2U_TOP 32
@@ -70,6 +73,36 @@ static uint8_t expFru = 0;
 static uint8_t cwcPlat = 0;
 #endif
 
+// Options which are the same for every FRU
+typedef struct {
+  int sensor_num;
+  bool history;
+  bool threshold;
+  bool json;
+  bool history_clear;
+  bool filter;
+  char ** filter_list;
+  int filter_len;
+  long period;
+} sensor_util_opts;
+
+// One FRU to print, handed to a worker
+typedef struct {
+  job_t job;
+  uint8_t fru;
+  bool allow_absent;
+  bool force;
+  const char *banner;
+  const sensor_util_opts *opts;
+
+  int ret;
+  FILE *out;
+  char *out_buf;
+  size_t out_len;
+  json_t *fru_sensor_obj;
+  bool timed_out;
+} sensor_job;
+
 // This is for get_sensor_reading
 typedef struct {
   uint8_t fru;
@@ -83,6 +116,9 @@ typedef struct {
   int filter_len;
   json_t *fru_sensor_obj;
   uint8_t *sensor_list;
+  FILE *out;
+  const struct timespec *deadline;
+  bool timed_out;
 } get_sensor_reading_struct;
 
 const char *sensor_state_str[] = {
@@ -282,6 +318,36 @@ get_thresh_json_obj(thresh_sensor_t *thresh) {
   return thresh_obj;
 }
 
+/*
+ * Sensors with the same name, in one FRU or across FRUs, are collected
+ * in an array to match the RESTAPI format. Takes over sensor_obj.
+ */
+static void
+append_sensor_json(json_t *fru_sensor_obj, const char *name, json_t *sensor_obj) {
+  json_t *search = json_object_get(fru_sensor_obj, name);
+
+  if (search != NULL) {
+    if (json_is_object(search)) {
+      json_t *value_array = json_array();
+      json_array_append(value_array, search);
+      /*
+      Note : if we use append_new here,
+      the following "json_object_set_new(fru_sensor_obj, name, value_array)"
+      will free the json_object "search"
+      */
+      json_array_append_new(value_array, sensor_obj);
+      json_object_set_new(fru_sensor_obj, name, value_array);
+    } else if (json_is_array(search)) {
+      json_array_append_new(search, sensor_obj);
+    } else {
+      syslog(LOG_ERR, "[%s]get error type of the JSON obj", __func__);
+      json_decref(sensor_obj);
+    }
+  } else {
+    json_object_set_new(fru_sensor_obj, name, sensor_obj);
+  }
+}
+
 static void
 print_sensor_reading(float fvalue, uint16_t snr_num, thresh_sensor_t *thresh,
        get_sensor_reading_struct *sensor_info, char *status, json_t *fru_sensor_obj, char * filter_sensor_name) {
@@ -289,10 +355,11 @@ print_sensor_reading(float fvalue, uint16_t snr_num, thresh_sensor_t *thresh,
   bool threshold = sensor_info->threshold;
   bool json = sensor_info->json;
   bool filter = sensor_info->filter;
+  FILE *out = sensor_info->out;
 
   if (json) {
     json_t *sensor_obj = json_object();
-    json_t *search, *thresh_obj;
+    json_t *thresh_obj;
     char svalue[20];
 
     if (is_pldm_state_sensor(snr_num, sensor_info->fru)) {
@@ -309,77 +376,55 @@ print_sensor_reading(float fvalue, uint16_t snr_num, thresh_sensor_t *thresh,
     snprintf(svalue, sizeof(svalue), "%.2f", fvalue);
     json_object_set_new(sensor_obj, "value", json_string(svalue));
 
-    search = json_object_get(fru_sensor_obj, thresh->name);
-    if (search != NULL) {
-      /* in order to match the RESTAPI format */
-      if (json_is_object(search)) {
-        json_t *value_array = json_array();
-        json_array_append(value_array, search);
-        /*
-        Note : if we use append_new here,
-        the following "json_object_set_new(fru_sensor_obj, thresh->name, value_array)"
-        will free the json_object "search"
-        */
-        json_array_append_new(value_array, sensor_obj);
-        json_object_set_new(fru_sensor_obj, thresh->name, value_array);
-      } else if (json_is_array(search)) {
-        json_array_append_new(search, sensor_obj);
-      } else {
-        syslog(LOG_ERR, "[%s]get error type of the JSON obj", __func__);
-        json_decref(sensor_obj);
-      }
-    } else {
-      json_object_set_new(fru_sensor_obj, thresh->name, sensor_obj);
-    }
-
+    append_sensor_json(fru_sensor_obj, thresh->name, sensor_obj);
     return;
   }
 
   if (filter) {
-    printf("%-28s",filter_sensor_name);
+    fprintf(out, "%-28s",filter_sensor_name);
   } else {
-    printf("%-28s",thresh->name);
+    fprintf(out, "%-28s",thresh->name);
   }
 
   if (is_pldm_state_sensor(snr_num, sensor_info->fru)) {
-    printf(" (0x%X) : %10s    | (%s)",
+    fprintf(out, " (0x%X) : %10s    | (%s)",
         snr_num,
         numeric_state_to_name((int)fvalue, sensor_state_str,
              sizeof(sensor_state_str)/sizeof(sensor_state_str[0]),UNKNOWN_STATE),
              numeric_state_to_name((int)fvalue, sensor_status,
              sizeof(sensor_status)/sizeof(sensor_status[0]),STATUS_NS));
   } else {
-    printf(" (0x%X) : %7.2f %-5s | (%s)",
+    fprintf(out, " (0x%X) : %7.2f %-5s | (%s)",
         snr_num, fvalue, thresh->units, status);
   }
   if (threshold) {
-    printf(" | UCR: ");
+    fprintf(out, " | UCR: ");
     thresh->flag & GETMASK(UCR_THRESH) ?
-      printf("%.2f", thresh->ucr_thresh) : printf("NA");
+      fprintf(out, "%.2f", thresh->ucr_thresh) : fprintf(out, "NA");
 
-    printf(" | UNC: ");
+    fprintf(out, " | UNC: ");
     thresh->flag & GETMASK(UNC_THRESH) ?
-      printf("%.2f", thresh->unc_thresh) : printf("NA");
+      fprintf(out, "%.2f", thresh->unc_thresh) : fprintf(out, "NA");
 
-    printf(" | UNR: ");
+    fprintf(out, " | UNR: ");
     thresh->flag & GETMASK(UNR_THRESH) ?
-      printf("%.2f", thresh->unr_thresh) : printf("NA");
+      fprintf(out, "%.2f", thresh->unr_thresh) : fprintf(out, "NA");
 
-    printf(" | LCR: ");
+    fprintf(out, " | LCR: ");
     thresh->flag & GETMASK(LCR_THRESH) ?
-      printf("%.2f", thresh->lcr_thresh) : printf("NA");
+      fprintf(out, "%.2f", thresh->lcr_thresh) : fprintf(out, "NA");
 
-    printf(" | LNC: ");
+    fprintf(out, " | LNC: ");
     thresh->flag & GETMASK(LNC_THRESH) ?
-      printf("%.2f", thresh->lnc_thresh) : printf("NA");
+      fprintf(out, "%.2f", thresh->lnc_thresh) : fprintf(out, "NA");
 
-    printf(" | LNR: ");
+    fprintf(out, " | LNR: ");
     thresh->flag & GETMASK(LNR_THRESH) ?
-      printf("%.2f", thresh->lnr_thresh) : printf("NA");
+      fprintf(out, "%.2f", thresh->lnr_thresh) : fprintf(out, "NA");
 
   }
 
-  printf("\n");
+  fprintf(out, "\n");
 }
 
 static void
@@ -414,67 +459,90 @@ alter_to_fsc_style_sensor_name (char * str) {
   }
 }
 
-static void*
-get_sensor_reading(void *sensor_data) {
+static int64_t
+timespec_diff_ms(const struct timespec *a, const struct timespec *b) {
+  return (int64_t)(a->tv_sec - b->tv_sec) * 1000 + (a->tv_nsec - b->tv_nsec) / 1000000;
+}
+
+static bool
+deadline_passed(const struct timespec *deadline) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return timespec_diff_ms(&now, deadline) >= 0;
+}
+
+static void
+get_sensor_reading(get_sensor_reading_struct *sensor_info) {
 
-  get_sensor_reading_struct *sensor_info = (get_sensor_reading_struct *)sensor_data;
   int i = 0,j = 0;
+  int cnt = 0;
   uint8_t snr_num;
   float fvalue;
   char status[8];
-  thresh_sensor_t thresh;
+  thresh_sensor_t *thresh;
   int ret = 0;
   char fruname[32] = {0};
   bool json = sensor_info->json;
   bool filter = sensor_info->filter;
   char filter_sensor_name[64] = {0};
   json_t *fru_sensor_obj = sensor_info->fru_sensor_obj;
+  FILE *out = sensor_info->out;
+  uint8_t snr_list[MAX_SENSOR_NUM + 1];
+  thresh_sensor_t snr_thresh[MAX_SENSOR_NUM + 1];
+  int snr_ret[MAX_SENSOR_NUM + 1];
 
-  pthread_detach(pthread_self());
-  //Allow this thread to be killed at any time
-  pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, NULL);
-
-  for (i=0; i< sensor_info->filter_len; i++) {
-    alter_to_fsc_style_sensor_name(sensor_info->filter_list[i]);
-  }
-
-  for (i = 0; i < sensor_info->sensor_cnt; i++) {
+  /* If calculation is for a single sensor, ignore all others. */
+  for (i = 0; i < sensor_info->sensor_cnt && cnt <= MAX_SENSOR_NUM; i++) {
     snr_num = sensor_info->sensor_list[i];
-    /* If calculation is for a single sensor, ignore all others. */
-    if (sensor_info->sensor_num != SENSOR_ALL && snr_num != sensor_info->sensor_num) {
-      continue;
+    if (sensor_info->sensor_num == SENSOR_ALL || snr_num == sensor_info->sensor_num) {
+      snr_list[cnt++] = snr_num;
     }
+  }
 
-    if (sensor_info->fru == AGGREGATE_SENSOR_FRU_ID) {
-      if (aggregate_sensor_threshold(snr_num, &thresh)) {
-        syslog(LOG_ERR, "agg_snr_thresh failed for agg num: 0x%X", snr_num);
-        continue;
+  // The thresholds of the whole FRU in one go, the SDR is loaded once
+  if (sensor_info->fru == AGGREGATE_SENSOR_FRU_ID) {
+    for (i = 0; i < cnt; i++) {
+      snr_ret[i] = aggregate_sensor_threshold(snr_list[i], &snr_thresh[i]);
+      if (snr_ret[i]) {
+        syslog(LOG_ERR, "agg_snr_thresh failed for agg num: 0x%X", snr_list[i]);
       }
-    } else {
-      ret = sdr_get_snr_thresh(sensor_info->fru, snr_num, &thresh);
-      pal_alter_sensor_thresh_flag(sensor_info->fru, snr_num, &(thresh.flag));
-      if (ret == ERR_SENSOR_NA) {
-        get_fru_name(sensor_info->fru, fruname);
-        printf("%s SDR is missing!\n", fruname);
-
-        //modify the flag to true if we get the sensor reading
-        done_flag = true;
-
-        //Tell caller it's done
-        pthread_cond_signal(&done);
-
-        return NULL;
+    }
+  } else {
+    ret = sdr_get_fru_snr_thresh(sensor_info->fru, snr_list, cnt, snr_thresh, snr_ret);
+    for (i = 0; i < cnt; i++) {
+      if (ret < 0) {
+        snr_ret[i] = ret;
       }
-      else if (ret < 0) {
-        syslog(LOG_ERR, "sdr_get_snr_thresh failed for FRU %d num: 0x%X", sensor_info->fru, snr_num);
-        continue;
+      pal_alter_sensor_thresh_flag(sensor_info->fru, snr_list[i], &(snr_thresh[i].flag));
+      if (snr_ret[i] < 0 && snr_ret[i] != ERR_SENSOR_NA) {
+        syslog(LOG_ERR, "sdr_get_snr_thresh failed for FRU %d num: 0x%X", sensor_info->fru, snr_list[i]);
       }
     }
+  }
+
+  for (i = 0; i < cnt; i++) {
+    snr_num = snr_list[i];
+    thresh = &snr_thresh[i];
+    if (snr_ret[i] == ERR_SENSOR_NA) {
+      get_fru_name(sensor_info->fru, fruname);
+      fprintf(out, "%s SDR is missing!\n", fruname);
+      return;
+    }
+    if (snr_ret[i] != 0) {
+      continue;
+    }
+
+    // Give up on the rest of a FRU which takes too long
+    if (deadline_passed(sensor_info->deadline)) {
+      sensor_info->timed_out = true;
+      return;
+    }
 
     // for loop compare
     if (filter) {
       get_fru_name(sensor_info->fru, fruname);
-      sprintf(filter_sensor_name,"%s_%s", fruname,thresh.name);
+      sprintf(filter_sensor_name,"%s_%s", fruname,thresh->name);
       alter_to_fsc_style_sensor_name(filter_sensor_name);
       for (j=0;j<sensor_info->filter_len;j++) {
         if (strcmp(sensor_info->filter_list[j],filter_sensor_name) == 0) {
@@ -484,7 +552,7 @@ get_sensor_reading(void *sensor_data) {
       if (j == sensor_info->filter_len) {
         continue;
       }
-      sprintf(filter_sensor_name,"%s %s", fruname,thresh.name);
+      sprintf(filter_sensor_name,"%s %s", fruname,thresh->name);
     }
 
     if ((false == pal_sensor_is_cached(sensor_info->fru, snr_num)) || (true == sensor_info->force)) {
@@ -499,64 +567,28 @@ get_sensor_reading(void *sensor_data) {
       if (!is_pldm_sensor(snr_num, sensor_info->fru)) {
         if (json) {
           json_t *sensor_obj = json_object();
-          json_t *search = json_object_get(fru_sensor_obj, thresh.name);
 
           json_object_set_new(sensor_obj, "value", json_string("NA"));
-          if (search != NULL) {
-            /* in order to match the RESTAPI format */
-            if (json_is_object(search)) {
-              json_t *value_array = json_array();
-              json_array_append(value_array, search);
-              /*
-              Note : if we use append_new here,
-              the following "json_object_set_new(fru_sensor_obj, thresh->name, value_array)"
-              will free the json_object "search"
-              */
-              json_array_append_new(value_array, sensor_obj);
-              json_object_set_new(fru_sensor_obj, thresh.name, value_array);
-            } else if (json_is_array(search)) {
-              json_array_append_new(search, sensor_obj);
-            } else {
-              syslog(LOG_ERR, "[%s]get error type of the JSON obj", __func__);
-              json_decref(sensor_obj);
-            }
-          } else {
-            json_object_set_new(fru_sensor_obj, thresh.name, sensor_obj);
-          }
+          append_sensor_json(fru_sensor_obj, thresh->name, sensor_obj);
         } else if (filter) {
-          printf("%-28s (0x%X) : NA | (na)\n", filter_sensor_name, sensor_info->sensor_list[i]);
+          fprintf(out, "%-28s (0x%X) : NA | (na)\n", filter_sensor_name, snr_num);
         } else if (is_supported_sensor(snr_num, sensor_info->fru)) {
-          printf("%-28s (0x%X) : 0/NA | (na)\n", thresh.name, sensor_info->sensor_list[i]);
+          fprintf(out, "%-28s (0x%X) : 0/NA | (na)\n", thresh->name, snr_num);
         } else {
-          printf("%-28s (0x%X) : NA | (na)\n", thresh.name, sensor_info->sensor_list[i]);
+          fprintf(out, "%-28s (0x%X) : NA | (na)\n", thresh->name, snr_num);
         }
       }
       continue;
     }
     else {
-      get_sensor_status(fvalue, &thresh, status);
-      print_sensor_reading(fvalue, (uint16_t)snr_num, &thresh, sensor_info, status, fru_sensor_obj, filter_sensor_name);
+      get_sensor_status(fvalue, thresh, status);
+      print_sensor_reading(fvalue, (uint16_t)snr_num, thresh, sensor_info, status, fru_sensor_obj, filter_sensor_name);
     }
   }
-
-  //if the mutex is already locked, the calling thread shall block until the mutex becomes available
-  //wait for the mutex is released and then get the sensor reading
-  pthread_mutex_lock(&timer);
-
-  //modify the flag to true if we get the sensor reading
-  done_flag = true;
-
-  //Tell caller it's done
-  pthread_cond_signal(&done);
-
-  //release the mutex
-  pthread_mutex_unlock(&timer);
-
-  pthread_exit(0);
 }
 
 static void
-get_sensor_history(uint8_t fru, uint8_t *sensor_list, int sensor_cnt, int num, int period) {
+get_sensor_history(FILE *out, uint8_t fru, uint8_t *sensor_list, int sensor_cnt, int num, int period) {
 
   int start_time, i;
   uint8_t snr_num;
@@ -582,7 +614,7 @@ get_sensor_history(uint8_t fru, uint8_t *sensor_list, int sensor_cnt, int num, i
       ret = sdr_get_snr_thresh(fru, snr_num, &thresh);
       if (ret == ERR_SENSOR_NA) {
         get_fru_name(fru, fruname);
-        printf("%s SDR is missing!\n", fruname);
+        fprintf(out, "%s SDR is missing!\n", fruname);
         return;
       }
       else if (ret < 0) {
@@ -593,16 +625,16 @@ get_sensor_history(uint8_t fru, uint8_t *sensor_list, int sensor_cnt, int num, i
 
     if (sensor_read_history(fru, snr_num, &min, &average, &max, start_time) < 0) {
       if (!is_pldm_sensor(snr_num, fru)) {
-        printf("%-18s (0x%X) min = NA, average = NA, max = NA\n", thresh.name, snr_num);
+        fprintf(out, "%-18s (0x%X) min = NA, average = NA, max = NA\n", thresh.name, snr_num);
       }
       continue;
     }
 
-    printf("%-18s (0x%X) min = %.2f, average = %.2f, max = %.2f\n", thresh.name, snr_num, min, average, max);
+    fprintf(out, "%-18s (0x%X) min = %.2f, average = %.2f, max = %.2f\n", thresh.name, snr_num, min, average, max);
   }
 }
 
-static void clear_sensor_history(uint8_t fru, uint8_t *sensor_list, int sensor_cnt, int num) {
+static void clear_sensor_history(FILE *out, uint8_t fru, uint8_t *sensor_list, int sensor_cnt, int num) {
   int i;
   uint8_t snr_num;
 
@@ -612,104 +644,28 @@ static void clear_sensor_history(uint8_t fru, uint8_t *sensor_list, int sensor_c
       continue;
     }
     if (sensor_clear_history(fru, snr_num)) {
-      printf("Clearing fru:%u sensor[%u] failed!\n", fru, snr_num);
-    }
-  }
-}
-
-void get_sensor_reading_timer(struct timespec *timeout, get_sensor_reading_struct *sensor_data)
-{
-  struct timespec abs_time;
-  pthread_t tid_get_sensor_reading;
-  int err = 0;
-  int thread_alive = 0;
-  char fruname[32] = {0};
-
-  err = pthread_condattr_init(&done_attr);
-  if ( err != 0 )
-  {
-    syslog(LOG_WARNING, "[%s]init condattr fails. errno:%d", __func__, err);
-    return;
-  }
-
-  err = pthread_condattr_setclock(&done_attr, CLOCK_MONOTONIC);
-  if ( err != 0 )
-  {
-    syslog(LOG_WARNING, "[%s]set condattr clock fails. errno:%d", __func__, err);
-    return;
-  }
-
-  err = pthread_cond_init(&done, &done_attr);
-  if ( err != 0 )
-  {
-    syslog(LOG_WARNING, "[%s]init cond fails. errno:%d", __func__, err);
-    return;
-  }
-
-  pthread_mutex_lock(&timer);
-
-  //Assign the timeout time to abs_time
-  clock_gettime(CLOCK_MONOTONIC, &abs_time);
-  abs_time.tv_sec += timeout->tv_sec;
-  abs_time.tv_nsec += timeout->tv_nsec;
-
-  get_fru_name(sensor_data->fru, fruname);
-
-  //Make get_sensor_reading a thread
-  if (pthread_create(&tid_get_sensor_reading, NULL, get_sensor_reading, (void *) sensor_data) < 0) {
-    syslog(LOG_WARNING, "sensor-util FRU:%s, pthread_create failed\n", fruname);
-    pthread_mutex_unlock(&timer);
-    return;
-  }
-
-  //Check if thread is alive, if pthread_kill (thread_id, sig = 0) returns 0, means thread is alive
-  thread_alive = pthread_kill(tid_get_sensor_reading, 0);
-
-  if (thread_alive == 0)
-  {
-    while ( false == done_flag )
-    {
-      //Timer thread, continue only when get_sensor_reading send the done signal or abs_time timed out
-      err = pthread_cond_timedwait(&done, &timer, &abs_time);
-      if (err == ETIMEDOUT) {
-        break;
-      }
-    }
-
-    //Double Check if thread is still alive
-    thread_alive = pthread_kill(tid_get_sensor_reading, 0);
-
-    //Timeout actions
-    //If Timed out, and Thread is still alive, it means the thread is really timed out, cancel the thread
-    //If Timed out, and Thread is dead, it means the timed out is fake, do nothing
-    if ( (err == ETIMEDOUT) && (thread_alive == 0) ) {
-      printf("FRU:%s timed out...\n", fruname);
-      pthread_cancel(tid_get_sensor_reading);
+      fprintf(out, "Clearing fru:%u sensor[%u] failed!\n", fru, snr_num);
     }
   }
-
-  //re-init for the next fru
-  done_flag = false;
-
-  pthread_mutex_unlock(&timer);
-
-  return;
 }
 
 static int
-print_sensor(uint8_t fru, int sensor_num, bool allow_absent, bool history, bool threshold, bool force, bool json, bool history_clear, bool filter, char** filter_list, int filter_len,long period, json_t *fru_sensor_obj) {
+print_sensor(sensor_job *job) {
   int ret;
   uint8_t status;
   int sensor_cnt;
   uint8_t *sensor_list;
   char fruname[16] = {0};
-  struct timespec timeout;
   get_sensor_reading_struct data;
   char fru_list[256] = {0};
-
-  //Setup timeout for each fru get_sensor_reading
-  memset(&timeout, 0, sizeof(timeout));
-  timeout.tv_sec = pal_get_sensor_util_timeout(fru);
+  uint8_t fru = job->fru;
+  bool allow_absent = job->allow_absent;
+  bool force = job->force;
+  const sensor_util_opts *opts = job->opts;
+  int sensor_num = opts->sensor_num;
+  bool json = opts->json;
+  bool history_clear = opts->history_clear;
+  FILE *out = job->out;
 
   if (fru == AGGREGATE_SENSOR_FRU_ID) {
     size_t cnt, i;
@@ -754,7 +710,7 @@ print_sensor(uint8_t fru, int sensor_num, bool allow_absent, bool history, bool
     ret = pal_is_fru_prsnt(fru, &status);
     if (ret < 0) {
       if (json == 0)
-        printf("pal_is_fru_prsnt failed for fru: %s\n", fruname);
+        fprintf(out, "pal_is_fru_prsnt failed for fru: %s\n", fruname);
       return ret;
     }
     // FRU is not present
@@ -764,21 +720,21 @@ print_sensor(uint8_t fru, int sensor_num, bool allow_absent, bool history, bool
       if (allow_absent == true)
         return 0;
       if (json == 0)
-        printf("%s is not present!\n\n", fruname);
+        fprintf(out, "%s is not present!\n\n", fruname);
       return -1;
     }
 
     ret = pal_is_fru_ready(fru, &status);
     if ((ret < 0) || (status == 0)) {
       if (json == 0)
-        printf("%s is unavailable!\n\n", fruname);
+        fprintf(out, "%s is unavailable!\n\n", fruname);
       return ret;
     }
 
     ret = pal_get_fru_sensor_list(fru, &sensor_list, &sensor_cnt);
     if (ret < 0) {
       if (json == 0)
-        printf("%s get sensor list failed!\n", fruname);
+        fprintf(out, "%s get sensor list failed!\n", fruname);
       return ret;
     }
   }
@@ -794,35 +750,152 @@ print_sensor(uint8_t fru, int sensor_num, bool allow_absent, bool history, bool
 #endif
 
   if (history_clear) {
-    clear_sensor_history(fru, sensor_list, sensor_cnt, sensor_num);
-  } else if (history) {
-    get_sensor_history(fru, sensor_list, sensor_cnt, sensor_num, period);
+    clear_sensor_history(out, fru, sensor_list, sensor_cnt, sensor_num);
+  } else if (opts->history) {
+    get_sensor_history(out, fru, sensor_list, sensor_cnt, sensor_num, opts->period);
   } else {
     data.fru = fru;
     data.sensor_cnt = sensor_cnt;
     data.sensor_num = sensor_num;
-    data.threshold = threshold;
+    data.threshold = opts->threshold;
     data.force = force;
     data.json = json;
-    data.filter = filter;
-    data.filter_list = filter_list;
-    data.filter_len = filter_len;
-    data.fru_sensor_obj = fru_sensor_obj;
+    data.filter = opts->filter;
+    data.filter_list = opts->filter_list;
+    data.filter_len = opts->filter_len;
+    data.fru_sensor_obj = job->fru_sensor_obj;
     data.sensor_list = sensor_list;
-    // memcpy(data.sensor_list, sensor_list, sizeof(uint8_t)*sensor_cnt);
-    get_sensor_reading_timer(&timeout, &data);
+    data.out = out;
+    data.deadline = &job->job.deadline;
+    data.timed_out = false;
+    get_sensor_reading(&data);
+    if (data.timed_out) {
+      job->timed_out = true;
+      return 0;
+    }
   }
 
   //Print Empty Line to separate frus,
   //only when sensor_cnt greater than 0, not history-clear, and sensor_num is not specified
   if ( (sensor_cnt > 0) && (!history_clear) && (sensor_num == SENSOR_ALL) ){
     if (json == 0)
-      printf("\n");
+      fprintf(out, "\n");
   }
 
   return 0;
 }
 
+static int
+run_sensor_job(job_t *j) {
+  sensor_job *job = (sensor_job *)j;
+  int ret;
+
+  ret = print_sensor(job);
+  fclose(job->out);
+  return ret;
+}
+
+static sensor_job *
+add_sensor_job(const sensor_util_opts *opts, uint8_t fru, bool allow_absent, bool force, const char *banner) {
+  sensor_job *job;
+
+  job = (sensor_job *)calloc(1, sizeof(*job));
+  if (job == NULL) {
+    return NULL;
+  }
+  job->out = open_memstream(&job->out_buf, &job->out_len);
+  if (job->out == NULL) {
+    free(job);
+    return NULL;
+  }
+  job->fru = fru;
+  job->allow_absent = allow_absent;
+  job->force = force;
+  job->banner = banner;
+  job->opts = opts;
+  job->fru_sensor_obj = json_object();
+  job->job.run = run_sensor_job;
+  job->job.timeout = pal_get_sensor_util_timeout(fru);
+  if (job_pool_add(&sensor_jobs, &job->job)) {
+    fclose(job->out);
+    free(job->out_buf);
+    json_decref(job->fru_sensor_obj);
+    free(job);
+    return NULL;
+  }
+  return job;
+}
+
+static void
+merge_sensor_json(json_t *fru_sensor_obj, json_t *job_obj) {
+  const char *name;
+  json_t *value, *elem;
+  size_t i;
+
+  json_object_foreach(job_obj, name, value) {
+    if (json_is_array(value)) {
+      json_array_foreach(value, i, elem) {
+        append_sensor_json(fru_sensor_obj, name, json_incref(elem));
+      }
+    } else {
+      append_sensor_json(fru_sensor_obj, name, json_incref(value));
+    }
+  }
+}
+
+/*
+ * Runs the queued FRUs on up to MAX_SENSOR_UTIL_WORKERS threads and prints
+ * them in the order they were added. A FRU which is still busy after its
+ * timeout is left behind, and a new worker takes its place.
+ */
+static int
+run_sensor_jobs(json_t *fru_sensor_obj, bool combine) {
+  char fruname[32];
+  sensor_job *job;
+  int i, rc;
+  int ret = 0;
+
+  if (job_pool_start(&sensor_jobs, MAX_SENSOR_UTIL_WORKERS) < 0) {
+    return -1;
+  }
+
+  for (i = 0; i < sensor_jobs.count; i++) {
+    job = (sensor_job *)sensor_jobs.jobs[i];
+    rc = job_pool_wait(&sensor_jobs, &job->job);
+
+    if (job->banner) {
+      printf("%s\n", job->banner);
+    }
+    if (get_fru_name(job->fru, fruname)) {
+      sprintf(fruname, "fru%d", job->fru);
+    }
+    if (rc != 0) {
+      // The worker still owns the job, leave it alone
+      printf("FRU:%s timed out...\n", fruname);
+      if (!combine) {
+        ret = 0;
+      }
+      if (rc < 0) {
+        return -1;
+      }
+      continue;
+    }
+
+    fwrite(job->out_buf, 1, job->out_len, stdout);
+    if (job->timed_out) {
+      printf("FRU:%s timed out...\n", fruname);
+    }
+    merge_sensor_json(fru_sensor_obj, job->fru_sensor_obj);
+    ret = combine ? (ret | job->job.ret) : job->job.ret;
+
+    json_decref(job->fru_sensor_obj);
+    free(job->out_buf);
+    free(job);
+  }
+
+  return ret;
+}
+
 int parse_args(int argc, char *argv[], char *fruname,
     bool *history_clear, bool *history, bool *threshold, bool *force, bool *json, bool *filter, long *period, int *snr)
 {
@@ -950,6 +1023,9 @@ main(int argc, char **argv) {
   int filter_len = argc - 3;
   char ** filter_list = argv + 3;
   json_t *fru_sensor_obj = json_object();
+  sensor_util_opts opts;
+  bool all;
+  int i;
 
 #ifdef CONFIG_FBY3_CWC
   if (pal_is_cwc() == PAL_EOK) {
@@ -996,35 +1072,52 @@ main(int argc, char **argv) {
 #ifdef CONFIG_FBY3_CWC
 history_exit:
 #endif
-  if (fru == 0) {
+  opts.sensor_num = num;
+  opts.history = history;
+  opts.threshold = threshold;
+  opts.json = json;
+  opts.history_clear = history_clear;
+  opts.filter = filter;
+  opts.filter_list = filter_list;
+  opts.filter_len = filter_len;
+  opts.period = period;
+  for (i = 0; i < filter_len; i++) {
+    alter_to_fsc_style_sensor_name(filter_list[i]);
+  }
+
+  if (job_pool_init(&sensor_jobs, MAX_SENSOR_UTIL_JOBS)) {
+    return -1;
+  }
+
+  all = (fru == 0);
+  if (all) {
     for (fru = 1; fru <= MAX_NUM_FRUS; fru++) {
-      ret |= print_sensor(fru, num, true, history, threshold, force, json, history_clear, filter, filter_list, filter_len, period, fru_sensor_obj);
+      add_sensor_job(&opts, fru, true, force, NULL);
     }
-    ret |= print_sensor(AGGREGATE_SENSOR_FRU_ID, num, true, history, threshold, false, json, history_clear, filter, filter_list, filter_len, period, fru_sensor_obj);
+    add_sensor_job(&opts, AGGREGATE_SENSOR_FRU_ID, true, false, NULL);
 #ifdef CONFIG_FBY3_CWC
   if (cwcPlat > 0) {
-    printf("====================TOP GPV3====================\n");
-    ret = print_sensor(FRU_2U_TOP, num, false, history, threshold, force, json, history_clear, filter, filter_list, filter_len, period, fru_sensor_obj);
-    printf("===================BOTTOM GPV3===================\n");
-    ret = print_sensor(FRU_2U_BOT, num, false, history, threshold, force, json, history_clear, filter, filter_list, filter_len, period, fru_sensor_obj);
+    add_sensor_job(&opts, FRU_2U_TOP, false, force, "====================TOP GPV3====================");
+    add_sensor_job(&opts, FRU_2U_BOT, false, force, "===================BOTTOM GPV3===================");
   }
 #endif
   } else if (pal_get_pair_fru(fru, &pair_fru)) {
-    ret = print_sensor(fru, num, false, history, threshold, fru == AGGREGATE_SENSOR_FRU_ID ? false : force, json, history_clear, filter, filter_list, filter_len, period, fru_sensor_obj);
-    ret = print_sensor(pair_fru, num, false, history, threshold, pair_fru == AGGREGATE_SENSOR_FRU_ID ? false : force, json, history_clear, filter, filter_list, filter_len ,period, fru_sensor_obj);
+    add_sensor_job(&opts, fru, false, fru == AGGREGATE_SENSOR_FRU_ID ? false : force, NULL);
+    add_sensor_job(&opts, pair_fru, false, pair_fru == AGGREGATE_SENSOR_FRU_ID ? false : force, NULL);
   } else {
-    ret = print_sensor(fru, num, false, history, threshold, fru == AGGREGATE_SENSOR_FRU_ID ? false : force, json, history_clear, filter, filter_list, filter_len, period, fru_sensor_obj);
+    add_sensor_job(&opts, fru, false, fru == AGGREGATE_SENSOR_FRU_ID ? false : force, NULL);
   }
 
 #ifdef CONFIG_FBY3_CWC
   if (cwcPlat > 0 && fru == FRU_SLOT1) {
-    printf("====================TOP GPV3====================\n");
-    ret = print_sensor(FRU_2U_TOP, num, false, history, threshold, force, json, history_clear, filter, filter_list, filter_len, period, fru_sensor_obj);
-    printf("===================BOTTOM GPV3===================\n");
-    ret = print_sensor(FRU_2U_BOT, num, false, history, threshold, force, json, history_clear, filter, filter_list, filter_len, period, fru_sensor_obj);
+    add_sensor_job(&opts, FRU_2U_TOP, false, force, "====================TOP GPV3====================");
+    add_sensor_job(&opts, FRU_2U_BOT, false, force, "===================BOTTOM GPV3===================");
   }
 #endif
 
+  // All FRUs: any failure counts, otherwise the last FRU decides
+  ret = run_sensor_jobs(fru_sensor_obj, all);
+
   if (json) {
     json_dumpf(fru_sensor_obj, stdout, 4);
     printf("\n");
@@ -0,0 +1,94 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <unistd.h>
+#include "../sensor-jobs.h"
+
+using namespace std;
+
+struct test_job {
+  job_t job;  // must be first
+  int id;
+  int sleep_ms;
+};
+
+static atomic<int> running;
+static atomic<int> peak;
+
+static int run_test_job(job_t *job) {
+  test_job *t = (test_job *)job;
+  int now = ++running;
+  int old = peak;
+
+  while (now > old && !peak.compare_exchange_weak(old, now))
+    ;
+  usleep(t->sleep_ms * 1000);
+  running--;
+  return t->id;
+}
+
+// Pools and jobs outlive abandoned workers, so never put them on the stack
+static test_job *make_jobs(job_pool_t *pool, int count, int sleep_ms, int timeout) {
+  test_job *jobs = new test_job[count]();
+
+  EXPECT_EQ(job_pool_init(pool, count), 0);
+  for (int i = 0; i < count; i++) {
+    jobs[i].job.run = run_test_job;
+    jobs[i].job.timeout = timeout;
+    jobs[i].id = i;
+    jobs[i].sleep_ms = sleep_ms;
+    EXPECT_EQ(job_pool_add(pool, &jobs[i].job), 0);
+  }
+  return jobs;
+}
+
+TEST(job_pool, results_in_order) {
+  static job_pool_t pool;
+  test_job *jobs = make_jobs(&pool, 16, 1, 5);
+
+  running = peak = 0;
+  ASSERT_EQ(job_pool_start(&pool, 4), 4);
+  for (int i = 0; i < 16; i++) {
+    ASSERT_EQ(job_pool_wait(&pool, &jobs[i].job), 0);
+    EXPECT_EQ(jobs[i].job.ret, i);
+  }
+  EXPECT_LE(peak, 4);
+}
+
+TEST(job_pool, pool_is_full) {
+  static job_pool_t pool;
+  test_job extra = {};
+
+  make_jobs(&pool, 2, 0, 1);
+  EXPECT_EQ(job_pool_add(&pool, &extra.job), -1);
+}
+
+TEST(job_pool, waits_for_pickup) {
+  static job_pool_t pool;
+  // One worker, so the last job sits in the queue for ~1.2s, longer
+  // than its 1s timeout. It must not be abandoned while unstarted.
+  test_job *jobs = make_jobs(&pool, 4, 400, 1);
+
+  ASSERT_EQ(job_pool_start(&pool, 1), 1);
+  for (int i = 0; i < 4; i++) {
+    ASSERT_EQ(job_pool_wait(&pool, &jobs[i].job), 0);
+    EXPECT_EQ(jobs[i].job.ret, i);
+  }
+}
+
+TEST(job_pool, stuck_job_is_abandoned) {
+  static job_pool_t pool;
+  test_job *jobs = make_jobs(&pool, 4, 10, 1);
+  struct timespec start, end;
+
+  jobs[0].sleep_ms = 3000;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  ASSERT_EQ(job_pool_start(&pool, 1), 1);
+  EXPECT_EQ(job_pool_wait(&pool, &jobs[0].job), 1);
+  // A new worker picks up the rest of the queue
+  for (int i = 1; i < 4; i++) {
+    ASSERT_EQ(job_pool_wait(&pool, &jobs[i].job), 0);
+    EXPECT_EQ(jobs[i].job.ret, i);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  EXPECT_LT(end.tv_sec - start.tv_sec, 3);
+}
@@ -18,13 +18,22 @@
  * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <syslog.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <libgen.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
+#include <zlib.h>
 #include <openbmc/pal.h>
 
 #define MAX_FRU_NAME_LEN  64
@@ -42,15 +51,18 @@
 #define MFIH_MAGIC_TAG "/@MFG_ss"
 
 #define MAX_REASON_DESC 1024
-#define DEFAULT_REASON_FILE_NAME "/tmp/snapshot-reason-dft"
+#define DEFAULT_REASON_NAME "snapshot-reason-dft"
 
 // extra pw to prevent accidental clear of RMA data
 #define CLEAR_PW      "571932"
 
-#define TMP_SS_PATH   "/tmp/_snapshot"
-#define TMP_LOG_FILE  TMP_SS_PATH"/log.txt"
-#define TMP_POST_FILE TMP_SS_PATH"/postcode.txt"
-#define TMP_TARBALL   TMP_SS_PATH"/ss.tgz"
+#define SS_LOG_LINES    50
+#define SS_OUTPUT_MAX   (64 * 1024)   // output kept of each command
+#define SS_TAR_BLOCK    512
+
+#ifndef ARRAY_SIZE
+#define ARRAY_SIZE(_a) (sizeof(_a) / sizeof((_a)[0]))
+#endif
 
 #define OEM_REC_TYPE 0xFA
 
@@ -62,14 +74,6 @@
 #define EEPROM_ADDR 0xA2  // 8-bit address
 #endif
 
-#define log_system(cmd)                                                     \
-do {                                                                        \
-  int sysret = system(cmd);                                                 \
-  if (sysret)                                                               \
-    syslog(LOG_WARNING, "%s: system command failed, cmd: \"%s\",  ret: %d", \
-            __func__, cmd, sysret);                                         \
-} while(0)
-
 typedef struct _info_hdr {
   uint8_t magic_tag[8];
   uint16_t version;
@@ -242,51 +246,302 @@ is_ih_exist(uint8_t slot_id, uint8_t info_type, uint8_t idx, uint16_t *checksum,
   return 0;
 }
 
-static int
-util_create_default_reason(char *buf_data) {
-  FILE *f = fopen(DEFAULT_REASON_FILE_NAME, "w");
-  if (f == NULL) {
-      printf("Error creating default reason file!\n");
-      return -1;
+/*
+ * The snapshot is collected by independent collectors which run
+ * concurrently, each within its own time budget. Their output is kept in
+ * memory and streamed into one gzipped tar together with a manifest of
+ * what each collector did, so nothing is staged under /tmp.
+ */
+typedef struct _ss_collector {
+  const char *name;       // file in the archive
+  char *argv[6];          // command to run, NULL to use the given data
+  int budget_ms;
+  int tail_lines;         // keep only the last lines, 0 for all
+  pthread_t tid;
+  char *buf;
+  size_t len;
+  const char *status;
+  long elapsed_ms;
+} ss_collector;
+
+typedef struct _ss_archive {
+  z_stream zs;
+  time_t mtime;
+  int err;
+} ss_archive;
+
+static long
+ms_since(struct timespec *start) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) * 1000 +
+         (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+// Keep the output within SS_OUTPUT_MAX, dropping whole lines from the front
+static void
+collector_trim(ss_collector *c, size_t keep, int lines) {
+  size_t start = (c->len > keep) ? c->len - keep : 0;
+  size_t pos;
+
+  if (lines > 0) {
+    pos = c->len;
+    if (pos > 0 && c->buf[pos - 1] == '\n') {
+      pos--;
+    }
+    while (pos > start && lines > 0) {
+      if (c->buf[--pos] == '\n' && --lines == 0) {
+        pos++;
+        break;
+      }
+    }
+    if (lines == 0 || pos > start) {
+      start = pos;
+    }
+  } else if (start > 0) {
+    char *nl = memchr(c->buf + start, '\n', c->len - start);
+    if (nl != NULL) {
+      start = nl - c->buf + 1;
+    }
   }
 
-  // store at most MAX_REASON_DESC characters to file
-  fprintf(f, "%.*s\n", MAX_REASON_DESC, buf_data);
+  if (start > 0) {
+    memmove(c->buf, c->buf + start, c->len - start);
+    c->len -= start;
+  }
+}
 
-  fclose(f);
-  return 0;
+static void *
+collector_run(void *arg) {
+  ss_collector *c = (ss_collector *)arg;
+  struct timespec start;
+  struct pollfd pfd;
+  int fds[2], status = 0, timeout;
+  ssize_t n;
+  pid_t pid;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  c->status = "failed";
+  c->buf = malloc(SS_OUTPUT_MAX);
+  if (c->buf == NULL || pipe2(fds, O_CLOEXEC) != 0) {
+    goto done;
+  }
+
+  pid = fork();
+  if (pid < 0) {
+    close(fds[0]);
+    close(fds[1]);
+    goto done;
+  }
+  if (pid == 0) {
+    dup2(fds[1], STDOUT_FILENO);
+    execv(c->argv[0], c->argv);
+    _exit(127);
+  }
+  close(fds[1]);
+
+  pfd.fd = fds[0];
+  pfd.events = POLLIN;
+  c->status = "ok";
+  while (1) {
+    timeout = c->budget_ms - ms_since(&start);
+    if (timeout <= 0 || poll(&pfd, 1, timeout) == 0) {
+      c->status = "timeout";
+      kill(pid, SIGKILL);
+      break;
+    }
+    if (c->len == SS_OUTPUT_MAX) {
+      collector_trim(c, SS_OUTPUT_MAX / 2, 0);
+    }
+    n = read(fds[0], c->buf + c->len, SS_OUTPUT_MAX - c->len);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+    c->len += n;
+  }
+  close(fds[0]);
+
+  if (waitpid(pid, &status, 0) == pid && strcmp(c->status, "ok") == 0 &&
+      !(WIFEXITED(status) && WEXITSTATUS(status) == 0)) {
+    c->status = "failed";
+  }
+  if (c->tail_lines > 0) {
+    collector_trim(c, c->len, c->tail_lines);
+  }
+
+done:
+  c->elapsed_ms = ms_since(&start);
+  if (strcmp(c->status, "ok") != 0) {
+    syslog(LOG_WARNING, "%s: %s %s after %ld ms", __func__, c->argv[0],
+           c->status, c->elapsed_ms);
+  }
+  return NULL;
 }
 
+static int
+archive_write(ss_archive *ar, const void *data, size_t len) {
+  ar->zs.next_in = (Bytef *)data;
+  ar->zs.avail_in = len;
+  while (ar->zs.avail_in > 0 && !ar->err) {
+    if (ar->zs.avail_out == 0 || deflate(&ar->zs, Z_NO_FLUSH) != Z_OK) {
+      ar->err = -1;
+    }
+  }
+  return ar->err;
+}
+
+static int
+archive_add(ss_archive *ar, const char *name, const char *data, size_t len) {
+  uint8_t hdr[SS_TAR_BLOCK] = {0};
+  unsigned int sum = 0;
+  int i;
+
+  // ustar header, the same entry names "tar czf ss.tgz ./*" used to give
+  snprintf((char *)&hdr[0], 100, "./%s", name);
+  snprintf((char *)&hdr[100], 8, "%07o", 0644);
+  snprintf((char *)&hdr[108], 8, "%07o", 0);
+  snprintf((char *)&hdr[116], 8, "%07o", 0);
+  snprintf((char *)&hdr[124], 12, "%011o", (unsigned int)len);
+  snprintf((char *)&hdr[136], 12, "%011lo", (unsigned long)ar->mtime);
+  memset(&hdr[148], ' ', 8);
+  hdr[156] = '0';
+  memcpy(&hdr[257], "ustar\0" "00", 8);
+  snprintf((char *)&hdr[265], 32, "root");
+  snprintf((char *)&hdr[297], 32, "root");
+  for (i = 0; i < SS_TAR_BLOCK; i++) {
+    sum += hdr[i];
+  }
+  snprintf((char *)&hdr[148], 8, "%06o", sum);
+
+  archive_write(ar, hdr, sizeof(hdr));
+  archive_write(ar, data, len);
+  memset(hdr, 0, sizeof(hdr));
+  if (len % SS_TAR_BLOCK) {
+    archive_write(ar, hdr, SS_TAR_BLOCK - len % SS_TAR_BLOCK);
+  }
+  return ar->err;
+}
+
+/*
+ * Collect the snapshot of a FRU into a gzipped tar of at most max_len
+ * bytes. Returns its length, or -1 if it does not fit.
+ */
+static int
+collect_snapshot(const char *fru_name, const char *reason_name,
+                 const char *reason, size_t reason_len,
+                 uint8_t *out, size_t max_len) {
+  ss_collector cmds[] = {
+    {
+      .name = "log.txt",
+      .argv = {"/usr/local/bin/log-util", "all", "--print", NULL},
+      .budget_ms = 10000,
+      .tail_lines = SS_LOG_LINES,
+    },
+    {
+      .name = "postcode.txt",
+      .argv = {"/usr/local/bin/bios-util", (char *)fru_name, "--postcode",
+               "get", NULL},
+      .budget_ms = 5000,
+    },
+  };
+  char manifest[2 * SS_TAR_BLOCK];
+  struct timespec start;
+  ss_archive ar;
+  int i, pos, len = -1;
+
+  memset(&ar, 0, sizeof(ar));
+  ar.mtime = time(NULL);
+  if (deflateInit2(&ar.zs, Z_BEST_COMPRESSION, Z_DEFLATED, MAX_WBITS + 16,
+                   9, Z_DEFAULT_STRATEGY) != Z_OK) {
+    return -1;
+  }
+  ar.zs.next_out = out;
+  ar.zs.avail_out = max_len;
+
+  printf("Getting logs and POST codes...\n");
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < ARRAY_SIZE(cmds); i++) {
+    if (pthread_create(&cmds[i].tid, NULL, collector_run, &cmds[i]) != 0) {
+      collector_run(&cmds[i]);
+      cmds[i].tid = 0;
+    }
+  }
+  for (i = 0; i < ARRAY_SIZE(cmds); i++) {
+    if (cmds[i].tid) {
+      pthread_join(cmds[i].tid, NULL);
+    }
+  }
+
+  pos = snprintf(manifest, sizeof(manifest),
+                 "fru: %s\ncollected: %ld ms\n%-16s %-8s %8s %8s %8s\n"
+                 "%-16s %-8s %8d %8d %8zu\n",
+                 fru_name, ms_since(&start), "file", "status", "ms",
+                 "budget", "bytes", reason_name, "ok", 0, 0, reason_len);
+  for (i = 0; i < ARRAY_SIZE(cmds) && pos < sizeof(manifest); i++) {
+    pos += snprintf(manifest + pos, sizeof(manifest) - pos,
+                    "%-16s %-8s %8ld %8d %8zu\n", cmds[i].name,
+                    cmds[i].status, cmds[i].elapsed_ms, cmds[i].budget_ms,
+                    cmds[i].len);
+  }
+
+  archive_add(&ar, "manifest.txt", manifest, strlen(manifest));
+  archive_add(&ar, reason_name, reason, reason_len);
+  for (i = 0; i < ARRAY_SIZE(cmds); i++) {
+    archive_add(&ar, cmds[i].name, cmds[i].buf, cmds[i].len);
+    free(cmds[i].buf);
+  }
+  // end of archive: two zero blocks
+  memset(manifest, 0, 2 * SS_TAR_BLOCK);
+  archive_write(&ar, manifest, 2 * SS_TAR_BLOCK);
+
+  if (!ar.err && deflate(&ar.zs, Z_FINISH) == Z_STREAM_END) {
+    len = ar.zs.total_out;
+  }
+  deflateEnd(&ar.zs);
+  return len;
+}
 
 static int
 util_store_snapshot(uint8_t slot_id, uint8_t info_type, char *cmdline_opt) {
   uint8_t wbuf[64], rbuf[64], ih_buf[IH_SIZE], ih_offs, idx, max_idx;
+  uint8_t *archive;
   uint16_t sum;
-  char cmd[256], *magic_tag;
-  int ret, fsize, offset, len, i;
+  char *magic_tag, *reason_name;
+  char reason[MAX_REASON_DESC + 2];
+  int ret, fsize, offset, len, i, pos;
+  size_t reason_len;
   info_hdr *ih = (info_hdr *)ih_buf;
   struct stat st = {0};
   FILE *fp;
-  char *reason_file = cmdline_opt;
   char fru_name[MAX_FRU_NAME_LEN] = {0};
 
   memset(fru_name, 0, sizeof(fru_name));
 
   // check if user specified a file containing "reason string"
   if (stat(cmdline_opt, &st) != 0) {
-    // file doesn't exist, treat it as stdin and create a file instead
+    // file doesn't exist, treat it as the reason itself
     printf("Reason file doesn't exist, assume stdin\n");
-    ret = util_create_default_reason(reason_file);
-    if (!ret) {
-      reason_file = DEFAULT_REASON_FILE_NAME;
-    } else {
-      return ret;
+    // store at most MAX_REASON_DESC characters
+    reason_len = snprintf(reason, sizeof(reason), "%.*s\n", MAX_REASON_DESC,
+                          cmdline_opt);
+    reason_name = DEFAULT_REASON_NAME;
+  } else {
+    if (st.st_size > MAX_REASON_DESC) {
+      printf("%s is too large\n", cmdline_opt);
+      return -1;
     }
-  }
-
-  if (st.st_size > MAX_REASON_DESC) {
-    printf("%s is too large\n", reason_file);
-    return -1;
+    fp = fopen(cmdline_opt, "rb");
+    if (fp == NULL) {
+      printf("unable to get the %s fp %s\n", cmdline_opt, strerror(errno));
+      return errno;
+    }
+    reason_len = fread(reason, 1, MAX_REASON_DESC, fp);
+    fclose(fp);
+    reason_name = basename(cmdline_opt);
   }
 
   max_idx = (info_type == TYPE_MFG) ? MAX_MFI_NUM : MAX_RI_NUM;
@@ -299,40 +554,11 @@ util_store_snapshot(uint8_t slot_id, uint8_t info_type, char *cmdline_opt) {
     return -1;
   }
 
-  snprintf(cmd, sizeof(cmd), "rm -rf %s", TMP_SS_PATH);
-  log_system(cmd);
-  mkdir(TMP_SS_PATH, 0755);
-
-  snprintf(cmd, sizeof(cmd), "cp %s %s/", reason_file, TMP_SS_PATH);
-  log_system(cmd);
-
   if (pal_get_fru_name(slot_id, fru_name) < 0) {
     syslog(LOG_ERR, "%s: failed to get fru name", __func__);
     return -1;
   }
 
-  printf("Getting logs...\n");
-  snprintf(cmd, sizeof(cmd), "/usr/local/bin/log-util all --print | /usr/bin/tail -n 50 > %s",
-           TMP_LOG_FILE);
-  log_system(cmd);
-
-  printf("Getting POST codes...\n");
-  snprintf(cmd, sizeof(cmd), "/usr/local/bin/bios-util %s --postcode get > %s", fru_name, TMP_POST_FILE);
-  log_system(cmd);
-
-  if (chdir(TMP_SS_PATH)) {
-    syslog(LOG_WARNING, "chdir failed, dir path: %s", TMP_SS_PATH);
-    return -1;
-  }
-  snprintf(cmd, sizeof(cmd), "tar czf %s ./*", TMP_TARBALL);
-  log_system(cmd);
-
-  fp = fopen(TMP_TARBALL, "rb");
-  if (fp == NULL) {
-    printf("unable to get the %s fp %s\n", TMP_TARBALL, strerror(errno));
-    return errno;
-  }
-
   if (info_type == TYPE_MFG) {
     idx = MAX_RI_NUM;
     magic_tag = MFIH_MAGIC_TAG;
@@ -340,26 +566,31 @@ util_store_snapshot(uint8_t slot_id, uint8_t info_type, char *cmdline_opt) {
     magic_tag = RIH_MAGIC_TAG;
   }
 
-  fseek(fp, 0L, SEEK_END);
-  fsize = ftell(fp);
-  printf("File Size: %d\n", fsize);
-  if ((fsize + IH_SIZE) > m_info_rec[idx].size) {
+  archive = malloc(m_info_rec[idx].size);
+  if (archive == NULL) {
+    return -1;
+  }
+  fsize = collect_snapshot(fru_name, reason_name, reason, reason_len,
+                           archive, m_info_rec[idx].size - IH_SIZE);
+  if (fsize < 0) {
     printf("file is too large\n");
-    fclose(fp);
+    free(archive);
     return -1;
   }
+  printf("File Size: %d\n", fsize);
   printf("Storing to EEPROM...\n");
 
   sum = 0;
-  rewind(fp);
   offset = m_info_rec[idx].offset + IH_SIZE;
-  while ((len = fread(&wbuf[2], 1, BLOCK_SIZE, fp)) > 0) {
+  for (pos = 0; pos < fsize; pos += len) {
+    len = (fsize - pos > BLOCK_SIZE) ? BLOCK_SIZE : fsize - pos;
     wbuf[0] = (offset >> 8) & 0xFF;
     wbuf[1] = offset & 0xFF;
+    memcpy(&wbuf[2], &archive[pos], len);
     ret = bic_master_write_read(slot_id, EEPROM_BUS, EEPROM_ADDR, wbuf, 2+len, rbuf, 0);
     if (ret != 0) {
       printf("write failed 0x%x, len = %d\n", offset, len);
-      fclose(fp);
+      free(archive);
       return ret;
     }
 
@@ -370,7 +601,7 @@ util_store_snapshot(uint8_t slot_id, uint8_t info_type, char *cmdline_opt) {
     offset += len;
     msleep(10);
   }
-  fclose(fp);
+  free(archive);
 
   memset(ih_buf, 0x00, IH_SIZE);
   memcpy(ih->magic_tag, magic_tag, 8);
@@ -393,7 +624,6 @@ util_store_snapshot(uint8_t slot_id, uint8_t info_type, char *cmdline_opt) {
     ret = bic_master_write_read(slot_id, EEPROM_BUS, EEPROM_ADDR, wbuf, 2+len, rbuf, 0);
     if (ret != 0) {
       printf("write failed 0x%x, len = %d\n", offset, len);
-      fclose(fp);
       return ret;
     }
 
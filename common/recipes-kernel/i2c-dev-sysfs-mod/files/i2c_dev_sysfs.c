@@ -25,6 +25,7 @@
 #include <linux/hwmon.h>
 #include <linux/hwmon-sysfs.h>
 #include <linux/i2c.h>
+#include <linux/jiffies.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
 #include <linux/slab.h>
@@ -45,6 +46,133 @@
 
 #endif
 
+static inline bool i2c_dev_shadow_covers(const i2c_dev_shadow_st *shadow,
+                                         int reg)
+{
+  return reg >= shadow->ids_first_reg &&
+         reg < shadow->ids_first_reg + shadow->ids_n_regs;
+}
+
+/*
+ * The registers read together with the non-volatile register at index
+ * idx: its block of I2C_SMBUS_BLOCK_MAX registers, cut short at volatile
+ * registers on either side, as reading latched registers may clear them.
+ */
+static int i2c_dev_shadow_window(const i2c_dev_shadow_st *shadow,
+                                 int idx, int *n)
+{
+  int lo, hi, base;
+
+  base = idx - idx % I2C_SMBUS_BLOCK_MAX;
+  hi = min(base + I2C_SMBUS_BLOCK_MAX, shadow->ids_n_regs);
+  hi = find_next_bit(shadow->ids_volatile, hi, idx);
+  for (lo = idx; lo > base && !test_bit(lo - 1, shadow->ids_volatile); lo--)
+    ;
+  *n = hi - lo;
+  return lo;
+}
+
+/*
+ * Refresh the shadow around reg: one block read of up to
+ * I2C_SMBUS_BLOCK_MAX registers, or only reg when the adapter cannot do
+ * I2C block reads.
+ */
+static int i2c_dev_shadow_refresh(struct i2c_client *client,
+                                  i2c_dev_shadow_st *shadow,
+                                  int reg)
+{
+  int first, n, i, ret;
+  uint8_t *regs;
+
+  if (shadow->ids_block_read) {
+    first = shadow->ids_first_reg +
+            i2c_dev_shadow_window(shadow, reg - shadow->ids_first_reg, &n);
+  } else {
+    first = reg;
+    n = 1;
+  }
+  regs = &shadow->ids_regs[first - shadow->ids_first_reg];
+
+  shadow->ids_bus_reads++;
+  if (n > 1) {
+    shadow->ids_block_reads++;
+    ret = i2c_smbus_read_i2c_block_data(client, first, n, regs);
+    if (ret >= 0 && ret != n) {
+      ret = -EIO;
+    }
+  } else {
+    ret = i2c_smbus_read_byte_data(client, first);
+    if (ret >= 0) {
+      regs[0] = ret;
+    }
+  }
+  if (ret < 0) {
+    return ret;
+  }
+
+  for (i = first - shadow->ids_first_reg; n > 0; i++, n--) {
+    set_bit(i, shadow->ids_valid);
+    shadow->ids_stamp[i] = jiffies;
+  }
+  PP_DEBUG("Refreshed shadow from register %#x", first);
+  return 0;
+}
+
+/*
+ * Read one register, from the shadow if the device has one and the
+ * register is neither volatile nor stale. Called with idd_lock held.
+ */
+static int i2c_dev_reg_read(struct i2c_client *client,
+                            i2c_dev_data_st *data,
+                            int reg)
+{
+  i2c_dev_shadow_st *shadow = data->idd_shadow;
+  int idx, ret;
+
+  if (!shadow) {
+    return i2c_smbus_read_byte_data(client, reg);
+  }
+
+  shadow->ids_reads++;
+  if (!i2c_dev_shadow_covers(shadow, reg)) {
+    shadow->ids_bus_reads++;
+    return i2c_smbus_read_byte_data(client, reg);
+  }
+
+  idx = reg - shadow->ids_first_reg;
+  if (test_bit(idx, shadow->ids_volatile) || !shadow->ids_valid_ms) {
+    shadow->ids_bus_reads++;
+    ret = i2c_smbus_read_byte_data(client, reg);
+    if (ret >= 0) {
+      shadow->ids_regs[idx] = ret;
+    }
+    return ret;
+  }
+
+  if (!test_bit(idx, shadow->ids_valid) ||
+      time_after(jiffies, shadow->ids_stamp[idx] +
+                          msecs_to_jiffies(shadow->ids_valid_ms))) {
+    ret = i2c_dev_shadow_refresh(client, shadow, reg);
+    if (ret < 0) {
+      return ret;
+    }
+  }
+  return shadow->ids_regs[idx];
+}
+
+/*
+ * The device may not read back what was written, e.g. write-1-to-clear
+ * bits, so the next read of the register goes to the device.
+ */
+static void i2c_dev_reg_written(i2c_dev_data_st *data, int reg)
+{
+  i2c_dev_shadow_st *shadow = data->idd_shadow;
+
+  if (shadow && i2c_dev_shadow_covers(shadow, reg)) {
+    clear_bit(reg - shadow->ids_first_reg, shadow->ids_valid);
+  }
+}
+
 ssize_t i2c_dev_show_label(struct device *dev,
                            struct device_attribute *attr,
                            char *buf)
@@ -73,7 +201,7 @@ int i2c_dev_read_byte(struct device *dev,
 
   mutex_lock(&data->idd_lock);
 
-  val = i2c_smbus_read_byte_data(client, dev_attr->ida_reg);
+  val = i2c_dev_reg_read(client, data, dev_attr->ida_reg);
 
   mutex_unlock(&data->idd_lock);
 
@@ -101,7 +229,7 @@ int i2c_dev_read_nbytes(struct device *dev,
 
   mutex_lock(&data->idd_lock);
   for (i = 0; i < nbytes; ++i) {
-    ret_val = i2c_smbus_read_byte_data(client, dev_attr->ida_reg + i);
+    ret_val = i2c_dev_reg_read(client, data, dev_attr->ida_reg + i);
     if (ret_val < 0) {
       mutex_unlock(&data->idd_lock);
       return ret_val;
@@ -191,7 +319,7 @@ static ssize_t i2c_dev_sysfs_show(struct device *dev,
   mutex_lock(&data->idd_lock);
 
   /* default handling */
-  reg_val = i2c_smbus_read_byte_data(client, dev_attr->ida_reg);
+  reg_val = i2c_dev_reg_read(client, data, dev_attr->ida_reg);
 
   mutex_unlock(&data->idd_lock);
 
@@ -239,7 +367,10 @@ static ssize_t i2c_dev_sysfs_store(struct device *dev,
 
   mutex_lock(&data->idd_lock);
 
-  /* default handling, first read back the current value */
+  /*
+   * default handling, first read back the current value. Always from the
+   * device, other bits may have changed since the shadow was refreshed.
+   */
   val = i2c_smbus_read_byte_data(client, dev_attr->ida_reg);
 
   if (val < 0) {
@@ -252,6 +383,7 @@ static ssize_t i2c_dev_sysfs_store(struct device *dev,
   val |= req_val << dev_attr->ida_bit_offset;
 
   val = i2c_smbus_write_byte_data(client, dev_attr->ida_reg, val);
+  i2c_dev_reg_written(data, dev_attr->ida_reg);
 
  unlock_out:
   mutex_unlock(&data->idd_lock);
@@ -270,11 +402,169 @@ static ssize_t i2c_dev_sysfs_store(struct device *dev,
   return count;
 }
 
+static ssize_t i2c_dev_shadow_stats_show(struct device *dev,
+                                         struct device_attribute *attr,
+                                         char *buf)
+{
+  struct i2c_client *client = to_i2c_client(dev);
+  i2c_dev_data_st *data = i2c_get_clientdata(client);
+  i2c_dev_shadow_st *shadow = data->idd_shadow;
+  unsigned long reads, bus_reads, block_reads;
+
+  mutex_lock(&data->idd_lock);
+  reads = shadow->ids_reads;
+  bus_reads = shadow->ids_bus_reads;
+  block_reads = shadow->ids_block_reads;
+  mutex_unlock(&data->idd_lock);
+
+  return scnprintf(buf, PAGE_SIZE,
+                   "reads: %lu\nbus_reads: %lu\nblock_reads: %lu\n"
+                   "bus_reads_saved: %lu\n",
+                   reads, bus_reads, block_reads,
+                   reads > bus_reads ? reads - bus_reads : 0);
+}
+
+static ssize_t i2c_dev_shadow_valid_ms_show(struct device *dev,
+                                            struct device_attribute *attr,
+                                            char *buf)
+{
+  struct i2c_client *client = to_i2c_client(dev);
+  i2c_dev_data_st *data = i2c_get_clientdata(client);
+
+  return scnprintf(buf, PAGE_SIZE, "%u\n", data->idd_shadow->ids_valid_ms);
+}
+
+static ssize_t i2c_dev_shadow_valid_ms_store(struct device *dev,
+                                             struct device_attribute *attr,
+                                             const char *buf, size_t count)
+{
+  struct i2c_client *client = to_i2c_client(dev);
+  i2c_dev_data_st *data = i2c_get_clientdata(client);
+  unsigned int val;
+
+  if (kstrtouint(buf, 0, &val)) {
+    return -EINVAL;
+  }
+
+  mutex_lock(&data->idd_lock);
+  data->idd_shadow->ids_valid_ms = val;
+  mutex_unlock(&data->idd_lock);
+  return count;
+}
+
+static DEVICE_ATTR(shadow_stats, S_IRUGO, i2c_dev_shadow_stats_show, NULL);
+static DEVICE_ATTR(shadow_valid_ms, S_IRUGO | S_IWUSR,
+                   i2c_dev_shadow_valid_ms_show,
+                   i2c_dev_shadow_valid_ms_store);
+
+static struct attribute *i2c_dev_shadow_attrs[] = {
+  &dev_attr_shadow_stats.attr,
+  &dev_attr_shadow_valid_ms.attr,
+  NULL,
+};
+
+static const struct attribute_group i2c_dev_shadow_attr_group = {
+  .attrs = i2c_dev_shadow_attrs,
+};
+
+/*
+ * Some devices do not auto-increment the register address on I2C block
+ * reads. Compare one block read with byte reads of the same registers.
+ */
+static bool i2c_dev_shadow_block_ok(struct i2c_client *client,
+                                    const i2c_dev_shadow_st *shadow)
+{
+  uint8_t block[I2C_SMBUS_BLOCK_MAX];
+  int idx, first, n, i, ret;
+
+  idx = find_first_zero_bit(shadow->ids_volatile, shadow->ids_n_regs);
+  if (idx >= shadow->ids_n_regs) {
+    return false;
+  }
+  first = i2c_dev_shadow_window(shadow, idx, &n);
+  if (n < 2) {
+    return false;
+  }
+  first += shadow->ids_first_reg;
+
+  ret = i2c_smbus_read_i2c_block_data(client, first, n, block);
+  if (ret != n) {
+    return false;
+  }
+  for (i = 0; i < n; i++) {
+    ret = i2c_smbus_read_byte_data(client, first + i);
+    if (ret < 0 || ret != block[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * Enable the register shadow of a device set up by
+ * i2c_dev_sysfs_data_init(). Block reads are only used if they return
+ * the same as byte reads at probe time.
+ */
+int i2c_dev_sysfs_shadow_init(struct i2c_client *client,
+                              i2c_dev_data_st *data,
+                              const i2c_dev_shadow_cfg_st *cfg)
+{
+  i2c_dev_shadow_st *shadow;
+  int i, reg, err;
+
+  if (cfg->isc_first_reg < 0 || cfg->isc_n_regs <= 0 ||
+      cfg->isc_n_regs > I2C_DEV_SHADOW_MAX_REGS) {
+    return -EINVAL;
+  }
+
+  shadow = kzalloc(sizeof(*shadow), GFP_KERNEL);
+  if (!shadow) {
+    return -ENOMEM;
+  }
+  shadow->ids_first_reg = cfg->isc_first_reg;
+  shadow->ids_n_regs = cfg->isc_n_regs;
+  shadow->ids_valid_ms = cfg->isc_valid_ms;
+  for (i = 0; i < cfg->isc_n_volatile_regs; i++) {
+    reg = cfg->isc_volatile_regs[i];
+    if (i2c_dev_shadow_covers(shadow, reg)) {
+      set_bit(reg - shadow->ids_first_reg, shadow->ids_volatile);
+    }
+  }
+  if (i2c_check_functionality(client->adapter,
+                              I2C_FUNC_SMBUS_READ_I2C_BLOCK)) {
+    shadow->ids_block_read = i2c_dev_shadow_block_ok(client, shadow);
+    if (!shadow->ids_block_read) {
+      dev_info(&client->dev,
+               "block reads differ from byte reads, using byte reads\n");
+    }
+  }
+
+  if ((err = sysfs_create_group(&client->dev.kobj,
+                                &i2c_dev_shadow_attr_group))) {
+    kfree(shadow);
+    return err;
+  }
+
+  mutex_lock(&data->idd_lock);
+  data->idd_shadow = shadow;
+  mutex_unlock(&data->idd_lock);
+
+  PP_DEBUG("Shadowing %d registers from %#x, %s reads",
+           shadow->ids_n_regs, shadow->ids_first_reg,
+           shadow->ids_block_read ? "block" : "byte");
+  return 0;
+}
+EXPORT_SYMBOL_GPL(i2c_dev_sysfs_shadow_init);
+
 void i2c_dev_sysfs_data_clean(struct i2c_client *client, i2c_dev_data_st *data)
 {
   if (!data) {
     return;
   }
+  if (data->idd_shadow) {
+    sysfs_remove_group(&client->dev.kobj, &i2c_dev_shadow_attr_group);
+    kfree(data->idd_shadow);
+  }
   if (data->idd_hwmon_dev) {
     hwmon_device_unregister(data->idd_hwmon_dev);
   }
@@ -53,11 +53,44 @@ typedef struct i2c_sysfs_attr_st_{
 #define TO_I2C_SYSFS_ATTR(_attr) \
 	container_of(_attr, i2c_sysfs_attr_st, isa_dev_attr)
 
+/*
+ * Optional register shadow. Registers in [isc_first_reg, isc_first_reg +
+ * isc_n_regs) are read from the device with I2C block reads and served
+ * from memory for isc_valid_ms. Volatile registers, such as latched
+ * interrupt status, are always read from the device on their own and
+ * never as part of a block read.
+ */
+#define I2C_DEV_SHADOW_MAX_REGS 256
+
+typedef struct i2c_dev_shadow_cfg_st_ {
+  int isc_first_reg;
+  int isc_n_regs;
+  unsigned int isc_valid_ms;
+  const int *isc_volatile_regs;
+  int isc_n_volatile_regs;
+} i2c_dev_shadow_cfg_st;
+
+typedef struct i2c_dev_shadow_st_ {
+  int ids_first_reg;
+  int ids_n_regs;
+  unsigned int ids_valid_ms;
+  bool ids_block_read;
+  DECLARE_BITMAP(ids_volatile, I2C_DEV_SHADOW_MAX_REGS);
+  DECLARE_BITMAP(ids_valid, I2C_DEV_SHADOW_MAX_REGS);
+  unsigned long ids_stamp[I2C_DEV_SHADOW_MAX_REGS];
+  uint8_t ids_regs[I2C_DEV_SHADOW_MAX_REGS];
+  /* statistics */
+  unsigned long ids_reads;
+  unsigned long ids_bus_reads;
+  unsigned long ids_block_reads;
+} i2c_dev_shadow_st;
+
 typedef struct i2c_dev_data_st_ {
   struct device *idd_hwmon_dev;
   struct mutex idd_lock;
   i2c_sysfs_attr_st *idd_attrs;
   struct attribute_group idd_attr_group;
+  i2c_dev_shadow_st *idd_shadow;
 } i2c_dev_data_st;
 
 int i2c_dev_sysfs_data_init(struct i2c_client *client,
@@ -65,6 +98,9 @@ int i2c_dev_sysfs_data_init(struct i2c_client *client,
                             const i2c_dev_attr_st *dev_attrs,
                             int n_attrs);
 void i2c_dev_sysfs_data_clean(struct i2c_client *client, i2c_dev_data_st *data);
+int i2c_dev_sysfs_shadow_init(struct i2c_client *client,
+                              i2c_dev_data_st *data,
+                              const i2c_dev_shadow_cfg_st *cfg);
 int i2c_dev_read_byte(struct device *dev,
                       struct device_attribute *attr);
 int i2c_dev_read_nbytes(struct device *dev,
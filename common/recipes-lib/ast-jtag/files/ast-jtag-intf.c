@@ -1,14 +1,27 @@
 #include <unistd.h>
+#include <string.h>
 
 #include "ast-jtag-intf.h"
+#include "ast-jtag.h"
 #include <openbmc/misc-utils.h>
 
 extern struct jtag_ops jtag0_ops;
 extern struct jtag_ops astjtag_ops;
+extern struct jtag_ops jtag_sim_ops;
+void jtag_sim_set_dev(const struct ast_jtag_sim_dev *dev);
 
 static struct jtag_ops *jtag_ops = &jtag0_ops;
 static int lock_fd = -1;
 
+/* Operations and the TDI data they shift, see ast_jtag_queue_*() */
+#define JTAG_QUEUE_OPS   512
+#define JTAG_QUEUE_WORDS 8192
+
+static struct jtag_op jtag_queue[JTAG_QUEUE_OPS];
+static unsigned int jtag_queue_data[JTAG_QUEUE_WORDS];
+static int queue_ops = 0;
+static int queue_words = 0;
+
 
 __attribute__((constructor))
 void __attribute__((constructor)) ast_jtag_init(void)
@@ -20,6 +33,20 @@ void __attribute__((constructor)) ast_jtag_init(void)
   }
 }
 
+int ast_jtag_sim_attach(const struct ast_jtag_sim_dev *dev)
+{
+  if (lock_fd != -1) {
+    return -1;
+  }
+  if (dev == NULL) {
+    ast_jtag_init();
+    return 0;
+  }
+  jtag_sim_set_dev(dev);
+  jtag_ops = &jtag_sim_ops;
+  return 0;
+}
+
 void ast_jtag_set_mode(unsigned int mode)
 {
   jtag_ops->set_mode(mode);
@@ -44,6 +71,7 @@ int ast_jtag_open(void)
 
 void ast_jtag_close(void)
 {
+  ast_jtag_queue_flush();
   jtag_ops->close();
   single_instance_unlock(lock_fd);
   lock_fd = -1;
@@ -61,20 +89,148 @@ int ast_set_jtag_freq(unsigned int freq)
 
 int ast_jtag_run_test_idle(unsigned char reset, unsigned char end, unsigned char tck)
 {
+  if (ast_jtag_queue_flush())
+    return -1;
   return jtag_ops->run_test_idle(reset, end, tck);
 }
 
 int ast_jtag_sir_xfer(unsigned char endir, unsigned int len, unsigned int tdi)
 {
+  if (ast_jtag_queue_flush())
+    return -1;
   return jtag_ops->sir_xfer(endir, len, tdi);
 }
 
 int ast_jtag_tdi_xfer(unsigned char enddr, unsigned int len, unsigned int *tdio)
 {
+  if (ast_jtag_queue_flush())
+    return -1;
   return jtag_ops->tdi_xfer(enddr, len, tdio);
 }
 
 int ast_jtag_tdo_xfer(unsigned char enddr, unsigned int len, unsigned int *tdio)
 {
+  if (ast_jtag_queue_flush())
+    return -1;
   return jtag_ops->tdo_xfer(enddr, len, tdio);
 }
+
+static struct jtag_op *queue_add(unsigned char type, unsigned int words)
+{
+  struct jtag_op *op;
+
+  if (queue_ops == JTAG_QUEUE_OPS || queue_words + words > JTAG_QUEUE_WORDS) {
+    if (ast_jtag_queue_flush())
+      return NULL;
+  }
+
+  op = &jtag_queue[queue_ops++];
+  memset(op, 0, sizeof(*op));
+  op->type = type;
+  return op;
+}
+
+int ast_jtag_queue_run_test_idle(unsigned char reset, unsigned char end, unsigned char tck)
+{
+  struct jtag_op *op = queue_add(JTAG_OP_RUN_TEST_IDLE, 0);
+
+  if (op == NULL)
+    return -1;
+  op->reset = reset;
+  op->end = end;
+  op->tck = tck;
+  return 0;
+}
+
+int ast_jtag_queue_sir(unsigned char endir, unsigned int len, unsigned int tdi)
+{
+  struct jtag_op *op;
+
+  if (len > 32)
+    return -1;
+  op = queue_add(JTAG_OP_SIR, 0);
+  if (op == NULL)
+    return -1;
+  op->end = endir;
+  op->len = len;
+  op->tdi = tdi;
+  return 0;
+}
+
+int ast_jtag_queue_tdi(unsigned char enddr, unsigned int len, const unsigned int *tdio)
+{
+  unsigned int words = (len + 31) / 32;
+  struct jtag_op *op;
+
+  if (tdio == NULL)
+    return -1;
+  if (words > JTAG_QUEUE_WORDS) {
+    /* Too big to queue, do it right away */
+    return ast_jtag_tdi_xfer(enddr, len, (unsigned int *)tdio);
+  }
+
+  op = queue_add(JTAG_OP_TDI, words);
+  if (op == NULL)
+    return -1;
+  op->end = enddr;
+  op->len = len;
+  op->tdio = &jtag_queue_data[queue_words];
+  memcpy(op->tdio, tdio, words * sizeof(unsigned int));
+  queue_words += words;
+  return 0;
+}
+
+int ast_jtag_queue_tdo(unsigned char enddr, unsigned int len, unsigned int *tdio)
+{
+  struct jtag_op *op;
+
+  if (tdio == NULL)
+    return -1;
+  op = queue_add(JTAG_OP_TDO, 0);
+  if (op == NULL)
+    return -1;
+  op->end = enddr;
+  op->len = len;
+  op->tdio = tdio;
+  return 0;
+}
+
+/*
+ * Run all queued operations. Drivers that can take a list of transfers
+ * get the whole queue at once, others get one call per operation.
+ * Returns -1 if any operation failed; the operations after it are dropped.
+ */
+int ast_jtag_queue_flush(void)
+{
+  struct jtag_op *op;
+  int i, ret = 0;
+
+  if (queue_ops == 0)
+    return 0;
+
+  if (jtag_ops->xfer_batch) {
+    ret = jtag_ops->xfer_batch(jtag_queue, queue_ops);
+  } else {
+    for (i = 0; i < queue_ops && ret >= 0; i++) {
+      op = &jtag_queue[i];
+      switch (op->type) {
+        case JTAG_OP_RUN_TEST_IDLE:
+          ret = jtag_ops->run_test_idle(op->reset, op->end, op->tck);
+          break;
+        case JTAG_OP_SIR:
+          ret = jtag_ops->sir_xfer(op->end, op->len, op->tdi);
+          break;
+        case JTAG_OP_TDI:
+          ret = jtag_ops->tdi_xfer(op->end, op->len, op->tdio);
+          break;
+        case JTAG_OP_TDO:
+          ret = jtag_ops->tdo_xfer(op->end, op->len, op->tdio);
+          break;
+      }
+    }
+  }
+
+  queue_ops = 0;
+  queue_words = 0;
+  return ret < 0 ? -1 : 0;
+}
@@ -1,6 +1,24 @@
 #ifndef _AST_JTAG_INTF_H_
 #define _AST_JTAG_INTF_H_
 
+enum {
+  JTAG_OP_RUN_TEST_IDLE,
+  JTAG_OP_SIR,
+  JTAG_OP_TDI,
+  JTAG_OP_TDO,
+};
+
+/* One queued operation, see ast_jtag_queue_*() */
+struct jtag_op {
+  unsigned char type;
+  unsigned char reset;
+  unsigned char end;
+  unsigned char tck;
+  unsigned int len;
+  unsigned int tdi;
+  unsigned int *tdio;
+};
+
 struct jtag_ops {
   int (*open)();
   void (*close)();
@@ -11,6 +29,8 @@ struct jtag_ops {
   int (*sir_xfer)(unsigned char,unsigned int, unsigned int);
   int (*tdo_xfer)(unsigned char, unsigned int, unsigned int*);
   int (*tdi_xfer)(unsigned char, unsigned int, unsigned int*);
+  /* Optional, runs a whole queue in one driver transaction */
+  int (*xfer_batch)(struct jtag_op *, int);
 };
 
 #endif
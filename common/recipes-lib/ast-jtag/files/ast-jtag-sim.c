@@ -0,0 +1,384 @@
+/*
+ * ast-jtag software TAP model
+ *
+ * Copyright 2021-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * Every operation is turned into TMS/TDI cycles which clock an IEEE 1149.1
+ * TAP controller; the device only sees Capture/Update events. Like the
+ * ASPEED driver, an SIR/SDR ends in Pause-IR/DR when a pause end state is
+ * requested and in Run-Test/Idle otherwise.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "ast-jtag-intf.h"
+#include "ast-jtag.h"
+
+#define SIM_DR_WORDS (AST_JTAG_SIM_DR_MAX / 32)
+
+static const struct ast_jtag_sim_dev *sim_dev = NULL;
+static enum jtag_endstate tap_state = JTAG_STATE_TLRESET;
+static unsigned int sim_ir = 0;
+static unsigned int sim_sr[SIM_DR_WORDS];
+static unsigned int sim_sr_len = 0;
+static unsigned int sim_sr_pos = 0;
+static unsigned int sim_freq = 0;
+static struct ast_jtag_sim_stats sim_stats;
+static unsigned long sim_fail_call = 0;
+
+/* Next state for TMS = 0 and TMS = 1 */
+static const unsigned char tap_next[16][2] = {
+  [JTAG_STATE_TLRESET]   = {JTAG_STATE_IDLE,     JTAG_STATE_TLRESET},
+  [JTAG_STATE_IDLE]      = {JTAG_STATE_IDLE,     JTAG_STATE_SELECTDR},
+  [JTAG_STATE_SELECTDR]  = {JTAG_STATE_CAPTUREDR, JTAG_STATE_SELECTIR},
+  [JTAG_STATE_CAPTUREDR] = {JTAG_STATE_SHIFTDR,  JTAG_STATE_EXIT1DR},
+  [JTAG_STATE_SHIFTDR]   = {JTAG_STATE_SHIFTDR,  JTAG_STATE_EXIT1DR},
+  [JTAG_STATE_EXIT1DR]   = {JTAG_STATE_PAUSEDR,  JTAG_STATE_UPDATEDR},
+  [JTAG_STATE_PAUSEDR]   = {JTAG_STATE_PAUSEDR,  JTAG_STATE_EXIT2DR},
+  [JTAG_STATE_EXIT2DR]   = {JTAG_STATE_SHIFTDR,  JTAG_STATE_UPDATEDR},
+  [JTAG_STATE_UPDATEDR]  = {JTAG_STATE_IDLE,     JTAG_STATE_SELECTDR},
+  [JTAG_STATE_SELECTIR]  = {JTAG_STATE_CAPTUREIR, JTAG_STATE_TLRESET},
+  [JTAG_STATE_CAPTUREIR] = {JTAG_STATE_SHIFTIR,  JTAG_STATE_EXIT1IR},
+  [JTAG_STATE_SHIFTIR]   = {JTAG_STATE_SHIFTIR,  JTAG_STATE_EXIT1IR},
+  [JTAG_STATE_EXIT1IR]   = {JTAG_STATE_PAUSEIR,  JTAG_STATE_UPDATEIR},
+  [JTAG_STATE_PAUSEIR]   = {JTAG_STATE_PAUSEIR,  JTAG_STATE_EXIT2IR},
+  [JTAG_STATE_EXIT2IR]   = {JTAG_STATE_SHIFTIR,  JTAG_STATE_UPDATEIR},
+  [JTAG_STATE_UPDATEIR]  = {JTAG_STATE_IDLE,     JTAG_STATE_SELECTDR},
+};
+
+void jtag_sim_set_dev(const struct ast_jtag_sim_dev *dev)
+{
+  sim_dev = dev;
+  tap_state = JTAG_STATE_TLRESET;
+}
+
+void ast_jtag_sim_get_stats(struct ast_jtag_sim_stats *stats)
+{
+  *stats = sim_stats;
+}
+
+void ast_jtag_sim_clear_stats(void)
+{
+  memset(&sim_stats, 0, sizeof(sim_stats));
+}
+
+void ast_jtag_sim_fail_call(unsigned long n)
+{
+  sim_fail_call = n ? sim_stats.calls + n : 0;
+}
+
+/* Count a driver transaction, false if it is the one set up to fail */
+static bool sim_call(void)
+{
+  sim_stats.calls++;
+  if (sim_fail_call != 0 && sim_stats.calls == sim_fail_call) {
+    sim_fail_call = 0;
+    return false;
+  }
+  return true;
+}
+
+enum jtag_endstate ast_jtag_sim_get_state(void)
+{
+  return tap_state;
+}
+
+static unsigned int ir_mask(void)
+{
+  return sim_dev->ir_len >= 32 ? ~0U : (1U << sim_dev->ir_len) - 1;
+}
+
+static int sr_bit(const unsigned int *buf, unsigned int bit)
+{
+  return (buf[bit / 32] >> (bit % 32)) & 1;
+}
+
+static void sr_set_bit(unsigned int *buf, unsigned int bit, int val)
+{
+  if (val)
+    buf[bit / 32] |= 1U << (bit % 32);
+  else
+    buf[bit / 32] &= ~(1U << (bit % 32));
+}
+
+/*
+ * The shift register is a ring: bit sim_sr_pos is next out on TDO and is
+ * replaced by TDI. Rotate it back into order before an update.
+ */
+static void sr_rotate(void)
+{
+  unsigned int tmp[SIM_DR_WORDS];
+  unsigned int i;
+
+  if (sim_sr_pos == 0)
+    return;
+  memset(tmp, 0, sizeof(tmp));
+  for (i = 0; i < sim_sr_len; i++)
+    sr_set_bit(tmp, i, sr_bit(sim_sr, (sim_sr_pos + i) % sim_sr_len));
+  memcpy(sim_sr, tmp, sizeof(tmp));
+  sim_sr_pos = 0;
+}
+
+/* One TCK cycle, returns TDO */
+static int sim_clock(int tms, int tdi)
+{
+  int tdo = 0;
+
+  switch (tap_state) {
+    case JTAG_STATE_CAPTUREDR:
+      memset(sim_sr, 0, sizeof(sim_sr));
+      sim_sr_len = 0;
+      if (sim_dev->capture_dr)
+        sim_sr_len = sim_dev->capture_dr(sim_dev->priv, sim_ir, sim_sr);
+      if (sim_sr_len == 0 || sim_sr_len > AST_JTAG_SIM_DR_MAX) {
+        /* BYPASS */
+        sim_sr[0] = 0;
+        sim_sr_len = 1;
+      }
+      sim_sr_pos = 0;
+      break;
+    case JTAG_STATE_CAPTUREIR:
+      /* IEEE 1149.1 requires 01 in the two bits closest to TDO */
+      sim_sr[0] = 0x1;
+      sim_sr_len = sim_dev->ir_len;
+      sim_sr_pos = 0;
+      break;
+    case JTAG_STATE_SHIFTDR:
+    case JTAG_STATE_SHIFTIR:
+      tdo = sr_bit(sim_sr, sim_sr_pos);
+      sr_set_bit(sim_sr, sim_sr_pos, tdi);
+      if (++sim_sr_pos == sim_sr_len)
+        sim_sr_pos = 0;
+      break;
+    default:
+      break;
+  }
+
+  tap_state = tap_next[tap_state][tms ? 1 : 0];
+  sim_stats.tck++;
+
+  switch (tap_state) {
+    case JTAG_STATE_UPDATEDR:
+      sr_rotate();
+      if (sim_dev->update_dr)
+        sim_dev->update_dr(sim_dev->priv, sim_ir, sim_sr, sim_sr_len);
+      break;
+    case JTAG_STATE_UPDATEIR:
+      sr_rotate();
+      sim_ir = sim_sr[0] & ir_mask();
+      if (sim_dev->update_ir)
+        sim_dev->update_ir(sim_dev->priv, sim_ir);
+      break;
+    case JTAG_STATE_TLRESET:
+      sim_ir = sim_dev->reset ? sim_dev->reset(sim_dev->priv) & ir_mask() : ir_mask();
+      break;
+    default:
+      break;
+  }
+
+  return tdo;
+}
+
+/* Walk the shortest TMS path to a state */
+static void sim_goto(enum jtag_endstate target)
+{
+  unsigned char prev[16], tms[16], path[16];
+  unsigned char queue[16];
+  int head = 0, tail = 0, len = 0;
+  int s, n, b;
+
+  if (tap_state == target)
+    return;
+  if (target == JTAG_STATE_TLRESET) {
+    for (n = 0; n < 5; n++)
+      sim_clock(1, 0);
+    return;
+  }
+
+  memset(prev, 0xff, sizeof(prev));
+  prev[tap_state] = tap_state;
+  queue[tail++] = tap_state;
+  while (head < tail && prev[target] == 0xff) {
+    s = queue[head++];
+    for (b = 0; b < 2; b++) {
+      n = tap_next[s][b];
+      if (prev[n] == 0xff) {
+        prev[n] = s;
+        tms[n] = b;
+        queue[tail++] = n;
+      }
+    }
+  }
+
+  for (s = target; s != tap_state; s = prev[s])
+    path[len++] = tms[s];
+  while (len > 0)
+    sim_clock(path[--len], 0);
+}
+
+static enum jtag_endstate stable_end(unsigned char end, int ir)
+{
+  if (end == JTAG_STATE_PAUSEIR || end == JTAG_STATE_PAUSEDR)
+    return ir ? JTAG_STATE_PAUSEIR : JTAG_STATE_PAUSEDR;
+  return JTAG_STATE_IDLE;
+}
+
+static void sim_shift(int ir, unsigned char end, unsigned int len,
+                      const unsigned int *tdi, unsigned int *tdo)
+{
+  unsigned int i;
+  int bit;
+
+  sim_goto(ir ? JTAG_STATE_SHIFTIR : JTAG_STATE_SHIFTDR);
+  for (i = 0; i < len; i++) {
+    bit = sim_clock(i == len - 1, tdi ? sr_bit(tdi, i) : 0);
+    if (tdo)
+      sr_set_bit(tdo, i, bit);
+  }
+  sim_goto(stable_end(end, ir));
+}
+
+static int sim_run_op(struct jtag_op *op)
+{
+  int i;
+
+  if (sim_dev == NULL)
+    return -1;
+  sim_stats.ops++;
+
+  switch (op->type) {
+    case JTAG_OP_RUN_TEST_IDLE:
+      if (op->reset)
+        sim_goto(JTAG_STATE_TLRESET);
+      if (op->end == JTAG_STATE_TLRESET) {
+        sim_goto(JTAG_STATE_TLRESET);
+        for (i = 0; i < op->tck; i++)
+          sim_clock(1, 0);
+      } else {
+        sim_goto(stable_end(op->end, op->end == JTAG_STATE_PAUSEIR));
+        for (i = 0; i < op->tck; i++)
+          sim_clock(0, 0);
+      }
+      break;
+    case JTAG_OP_SIR:
+      if (op->len == 0 || op->len > 32)
+        return -1;
+      sim_shift(1, op->end, op->len, &op->tdi, NULL);
+      break;
+    case JTAG_OP_TDI:
+    case JTAG_OP_TDO:
+      if (op->tdio == NULL || op->len == 0)
+        return -1;
+      if (op->type == JTAG_OP_TDO) {
+        memset(op->tdio, 0, (op->len + 31) / 32 * sizeof(unsigned int));
+        sim_shift(0, op->end, op->len, NULL, op->tdio);
+      } else {
+        sim_shift(0, op->end, op->len, op->tdio, NULL);
+      }
+      break;
+    default:
+      return -1;
+  }
+  return 0;
+}
+
+static int sim_run_single(struct jtag_op *op)
+{
+  if (!sim_call())
+    return -1;
+  return sim_run_op(op);
+}
+
+static int _sim_open(void)
+{
+  if (sim_dev == NULL)
+    return -1;
+  sim_goto(JTAG_STATE_TLRESET);
+  return 0;
+}
+
+static void _sim_close(void)
+{
+}
+
+static void _sim_set_mode(unsigned int mode)
+{
+}
+
+static unsigned int _sim_get_freq(void)
+{
+  return sim_freq;
+}
+
+static int _sim_set_freq(unsigned int freq)
+{
+  sim_freq = freq;
+  return 0;
+}
+
+static int _sim_run_test_idle(unsigned char reset, unsigned char end, unsigned char tck)
+{
+  struct jtag_op op = {JTAG_OP_RUN_TEST_IDLE, reset, end, tck, 0, 0, NULL};
+  return sim_run_single(&op);
+}
+
+static int _sim_sir_xfer(unsigned char endir, unsigned int len, unsigned int tdi)
+{
+  struct jtag_op op = {JTAG_OP_SIR, 0, endir, 0, len, tdi, NULL};
+  return sim_run_single(&op);
+}
+
+static int _sim_tdo_xfer(unsigned char enddr, unsigned int len, unsigned int *tdio)
+{
+  struct jtag_op op = {JTAG_OP_TDO, 0, enddr, 0, len, 0, tdio};
+  return sim_run_single(&op);
+}
+
+static int _sim_tdi_xfer(unsigned char enddr, unsigned int len, unsigned int *tdio)
+{
+  struct jtag_op op = {JTAG_OP_TDI, 0, enddr, 0, len, 0, tdio};
+  return sim_run_single(&op);
+}
+
+static int _sim_xfer_batch(struct jtag_op *ops, int count)
+{
+  int i;
+
+  if (!sim_call())
+    return -1;
+  for (i = 0; i < count; i++) {
+    if (sim_run_op(&ops[i]))
+      return -1;
+  }
+  return 0;
+}
+
+struct jtag_ops jtag_sim_ops = {
+  _sim_open,
+  _sim_close,
+  _sim_set_mode,
+  _sim_get_freq,
+  _sim_set_freq,
+  _sim_run_test_idle,
+  _sim_sir_xfer,
+  _sim_tdo_xfer,
+  _sim_tdi_xfer,
+  _sim_xfer_batch
+};
@@ -0,0 +1,213 @@
+/*
+ * Copyright 2021-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * Runs the JTAG API against the software TAP model: TAP state tracking,
+ * IR/DR scans, BYPASS, and queued operations giving the same results as
+ * direct calls in a single driver transaction.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "ast-jtag.h"
+
+#define TEST_IR_LEN   8
+#define TEST_IDCODE   0xE0
+#define TEST_DATA     0x10
+#define TEST_BYPASS   0xFF
+#define TEST_ID       0x012BD043
+#define TEST_DATA_LEN 200
+
+struct test_dev {
+  unsigned int data[(TEST_DATA_LEN + 31) / 32];
+  int updates;
+};
+
+static struct test_dev dev;
+
+static unsigned int test_reset(void *priv)
+{
+  return TEST_IDCODE;
+}
+
+static unsigned int test_capture_dr(void *priv, unsigned int ir, unsigned int *dr)
+{
+  struct test_dev *d = priv;
+
+  switch (ir) {
+    case TEST_IDCODE:
+      dr[0] = TEST_ID;
+      return 32;
+    case TEST_DATA:
+      memcpy(dr, d->data, sizeof(d->data));
+      return TEST_DATA_LEN;
+  }
+  return 0;
+}
+
+static void test_update_dr(void *priv, unsigned int ir, const unsigned int *dr, unsigned int len)
+{
+  struct test_dev *d = priv;
+
+  if (ir == TEST_DATA) {
+    memcpy(d->data, dr, sizeof(d->data));
+    d->updates++;
+  }
+}
+
+static const struct ast_jtag_sim_dev sim = {
+  .ir_len = TEST_IR_LEN,
+  .priv = &dev,
+  .reset = test_reset,
+  .capture_dr = test_capture_dr,
+  .update_dr = test_update_dr,
+};
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+  if (!(cond)) { \
+    printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+    failures++; \
+  } \
+} while (0)
+
+static void test_states(void)
+{
+  CHECK(ast_jtag_sim_get_state() == JTAG_STATE_TLRESET);
+  CHECK(ast_jtag_run_test_idle(0, JTAG_STATE_IDLE, 3) == 0);
+  CHECK(ast_jtag_sim_get_state() == JTAG_STATE_IDLE);
+  CHECK(ast_jtag_sir_xfer(JTAG_STATE_PAUSEIR, TEST_IR_LEN, TEST_BYPASS) == 0);
+  CHECK(ast_jtag_sim_get_state() == JTAG_STATE_PAUSEIR);
+  /* Non-pause end states leave the TAP in Run-Test/Idle */
+  CHECK(ast_jtag_sir_xfer(JTAG_STATE_TLRESET, TEST_IR_LEN, TEST_BYPASS) == 0);
+  CHECK(ast_jtag_sim_get_state() == JTAG_STATE_IDLE);
+  CHECK(ast_jtag_run_test_idle(1, JTAG_STATE_IDLE, 0) == 0);
+  CHECK(ast_jtag_sim_get_state() == JTAG_STATE_IDLE);
+}
+
+static void test_scans(void)
+{
+  unsigned int id = 0, bypass = 0xffffffff;
+  unsigned int out[(TEST_DATA_LEN + 31) / 32], in[(TEST_DATA_LEN + 31) / 32];
+  int i;
+
+  /* Test-Logic-Reset selects IDCODE */
+  CHECK(ast_jtag_run_test_idle(1, JTAG_STATE_IDLE, 0) == 0);
+  CHECK(ast_jtag_tdo_xfer(JTAG_STATE_IDLE, 32, &id) == 0);
+  CHECK(id == TEST_ID);
+
+  id = 0;
+  CHECK(ast_jtag_sir_xfer(JTAG_STATE_IDLE, TEST_IR_LEN, TEST_IDCODE) == 0);
+  CHECK(ast_jtag_tdo_xfer(JTAG_STATE_PAUSEDR, 32, &id) == 0);
+  CHECK(ast_jtag_sim_get_state() == JTAG_STATE_PAUSEDR);
+  CHECK(id == TEST_ID);
+
+  CHECK(ast_jtag_sir_xfer(JTAG_STATE_IDLE, TEST_IR_LEN, TEST_BYPASS) == 0);
+  CHECK(ast_jtag_tdo_xfer(JTAG_STATE_IDLE, 32, &bypass) == 0);
+  CHECK(bypass == 0);
+
+  for (i = 0; i < (int)(sizeof(in) / sizeof(in[0])); i++)
+    in[i] = 0x9e3779b9 * (i + 1);
+  in[TEST_DATA_LEN / 32] &= (1U << (TEST_DATA_LEN % 32)) - 1;
+  CHECK(ast_jtag_sir_xfer(JTAG_STATE_IDLE, TEST_IR_LEN, TEST_DATA) == 0);
+  CHECK(ast_jtag_tdi_xfer(JTAG_STATE_IDLE, TEST_DATA_LEN, in) == 0);
+  CHECK(memcmp(dev.data, in, sizeof(in)) == 0);
+  memset(out, 0, sizeof(out));
+  CHECK(ast_jtag_tdo_xfer(JTAG_STATE_IDLE, TEST_DATA_LEN, out) == 0);
+  CHECK(memcmp(out, in, sizeof(in)) == 0);
+}
+
+static void test_queue(void)
+{
+  unsigned int direct[8][(TEST_DATA_LEN + 31) / 32];
+  unsigned int queued[8][(TEST_DATA_LEN + 31) / 32];
+  unsigned int data[(TEST_DATA_LEN + 31) / 32];
+  struct ast_jtag_sim_stats st;
+  unsigned long long tck;
+  int i, j;
+
+  memset(direct, 0, sizeof(direct));
+  memset(queued, 0, sizeof(queued));
+
+  ast_jtag_sim_clear_stats();
+  for (i = 0; i < 8; i++) {
+    for (j = 0; j < (int)(sizeof(data) / sizeof(data[0])); j++)
+      data[j] = (i + 1) * 0x01010101 + j;
+    data[TEST_DATA_LEN / 32] &= (1U << (TEST_DATA_LEN % 32)) - 1;
+    ast_jtag_sir_xfer(JTAG_STATE_PAUSEIR, TEST_IR_LEN, TEST_DATA);
+    ast_jtag_tdi_xfer(JTAG_STATE_IDLE, TEST_DATA_LEN, data);
+    ast_jtag_run_test_idle(0, JTAG_STATE_IDLE, 10);
+    ast_jtag_tdo_xfer(JTAG_STATE_IDLE, TEST_DATA_LEN, direct[i]);
+  }
+  ast_jtag_sim_get_stats(&st);
+  CHECK(st.calls == 32);
+  CHECK(st.ops == 32);
+  tck = st.tck;
+
+  ast_jtag_sim_clear_stats();
+  for (i = 0; i < 8; i++) {
+    for (j = 0; j < (int)(sizeof(data) / sizeof(data[0])); j++)
+      data[j] = (i + 1) * 0x01010101 + j;
+    data[TEST_DATA_LEN / 32] &= (1U << (TEST_DATA_LEN % 32)) - 1;
+    CHECK(ast_jtag_queue_sir(JTAG_STATE_PAUSEIR, TEST_IR_LEN, TEST_DATA) == 0);
+    CHECK(ast_jtag_queue_tdi(JTAG_STATE_IDLE, TEST_DATA_LEN, data) == 0);
+    CHECK(ast_jtag_queue_run_test_idle(0, JTAG_STATE_IDLE, 10) == 0);
+    CHECK(ast_jtag_queue_tdo(JTAG_STATE_IDLE, TEST_DATA_LEN, queued[i]) == 0);
+  }
+  /* Nothing runs before the flush; TDI data was copied */
+  memset(data, 0, sizeof(data));
+  ast_jtag_sim_get_stats(&st);
+  CHECK(st.calls == 0);
+  CHECK(ast_jtag_queue_flush() == 0);
+  ast_jtag_sim_get_stats(&st);
+  CHECK(st.calls == 1);
+  CHECK(st.ops == 32);
+  CHECK(st.tck == tck);
+  CHECK(memcmp(direct, queued, sizeof(direct)) == 0);
+
+  /* Direct calls run what is queued first */
+  memset(queued, 0, sizeof(queued));
+  CHECK(ast_jtag_queue_sir(JTAG_STATE_IDLE, TEST_IR_LEN, TEST_DATA) == 0);
+  CHECK(ast_jtag_queue_tdi(JTAG_STATE_IDLE, TEST_DATA_LEN, direct[3]) == 0);
+  CHECK(ast_jtag_tdo_xfer(JTAG_STATE_IDLE, TEST_DATA_LEN, queued[0]) == 0);
+  CHECK(memcmp(queued[0], direct[3], sizeof(queued[0])) == 0);
+
+  /* Errors are reported by the flush */
+  CHECK(ast_jtag_queue_tdo(JTAG_STATE_IDLE, 0, queued[0]) == 0);
+  CHECK(ast_jtag_queue_flush() == -1);
+  CHECK(ast_jtag_queue_sir(JTAG_STATE_IDLE, 33, 0) == -1);
+}
+
+int main(void)
+{
+  if (ast_jtag_sim_attach(&sim) || ast_jtag_open()) {
+    printf("Cannot open the simulated JTAG device\n");
+    return 1;
+  }
+  test_states();
+  test_scans();
+  test_queue();
+  ast_jtag_close();
+
+  if (failures) {
+    printf("%d checks failed\n", failures);
+    return 1;
+  }
+  printf("All tests passed\n");
+  return 0;
+}
@@ -18,4 +18,51 @@ int ast_jtag_sir_xfer(unsigned char endir, unsigned int len, unsigned int tdi);
 int ast_jtag_tdo_xfer(unsigned char enddr, unsigned int len, unsigned int *tdio);
 int ast_jtag_tdi_xfer(unsigned char enddr, unsigned int len, unsigned int *tdio);
 
+/*
+ * Queued operations. They take the same arguments as the calls above but
+ * only run when the queue is flushed, in as few driver transactions as
+ * the driver allows. TDI data is copied when queued; TDO buffers are
+ * filled by ast_jtag_queue_flush(). Direct calls flush the queue first.
+ */
+int ast_jtag_queue_run_test_idle(unsigned char reset, unsigned char end, unsigned char tck);
+int ast_jtag_queue_sir(unsigned char endir, unsigned int len, unsigned int tdi);
+int ast_jtag_queue_tdi(unsigned char enddr, unsigned int len, const unsigned int *tdio);
+int ast_jtag_queue_tdo(unsigned char enddr, unsigned int len, unsigned int *tdio);
+int ast_jtag_queue_flush(void);
+
+/******************************************************************************************************************/
+/*
+ * Software TAP model. ast_jtag_sim_attach() replaces the JTAG driver with
+ * a TCK level TAP controller connected to the given device, so programming
+ * flows can be tested and benchmarked without hardware. Pass NULL to go
+ * back to the real driver. Must be called before ast_jtag_open().
+ */
+#define AST_JTAG_SIM_DR_MAX 4096
+
+struct ast_jtag_sim_dev {
+  unsigned int ir_len;
+  void *priv;
+  /* Test-Logic-Reset, returns the instruction selected by the reset */
+  unsigned int (*reset)(void *priv);
+  /* Update-IR */
+  void (*update_ir)(void *priv, unsigned int ir);
+  /* Capture-DR, fills dr and returns the length of the selected register */
+  unsigned int (*capture_dr)(void *priv, unsigned int ir, unsigned int *dr);
+  /* Update-DR */
+  void (*update_dr)(void *priv, unsigned int ir, const unsigned int *dr, unsigned int len);
+};
+
+struct ast_jtag_sim_stats {
+  unsigned long calls;    /* driver transactions */
+  unsigned long ops;      /* SIR, SDR and run-test-idle operations */
+  unsigned long long tck; /* TCK cycles */
+};
+
+int ast_jtag_sim_attach(const struct ast_jtag_sim_dev *dev);
+void ast_jtag_sim_get_stats(struct ast_jtag_sim_stats *stats);
+void ast_jtag_sim_clear_stats(void);
+/* Fail the n-th driver transaction from now, without running it; 0 cancels */
+void ast_jtag_sim_fail_call(unsigned long n);
+enum jtag_endstate ast_jtag_sim_get_state(void);
+
 #endif /* __AST_JTAG_H__ */
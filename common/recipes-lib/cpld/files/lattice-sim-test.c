@@ -0,0 +1,345 @@
+/*
+ * Copyright 2021-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * Programs a generated JED file into a simulated LCMXO2-7000HC through the
+ * cpld_* API and checks the flash contents and the USERCODE afterwards.
+ * Page programming and erase keep the model busy for a while, and a page
+ * written while busy marks the device failed, so the busy polling is
+ * exercised as well. Finally a JTAG transaction is made to fail halfway
+ * through a second update, which has to abort it.
+ *
+ * Usage: lattice-sim-test [cf_rows]
+ * Prints the time taken and the number of JTAG driver transactions, so it
+ * doubles as a benchmark of the Lattice update path.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <openbmc/ast-jtag.h>
+#include "cpld.h"
+#include "lattice.h"
+
+#define ROW_WORDS     4
+#define MAX_CF_ROWS   9212
+#define UFM_ROWS      32
+#define SIM_DEV_ID    0x012BD043
+#define SIM_USERCODE  0x00C0FFEE
+#define T_PROG_US     200
+#define T_ERASE_US    5000
+
+struct lcmxo2 {
+  unsigned int ir;
+  unsigned int cf[MAX_CF_ROWS][ROW_WORDS];
+  unsigned int ufm[UFM_ROWS][ROW_WORDS];
+  unsigned int *section;
+  unsigned int section_rows;
+  unsigned int addr;
+  unsigned int usercode;
+  unsigned int last_dr32;
+  int enabled;
+  int done;
+  int failed;
+  uint64_t busy_until;
+};
+
+static struct lcmxo2 dev;
+static unsigned int jed_cf[MAX_CF_ROWS][ROW_WORDS];
+static unsigned int jed_ufm[UFM_ROWS][ROW_WORDS];
+
+static uint64_t now_us(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int lcmxo2_busy(struct lcmxo2 *d)
+{
+  return now_us() < d->busy_until;
+}
+
+static void lcmxo2_set_section(struct lcmxo2 *d, unsigned int *rows, unsigned int n)
+{
+  d->section = rows;
+  d->section_rows = n;
+  d->addr = 0;
+}
+
+static unsigned int lcmxo2_reset(void *priv)
+{
+  return LCMXO2_IDCODE_PUB;
+}
+
+static void lcmxo2_update_ir(void *priv, unsigned int ir)
+{
+  struct lcmxo2 *d = priv;
+
+  d->ir = ir;
+  switch (ir) {
+    case LCMXO2_LSC_INIT_ADDRESS:
+      lcmxo2_set_section(d, &d->cf[0][0], MAX_CF_ROWS);
+      break;
+    case LCMXO2_LSC_INIT_ADDR_UFM:
+      lcmxo2_set_section(d, &d->ufm[0][0], UFM_ROWS);
+      break;
+    case LCMXO2_ISC_PROGRAM_USERCOD:
+      if (!d->enabled || lcmxo2_busy(d))
+        d->failed = 1;
+      /* The USERCODE is shifted in before the instruction */
+      d->usercode = d->last_dr32;
+      d->busy_until = now_us() + T_PROG_US;
+      break;
+    case LCMXO2_ISC_PROGRAM_DONE:
+      if (!d->enabled)
+        d->failed = 1;
+      d->done = 1;
+      d->busy_until = now_us() + T_PROG_US;
+      break;
+    case LCMXO2_ISC_DISABLE:
+      d->enabled = 0;
+      break;
+  }
+}
+
+static unsigned int lcmxo2_capture_dr(void *priv, unsigned int ir, unsigned int *dr)
+{
+  struct lcmxo2 *d = priv;
+
+  switch (ir) {
+    case LCMXO2_IDCODE_PUB:
+      dr[0] = SIM_DEV_ID;
+      return 32;
+    case LCMXO2_USERCODE:
+      dr[0] = d->usercode;
+      return 32;
+    case LCMXO2_LSC_CHECK_BUSY:
+      dr[0] = lcmxo2_busy(d) ? 0x80 : 0;
+      return 8;
+    case LCMXO2_LSC_READ_STATUS:
+      dr[0] = (lcmxo2_busy(d) ? 1 << 12 : 0) | (d->failed ? 1 << 13 : 0);
+      return 32;
+    case LCMXO2_LSC_READ_INCR_NV:
+      if (d->section && d->addr < d->section_rows)
+        memcpy(dr, &d->section[d->addr++ * ROW_WORDS], ROW_WORDS * sizeof(unsigned int));
+      return ROW_WORDS * 32;
+    case LCMXO2_ISC_ENABLE_X:
+    case LCMXO2_ISC_ERASE:
+    case LCMXO2_LSC_INIT_ADDRESS:
+      return 8;
+    case LCMXO2_LSC_PROG_INCR_NV:
+      return ROW_WORDS * 32;
+  }
+  return 0;
+}
+
+static void lcmxo2_update_dr(void *priv, unsigned int ir, const unsigned int *dr, unsigned int len)
+{
+  struct lcmxo2 *d = priv;
+
+  if (len == 32)
+    d->last_dr32 = dr[0];
+
+  switch (ir) {
+    case LCMXO2_ISC_ENABLE_X:
+      d->enabled = 1;
+      break;
+    case LCMXO2_ISC_ERASE:
+      if (!d->enabled || lcmxo2_busy(d)) {
+        d->failed = 1;
+        break;
+      }
+      if (dr[0] & 0x4)
+        memset(d->cf, 0, sizeof(d->cf));
+      if (dr[0] & 0x8)
+        memset(d->ufm, 0, sizeof(d->ufm));
+      d->usercode = 0;
+      d->done = 0;
+      d->busy_until = now_us() + T_ERASE_US;
+      break;
+    case LCMXO2_LSC_INIT_ADDRESS:
+      lcmxo2_set_section(d, &d->cf[0][0], MAX_CF_ROWS);
+      break;
+    case LCMXO2_LSC_PROG_INCR_NV:
+      if (!d->enabled || lcmxo2_busy(d) || d->section == NULL ||
+          d->addr >= d->section_rows) {
+        d->failed = 1;
+        break;
+      }
+      memcpy(&d->section[d->addr++ * ROW_WORDS], dr, ROW_WORDS * sizeof(unsigned int));
+      d->busy_until = now_us() + T_PROG_US;
+      break;
+  }
+}
+
+static const struct ast_jtag_sim_dev sim = {
+  .ir_len = LATTICE_INS_LENGTH,
+  .priv = &dev,
+  .reset = lcmxo2_reset,
+  .update_ir = lcmxo2_update_ir,
+  .capture_dr = lcmxo2_capture_dr,
+  .update_dr = lcmxo2_update_dr,
+};
+
+static void write_rows(FILE *fp, unsigned int (*rows)[ROW_WORDS], int n)
+{
+  int i, b;
+
+  for (i = 0; i < n; i++) {
+    for (b = 0; b < ROW_WORDS * 32; b++)
+      fputc((rows[i][b / 32] >> (b % 32)) & 1 ? '1' : '0', fp);
+    fputc('\n', fp);
+  }
+}
+
+static int write_jed(const char *path, int cf_rows)
+{
+  unsigned int seed = 0x12345678;
+  unsigned int checksum = 0;
+  FILE *fp;
+  int i, j;
+
+  for (i = 0; i < cf_rows; i++) {
+    for (j = 0; j < ROW_WORDS; j++) {
+      seed = seed * 1103515245 + 12345;
+      jed_cf[i][j] = seed ^ (seed >> 16);
+      checksum += (jed_cf[i][j] & 0xff) + ((jed_cf[i][j] >> 8) & 0xff) +
+                  ((jed_cf[i][j] >> 16) & 0xff) + (jed_cf[i][j] >> 24);
+    }
+  }
+  for (i = 0; i < UFM_ROWS; i++) {
+    for (j = 0; j < ROW_WORDS; j++)
+      jed_ufm[i][j] = 0xa5a50000 | (i << 8) | j;
+  }
+
+  fp = fopen(path, "w");
+  if (fp == NULL)
+    return -1;
+  fprintf(fp, "\002NOTE lattice-sim-test generated image*\n");
+  fprintf(fp, "NOTE DEVICE NAME:\tLCMXO2-7000HC-4TQFP144*\n");
+  fprintf(fp, "QF%d*\n", cf_rows * ROW_WORDS * 32);
+  fprintf(fp, "G0*\nF0*\n");
+  fprintf(fp, "L000000\n");
+  write_rows(fp, jed_cf, cf_rows);
+  fprintf(fp, "*\n");
+  fprintf(fp, "NOTE TAG DATA*\n");
+  fprintf(fp, "L2955008\n");
+  write_rows(fp, jed_ufm, UFM_ROWS);
+  fprintf(fp, "*\n");
+  fprintf(fp, "NOTE User Electronic Signature Data*\n");
+  fprintf(fp, "UH%08X*\n", SIM_USERCODE);
+  fprintf(fp, "C%04X*\n", checksum & 0xffff);
+  fprintf(fp, "\0030000\n");
+  fclose(fp);
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  char path[] = "/tmp/lattice-sim-testXXXXXX";
+  struct ast_jtag_sim_stats st;
+  uint32_t ver = 0, id = 0;
+  int cf_rows = 1024;
+  unsigned long full_calls;
+  uint64_t start;
+  int fd, ret = 0;
+
+  if (argc > 1)
+    cf_rows = atoi(argv[1]);
+  if (cf_rows <= 0 || cf_rows > MAX_CF_ROWS) {
+    printf("cf_rows must be between 1 and %d\n", MAX_CF_ROWS);
+    return 1;
+  }
+
+  fd = mkstemp(path);
+  if (fd < 0 || write_jed(path, cf_rows)) {
+    printf("Cannot create the JED file\n");
+    return 1;
+  }
+  close(fd);
+
+  if (ast_jtag_sim_attach(&sim) ||
+      cpld_intf_open(LCMXO2_7000HC, INTF_JTAG, NULL)) {
+    printf("Cannot open the simulated CPLD\n");
+    unlink(path);
+    return 1;
+  }
+
+  if (cpld_get_device_id(&id) || id != SIM_DEV_ID) {
+    printf("Wrong device id %08x\n", id);
+    ret = 1;
+  }
+
+  ast_jtag_sim_clear_stats();
+  start = now_us();
+  if (cpld_program(path, NULL, 0)) {
+    printf("Program failed\n");
+    ret = 1;
+  }
+  ast_jtag_sim_get_stats(&st);
+  printf("Programmed %d CF rows in %.3f s: %lu driver calls, %lu operations, %llu TCK\n",
+         cf_rows, (now_us() - start) / 1e6, st.calls, st.ops, st.tck);
+
+  if (memcmp(dev.cf, jed_cf, cf_rows * sizeof(jed_cf[0]))) {
+    printf("CF contents do not match the JED file\n");
+    ret = 1;
+  }
+  if (memcmp(dev.ufm, jed_ufm, sizeof(jed_ufm))) {
+    printf("UFM contents do not match the JED file\n");
+    ret = 1;
+  }
+  if (dev.failed || !dev.done || dev.enabled) {
+    printf("Device state failed=%d done=%d enabled=%d\n",
+           dev.failed, dev.done, dev.enabled);
+    ret = 1;
+  }
+  if (cpld_get_ver(&ver) || ver != SIM_USERCODE) {
+    printf("Wrong USERCODE %08x\n", ver);
+    ret = 1;
+  }
+
+  /*
+   * A driver transaction that fails halfway through has to abort the
+   * update rather than carry on programming a device in unknown state.
+   */
+  full_calls = st.calls;
+  ast_jtag_sim_clear_stats();
+  ast_jtag_sim_fail_call(full_calls / 2);
+  if (!cpld_program(path, NULL, 0)) {
+    printf("Program succeeded despite a failed JTAG transaction\n");
+    ret = 1;
+  }
+  ast_jtag_sim_fail_call(0);
+  ast_jtag_sim_get_stats(&st);
+  printf("Failed transaction aborted the update after %lu of %lu driver calls\n",
+         st.calls, full_calls);
+  if (st.calls > full_calls / 2 + 2) {
+    printf("Update kept going after the failed transaction\n");
+    ret = 1;
+  }
+
+  cpld_intf_close(INTF_JTAG);
+  unlink(path);
+
+  printf("%s\n", ret ? "FAILED" : "PASSED");
+  return ret;
+}
@@ -7,6 +7,10 @@
 #include "lattice.h"
 
 #define MAX_RETRY 4000
+#define STATUS_POLL_US 100
+// status of a busy or status read that didn't reach the device
+#define STATUS_XFER_ERROR 0xFFFFFFFF
+#define VERIFY_BATCH 64
 #define LATTICE_COL_SIZE 128
 #define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
 
@@ -133,63 +137,60 @@ ShiftData(char *data, unsigned int *result, int len)
   return ret;
 }
 
+/*
+ * Read the busy flag or the status bits; the instruction scan and the data
+ * scan go to the driver as one batch, together with anything queued before.
+ * Returns STATUS_XFER_ERROR if the batch failed.
+ */
 static unsigned int
-LCMXO2Family_Check_Device_Status(int mode)
+LCMXO2Family_Read_Device_Status(int mode)
 {
-  int RETRY = MAX_RETRY;
   unsigned int buf[4] = {0};
 
-  switch (mode)
+  if (mode == CHECK_BUSY)
   {
-    case CHECK_BUSY:
-//      ast_jtag_run_test_idle(0, JTAG_STATE_TLRESET, 3);
-      do
-      {
-	ast_jtag_sir_xfer(JTAG_STATE_TLRESET, LATTICE_INS_LENGTH, LCMXO2_LSC_CHECK_BUSY);
-	usleep(1000);
-
-	buf[0] = 0x0;
-
-	ast_jtag_tdo_xfer(JTAG_STATE_TLRESET, 8, &buf[0]);
-
-	buf[0] = (buf[0] >> 7) & 0x1;
-
-	if (buf[0] == 0x0)
-	{
-	  break;
-	}
-	RETRY--;
-
-      } while ( RETRY );
-      break;
-
-    case CHECK_STATUS:
-//      ast_jtag_run_test_idle(0, JTAG_STATE_TLRESET, 3);
-      do
-      {
-	ast_jtag_sir_xfer(JTAG_STATE_TLRESET, LATTICE_INS_LENGTH, LCMXO2_LSC_READ_STATUS);
-	usleep(1000);
+    ast_jtag_queue_sir(JTAG_STATE_TLRESET, LATTICE_INS_LENGTH, LCMXO2_LSC_CHECK_BUSY);
+    ast_jtag_queue_tdo(JTAG_STATE_TLRESET, 8, &buf[0]);
+    if (ast_jtag_queue_flush() < 0)
+    {
+      return STATUS_XFER_ERROR;
+    }
 
-	buf[0] = 0x0;
+    return (buf[0] >> 7) & 0x1;
+  }
 
-	ast_jtag_tdo_xfer(JTAG_STATE_TLRESET, 32, &buf[0]);
+  ast_jtag_queue_sir(JTAG_STATE_TLRESET, LATTICE_INS_LENGTH, LCMXO2_LSC_READ_STATUS);
+  ast_jtag_queue_tdo(JTAG_STATE_TLRESET, 32, &buf[0]);
+  if (ast_jtag_queue_flush() < 0)
+  {
+    return STATUS_XFER_ERROR;
+  }
 
-	buf[0] = (buf[0] >> 12) & 0x3;
+  return (buf[0] >> 12) & 0x3;
+}
 
-	if (buf[0] == 0x0)
-	{
-	  break;
-	}
-	RETRY--;
-      } while ( RETRY );
-      break;
+/*
+ * Poll until the device is idle. Page programming takes a few hundred
+ * microseconds, so poll often instead of sleeping 1ms per check; the
+ * overall timeout stays at MAX_RETRY ms.
+ */
+static unsigned int
+LCMXO2Family_Check_Device_Status(int mode)
+{
+  int RETRY = MAX_RETRY * 1000 / STATUS_POLL_US;
+  unsigned int status;
 
-    default:
+  while (1)
+  {
+    status = LCMXO2Family_Read_Device_Status(mode);
+    if (status == 0x0 || status == STATUS_XFER_ERROR || --RETRY == 0)
+    {
       break;
-
+    }
+    usleep(STATUS_POLL_US);
   }
 
-  return buf[0];
+  return status;
 }
 
 /*write cf data*/
@@ -211,10 +212,10 @@ LCMXO2Family_SendCFdata(CPLDInfo *dev_info)
 //    ast_jtag_run_test_idle(0, JTAG_STATE_TLRESET, 3);
 
     //set page to program page
-    ast_jtag_sir_xfer(JTAG_STATE_PAUSEIR, LATTICE_INS_LENGTH, LCMXO2_LSC_PROG_INCR_NV);
+    ast_jtag_queue_sir(JTAG_STATE_PAUSEIR, LATTICE_INS_LENGTH, LCMXO2_LSC_PROG_INCR_NV);
 
-    //send data
-    ast_jtag_tdi_xfer(JTAG_STATE_TLRESET, LATTICE_COL_SIZE, &dev_info->CF[CurrentAddr]);
+    //send data, it goes out with the first busy check
+    ast_jtag_queue_tdi(JTAG_STATE_TLRESET, LATTICE_COL_SIZE, &dev_info->CF[CurrentAddr]);
 
     //usleep(1000);
 
@@ -249,10 +250,10 @@ LCMXO2Family_SendUFMdata(CPLDInfo *dev_info)
 //    ast_jtag_run_test_idle(0, JTAG_STATE_TLRESET, 3);
 
     //set page to program page
-    ast_jtag_sir_xfer(JTAG_STATE_PAUSEIR, LATTICE_INS_LENGTH, LCMXO2_LSC_PROG_INCR_NV);
+    ast_jtag_queue_sir(JTAG_STATE_PAUSEIR, LATTICE_INS_LENGTH, LCMXO2_LSC_PROG_INCR_NV);
 
-    //send data
-    ast_jtag_tdi_xfer(JTAG_STATE_TLRESET, LATTICE_COL_SIZE, &dev_info->UFM[CurrentAddr]);
+    //send data, it goes out with the first busy check
+    ast_jtag_queue_tdi(JTAG_STATE_TLRESET, LATTICE_COL_SIZE, &dev_info->UFM[CurrentAddr]);
 
     //usleep(1000);
 
@@ -576,17 +577,17 @@ LCMXO2Family_JED_File_Parser(FILE *jed_fd, CPLDInfo *dev_info, int cf_size, int
 static int
 LCMXO2Family_cpld_verify(CPLDInfo *dev_info)
 {
-  int i;
+  int i, j, rows;
   int result;
   int current_addr = 0;
-  unsigned int buff[4] = {0};
+  unsigned int buff[VERIFY_BATCH][LATTICE_COL_SIZE / 32];
   int ret = 0;
 
 //  ast_jtag_run_test_idle(0, JTAG_STATE_TLRESET, 3);
   ast_jtag_sir_xfer(JTAG_STATE_TLRESET, LATTICE_INS_LENGTH, LCMXO2_LSC_INIT_ADDRESS);
 
-  buff[0] = 0x04;
-  ast_jtag_tdi_xfer(JTAG_STATE_TLRESET, LATTICE_INS_LENGTH, &buff[0]);
+  buff[0][0] = 0x04;
+  ast_jtag_tdi_xfer(JTAG_STATE_TLRESET, LATTICE_INS_LENGTH, &buff[0][0]);
   usleep(1000);
 
 //  ast_jtag_run_test_idle(0, JTAG_STATE_TLRESET, 3);
@@ -597,29 +598,46 @@ LCMXO2Family_cpld_verify(CPLDInfo *dev_info)
   printf("[%s] dev_info->CF_Line: %u\n", __func__, dev_info->CF_Line);
 #endif
 
-  for(i = 0; i < dev_info->CF_Line; i++)
+  //read back VERIFY_BATCH pages per driver transaction
+  for(i = 0; i < dev_info->CF_Line && ret == 0; i += rows)
   {
-    printf("Verify Data: %d/%u (%.2f%%) \r",(i+1), dev_info->CF_Line, (((i+1)/(float)dev_info->CF_Line)*100));
-
-    current_addr = (i * LATTICE_COL_SIZE) / 32;
+    rows = dev_info->CF_Line - i;
+    if (rows > VERIFY_BATCH)
+    {
+      rows = VERIFY_BATCH;
+    }
 
     memset(buff, 0, sizeof(buff));
+    for (j = 0; j < rows; j++)
+    {
+      ast_jtag_queue_tdo(JTAG_STATE_TLRESET, LATTICE_COL_SIZE, buff[j]);
+    }
+    if (ast_jtag_queue_flush() < 0)
+    {
+      ret = -1;
+      break;
+    }
 
-    ast_jtag_tdo_xfer(JTAG_STATE_TLRESET, LATTICE_COL_SIZE, buff);
+    for (j = 0; j < rows; j++)
+    {
+      printf("Verify Data: %d/%u (%.2f%%) \r",(i+j+1), dev_info->CF_Line, (((i+j+1)/(float)dev_info->CF_Line)*100));
 
-    result = memcmp(buff, &dev_info->CF[current_addr], sizeof(unsigned int));
+      current_addr = ((i + j) * LATTICE_COL_SIZE) / 32;
 
-    if (result)
-    {
+      result = memcmp(buff[j], &dev_info->CF[current_addr], sizeof(unsigned int));
+
+      if (result)
+      {
 
 #ifdef CPLD_DEBUG
-      printf("\nPage#%d (%x %x %x %x) did not match with CF (%x %x %x %x)\n",
-	     i, buff[0], buff[1], buff[2], buff[3],
-	     dev_info->CF[current_addr], dev_info->CF[current_addr+1],
-	     dev_info->CF[current_addr+2], dev_info->CF[current_addr+3]);
+        printf("\nPage#%d (%x %x %x %x) did not match with CF (%x %x %x %x)\n",
+	       i + j, buff[j][0], buff[j][1], buff[j][2], buff[j][3],
+	       dev_info->CF[current_addr], dev_info->CF[current_addr+1],
+	       dev_info->CF[current_addr+2], dev_info->CF[current_addr+3]);
 #endif
-      ret = -1;
-      break;
+        ret = -1;
+        break;
+      }
     }
   }
 
@@ -0,0 +1,165 @@
+/*
+ * Copyright 2021-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * Benchmark for the FRU parser.
+ *
+ * Usage: fruid-bench [fru.bin] [iterations]
+ *
+ * Without a file a generated image with all areas filled is used.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "fruid.h"
+
+#define BENCH_ITERATIONS 20000
+#define BENCH_FILE       "/tmp/fruid-bench.bin"
+#define BENCH_IMAGE_MAX  4096
+
+static fruid_view_t view;
+
+static double now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void set_chksum(uint8_t * area, int len)
+{
+  uint8_t chksum = 0;
+  int i;
+
+  for (i = 0; i < len - 1; i++)
+    chksum += area[i];
+  area[len - 1] = ~chksum + 1;
+}
+
+static int add_area(uint8_t * area, int hdr_len, int num_fields)
+{
+  int i, idx = hdr_len, len;
+
+  area[0] = FRUID_FORMAT_VER;
+  for (i = 0; i < num_fields; i++) {
+    len = snprintf((char *) &area[idx + 1], 32, "FIELD-%02d-0123456789", i);
+    area[idx] = (TYPE_ASCII_8BIT << 6) | len;
+    idx += len + 1;
+  }
+  area[idx++] = 0xC1;
+  len = (idx + 1 + 7) & ~7;
+  area[1] = len / FRUID_AREA_LEN_MULTIPLIER;
+  set_chksum(area, len);
+  return len;
+}
+
+static int build_image(uint8_t * img)
+{
+  int off = 8;
+
+  img[0] = FRUID_FORMAT_VER;
+  img[2] = off / FRUID_OFFSET_MULTIPLIER;
+  img[off + 2] = 0x17;
+  off += add_area(img + off, 3, 2 + 4);
+  img[3] = off / FRUID_OFFSET_MULTIPLIER;
+  off += add_area(img + off, 6, 5 + 4);
+  img[4] = off / FRUID_OFFSET_MULTIPLIER;
+  off += add_area(img + off, 3, 7 + 4);
+  set_chksum(img, 8);
+  return off;
+}
+
+static void report(const char * name, double start, int iterations)
+{
+  printf("%-28s %10.0f ns/op\n", name, (now_ns() - start) / iterations);
+}
+
+int main(int argc, char * argv[])
+{
+  static uint8_t img[BENCH_IMAGE_MAX];
+  const char * bin = BENCH_FILE;
+  int iterations = BENCH_ITERATIONS;
+  const fruid_view_t * cached;
+  fruid_info_t fruid;
+  FILE * fp;
+  double start;
+  int i, len, ret;
+
+  if (argc > 1)
+    bin = argv[1];
+  if (argc > 2)
+    iterations = atoi(argv[2]);
+
+  if (argc > 1) {
+    fp = fopen(bin, "rb");
+    if (fp == NULL) {
+      perror(bin);
+      return 1;
+    }
+    len = fread(img, 1, sizeof(img), fp);
+    fclose(fp);
+  } else {
+    len = build_image(img);
+    fp = fopen(bin, "wb");
+    if (fp == NULL || fwrite(img, 1, len, fp) != len) {
+      perror(bin);
+      return 1;
+    }
+    fclose(fp);
+  }
+
+  ret = fruid_parse_view(img, len, &view);
+  if (ret) {
+    printf("%s does not parse: %d\n", bin, ret);
+    return 1;
+  }
+  printf("image %d bytes, %d iterations\n", len, iterations);
+
+  start = now_ns();
+  for (i = 0; i < iterations; i++) {
+    fruid_parse_eeprom(img, len, &fruid);
+    free_fruid_info(&fruid);
+  }
+  report("fruid_parse_eeprom", start, iterations);
+
+  start = now_ns();
+  for (i = 0; i < iterations; i++)
+    fruid_parse_view(img, len, &view);
+  report("fruid_parse_view", start, iterations);
+
+  start = now_ns();
+  for (i = 0; i < iterations; i++) {
+    fruid_parse(bin, &fruid);
+    free_fruid_info(&fruid);
+  }
+  report("fruid_parse (cached)", start, iterations);
+
+  start = now_ns();
+  for (i = 0; i < iterations; i++) {
+    cached = fruid_view_get(bin, NULL);
+    fruid_view_put(cached);
+  }
+  report("fruid_view_get (cached)", start, iterations);
+
+  if (argc < 2)
+    unlink(bin);
+  return 0;
+}
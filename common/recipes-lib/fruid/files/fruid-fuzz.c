@@ -0,0 +1,219 @@
+/*
+ * Copyright 2021-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * Fuzz target for the FRU parser. Build with -DFRUID_LIBFUZZER and
+ * -fsanitize=fuzzer,address to run it under libFuzzer; otherwise main()
+ * runs a fixed number of deterministic mutations of a few seed images,
+ * which is what the meson test does.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fruid.h"
+
+static int check_field(const fruid_view_t * view, const fruid_field_t * field)
+{
+  if (field->str == NULL)
+    return 0;
+  if (strlen(field->str) > field->len)
+    return -1;
+  /* Strings are either constants or inside the used part of the arena */
+  if (field->str >= view->arena &&
+      field->str < view->arena + sizeof(view->arena) &&
+      field->str + field->len >= view->arena + view->arena_used)
+    return -1;
+  return 0;
+}
+
+static int check_view(const fruid_view_t * view)
+{
+  const fruid_field_t * f;
+  int i, ret = 0;
+
+  if (view->arena_used > sizeof(view->arena))
+    return -1;
+
+  for (i = 0; i < FRUID_CUSTOM_FIELDS; i++) {
+    ret |= check_field(view, &view->chassis.custom[i]);
+    ret |= check_field(view, &view->board.custom[i]);
+    ret |= check_field(view, &view->product.custom[i]);
+  }
+  for (f = &view->chassis.part; f <= &view->chassis.serial; f++)
+    ret |= check_field(view, f);
+  for (f = &view->board.mfg_time_str; f <= &view->board.fruid; f++)
+    ret |= check_field(view, f);
+  for (f = &view->product.mfg; f <= &view->product.fruid; f++)
+    ret |= check_field(view, f);
+  ret |= check_field(view, &view->multirecord_smart_fan.mfg_time_str);
+  ret |= check_field(view, &view->multirecord_smart_fan.clei_code);
+  return ret;
+}
+
+static fruid_view_t view;
+
+int LLVMFuzzerTestOneInput(const uint8_t * data, size_t size)
+{
+  fruid_info_t fruid;
+  int ret, ret_compat;
+
+  ret = fruid_parse_view(data, size, &view);
+  if (ret == 0 && check_view(&view))
+    abort();
+
+  ret_compat = fruid_parse_eeprom(data, size, &fruid);
+  if (ret != ret_compat)
+    abort();
+  if (ret_compat == 0)
+    free_fruid_info(&fruid);
+  return 0;
+}
+
+#ifndef FRUID_LIBFUZZER
+
+#define FUZZ_ITERATIONS 200000
+#define FUZZ_IMAGE_SIZE 512
+
+static uint32_t fuzz_seed = 0x12345678;
+
+static uint32_t fuzz_rand(void)
+{
+  /* xorshift32, so every run sees the same inputs */
+  fuzz_seed ^= fuzz_seed << 13;
+  fuzz_seed ^= fuzz_seed >> 17;
+  fuzz_seed ^= fuzz_seed << 5;
+  return fuzz_seed;
+}
+
+static void set_chksum(uint8_t * area, int len)
+{
+  uint8_t chksum = 0;
+  int i;
+
+  for (i = 0; i < len - 1; i++)
+    chksum += area[i];
+  area[len - 1] = ~chksum + 1;
+}
+
+static int add_area(uint8_t * area, int hdr_len, int num_fields)
+{
+  int i, j, len, idx = hdr_len;
+
+  area[0] = FRUID_FORMAT_VER;
+  for (i = 0; i < num_fields; i++) {
+    len = fuzz_rand() % 24;
+    area[idx++] = ((fuzz_rand() % 4) << 6) | len;
+    for (j = 0; j < len; j++)
+      area[idx++] = 'A' + fuzz_rand() % 26;
+  }
+  area[idx++] = 0xC1;
+  len = (idx + 1 + 7) & ~7;
+  area[1] = len / FRUID_AREA_LEN_MULTIPLIER;
+  set_chksum(area, len);
+  return len;
+}
+
+/* Build a valid image with chassis, board, product and smart fan areas */
+static int build_seed(uint8_t * img)
+{
+  uint8_t * rec;
+  int off = 8, i;
+
+  memset(img, 0, FUZZ_IMAGE_SIZE);
+  img[0] = FRUID_FORMAT_VER;
+
+  img[2] = off / FRUID_OFFSET_MULTIPLIER;
+  img[off + 2] = 1 + fuzz_rand() % 32;
+  off += add_area(img + off, 3, 2 + fuzz_rand() % 4);
+
+  img[3] = off / FRUID_OFFSET_MULTIPLIER;
+  off += add_area(img + off, 6, 5 + fuzz_rand() % 4);
+
+  img[4] = off / FRUID_OFFSET_MULTIPLIER;
+  off += add_area(img + off, 3, 7 + fuzz_rand() % 4);
+
+  img[5] = off / FRUID_OFFSET_MULTIPLIER;
+  rec = img + off;
+  rec[0] = SMART_FAN_RECORD_ID;
+  rec[1] = MULTIRECORD_LAST_RECORED_BIT | MULTIRECORD_FORMAT_VER;
+  rec[2] = 42;
+  for (i = 0; i < rec[2]; i++)
+    rec[5 + i] = fuzz_rand();
+  set_chksum(rec + 5, rec[2] + 1);
+  rec[3] = rec[5 + rec[2]];
+  set_chksum(rec, 5);
+  off += 5 + rec[2];
+
+  set_chksum(img, 8);
+  return off;
+}
+
+int main(int argc, char * argv[])
+{
+  uint8_t seed[FUZZ_IMAGE_SIZE], img[FUZZ_IMAGE_SIZE];
+  int iterations = FUZZ_ITERATIONS;
+  uint8_t * buf;
+  int i, n, len, seed_len = 0;
+
+  if (argc > 1)
+    iterations = atoi(argv[1]);
+
+  for (i = 0; i < iterations; i++) {
+    if (i % 1000 == 0) {
+      seed_len = build_seed(seed);
+      /* The unmodified seed has to parse */
+      if (fruid_parse_view(seed, seed_len, &view) != 0) {
+        printf("seed image %d does not parse\n", i / 1000);
+        return 1;
+      }
+    }
+    memcpy(img, seed, sizeof(img));
+    len = seed_len;
+
+    for (n = fuzz_rand() % 4; n >= 0; n--) {
+      switch (fuzz_rand() % 4) {
+      case 0:
+        img[fuzz_rand() % len] ^= 1 << (fuzz_rand() % 8);
+        break;
+      case 1:
+        img[fuzz_rand() % len] = fuzz_rand();
+        break;
+      case 2:
+        len = fuzz_rand() % seed_len + 1;
+        break;
+      default:
+        /* Keep the header valid so the mutation reaches the areas */
+        img[8 + fuzz_rand() % (len > 8 ? len - 8 : 1)] = fuzz_rand();
+        set_chksum(img, 8);
+        break;
+      }
+    }
+
+    /* Copy to an exact size buffer so ASan catches over-reads */
+    buf = malloc(len);
+    if (buf == NULL)
+      return 1;
+    memcpy(buf, img, len);
+    LLVMFuzzerTestOneInput(buf, len);
+    free(buf);
+  }
+
+  printf("%d inputs parsed\n", iterations);
+  return 0;
+}
+#endif
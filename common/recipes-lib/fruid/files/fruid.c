@@ -22,6 +22,11 @@
 #include <string.h>
 #include <syslog.h>
 #include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <sys/stat.h>
 #include "fruid.h"
 #include <stdbool.h>
 
@@ -45,44 +50,6 @@ const char * ascii_6bit[4] = {
   "PQRSTUVWXYZ[\\]^_"
 };
 
-/*
- * calculate_time - calculate time from the unix time stamp stored
- *
- * @mfg_time    : Unix timestamp since 1996
- *
- * returns char * for mfg_time_str
- * returns NULL for memory allocation failure
- */
-static char * calculate_time(uint8_t * mfg_time)
-{
-  int len;
-  struct tm * local;
-  time_t unix_time = 0;
-  unix_time = ((mfg_time[2] << 16) + (mfg_time[1] << 8) + mfg_time[0]) * 60;
-  unix_time += UNIX_TIMESTAMP_1996;
-
-  local = localtime(&unix_time);
-  char * str = asctime(local);
-
-  len = strlen(str);
-
-  char * mfg_time_str = (char *) malloc(len);
-  if (!mfg_time_str) {
-#ifdef DEBUG
-    syslog(LOG_WARNING, "fruid: malloc: memory allocation failed\n");
-#endif
-    return NULL;
-  }
-
-  memset(mfg_time_str, 0, len);
-
-  memcpy(mfg_time_str, str, len);
-
-  mfg_time_str[len - 1] = '\0';
-
-  return mfg_time_str;
-}
-
 /*
  * verify_chksum - verify the zero checksum of the data
  *
@@ -93,7 +60,7 @@ static char * calculate_time(uint8_t * mfg_time)
  * returns 0 if chksum is verified
  * returns -1 if there exist a mismatch
  */
-static int verify_chksum(uint8_t * area, uint8_t len, uint8_t chksum_read)
+static int verify_chksum(uint8_t * area, int len, uint8_t chksum_read)
 {
   int i;
   uint8_t chksum = 0;
@@ -108,68 +75,104 @@ static int verify_chksum(uint8_t * area, uint8_t len, uint8_t chksum_read)
 }
 
 /*
- * get_chassis_type - get the Chassis type
+ * view_alloc - carve len bytes out of the arena of a view
  *
- * @type_hex  : type stored in the data
- *
- * returns char ptr for chassis type string
- * returns NULL if type not in the list
+ * returns NULL if the arena is exhausted
  */
-static char * get_chassis_type(uint8_t type_hex)
+static char * view_alloc(fruid_view_t * view, int len)
 {
-  int type;
-  char type_int[4];
-
-  sprintf(type_int, "%u", type_hex);
-  type = atoi(type_int) - 1;
+  char * p;
 
-  /* If the type is not in the list defined.*/
-  if (type > FRUID_CHASSIS_TYPECODE_MAX || type < FRUID_CHASSIS_TYPECODE_MIN) {
+  if (len > (int)sizeof(view->arena) - view->arena_used) {
 #ifdef DEBUG
-    syslog(LOG_INFO, "fruid: chassis area: invalid chassis type\n");
+    syslog(LOG_WARNING, "fruid: view arena exhausted\n");
 #endif
     return NULL;
   }
+  p = &view->arena[view->arena_used];
+  view->arena_used += len;
+  return p;
+}
 
-  char * type_str = (char *) malloc(strlen(fruid_chassis_type[type])+1);
-  if (!type_str) {
-#ifdef DEBUG
-    syslog(LOG_WARNING, "fruid: malloc: memory allocation failed\n");
-#endif
-    return NULL;
-  }
+/*
+ * view_set_time - decode the minutes since 1996 stored in mfg_time
+ *
+ * @mfg_time    : 3 byte timestamp
+ * @field       : field to hold the asctime() formatted string
+ */
+static int view_set_time(fruid_view_t * view, const uint8_t * mfg_time,
+      fruid_field_t * field)
+{
+  struct tm local;
+  time_t unix_time;
+  char buf[64];
+  char * str;
+  int len;
+
+  unix_time = ((mfg_time[2] << 16) + (mfg_time[1] << 8) + mfg_time[0]) * 60;
+  unix_time += UNIX_TIMESTAMP_1996;
+
+  if (localtime_r(&unix_time, &local) == NULL || asctime_r(&local, buf) == NULL)
+    return EINVAL;
 
-  memcpy(type_str, fruid_chassis_type[type], strlen(fruid_chassis_type[type]));
-  type_str[strlen(fruid_chassis_type[type])] = '\0';
+  /* Drop the trailing newline of asctime() */
+  len = strlen(buf);
+  if (len > 0 && buf[len - 1] == '\n')
+    len--;
+
+  str = view_alloc(view, len + 1);
+  if (str == NULL)
+    return ENOMEM;
+  memcpy(str, buf, len);
+  str[len] = '\0';
 
-  return type_str;
+  field->str = str;
+  field->len = len;
+  return 0;
 }
 
 /*
- * _fruid_area_field_read - read the field data
+ * view_field_read - decode one type/length field into the arena
  *
- * @offset    : offset of the field
+ * @field     : type/length byte of the field
+ * @end       : end of the eeprom image
+ * @out       : decoded field
  *
- * returns char ptr for the field data string
+ * returns 0 on success
+ * returns ENODATA if the field runs past the end of the image
+ * returns ENOMEM if the arena is exhausted
  */
-static char * _fruid_area_field_read(uint8_t *offset)
+static int view_field_read(fruid_view_t * view, const uint8_t * field,
+      const uint8_t * end, fruid_field_t * out)
 {
-  int field_type, field_len, field_len_eff, alloc_len;
+  int field_type, field_len, field_len_eff = 0;
   int idx, idx_eff, val;
-  char * field;
+  char * str;
+
+  if (field >= end)
+    return ENODATA;
 
   /* Bits 7:6 */
-  field_type = FIELD_TYPE(offset[0]);
+  field_type = FIELD_TYPE(field[0]);
   /* Bits 5:0 */
-  field_len = FIELD_LEN(offset[0]);
+  field_len = FIELD_LEN(field[0]);
+
+  if (field + 1 + field_len > end)
+    return ENODATA;
+
+  out->type_len = field[0];
 
   /* Calculate the effective length of the field data based on type stored. */
   switch (field_type) {
-
   case TYPE_BINARY:
     /* TODO: Need to add support to read data stored in binary type. */
-    field_len_eff = 1;
-    break;
+    str = view_alloc(view, 1);
+    if (str == NULL)
+      return ENOMEM;
+    str[0] = '\0';
+    out->str = str;
+    out->len = 0;
+    return 0;
 
   case TYPE_ASCII_6BIT:
     /*
@@ -182,707 +185,383 @@ static char * _fruid_area_field_read(uint8_t *offset)
   case TYPE_BCD_PLUS:
     field_len_eff = ((field_len * 2) + 1);
     break;
+
   case TYPE_ASCII_8BIT:
     field_len_eff = field_len;
     break;
   }
 
   /* If field data is zero, store 'N/A' for that field. */
-  alloc_len = ((field_len_eff > 0) ? field_len_eff : strlen(FIELD_EMPTY)) + 1;
-  field = (char *) malloc(alloc_len);
-  if (!field) {
-#ifdef DEBUG
-    syslog(LOG_WARNING, "fruid: malloc: memory allocation failed\n");
-#endif
-    return NULL;
-  }
-
-  memset(field, 0, alloc_len);
-
   if (field_len_eff < 1) {
-    strcpy(field, FIELD_EMPTY);
-    return field;
+    out->str = FIELD_EMPTY;
+    out->len = strlen(FIELD_EMPTY);
+    return 0;
   }
 
+  str = view_alloc(view, field_len_eff + 1);
+  if (str == NULL)
+    return ENOMEM;
+
   /* Retrieve field data depending on the type it was stored. */
   switch (field_type) {
-  case TYPE_BINARY:
-   /* TODO: Need to add support to read data stored in binary type. */
-    break;
-
   case TYPE_BCD_PLUS:
-
     for (idx = 0; idx < field_len; idx++) {
-      field[idx * 2] = bcd_plus_array[(offset[idx + 1] >> 4) & 0x0F];
-      field[idx * 2 + 1] = bcd_plus_array[(offset[idx + 1]) & 0x0F];
+      str[idx * 2] = bcd_plus_array[(field[idx + 1] >> 4) & 0x0F];
+      str[idx * 2 + 1] = bcd_plus_array[(field[idx + 1]) & 0x0F];
     }
-    field[idx * 2] = '\0';
+    str[idx * 2] = '\0';
+    out->len = idx * 2;
     break;
 
   case TYPE_ASCII_6BIT:
-
     idx_eff = 0, idx = 1;
 
     while (field_len > 0) {
 
       /* 6-Bits => Bits 5:0 of the first byte */
-      val = offset[idx] & 0x3F;
-      field[idx_eff++] = ascii_6bit[(val & 0xF0) >> 4][val & 0x0F];
+      val = field[idx] & 0x3F;
+      str[idx_eff++] = ascii_6bit[(val & 0xF0) >> 4][val & 0x0F];
       field_len--;
 
       if (field_len > 0) {
         /* 6-Bits => Bits 3:0 of second byte + Bits 7:6 of first byte. */
-        val = ((offset[idx] & 0xC0) >> 6) |
-              ((offset[idx + 1] & 0x0F) << 2);
-        field[idx_eff++] = ascii_6bit[(val & 0xF0) >> 4][val & 0x0F];
+        val = ((field[idx] & 0xC0) >> 6) |
+              ((field[idx + 1] & 0x0F) << 2);
+        str[idx_eff++] = ascii_6bit[(val & 0xF0) >> 4][val & 0x0F];
         field_len--;
       }
 
       if (field_len > 0) {
         /* 6-Bits => Bits 1:0 of third byte + Bits 7:4 of second byte. */
-        val = ((offset[idx + 1] & 0xF0) >> 4) |
-              ((offset[idx + 2] & 0x03) << 4);
-        field[idx_eff++] = ascii_6bit[(val & 0xF0) >> 4][val & 0x0F];
+        val = ((field[idx + 1] & 0xF0) >> 4) |
+              ((field[idx + 2] & 0x03) << 4);
+        str[idx_eff++] = ascii_6bit[(val & 0xF0) >> 4][val & 0x0F];
 
         /* 6-Bits => Bits 7:2 of third byte. */
-        val = ((offset[idx + 2] & 0xFC) >> 2);
-        field[idx_eff++] = ascii_6bit[(val & 0xF0) >> 4][val & 0x0F];
+        val = ((field[idx + 2] & 0xFC) >> 2);
+        str[idx_eff++] = ascii_6bit[(val & 0xF0) >> 4][val & 0x0F];
 
         field_len--;
         idx += 3;
       }
     }
     /* Add Null terminator */
-    field[idx_eff] = '\0';
+    str[idx_eff] = '\0';
+    out->len = idx_eff;
     break;
 
   case TYPE_ASCII_8BIT:
-
-    memcpy(field, offset + 1, field_len);
+    memcpy(str, field + 1, field_len);
     /* Add Null terminator */
-    field[field_len] = '\0';
+    str[field_len] = '\0';
+    out->len = field_len;
     break;
   }
 
-  return field;
+  out->str = str;
+  return 0;
 }
 
-/* Free all the memory allocated for fruid information */
-void free_fruid_info(fruid_info_t * fruid)
+/*
+ * view_fields_read - decode the fixed fields of an area followed by
+ *                    up to FRUID_CUSTOM_FIELDS custom fields
+ *
+ * returns 0 on success or the error of the failing field
+ */
+static int view_fields_read(fruid_view_t * view, const uint8_t * area,
+      int index, const uint8_t * end, fruid_field_t ** fields, int num_fields,
+      fruid_field_t * custom)
 {
-  if (fruid->chassis.flag) {
-    free(fruid->chassis.type_str);
-    free(fruid->chassis.part);
-    free(fruid->chassis.serial);
-    free(fruid->chassis.custom1);
-    free(fruid->chassis.custom2);
-    free(fruid->chassis.custom3);
-    free(fruid->chassis.custom4);
-    free(fruid->chassis.custom5);
-    free(fruid->chassis.custom6);
-  }
-
-  if (fruid->board.flag) {
-    free(fruid->board.mfg_time_str);
-    free(fruid->board.mfg_time);
-    free(fruid->board.mfg);
-    free(fruid->board.name);
-    free(fruid->board.serial);
-    free(fruid->board.part);
-    free(fruid->board.fruid);
-    free(fruid->board.custom1);
-    free(fruid->board.custom2);
-    free(fruid->board.custom3);
-    free(fruid->board.custom4);
-    free(fruid->board.custom5);
-    free(fruid->board.custom6);
-  }
+  int ret, i;
 
-  if (fruid->product.flag) {
-    free(fruid->product.mfg);
-    free(fruid->product.name);
-    free(fruid->product.part);
-    free(fruid->product.version);
-    free(fruid->product.serial);
-    free(fruid->product.asset_tag);
-    free(fruid->product.fruid);
-    free(fruid->product.custom1);
-    free(fruid->product.custom2);
-    free(fruid->product.custom3);
-    free(fruid->product.custom4);
-    free(fruid->product.custom5);
-    free(fruid->product.custom6);
+  for (i = 0; i < num_fields; i++) {
+    ret = view_field_read(view, &area[index], end, fields[i]);
+    if (ret)
+      return ret;
+    index += FIELD_LEN(area[index]) + 1;
+  }
+
+  for (i = 0; i < FRUID_CUSTOM_FIELDS; i++) {
+    /* Tolerate images that end without the end-of-fields marker */
+    if (&area[index] >= end)
+      return 0;
+    /* Check if this field was last and there is no more custom data */
+    custom[i].type_len = area[index];
+    if (area[index] == NO_MORE_DATA_BYTE)
+      return 0;
+    ret = view_field_read(view, &area[index], end, &custom[i]);
+    if (ret)
+      return ret;
+    index += FIELD_LEN(area[index]) + 1;
   }
 
-  if (fruid->multirecord_smart_fan.flag) {
-    free(fruid->multirecord_smart_fan.smart_fan_ver);
-    free(fruid->multirecord_smart_fan.fw_ver);
-    free(fruid->multirecord_smart_fan.mfg_time);
-    free(fruid->multirecord_smart_fan.mfg_time_str);
-    free(fruid->multirecord_smart_fan.mfg_line);
-    free(fruid->multirecord_smart_fan.clei_code);
-  }
+  return 0;
 }
 
+/*
+ * view_area_check - validate the version, length and checksum of an
+ *                   info area
+ *
+ * returns 0 and the area length in bytes if the area is good
+ */
+static int view_area_check(const uint8_t * area, const uint8_t * end,
+      uint16_t * area_len, uint8_t * chksum)
+{
+  if (area + 3 > end)
+    return ENODATA;
 
-static uint32_t get_dword(uint8_t * buf, uint8_t len) {
-  uint32_t dword_value = 0;
-  int i = 0;
-
-  if (buf == NULL) {
+  /* Check if the format version (bits 3:0) is as per IPMI FRUID v1.0 spec */
+  if ((area[0] & 0x0F) != FRUID_FORMAT_VER) {
 #ifdef DEBUG
-    syslog(LOG_ERR, "fruid: get_dword failed, read buffer is null");
+    syslog(LOG_ERR, "fruid: area format version not supported");
 #endif
-    return 0;
+    return EPROTONOSUPPORT;
   }
 
-  if (len > 4) {
+  *area_len = area[1] * FRUID_AREA_LEN_MULTIPLIER;
+  if (*area_len == 0 || area + *area_len > end)
+    return ENODATA;
+
+  *chksum = area[*area_len - 1];
+  if (verify_chksum((uint8_t *) area, *area_len, *chksum)) {
 #ifdef DEBUG
-    syslog(LOG_ERR, "fruid: multi_record_area: get_dword failed, invalid length %u", len);
+    syslog(LOG_ERR, "fruid: area chksum not verified.");
 #endif
-    return 0;
-  }
-
-  for (i = 0; i < len; i++) {
-    dword_value |= (buf[i] << (8 * i));
+    return EBADF;
   }
 
-  return dword_value;
+  return 0;
 }
 
-static char * get_bcd_plus_string(uint8_t * buf, uint8_t len) {
-  char * bcd_plus_str = NULL;
-  int i = 0;
-  int shift = 0;
+/* Parse the Chassis area data */
+static int view_parse_chassis(fruid_view_t * view, const uint8_t * chassis,
+      const uint8_t * end)
+{
+  fruid_field_t * fields[] = {
+    &view->chassis.part,
+    &view->chassis.serial,
+  };
+  int ret, type;
+
+  ret = view_area_check(chassis, end, &view->chassis.area_len,
+          &view->chassis.chksum);
+  if (ret)
+    return ret;
 
-  if (buf == NULL) {
+  view->chassis.format_ver = chassis[0] & 0x0F;
+  view->chassis.type = chassis[2];
+
+  /* If the type is not in the list defined.*/
+  type = view->chassis.type - 1;
+  if (type > FRUID_CHASSIS_TYPECODE_MAX || type < FRUID_CHASSIS_TYPECODE_MIN) {
 #ifdef DEBUG
-    syslog(LOG_ERR, "fruid: multi_record_area: get_bcd_plus_string failed, read buffer is null");
+    syslog(LOG_INFO, "fruid: chassis area: invalid chassis type\n");
 #endif
-    return NULL;
+    return ENOMSG;
   }
+  view->chassis.type_str = fruid_chassis_type[type];
 
-  bcd_plus_str = (char *) malloc((len * 2) + 1);
-  if (bcd_plus_str == NULL) {
-#ifdef DEBUG
-    syslog(LOG_WARNING, "fruid: get_bcd_plus_string: malloc: memory allocation failed\n");
-#endif
-    return NULL;
+  return view_fields_read(view, chassis, 3, end, fields,
+          sizeof(fields) / sizeof(fields[0]), view->chassis.custom);
+}
+
+/* Parse the Board area data */
+static int view_parse_board(fruid_view_t * view, const uint8_t * board,
+      const uint8_t * end)
+{
+  fruid_field_t * fields[] = {
+    &view->board.mfg,
+    &view->board.name,
+    &view->board.serial,
+    &view->board.part,
+    &view->board.fruid,
+  };
+  int ret;
+
+  ret = view_area_check(board, end, &view->board.area_len,
+          &view->board.chksum);
+  if (ret)
+    return ret;
+  if (board + 3 + MFG_DATE_TIME_LENGTH > end)
+    return ENODATA;
+
+  view->board.format_ver = board[0] & 0x0F;
+  view->board.lang_code = board[2];
+  memcpy(view->board.mfg_time, &board[3], MFG_DATE_TIME_LENGTH);
+
+  ret = view_set_time(view, view->board.mfg_time, &view->board.mfg_time_str);
+  if (ret)
+    return ret;
+
+  return view_fields_read(view, board, 3 + MFG_DATE_TIME_LENGTH, end, fields,
+          sizeof(fields) / sizeof(fields[0]), view->board.custom);
+}
+
+/* Parse the Product area data */
+static int view_parse_product(fruid_view_t * view, const uint8_t * product,
+      const uint8_t * end)
+{
+  fruid_field_t * fields[] = {
+    &view->product.mfg,
+    &view->product.name,
+    &view->product.part,
+    &view->product.version,
+    &view->product.serial,
+    &view->product.asset_tag,
+    &view->product.fruid,
+  };
+  int ret;
+
+  ret = view_area_check(product, end, &view->product.area_len,
+          &view->product.chksum);
+  if (ret)
+    return ret;
+
+  view->product.format_ver = product[0] & 0x0F;
+  view->product.lang_code = product[2];
+
+  return view_fields_read(view, product, 3, end, fields,
+          sizeof(fields) / sizeof(fields[0]), view->product.custom);
+}
+
+static uint32_t get_dword(const uint8_t * buf, uint8_t len) {
+  uint32_t dword_value = 0;
+  int i = 0;
+
+  for (i = 0; i < len && i < 4; i++) {
+    dword_value |= (buf[i] << (8 * i));
   }
-  memset(bcd_plus_str, 0, (len * 2) + 1); // null terminated
 
-  for (i = 0; i < len * 2; i++) {
-    if ((i % 2) == 0) {
-      shift = 4;
-    } else {
-      shift = 0;
-    }
-    bcd_plus_str[i] = bcd_plus_array[((buf[i / 2] >> shift) & 0x0F)];
+  return dword_value;
+}
+
+/* Copy len raw bytes (BCD plus decoded if bcd is set) into the arena */
+static int view_copy_bytes(fruid_view_t * view, const uint8_t * buf, int len,
+      bool bcd, fruid_field_t * out)
+{
+  int i, str_len = bcd ? len * 2 : len;
+  char * str;
+
+  str = view_alloc(view, str_len + 1);
+  if (str == NULL)
+    return ENOMEM;
+
+  for (i = 0; i < str_len; i++) {
+    if (bcd)
+      str[i] = bcd_plus_array[(buf[i / 2] >> ((i % 2) ? 0 : 4)) & 0x0F];
+    else
+      str[i] = buf[i];
   }
+  str[str_len] = '\0';
 
-  return bcd_plus_str;
+  out->str = str;
+  out->len = str_len;
+  return 0;
 }
 
-int parse_fruid_area_multirecord_smart_fan(uint8_t * multirecord,
-      fruid_area_multirecord_smart_fan_t * fruid_multirecord_smart_fan)
+#define SMART_FAN_RECORD_LEN (MANUFACTURER_ID_DATA_LENGTH + \
+  SMART_FAN_VERSION_LENGTH + SMART_FAN_FW_VERSION_LENGTH + \
+  MFG_DATE_TIME_LENGTH + SMART_FAN_MFG_LINE_LENGTH + \
+  SMART_FAN_CLEI_CODE_LENGTH + SMART_FAN_VOL_DATA_LENGTH + \
+  SMART_FAN_CUR_DATA_LENGTH + 2 * SMART_FAN_RPM_DATA_LENGTH)
+
+static int view_parse_smart_fan(fruid_view_t * view, const uint8_t * multirecord,
+      const uint8_t * end)
 {
   int index = 0;
-  int i = 0;
+  int ret;
 
-  /* Reset the struct to zero */
-  memset(fruid_multirecord_smart_fan, 0, sizeof(fruid_area_multirecord_smart_fan_t));
+  if (multirecord + SMART_FAN_RECORD_LEN > end)
+    return ENODATA;
 
-  fruid_multirecord_smart_fan->manufacturer_id = get_dword(multirecord + index, MANUFACTURER_ID_DATA_LENGTH);
+  view->multirecord_smart_fan.manufacturer_id = get_dword(multirecord + index, MANUFACTURER_ID_DATA_LENGTH);
   index += MANUFACTURER_ID_DATA_LENGTH;
 
-  fruid_multirecord_smart_fan->smart_fan_ver = get_bcd_plus_string(multirecord + index, SMART_FAN_VERSION_LENGTH);
+  ret = view_copy_bytes(view, multirecord + index, SMART_FAN_VERSION_LENGTH, true,
+          &view->multirecord_smart_fan.smart_fan_ver);
+  if (ret)
+    return ret;
   index += SMART_FAN_VERSION_LENGTH;
 
-  fruid_multirecord_smart_fan->fw_ver = get_bcd_plus_string(multirecord + index, SMART_FAN_FW_VERSION_LENGTH);
+  ret = view_copy_bytes(view, multirecord + index, SMART_FAN_FW_VERSION_LENGTH, true,
+          &view->multirecord_smart_fan.fw_ver);
+  if (ret)
+    return ret;
   index += SMART_FAN_FW_VERSION_LENGTH;
 
-  fruid_multirecord_smart_fan->mfg_time = (uint8_t *) malloc(MFG_DATE_TIME_LENGTH);
-
-  if (fruid_multirecord_smart_fan->mfg_time == NULL) {
-#ifdef DEBUG
-    syslog(LOG_ERR, "fruid: multi_record_area: mfg_time: out of memory");
-#endif
-    return ENOMEM;
-  }
-
-  for (i = 0; i < MFG_DATE_TIME_LENGTH; i++) {
-    fruid_multirecord_smart_fan->mfg_time[i] = multirecord[index++];
-  }
-
-  fruid_multirecord_smart_fan->mfg_time_str = calculate_time(fruid_multirecord_smart_fan->mfg_time);
-  if (fruid_multirecord_smart_fan->mfg_time_str == NULL) {
-#ifdef DEBUG
-    syslog(LOG_ERR, "fruid: multi_record_area: mfg_time_str: out of memory");
-#endif
-    return ENOMEM;
-  }
+  memcpy(view->multirecord_smart_fan.mfg_time, multirecord + index, MFG_DATE_TIME_LENGTH);
+  index += MFG_DATE_TIME_LENGTH;
+  ret = view_set_time(view, view->multirecord_smart_fan.mfg_time,
+          &view->multirecord_smart_fan.mfg_time_str);
+  if (ret)
+    return ret;
 
-  fruid_multirecord_smart_fan->mfg_line = (char *) calloc(SMART_FAN_MFG_LINE_LENGTH + 1, sizeof(char));
-  if (fruid_multirecord_smart_fan->mfg_line == NULL) {
-#ifdef DEBUG
-    syslog(LOG_ERR, "fruid: multi_record_area: mfg_line: out of memory");
-#endif
-    return ENOMEM;
-  }
-  for (i = 0; i < SMART_FAN_MFG_LINE_LENGTH; i++) {
-    fruid_multirecord_smart_fan->mfg_line[i] = multirecord[index++];
-  }
+  ret = view_copy_bytes(view, multirecord + index, SMART_FAN_MFG_LINE_LENGTH, false,
+          &view->multirecord_smart_fan.mfg_line);
+  if (ret)
+    return ret;
+  index += SMART_FAN_MFG_LINE_LENGTH;
 
-  fruid_multirecord_smart_fan->clei_code = (char *) calloc(SMART_FAN_CLEI_CODE_LENGTH + 1, sizeof(char));
-  if (fruid_multirecord_smart_fan->clei_code == NULL) {
-#ifdef DEBUG
-    syslog(LOG_ERR, "fruid: multi_record_area: clei_code: out of memory");
-#endif
-    return ENOMEM;
-  }
-  for (i = 0; i < SMART_FAN_CLEI_CODE_LENGTH; i++) {
-    fruid_multirecord_smart_fan->clei_code[i] = multirecord[index++];
-  }
+  ret = view_copy_bytes(view, multirecord + index, SMART_FAN_CLEI_CODE_LENGTH, false,
+          &view->multirecord_smart_fan.clei_code);
+  if (ret)
+    return ret;
+  index += SMART_FAN_CLEI_CODE_LENGTH;
 
-  fruid_multirecord_smart_fan->voltage = (get_dword(multirecord + index, SMART_FAN_VOL_DATA_LENGTH) * SMART_FAN_VOL_CUR_MULTIPLIER);
+  view->multirecord_smart_fan.voltage = (get_dword(multirecord + index, SMART_FAN_VOL_DATA_LENGTH) * SMART_FAN_VOL_CUR_MULTIPLIER);
   index += SMART_FAN_VOL_DATA_LENGTH;
 
-  fruid_multirecord_smart_fan->current = (get_dword(multirecord + index, SMART_FAN_CUR_DATA_LENGTH) * SMART_FAN_VOL_CUR_MULTIPLIER);
+  view->multirecord_smart_fan.current = (get_dword(multirecord + index, SMART_FAN_CUR_DATA_LENGTH) * SMART_FAN_VOL_CUR_MULTIPLIER);
   index += SMART_FAN_CUR_DATA_LENGTH;
 
-  fruid_multirecord_smart_fan->rpm_front = get_dword(multirecord + index, SMART_FAN_RPM_DATA_LENGTH);
+  view->multirecord_smart_fan.rpm_front = get_dword(multirecord + index, SMART_FAN_RPM_DATA_LENGTH);
   index += SMART_FAN_RPM_DATA_LENGTH;
 
-  fruid_multirecord_smart_fan->rpm_rear = get_dword(multirecord + index, SMART_FAN_RPM_DATA_LENGTH);
+  view->multirecord_smart_fan.rpm_rear = get_dword(multirecord + index, SMART_FAN_RPM_DATA_LENGTH);
 
+  view->multirecord_smart_fan.flag = 1;
   return 0;
 }
 
-/* Parse the Product area data */
-int parse_fruid_area_product(uint8_t * product,
-      fruid_area_product_t * fruid_product)
+/* Populate the common header struct */
+static int parse_fruid_header(const uint8_t * eeprom, int eeprom_len,
+      fruid_header_t * header)
 {
-  int ret, index;
-
-  index = 0;
+  int ret;
 
-  /* Reset the struct to zero */
-  memset(fruid_product, 0, sizeof(fruid_area_product_t));
+  if (eeprom_len < (int)sizeof(fruid_header_t))
+    return ENODATA;
 
-  /* Check if the format version is as per IPMI FRUID v1.0 format spec */
-  fruid_product->format_ver = product[index++];
-  if (fruid_product->format_ver != FRUID_FORMAT_VER) {
+  memcpy((uint8_t *)header, (uint8_t *)eeprom, sizeof(fruid_header_t));
+  ret = verify_chksum((uint8_t *) header,
+          sizeof(fruid_header_t), header->chksum);
+  if (ret) {
 #ifdef DEBUG
-    syslog(LOG_ERR, "fruid: product_area: format version not supported");
+    syslog(LOG_ERR, "fruid: common_header: chksum not verified.");
 #endif
-    return EPROTONOSUPPORT;
+    return EBADF;
   }
 
-  fruid_product->area_len = product[index++] * FRUID_AREA_LEN_MULTIPLIER;
-  fruid_product->lang_code = product[index++];
+  return ret;
+}
 
-  fruid_product->chksum = product[fruid_product->area_len - 1];
-  ret = verify_chksum((uint8_t *) product,
-          fruid_product->area_len, fruid_product->chksum);
+static int check_multirecord_area(const uint8_t *multirecord, int remain_len, bool *is_last_area, uint8_t *type_id, uint8_t *area_len) {
+  int ret = 0;
+  int index = 0;
+  uint8_t format_ver = 0;
+  uint8_t record_chksum = 0;
+  uint8_t header_chksum = 0;
 
-  if (ret) {
+  if (multirecord == NULL || is_last_area == NULL || type_id == NULL || area_len == NULL) {
 #ifdef DEBUG
-    syslog(LOG_ERR, "fruid: product_area: chksum not verified.");
+    syslog(LOG_ERR, "%s Failed to parse multirecord by NULL parameter", __func__);
 #endif
-    return EBADF;
+    return -1;
   }
 
-  fruid_product->mfg_type_len = product[index];
-  fruid_product->mfg = _fruid_area_field_read(&product[index]);
-  if (fruid_product->mfg == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(product[index]) + 1;
-
-  fruid_product->name_type_len = product[index];
-  fruid_product->name = _fruid_area_field_read(&product[index]);
-  if (fruid_product->name == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(product[index]) + 1;
-
-  fruid_product->part_type_len = product[index];
-  fruid_product->part = _fruid_area_field_read(&product[index]);
-  if (fruid_product->part == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(product[index]) + 1;
-
-  fruid_product->version_type_len = product[index];
-  fruid_product->version = _fruid_area_field_read(&product[index]);
-  if (fruid_product->version == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(product[index]) + 1;
-
-  fruid_product->serial_type_len = product[index];
-  fruid_product->serial = _fruid_area_field_read(&product[index]);
-  if (fruid_product->serial == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(product[index]) + 1;
-
-  fruid_product->asset_tag_type_len = product[index];
-  fruid_product->asset_tag = _fruid_area_field_read(&product[index]);
-  if (fruid_product->asset_tag == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(product[index]) + 1;
-
-  fruid_product->fruid_type_len = product[index];
-  fruid_product->fruid = _fruid_area_field_read(&product[index]);
-  if (fruid_product->fruid == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(product[index]) + 1;
-
-  /* Check if this field was last and there is no more custom data */
-  fruid_product->custom1_type_len = product[index];
-  if (product[index] == NO_MORE_DATA_BYTE)
-    return 0;
-  fruid_product->custom1 = _fruid_area_field_read(&product[index]);
-  if (fruid_product->custom1 == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(product[index]) + 1;
-
-  /* Check if this field was last and there is no more custom data */
-  fruid_product->custom2_type_len = product[index];
-  if (product[index] == NO_MORE_DATA_BYTE)
-    return 0;
-  fruid_product->custom2 = _fruid_area_field_read(&product[index]);
-  if (fruid_product->custom2 == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(product[index]) + 1;
-
-  /* Check if this field was last and there is no more custom data */
-  fruid_product->custom3_type_len = product[index];
-  if (product[index] == NO_MORE_DATA_BYTE)
-    return 0;
-  fruid_product->custom3 = _fruid_area_field_read(&product[index]);
-  if (fruid_product->custom3 == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(product[index]) + 1;
-
-  /* Check if this field was last and there is no more custom data */
-  fruid_product->custom4_type_len = product[index];
-  if (product[index] == NO_MORE_DATA_BYTE)
-    return 0;
-  fruid_product->custom4 = _fruid_area_field_read(&product[index]);
-  if (fruid_product->custom4 == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(product[index]) + 1;
-
-  /* Check if this field was last and there is no more custom data */
-  fruid_product->custom5_type_len = product[index];
-  if (product[index] == NO_MORE_DATA_BYTE)
-    return 0;
-  fruid_product->custom5 = _fruid_area_field_read(&product[index]);
-  if (fruid_product->custom5 == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(product[index]) + 1;
-
-  /* Check if this field was last and there is no more custom data */
-  fruid_product->custom6_type_len = product[index];
-  if (product[index] == NO_MORE_DATA_BYTE)
-    return 0;
-  fruid_product->custom6 = _fruid_area_field_read(&product[index]);
-  if (fruid_product->custom6 == NULL)
-    return ENOMEM;
-
-  return 0;
-}
-
-/* Parse the Board area data */
-int parse_fruid_area_board(uint8_t * board,
-      fruid_area_board_t * fruid_board)
-{
-  int ret, index, i;
-
-  index = 0;
-
-  /* Reset the struct to zero */
-  memset(fruid_board, 0, sizeof(fruid_area_board_t));
-
-  /* Check if the format version is as per IPMI FRUID v1.0 format spec */
-  fruid_board->format_ver = board[index++];
-  if (fruid_board->format_ver != FRUID_FORMAT_VER) {
-#ifdef DEBUG
-    syslog(LOG_ERR, "fruid: board_area: format version not supported");
-#endif
-    return EPROTONOSUPPORT;
-  }
-  fruid_board->area_len = board[index++] * FRUID_AREA_LEN_MULTIPLIER;
-  fruid_board->lang_code = board[index++];
-
-  fruid_board->chksum = board[fruid_board->area_len - 1];
-  ret = verify_chksum((uint8_t *) board,
-          fruid_board->area_len, fruid_board->chksum);
-
-  if (ret) {
-#ifdef DEBUG
-    syslog(LOG_ERR, "fruid: board_area: chksum not verified.");
-#endif
-    return EBADF;
-  }
-
-  fruid_board->mfg_time = (uint8_t *) malloc(3*sizeof(uint8_t));
-  if (fruid_board->mfg_time == NULL)
-    return ENOMEM;
-  for (i = 0; i < 3; i++) {
-    fruid_board->mfg_time[i] = board[index++];
-  }
-
-  fruid_board->mfg_time_str = calculate_time(fruid_board->mfg_time);
-  if (fruid_board->mfg_time_str == NULL)
-    return ENOMEM;
-
-  fruid_board->mfg_type_len = board[index];
-  fruid_board->mfg = _fruid_area_field_read(&board[index]);
-  if (fruid_board->mfg == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(board[index]) + 1;
-
-  fruid_board->name_type_len = board[index];
-  fruid_board->name = _fruid_area_field_read(&board[index]);
-  if (fruid_board->name == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(board[index]) + 1;
-
-  fruid_board->serial_type_len = board[index];
-  fruid_board->serial = _fruid_area_field_read(&board[index]);
-  if (fruid_board->serial == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(board[index]) + 1;
-
-  fruid_board->part_type_len = board[index];
-  fruid_board->part = _fruid_area_field_read(&board[index]);
-  if (fruid_board->part == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(board[index]) + 1;
-
-  fruid_board->fruid_type_len = board[index];
-  fruid_board->fruid = _fruid_area_field_read(&board[index]);
-  if (fruid_board->fruid == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(board[index]) + 1;
-
-  /* Check if this field was last and there is no more custom data */
-  fruid_board->custom1_type_len = board[index];
-  if (board[index] == NO_MORE_DATA_BYTE)
-    return 0;
-  fruid_board->custom1 = _fruid_area_field_read(&board[index]);
-  if (fruid_board->custom1 == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(board[index]) + 1;
-
-  /* Check if this field was last and there is no more custom data */
-  fruid_board->custom2_type_len = board[index];
-  if (board[index] == NO_MORE_DATA_BYTE)
-    return 0;
-  fruid_board->custom2 = _fruid_area_field_read(&board[index]);
-  if (fruid_board->custom2 == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(board[index]) + 1;
-
-  /* Check if this field was last and there is no more custom data */
-  fruid_board->custom3_type_len = board[index];
-  if (board[index] == NO_MORE_DATA_BYTE)
-    return 0;
-  fruid_board->custom3 = _fruid_area_field_read(&board[index]);
-  if (fruid_board->custom3 == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(board[index]) + 1;
-
-  /* Check if this field was last and there is no more custom data */
-  fruid_board->custom4_type_len = board[index];
-  if (board[index] == NO_MORE_DATA_BYTE)
-    return 0;
-  fruid_board->custom4 = _fruid_area_field_read(&board[index]);
-  if (fruid_board->custom4 == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(board[index]) + 1;
-
-  /* Check if this field was last and there is no more custom data */
-  fruid_board->custom5_type_len = board[index];
-  if (board[index] == NO_MORE_DATA_BYTE)
-    return 0;
-  fruid_board->custom5 = _fruid_area_field_read(&board[index]);
-  if (fruid_board->custom5 == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(board[index]) + 1;
-
-  /* Check if this field was last and there is no more custom data */
-  fruid_board->custom6_type_len = board[index];
-  if (board[index] == NO_MORE_DATA_BYTE)
-    return 0;
-  fruid_board->custom6 = _fruid_area_field_read(&board[index]);
-  if (fruid_board->custom6 == NULL)
-    return ENOMEM;
-
-  return 0;
-}
-
-/* Parse the Chassis area data */
-int parse_fruid_area_chassis(uint8_t * chassis,
-      fruid_area_chassis_t * fruid_chassis)
-{
-  int ret, index;
-
-  index = 0;
-
-  /* Reset the struct to zero */
-  memset(fruid_chassis, 0, sizeof(fruid_area_chassis_t));
-
-  /* Check if the format version is as per IPMI FRUID v1.0 format spec */
-  fruid_chassis->format_ver = chassis[index++];
-  if (fruid_chassis->format_ver != FRUID_FORMAT_VER) {
-#ifdef DEBUG
-    syslog(LOG_ERR, "fruid: chassis_area: format version not supported");
-#endif
-    return EPROTONOSUPPORT;
-  }
-
-  fruid_chassis->area_len = chassis[index++] * FRUID_AREA_LEN_MULTIPLIER;
-  fruid_chassis->type = chassis[index++];
-
-  fruid_chassis->chksum = chassis[fruid_chassis->area_len - 1];
-  ret = verify_chksum((uint8_t *) chassis,
-          fruid_chassis->area_len, fruid_chassis->chksum);
-  if (ret) {
-#ifdef DEBUG
-    syslog(LOG_ERR, "fruid: chassis_area: chksum not verified.");
-#endif
-    return EBADF;
-  }
-
-  fruid_chassis->type_str = get_chassis_type(fruid_chassis->type);
-  if (fruid_chassis->type_str == NULL)
-    return ENOMSG;
-
-  fruid_chassis->part_type_len = chassis[index];
-  fruid_chassis->part = _fruid_area_field_read(&chassis[index]);
-  if (fruid_chassis->part == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(chassis[index]) + 1;
-
-  fruid_chassis->serial_type_len = chassis[index];
-  fruid_chassis->serial = _fruid_area_field_read(&chassis[index]);
-  if (fruid_chassis->serial == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(chassis[index]) + 1;
-
-  /* Check if this field was last and there is no more custom data */
-  fruid_chassis->custom1_type_len = chassis[index];
-  if (chassis[index] == NO_MORE_DATA_BYTE)
-    return 0;
-  fruid_chassis->custom1 = _fruid_area_field_read(&chassis[index]);
-  if (fruid_chassis->custom1 == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(chassis[index]) + 1;
-
-  /* Check if this field was last and there is no more custom data */
-  fruid_chassis->custom2_type_len = chassis[index];
-  if (chassis[index] == NO_MORE_DATA_BYTE)
-    return 0;
-  fruid_chassis->custom2 = _fruid_area_field_read(&chassis[index]);
-  if (fruid_chassis->custom2 == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(chassis[index]) + 1;
-
-  /* Check if this field was last and there is no more custom data */
-  fruid_chassis->custom3_type_len = chassis[index];
-  if (chassis[index] == NO_MORE_DATA_BYTE)
-    return 0;
-  fruid_chassis->custom3 = _fruid_area_field_read(&chassis[index]);
-  if (fruid_chassis->custom3 == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(chassis[index]) + 1;
-
-  /* Check if this field was last and there is no more custom data */
-  fruid_chassis->custom4_type_len = chassis[index];
-  if (chassis[index] == NO_MORE_DATA_BYTE)
-    return 0;
-  fruid_chassis->custom4 = _fruid_area_field_read(&chassis[index]);
-  if (fruid_chassis->custom4 == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(chassis[index]) + 1;
-
-  /* Check if this field was last and there is no more custom data */
-  fruid_chassis->custom5_type_len = chassis[index];
-  if (chassis[index] == NO_MORE_DATA_BYTE)
-    return 0;
-  fruid_chassis->custom5 = _fruid_area_field_read(&chassis[index]);
-  if (fruid_chassis->custom5 == NULL)
-    return ENOMEM;
-  index += FIELD_LEN(chassis[index]) + 1;
-
-  /* Check if this field was last and there is no more custom data */
-  fruid_chassis->custom6_type_len = chassis[index];
-  if (chassis[index] == NO_MORE_DATA_BYTE)
-    return 0;
-  fruid_chassis->custom6 = _fruid_area_field_read(&chassis[index]);
-  if (fruid_chassis->custom6 == NULL)
-    return ENOMEM;
-
-  return 0;
-}
-
-/* Calculate the area offsets and populate the fruid_eeprom_t struct */
-void set_fruid_eeprom_offsets(const uint8_t * eeprom, fruid_header_t * header,
-      fruid_eeprom_t * fruid_eeprom)
-{
-  fruid_eeprom->header = (uint8_t *)eeprom + 0x00;
-
-  header->offset_area.chassis ? (fruid_eeprom->chassis = (uint8_t *)eeprom + \
-    (header->offset_area.chassis * FRUID_OFFSET_MULTIPLIER)) : \
-    (fruid_eeprom->chassis = NULL);
-
-  header->offset_area.board ? (fruid_eeprom->board = (uint8_t *)eeprom + \
-    (header->offset_area.board * FRUID_OFFSET_MULTIPLIER)) : \
-    (fruid_eeprom->board = NULL);
-
-  header->offset_area.product ? (fruid_eeprom->product = (uint8_t *)eeprom + \
-    (header->offset_area.product * FRUID_OFFSET_MULTIPLIER)) : \
-    (fruid_eeprom->product = NULL);
-
-  header->offset_area.multirecord ? (fruid_eeprom->multirecord = (uint8_t *)eeprom + \
-    (header->offset_area.multirecord * FRUID_OFFSET_MULTIPLIER)) : \
-    (fruid_eeprom->multirecord = NULL);
-}
-
-/* Populate the common header struct */
-int parse_fruid_header(const uint8_t * eeprom, fruid_header_t * header)
-{
-  int ret;
-
-  memcpy((uint8_t *)header, (uint8_t *)eeprom, sizeof(fruid_header_t));
-  ret = verify_chksum((uint8_t *) header,
-          sizeof(fruid_header_t), header->chksum);
-  if (ret) {
-#ifdef DEBUG
-    syslog(LOG_ERR, "fruid: common_header: chksum not verified.");
-#endif
-    return EBADF;
-  }
-
-  return ret;
-}
-
-static int check_multirecord_area(uint8_t *multirecord, int remain_len, bool *is_last_area, uint8_t *type_id, uint8_t *area_len) {
-  int ret = 0;
-  int index = 0;
-  uint8_t format_ver = 0;
-  uint8_t record_chksum = 0;
-  uint8_t header_chksum = 0;
-
-  if (multirecord == NULL || is_last_area == NULL || type_id == NULL || area_len == NULL) {
-#ifdef DEBUG
-    syslog(LOG_ERR, "%s Failed to parse multirecord by NULL parameter", __func__);
-#endif
-    return -1;
-  }
-
-  if (remain_len < sizeof(fruid_area_multirecord_header_t)) {
-    return -1;
-  }
+  if (remain_len < sizeof(fruid_area_multirecord_header_t)) {
+    return -1;
+  }
 
   *type_id = multirecord[index++];
   format_ver = multirecord[index++];
@@ -892,6 +571,10 @@ static int check_multirecord_area(uint8_t *multirecord, int remain_len, bool *is
 
   *is_last_area = format_ver & MULTIRECORD_LAST_RECORED_BIT;
 
+  if (remain_len < sizeof(fruid_area_multirecord_header_t) + *area_len) {
+    return -1;
+  }
+
   if ((format_ver & MULTIRECORD_FORMAT_VER_MASK) != MULTIRECORD_FORMAT_VER) {
 #ifdef DEBUG
     syslog(LOG_ERR, "%s: format version: %u not supported", __func__, format_ver);
@@ -899,13 +582,13 @@ static int check_multirecord_area(uint8_t *multirecord, int remain_len, bool *is
     return 1;
   }
 
-  ret = verify_chksum((multirecord + sizeof(fruid_area_multirecord_header_t)), *area_len + 1, record_chksum);
+  ret = verify_chksum((uint8_t *)(multirecord + sizeof(fruid_area_multirecord_header_t)), *area_len + 1, record_chksum);
   if (ret != 0) {
     syslog(LOG_ERR, "%s: record chksum not verified.", __func__);
     return 1;
   }
 
-  ret = verify_chksum(multirecord, sizeof(fruid_area_multirecord_header_t), header_chksum);
+  ret = verify_chksum((uint8_t *)multirecord, sizeof(fruid_area_multirecord_header_t), header_chksum);
   if (ret != 0) {
     syslog(LOG_ERR, "%s: header chksum not verified.", __func__);
     return 1;
@@ -914,135 +597,66 @@ static int check_multirecord_area(uint8_t *multirecord, int remain_len, bool *is
   return 0;
 }
 
-/* Parse the eeprom dump and populate the fruid info in struct */
-int populate_fruid_info(fruid_eeprom_t * fruid_eeprom, fruid_info_t * fruid, int eeprom_len)
+/*
+ * fruid_parse_view - parse an eeprom dump into a view
+ *
+ * @eeprom     : eeprom dump
+ * @eeprom_len : length of the dump; nothing past it is read
+ * @view       : view to fill. All strings are stored in view->arena,
+ *               so nothing needs to be freed afterwards.
+ *
+ * returns 0 on success
+ * returns non-zero errno value on error
+ */
+int fruid_parse_view(const uint8_t * eeprom, int eeprom_len, fruid_view_t * view)
 {
-  int ret;
-  uint8_t *pMultirecord = NULL;
-  uint8_t *pEnd = (fruid_eeprom->header + eeprom_len);
+  const uint8_t *end = eeprom + eeprom_len;
+  const uint8_t *pMultirecord;
+  fruid_header_t header;
   uint8_t type_id = 0;
   uint8_t area_len = 0;
-  int remain_len = 0;
   bool is_last_area = true;
+  int ret;
 
-  /* Initial all the required fruid structures */
-  fruid_area_chassis_t fruid_chassis;
-  fruid_area_board_t fruid_board;
-  fruid_area_product_t fruid_product;
-  fruid_area_multirecord_smart_fan_t fruid_multirecord_smart_fan;
-
-  /* If Chassis area is present, parse and print it */
-  if (fruid_eeprom->chassis) {
-    ret = parse_fruid_area_chassis(fruid_eeprom->chassis, &fruid_chassis);
-    if (!ret) {
-      fruid->chassis.flag = 1;
-      fruid->chassis.format_ver = fruid_chassis.format_ver;
-      fruid->chassis.area_len = fruid_chassis.area_len;
-      fruid->chassis.type = fruid_chassis.type;
-      fruid->chassis.type_str = fruid_chassis.type_str;
-      fruid->chassis.part_type_len = fruid_chassis.part_type_len;
-      fruid->chassis.part = fruid_chassis.part;
-      fruid->chassis.serial_type_len = fruid_chassis.serial_type_len;
-      fruid->chassis.serial = fruid_chassis.serial;
-      fruid->chassis.custom1_type_len = fruid_chassis.custom1_type_len;
-      fruid->chassis.custom1 = fruid_chassis.custom1;
-      fruid->chassis.custom2_type_len = fruid_chassis.custom2_type_len;
-      fruid->chassis.custom2 = fruid_chassis.custom2;
-      fruid->chassis.custom3_type_len = fruid_chassis.custom3_type_len;
-      fruid->chassis.custom3 = fruid_chassis.custom3;
-      fruid->chassis.custom4_type_len = fruid_chassis.custom4_type_len;
-      fruid->chassis.custom4 = fruid_chassis.custom4;
-      fruid->chassis.custom5_type_len = fruid_chassis.custom5_type_len;
-      fruid->chassis.custom5 = fruid_chassis.custom5;
-      fruid->chassis.custom6_type_len = fruid_chassis.custom6_type_len;
-      fruid->chassis.custom6 = fruid_chassis.custom6;
-      fruid->chassis.chksum = fruid_chassis.chksum;
-    } else
+  memset(view, 0, offsetof(fruid_view_t, arena));
+
+  /* Parse the common header data */
+  ret = parse_fruid_header(eeprom, eeprom_len, &header);
+  if (ret)
+    return ret;
+
+  /* If Chassis area is present, parse it */
+  if (header.offset_area.chassis) {
+    ret = view_parse_chassis(view,
+            eeprom + header.offset_area.chassis * FRUID_OFFSET_MULTIPLIER, end);
+    if (ret)
       return ret;
+    view->chassis.flag = 1;
   }
 
-  /* If Board area is present, parse and print it */
-  if (fruid_eeprom->board) {
-    ret = parse_fruid_area_board(fruid_eeprom->board, &fruid_board);
-    if (!ret) {
-      fruid->board.flag = 1;
-      fruid->board.format_ver = fruid_board.format_ver;
-      fruid->board.area_len = fruid_board.area_len;
-      fruid->board.lang_code = fruid_board.lang_code;
-      fruid->board.mfg_time = fruid_board.mfg_time;
-      fruid->board.mfg_time_str = fruid_board.mfg_time_str;
-      fruid->board.mfg_type_len = fruid_board.mfg_type_len;
-      fruid->board.mfg = fruid_board.mfg;
-      fruid->board.name_type_len = fruid_board.name_type_len;
-      fruid->board.name = fruid_board.name;
-      fruid->board.serial_type_len = fruid_board.serial_type_len;
-      fruid->board.serial = fruid_board.serial;
-      fruid->board.part_type_len = fruid_board.part_type_len;
-      fruid->board.part = fruid_board.part;
-      fruid->board.fruid_type_len = fruid_board.fruid_type_len;
-      fruid->board.fruid = fruid_board.fruid;
-      fruid->board.custom1_type_len = fruid_board.custom1_type_len;
-      fruid->board.custom1 = fruid_board.custom1;
-      fruid->board.custom2_type_len = fruid_board.custom2_type_len;
-      fruid->board.custom2 = fruid_board.custom2;
-      fruid->board.custom3_type_len = fruid_board.custom3_type_len;
-      fruid->board.custom3 = fruid_board.custom3;
-      fruid->board.custom4_type_len = fruid_board.custom4_type_len;
-      fruid->board.custom4 = fruid_board.custom4;
-      fruid->board.custom5_type_len = fruid_board.custom5_type_len;
-      fruid->board.custom5 = fruid_board.custom5;
-      fruid->board.custom6_type_len = fruid_board.custom6_type_len;
-      fruid->board.custom6 = fruid_board.custom6;
-      fruid->board.chksum = fruid_board.chksum;
-    } else
+  /* If Board area is present, parse it */
+  if (header.offset_area.board) {
+    ret = view_parse_board(view,
+            eeprom + header.offset_area.board * FRUID_OFFSET_MULTIPLIER, end);
+    if (ret)
       return ret;
+    view->board.flag = 1;
   }
 
-  /* If Product area is present, parse and print it */
-  if (fruid_eeprom->product) {
-    ret = parse_fruid_area_product(fruid_eeprom->product, &fruid_product);
-    if (!ret) {
-      fruid->product.flag = 1;
-      fruid->product.format_ver = fruid_product.format_ver;
-      fruid->product.area_len = fruid_product.area_len;
-      fruid->product.lang_code = fruid_product.lang_code;
-      fruid->product.mfg_type_len = fruid_product.mfg_type_len;
-      fruid->product.mfg = fruid_product.mfg;
-      fruid->product.name_type_len = fruid_product.name_type_len;
-      fruid->product.name = fruid_product.name;
-      fruid->product.part_type_len = fruid_product.part_type_len;
-      fruid->product.part = fruid_product.part;
-      fruid->product.version_type_len = fruid_product.version_type_len;
-      fruid->product.version = fruid_product.version;
-      fruid->product.serial_type_len = fruid_product.serial_type_len;
-      fruid->product.serial = fruid_product.serial;
-      fruid->product.asset_tag_type_len = fruid_product.asset_tag_type_len;
-      fruid->product.asset_tag = fruid_product.asset_tag;
-      fruid->product.fruid_type_len = fruid_product.fruid_type_len;
-      fruid->product.fruid = fruid_product.fruid;
-      fruid->product.custom1_type_len = fruid_product.custom1_type_len;
-      fruid->product.custom1 = fruid_product.custom1;
-      fruid->product.custom2_type_len = fruid_product.custom2_type_len;
-      fruid->product.custom2 = fruid_product.custom2;
-      fruid->product.custom3_type_len = fruid_product.custom3_type_len;
-      fruid->product.custom3 = fruid_product.custom3;
-      fruid->product.custom4_type_len = fruid_product.custom4_type_len;
-      fruid->product.custom4 = fruid_product.custom4;
-      fruid->product.custom5_type_len = fruid_product.custom5_type_len;
-      fruid->product.custom5 = fruid_product.custom5;
-      fruid->product.custom6_type_len = fruid_product.custom6_type_len;
-      fruid->product.custom6 = fruid_product.custom6;
-      fruid->product.chksum = fruid_product.chksum;
-    } else
+  /* If Product area is present, parse it */
+  if (header.offset_area.product) {
+    ret = view_parse_product(view,
+            eeprom + header.offset_area.product * FRUID_OFFSET_MULTIPLIER, end);
+    if (ret)
       return ret;
+    view->product.flag = 1;
   }
 
-  if (fruid_eeprom->multirecord) {
-    pMultirecord = fruid_eeprom->multirecord;
+  if (header.offset_area.multirecord) {
+    pMultirecord = eeprom + header.offset_area.multirecord * FRUID_OFFSET_MULTIPLIER;
     // get area index and area id
-    while(pMultirecord < pEnd) {
-      remain_len = (pEnd - pMultirecord);
-      ret = check_multirecord_area(pMultirecord, remain_len, &is_last_area, &type_id, &area_len);
+    while (pMultirecord < end) {
+      ret = check_multirecord_area(pMultirecord, end - pMultirecord, &is_last_area, &type_id, &area_len);
       if (ret < 0) {
         break;
       }
@@ -1051,21 +665,7 @@ int populate_fruid_info(fruid_eeprom_t * fruid_eeprom, fruid_info_t * fruid, int
         continue;
       }
       if (type_id == SMART_FAN_RECORD_ID) {
-        ret = parse_fruid_area_multirecord_smart_fan(pMultirecord + sizeof(fruid_area_multirecord_header_t), &fruid_multirecord_smart_fan);
-        if (ret == 0) {
-          fruid->multirecord_smart_fan.flag = 1;
-          fruid->multirecord_smart_fan.manufacturer_id = fruid_multirecord_smart_fan.manufacturer_id;
-          fruid->multirecord_smart_fan.smart_fan_ver = fruid_multirecord_smart_fan.smart_fan_ver;
-          fruid->multirecord_smart_fan.fw_ver = fruid_multirecord_smart_fan.fw_ver;
-          fruid->multirecord_smart_fan.mfg_time = fruid_multirecord_smart_fan.mfg_time;
-          fruid->multirecord_smart_fan.mfg_time_str = fruid_multirecord_smart_fan.mfg_time_str;
-          fruid->multirecord_smart_fan.mfg_line = fruid_multirecord_smart_fan.mfg_line;
-          fruid->multirecord_smart_fan.clei_code = fruid_multirecord_smart_fan.clei_code;
-          fruid->multirecord_smart_fan.voltage = fruid_multirecord_smart_fan.voltage;
-          fruid->multirecord_smart_fan.current = fruid_multirecord_smart_fan.current;
-          fruid->multirecord_smart_fan.rpm_front = fruid_multirecord_smart_fan.rpm_front;
-          fruid->multirecord_smart_fan.rpm_rear = fruid_multirecord_smart_fan.rpm_rear;
-        }
+        view_parse_smart_fan(view, pMultirecord + sizeof(fruid_area_multirecord_header_t), end);
       }
       // append other type here
       if (is_last_area == true) { // last one record of the list
@@ -1079,99 +679,486 @@ int populate_fruid_info(fruid_eeprom_t * fruid_eeprom, fruid_info_t * fruid, int
 }
 
 /*
- * fruid_parse - To parse the bin file (eeprom) and populate
- *               the fruid information in the struct
- * @bin       : Eeprom binary file
- * @fruid     : ptr to the struct that holds the fruid information
+ * Parsed FRU cache.
  *
- * returns 0 on success
- * returns non-zero errno value on error
+ * Daemons parse the same handful of FRU images over and over. The cache
+ * keeps the views of the most recently used images, keyed by path and
+ * checksum of the content, so an unchanged image is only read, not
+ * parsed again. Views are reference counted; a view whose image changed
+ * stays valid until its last user puts it.
  */
-int fruid_parse(const char * bin, fruid_info_t * fruid)
+#define FRUID_CACHE_ENTRIES  16
+#define FRUID_CACHE_PATH_LEN 128
+
+typedef struct fruid_cache_node_t {
+  fruid_view_t view;    /* must be first, users only see the view */
+  char path[FRUID_CACHE_PATH_LEN];
+  uint32_t chksum;
+  int len;
+  int refs;
+  bool cached;
+  uint64_t last_use;
+} fruid_cache_node_t;
+
+static pthread_mutex_t fruid_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static fruid_cache_node_t * fruid_cache[FRUID_CACHE_ENTRIES];
+static uint64_t fruid_cache_tick;
+
+/* FNV-1a, good enough to tell FRU images apart */
+static uint32_t fruid_image_chksum(const uint8_t * buf, int len)
 {
-  int fruid_len, ret;
-  FILE *fruid_fd;
-  uint8_t * eeprom;
+  uint32_t hash = 2166136261u;
+  int i;
 
-  /* Reset parser return value */
-  ret = 0;
+  for (i = 0; i < len; i++) {
+    hash ^= buf[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
 
-  /* Open the FRUID binary file */
-  fruid_fd = fopen(bin, "rb");
-  if (!fruid_fd) {
+/* Read a whole FRU binary file. The caller frees the buffer. */
+static int fruid_read_file(const char * bin, uint8_t ** buf, int * len)
+{
+  struct stat st;
+  int fd, ret;
+
+  fd = open(bin, O_RDONLY);
+  if (fd < 0) {
 #ifdef DEBUG
     syslog(LOG_ERR, "fruid: unable to open the file");
 #endif
     return ENOENT;
   }
 
-  /* Get the size of the binary file */
-  fseek(fruid_fd, 0, SEEK_END);
-  fruid_len = (uint32_t) ftell(fruid_fd);
-  if (fruid_len == 0) {
-    fclose(fruid_fd);
+  /* sysfs eeprom files report their size, so fstat works for them too */
+  if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+    close(fd);
     syslog(LOG_WARNING, "fruid: file %s is empty", bin);
     return -1;
   }
 
-  fseek(fruid_fd, 0, SEEK_SET);
-
-  eeprom = (uint8_t *) malloc(fruid_len);
-  if (!eeprom) {
-    fclose(fruid_fd);
+  *buf = (uint8_t *) malloc(st.st_size);
+  if (*buf == NULL) {
+    close(fd);
 #ifdef DEBUG
     syslog(LOG_WARNING, "fruid: malloc: memory allocation failed\n");
 #endif
     return ENOMEM;
   }
 
-  /* Read the binary file */
-  ret = fread(eeprom, sizeof(uint8_t), fruid_len, fruid_fd);
-  if (ret != fruid_len) {
+  *len = 0;
+  while (*len < st.st_size) {
+    ret = read(fd, *buf + *len, st.st_size - *len);
+    if (ret < 0 && errno == EINTR)
+      continue;
+    if (ret <= 0)
+      break;
+    *len += ret;
+  }
+  close(fd);
+
+  if (*len != st.st_size) {
+    free(*buf);
+    *buf = NULL;
     printf("Failed to read binary file, inconsistent length\n");
     return -1;
   }
 
-  /* Close the FRUID binary file */
-  fclose(fruid_fd);
+  return 0;
+}
 
-  /* Parse eeprom dump*/
-  ret = fruid_parse_eeprom(eeprom, fruid_len, fruid);
+static void fruid_cache_release(fruid_cache_node_t * node)
+{
+  if (!node->cached && node->refs == 0)
+    free(node);
+}
 
-  /* Free the eeprom malloced memory */
+/* Insert a node, replacing an older image of the same path. Called locked. */
+static void fruid_cache_insert(fruid_cache_node_t * node)
+{
+  int i, slot = -1;
+
+  for (i = 0; i < FRUID_CACHE_ENTRIES; i++) {
+    if (fruid_cache[i] && !strcmp(fruid_cache[i]->path, node->path)) {
+      slot = i;
+      break;
+    }
+  }
+  if (slot < 0) {
+    for (i = 0; i < FRUID_CACHE_ENTRIES; i++) {
+      if (fruid_cache[i] == NULL) {
+        slot = i;
+        break;
+      }
+      if (slot < 0 || fruid_cache[i]->last_use < fruid_cache[slot]->last_use)
+        slot = i;
+    }
+  }
+
+  if (fruid_cache[slot]) {
+    fruid_cache[slot]->cached = false;
+    fruid_cache_release(fruid_cache[slot]);
+  }
+  node->cached = true;
+  fruid_cache[slot] = node;
+}
+
+/*
+ * fruid_view_get - get the parsed view of a FRU binary file
+ *
+ * @bin       : Eeprom binary file
+ * @err       : errno value on failure, may be NULL
+ *
+ * The file is read on every call, but only parsed when its content
+ * differs from the cached view. The view must be released with
+ * fruid_view_put().
+ *
+ * returns the view, or NULL on error
+ */
+const fruid_view_t * fruid_view_get(const char * bin, int * err)
+{
+  fruid_cache_node_t * node = NULL;
+  uint8_t * eeprom = NULL;
+  uint32_t chksum;
+  int len = 0, ret, i;
+
+  ret = fruid_read_file(bin, &eeprom, &len);
+  if (ret)
+    goto exit;
+  chksum = fruid_image_chksum(eeprom, len);
+
+  pthread_mutex_lock(&fruid_cache_lock);
+  for (i = 0; i < FRUID_CACHE_ENTRIES; i++) {
+    node = fruid_cache[i];
+    if (node && node->len == len && node->chksum == chksum &&
+        !strcmp(node->path, bin)) {
+      node->refs++;
+      node->last_use = ++fruid_cache_tick;
+      break;
+    }
+    node = NULL;
+  }
+  pthread_mutex_unlock(&fruid_cache_lock);
+  if (node)
+    goto exit;
+
+  node = (fruid_cache_node_t *) malloc(sizeof(fruid_cache_node_t));
+  if (node == NULL) {
+    ret = ENOMEM;
+    goto exit;
+  }
+  ret = fruid_parse_view(eeprom, len, &node->view);
+  if (ret) {
+    free(node);
+    node = NULL;
+    goto exit;
+  }
+  node->chksum = chksum;
+  node->len = len;
+  node->refs = 1;
+  node->cached = false;
+
+  /* Paths too long for the cache get a private view */
+  if (strlen(bin) < sizeof(node->path)) {
+    strcpy(node->path, bin);
+    pthread_mutex_lock(&fruid_cache_lock);
+    node->last_use = ++fruid_cache_tick;
+    fruid_cache_insert(node);
+    pthread_mutex_unlock(&fruid_cache_lock);
+  }
+
+exit:
   free(eeprom);
-  return ret;
+  if (err)
+    *err = ret;
+  return node ? &node->view : NULL;
 }
 
-/* Populate the fruid from eeprom dump*/
-int fruid_parse_eeprom(const uint8_t * eeprom, int eeprom_len, fruid_info_t * fruid)
+/* Release a view obtained from fruid_view_get() */
+void fruid_view_put(const fruid_view_t * view)
 {
-  int ret = 0;
+  fruid_cache_node_t * node = (fruid_cache_node_t *) view;
 
-  /* Initial all the required fruid structures */
-  fruid_header_t fruid_header;
-  fruid_eeprom_t fruid_eeprom;
+  if (view == NULL)
+    return;
 
-  memset(&fruid_header, 0, sizeof(fruid_header_t));
-  memset(&fruid_eeprom, 0, sizeof(fruid_eeprom_t));
-  memset(fruid, 0, sizeof(fruid_info_t));
+  pthread_mutex_lock(&fruid_cache_lock);
+  node->refs--;
+  fruid_cache_release(node);
+  pthread_mutex_unlock(&fruid_cache_lock);
+}
 
-  /* Parse the common header data */
-  ret = parse_fruid_header(eeprom, &fruid_header);
-  if (ret) {
-    return ret;
+/* Drop all cached views, e.g. after a FRU image was rewritten in place */
+void fruid_view_cache_flush(void)
+{
+  int i;
+
+  pthread_mutex_lock(&fruid_cache_lock);
+  for (i = 0; i < FRUID_CACHE_ENTRIES; i++) {
+    if (fruid_cache[i]) {
+      fruid_cache[i]->cached = false;
+      fruid_cache_release(fruid_cache[i]);
+      fruid_cache[i] = NULL;
+    }
   }
+  pthread_mutex_unlock(&fruid_cache_lock);
+}
 
-  /* Calculate all the area offsets */
-  set_fruid_eeprom_offsets(eeprom, &fruid_header, &fruid_eeprom);
+/*
+ * The fruid_info_t API hands out separately allocated strings that
+ * free_fruid_info() and fruid_modify() free one by one, so the
+ * compatibility path copies each field out of the view.
+ */
+static char * dup_field(const fruid_field_t * field, int * err)
+{
+  char * str;
 
-  /* Parse the eeprom and populate the fruid information */
-  ret = populate_fruid_info(&fruid_eeprom, fruid, eeprom_len);
-  if (ret) {
+  if (field->str == NULL)
+    return NULL;
+
+  str = (char *) malloc(field->len + 1);
+  if (str == NULL) {
+    *err = ENOMEM;
+    return NULL;
+  }
+  memcpy(str, field->str, field->len);
+  str[field->len] = '\0';
+  return str;
+}
+
+static uint8_t * dup_time(const uint8_t * mfg_time, int * err)
+{
+  uint8_t * buf = (uint8_t *) malloc(MFG_DATE_TIME_LENGTH);
+
+  if (buf == NULL) {
+    *err = ENOMEM;
+    return NULL;
+  }
+  memcpy(buf, mfg_time, MFG_DATE_TIME_LENGTH);
+  return buf;
+}
+
+static int view_to_info(const fruid_view_t * view, fruid_info_t * fruid)
+{
+  int err = 0;
+
+  memset(fruid, 0, sizeof(fruid_info_t));
+
+  if (view->chassis.flag) {
+    fruid->chassis.flag = 1;
+    fruid->chassis.format_ver = view->chassis.format_ver;
+    fruid->chassis.area_len = view->chassis.area_len;
+    fruid->chassis.type = view->chassis.type;
+    fruid->chassis.type_str = strdup(view->chassis.type_str);
+    if (fruid->chassis.type_str == NULL)
+      err = ENOMEM;
+    fruid->chassis.part_type_len = view->chassis.part.type_len;
+    fruid->chassis.part = dup_field(&view->chassis.part, &err);
+    fruid->chassis.serial_type_len = view->chassis.serial.type_len;
+    fruid->chassis.serial = dup_field(&view->chassis.serial, &err);
+    fruid->chassis.custom1_type_len = view->chassis.custom[0].type_len;
+    fruid->chassis.custom1 = dup_field(&view->chassis.custom[0], &err);
+    fruid->chassis.custom2_type_len = view->chassis.custom[1].type_len;
+    fruid->chassis.custom2 = dup_field(&view->chassis.custom[1], &err);
+    fruid->chassis.custom3_type_len = view->chassis.custom[2].type_len;
+    fruid->chassis.custom3 = dup_field(&view->chassis.custom[2], &err);
+    fruid->chassis.custom4_type_len = view->chassis.custom[3].type_len;
+    fruid->chassis.custom4 = dup_field(&view->chassis.custom[3], &err);
+    fruid->chassis.custom5_type_len = view->chassis.custom[4].type_len;
+    fruid->chassis.custom5 = dup_field(&view->chassis.custom[4], &err);
+    fruid->chassis.custom6_type_len = view->chassis.custom[5].type_len;
+    fruid->chassis.custom6 = dup_field(&view->chassis.custom[5], &err);
+    fruid->chassis.chksum = view->chassis.chksum;
+  }
+
+  if (view->board.flag) {
+    fruid->board.flag = 1;
+    fruid->board.format_ver = view->board.format_ver;
+    fruid->board.area_len = view->board.area_len;
+    fruid->board.lang_code = view->board.lang_code;
+    fruid->board.mfg_time = dup_time(view->board.mfg_time, &err);
+    fruid->board.mfg_time_str = dup_field(&view->board.mfg_time_str, &err);
+    fruid->board.mfg_type_len = view->board.mfg.type_len;
+    fruid->board.mfg = dup_field(&view->board.mfg, &err);
+    fruid->board.name_type_len = view->board.name.type_len;
+    fruid->board.name = dup_field(&view->board.name, &err);
+    fruid->board.serial_type_len = view->board.serial.type_len;
+    fruid->board.serial = dup_field(&view->board.serial, &err);
+    fruid->board.part_type_len = view->board.part.type_len;
+    fruid->board.part = dup_field(&view->board.part, &err);
+    fruid->board.fruid_type_len = view->board.fruid.type_len;
+    fruid->board.fruid = dup_field(&view->board.fruid, &err);
+    fruid->board.custom1_type_len = view->board.custom[0].type_len;
+    fruid->board.custom1 = dup_field(&view->board.custom[0], &err);
+    fruid->board.custom2_type_len = view->board.custom[1].type_len;
+    fruid->board.custom2 = dup_field(&view->board.custom[1], &err);
+    fruid->board.custom3_type_len = view->board.custom[2].type_len;
+    fruid->board.custom3 = dup_field(&view->board.custom[2], &err);
+    fruid->board.custom4_type_len = view->board.custom[3].type_len;
+    fruid->board.custom4 = dup_field(&view->board.custom[3], &err);
+    fruid->board.custom5_type_len = view->board.custom[4].type_len;
+    fruid->board.custom5 = dup_field(&view->board.custom[4], &err);
+    fruid->board.custom6_type_len = view->board.custom[5].type_len;
+    fruid->board.custom6 = dup_field(&view->board.custom[5], &err);
+    fruid->board.chksum = view->board.chksum;
+  }
+
+  if (view->product.flag) {
+    fruid->product.flag = 1;
+    fruid->product.format_ver = view->product.format_ver;
+    fruid->product.area_len = view->product.area_len;
+    fruid->product.lang_code = view->product.lang_code;
+    fruid->product.mfg_type_len = view->product.mfg.type_len;
+    fruid->product.mfg = dup_field(&view->product.mfg, &err);
+    fruid->product.name_type_len = view->product.name.type_len;
+    fruid->product.name = dup_field(&view->product.name, &err);
+    fruid->product.part_type_len = view->product.part.type_len;
+    fruid->product.part = dup_field(&view->product.part, &err);
+    fruid->product.version_type_len = view->product.version.type_len;
+    fruid->product.version = dup_field(&view->product.version, &err);
+    fruid->product.serial_type_len = view->product.serial.type_len;
+    fruid->product.serial = dup_field(&view->product.serial, &err);
+    fruid->product.asset_tag_type_len = view->product.asset_tag.type_len;
+    fruid->product.asset_tag = dup_field(&view->product.asset_tag, &err);
+    fruid->product.fruid_type_len = view->product.fruid.type_len;
+    fruid->product.fruid = dup_field(&view->product.fruid, &err);
+    fruid->product.custom1_type_len = view->product.custom[0].type_len;
+    fruid->product.custom1 = dup_field(&view->product.custom[0], &err);
+    fruid->product.custom2_type_len = view->product.custom[1].type_len;
+    fruid->product.custom2 = dup_field(&view->product.custom[1], &err);
+    fruid->product.custom3_type_len = view->product.custom[2].type_len;
+    fruid->product.custom3 = dup_field(&view->product.custom[2], &err);
+    fruid->product.custom4_type_len = view->product.custom[3].type_len;
+    fruid->product.custom4 = dup_field(&view->product.custom[3], &err);
+    fruid->product.custom5_type_len = view->product.custom[4].type_len;
+    fruid->product.custom5 = dup_field(&view->product.custom[4], &err);
+    fruid->product.custom6_type_len = view->product.custom[5].type_len;
+    fruid->product.custom6 = dup_field(&view->product.custom[5], &err);
+    fruid->product.chksum = view->product.chksum;
+  }
+
+  if (view->multirecord_smart_fan.flag) {
+    fruid->multirecord_smart_fan.flag = 1;
+    fruid->multirecord_smart_fan.manufacturer_id = view->multirecord_smart_fan.manufacturer_id;
+    fruid->multirecord_smart_fan.smart_fan_ver = dup_field(&view->multirecord_smart_fan.smart_fan_ver, &err);
+    fruid->multirecord_smart_fan.fw_ver = dup_field(&view->multirecord_smart_fan.fw_ver, &err);
+    fruid->multirecord_smart_fan.mfg_time = dup_time(view->multirecord_smart_fan.mfg_time, &err);
+    fruid->multirecord_smart_fan.mfg_time_str = dup_field(&view->multirecord_smart_fan.mfg_time_str, &err);
+    fruid->multirecord_smart_fan.mfg_line = dup_field(&view->multirecord_smart_fan.mfg_line, &err);
+    fruid->multirecord_smart_fan.clei_code = dup_field(&view->multirecord_smart_fan.clei_code, &err);
+    fruid->multirecord_smart_fan.voltage = view->multirecord_smart_fan.voltage;
+    fruid->multirecord_smart_fan.current = view->multirecord_smart_fan.current;
+    fruid->multirecord_smart_fan.rpm_front = view->multirecord_smart_fan.rpm_front;
+    fruid->multirecord_smart_fan.rpm_rear = view->multirecord_smart_fan.rpm_rear;
+  }
+
+  if (err) {
     /* Free the malloced memory for the fruid information */
     free_fruid_info(fruid);
   }
+  return err;
+}
+
+/* Free all the memory allocated for fruid information */
+void free_fruid_info(fruid_info_t * fruid)
+{
+  if (fruid->chassis.flag) {
+    free(fruid->chassis.type_str);
+    free(fruid->chassis.part);
+    free(fruid->chassis.serial);
+    free(fruid->chassis.custom1);
+    free(fruid->chassis.custom2);
+    free(fruid->chassis.custom3);
+    free(fruid->chassis.custom4);
+    free(fruid->chassis.custom5);
+    free(fruid->chassis.custom6);
+  }
+
+  if (fruid->board.flag) {
+    free(fruid->board.mfg_time_str);
+    free(fruid->board.mfg_time);
+    free(fruid->board.mfg);
+    free(fruid->board.name);
+    free(fruid->board.serial);
+    free(fruid->board.part);
+    free(fruid->board.fruid);
+    free(fruid->board.custom1);
+    free(fruid->board.custom2);
+    free(fruid->board.custom3);
+    free(fruid->board.custom4);
+    free(fruid->board.custom5);
+    free(fruid->board.custom6);
+  }
+
+  if (fruid->product.flag) {
+    free(fruid->product.mfg);
+    free(fruid->product.name);
+    free(fruid->product.part);
+    free(fruid->product.version);
+    free(fruid->product.serial);
+    free(fruid->product.asset_tag);
+    free(fruid->product.fruid);
+    free(fruid->product.custom1);
+    free(fruid->product.custom2);
+    free(fruid->product.custom3);
+    free(fruid->product.custom4);
+    free(fruid->product.custom5);
+    free(fruid->product.custom6);
+  }
+
+  if (fruid->multirecord_smart_fan.flag) {
+    free(fruid->multirecord_smart_fan.smart_fan_ver);
+    free(fruid->multirecord_smart_fan.fw_ver);
+    free(fruid->multirecord_smart_fan.mfg_time);
+    free(fruid->multirecord_smart_fan.mfg_time_str);
+    free(fruid->multirecord_smart_fan.mfg_line);
+    free(fruid->multirecord_smart_fan.clei_code);
+  }
+}
+
+/*
+ * fruid_parse - To parse the bin file (eeprom) and populate
+ *               the fruid information in the struct
+ * @bin       : Eeprom binary file
+ * @fruid     : ptr to the struct that holds the fruid information
+ *
+ * returns 0 on success
+ * returns non-zero errno value on error
+ */
+int fruid_parse(const char * bin, fruid_info_t * fruid)
+{
+  const fruid_view_t * view;
+  int ret;
+
+  memset(fruid, 0, sizeof(fruid_info_t));
+
+  view = fruid_view_get(bin, &ret);
+  if (view == NULL)
+    return ret;
+
+  ret = view_to_info(view, fruid);
+  fruid_view_put(view);
+  return ret;
+}
+
+/* Populate the fruid from eeprom dump*/
+int fruid_parse_eeprom(const uint8_t * eeprom, int eeprom_len, fruid_info_t * fruid)
+{
+  fruid_view_t * view;
+  int ret;
+
+  memset(fruid, 0, sizeof(fruid_info_t));
+
+  view = (fruid_view_t *) malloc(sizeof(fruid_view_t));
+  if (view == NULL)
+    return ENOMEM;
+
+  ret = fruid_parse_view(eeprom, eeprom_len, view);
+  if (ret == 0)
+    ret = view_to_info(view, fruid);
 
+  free(view);
   return ret;
 }
 
@@ -300,6 +300,85 @@ typedef struct fruid_info_t {
   } multirecord_smart_fan;
 } fruid_info_t;
 
+/*
+ * One decoded field of a view. str points into the arena of the view
+ * (or at a constant string) and is NUL terminated; len excludes the NUL.
+ * str is NULL for fields that are not present.
+ */
+typedef struct fruid_field_t {
+  const char * str;
+  uint8_t len;
+  uint8_t type_len;
+} fruid_field_t;
+
+#define FRUID_CUSTOM_FIELDS   6
+/* Worst case is every field of every area at the maximum length */
+#define FRUID_VIEW_ARENA_SIZE 4608
+
+/*
+ * Parsed FRU data with all strings kept in a single arena, so a view
+ * is one allocation (or none, when it lives on the stack).
+ */
+typedef struct fruid_view_t {
+  struct {
+    uint8_t flag;
+    uint8_t format_ver;
+    uint16_t area_len;
+    uint8_t type;
+    const char * type_str;
+    fruid_field_t part;
+    fruid_field_t serial;
+    fruid_field_t custom[FRUID_CUSTOM_FIELDS];
+    uint8_t chksum;
+  } chassis;
+  struct {
+    uint8_t flag;
+    uint8_t format_ver;
+    uint16_t area_len;
+    uint8_t lang_code;
+    uint8_t mfg_time[MFG_DATE_TIME_LENGTH];
+    fruid_field_t mfg_time_str;
+    fruid_field_t mfg;
+    fruid_field_t name;
+    fruid_field_t serial;
+    fruid_field_t part;
+    fruid_field_t fruid;
+    fruid_field_t custom[FRUID_CUSTOM_FIELDS];
+    uint8_t chksum;
+  } board;
+  struct {
+    uint8_t flag;
+    uint8_t format_ver;
+    uint16_t area_len;
+    uint8_t lang_code;
+    fruid_field_t mfg;
+    fruid_field_t name;
+    fruid_field_t part;
+    fruid_field_t version;
+    fruid_field_t serial;
+    fruid_field_t asset_tag;
+    fruid_field_t fruid;
+    fruid_field_t custom[FRUID_CUSTOM_FIELDS];
+    uint8_t chksum;
+  } product;
+  struct {
+    uint8_t flag;
+    uint32_t manufacturer_id;
+    fruid_field_t smart_fan_ver;
+    fruid_field_t fw_ver;
+    uint8_t mfg_time[MFG_DATE_TIME_LENGTH];
+    fruid_field_t mfg_time_str;
+    fruid_field_t mfg_line;
+    fruid_field_t clei_code;
+    uint32_t voltage;
+    uint32_t current;
+    uint32_t rpm_front;
+    uint32_t rpm_rear;
+  } multirecord_smart_fan;
+  uint16_t arena_used;
+  char arena[FRUID_VIEW_ARENA_SIZE];
+} fruid_view_t;
+
 /* To hold the different area offsets. */
 typedef struct fruid_eeprom_t {
   uint8_t * header;
@@ -420,6 +499,10 @@ enum {
 int fruid_parse(const char * bin, fruid_info_t * fruid);
 int fruid_parse_eeprom(const uint8_t * eeprom, int eeprom_len, fruid_info_t * fruid);
 void free_fruid_info(fruid_info_t * fruid);
+int fruid_parse_view(const uint8_t * eeprom, int eeprom_len, fruid_view_t * view);
+const fruid_view_t * fruid_view_get(const char * bin, int * err);
+void fruid_view_put(const fruid_view_t * view);
+void fruid_view_cache_flush(void);
 int fruid_modify(const char * cur_bin, const char * new_bin, const char * field, const char * content);
 
 #ifdef __cplusplus
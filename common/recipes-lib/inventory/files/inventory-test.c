@@ -0,0 +1,156 @@
+#include <assert.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <openbmc/ipc.h>
+#include "inventory.h"
+
+#define BIG_ENTRIES 300
+
+static inv_builder_t big;
+static int bump_gen_at = -1;
+static int requests;
+
+static void build_big(void)
+{
+  char key[32], val[64];
+  int i;
+
+  assert(inv_builder_init(&big, 3, INV_FW) == 0);
+  for (i = 0; i < BIG_ENTRIES; i++) {
+    snprintf(key, sizeof(key), "Component %d Version", i);
+    snprintf(val, sizeof(val), "v%d.%d-%0*d", i / 10, i % 10, 20, i);
+    assert(inv_builder_add(&big, key, val) == 0);
+  }
+  assert(big.len > 3 * INV_CHUNK);
+}
+
+/* Serves the big record in chunks, the way inventoryd does */
+static int handle_req(client_t *cli)
+{
+  uint8_t resp[INV_MAX_RESP];
+  inv_resp_hdr_t *hdr = (inv_resp_hdr_t *)resp;
+  static uint32_t gen = 1;
+  inv_req_t req;
+  size_t len = sizeof(req);
+  size_t n = 0;
+
+  if (ipc_recv_req(cli, (uint8_t *)&req, &len, 1) || len != sizeof(req))
+    return -1;
+
+  memset(hdr, 0, sizeof(*hdr));
+  if (requests++ == bump_gen_at)
+    gen++;
+  if (req.cmd == INV_CMD_REFRESH) {
+    hdr->status = req.fru == 3 ? INV_OK : INV_ERR_INVALID;
+  } else if (req.fru != 3) {
+    hdr->status = INV_ERR_PENDING;
+  } else if (req.fmt == INV_FMT_JSON) {
+    const char *json = "{\"a\": \"b\"}";
+    n = strlen(json);
+    hdr->total = n;
+    hdr->gen = gen;
+    memcpy(resp + sizeof(*hdr), json, n);
+  } else {
+    hdr->total = big.len;
+    hdr->gen = gen;
+    hdr->age = 7;
+    if (req.offset < big.len) {
+      n = big.len - req.offset;
+      if (n > INV_CHUNK)
+        n = INV_CHUNK;
+      memcpy(resp + sizeof(*hdr), big.buf + req.offset, n);
+    }
+  }
+  hdr->len = n;
+  return ipc_send_resp(cli, resp, sizeof(*hdr) + n);
+}
+
+static void test_builder(void)
+{
+  inv_builder_t b;
+  inv_record_t rec;
+
+  assert(inv_builder_init(&b, 1, INV_DIMM) == 0);
+  assert(inv_builder_add_line(&b, "DIMM A0 Size: 32 GB \n") == 0);
+  assert(inv_builder_add_line(&b, "FRU: slot1") == 0);
+  assert(inv_builder_add_line(&b, "\n") == 0);
+  assert(inv_builder_add_line(&b, "Speed:") == 0);
+  assert(inv_builder_add_line(&b, "Vendor: ") == 0);
+  assert(inv_builder_add_line(&b, "http://example") == 0);
+  assert(inv_builder_add(&b, "Board Serial ", "  ") == 0);
+  assert(b.count == 6);
+
+  assert(inventory_decode(b.buf, b.len, &rec) == 0);
+  assert(rec.fru == 1 && rec.kind == INV_DIMM && rec.count == 6);
+  assert(!strcmp(rec.entries[0].key, "DIMM A0 Size"));
+  assert(!strcmp(rec.entries[0].value, "32 GB"));
+  assert(!strcmp(rec.entries[1].key, "FRU"));
+  assert(!strcmp(rec.entries[1].value, "slot1"));
+  /* No space after the colon, so not a key/value pair */
+  assert(!strcmp(rec.entries[2].key, "Speed:"));
+  assert(rec.entries[2].value == NULL);
+  assert(!strcmp(rec.entries[3].key, "Vendor"));
+  assert(!strcmp(rec.entries[3].value, ""));
+  assert(!strcmp(rec.entries[4].key, "http://example"));
+  assert(rec.entries[4].value == NULL);
+  assert(!strcmp(rec.entries[5].key, "Board Serial"));
+  assert(!strcmp(rec.entries[5].value, ""));
+  inventory_free(&rec);
+
+  /* Truncated records are rejected */
+  assert(inventory_decode(b.buf, b.len - 1, &rec) != 0);
+  assert(inventory_decode(b.buf, 3, &rec) != 0);
+  inv_builder_free(&b);
+}
+
+static void test_client(void)
+{
+  inv_record_t rec;
+  char *json;
+  char val[64];
+  int i;
+
+  assert(inventory_get(3, INV_FW, &rec) == 0);
+  assert(rec.fru == 3 && rec.kind == INV_FW && rec.age == 7);
+  assert(rec.count == BIG_ENTRIES);
+  for (i = 0; i < BIG_ENTRIES; i++) {
+    snprintf(val, sizeof(val), "v%d.%d-%0*d", i / 10, i % 10, 20, i);
+    assert(!strcmp(rec.entries[i].value, val));
+  }
+  inventory_free(&rec);
+
+  /* The record changes while it is being read */
+  requests = 0;
+  bump_gen_at = 2;
+  assert(inventory_get(3, INV_FW, &rec) == 0);
+  assert(rec.count == BIG_ENTRIES);
+  assert(requests > 4);
+  inventory_free(&rec);
+
+  assert(inventory_get(2, INV_FW, &rec) == INV_ERR_PENDING);
+  assert(inventory_get_json(3, INV_FRUID, &json) == 0);
+  assert(!strcmp(json, "{\"a\": \"b\"}"));
+  free(json);
+
+  assert(inventory_refresh(3) == 0);
+  assert(inventory_refresh(4) == INV_ERR_INVALID);
+}
+
+int main(int argc, char **argv)
+{
+  pthread_t tid;
+
+  test_builder();
+
+  build_big();
+  assert(ipc_start_svc(INVENTORY_ENDPOINT, handle_req, 4, NULL, &tid) == 0);
+  usleep(100 * 1000);
+  test_client();
+  inv_builder_free(&big);
+
+  printf("inventory tests passed\n");
+  return 0;
+}
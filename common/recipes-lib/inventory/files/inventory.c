@@ -0,0 +1,301 @@
+/*
+ * Copyright 2021-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <openbmc/ipc.h>
+#include "inventory.h"
+
+#define REC_HDR_LEN   4
+#define ENTRY_HDR_LEN 3
+#define MAX_RETRIES   3
+
+int inv_builder_init(inv_builder_t *b, uint8_t fru, uint8_t kind)
+{
+  b->size = 512;
+  b->buf = malloc(b->size);
+  if (b->buf == NULL)
+    return -1;
+  b->buf[0] = fru;
+  b->buf[1] = kind;
+  b->buf[2] = b->buf[3] = 0;
+  b->len = REC_HDR_LEN;
+  b->count = 0;
+  return 0;
+}
+
+static int builder_reserve(inv_builder_t *b, size_t len)
+{
+  uint8_t *buf;
+  size_t size = b->size;
+
+  while (b->len + len > size)
+    size *= 2;
+  if (size == b->size)
+    return 0;
+  buf = realloc(b->buf, size);
+  if (buf == NULL)
+    return -1;
+  b->buf = buf;
+  b->size = size;
+  return 0;
+}
+
+static size_t trimmed_len(const char *s, size_t len)
+{
+  while (len > 0 && isspace((unsigned char)s[len - 1]))
+    len--;
+  return len;
+}
+
+static int builder_put(inv_builder_t *b, const char *key, size_t klen,
+                       const char *value, size_t vlen)
+{
+  uint8_t *p;
+
+  if (b->buf == NULL || b->count == 0xffff)
+    return -1;
+  if (klen > 0xff)
+    klen = 0xff;
+  if (value == NULL)
+    vlen = 0;
+  else if (vlen >= INV_NO_VALUE)
+    vlen = INV_NO_VALUE - 1;
+  if (builder_reserve(b, ENTRY_HDR_LEN + klen + vlen))
+    return -1;
+
+  p = b->buf + b->len;
+  p[0] = klen;
+  p[1] = value ? vlen & 0xff : INV_NO_VALUE & 0xff;
+  p[2] = value ? vlen >> 8 : INV_NO_VALUE >> 8;
+  memcpy(p + ENTRY_HDR_LEN, key, klen);
+  if (vlen)
+    memcpy(p + ENTRY_HDR_LEN + klen, value, vlen);
+  b->len += ENTRY_HDR_LEN + klen + vlen;
+  b->count++;
+  b->buf[2] = b->count & 0xff;
+  b->buf[3] = b->count >> 8;
+  return 0;
+}
+
+int inv_builder_add(inv_builder_t *b, const char *key, const char *value)
+{
+  return builder_put(b, key, trimmed_len(key, strlen(key)),
+                     value, value ? trimmed_len(value, strlen(value)) : 0);
+}
+
+int inv_builder_add_line(inv_builder_t *b, const char *line)
+{
+  const char *sep = strstr(line, ": ");
+  size_t len = trimmed_len(line, strlen(line));
+  size_t klen, voff;
+
+  if (len == 0)
+    return 0;
+  if (sep == NULL || (size_t)(sep - line) >= len)
+    return builder_put(b, line, len, NULL, 0);
+  klen = sep - line;
+  voff = klen + 2;
+  return builder_put(b, line, trimmed_len(line, klen),
+                     sep + 2, voff < len ? len - voff : 0);
+}
+
+void inv_builder_free(inv_builder_t *b)
+{
+  free(b->buf);
+  b->buf = NULL;
+  b->len = b->size = 0;
+}
+
+int inventory_decode(const uint8_t *buf, size_t len, inv_record_t *rec)
+{
+  size_t off = REC_HDR_LEN, klen, vlen, slen = 0;
+  int i, count;
+  char *s;
+
+  memset(rec, 0, sizeof(*rec));
+  if (len < REC_HDR_LEN)
+    return -1;
+  count = buf[2] | (buf[3] << 8);
+
+  /* Validate and size the strings first */
+  for (i = 0; i < count; i++) {
+    if (off + ENTRY_HDR_LEN > len)
+      return -1;
+    klen = buf[off];
+    vlen = buf[off + 1] | (buf[off + 2] << 8);
+    off += ENTRY_HDR_LEN;
+    if (vlen == INV_NO_VALUE) {
+      if (off + klen > len)
+        return -1;
+      off += klen;
+      slen += klen + 1;
+    } else {
+      if (off + klen + vlen > len)
+        return -1;
+      off += klen + vlen;
+      slen += klen + vlen + 2;
+    }
+  }
+
+  rec->entries = calloc(count ? count : 1, sizeof(inv_entry_t));
+  rec->strings = malloc(slen ? slen : 1);
+  if (rec->entries == NULL || rec->strings == NULL) {
+    inventory_free(rec);
+    return -1;
+  }
+  rec->fru = buf[0];
+  rec->kind = buf[1];
+  rec->count = count;
+
+  s = rec->strings;
+  off = REC_HDR_LEN;
+  for (i = 0; i < count; i++) {
+    klen = buf[off];
+    vlen = buf[off + 1] | (buf[off + 2] << 8);
+    off += ENTRY_HDR_LEN;
+    memcpy(s, buf + off, klen);
+    s[klen] = '\0';
+    rec->entries[i].key = s;
+    s += klen + 1;
+    off += klen;
+    if (vlen == INV_NO_VALUE)
+      continue;
+    memcpy(s, buf + off, vlen);
+    s[vlen] = '\0';
+    rec->entries[i].value = s;
+    s += vlen + 1;
+    off += vlen;
+  }
+  return 0;
+}
+
+void inventory_free(inv_record_t *rec)
+{
+  free(rec->entries);
+  free(rec->strings);
+  rec->entries = NULL;
+  rec->strings = NULL;
+  rec->count = 0;
+}
+
+/*
+ * Records larger than one IPC message are read in chunks. When the
+ * record is refreshed in between, the generation changes and the read
+ * starts over.
+ */
+static int inventory_fetch(uint8_t fru, uint8_t kind, uint8_t fmt,
+                           uint8_t **data, size_t *data_len, uint32_t *age)
+{
+  uint8_t resp[INV_MAX_RESP];
+  inv_resp_hdr_t *hdr = (inv_resp_hdr_t *)resp;
+  inv_req_t req = {INV_CMD_GET, fru, kind, fmt, 0};
+  uint8_t *buf = NULL;
+  uint32_t gen = 0, total = 0;
+  size_t resp_len;
+  int retry = 0;
+
+  while (1) {
+    resp_len = sizeof(resp);
+    if (ipc_send_req(INVENTORY_ENDPOINT, (uint8_t *)&req, sizeof(req),
+                     resp, &resp_len, INVENTORY_TIMEOUT) ||
+        resp_len < sizeof(*hdr) || resp_len < sizeof(*hdr) + hdr->len) {
+      free(buf);
+      return -1;
+    }
+    if (hdr->status != INV_OK) {
+      free(buf);
+      return hdr->status;
+    }
+
+    if (req.offset == 0) {
+      gen = hdr->gen;
+      total = hdr->total;
+      *age = hdr->age;
+      free(buf);
+      buf = malloc(total + 1);
+      if (buf == NULL)
+        return -1;
+    } else if (hdr->gen != gen || hdr->total != total) {
+      if (++retry >= MAX_RETRIES) {
+        free(buf);
+        return INV_ERR_PENDING;
+      }
+      req.offset = 0;
+      continue;
+    }
+
+    if (req.offset + hdr->len > total) {
+      free(buf);
+      return -1;
+    }
+    memcpy(buf + req.offset, resp + sizeof(*hdr), hdr->len);
+    req.offset += hdr->len;
+    if (req.offset >= total || hdr->len == 0)
+      break;
+  }
+
+  buf[req.offset] = '\0';
+  *data = buf;
+  *data_len = req.offset;
+  return 0;
+}
+
+int inventory_get(uint8_t fru, uint8_t kind, inv_record_t *rec)
+{
+  uint8_t *buf;
+  size_t len;
+  uint32_t age;
+  int ret;
+
+  ret = inventory_fetch(fru, kind, INV_FMT_BIN, &buf, &len, &age);
+  if (ret)
+    return ret;
+  ret = inventory_decode(buf, len, rec);
+  free(buf);
+  if (ret == 0)
+    rec->age = age;
+  return ret;
+}
+
+int inventory_get_json(uint8_t fru, uint8_t kind, char **json)
+{
+  uint8_t *buf;
+  size_t len;
+  uint32_t age;
+  int ret;
+
+  ret = inventory_fetch(fru, kind, INV_FMT_JSON, &buf, &len, &age);
+  if (ret == 0)
+    *json = (char *)buf;
+  return ret;
+}
+
+int inventory_refresh(uint8_t fru)
+{
+  inv_req_t req = {INV_CMD_REFRESH, fru, 0, 0, 0};
+  uint8_t resp[sizeof(inv_resp_hdr_t)];
+  size_t resp_len = sizeof(resp);
+
+  if (ipc_send_req(INVENTORY_ENDPOINT, (uint8_t *)&req, sizeof(req),
+                   resp, &resp_len, INVENTORY_TIMEOUT) ||
+      resp_len < sizeof(inv_resp_hdr_t))
+    return -1;
+  return ((inv_resp_hdr_t *)resp)->status;
+}
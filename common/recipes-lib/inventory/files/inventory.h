@@ -0,0 +1,141 @@
+/*
+ * Copyright 2021-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#ifndef __INVENTORY_H__
+#define __INVENTORY_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Client side of inventoryd, which keeps the FRUID, DIMM and firmware
+ * version data of every FRU in memory. A record is an ordered list of
+ * key/value pairs, the keys being the labels the respective utility
+ * prints (e.g. "Board Serial" or "BMC Version"). Lines which are not
+ * of the "key: value" form are kept as a key without a value.
+ */
+#ifndef INVENTORY_ENDPOINT
+#define INVENTORY_ENDPOINT  "inventoryd"
+#endif
+#define INVENTORY_TIMEOUT   2   /* seconds */
+
+enum {
+  INV_FRUID = 0,
+  INV_DIMM,
+  INV_FW,
+  INV_KINDS
+};
+
+enum {
+  INV_FMT_BIN = 0,
+  INV_FMT_JSON,
+};
+
+enum {
+  INV_CMD_GET = 1,
+  INV_CMD_REFRESH,
+};
+
+/* Response status */
+enum {
+  INV_OK = 0,
+  INV_ERR_PENDING,    /* not gathered yet */
+  INV_ERR_ABSENT,     /* FRU not present, or no such data for it */
+  INV_ERR_INVALID,
+};
+
+/* Value length of a line without a value */
+#define INV_NO_VALUE  0xffff
+
+typedef struct {
+  uint8_t cmd;
+  uint8_t fru;
+  uint8_t kind;
+  uint8_t fmt;
+  uint32_t offset;
+} __attribute__((packed)) inv_req_t;
+
+typedef struct {
+  uint8_t status;
+  uint8_t rsvd;
+  uint16_t len;       /* bytes of data following the header */
+  uint32_t total;     /* size of the whole record */
+  uint32_t gen;       /* changes every time the record is refreshed */
+  uint32_t age;       /* seconds since the record was gathered */
+} __attribute__((packed)) inv_resp_hdr_t;
+
+#define INV_MAX_RESP  4096
+#define INV_CHUNK     (INV_MAX_RESP - sizeof(inv_resp_hdr_t))
+
+/*
+ * Binary form of a record:
+ *   u8 fru, u8 kind, u16 count
+ *   count * { u8 key_len, u16 val_len, key, value }
+ * val_len is INV_NO_VALUE for lines without a value. Strings are not
+ * NUL terminated.
+ */
+typedef struct {
+  const char *key;
+  const char *value;  /* NULL for lines without a value */
+} inv_entry_t;
+
+typedef struct {
+  uint8_t fru;
+  uint8_t kind;
+  uint32_t age;
+  int count;
+  inv_entry_t *entries;
+  char *strings;
+} inv_record_t;
+
+/* Building a record (used by the daemon) */
+typedef struct {
+  uint8_t *buf;
+  size_t len;
+  size_t size;
+  uint16_t count;
+} inv_builder_t;
+
+int inv_builder_init(inv_builder_t *b, uint8_t fru, uint8_t kind);
+int inv_builder_add(inv_builder_t *b, const char *key, const char *value);
+/* Add "key: value" or a plain line, trailing whitespace removed */
+int inv_builder_add_line(inv_builder_t *b, const char *line);
+void inv_builder_free(inv_builder_t *b);
+
+int inventory_decode(const uint8_t *buf, size_t len, inv_record_t *rec);
+void inventory_free(inv_record_t *rec);
+
+/*
+ * Fetch a record from inventoryd. Returns 0, INV_ERR_* when the daemon
+ * has no data, or -1 when it cannot be reached. Callers are expected to
+ * fall back to reading the devices themselves on anything but 0.
+ */
+int inventory_get(uint8_t fru, uint8_t kind, inv_record_t *rec);
+/* Same, as a NUL terminated JSON object which the caller frees */
+int inventory_get_json(uint8_t fru, uint8_t kind, char **json);
+/* Ask inventoryd to gather the data of a FRU again, 0 for all FRUs */
+int inventory_refresh(uint8_t fru);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
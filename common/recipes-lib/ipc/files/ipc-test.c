@@ -1,7 +1,11 @@
 #include <assert.h>
+#include <errno.h>
 #include <string.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include "ipc.h"
 
 char *svc_cookie = "test_cookie";
@@ -32,6 +36,111 @@ int test_handle_req(client_t *cli)
   return 0;
 }
 
+static int last_fd = -1;
+
+/*
+ * Echo handler. The first byte selects a delay in ms, so responses to
+ * concurrent requests come back out of order. 0xff drops the request,
+ * 0xfe answers with more than a frame can carry.
+ */
+int mux_handle_req(client_t *cli)
+{
+  uint8_t req[64];
+  size_t len = sizeof(req);
+
+  if (ipc_recv_req(cli, req, &len, 1) != 0) {
+    return -1;
+  }
+  __atomic_store_n(&last_fd, cli->fd, __ATOMIC_SEQ_CST);
+  if (req[0] == 0xff) {
+    return -1;
+  }
+  if (req[0] == 0xfe) {
+    static uint8_t big[8192];
+    assert(ipc_send_resp(cli, big, sizeof(big)) != 0 && errno == EMSGSIZE);
+    return -1;
+  }
+  usleep(req[0] * 1000);
+  return ipc_send_resp(cli, req, len);
+}
+
+#define MUX_THREADS 8
+#define MUX_REQS 50
+
+void *mux_client(void *arg)
+{
+  uint8_t id = (uint8_t)(uintptr_t)arg;
+  for (int i = 0; i < MUX_REQS; i++) {
+    uint8_t req[8] = {(uint8_t)((id * 7 + i) % 5), id, (uint8_t)i, 0x5a};
+    uint8_t resp[8] = {0};
+    size_t resp_len = sizeof(resp);
+    int rc = ipc_send_req("test_mux", req, 4, resp, &resp_len, 5);
+    assert(rc == 0);
+    assert(resp_len == 4);
+    assert(memcmp(req, resp, 4) == 0);
+  }
+  return NULL;
+}
+
+void test_mux(void)
+{
+  pthread_t tid[MUX_THREADS];
+  uint8_t req[4] = {0, 1, 2, 3};
+  uint8_t resp[8];
+  size_t resp_len = sizeof(resp);
+  struct sockaddr_un addr;
+  int rc, fd, first_fd;
+
+  rc = ipc_start_svc("test_mux", mux_handle_req, 4, NULL, NULL);
+  assert(rc == 0);
+  sleep(1);
+
+  rc = ipc_send_req("test_mux", req, 4, resp, &resp_len, 2);
+  assert(rc == 0 && resp_len == 4);
+  first_fd = __atomic_load_n(&last_fd, __ATOMIC_SEQ_CST);
+  resp_len = sizeof(resp);
+  rc = ipc_send_req("test_mux", req, 4, resp, &resp_len, 2);
+  assert(rc == 0 && resp_len == 4);
+  assert(__atomic_load_n(&last_fd, __ATOMIC_SEQ_CST) == first_fd);
+  printf("PASSED: Connection is reused across requests\n");
+
+  for (int i = 0; i < MUX_THREADS; i++) {
+    rc = pthread_create(&tid[i], NULL, mux_client, (void *)(uintptr_t)i);
+    assert(rc == 0);
+  }
+  for (int i = 0; i < MUX_THREADS; i++) {
+    pthread_join(tid[i], NULL);
+  }
+  printf("PASSED: Concurrent requests on a shared connection\n");
+
+  req[0] = 0xff;
+  resp_len = sizeof(resp);
+  rc = ipc_send_req("test_mux", req, 4, resp, &resp_len, 10);
+  assert(rc == 0 && resp_len == 0);
+  printf("PASSED: Dropped request completes without waiting for timeout\n");
+
+  req[0] = 0xfe;
+  resp_len = sizeof(resp);
+  rc = ipc_send_req("test_mux", req, 4, resp, &resp_len, 10);
+  assert(rc != 0 && errno == EMSGSIZE);
+  printf("PASSED: Oversized response fails the request\n");
+
+  // Raw clients keep using the unframed protocol.
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  assert(fd >= 0);
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, "/tmp/test_mux");
+  rc = connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+  assert(rc == 0);
+  req[0] = 1;
+  assert(send(fd, req, 4, 0) == 4);
+  assert(recv(fd, resp, sizeof(resp), 0) == 4);
+  assert(memcmp(req, resp, 4) == 0);
+  assert(recv(fd, resp, sizeof(resp), 0) == 0);
+  close(fd);
+  printf("PASSED: Unframed request on the original socket\n");
+}
+
 int main(int argc, char *argv[])
 {
   int rc;
@@ -55,5 +164,6 @@ int main(int argc, char *argv[])
     assert(memcmp(req, resp, 4) == 0);
   }
   printf("PASSED: Multiple request\n");
+  test_mux();
   return 0;
 }
@@ -16,13 +16,18 @@
  * along with this program; if not, write to the Free Software
  * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
+#define _GNU_SOURCE
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <syslog.h>
 #include <pthread.h>
 #include <string.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <sys/time.h>
 #include <unistd.h>
@@ -53,8 +58,27 @@
 #define MAX_RETRIES 5
 #define CLIENT_TIMEOUT 16
 
-#define WAIT_CLIENT_RETRIES 5
 #define ACCEPT_RECOVER_RETRIES 5
+#define MAX_EVENTS 16
+
+/*
+ * Every service listens on two sockets:
+ *   /tmp/<endpoint>      one unframed request/response per connection
+ *                        (the original protocol, still used by anything
+ *                        talking to the socket directly).
+ *   /tmp/<endpoint>.mux  persistent connections carrying length-framed
+ *                        messages tagged with a request ID, so one
+ *                        connection can have several outstanding requests.
+ * ipc_send_req() uses the mux socket when it exists and falls back to the
+ * original protocol otherwise.
+ */
+#define MUX_SUFFIX ".mux"
+#define IPC_FRAME_MAGIC 0x31435049 /* "IPC1" */
+#define IPC_MAX_MSG_LEN 4096
+/* The request was dropped by the service without a response */
+#define IPC_FRAME_NO_RESP 0x1
+/* The service failed the request, the payload is the errno (uint32_t) */
+#define IPC_FRAME_ERROR 0x2
 
 #define SAVE_ERRNO_RUN(exp)  \
   do {                       \
@@ -63,13 +87,60 @@
     errno = saved_errno;     \
   } while (0)
 
+typedef struct {
+  uint32_t magic;
+  uint32_t len;
+  uint32_t id;
+  uint32_t flags;
+} ipc_hdr_t;
+
+#define IPC_MAX_FRAME_LEN (sizeof(ipc_hdr_t) + IPC_MAX_MSG_LEN)
+
+enum {
+  EP_LISTEN,
+  EP_LISTEN_MUX,
+  EP_CONN,
+};
+
+/* A persistent (mux) connection accepted by a service. */
+typedef struct svc_conn_s {
+  int type;
+  int fd;
+  int refs;
+  pthread_mutex_t wlock;
+  size_t rx_len;
+  uint8_t rx[IPC_MAX_FRAME_LEN];
+} svc_conn_t;
+
+/*
+ * A request slot. The client_t handed to the handler is embedded, so
+ * the handler API is unchanged while no allocation happens per request.
+ */
+typedef struct ipc_req_s {
+  client_t cli;
+  svc_conn_t *conn;
+  uint32_t id;
+  int done;
+  uint8_t *buf;
+  size_t len;
+  size_t cap;
+  struct ipc_req_s *next;
+} ipc_req_t;
+
 struct service_s {
   ipc_handle_req_t handle_req;
   client_t base_cli;
   pthread_mutex_t mutex;
   pthread_cond_t  cond;
+  pthread_cond_t  free_cond;
   int             num_active;
   int             active_limit;
+  ipc_req_t      *reqs;
+  ipc_req_t      *free_reqs;
+  ipc_req_t      *queue_head;
+  ipc_req_t      *queue_tail;
+  int             listen_type;
+  int             listen_mux_type;
 };
 
 static void set_sock_timeout(int sock, int timeout)
@@ -84,19 +155,431 @@ static void set_sock_timeout(int sock, int timeout)
   }
 }
 
-int ipc_send_req(const char *endpoint, uint8_t *req, size_t req_len,
-                 uint8_t *resp, size_t *resp_len, int timeout)
+static int sock_path(struct sockaddr_un *addr, const char *endpoint, const char *suffix)
+{
+  addr->sun_family = AF_UNIX;
+  snprintf(addr->sun_path, sizeof(addr->sun_path), "/tmp/%s%s", endpoint, suffix);
+  return strlen(addr->sun_path) + sizeof(addr->sun_family);
+}
+
+static int64_t now_ms(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Write the whole frame. The socket may be non-blocking, wait at most
+ * timeout_ms for it to drain.
+ */
+static int send_frame(int fd, uint32_t id, uint32_t flags,
+                      const uint8_t *buf, size_t len, int timeout_ms)
+{
+  ipc_hdr_t hdr = {IPC_FRAME_MAGIC, (uint32_t)len, id, flags};
+  struct iovec iov[2] = {
+    {&hdr, sizeof(hdr)},
+    {(void *)buf, len},
+  };
+  struct msghdr msg;
+  int64_t deadline = now_ms() + timeout_ms;
+  size_t left = sizeof(hdr) + len;
+  ssize_t n;
+
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = len ? 2 : 1;
+  while (left > 0) {
+    n = sendmsg(fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (n < 0) {
+      struct pollfd pfd = {fd, POLLOUT, 0};
+      int wait = (int)(deadline - now_ms());
+      if (errno == EINTR)
+        continue;
+      if ((errno != EAGAIN && errno != EWOULDBLOCK) || wait <= 0)
+        return -1;
+      poll(&pfd, 1, wait);
+      continue;
+    }
+    left -= n;
+    while (n > 0 && msg.msg_iovlen > 0) {
+      if ((size_t)n >= msg.msg_iov->iov_len) {
+        n -= msg.msg_iov->iov_len;
+        msg.msg_iov++;
+        msg.msg_iovlen--;
+      } else {
+        msg.msg_iov->iov_base = (uint8_t *)msg.msg_iov->iov_base + n;
+        msg.msg_iov->iov_len -= n;
+        n = 0;
+      }
+    }
+  }
+  return 0;
+}
+
+/*
+ * Validate the frame at the start of buf. Returns the total frame length
+ * if it is complete, 0 if more data is needed and -1 on a protocol error.
+ */
+static int frame_complete(const uint8_t *buf, size_t len, ipc_hdr_t *hdr)
+{
+  if (len < sizeof(*hdr))
+    return 0;
+  memcpy(hdr, buf, sizeof(*hdr));
+  if (hdr->magic != IPC_FRAME_MAGIC || hdr->len > IPC_MAX_MSG_LEN) {
+    errno = EPROTO;
+    return -1;
+  }
+  if (len < sizeof(*hdr) + hdr->len)
+    return 0;
+  return sizeof(*hdr) + hdr->len;
+}
+
+/*
+ * Client side.
+ *
+ * One persistent connection per endpoint is shared by all threads of the
+ * process. A request registers itself in the pending list, writes its
+ * frame and waits for the response carrying its ID. Whichever waiter
+ * finds nobody reading becomes the reader, and it hands every response it
+ * reads to its owner.
+ */
+typedef struct ipc_pending_s {
+  uint32_t id;
+  uint8_t *resp;
+  size_t max;
+  size_t len;
+  int status;
+  int err;
+  struct ipc_pending_s *next;
+} ipc_pending_t;
+
+typedef struct ipc_conn_s {
+  char endpoint[MAX_ENDPOINT_LEN];
+  int fd;
+  int broken;
+  int reading;
+  int users;
+  uint32_t next_id;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  pthread_mutex_t wlock;
+  ipc_pending_t *pending;
+  size_t rx_len;
+  uint8_t rx[IPC_MAX_FRAME_LEN];
+  struct ipc_conn_s *next;
+} ipc_conn_t;
+
+enum {
+  PENDING_WAIT,
+  PENDING_DONE,
+  PENDING_ERROR,
+};
+
+static pthread_mutex_t conns_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t conns_once = PTHREAD_ONCE_INIT;
+static ipc_conn_t *conns = NULL;
+
+static void conns_prepare(void)
+{
+  pthread_mutex_lock(&conns_mutex);
+}
+
+static void conns_parent(void)
+{
+  pthread_mutex_unlock(&conns_mutex);
+}
+
+/*
+ * A forked child must not share the parent's connections, responses
+ * would be read by whichever process gets to them first.
+ */
+static void conns_child(void)
+{
+  ipc_conn_t *c, *next;
+
+  for (c = conns; c; c = next) {
+    next = c->next;
+    if (c->fd >= 0)
+      close(c->fd);
+    free(c);
+  }
+  conns = NULL;
+  pthread_mutex_init(&conns_mutex, NULL);
+}
+
+static void conns_init(void)
+{
+  pthread_atfork(conns_prepare, conns_parent, conns_child);
+}
+
+static ipc_conn_t *get_conn(const char *endpoint)
+{
+  ipc_conn_t *c;
+  pthread_condattr_t attr;
+
+  pthread_once(&conns_once, conns_init);
+  pthread_mutex_lock(&conns_mutex);
+  for (c = conns; c; c = c->next) {
+    if (!strcmp(c->endpoint, endpoint))
+      goto out;
+  }
+  c = calloc(1, sizeof(*c));
+  if (c) {
+    snprintf(c->endpoint, sizeof(c->endpoint), "%s", endpoint);
+    c->fd = -1;
+    pthread_mutex_init(&c->mutex, NULL);
+    pthread_mutex_init(&c->wlock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&c->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    c->next = conns;
+    conns = c;
+  }
+out:
+  pthread_mutex_unlock(&conns_mutex);
+  return c;
+}
+
+// Called with c->mutex held.
+static int conn_open(ipc_conn_t *c)
 {
   struct sockaddr_un remote;
-  int len, retry = 0, sockfd;
-  size_t max_resp;
+  int len, fd;
 
-  if (!req || !req_len || !resp || !resp_len || !*resp_len) {
-    DEBUG("%s(%s) bad parameters passed", __func__, endpoint);
-    errno = EINVAL;
+  if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1) {
     return -1;
   }
+  len = sock_path(&remote, c->endpoint, MUX_SUFFIX);
+  if (connect(fd, (struct sockaddr *)&remote, len) == -1) {
+    SAVE_ERRNO_RUN(close(fd));
+    return -1;
+  }
+  c->fd = fd;
+  c->broken = 0;
+  c->rx_len = 0;
+  return 0;
+}
+
+// Called with c->mutex held.
+static void conn_close_if_idle(ipc_conn_t *c)
+{
+  if (c->broken && c->users == 0 && c->fd >= 0) {
+    close(c->fd);
+    c->fd = -1;
+    c->broken = 0;
+    c->rx_len = 0;
+  }
+}
+
+// Called with c->mutex held.
+static void conn_fail(ipc_conn_t *c, int err)
+{
+  ipc_pending_t *p;
+
+  c->broken = 1;
+  for (p = c->pending; p; p = p->next) {
+    if (p->status == PENDING_WAIT) {
+      p->status = PENDING_ERROR;
+      p->err = err;
+    }
+  }
+  pthread_cond_broadcast(&c->cond);
+}
+
+// Called with c->mutex held.
+static void conn_dispatch(ipc_conn_t *c)
+{
+  ipc_hdr_t hdr;
+  ipc_pending_t *p;
+  int flen;
+
+  while ((flen = frame_complete(c->rx, c->rx_len, &hdr)) > 0) {
+    for (p = c->pending; p; p = p->next) {
+      if (p->id == hdr.id && p->status == PENDING_WAIT)
+        break;
+    }
+    // Responses nobody waits for any more (timed out) are dropped.
+    if (p && (hdr.flags & IPC_FRAME_ERROR)) {
+      uint32_t err = EIO;
+      if (hdr.len >= sizeof(err))
+        memcpy(&err, c->rx + sizeof(hdr), sizeof(err));
+      p->err = err ? (int)err : EIO;
+      p->status = PENDING_ERROR;
+    } else if (p) {
+      p->len = hdr.len < p->max ? hdr.len : p->max;
+      if (hdr.flags & IPC_FRAME_NO_RESP)
+        p->len = 0;
+      memcpy(p->resp, c->rx + sizeof(hdr), p->len);
+      p->status = PENDING_DONE;
+    }
+    c->rx_len -= flen;
+    memmove(c->rx, c->rx + flen, c->rx_len);
+  }
+  if (flen < 0) {
+    conn_fail(c, errno);
+  }
+  pthread_cond_broadcast(&c->cond);
+}
+
+/*
+ * Read whatever is available, waiting until deadline (-1 for ever).
+ * Called without c->mutex, only by the current reader.
+ */
+static int conn_read(ipc_conn_t *c, int64_t deadline)
+{
+  struct pollfd pfd = {c->fd, POLLIN, 0};
+  int wait, rc;
+  ssize_t n;
+
+  while (1) {
+    wait = -1;
+    if (deadline >= 0) {
+      wait = (int)(deadline - now_ms());
+      if (wait < 0)
+        wait = 0;
+    }
+    rc = poll(&pfd, 1, wait);
+    if (rc < 0 && errno == EINTR)
+      continue;
+    if (rc < 0)
+      return -1;
+    if (rc == 0) {
+      errno = ETIMEDOUT;
+      return -1;
+    }
+    n = recv(c->fd, c->rx + c->rx_len, sizeof(c->rx) - c->rx_len, MSG_DONTWAIT);
+    if (n < 0 && (errno == EINTR || errno == EAGAIN))
+      continue;
+    if (n < 0)
+      return -1;
+    if (n == 0) {
+      errno = ECONNRESET;
+      return -1;
+    }
+    c->rx_len += n;
+    return 0;
+  }
+}
+
+/*
+ * Send a request over the shared connection. Returns 1 if the mux socket
+ * is not available and the caller should fall back to the unframed
+ * protocol.
+ */
+static int mux_send_req(const char *endpoint, uint8_t *req, size_t req_len,
+                        uint8_t *resp, size_t *resp_len, int timeout)
+{
+  ipc_conn_t *c = get_conn(endpoint);
+  ipc_pending_t p, **pp;
+  int64_t deadline = -1;
+  int ret = -1, err = 0, rc, fd;
+  int send_failed = 0;
+
+  if (!c) {
+    return 1;
+  }
+  if (timeout > 0) {
+    deadline = now_ms() + (int64_t)timeout * 1000;
+  }
+
+  pthread_mutex_lock(&c->mutex);
+  if (c->fd < 0 && conn_open(c) != 0) {
+    pthread_mutex_unlock(&c->mutex);
+    return 1;
+  }
+  if (c->broken) {
+    // Still draining a failed connection, use a one-shot one meanwhile.
+    pthread_mutex_unlock(&c->mutex);
+    return 1;
+  }
+  memset(&p, 0, sizeof(p));
+  p.id = c->next_id++;
+  p.resp = resp;
+  p.max = *resp_len;
+  p.status = PENDING_WAIT;
+  p.next = c->pending;
+  c->pending = &p;
+  c->users++;
+  fd = c->fd;
+  pthread_mutex_unlock(&c->mutex);
+
+  pthread_mutex_lock(&c->wlock);
+  rc = send_frame(fd, p.id, 0, req, req_len, CLIENT_TIMEOUT * 1000);
+  err = errno;
+  pthread_mutex_unlock(&c->wlock);
+
+  pthread_mutex_lock(&c->mutex);
+  if (rc != 0) {
+    // Most likely the service restarted, the request was not seen by it.
+    DEBUG("%s(%s) failed to send (%s)", __func__, endpoint, strerror(err));
+    conn_fail(c, err);
+    send_failed = 1;
+  }
+  while (p.status == PENDING_WAIT) {
+    if (!c->reading && !c->broken) {
+      c->reading = 1;
+      pthread_mutex_unlock(&c->mutex);
+      rc = conn_read(c, deadline);
+      err = errno;
+      pthread_mutex_lock(&c->mutex);
+      c->reading = 0;
+      if (rc == 0) {
+        conn_dispatch(c);
+        continue;
+      }
+      pthread_cond_broadcast(&c->cond);
+      if (err == ETIMEDOUT) {
+        break;
+      }
+      DEBUG("%s(%s) failed to recv (%s)", __func__, endpoint, strerror(err));
+      conn_fail(c, err);
+    } else if (deadline < 0) {
+      pthread_cond_wait(&c->cond, &c->mutex);
+    } else {
+      struct timespec ts;
+      ts.tv_sec = deadline / 1000;
+      ts.tv_nsec = (deadline % 1000) * 1000000;
+      if (pthread_cond_timedwait(&c->cond, &c->mutex, &ts) == ETIMEDOUT &&
+          p.status == PENDING_WAIT) {
+        break;
+      }
+    }
+  }
+
+  if (p.status == PENDING_DONE) {
+    *resp_len = p.len;
+    ret = 0;
+  } else if (p.status == PENDING_ERROR) {
+    err = p.err;
+  } else {
+    DEBUG("%s(%s) timed out", __func__, endpoint);
+    err = EAGAIN;
+  }
+  for (pp = &c->pending; *pp; pp = &(*pp)->next) {
+    if (*pp == &p) {
+      *pp = p.next;
+      break;
+    }
+  }
+  c->users--;
+  conn_close_if_idle(c);
+  pthread_mutex_unlock(&c->mutex);
 
+  if (send_failed)
+    return 1;
+  if (ret != 0)
+    errno = err;
+  return ret;
+}
+
+static int oneshot_send_req(const char *endpoint, uint8_t *req, size_t req_len,
+                            uint8_t *resp, size_t *resp_len, int timeout)
+{
+  struct sockaddr_un remote;
+  int len, retry = 0, sockfd;
+  size_t max_resp;
 
   if ((sockfd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
     DEBUG("%s(%s) failed to create socket (%s)", __func__, endpoint, strerror(errno));
@@ -105,15 +588,13 @@ int ipc_send_req(const char *endpoint, uint8_t *req, size_t req_len,
 
   set_sock_timeout(sockfd, timeout);
 
-  remote.sun_family = AF_UNIX;
-  sprintf(remote.sun_path, "/tmp/%s", endpoint);
-  len = strlen(remote.sun_path) + sizeof(remote.sun_family);
+  len = sock_path(&remote, endpoint, "");
 
   if (connect(sockfd, (struct sockaddr *)&remote, len) == -1) {
     DEBUG("%s(%s) failed to connect (%s)", __func__, endpoint, strerror(errno));
     goto error;
   }
-  
+
   if (send(sockfd, req, req_len, MSG_NOSIGNAL) != req_len) {
     DEBUG("%s(%s) failed to send (%s)", __func__, endpoint, strerror(errno));
     goto error;
@@ -139,18 +620,54 @@ error:
   return -1;
 }
 
+int ipc_send_req(const char *endpoint, uint8_t *req, size_t req_len,
+                 uint8_t *resp, size_t *resp_len, int timeout)
+{
+  int ret;
+
+  if (!req || !req_len || !resp || !resp_len || !*resp_len) {
+    DEBUG("%s(%s) bad parameters passed", __func__, endpoint);
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (strlen(endpoint) < MAX_ENDPOINT_LEN && req_len <= IPC_MAX_MSG_LEN) {
+    ret = mux_send_req(endpoint, req, req_len, resp, resp_len, timeout);
+    if (ret <= 0) {
+      return ret;
+    }
+  }
+  return oneshot_send_req(endpoint, req, req_len, resp, resp_len, timeout);
+}
+
+/*
+ * Service side.
+ *
+ * A single thread per service runs an epoll loop accepting connections
+ * and reading frames from the mux connections. Requests are queued to a
+ * fixed pool of max_active workers which run the handler.
+ */
 int ipc_recv_req(client_t *cli, uint8_t *req, size_t *req_len, int timeout)
 {
-  int r;
+  ipc_req_t *r = (ipc_req_t *)cli;
+  int rr;
   int ret = -1;
-  int max = (int)*req_len;
+  int max;
   if (!cli || !req || !req_len || !*req_len) {
     return -1;
   }
+  max = (int)*req_len;
+
+  if (r->conn) {
+    // The request was already read by the service thread.
+    *req_len = r->len < *req_len ? r->len : *req_len;
+    memcpy(req, r->buf, *req_len);
+    return 0;
+  }
 
   set_sock_timeout(cli->fd, timeout);
-  
-  for (r = 0; r < MAX_RETRIES; r++) {
+
+  for (rr = 0; rr < MAX_RETRIES; rr++) {
     int rx_len = recv(cli->fd, req, max, 0);
     if (rx_len >= 0) {
       ret = 0;
@@ -168,26 +685,59 @@ int ipc_recv_req(client_t *cli, uint8_t *req, size_t *req_len, int timeout)
 
 static void cli_done(client_t *cli)
 {
-  service_t *svc = cli->svc;
-  cli->svc = NULL;
-  if (svc) {
+  ipc_req_t *r = (ipc_req_t *)cli;
+
+  if (r->done) {
+    return;
+  }
+  r->done = 1;
+  if (r->conn) {
+    // Let the client fail right away instead of waiting for its timeout.
+    pthread_mutex_lock(&r->conn->wlock);
+    send_frame(r->conn->fd, r->id, IPC_FRAME_NO_RESP, NULL, 0, CLIENT_TIMEOUT * 1000);
+    pthread_mutex_unlock(&r->conn->wlock);
+  } else {
     close(cli->fd);
-    free(cli);
-    pthread_mutex_lock(&svc->mutex);
-    svc->num_active--;
-    pthread_cond_signal(&svc->cond);
-    pthread_mutex_unlock(&svc->mutex);
   }
 }
 
 int ipc_send_resp(client_t *cli, uint8_t *resp, size_t resp_len)
 {
+  ipc_req_t *r = (ipc_req_t *)cli;
   int ret = 0;
   if (!cli || !resp || !resp_len) {
     return -1;
   }
+  if (r->done) {
+    errno = EBADF;
+    return -1;
+  }
+  if (r->conn) {
+    if (resp_len > IPC_MAX_MSG_LEN) {
+      // Fail the request on the client side too, an empty response
+      // would look like success there.
+      uint32_t err = EMSGSIZE;
+      ERROR("%s(%s) response too long (%zu)", __func__, cli->endpoint, resp_len);
+      pthread_mutex_lock(&r->conn->wlock);
+      send_frame(r->conn->fd, r->id, IPC_FRAME_ERROR, (uint8_t *)&err, sizeof(err),
+                 CLIENT_TIMEOUT * 1000);
+      pthread_mutex_unlock(&r->conn->wlock);
+      r->done = 1;
+      errno = EMSGSIZE;
+      return -1;
+    }
+    pthread_mutex_lock(&r->conn->wlock);
+    ret = send_frame(r->conn->fd, r->id, 0, resp, resp_len, CLIENT_TIMEOUT * 1000);
+    pthread_mutex_unlock(&r->conn->wlock);
+    if (ret == 0) {
+      r->done = 1;
+    } else {
+      DEBUG("%s(%s) failed to send (%s)", __func__, cli->endpoint, strerror(errno));
+    }
+    return ret;
+  }
   if (send(cli->fd, resp, resp_len, MSG_NOSIGNAL) < 0) {
-    DEBUG("%s(%s) failed to recv (%s)", __func__, cli->endpoint, strerror(errno));
+    DEBUG("%s(%s) failed to send (%s)", __func__, cli->endpoint, strerror(errno));
     ret = -1;
   } else {
     cli_done(cli);
@@ -195,116 +745,294 @@ int ipc_send_resp(client_t *cli, uint8_t *resp, size_t resp_len)
   return ret;
 }
 
-static void *conn_handler(void *param)
+// Called with svc->mutex held.
+static void svc_conn_put(svc_conn_t *conn)
 {
-  client_t *cli = (client_t *)param;
-  ipc_handle_req_t handle_req = cli->svc->handle_req;
-  if(handle_req(cli)) {
-    cli_done(cli);
+  if (--conn->refs == 0) {
+    close(conn->fd);
+    pthread_mutex_destroy(&conn->wlock);
+    free(conn);
   }
-  pthread_exit(NULL);
-  return NULL;
 }
 
-static client_t *get_client(service_t *svc)
+// Wait for a free request slot, the service thread blocks while all are in use.
+static ipc_req_t *svc_get_req(service_t *svc)
 {
-  client_t *cli = NULL;
-  struct timespec ts;
-  struct timeval tp;
-  int rc;
+  ipc_req_t *r;
 
-  gettimeofday(&tp, NULL);
-  ts.tv_sec = tp.tv_sec + CLIENT_TIMEOUT + 1;
-  ts.tv_nsec = 0;
+  pthread_mutex_lock(&svc->mutex);
+  while (!svc->free_reqs) {
+    pthread_cond_wait(&svc->free_cond, &svc->mutex);
+  }
+  r = svc->free_reqs;
+  svc->free_reqs = r->next;
+  pthread_mutex_unlock(&svc->mutex);
+  r->next = NULL;
+  return r;
+}
 
+static void svc_queue_req(service_t *svc, ipc_req_t *r)
+{
   pthread_mutex_lock(&svc->mutex);
-  while (svc->num_active >= svc->active_limit) {
-    rc = pthread_cond_timedwait(&svc->cond, &svc->mutex, &ts);
-    if (rc == ETIMEDOUT) {
-      break;
-    }
+  if (r->conn) {
+    r->conn->refs++;
   }
-  if (rc != ETIMEDOUT) {
-    cli = calloc(1, sizeof(*cli));
-    if (cli) {
-      svc->num_active++;
-      memcpy(cli, &svc->base_cli, sizeof(*cli));
-    }
+  if (svc->queue_tail) {
+    svc->queue_tail->next = r;
+  } else {
+    svc->queue_head = r;
   }
+  svc->queue_tail = r;
+  pthread_cond_signal(&svc->cond);
   pthread_mutex_unlock(&svc->mutex);
-  return cli;
 }
 
-static void *svc_thread(void *param)
+static void *svc_worker(void *param)
 {
   service_t *svc = (service_t *)param;
-  client_t *base_cli = &svc->base_cli;
-  struct sockaddr_un local, remote;
-  int sock, conn;
-  pthread_attr_t attr;
-  int len;
-  int cli_retries = WAIT_CLIENT_RETRIES;
-  int acc_retries = ACCEPT_RECOVER_RETRIES;
+  ipc_req_t *r;
 
-  pthread_attr_init(&attr);
-  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
-  pthread_attr_setstacksize(&attr, STACK_SIZE);
+  while (1) {
+    pthread_mutex_lock(&svc->mutex);
+    while (!svc->queue_head) {
+      pthread_cond_wait(&svc->cond, &svc->mutex);
+    }
+    r = svc->queue_head;
+    svc->queue_head = r->next;
+    if (!svc->queue_head) {
+      svc->queue_tail = NULL;
+    }
+    svc->num_active++;
+    pthread_mutex_unlock(&svc->mutex);
 
-  if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
-    DEBUG("%s(%s) failed to create socket (%s)", __func__, base_cli->endpoint, strerror(errno));
-    goto bail;
+    strcpy(r->cli.endpoint, svc->base_cli.endpoint);
+    r->cli.svc_cookie = svc->base_cli.svc_cookie;
+    r->cli.svc = svc;
+    if (r->conn) {
+      r->cli.fd = r->conn->fd;
+    }
+    r->done = 0;
+
+    svc->handle_req(&r->cli);
+    cli_done(&r->cli);
+
+    pthread_mutex_lock(&svc->mutex);
+    svc->num_active--;
+    if (r->conn) {
+      svc_conn_put(r->conn);
+      r->conn = NULL;
+    }
+    r->next = svc->free_reqs;
+    svc->free_reqs = r;
+    pthread_cond_signal(&svc->free_cond);
+    pthread_mutex_unlock(&svc->mutex);
   }
+  return NULL;
+}
 
-  local.sun_family = AF_UNIX;
-  sprintf(local.sun_path, "/tmp/%s", base_cli->endpoint);
+static int svc_listen(service_t *svc, const char *suffix)
+{
+  struct sockaddr_un local;
+  int sock, len;
+
+  if ((sock = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) == -1) {
+    DEBUG("%s(%s) failed to create socket (%s)", __func__, svc->base_cli.endpoint, strerror(errno));
+    return -1;
+  }
+
+  len = sock_path(&local, svc->base_cli.endpoint, suffix);
   unlink(local.sun_path);
-  len = strlen(local.sun_path) + sizeof(local.sun_family);
   if (bind(sock, (struct sockaddr *)&local, len) == -1) {
-    DEBUG("%s(%s) failed to bind (%s)", __func__, base_cli->endpoint, strerror(errno));
+    DEBUG("%s(%s) failed to bind (%s)", __func__, svc->base_cli.endpoint, strerror(errno));
     goto close_bail;
   }
 
   if (listen(sock, 5) == -1) {
-    DEBUG("%s(%s) failed to listen (%s)", __func__, base_cli->endpoint, strerror(errno));
+    DEBUG("%s(%s) failed to listen (%s)", __func__, svc->base_cli.endpoint, strerror(errno));
     goto close_bail;
   }
+  return sock;
+
+close_bail:
+  close(sock);
+  return -1;
+}
+
+static void svc_conn_close(service_t *svc, int epfd, svc_conn_t *conn)
+{
+  epoll_ctl(epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+  // Wake up the clients waiting on this connection.
+  shutdown(conn->fd, SHUT_RDWR);
+  pthread_mutex_lock(&svc->mutex);
+  svc_conn_put(conn);
+  pthread_mutex_unlock(&svc->mutex);
+}
+
+static void svc_conn_readable(service_t *svc, int epfd, svc_conn_t *conn)
+{
+  ipc_hdr_t hdr;
+  ipc_req_t *r;
+  ssize_t n;
+  int flen;
 
   while (1) {
-    socklen_t t = sizeof(remote);
-    pthread_t tid;
-    client_t *cli = get_client(svc);
-    if (!cli) {
-      if (--cli_retries <= 0) {
-        CRITICAL("%s(%s) outstanding clients %d exceeded limit %d",
-          __func__, base_cli->endpoint, svc->num_active, svc->active_limit);
-        break;
-      }
-      ERROR("%s(%s) outstanding clients %d exceeded limit %d retrying in 5 seconds",
-        __func__, base_cli->endpoint, svc->num_active, svc->active_limit);
-      sleep(5);
+    n = recv(conn->fd, conn->rx + conn->rx_len, sizeof(conn->rx) - conn->rx_len, MSG_DONTWAIT);
+    if (n < 0 && errno == EINTR) {
       continue;
     }
-    cli_retries = WAIT_CLIENT_RETRIES;
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return;
+    }
+    if (n <= 0) {
+      svc_conn_close(svc, epfd, conn);
+      return;
+    }
+    conn->rx_len += n;
+    while ((flen = frame_complete(conn->rx, conn->rx_len, &hdr)) > 0) {
+      r = svc_get_req(svc);
+      if (r->cap < hdr.len) {
+        uint8_t *buf = realloc(r->buf, hdr.len);
+        if (!buf) {
+          CRITICAL("%s(%s) out of memory", __func__, svc->base_cli.endpoint);
+          pthread_mutex_lock(&svc->mutex);
+          r->next = svc->free_reqs;
+          svc->free_reqs = r;
+          pthread_mutex_unlock(&svc->mutex);
+          svc_conn_close(svc, epfd, conn);
+          return;
+        }
+        r->buf = buf;
+        r->cap = hdr.len;
+      }
+      memcpy(r->buf, conn->rx + sizeof(hdr), hdr.len);
+      r->len = hdr.len;
+      r->id = hdr.id;
+      r->conn = conn;
+      svc_queue_req(svc, r);
+      conn->rx_len -= flen;
+      memmove(conn->rx, conn->rx + flen, conn->rx_len);
+    }
+    if (flen < 0) {
+      ERROR("%s(%s) bad frame, dropping connection", __func__, svc->base_cli.endpoint);
+      svc_conn_close(svc, epfd, conn);
+      return;
+    }
+  }
+}
 
-    while (--acc_retries > 0 && (conn = accept(sock, (struct sockaddr *)&remote, &t)) < 0) {
-      ERROR("%s(%s) failed to accept (%s) retrying in 5 seconds", __func__, base_cli->endpoint, strerror(errno));
-      sleep(5);
+static int svc_accept(service_t *svc, int epfd, int sock, int mux)
+{
+  struct sockaddr_un remote;
+  socklen_t t = sizeof(remote);
+  struct epoll_event ev;
+  svc_conn_t *conn;
+  ipc_req_t *r;
+  int fd;
+
+  while (1) {
+    fd = accept4(sock, (struct sockaddr *)&remote, &t,
+                 SOCK_CLOEXEC | (mux ? SOCK_NONBLOCK : 0));
+    if (fd < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return 0;
+      }
+      return -1;
+    }
+    if (!mux) {
+      r = svc_get_req(svc);
+      r->conn = NULL;
+      r->cli.fd = fd;
+      svc_queue_req(svc, r);
       continue;
     }
-    if (acc_retries <= 0 || conn < 0) {
-      CRITICAL("%s(%s) failed to accept (%s) retrying in 5 seconds", __func__, base_cli->endpoint, strerror(errno));
-      cli_done(cli);
+    conn = calloc(1, sizeof(*conn));
+    if (!conn) {
+      close(fd);
+      continue;
+    }
+    conn->type = EP_CONN;
+    conn->fd = fd;
+    conn->refs = 1;
+    pthread_mutex_init(&conn->wlock, NULL);
+    ev.events = EPOLLIN;
+    ev.data.ptr = conn;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+      ERROR("%s(%s) failed to add connection (%s)", __func__, svc->base_cli.endpoint, strerror(errno));
+      close(fd);
+      pthread_mutex_destroy(&conn->wlock);
+      free(conn);
+    }
+  }
+}
+
+static void *svc_thread(void *param)
+{
+  service_t *svc = (service_t *)param;
+  client_t *base_cli = &svc->base_cli;
+  struct epoll_event ev, events[MAX_EVENTS];
+  int sock, mux_sock, epfd = -1;
+  int acc_retries = ACCEPT_RECOVER_RETRIES;
+  int i, n;
+
+  if ((sock = svc_listen(svc, "")) < 0) {
+    goto bail;
+  }
+  mux_sock = svc_listen(svc, MUX_SUFFIX);
+  if (mux_sock < 0) {
+    ERROR("%s(%s) serving unframed requests only", __func__, base_cli->endpoint);
+  }
+
+  if ((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+    DEBUG("%s(%s) failed to create epoll (%s)", __func__, base_cli->endpoint, strerror(errno));
+    goto close_bail;
+  }
+  ev.events = EPOLLIN;
+  ev.data.ptr = &svc->listen_type;
+  epoll_ctl(epfd, EPOLL_CTL_ADD, sock, &ev);
+  if (mux_sock >= 0) {
+    ev.data.ptr = &svc->listen_mux_type;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, mux_sock, &ev);
+  }
+
+  while (1) {
+    n = epoll_wait(epfd, events, MAX_EVENTS, -1);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      CRITICAL("%s(%s) epoll_wait failed (%s)", __func__, base_cli->endpoint, strerror(errno));
       break;
     }
-    acc_retries = ACCEPT_RECOVER_RETRIES;
-    cli->fd = conn;
-    if (pthread_create(&tid, &attr, conn_handler, (void *)cli)) {
-      CRITICAL("%s(%s) failed to create thread (%s)", __func__, base_cli->endpoint, strerror(errno));
-      cli_done(cli);
+    for (i = 0; i < n; i++) {
+      int type = *(int *)events[i].data.ptr;
+      if (type == EP_CONN) {
+        svc_conn_readable(svc, epfd, (svc_conn_t *)events[i].data.ptr);
+        continue;
+      }
+      if (svc_accept(svc, epfd, type == EP_LISTEN ? sock : mux_sock,
+                     type == EP_LISTEN_MUX) == 0) {
+        acc_retries = ACCEPT_RECOVER_RETRIES;
+        continue;
+      }
+      if (--acc_retries <= 0) {
+        CRITICAL("%s(%s) failed to accept (%s)", __func__, base_cli->endpoint, strerror(errno));
+        goto close_bail;
+      }
+      ERROR("%s(%s) failed to accept (%s) retrying in 5 seconds", __func__, base_cli->endpoint, strerror(errno));
+      sleep(5);
     }
   }
 close_bail:
+  if (epfd >= 0) {
+    close(epfd);
+  }
   close(sock);
+  if (mux_sock >= 0) {
+    close(mux_sock);
+  }
 bail:
   pthread_exit(NULL);
   return NULL;
@@ -315,9 +1043,10 @@ int ipc_start_svc(const char *endpoint, ipc_handle_req_t handle_req, int max_act
   pthread_t tid;
   pthread_attr_t attr;
   int ret = 0;
+  int i, num_reqs;
   service_t *svc;
 
-  if (strlen(endpoint) >= MAX_ENDPOINT_LEN - 1) {
+  if (strlen(endpoint) >= MAX_ENDPOINT_LEN - 1 || max_active <= 0) {
     return -1;
   }
 
@@ -326,15 +1055,45 @@ int ipc_start_svc(const char *endpoint, ipc_handle_req_t handle_req, int max_act
     return -1;
   }
 
+  // Allow one queued request per active one.
+  num_reqs = max_active * 2;
+  svc->reqs = calloc(num_reqs, sizeof(ipc_req_t));
+  if (!svc->reqs) {
+    free(svc);
+    return -1;
+  }
+  for (i = 0; i < num_reqs; i++) {
+    svc->reqs[i].next = svc->free_reqs;
+    svc->free_reqs = &svc->reqs[i];
+  }
+
   strcpy(svc->base_cli.endpoint, endpoint);
   svc->base_cli.svc_cookie = svc_cookie;
   svc->base_cli.fd = -1;
   svc->handle_req = handle_req;
   pthread_mutex_init(&svc->mutex, NULL);
   pthread_cond_init(&svc->cond, NULL);
+  pthread_cond_init(&svc->free_cond, NULL);
   svc->base_cli.svc = svc;
   svc->num_active = 0;
   svc->active_limit = max_active;
+  svc->listen_type = EP_LISTEN;
+  svc->listen_mux_type = EP_LISTEN_MUX;
+
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  pthread_attr_setstacksize(&attr, STACK_SIZE);
+  for (i = 0; i < max_active; i++) {
+    if (pthread_create(&tid, &attr, svc_worker, svc)) {
+      CRITICAL("%s(%s) failed to create worker (%s)", __func__, endpoint, strerror(errno));
+      break;
+    }
+  }
+  pthread_attr_destroy(&attr);
+  if (i == 0) {
+    // Workers never exit, the service is leaked on partial failure.
+    return -1;
+  }
 
   pthread_attr_init(&attr);
   if (!waiter)
@@ -342,7 +1101,6 @@ int ipc_start_svc(const char *endpoint, ipc_handle_req_t handle_req, int max_act
 
   if (pthread_create(&tid, &attr, svc_thread, svc)) {
       DEBUG("%s(%s) failed to start thread (%s)", __func__, endpoint, strerror(errno));
-      free(svc);
       ret = -1;
   }
   pthread_attr_destroy(&attr);
@@ -4,6 +4,10 @@
 #include <stdlib.h>
 #include <pthread.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #define MAX_ENDPOINT_LEN 32
 
 struct client_s;
@@ -26,4 +30,8 @@ int ipc_recv_req(client_t *cli, uint8_t *req, size_t *req_len, int timeout);
 int ipc_send_resp(client_t *cli, uint8_t *resp, size_t resp_len);
 int ipc_start_svc(const char *endpoint, ipc_handle_req_t handle_req, int max_active, void *cookie, pthread_t *waiter);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
@@ -1,6 +1,7 @@
 /* SPDX-License-Identifier: GPL-2.0-or-later
  * Copyright 2020-present Facebook. All Rights Reserved.
  */
+#include <array>
 #include <iostream>
 #include <limits>
 #include <unistd.h>
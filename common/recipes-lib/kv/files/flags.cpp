@@ -0,0 +1,294 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later
+ * Copyright 2021-present Facebook. All Rights Reserved.
+ */
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sched.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <climits>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "flags.hpp"
+#include "kv.hpp"
+#include "log.hpp"
+
+namespace kv
+{
+
+#ifndef __TEST__
+constexpr auto flags_shm_name = "kv_flags";
+#else
+constexpr auto flags_shm_name = "kv_flags_test";
+#endif
+
+enum : uint32_t { shm_uninit = 0, shm_initializing, shm_ready };
+
+// Yields to wait for another process to set up the segment
+constexpr int init_wait = 1000;
+
+static flags_shm* flags_open() {
+  flags_shm* shm;
+  pthread_mutexattr_t attr;
+  uint32_t state = shm_uninit;
+  int fd;
+
+  fd = shm_open(flags_shm_name, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+  if (fd < 0) {
+    KV_WARN("kv flags: shm_open failed, errno %d", errno);
+    return nullptr;
+  }
+  // Growing to the same size is harmless when racing with another process
+  if (ftruncate(fd, sizeof(*shm)) != 0) {
+    close(fd);
+    return nullptr;
+  }
+  shm = static_cast<flags_shm*>(mmap(nullptr, sizeof(*shm),
+        PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+  close(fd);
+  if (shm == MAP_FAILED) {
+    return nullptr;
+  }
+
+  if (__atomic_compare_exchange_n(&shm->state, &state, shm_initializing,
+        false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&shm->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    __atomic_store_n(&shm->state, shm_ready, __ATOMIC_RELEASE);
+    return shm;
+  }
+  // Whoever set it up died half way if this takes long, use kv then
+  for (int i = 0; state != shm_ready && i < init_wait; i++) {
+    sched_yield();
+    state = __atomic_load_n(&shm->state, __ATOMIC_ACQUIRE);
+  }
+  if (state != shm_ready) {
+    munmap(shm, sizeof(*shm));
+    return nullptr;
+  }
+  return shm;
+}
+
+flags_shm* flags_map() {
+  static flags_shm* shm = flags_open();
+  return shm;
+}
+
+static bool flags_lock(flags_shm* shm) {
+  int ret = pthread_mutex_lock(&shm->lock);
+
+  // Slots are only ever filled in, so there is nothing to repair
+  if (ret == EOWNERDEAD) {
+    ret = pthread_mutex_consistent(&shm->lock);
+  }
+  return ret == 0;
+}
+
+static uint32_t flag_hash(const char* name) {
+  uint32_t h = 2166136261u;
+
+  while (*name) {
+    h = (h ^ (uint8_t)*name++) * 16777619u;
+  }
+  return h;
+}
+
+// Slot of name if it was registered, lock-free
+static flag_slot* flag_find(flags_shm* shm, const char* name) {
+  uint32_t idx = flag_hash(name) % max_flags;
+
+  for (unsigned i = 0; i < max_flags; i++) {
+    flag_slot* slot = &shm->slots[(idx + i) % max_flags];
+    if (__atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) == flag_free) {
+      break;
+    }
+    if (!strcmp(slot->name, name)) {
+      return slot;
+    }
+  }
+  return nullptr;
+}
+
+// Publish a new value and wake the waiters of the slot
+static void flag_publish(flag_slot* slot, int32_t value) {
+  __atomic_store_n(&slot->value, value, __ATOMIC_RELEASE);
+  __atomic_add_fetch(&slot->seq, 1, __ATOMIC_RELEASE);
+  syscall(SYS_futex, &slot->seq, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+static int32_t flag_read(const std::string& key) {
+  try {
+    return strtol(get(key, region::temp).c_str(), nullptr, 10);
+  } catch (std::exception& e) {
+    return 0;
+  }
+}
+
+/*
+ * Register name, with the lock held. The slot is made visible to writers
+ * before the key is read, so a write racing with this either lands
+ * before the read or refreshes the slot after us.
+ */
+static flag_slot* flag_register(flags_shm* shm, const char* name) {
+  uint32_t idx = flag_hash(name) % max_flags;
+  flag_slot* slot = nullptr;
+
+  for (unsigned i = 0; i < max_flags; i++) {
+    flag_slot* s = &shm->slots[(idx + i) % max_flags];
+    if (__atomic_load_n(&s->state, __ATOMIC_RELAXED) == flag_free) {
+      slot = s;
+      strcpy(slot->name, name);
+      __atomic_store_n(&slot->state, flag_registering, __ATOMIC_RELEASE);
+      break;
+    }
+    // Registered meanwhile, or left half way by a process which died
+    if (!strcmp(s->name, name)) {
+      slot = s;
+      break;
+    }
+  }
+  if (slot == nullptr) {
+    static bool warned = false;
+    if (!warned) {
+      KV_WARN("kv flags: no slot left for %s, reading it from kv", name);
+      warned = true;
+    }
+    return nullptr;
+  }
+  flag_publish(slot, flag_read(name));
+  __atomic_store_n(&slot->state, flag_ready, __ATOMIC_RELEASE);
+  return slot;
+}
+
+void flag_refresh(const std::string& key) {
+  flags_shm* shm = flags_map();
+  flag_slot* slot;
+
+  if (shm == nullptr || key.size() >= MAX_KEY_LEN ||
+      (slot = flag_find(shm, key.c_str())) == nullptr) {
+    return;
+  }
+  // Read back under the lock, so the last writer to get here leaves the
+  // value of the last write
+  if (flags_lock(shm)) {
+    flag_publish(slot, flag_read(key));
+    pthread_mutex_unlock(&shm->lock);
+  }
+}
+
+} // namespace kv
+
+using namespace kv;
+
+// Registered slot of key, nullptr if the mirror cannot hold it
+static flag_slot* flag_slot_of(const char* key) {
+  flags_shm* shm = flags_map();
+  flag_slot* slot;
+
+  if (shm == nullptr) {
+    return nullptr;
+  }
+  slot = flag_find(shm, key);
+  if (slot == nullptr || __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) != flag_ready) {
+    slot = nullptr;
+    if (flags_lock(shm)) {
+      slot = flag_register(shm, key);
+      pthread_mutex_unlock(&shm->lock);
+    }
+  }
+  return slot;
+}
+
+static int64_t flag_now_ms() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+*  get the integer value of a regular key from the shared memory mirror,
+*      registering the key with it on first use.
+*  A missing or non-numeric key reads as 0.
+*
+*  return 0 on success, negative error code on failure.
+*/
+int kv_flag_get(const char *key, int32_t *value) {
+  flag_slot* slot;
+
+  if (key == nullptr || value == nullptr || strlen(key) >= MAX_KEY_LEN) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  slot = flag_slot_of(key);
+  if (slot != nullptr) {
+    *value = __atomic_load_n(&slot->value, __ATOMIC_ACQUIRE);
+    return 0;
+  }
+  *value = flag_read(key);
+  return 0;
+}
+
+/*
+*  wait for the integer value of a regular key to differ from *value.
+*  timeout_ms < 0 waits forever.
+*  Keys the mirror cannot hold are polled from kv once a second.
+*
+*  return 0 with *value updated on a change,
+*      negative error code with errno ETIMEDOUT on timeout.
+*/
+int kv_flag_wait(const char *key, int32_t *value, int timeout_ms) {
+  int64_t deadline = flag_now_ms() + timeout_ms, left;
+  struct timespec ts, *tsp;
+  flag_slot* slot;
+  uint32_t seq;
+  int32_t cur;
+
+  if (key == nullptr || value == nullptr || strlen(key) >= MAX_KEY_LEN) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  slot = flag_slot_of(key);
+  while (true) {
+    // Sample the counter first, so a change after the read wakes us
+    if (slot != nullptr) {
+      seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+      cur = __atomic_load_n(&slot->value, __ATOMIC_ACQUIRE);
+    } else {
+      cur = flag_read(key);
+    }
+    if (cur != *value) {
+      *value = cur;
+      return 0;
+    }
+
+    left = deadline - flag_now_ms();
+    if (timeout_ms >= 0 && left <= 0) {
+      errno = ETIMEDOUT;
+      return -1;
+    }
+    if (slot == nullptr) {
+      usleep((timeout_ms < 0 || left > 1000 ? 1000 : left) * 1000);
+      continue;
+    }
+    tsp = nullptr;
+    if (timeout_ms >= 0) {
+      ts.tv_sec = left / 1000;
+      ts.tv_nsec = (left % 1000) * 1000000;
+      tsp = &ts;
+    }
+    // Shared between processes, so no FUTEX_PRIVATE_FLAG
+    syscall(SYS_futex, &slot->seq, FUTEX_WAIT, seq, tsp, nullptr, 0);
+  }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+/* SPDX-License-Identifier: GPL-2.0-or-later
+ * Copyright 2021-present Facebook. All Rights Reserved.
+ */
+
+/*
+ * Shared memory mirror of the integer value of regular keys, for the
+ * flags daemons poll such as "fru1_fwupd". A key is mirrored once it is
+ * read with kv_flag_get(); from then on kv::set() and kv::del() of the
+ * key refresh the mirror, so writers need not know about it.
+ *
+ * Registering and refreshing a key take a robust process shared mutex,
+ * so a process dying with it held does not block the others. Reading a
+ * registered key takes no lock and no syscall. Each refresh bumps the
+ * slot's change counter, which kv_flag_wait() sleeps on as a futex.
+ */
+#include <pthread.h>
+#include <string>
+#include "kv.h"
+
+namespace kv
+{
+
+static constexpr unsigned max_flags = 128;
+
+enum flag_state : uint32_t {
+  flag_free = 0,
+  flag_registering,     // name set, value not read yet
+  flag_ready,
+};
+
+// 32-bit fields only, 64-bit atomics are not lock-free on all BMCs
+struct flag_slot {
+  uint32_t state;
+  int32_t value;
+  uint32_t seq;         // bumped after each refresh of value
+  char name[MAX_KEY_LEN];
+};
+
+// An all-zero segment is not initialized yet
+struct flags_shm {
+  uint32_t state;
+  pthread_mutex_t lock;
+  flag_slot slots[max_flags];
+};
+
+// The mapped segment, nullptr if it cannot be used
+flags_shm* flags_map();
+
+// Called after a regular key was written or removed
+void flag_refresh(const std::string& key);
+
+} // namespace kv
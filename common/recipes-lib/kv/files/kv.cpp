@@ -8,6 +8,7 @@
 
 #include "kv.hpp"
 #include "fileops.hpp"
+#include "flags.hpp"
 #include "log.hpp"
 
 using namespace kv;
@@ -149,21 +150,28 @@ void set(const std::string& key, const std::string& value,
          region r, bool require_create)
 {
 
-  FileHandle fp;
-  fp.open_and_lock<FileHandle::access::write>(key, r);
+  {
+    FileHandle fp;
+    fp.open_and_lock<FileHandle::access::write>(key, r);
 
 
-  if (fp.was_present() && require_create) {
-    throw key_already_exists("kv_set: key " + key + " already exists");
-  }
+    if (fp.was_present() && require_create) {
+      throw key_already_exists("kv_set: key " + key + " already exists");
+    }
 
-  // Check if we are writing the same value. If so, exit early
-  // to save on number of times flash is updated.
-  if (fp.was_present() && r == region::persist && (fp.read() == value)) {
-    return;
+    // Check if we are writing the same value. If so, exit early
+    // to save on number of times flash is updated.
+    if (fp.was_present() && r == region::persist && (fp.read() == value)) {
+      return;
+    }
+
+    fp.write(value);
   }
 
-  fp.write(value);
+  // After unlocking, the mirror reads the key back
+  if (r == region::temp) {
+    flag_refresh(key);
+  }
 }
 
 std::string get(const std::string& key, region r)
@@ -177,6 +185,9 @@ std::string get(const std::string& key, region r)
 void del(const std::string& key, region r)
 {
   FileHandle::remove(key, r);
+  if (r == region::temp) {
+    flag_refresh(key);
+  }
 }
 
 
@@ -30,6 +30,15 @@ int kv_get(const char *key, char *value, size_t *len, unsigned int flags);
 int kv_set(const char *key, const char *value, size_t len, unsigned int flags);
 int kv_del(const char *key, unsigned int flags);
 
+/* Integer value of a regular key, from a shared memory mirror which
+ * kv_set() and kv_del() keep up to date, so polling it costs no syscall.
+ * A missing key reads as 0. */
+int kv_flag_get(const char *key, int32_t *value);
+
+/* Sleep until the flag no longer reads *value, or for timeout_ms (< 0 for
+ * ever). Returns 0 with *value updated, or -1 with errno ETIMEDOUT. */
+int kv_flag_wait(const char *key, int32_t *value, int timeout_ms);
+
 #ifdef __cplusplus
 }
 #endif
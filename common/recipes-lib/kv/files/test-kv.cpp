@@ -4,13 +4,20 @@
 
 #include <array>
 #include <cassert>
+#include <cerrno>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 #include "kv.hpp"
+#include "flags.hpp"
 
 int main(int argc, char *argv[])
 {
   char value[MAX_VALUE_LEN*2];
   size_t len;
+  int32_t flag;
+
+  shm_unlink("kv_flags_test");
 
   assert(kv_get("test1", value, NULL, KV_FPERSIST) != 0);
   printf("SUCCESS: Non-existent file results in error.\n");
@@ -122,6 +129,70 @@ int main(int argc, char *argv[])
     printf("SUCCESS: Read and write using C++ interface.\n");
   }
 
+  assert(kv_flag_get("flag1", &flag) == 0 && flag == 0);
+  printf("SUCCESS: Missing flag reads as 0\n");
+  assert(kv_set("flag1", "5", 0, 0) == 0);
+  assert(kv_flag_get("flag1", &flag) == 0 && flag == 5);
+  printf("SUCCESS: Flag follows kv_set\n");
+  kv::set("flag1", "9");
+  assert(kv_flag_get("flag1", &flag) == 0 && flag == 9);
+  printf("SUCCESS: Flag follows the C++ interface\n");
+  assert(kv_del("flag1", 0) == 0);
+  assert(kv_flag_get("flag1", &flag) == 0 && flag == 0);
+  printf("SUCCESS: Flag follows kv_del\n");
+  assert(kv_set("flag2", "-7", 0, 0) == 0);
+  assert(kv_flag_get("flag2", &flag) == 0 && flag == -7);
+  printf("SUCCESS: Flag is seeded from its key\n");
+  assert(kv_set("flag2", "3", 0, KV_FPERSIST) == 0);
+  assert(kv_flag_get("flag2", &flag) == 0 && flag == -7);
+  printf("SUCCESS: Persistent key of the same name leaves the flag alone\n");
+
+  {
+    pid_t pid = fork();
+
+    assert(pid >= 0);
+    if (pid == 0) {
+      // Die holding the lock
+      pthread_mutex_lock(&kv::flags_map()->lock);
+      _exit(0);
+    }
+    assert(waitpid(pid, nullptr, 0) == pid);
+    assert(kv_set("flag3", "3", 0, 0) == 0);
+    assert(kv_flag_get("flag3", &flag) == 0 && flag == 3);
+    assert(kv_set("flag3", "4", 0, 0) == 0);
+    assert(kv_flag_get("flag3", &flag) == 0 && flag == 4);
+    printf("SUCCESS: Flags work after a process died holding the lock\n");
+  }
+
+  {
+    pid_t pid = fork();
+
+    assert(pid >= 0);
+    if (pid == 0) {
+      usleep(100000);
+      kv_set("flag4", "1", 0, 0);
+      _exit(0);
+    }
+    flag = 0;
+    assert(kv_flag_wait("flag4", &flag, 5000) == 0 && flag == 1);
+    assert(waitpid(pid, nullptr, 0) == pid);
+    printf("SUCCESS: Flag wait wakes up on a write from another process\n");
+    assert(kv_flag_wait("flag4", &flag, 100) != 0 && errno == ETIMEDOUT);
+    assert(flag == 1);
+    printf("SUCCESS: Flag wait times out when the flag does not change\n");
+  }
+
+  for (int i = 0; i < (int)kv::max_flags + 1; i++) {
+    std::string key = "flag_fill" + std::to_string(i);
+    kv::set(key, std::to_string(i));
+    assert(kv_flag_get(key.c_str(), &flag) == 0 && flag == i);
+  }
+  printf("SUCCESS: Flags beyond the mirror are read from kv\n");
+  flag = 0;
+  assert(kv_flag_wait("flag_fill128", &flag, 100) == 0 && flag == 128);
+  printf("SUCCESS: Flag wait works beyond the mirror\n");
+
+  shm_unlink("kv_flags_test");
   assert(system("rm -rf ./test") == 0);
 
   return 0;
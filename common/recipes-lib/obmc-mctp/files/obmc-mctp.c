@@ -25,6 +25,10 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <syslog.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
 #include <libmctp-alloc.h>
 #include <libmctp-log.h>
 #include "obmc-mctp.h"
@@ -32,8 +36,22 @@
 //#define DEBUG
 #define SYSFS_SLAVE_QUEUE "/sys/bus/i2c/devices/%d-10%02x/slave-mqueue"
 
+#define RX_TIMEOUT_MS (6 * 1000)
+// Upper bound of one wait, in case the slave queue never signals
+#define RX_POLL_SLICE_MS 50
+
+// Parameters of the most recent binding, used by mctp_smbus_send_data()
 struct mctp_smbus_pkt_private *smbus_extra_params = NULL;
 
+// Open bindings, to find the slave queue of an SMBus binding
+static pthread_mutex_t bindings_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct obmc_mctp_binding *bindings = NULL;
+
+struct rx_ctx {
+  void *data;
+  bool received;
+};
+
 // TODO:
 //      Migrate this library to C++ if BMC need to support MCTP over PCIe
 
@@ -47,7 +65,8 @@ static void rx_handler(uint8_t eid, void *data, void *msg, size_t len,
 {
   // TODO:
   //    We should send device the response according to the EID
-  struct obmc_mctp_hdr *p = (struct obmc_mctp_hdr *)data;
+  struct rx_ctx *ctx = (struct rx_ctx *)data;
+  struct obmc_mctp_hdr *p = (struct obmc_mctp_hdr *)ctx->data;
 
   if (tag_owner)
     p->flag_tag |= MCTP_HDR_FLAG_TO;
@@ -55,6 +74,114 @@ static void rx_handler(uint8_t eid, void *data, void *msg, size_t len,
 
   p->Msg_Size = len;
   memcpy(&p->Msg_Type, msg, len);
+  ctx->received = true;
+}
+
+static int64_t now_ms(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void register_binding(struct obmc_mctp_binding *binding)
+{
+  pthread_mutex_lock(&bindings_lock);
+  binding->next = bindings;
+  bindings = binding;
+  pthread_mutex_unlock(&bindings_lock);
+}
+
+static void unregister_binding(struct obmc_mctp_binding *binding)
+{
+  struct obmc_mctp_binding **pp;
+
+  pthread_mutex_lock(&bindings_lock);
+  for (pp = &bindings; *pp; pp = &(*pp)->next) {
+    if (*pp == binding) {
+      *pp = binding->next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&bindings_lock);
+}
+
+static int smbus_rx_fd(struct mctp_binding_smbus *smbus)
+{
+  struct obmc_mctp_binding *b;
+  int fd = -1;
+
+  pthread_mutex_lock(&bindings_lock);
+  for (b = bindings; b; b = b->next) {
+    if (b->prot == smbus) {
+      fd = b->rx_fd;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&bindings_lock);
+  return fd;
+}
+
+/*
+ * The slave mqueue driver notifies its sysfs file on every message it
+ * queues, so block in poll() instead of reading it in a sleep loop.
+ */
+static int rx_fd_wait(int fd, int timeout_ms)
+{
+  struct pollfd pfd = {.fd = fd, .events = POLLPRI};
+  int ret;
+
+  if (timeout_ms > RX_POLL_SLICE_MS)
+    timeout_ms = RX_POLL_SLICE_MS;
+  if (fd < 0) {
+    usleep(timeout_ms * 1000);
+    return 0;
+  }
+  ret = poll(&pfd, 1, timeout_ms);
+  if (ret < 0 && errno != EINTR)
+    return -1;
+  return ret > 0 ? 1 : 0;
+}
+
+int obmc_mctp_smbus_wait(struct obmc_mctp_binding *binding, int timeout_ms)
+{
+  return rx_fd_wait(binding->rx_fd, timeout_ms);
+}
+
+// Read packets until handler got a whole message or the time is up
+static int smbus_recv_timeout(struct mctp *mctp,
+                              struct mctp_binding_smbus *smbus,
+                              mctp_rx_fn handler, void *data, int timeout_ms)
+{
+  struct rx_ctx ctx = {data, false};
+  int64_t deadline = now_ms() + timeout_ms;
+  int fd = smbus_rx_fd(smbus);
+  int64_t left;
+  int ret = -1;
+
+  mctp_set_rx_all(mctp, handler, &ctx);
+  while (1) {
+    if (mctp_smbus_read(smbus) < 0) {
+      syslog(LOG_ERR, "%s: MCTP RX error", __func__);
+      break;
+    }
+    if (ctx.received) {
+      ret = 0;
+      break;
+    }
+    left = deadline - now_ms();
+    if (left <= 0) {
+      syslog(LOG_ERR, "%s: MCTP timeout", __func__);
+      break;
+    }
+    if (rx_fd_wait(fd, left) < 0) {
+      syslog(LOG_ERR, "%s: poll failed, errno = %d", __func__, errno);
+      break;
+    }
+  }
+  mctp_set_rx_all(mctp, NULL, NULL);
+  return ret;
 }
 
 struct obmc_mctp_binding* obmc_mctp_smbus_init(uint8_t bus, uint8_t src_addr, uint8_t dst_addr, uint8_t src_eid,
@@ -67,11 +194,12 @@ struct obmc_mctp_binding* obmc_mctp_smbus_init(uint8_t bus, uint8_t src_addr, ui
   struct mctp_binding_smbus *smbus;
   struct obmc_mctp_binding *mctp_binding;
 
-  mctp_binding = (struct obmc_mctp_binding *)malloc(sizeof(struct obmc_mctp_binding));
+  mctp_binding = (struct obmc_mctp_binding *)calloc(1, sizeof(struct obmc_mctp_binding));
   if (mctp_binding == NULL) {
     syslog(LOG_ERR, "%s: out of memory", __func__);
     return NULL;
   }
+  mctp_binding->rx_fd = -1;
 
   if (pkt_size < MCTP_PAYLOAD_SIZE + MCTP_HEADER_SIZE)
     pkt_size = MCTP_PAYLOAD_SIZE + MCTP_HEADER_SIZE;
@@ -84,12 +212,16 @@ struct obmc_mctp_binding* obmc_mctp_smbus_init(uint8_t bus, uint8_t src_addr, ui
     goto bail;
   }
 
-  smbus_extra_params = (struct mctp_smbus_pkt_private *)
-                       malloc(sizeof(struct mctp_smbus_pkt_private));
-  if (smbus_extra_params == NULL) {
+  mctp_binding->mctp = mctp;
+  mctp_binding->prot = (void *)smbus;
+  mctp_binding->smbus_params = (struct mctp_smbus_pkt_private *)
+                               calloc(1, sizeof(struct mctp_smbus_pkt_private));
+  if (mctp_binding->smbus_params == NULL) {
     syslog(LOG_ERR, "%s: out of memory", __func__);
     goto bail;
   }
+  smbus_extra_params = mctp_binding->smbus_params;
+  smbus_extra_params->fd = -1;
 
   snprintf(dev, sizeof(dev), "/dev/i2c-%d", bus);
   fd = open(dev, O_RDWR);
@@ -109,14 +241,14 @@ struct obmc_mctp_binding* obmc_mctp_smbus_init(uint8_t bus, uint8_t src_addr, ui
     goto bail;
   }
   mctp_smbus_set_in_fd(smbus, fd);
+  mctp_binding->rx_fd = fd;
+  register_binding(mctp_binding);
 
 #ifdef DEBUG
   mctp_set_log_stdio(MCTP_LOG_DEBUG);
   mctp_set_tracing_enabled(true);
 #endif
 
-  mctp_binding->mctp = mctp;
-  mctp_binding->prot = (void *)smbus;
   return mctp_binding;
 bail:
   obmc_mctp_smbus_free(mctp_binding);
@@ -125,10 +257,36 @@ bail:
 
 void obmc_mctp_smbus_free(struct obmc_mctp_binding* binding)
 {
-  mctp_smbus_free(binding->prot);
-  mctp_destroy(binding->mctp);
+  if (binding->rx_fd >= 0) {
+    unregister_binding(binding);
+    close(binding->rx_fd);
+  }
+  if (binding->prot)
+    mctp_smbus_free(binding->prot);
+  if (binding->mctp)
+    mctp_destroy(binding->mctp);
+  if (binding->smbus_params) {
+    if (binding->smbus_params->fd >= 0)
+      close(binding->smbus_params->fd);
+    if (smbus_extra_params == binding->smbus_params)
+      smbus_extra_params = NULL;
+    free(binding->smbus_params);
+  }
   free(binding);
-  free(smbus_extra_params);
+}
+
+int obmc_mctp_smbus_send(struct obmc_mctp_binding *binding, uint8_t dst_eid,
+                         uint8_t flag_tag, void *req, size_t size)
+{
+  bool tag_owner = flag_tag & MCTP_HDR_FLAG_TO? true: false;
+  uint8_t tag = MCTP_HDR_GET_TAG(flag_tag);
+
+  if (mctp_message_tx(binding->mctp, dst_eid, req, size,
+                      tag_owner, tag, binding->smbus_params) < 0) {
+    syslog(LOG_ERR, "%s: MCTP TX error", __func__);
+    return -1;
+  }
+  return 0;
 }
 
 int mctp_smbus_send_data(struct mctp* mctp, uint8_t dst, uint8_t flag_tag,
@@ -157,43 +315,26 @@ int mctp_smbus_recv_data_timeout(struct mctp *mctp, uint8_t dst,
 {
   // TODO:
   //    Function overloading
-  int retry = 6*10; // Default 6 secs
   struct obmc_mctp_hdr *p = (struct obmc_mctp_hdr *)data;
 
-  mctp_set_rx_all(mctp, rx_handler, data);
-
-  if (TOsec > 0)
-    retry = TOsec*10;
-
-  while (retry--) {
-    usleep(100*1000);
+  if (smbus_recv_timeout(mctp, smbus, rx_handler, data,
+                         TOsec > 0 ? TOsec * 1000 : RX_TIMEOUT_MS) < 0)
+    return -1;
 
-    if (mctp_smbus_read(smbus) < 0) {
-      syslog(LOG_ERR, "%s: MCTP RX error", __func__);
-      return -1;
-    }
+  if (p->Msg_Type == MCTP_TYPE_NCSI) {
+    struct obmc_mctp_ncsi_rsp *tmp = (struct obmc_mctp_ncsi_rsp *)data;
+    return tmp->pkt.data.Response_Code;
 
-    if (p->Msg_Size > 0) {
-      if (p->Msg_Type == MCTP_TYPE_NCSI) {
-        struct obmc_mctp_ncsi_rsp *tmp = (struct obmc_mctp_ncsi_rsp *)data;
-        return tmp->pkt.data.Response_Code;
-
-      } else if (p->Msg_Type == MCTP_TYPE_PLDM) {
-        struct obmc_mctp_pldm_rsp *tmp = (struct obmc_mctp_pldm_rsp *)data;
-        if (tmp->hdr.flag_tag & MCTP_HDR_FLAG_TO) {
-          // Request comes from device, just return CC_SUCCESS
-          return CC_SUCCESS;
-        } else {
-          return tmp->pkt.Complete_Code;
-        }
-      } else {
-        syslog(LOG_ERR, "%s: Unknown message (0x%02X)", __func__, p->Msg_Type);
-        return -1;
-      }
+  } else if (p->Msg_Type == MCTP_TYPE_PLDM) {
+    struct obmc_mctp_pldm_rsp *tmp = (struct obmc_mctp_pldm_rsp *)data;
+    if (tmp->hdr.flag_tag & MCTP_HDR_FLAG_TO) {
+      // Request comes from device, just return CC_SUCCESS
+      return CC_SUCCESS;
+    } else {
+      return tmp->pkt.Complete_Code;
     }
-
   }
-  syslog(LOG_ERR, "%s: MCTP timeout", __func__);
+  syslog(LOG_ERR, "%s: Unknown message (0x%02X)", __func__, p->Msg_Type);
   return -1;
 }
 
@@ -203,36 +344,21 @@ int mctp_smbus_recv_data_timeout_raw(struct mctp *mctp, uint8_t dst,
                                  struct mctp_binding_smbus *smbus,
                                  void *data, int TOsec)
 {
-  int retry = 6*10; // Default 6 secs
   struct obmc_mctp_hdr *p = (struct obmc_mctp_hdr *)data;
 
-  mctp_set_rx_all(mctp, rx_handler, data);
-
-  if (TOsec > 0)
-    retry = TOsec*10;
-
-  while (retry--) {
-    usleep(100*1000);
-
-    if (mctp_smbus_read(smbus) < 0) {
-      syslog(LOG_ERR, "%s: MCTP RX error", __func__);
-      return -1;
-    }
-
-    // Total size of raw message is body + tag + size byte
-    if (p->Msg_Size > 0) {
-      return p->Msg_Size + 2;
-    }
-  }
+  if (smbus_recv_timeout(mctp, smbus, rx_handler, data,
+                         TOsec > 0 ? TOsec * 1000 : RX_TIMEOUT_MS) < 0)
+    return -1;
 
-  syslog(LOG_ERR, "%s: MCTP timeout", __func__);
-  return -1;
+  // Total size of raw message is body + tag + size byte
+  return p->Msg_Size + 2;
 }
 
 static void spdm_rx_handler(uint8_t eid, void *data, void *msg, size_t len,
                        bool tag_owner, uint8_t tag, void *prv)
 {
-  struct obmc_mctp_spdm_hdr *p = (struct obmc_mctp_spdm_hdr *)data;
+  struct rx_ctx *ctx = (struct rx_ctx *)data;
+  struct obmc_mctp_spdm_hdr *p = (struct obmc_mctp_spdm_hdr *)ctx->data;
 
   if (tag_owner)
     p->flag_tag |= MCTP_HDR_FLAG_TO;
@@ -240,6 +366,7 @@ static void spdm_rx_handler(uint8_t eid, void *data, void *msg, size_t len,
 
   p->Msg_Size = len;
   memcpy(&p->Msg_Type, msg, len);
+  ctx->received = true;
 }
 
 // reads MCTP response off smbus
@@ -250,23 +377,12 @@ int mctp_smbus_recv_spdm_data_raw(struct mctp *mctp, uint8_t dst,
 {
   struct obmc_mctp_spdm_hdr *p = (struct obmc_mctp_spdm_hdr *)data;
 
-  mctp_set_rx_all(mctp, spdm_rx_handler, data);
-
-  while (1) {
-    if (mctp_smbus_read(smbus) < 0) {
-      syslog(LOG_ERR, "%s: MCTP RX error", __func__);
-      return -1;
-    }
-
-
-    // Total size of raw message is body + tag + size byte
-    if (p->Msg_Size > 0) {
-      return p->Msg_Size + 1 + sizeof(p->Msg_Size);
-    }
-  }
+  if (smbus_recv_timeout(mctp, smbus, spdm_rx_handler, data,
+                         TOsec > 0 ? TOsec * 1000 : RX_TIMEOUT_MS) < 0)
+    return -1;
 
-  syslog(LOG_ERR, "%s: MCTP timeout", __func__);
-  return -1;
+  // Total size of raw message is body + tag + size byte
+  return p->Msg_Size + 1 + sizeof(p->Msg_Size);
 }
 
 
@@ -554,6 +670,8 @@ int obmc_mctp_fw_update(struct obmc_mctp_binding *binding, uint8_t dst_eid,
     }
   }
 
+  // Components are updated one at a time: UpdateComponent, then the FD
+  // requests the data of that component until it applied it
   for (i = 0; i < pkgHdr->componentImageCnt; ++i) {
     memset(&pldmReq, 0, sizeof(pldm_cmd_req));
     pldmCreateUpdateComponentCmd(pkgHdr, i, &pldmReq);
@@ -570,37 +688,40 @@ int obmc_mctp_fw_update(struct obmc_mctp_binding *binding, uint8_t dst_eid,
     if (ret != CC_SUCCESS) {
       goto exit;
     }
-  }
 
-  // FW data transfer
-  setPldmTimeout(CMD_UPDATE_COMPONENT, &waitTOsec);
-  while (1) {
-    memset(&obmc_req, 0, sizeof(obmc_req));
-    ret = mctp_smbus_recv_data_timeout(mctp, dst_eid, smbus, &obmc_req, waitTOsec);
-    if (ret != CC_SUCCESS) {
-      break;
-    }
-    pldmCmd = obmc_req.pkt.hdr.Command_Code;
-    if ( (pldmCmd == CMD_REQUEST_FIRMWARE_DATA) ||
-         (pldmCmd == CMD_TRANSFER_COMPLETE) ||
-         (pldmCmd == CMD_VERIFY_COMPLETE) ||
-         (pldmCmd == CMD_APPLY_COMPLETE)) {
-      setPldmTimeout(pldmCmd, &waitTOsec);
-      mctpReq_to_pldmReq(&pldmReq, &obmc_req);
-      pldmCmdStatus = pldmFwUpdateCmdHandler(pkgHdr, &pldmReq, &pldmRes);
-      pldmRes_to_mctpRes(&rsp, &pldmRes);
-
-      ret = mctp_smbus_send_data(mctp, dst_eid, tag,
-                                 smbus, &rsp, pldmRes.resp_size+1);
-      if (ret < 0) {
+    // FW data transfer
+    setPldmTimeout(CMD_UPDATE_COMPONENT, &waitTOsec);
+    while (1) {
+      memset(&obmc_req, 0, sizeof(obmc_req));
+      ret = mctp_smbus_recv_data_timeout(mctp, dst_eid, smbus, &obmc_req, waitTOsec);
+      if (ret != CC_SUCCESS) {
         break;
       }
-      if ((pldmCmd == CMD_APPLY_COMPLETE) || (pldmCmdStatus == -1))
+      pldmCmd = obmc_req.pkt.hdr.Command_Code;
+      if ( (pldmCmd == CMD_REQUEST_FIRMWARE_DATA) ||
+           (pldmCmd == CMD_TRANSFER_COMPLETE) ||
+           (pldmCmd == CMD_VERIFY_COMPLETE) ||
+           (pldmCmd == CMD_APPLY_COMPLETE)) {
+        setPldmTimeout(pldmCmd, &waitTOsec);
+        mctpReq_to_pldmReq(&pldmReq, &obmc_req);
+        pldmCmdStatus = pldmFwUpdateCmdHandler(pkgHdr, &pldmReq, &pldmRes);
+        pldmRes_to_mctpRes(&rsp, &pldmRes);
+
+        ret = mctp_smbus_send_data(mctp, dst_eid, tag,
+                                   smbus, &rsp, pldmRes.resp_size+1);
+        if (ret < 0) {
+          break;
+        }
+        if ((pldmCmd == CMD_APPLY_COMPLETE) || (pldmCmdStatus == -1))
+          break;
+      } else {
+        printf("unknown PLDM cmd 0x%02X\n", pldmCmd);
         break;
-    } else {
-      printf("unknown PLDM cmd 0x%02X\n", pldmCmd);
-      break;
+      }
     }
+
+    if (pldmCmdStatus || (pldmCmd != CMD_APPLY_COMPLETE))
+      break;
   }
 
 exit:
@@ -116,6 +116,9 @@ struct mctp_pldm_rsp {
 struct obmc_mctp_binding {
   struct mctp *mctp;
   void *prot;
+  struct mctp_smbus_pkt_private *smbus_params;
+  int rx_fd;                          // slave queue
+  struct obmc_mctp_binding *next;
 };
 
 struct obmc_mctp_hdr {
@@ -150,6 +153,12 @@ struct obmc_mctp_binding* obmc_mctp_smbus_init(uint8_t bus, uint8_t src_addr, ui
                                                int pkt_size);
 void obmc_mctp_smbus_free(struct obmc_mctp_binding* binding);
 
+// Send on a given binding, safe with several bindings open at a time
+int obmc_mctp_smbus_send(struct obmc_mctp_binding *binding, uint8_t dst_eid,
+                         uint8_t flag_tag, void *req, size_t size);
+// Block until the slave queue has data, returns 1, 0 on timeout or -1
+int obmc_mctp_smbus_wait(struct obmc_mctp_binding *binding, int timeout_ms);
+
 // Debugging
 int mctp_smbus_send_data(struct mctp* mctp, uint8_t dst, uint8_t flag_tag,
                          struct mctp_binding_smbus *smbus,
@@ -18,6 +18,7 @@
 #define _XOPEN_SOURCE
 #define _GNU_SOURCE
 #include "obmc-pal.h"
+#include "pal-flags.h"
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
@@ -2038,16 +2039,10 @@ pal_channel_to_bus(int channel)
 int __attribute__((weak))
 pal_set_fw_update_ongoing(uint8_t fruid, uint16_t tmout) {
   char key[64] = {0};
-  char value[64] = {0};
-  struct timespec ts;
 
   sprintf(key, "fru%d_fwupd", fruid);
 
-  clock_gettime(CLOCK_MONOTONIC, &ts);
-  ts.tv_sec += tmout;
-  sprintf(value, "%ld", ts.tv_sec);
-
-  if (kv_set(key, value, 0, 0) < 0) {
+  if (pal_flag_set_timeout(key, tmout) < 0) {
      return -1;
   }
 
@@ -2062,6 +2057,11 @@ pal_is_fw_update_ongoing(uint8_t fruid) {
   struct timespec ts;
 
   sprintf(key, "fru%d_fwupd", fruid);
+  ret = pal_flag_is_set(key, PAL_FLAG_DEADLINE);
+  if (ret >= 0) {
+     return ret;
+  }
+
   ret = kv_get(key, value, NULL, 0);
   if (ret < 0) {
      return false;
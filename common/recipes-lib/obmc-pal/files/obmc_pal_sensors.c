@@ -25,6 +25,7 @@
 #include <unistd.h>
 #include <float.h>
 #include <time.h>
+#include <pthread.h>
 #include <sys/file.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -32,6 +33,7 @@
 #include <sys/mman.h>
 #include <errno.h>
 #include <openbmc/kv.h>
+#include <openbmc/tsdb.h>
 #include "obmc-pal.h"
 #include "obmc_pal_sensors.h"
 
@@ -45,33 +47,30 @@
 #define DEBUG_STR(...)
 #endif
 
-#define MAX_DATA_NUM    2000
-
 #define CACHE_READ_RETRY 5
 
-typedef struct {
-  long log_time;
-  float value;
-} sensor_data_t;
+#ifndef __TEST__
+#define SENSOR_HISTORY_DIR    "/mnt/data/sensor_history"
+#else
+#define SENSOR_HISTORY_DIR    "./test/sensor_history"
+#endif
+#define SENSOR_HISTORY_OUTBOX "sensor_history_outbox"
+#define SENSOR_HISTORY_FLUSH  "sensor_history_flush"
+#define HISTORY_FLUSH_POLL    30
+#define HISTORY_PUSH_RETRY    3
 
 typedef struct {
-  int index;
-  sensor_data_t data[MAX_DATA_NUM];
-} sensor_shm_t;
+  int fd;
+  size_t size;
+  void *ptr;
+} history_shm_t;
 
 typedef struct {
-  long log_time;
-  float sum;
-  float count;
-  float avg;
-  float max;
+  double total;
+  double weight;
   float min;
-} sensor_coarse_data_t;
-
-typedef struct {
-  int index;
-  sensor_coarse_data_t data[MAX_COARSE_DATA_NUM];
-} sensor_coarse_shm_t;
+  float max;
+} history_stats_t;
 
 static int
 sensor_key_get(uint8_t fru, uint8_t sensor_num, char *key)
@@ -88,144 +87,193 @@ sensor_key_get(uint8_t fru, uint8_t sensor_num, char *key)
   return 0;
 }
 
+/*
+ * Map a shared memory object of the history locked. Readers get a read
+ * only mapping and fail if the object does not exist yet.
+ */
 static int
-sensor_coarse_key_get(uint8_t fru, uint8_t sensor_num, char *key)
+history_shm_open(const char *key, size_t size, bool rw, history_shm_t *shm)
 {
-  int ret = sensor_key_get(fru, sensor_num, key);
-  if (ret) {
-    return ret;
-  }
-  strcat(key, "_coarse");
-  return 0;
-}
-
-static int
-cache_set_coarse_history(char *key, float value) {
-  int fd;
-  int share_size = sizeof(sensor_coarse_shm_t);
-  void *ptr;
-  sensor_coarse_shm_t *snr_shm;
-  long current_time;
-  int ret = ERR_FAILURE;
+  struct stat st;
 
-  fd = shm_open(key, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
-  if (fd < 0) {
+  shm->size = size;
+  shm->fd = shm_open(key, rw ? O_CREAT | O_RDWR : O_RDONLY, S_IRUSR | S_IWUSR);
+  if (shm->fd < 0) {
     DEBUG_STR("%s: shm_open %s failed, errno = %d", __FUNCTION__, key, errno);
     return -1;
   }
 
-  if (flock(fd, LOCK_EX) < 0) {
+  if (flock(shm->fd, LOCK_EX) < 0) {
     syslog(LOG_INFO, "%s: file-lock %s failed errno = %d\n", __FUNCTION__, key, errno);
     goto close_bail;
   }
 
-  if (ftruncate(fd, share_size) != 0) {
-    syslog(LOG_INFO, "%s: truncate %s failed errno = %d\n", __FUNCTION__, key, errno);
-    goto close_bail;
-  }
-
-  ptr = mmap(NULL, share_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-  if (ptr == MAP_FAILED) {
-    syslog(LOG_INFO, "%s: mmap %s failed, errno = %d", __FUNCTION__, key, errno);
-    goto unlock_bail;
-  }
-
-  snr_shm = (sensor_coarse_shm_t *)ptr;
-  current_time = time(NULL);
-  if (snr_shm->data[snr_shm->index].log_time == 0) {
-    sensor_coarse_data_t *s = &snr_shm->data[snr_shm->index];
-    s->log_time = current_time;
-    s->avg = s->sum = s->max = s->min = value;
-    s->count = 1;
-  } else {
-    sensor_coarse_data_t *s = &snr_shm->data[snr_shm->index];
-    /* If the log was started less than an hour ago, then 
-     * continue to log to this entry */
-    if (difftime(current_time, s->log_time) < COARSE_THRESHOLD) {
-      s->sum += value;
-      s->count += 1;
-      if (value > s->max)
-        s->max = value;
-      if (value < s->min)
-        s->min = value;
-      s->avg = s->sum / s->count;
-    } else {
-      /* Start logging to the next entry */
-      snr_shm->index = (snr_shm->index + 1) % MAX_COARSE_DATA_NUM;
-      s = &snr_shm->data[snr_shm->index];
-      memset(s, 0, sizeof(*s));
-      s->log_time = current_time;
-      s->avg = s->sum = s->max = s->min = value;
-      s->count = 1;
+  if (rw) {
+    if (ftruncate(shm->fd, size) != 0) {
+      syslog(LOG_INFO, "%s: truncate %s failed errno = %d\n", __FUNCTION__, key, errno);
+      goto unlock_bail;
     }
+  } else if (fstat(shm->fd, &st) != 0 || st.st_size < (off_t)size) {
+    goto unlock_bail;
   }
 
-  if (munmap(ptr, share_size) != 0) {
-    syslog(LOG_INFO, "%s: munmap %s failed, errno = %d", __FUNCTION__, key, errno);
+  shm->ptr = mmap(NULL, size, rw ? PROT_READ | PROT_WRITE : PROT_READ,
+                  MAP_SHARED, shm->fd, 0);
+  if (shm->ptr == MAP_FAILED) {
+    syslog(LOG_INFO, "%s: mmap %s failed, errno = %d", __FUNCTION__, key, errno);
     goto unlock_bail;
   }
-  ret = 0;
+  return 0;
 
 unlock_bail:
-  if (flock(fd, LOCK_UN) < 0) {
-    syslog(LOG_INFO, "%s: file-unlock %s failed errno = %d\n", __FUNCTION__, key, errno);
-    ret = -1;
-  }
+  flock(shm->fd, LOCK_UN);
 close_bail:
-  close(fd);
-  return ret;
+  close(shm->fd);
+  return -1;
 }
 
-static int
-cache_set_history(char *key, float value) {
+static void
+history_shm_close(history_shm_t *shm)
+{
+  munmap(shm->ptr, shm->size);
+  flock(shm->fd, LOCK_UN);
+  close(shm->fd);
+}
 
-  int fd;
-  int share_size = sizeof(sensor_shm_t);
-  void *ptr;
-  sensor_shm_t *snr_shm;
-  int ret = ERR_FAILURE;
+static pthread_once_t history_flusher_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t history_flush_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t history_flush_cond = PTHREAD_COND_INITIALIZER;
 
-  fd = shm_open(key, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
-  if (fd < 0) {
-    DEBUG_STR("%s: shm_open %s failed, errno = %d", __FUNCTION__, key, errno);
-    return -1;
-  }
+/*
+ * Write the outbox to the files if it is due, or whatever is in it with
+ * force. The outbox is copied and unlocked meanwhile, so sensors are
+ * never held up by the flash. Only one process flushes at a time; a
+ * forced flush waits for the one in progress.
+ */
+static void
+history_flush(bool force)
+{
+  history_shm_t shm;
+  tsdb_outbox_t *ob, *copy;
+  int lock;
+
+  lock = shm_open(SENSOR_HISTORY_FLUSH, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+  if (lock < 0)
+    return;
+  if (flock(lock, LOCK_EX | (force ? 0 : LOCK_NB)) < 0)
+    goto close_lock;
+  if (history_shm_open(SENSOR_HISTORY_OUTBOX, sizeof(tsdb_outbox_t), true, &shm))
+    goto close_lock;
+  ob = (tsdb_outbox_t *)shm.ptr;
+
+  // The outbox starts out zeroed after a reboot. Sensors wait for this
+  // once, checkpoints of the last boot must reach the files first.
+  if (!ob->recovered) {
+    ob->recovered = 1;
+    if (tsdb_checkpoint_recover(SENSOR_HISTORY_DIR))
+      syslog(LOG_WARNING, "%s: cannot recover the checkpoint", __FUNCTION__);
+  }
+
+  if ((!force && !tsdb_outbox_due(ob, time(NULL))) || ob->cnt == 0 ||
+      (copy = (tsdb_outbox_t *)malloc(sizeof(*copy))) == NULL) {
+    history_shm_close(&shm);
+    goto close_lock;
+  }
+  memcpy(copy, ob, sizeof(*copy));
+  history_shm_close(&shm);
+
+  if (tsdb_outbox_write(copy, SENSOR_HISTORY_DIR))
+    syslog(LOG_WARNING, "%s: cannot write %s", __FUNCTION__, SENSOR_HISTORY_DIR);
+  // Nowhere to keep them on failure, they are dropped
+  if (history_shm_open(SENSOR_HISTORY_OUTBOX, sizeof(tsdb_outbox_t), true, &shm) == 0) {
+    tsdb_outbox_drop((tsdb_outbox_t *)shm.ptr, copy->cnt, time(NULL));
+    history_shm_close(&shm);
+  }
+  free(copy);
+close_lock:
+  close(lock);
+}
+
+static void *
+history_flusher(void *arg)
+{
+  struct timespec ts;
 
-  if (flock(fd, LOCK_EX) < 0) {
-    syslog(LOG_INFO, "%s: file-lock %s failed errno = %d\n", __FUNCTION__, key, errno);
-    goto close_bail;
+  while (1) {
+    pthread_mutex_lock(&history_flush_mutex);
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += HISTORY_FLUSH_POLL;
+    pthread_cond_timedwait(&history_flush_cond, &history_flush_mutex, &ts);
+    pthread_mutex_unlock(&history_flush_mutex);
+    history_flush(false);
   }
+  return NULL;
+}
 
-  if (ftruncate(fd, share_size) != 0) {
-    syslog(LOG_INFO, "%s: truncate %s failed errno = %d\n", __FUNCTION__, key, errno);
-    goto close_bail;
-  }
+static void
+history_flusher_start(void)
+{
+  pthread_attr_t attr;
+  pthread_t tid;
 
-  ptr = mmap(NULL, share_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-  if (ptr == MAP_FAILED) {
-    syslog(LOG_INFO, "%s: mmap %s failed, errno = %d", __FUNCTION__, key, errno);
-    goto unlock_bail;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  if (pthread_create(&tid, &attr, history_flusher, NULL))
+    syslog(LOG_WARNING, "%s: cannot start the history flusher", __FUNCTION__);
+  pthread_attr_destroy(&attr);
+}
+
+/*
+ * Sealed blocks of all sensors are collected in one outbox, so the
+ * flash only sees a large append every few minutes. If the flusher
+ * falls behind and the outbox fills up, the sensor writes it out
+ * itself rather than losing the block.
+ */
+static void
+history_sink(const tsdb_block_t *blk, void *arg)
+{
+  history_shm_t shm;
+  tsdb_outbox_t *ob;
+  uint32_t now = time(NULL);
+  int retry;
+
+  for (retry = 0; retry < HISTORY_PUSH_RETRY; retry++) {
+    if (history_shm_open(SENSOR_HISTORY_OUTBOX, sizeof(tsdb_outbox_t), true, &shm))
+      return;
+    ob = (tsdb_outbox_t *)shm.ptr;
+    if (tsdb_outbox_push(ob, blk, now) == 0) {
+      if (tsdb_outbox_due(ob, now))
+        pthread_cond_signal(&history_flush_cond);
+      history_shm_close(&shm);
+      return;
+    }
+    history_shm_close(&shm);
+    history_flush(true);
   }
+  syslog(LOG_WARNING, "%s: outbox full, block of series 0x%08x dropped",
+         __FUNCTION__, blk->hdr.series);
+}
 
-  snr_shm = (sensor_shm_t *)ptr;
-  snr_shm->data[snr_shm->index].log_time = time(NULL);
-  snr_shm->data[snr_shm->index].value = value;
-  snr_shm->index = (snr_shm->index + 1) % MAX_DATA_NUM;
+static int
+cache_set_history(char *key, float value) {
+  history_shm_t shm;
+  tsdb_series_t *series;
+  uint32_t id = tsdb_series_id(key);
+  uint32_t now = time(NULL);
 
-  if (munmap(ptr, share_size) != 0) {
-    syslog(LOG_INFO, "%s: munmap %s failed, errno = %d", __FUNCTION__, key, errno);
-    goto unlock_bail;
-  }
-  ret = 0;
+  pthread_once(&history_flusher_once, history_flusher_start);
+  if (history_shm_open(key, sizeof(tsdb_series_t), true, &shm))
+    return ERR_FAILURE;
 
-unlock_bail:
-  if (flock(fd, LOCK_UN) < 0) {
-    syslog(LOG_INFO, "%s: file-unlock %s failed errno = %d\n", __FUNCTION__, key, errno);
-    ret = -1;
-  }
-close_bail:
-  close(fd);
-  return ret;
+  // New, or left behind by an older format
+  series = (tsdb_series_t *)shm.ptr;
+  if (!tsdb_series_valid(series, id))
+    tsdb_series_init(series, id);
+  tsdb_series_add(series, now, value, history_sink, NULL);
+  tsdb_series_checkpoint(series, now, history_sink, NULL);
+
+  history_shm_close(&shm);
+  return 0;
 }
 
 int __attribute__((weak))
@@ -280,12 +328,8 @@ sensor_cache_write(uint8_t fru, uint8_t sensor_num, bool available, float value)
     DEBUG_STR("sensor_cache_write: cache_set %s failed.\n", key);
     return ERR_FAILURE;
   }
-  if (available) {
+  if (available)
     cache_set_history(key, value);
-    if (sensor_coarse_key_get(fru, sensor_num, key) == 0) {
-      cache_set_coarse_history(key, value);
-    }
-  }
   return 0;
 }
 
@@ -305,248 +349,122 @@ int sensor_raw_read(uint8_t fru, uint8_t sensor_num, float *value)
 }
 
 static int
-sensor_read_short_history(uint8_t fru, uint8_t sensor_num, float *min,
-    float *average, float *max, int start_time)
+history_point(uint32_t ts, const float *vals, int ncols, void *arg)
 {
-  char key[MAX_KEY_LEN] = {0};
-  int fd;
-  int share_size = sizeof(sensor_shm_t);
-  void *ptr;
-  sensor_shm_t *snr_shm;
-  int16_t read_index;
-  uint16_t count = 0;
-  float read_val;
-  double total = 0;
-  int ret = ERR_FAILURE;
-
-  if (sensor_key_get(fru, sensor_num, key))
-    return ERR_UNKNOWN_FRU;
-
-  fd = shm_open(key, O_RDONLY, S_IRUSR | S_IWUSR);
-  if (fd < 0) {
-    DEBUG_STR("%s: shm_open %s failed, errno = %d", __FUNCTION__, key, errno);
-    return ERR_FAILURE;
-  }
-
-  if (flock(fd, LOCK_EX) < 0) {
-    syslog(LOG_INFO, "%s: file-lock %s failed errno = %d\n", __FUNCTION__, key, errno);
-    goto close_bail;
-  }
-
-  ptr = mmap(NULL, share_size, PROT_READ, MAP_SHARED, fd, 0);
-  if (ptr == MAP_FAILED) {
-    syslog(LOG_INFO, "%s: mmap %s failed, errno = %d", __FUNCTION__, key, errno);
-    goto unlock_bail;
-  }
-
-  snr_shm = (sensor_shm_t *)ptr;
-  read_index = snr_shm->index - 1;
-  if (read_index < 0) {
-    read_index += MAX_DATA_NUM;
-  }
-
-  read_val = snr_shm->data[read_index].value;
-  *min = read_val;
-  *max = read_val;
-
-  while ((snr_shm->data[read_index].log_time >= start_time) && (count < MAX_DATA_NUM)) {
-    read_val = snr_shm->data[read_index].value;
-    if (read_val > *max)
-      *max = read_val;
-    if (read_val < *min)
-      *min = read_val;
-
-    total += read_val;
-    count++;
-    if ((--read_index) < 0) {
-      read_index += MAX_DATA_NUM;
-    }
-  }
-
-  if (munmap(ptr, share_size) != 0) {
-    syslog(LOG_INFO, "%s: munmap %s failed, errno = %d", __FUNCTION__, key, errno);
-    goto unlock_bail;
-  }
-
-  /* If none found in history, just return the cached value */
-  if (!count) {
-    float read_value;
-    ret = sensor_cache_read(fru, sensor_num, &read_value);
-    if (ret)
-      return ret;
-    total = *min = *max = read_value;
-    count = 1;
-  }
-
-  *average = total / count;
-  ret = 0;
-unlock_bail:
-  if (flock(fd, LOCK_UN) < 0) {
-    syslog(LOG_INFO, "%s: file-unlock %s failed errno = %d\n", __FUNCTION__, key, errno);
-    ret = -1;
-  }
-close_bail:
-  close(fd);
-  return ret;
+  history_stats_t *st = (history_stats_t *)arg;
+  float min = vals[0], max = vals[0];
+  float weight = 1;
+
+  if (ncols > TSDB_COL_COUNT) {
+    min = vals[TSDB_COL_MIN];
+    max = vals[TSDB_COL_MAX];
+    weight = vals[TSDB_COL_COUNT];
+  }
+  if (min < st->min)
+    st->min = min;
+  if (max > st->max)
+    st->max = max;
+  st->total += (double)vals[0] * weight;
+  st->weight += weight;
+  return 0;
 }
 
-static int
-sensor_read_long_history(uint8_t fru, uint8_t sensor_num, float *min,
-    float *average, float *max, int start_time)
+int
+sensor_read_history(uint8_t fru, uint8_t sensor_num, float *min, float *average, float *max, int start_time)
 {
   char key[MAX_KEY_LEN] = {0};
-  int fd;
-  int share_size = sizeof(sensor_coarse_shm_t);
-  void *ptr;
-  sensor_coarse_shm_t *snr_shm;
-  sensor_coarse_data_t *s;
-  int16_t read_index;
-  uint16_t count = 0;
-  double total = 0;
-  int ret = ERR_FAILURE;
-
-  if (sensor_coarse_key_get(fru, sensor_num, key))
+  history_shm_t shm;
+  history_stats_t st = {0, 0, FLT_MAX, -FLT_MAX};
+  tsdb_series_t *series = NULL;
+  tsdb_outbox_t *outbox = NULL;
+  uint32_t id, start;
+  long current_time = time(NULL);
+  double span = difftime(current_time, start_time);
+  int tier, ret;
+
+  if (sensor_key_get(fru, sensor_num, key))
     return ERR_UNKNOWN_FRU;
+  id = tsdb_series_id(key);
 
-  fd = shm_open(key, O_RDONLY, S_IRUSR | S_IWUSR);
-  if (fd < 0) {
-    DEBUG_STR("%s: shm_open %s failed, errno = %d", __FUNCTION__, key, errno);
-    return ERR_FAILURE;
-  }
+  /* Raw points for the last hour, the downsampled tiers beyond that. */
+  if (span <= COARSE_THRESHOLD)
+    tier = TSDB_TIER_RAW;
+  else if (span <= 24 * COARSE_THRESHOLD)
+    tier = TSDB_TIER_5MIN;
+  else
+    tier = TSDB_TIER_HOUR;
 
-  if (flock(fd, LOCK_EX) < 0) {
-    syslog(LOG_INFO, "%s: file-lock %s failed errno = %d\n", __FUNCTION__, key, errno);
-    goto close_bail;
+  /* Work on copies, so the sensor can be updated during the query. */
+  series = (tsdb_series_t *)calloc(1, sizeof(*series));
+  outbox = (tsdb_outbox_t *)calloc(1, sizeof(*outbox));
+  if (series == NULL || outbox == NULL) {
+    ret = ERR_FAILURE;
+    goto exit;
   }
-
-  ptr = mmap(NULL, share_size, PROT_READ, MAP_SHARED, fd, 0);
-  if (ptr == MAP_FAILED) {
-    syslog(LOG_INFO, "%s: mmap %s failed, errno = %d", __FUNCTION__, key, errno);
-    goto unlock_bail;
+  if (history_shm_open(key, sizeof(*series), false, &shm) == 0) {
+    memcpy(series, shm.ptr, sizeof(*series));
+    history_shm_close(&shm);
   }
-
-  snr_shm = (sensor_coarse_shm_t *)ptr;
-  read_index = snr_shm->index;
-  total = 0;
-  *max = -FLT_MAX;
-  *min = FLT_MAX;
-  while (count < MAX_COARSE_DATA_NUM) {
-    s = &snr_shm->data[read_index];
-    if (s->log_time < start_time) {
-      break;
-    }
-    if (s->max > *max)
-      *max = s->max;
-    if (s->min < *min)
-      *min = s->min;
-    total += s->avg;
-    count++;
-    if ((--read_index) < 0) {
-      read_index += MAX_COARSE_DATA_NUM;
-    }
+  if (!tsdb_series_valid(series, id)) {
+    free(series);
+    series = NULL;
   }
-  if (munmap(ptr, share_size) != 0) {
-    syslog(LOG_INFO, "%s: munmap %s failed, errno = %d", __FUNCTION__, key, errno);
-    goto unlock_bail;
+  if (history_shm_open(SENSOR_HISTORY_OUTBOX, sizeof(*outbox), false, &shm) == 0) {
+    memcpy(outbox, shm.ptr, sizeof(*outbox));
+    history_shm_close(&shm);
   }
 
+  /* Buckets which started before start_time still overlap the range. */
+  start = start_time > 0 ? start_time : 0;
+  if (tier != TSDB_TIER_RAW && start >= tsdb_tier_period(tier))
+    start -= tsdb_tier_period(tier) - 1;
+  tsdb_series_query(series, outbox, SENSOR_HISTORY_DIR, id, tier,
+                    start, current_time, history_point, &st);
+
   /* If none found in history, just return the cached value */
-  if (!count) {
+  if (st.weight == 0) {
     float read_value;
     ret = sensor_cache_read(fru, sensor_num, &read_value);
     if (ret)
-      return ret;
-    total = *min = *max = read_value;
-    count = 1;
+      goto exit;
+    st.total = st.min = st.max = read_value;
+    st.weight = 1;
   }
 
-  *average = total / count;
+  *min = st.min;
+  *max = st.max;
+  *average = st.total / st.weight;
   ret = 0;
-unlock_bail:
-  if (flock(fd, LOCK_UN) < 0) {
-    syslog(LOG_INFO, "%s: file-unlock %s failed errno = %d\n", __FUNCTION__, key, errno);
-    ret = -1;
-  }
-close_bail:
-  close(fd);
-  return ret;
-}
-
-int
-sensor_read_history(uint8_t fru, uint8_t sensor_num, float *min, float *average, float *max, int start_time)
-{
-  long current_time = time(NULL);
-  
-  /* If requested start is greater than the coarse threshold (mostly an hour),
-   * then go through the coarse stats to compute the max,min avg. else use the
-   * fine grained data to get the values */
-  if (difftime(current_time, start_time) > COARSE_THRESHOLD) {
-    return sensor_read_long_history(fru, sensor_num, min, average, max, start_time);
-  }
-  return sensor_read_short_history(fru, sensor_num, min, average, max, start_time);
-}
-
-static int sensor_clear_history_helper(char *shm_name, int share_size)
-{
-  int fd;
-  long *shm;
-  int ret = ERR_FAILURE;
-
-  fd = shm_open(shm_name, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
-  if (fd < 0) {
-    return ERR_FAILURE;
-  }
-  if (flock(fd, LOCK_EX) < 0) {
-    syslog(LOG_INFO, "%s: file-lock %s failed errno = %d\n", __FUNCTION__, shm_name, errno);
-    goto close_bail;
-  }
-
-  if (ftruncate(fd, share_size) != 0) {
-    syslog(LOG_INFO, "%s: truncate %s failed errno = %d\n", __FUNCTION__, shm_name, errno);
-    goto close_bail;
-  }
-
-  shm = (long *)mmap(NULL, share_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-  if (shm == MAP_FAILED) {
-    syslog(LOG_INFO, "%s: mmap %s failed, errno = %d", __FUNCTION__, shm_name, errno);
-    goto unlock_bail;
-  }
-
-  memset(shm, 0, share_size);
-  if (munmap(shm, share_size) != 0) {
-    syslog(LOG_INFO, "%s: munmap %s failed, errno = %d", __FUNCTION__, shm_name, errno);
-    goto unlock_bail;
-  }
-  ret = 0;
-unlock_bail:
-  if (flock(fd, LOCK_UN) < 0) {
-    syslog(LOG_INFO, "%s: file-unlock %s failed errno = %d\n", __FUNCTION__, shm_name, errno);
-    ret = -1;
-  }
-close_bail:
-  close(fd);
+exit:
+  free(series);
+  free(outbox);
   return ret;
 }
 
 int sensor_clear_history(uint8_t fru, uint8_t sensor_num)
 {
   char key[MAX_KEY_LEN] = {0};
-  int ret1, ret2;
+  history_shm_t shm;
+  uint32_t id;
+  int ret = 0;
 
   if (sensor_key_get(fru, sensor_num, key))
     return ERR_UNKNOWN_FRU;
+  id = tsdb_series_id(key);
 
-  ret1 = sensor_clear_history_helper(key, sizeof(sensor_shm_t));
-  if (ret1) {
-    syslog(LOG_INFO, "Clearing history failed: %d\n", ret1);
-  }
-  if (sensor_coarse_key_get(fru, sensor_num, key))
-    return ERR_UNKNOWN_FRU;
-  ret2 = sensor_clear_history_helper(key, sizeof(sensor_coarse_shm_t));
-  if (ret2) {
-    syslog(LOG_INFO, "Clearing coarse history failed: %d\n", ret2);
+  if (history_shm_open(key, sizeof(tsdb_series_t), true, &shm) == 0) {
+    tsdb_series_init((tsdb_series_t *)shm.ptr, id);
+    history_shm_close(&shm);
+  } else {
+    ret = ERR_FAILURE;
   }
-  return ret1 || ret2 ? ERR_FAILURE : 0;
+
+  /* Blocks already in the outbox or on flash are hidden from now on. */
+  if (tsdb_store_tombstone(SENSOR_HISTORY_DIR, id, time(NULL)))
+    ret = ERR_FAILURE;
+  if (ret)
+    syslog(LOG_INFO, "Clearing history failed: %d\n", ret);
+  return ret;
 }
 
 int __attribute__((weak))
@@ -69,10 +69,10 @@ typedef struct {
 #define AGGREGATE_SENSOR_FRU_ID   0xff
 #define AGGREGATE_SENSOR_FRU_NAME "aggregate"
 
-/* Store enough coarse data for 30 days, configurable */
+/* History can be queried for up to 30 days, in hourly points */
 #define MAX_COARSE_DATA_NUM (30 * 24)
-/* Any history more than an hour, loses its granularity and
- * it starts to get accounted in the COARSE grained calculations */
+/* History of more than an hour is read from the downsampled
+ * 5 minute and hourly points instead of the raw readings */
 #define COARSE_THRESHOLD ((double)3600)
 
 /* Functions */
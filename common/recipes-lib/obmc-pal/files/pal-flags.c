@@ -0,0 +1,103 @@
+/*
+ * Copyright 2021-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <openbmc/kv.h>
+#include "pal-flags.h"
+
+static int64_t
+flag_now_ms(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int32_t
+flag_now(void)
+{
+  return flag_now_ms() / 1000;
+}
+
+static bool
+flag_value_set(int32_t value, pal_flag_type_t type)
+{
+  if (type == PAL_FLAG_DEADLINE)
+    return value > flag_now();
+  return value != 0;
+}
+
+int
+pal_flag_set(const char *name, int32_t value)
+{
+  char str[16];
+
+  snprintf(str, sizeof(str), "%d", value);
+  return kv_set(name, str, 0, 0) < 0 ? -1 : 0;
+}
+
+int
+pal_flag_set_timeout(const char *name, uint16_t tmout)
+{
+  return pal_flag_set(name, flag_now() + tmout);
+}
+
+int
+pal_flag_get(const char *name, int32_t *value)
+{
+  return kv_flag_get(name, value) < 0 ? -1 : 0;
+}
+
+int
+pal_flag_is_set(const char *name, pal_flag_type_t type)
+{
+  int32_t value;
+
+  if (kv_flag_get(name, &value) < 0)
+    return -1;
+  return flag_value_set(value, type);
+}
+
+int
+pal_flag_wait(const char *name, pal_flag_type_t type, bool set, int timeout_ms)
+{
+  int64_t deadline = flag_now_ms() + timeout_ms, left, wait;
+  int32_t value;
+
+  if (kv_flag_get(name, &value) < 0)
+    return -1;
+  while (flag_value_set(value, type) != set) {
+    left = deadline - flag_now_ms();
+    if (timeout_ms >= 0 && left <= 0)
+      return 0;
+    wait = timeout_ms < 0 ? -1 : left;
+    // A deadline passing is no write, so wake up for it
+    if (type == PAL_FLAG_DEADLINE && !set) {
+      int64_t until = (int64_t)value * 1000 - flag_now_ms();
+      if (until < 0)
+        until = 0;
+      if (wait < 0 || until < wait)
+        wait = until;
+    }
+    if (kv_flag_wait(name, &value, wait) < 0 && errno != ETIMEDOUT)
+      return -1;
+  }
+  return 1;
+}
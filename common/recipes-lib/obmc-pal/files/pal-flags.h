@@ -0,0 +1,67 @@
+/*
+ * Copyright 2021-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * Flags daemons poll from each other, such as "fru1_fwupd" or
+ * "flag_sensord_monitor".
+ *
+ * A flag is a regular kv key holding an integer. Reads go through the
+ * kv shared memory mirror (kv_flag_get()) and cost no syscall, while
+ * writes are plain kv_set() calls, so the flag follows every writer of
+ * the key, including libraries and scripts which do not use these calls.
+ */
+#ifndef __PAL_FLAGS_H__
+#define __PAL_FLAGS_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+  PAL_FLAG_INT = 0,       // set while non-zero
+  PAL_FLAG_DEADLINE,      // CLOCK_MONOTONIC second, set until it passes
+} pal_flag_type_t;
+
+// Set an integer flag
+int pal_flag_set(const char *name, int32_t value);
+
+// Set a deadline flag for the next tmout seconds, 0 clears it
+int pal_flag_set_timeout(const char *name, uint16_t tmout);
+
+// Raw value of the flag; 0 if its kv key does not exist
+int pal_flag_get(const char *name, int32_t *value);
+
+// 1 if the flag is set, 0 if not, -1 on error
+int pal_flag_is_set(const char *name, pal_flag_type_t type);
+
+/*
+ * Sleep until the flag is set (or clear), for at most timeout_ms, < 0
+ * waits for ever. Writers wake the waiter through a futex on the flag's
+ * change counter, no polling involved.
+ * 1 once the flag is in that state, 0 on timeout, -1 on error.
+ */
+int pal_flag_wait(const char *name, pal_flag_type_t type, bool set, int timeout_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PAL_FLAGS_H__ */
@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+#
+# Copyright 2021-present Facebook. All Rights Reserved.
+#
+# This program file is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License as published by the
+# Free Software Foundation; version 2 of the License.
+#
+# This program is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+# for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program in a file named COPYING; if not, write to the
+# Free Software Foundation, Inc.,
+# 51 Franklin Street, Fifth Floor,
+# Boston, MA 02110-1301 USA
+#
+# Generate the PAL profiling wrappers from the prototypes in obmc-pal.h:
+#   pal-prof-gen.py --rename obmc-pal.h pal-prof-rename.h
+#   pal-prof-gen.py --wrap obmc-pal.h pal-prof-wrap.c
+# See pal-prof.h.
+
+import re
+import sys
+
+PROTO = re.compile(r"^\s*([A-Za-z_][\w\s\*]*?)\s*\b(pal_\w+)\s*\(([^()]*)\)\s*;")
+IMPL = "__pal_impl_"
+
+
+def parse(header):
+    funcs = []
+    seen = set()
+    with open(header) as f:
+        for line in f:
+            m = PROTO.match(line)
+            if not m or "typedef" in m.group(1) or m.group(2) in seen:
+                continue
+            ret, name, params = m.group(1).strip(), m.group(2), m.group(3).strip()
+            if "..." in params:
+                continue
+            args = []
+            if params not in ("", "void"):
+                for p in params.split(","):
+                    a = re.search(r"(\w+)\s*(\[[^\]]*\])?\s*$", p.strip())
+                    if not a:
+                        raise SystemExit("cannot parse %s: %s" % (name, p))
+                    args.append(a.group(1))
+            seen.add(name)
+            funcs.append((ret, name, params or "void", args))
+    return funcs
+
+
+def rename(funcs, out):
+    out.write("/* Generated by pal-prof-gen.py, do not edit. */\n")
+    out.write("#ifndef __PAL_PROF_RENAME_H__\n#define __PAL_PROF_RENAME_H__\n")
+    for _, name, _, _ in funcs:
+        out.write("#define %s %s%s\n" % (name, IMPL, name))
+    out.write("#endif\n")
+
+
+def wrap(funcs, out):
+    out.write("/* Generated by pal-prof-gen.py, do not edit. */\n")
+    out.write('#include "obmc-pal.h"\n#include "pal-prof.h"\n\n')
+    out.write("const int pal_prof_nfuncs = %d;\n" % len(funcs))
+    out.write("const char *const pal_prof_names[] = {\n")
+    for _, name, _, _ in funcs:
+        out.write('  "%s",\n' % name)
+    out.write("};\n")
+    for idx, (ret, name, params, args) in enumerate(funcs):
+        call = "%s%s(%s)" % (IMPL, name, ", ".join(args))
+        out.write("\n%s %s%s(%s);\n" % (ret, IMPL, name, params))
+        out.write("%s\n%s(%s)\n{\n" % (ret, name, params))
+        if ret == "void":
+            out.write("  uint64_t start;\n\n")
+            out.write("  if (__builtin_expect(pal_prof_stats == NULL, 1)) {\n")
+            out.write("    %s;\n    return;\n  }\n" % call)
+            out.write("  start = pal_prof_now();\n")
+            out.write("  %s;\n" % call)
+            out.write("  pal_prof_record(%d, start, false);\n}\n" % idx)
+        else:
+            error = "ret < 0" if ret == "int" else "false"
+            out.write("  uint64_t start;\n  %s ret;\n\n" % ret)
+            out.write("  if (__builtin_expect(pal_prof_stats == NULL, 1))\n")
+            out.write("    return %s;\n" % call)
+            out.write("  start = pal_prof_now();\n")
+            out.write("  ret = %s;\n" % call)
+            out.write("  pal_prof_record(%d, start, %s);\n" % (idx, error))
+            out.write("  return ret;\n}\n")
+
+
+def main():
+    if len(sys.argv) != 4 or sys.argv[1] not in ("--rename", "--wrap"):
+        raise SystemExit("usage: %s --rename|--wrap <obmc-pal.h> <output>" % sys.argv[0])
+    funcs = parse(sys.argv[2])
+    with open(sys.argv[3], "w") as out:
+        if sys.argv[1] == "--rename":
+            rename(funcs, out)
+        else:
+            wrap(funcs, out)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,273 @@
+/*
+ * Copyright 2021-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * pal-prof: dump and reset the PAL call stats of profiled processes.
+ */
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "pal-prof.h"
+
+enum {
+  CMD_DUMP,
+  CMD_RESET,
+  CMD_CLEAN,
+};
+
+typedef struct {
+  int cmd;
+  int pid;
+  bool all;
+  char sort;
+} options_t;
+
+static pal_prof_shm_t *sort_shm;
+static char sort_key;
+
+static void
+usage(void)
+{
+  printf("Usage: pal-prof [-p pid] [-a] [-s calls|total|avg|max]\n");
+  printf("       pal-prof [-p pid] -r\n");
+  printf("       pal-prof -c\n");
+  printf("  -p  only the process pid\n");
+  printf("  -a  list PAL calls which were never made too\n");
+  printf("  -s  sort by calls, total time (default), average or max time\n");
+  printf("  -r  reset the stats\n");
+  printf("  -c  remove the stats of processes which exited\n");
+  printf("Profile a process with PAL_PROF=1 in its environment, or with\n");
+  printf("  echo \"<process> ...|all\" > %s\n", PAL_PROF_FLAG);
+}
+
+static uint64_t
+sort_value(const pal_prof_func_t *f)
+{
+  switch (sort_key) {
+    case 'c':
+      return f->calls;
+    case 'a':
+      return f->calls ? f->total_ns / f->calls : 0;
+    case 'm':
+      return f->max_ns;
+    default:
+      return f->total_ns;
+  }
+}
+
+static int
+cmp_func(const void *a, const void *b)
+{
+  uint64_t va = sort_value(&sort_shm->funcs[*(const int *)a]);
+  uint64_t vb = sort_value(&sort_shm->funcs[*(const int *)b]);
+
+  return (va < vb) - (va > vb);
+}
+
+// Upper bound of the bucket the q-th fraction of the calls falls in
+static const char *
+percentile(const pal_prof_func_t *f, double q, char *buf, size_t len)
+{
+  uint64_t want = (uint64_t)(f->calls * q), n = 0;
+  int b;
+
+  for (b = 0; b < PAL_PROF_BUCKETS - 1; b++) {
+    n += f->hist[b];
+    if (n > want)
+      break;
+  }
+  if (b == PAL_PROF_BUCKETS - 1)
+    snprintf(buf, len, ">%llu", 1ULL << (b - 1));
+  else
+    snprintf(buf, len, "<%llu", 1ULL << b);
+  return buf;
+}
+
+// The pid may have been reused once the library marked the process exited
+static bool
+exited(const pal_prof_shm_t *shm)
+{
+  return shm->exited != 0 || (kill(shm->pid, 0) != 0 && errno == ESRCH);
+}
+
+static void
+dump(pal_prof_shm_t *shm, const options_t *opt)
+{
+  char p50[16], p99[16];
+  int order[shm->nfuncs];
+  uint64_t calls = 0;
+  uint32_t i;
+  bool alive = !exited(shm);
+  time_t start = shm->start;
+  pal_prof_func_t *f;
+
+  for (i = 0; i < shm->nfuncs; i++) {
+    order[i] = i;
+    calls += shm->funcs[i].calls;
+  }
+  sort_shm = shm;
+  qsort(order, shm->nfuncs, sizeof(order[0]), cmp_func);
+
+  printf("%s[%d]%s, %llu calls since %s", shm->comm, shm->pid,
+         alive ? "" : " (exited)", (unsigned long long)calls, ctime(&start));
+  printf("  %-40s %8s %6s %10s %9s %9s %9s %9s\n", "call", "calls", "errors",
+         "total_ms", "avg_us", "p50_us", "p99_us", "max_us");
+  for (i = 0; i < shm->nfuncs; i++) {
+    f = &shm->funcs[order[i]];
+    if (f->calls == 0 && !opt->all)
+      continue;
+    printf("  %-40.*s %8llu %6llu %10.1f %9llu %9s %9s %9llu\n",
+           PAL_PROF_NAME_LEN, f->name,
+           (unsigned long long)f->calls, (unsigned long long)f->errors,
+           f->total_ns / 1e6,
+           (unsigned long long)(f->calls ? f->total_ns / f->calls / 1000 : 0),
+           f->calls ? percentile(f, 0.5, p50, sizeof(p50)) : "-",
+           f->calls ? percentile(f, 0.99, p99, sizeof(p99)) : "-",
+           (unsigned long long)(f->max_ns / 1000));
+  }
+  printf("\n");
+}
+
+static void
+reset(pal_prof_shm_t *shm)
+{
+  uint32_t i;
+
+  // Racing with calls in flight only loses those
+  for (i = 0; i < shm->nfuncs; i++) {
+    pal_prof_func_t *f = &shm->funcs[i];
+    size_t off = offsetof(pal_prof_func_t, calls);
+
+    memset((char *)f + off, 0, sizeof(*f) - off);
+  }
+  shm->start = time(NULL);
+  printf("Reset %s[%d]\n", shm->comm, shm->pid);
+}
+
+static int
+visit(const char *name, const options_t *opt)
+{
+  struct stat st;
+  pal_prof_shm_t *shm;
+  int fd, ret = 0;
+
+  fd = shm_open(name, opt->cmd == CMD_RESET ? O_RDWR : O_RDONLY, 0);
+  if (fd < 0)
+    return -1;
+  if (fstat(fd, &st) != 0 || st.st_size < sizeof(*shm)) {
+    close(fd);
+    return -1;
+  }
+  shm = mmap(NULL, st.st_size,
+             opt->cmd == CMD_RESET ? PROT_READ | PROT_WRITE : PROT_READ,
+             MAP_SHARED, fd, 0);
+  close(fd);
+  if (shm == MAP_FAILED)
+    return -1;
+
+  if (shm->magic != PAL_PROF_MAGIC || shm->version != PAL_PROF_VERSION ||
+      PAL_PROF_SHM_SIZE(shm->nfuncs) > st.st_size) {
+    fprintf(stderr, "%s: unknown format\n", name);
+    ret = -1;
+  } else if (opt->cmd == CMD_DUMP) {
+    dump(shm, opt);
+  } else if (opt->cmd == CMD_RESET) {
+    reset(shm);
+  } else if (exited(shm)) {
+    printf("Removing %s[%d]\n", shm->comm, shm->pid);
+    shm_unlink(name);
+  }
+
+  munmap(shm, st.st_size);
+  return ret;
+}
+
+int
+main(int argc, char **argv)
+{
+  options_t opt = {.cmd = CMD_DUMP, .sort = 't'};
+  char name[64];
+  struct dirent *ent;
+  DIR *dir;
+  int c, found = 0;
+
+  while ((c = getopt(argc, argv, "p:as:rch")) != -1) {
+    switch (c) {
+      case 'p':
+        opt.pid = atoi(optarg);
+        break;
+      case 'a':
+        opt.all = true;
+        break;
+      case 's':
+        if (strcmp(optarg, "calls") && strcmp(optarg, "total") &&
+            strcmp(optarg, "avg") && strcmp(optarg, "max")) {
+          usage();
+          return -1;
+        }
+        opt.sort = optarg[0];
+        break;
+      case 'r':
+        opt.cmd = CMD_RESET;
+        break;
+      case 'c':
+        opt.cmd = CMD_CLEAN;
+        break;
+      default:
+        usage();
+        return c == 'h' ? 0 : -1;
+    }
+  }
+  sort_key = opt.sort;
+
+  if (opt.pid > 0) {
+    snprintf(name, sizeof(name), PAL_PROF_SHM_PREFIX "%d", opt.pid);
+    if (visit(name, &opt) != 0) {
+      fprintf(stderr, "No PAL stats of pid %d\n", opt.pid);
+      return -1;
+    }
+    return 0;
+  }
+
+  dir = opendir(PAL_PROF_SHM_DIR);
+  if (dir == NULL) {
+    perror(PAL_PROF_SHM_DIR);
+    return -1;
+  }
+  while ((ent = readdir(dir)) != NULL) {
+    if (strncmp(ent->d_name, PAL_PROF_SHM_PREFIX,
+                strlen(PAL_PROF_SHM_PREFIX)) == 0 &&
+        visit(ent->d_name, &opt) == 0)
+      found++;
+  }
+  closedir(dir);
+
+  if (found == 0 && opt.cmd != CMD_CLEAN)
+    printf("No profiled processes\n");
+  return 0;
+}
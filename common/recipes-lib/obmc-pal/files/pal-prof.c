@@ -0,0 +1,255 @@
+/*
+ * Copyright 2021-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include "pal-prof.h"
+
+pal_prof_func_t *pal_prof_stats = NULL;
+static pal_prof_shm_t *pal_prof_shm = NULL;
+
+uint64_t pal_prof_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void pal_prof_record(int idx, uint64_t start, bool error)
+{
+  pal_prof_func_t *f = &pal_prof_stats[idx];
+  uint64_t ns = pal_prof_now() - start;
+  uint64_t max = __atomic_load_n(&f->max_ns, __ATOMIC_RELAXED);
+  int b = 0;
+
+  while (b < PAL_PROF_BUCKETS - 1 && ns >= (1000ULL << b))
+    b++;
+  __atomic_fetch_add(&f->calls, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&f->total_ns, ns, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&f->hist[b], 1, __ATOMIC_RELAXED);
+  if (error)
+    __atomic_fetch_add(&f->errors, 1, __ATOMIC_RELAXED);
+  while (ns > max &&
+         !__atomic_compare_exchange_n(&f->max_ns, &max, ns, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+// Is comm in the space or comma separated list?
+static bool
+pal_prof_listed(const char *list, const char *comm)
+{
+  size_t len = strlen(comm);
+  const char *p = list;
+
+  while ((p = strstr(p, comm)) != NULL) {
+    if ((p == list || p[-1] == ' ' || p[-1] == ',') &&
+        (p[len] == '\0' || p[len] == ' ' || p[len] == ',' || p[len] == '\n'))
+      return true;
+    p += len;
+  }
+  return false;
+}
+
+static bool
+pal_prof_wanted(const char *comm)
+{
+  char list[256];
+  const char *env = getenv(PAL_PROF_ENV);
+  ssize_t len;
+  int fd;
+
+  if (env != NULL)
+    return strcmp(env, "0") != 0;
+  // Runs in every process linking libpal, keep it to one syscall
+  fd = open(PAL_PROF_FLAG, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  len = read(fd, list, sizeof(list) - 1);
+  close(fd);
+  if (len <= 0)
+    return false;
+  list[len] = '\0';
+  return pal_prof_listed(list, "all") || pal_prof_listed(list, comm);
+}
+
+// Counters mapped before fork() belong to the parent
+static void
+pal_prof_atfork_child(void)
+{
+  pal_prof_stats = NULL;
+  pal_prof_shm = NULL;
+}
+
+/*
+ * When the process of a segment went away, 0 if it is still running.
+ * Killed processes never set exited, their start time is used then.
+ * Segments of an unknown format count as long gone.
+ */
+static int64_t
+pal_prof_gone(const char *name)
+{
+  pal_prof_shm_t *shm;
+  int64_t gone = 0;
+  struct stat st;
+  int fd;
+
+  fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0)
+    return 0;
+  if (fstat(fd, &st) != 0 || st.st_size < sizeof(*shm)) {
+    close(fd);
+    return 1;
+  }
+  shm = mmap(NULL, sizeof(*shm), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (shm == MAP_FAILED)
+    return 0;
+  if (shm->magic != PAL_PROF_MAGIC || shm->version != PAL_PROF_VERSION)
+    gone = 1;
+  else if (shm->exited)
+    gone = shm->exited;
+  else if (kill(shm->pid, 0) != 0 && errno == ESRCH)
+    gone = shm->start ? shm->start : 1;
+  munmap(shm, sizeof(*shm));
+  return gone;
+}
+
+typedef struct {
+  char name[64];
+  int64_t gone;
+} pal_prof_dead_t;
+
+static int
+pal_prof_cmp_dead(const void *a, const void *b)
+{
+  int64_t ga = ((const pal_prof_dead_t *)a)->gone;
+  int64_t gb = ((const pal_prof_dead_t *)b)->gone;
+
+  return (ga < gb) - (ga > gb);
+}
+
+/*
+ * Keep the segments of exited processes for a while, so pal-prof can
+ * still show them, but no more than PAL_PROF_KEEP_EXITED of the newest
+ * and none gone for longer than PAL_PROF_KEEP_SECS.
+ */
+static void
+pal_prof_gc(void)
+{
+  size_t len = strlen(PAL_PROF_SHM_PREFIX);
+  pal_prof_dead_t *dead = NULL, *tmp;
+  int n = 0, size = 0, i, kept = 0;
+  int64_t now = time(NULL), gone;
+  struct dirent *ent;
+  DIR *dir;
+
+  dir = opendir(PAL_PROF_SHM_DIR);
+  if (dir == NULL)
+    return;
+  while ((ent = readdir(dir)) != NULL) {
+    if (strncmp(ent->d_name, PAL_PROF_SHM_PREFIX, len) != 0 ||
+        (gone = pal_prof_gone(ent->d_name)) == 0)
+      continue;
+    if (n == size) {
+      size = size ? size * 2 : 32;
+      tmp = realloc(dead, size * sizeof(*dead));
+      if (tmp == NULL)
+        break;
+      dead = tmp;
+    }
+    snprintf(dead[n].name, sizeof(dead[n].name), "%s", ent->d_name);
+    dead[n++].gone = gone;
+  }
+  closedir(dir);
+
+  qsort(dead, n, sizeof(*dead), pal_prof_cmp_dead);
+  for (i = 0; i < n; i++) {
+    if (kept < PAL_PROF_KEEP_EXITED && now - dead[i].gone < PAL_PROF_KEEP_SECS)
+      kept++;
+    else
+      shm_unlink(dead[i].name);
+  }
+  free(dead);
+}
+
+// The segment stays for pal-prof, pal_prof_gc() removes it eventually
+static void __attribute__((destructor))
+pal_prof_exit(void)
+{
+  if (pal_prof_shm == NULL)
+    return;
+  __atomic_store_n(&pal_prof_shm->exited, (int64_t)time(NULL), __ATOMIC_RELAXED);
+  pal_prof_shm = NULL;
+}
+
+static void __attribute__((constructor))
+pal_prof_init(void)
+{
+  size_t size = PAL_PROF_SHM_SIZE(pal_prof_nfuncs);
+  char comm[16] = {0}, key[64];
+  pal_prof_shm_t *shm;
+  int fd, i;
+
+  if (prctl(PR_GET_NAME, comm) != 0 || !pal_prof_wanted(comm))
+    return;
+  pal_prof_gc();
+
+  snprintf(key, sizeof(key), PAL_PROF_SHM_PREFIX "%d", getpid());
+  fd = shm_open(key, O_CREAT | O_RDWR | O_TRUNC, S_IRUSR | S_IWUSR);
+  if (fd < 0) {
+    syslog(LOG_WARNING, "%s: shm_open %s failed", __func__, key);
+    return;
+  }
+  if (ftruncate(fd, size) != 0) {
+    close(fd);
+    shm_unlink(key);
+    return;
+  }
+  shm = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (shm == MAP_FAILED) {
+    shm_unlink(key);
+    return;
+  }
+
+  shm->version = PAL_PROF_VERSION;
+  shm->pid = getpid();
+  shm->nfuncs = pal_prof_nfuncs;
+  memcpy(shm->comm, comm, sizeof(shm->comm));
+  shm->start = time(NULL);
+  for (i = 0; i < pal_prof_nfuncs; i++)
+    snprintf(shm->funcs[i].name, PAL_PROF_NAME_LEN, "%s", pal_prof_names[i]);
+  __atomic_store_n(&shm->magic, PAL_PROF_MAGIC, __ATOMIC_RELEASE);
+
+  pthread_atfork(NULL, NULL, pal_prof_atfork_child);
+  pal_prof_shm = shm;
+  pal_prof_stats = shm->funcs;
+  syslog(LOG_INFO, "PAL profiling enabled for %s[%d]", comm, shm->pid);
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright 2021-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * PAL call profiling.
+ *
+ * Every entry point declared in obmc-pal.h is built as
+ * __pal_impl_<name>, and a generated wrapper of the public name calls
+ * it. The wrapper only takes timestamps when profiling is on for the
+ * process, otherwise it costs one branch.
+ *
+ * Profiling is turned on by PAL_PROF=1 in the environment, or by
+ * listing the process name (or "all") in /tmp/pal_prof. Processes which
+ * are not profiled only pay for a failed open() of that file at start.
+ * The stats of each process live in the shared memory segment
+ * pal_prof.<pid>, where pal-prof reads and resets them.
+ *
+ * The segment stays after the process exits, so the stats of short-lived
+ * tools can be read afterwards. Each process starting to profile removes
+ * the segments of processes gone for more than PAL_PROF_KEEP_SECS, and
+ * the oldest ones beyond PAL_PROF_KEEP_EXITED; pal-prof -c removes all
+ * of them.
+ */
+#ifndef __PAL_PROF_H__
+#define __PAL_PROF_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PAL_PROF_ENV          "PAL_PROF"
+#define PAL_PROF_FLAG         "/tmp/pal_prof"
+#define PAL_PROF_SHM_DIR      "/dev/shm"
+#define PAL_PROF_SHM_PREFIX   "pal_prof."
+#define PAL_PROF_MAGIC        0x50414c50
+#define PAL_PROF_VERSION      2
+#define PAL_PROF_NAME_LEN     48
+// bucket i counts calls below 2^i us, the last one everything above
+#define PAL_PROF_BUCKETS      24
+// segments of processes which are gone, kept for pal-prof
+#define PAL_PROF_KEEP_EXITED  16
+#define PAL_PROF_KEEP_SECS    (24 * 3600)
+
+typedef struct {
+  char name[PAL_PROF_NAME_LEN];
+  uint64_t calls;
+  uint64_t errors;      // negative return values
+  uint64_t total_ns;
+  uint64_t max_ns;
+  uint64_t hist[PAL_PROF_BUCKETS];
+} pal_prof_func_t;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  int32_t pid;
+  uint32_t nfuncs;
+  char comm[16];
+  int64_t start;        // when profiling started, or was last reset
+  int64_t exited;       // when the process exited, 0 while running
+  pal_prof_func_t funcs[];
+} pal_prof_shm_t;
+
+#define PAL_PROF_SHM_SIZE(n) \
+  (sizeof(pal_prof_shm_t) + (n) * sizeof(pal_prof_func_t))
+
+// Stats of this process, NULL while profiling is off
+extern pal_prof_func_t *pal_prof_stats __attribute__((visibility("hidden")));
+
+// Tables generated along with the wrappers
+extern const char *const pal_prof_names[] __attribute__((visibility("hidden")));
+extern const int pal_prof_nfuncs __attribute__((visibility("hidden")));
+
+uint64_t pal_prof_now(void) __attribute__((visibility("hidden")));
+void pal_prof_record(int idx, uint64_t start, bool error)
+  __attribute__((visibility("hidden")));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PAL_PROF_H__ */
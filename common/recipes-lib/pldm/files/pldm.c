@@ -29,8 +29,10 @@
 #include <stddef.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include <zlib.h>
 #include <openbmc/ncsi.h>
 #include "pldm_base.h"
 #include "pldm_fw_update.h"
@@ -45,6 +47,10 @@
   #define DBG_PRINT(fmt, args...)
 #endif
 
+// component images are checksummed in chunks of this size, so that only
+// one chunk of a large package is resident at a time
+#define PLDM_CRC_CHUNK (1024 * 1024)
+
 // global PLDM control & configuration variables
 static uint8_t  gPldm_iid = 0; // technically only 5 bits as per DSP0240 v1.0.0
 static uint32_t gPldm_transfer_size = PLDM_MAX_XFER_SIZE;
@@ -319,6 +325,11 @@ void pldmCreateUpdateComponentCmd(pldm_fw_pkg_hdr_t *pFwPkgHdr, uint8_t compIdx,
 
   printf("\n\nCMD_UPDATE_COMPONENT\n");
 
+  // FW data requested from now on is for this component
+  memset(&pFwPkgHdr->xfer, 0, sizeof(pFwPkgHdr->xfer));
+  pFwPkgHdr->xfer.comp = compIdx;
+  pFwPkgHdr->xfer.inOrder = true;
+
   genReqCommonFields(PLDM_TYPE_FIRMWARE_UPDATE, CMD_UPDATE_COMPONENT, &(pPldmCdb->common[0]));
 
   pCmdPayload->_class = pCompImgInfo->_class;
@@ -497,9 +508,18 @@ void printComponentImgInfo(pldm_fw_pkg_hdr_t *pFwPkgHdr, int index)
 }
 
 
+// does [offset, offset + len) lie within the package header?
+static bool
+hdr_fits(pldm_fw_pkg_hdr_t *pFwPkgHdr, int offset, uint64_t len)
+{
+  return offset >= 0 &&
+         (uint64_t)offset + len <= pFwPkgHdr->phdrInfo->headerSize;
+}
+
+
 // Given a PLDM Firmware package, this function will
 //  1. allocate a pldm_fw_pkg_hdr_t structure representing this package,
-//  2. read PLDM firmware package to RAM
+//  2. map PLDM firmware package read-only, pages are read on demand
 //  3. initialize header info area of pldm_fw_pkg_hdr_t
 //  4. returns
 //       1. pointer to the struct,
@@ -508,59 +528,71 @@ void printComponentImgInfo(pldm_fw_pkg_hdr_t *pFwPkgHdr, int index)
 int
 init_pkg_hdr_info(char *path, pldm_fw_pkg_hdr_t** pFwPkgHdr, int *pOffset)
 {
-  FILE *fp;
-  int rcnt, size;
+  int fd;
   struct stat buf;
-
-  // Open the file exclusively for read
-  fp = fopen(path, "r");
-  if (!fp) {
-    printf("ERROR: invalid file path :%s!\n", path);
-    return -1;
-  }
-
-  stat(path, &buf);
-  size = buf.st_size;
-  printf("size of file is %d bytes\n", size);
+  void *map;
+  pldm_fw_pkg_hdr_info_t *phdrInfo;
 
   // allocate pointer structure to access fw pkg header
   *pFwPkgHdr = (pldm_fw_pkg_hdr_t *)calloc(1, sizeof(pldm_fw_pkg_hdr_t));
   if (!(*pFwPkgHdr)) {
     printf("ERROR: pFwPkgHdr malloc failed, size %zu\n", sizeof(pldm_fw_pkg_hdr_t));
-    fclose(fp);
     return -1;
   }
+  (*pFwPkgHdr)->pkgFd = -1;
 
-  // allocate actual buffer to store fw package header
-  (*pFwPkgHdr)->rawHdrBuf = (unsigned char *)calloc(1, size);
-  if (!(*pFwPkgHdr)->rawHdrBuf) {
-    printf("ERROR: rawHdrBuf malloc failed, size %d\n", size);
-    fclose(fp);
-    return -1;
+  fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    printf("ERROR: invalid file path :%s!\n", path);
+    goto error_exit;
   }
 
-  // Move the file pointer to the start and read the entire package header
-  fseek(fp, 0, SEEK_SET);
-  rcnt = fread((*pFwPkgHdr)->rawHdrBuf, 1, size, fp);
-  if (rcnt < size) {
-    printf("ERROR: rawHdrBuf read, rcnt(%d) < %d", rcnt,
-           size);
-    fclose(fp);
-    return -1;
+  if (fstat(fd, &buf) < 0 ||
+      buf.st_size < offsetof(pldm_fw_pkg_hdr_info_t, versionString)) {
+    printf("ERROR: %s is too small for a PLDM package\n", path);
+    close(fd);
+    goto error_exit;
   }
-  fclose(fp);
-
+  printf("size of file is %zu bytes\n", (size_t)buf.st_size);
 
-  (*pFwPkgHdr)->phdrInfo = (pldm_fw_pkg_hdr_info_t *)(*pFwPkgHdr)->rawHdrBuf;
-  printHdrInfo((*pFwPkgHdr)->phdrInfo, 1);
-  *pOffset += offsetof(pldm_fw_pkg_hdr_info_t, versionString) +
-             (*pFwPkgHdr)->phdrInfo->versionStringLength;
-  if (!isPldmFwUuid((char *)((*pFwPkgHdr)->phdrInfo->uuid))) {
+  map = mmap(NULL, buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) {
+    printf("ERROR: failed to map %s, errno %d\n", path, errno);
+    close(fd);
+    goto error_exit;
+  }
+  (*pFwPkgHdr)->rawHdrBuf = map;
+  (*pFwPkgHdr)->pkgSize = buf.st_size;
+  (*pFwPkgHdr)->pkgFd = fd;
+  (*pFwPkgHdr)->pkgMtime = buf.st_mtim;
+
+  phdrInfo = (pldm_fw_pkg_hdr_info_t *)(*pFwPkgHdr)->rawHdrBuf;
+  (*pFwPkgHdr)->phdrInfo = phdrInfo;
+  if (!isPldmFwUuid((char *)(phdrInfo->uuid))) {
     printf("Not a valid PLDM package, exiting\n");
-    return -1;
+    goto error_exit;
+  }
+  if (phdrInfo->headerSize > (*pFwPkgHdr)->pkgSize) {
+    printf("ERROR: header size(0x%x) exceeds package size(0x%zx)\n",
+           phdrInfo->headerSize, (*pFwPkgHdr)->pkgSize);
+    goto error_exit;
   }
+  if (!hdr_fits(*pFwPkgHdr, 0, offsetof(pldm_fw_pkg_hdr_info_t, versionString) +
+                phdrInfo->versionStringLength)) {
+    printf("ERROR: version string exceeds header size(0x%x)\n",
+           phdrInfo->headerSize);
+    goto error_exit;
+  }
+  printHdrInfo(phdrInfo, 1);
+  *pOffset += offsetof(pldm_fw_pkg_hdr_info_t, versionString) +
+             phdrInfo->versionStringLength;
 
   return 0;
+
+error_exit:
+  free_pldm_pkg_data(pFwPkgHdr);
+  *pFwPkgHdr = NULL;
+  return -1;
 }
 
 
@@ -579,6 +611,11 @@ init_device_id_records(pldm_fw_pkg_hdr_t* pFwPkgHdr, int *pOffset)
 {
   int i;
 
+  if (!hdr_fits(pFwPkgHdr, *pOffset, sizeof(pFwPkgHdr->devIdRecordCnt))) {
+    printf("ERROR: device ID record count exceeds header size(0x%x)\n",
+           pFwPkgHdr->phdrInfo->headerSize);
+    return -1;
+  }
   pFwPkgHdr->devIdRecordCnt = pFwPkgHdr->rawHdrBuf[*pOffset];
   *pOffset += sizeof(pFwPkgHdr->devIdRecordCnt);
   DBG_PRINT("\n\n Number of Device ID Record in package (devIdRecordCnt) =%d\n",
@@ -610,14 +647,25 @@ init_device_id_records(pldm_fw_pkg_hdr_t* pFwPkgHdr, int *pOffset)
     // "suboffset" is used to initialize subfields within current deviceRecord
     //    that are variable length
     int  subOffset = *pOffset;
-
+    // the fixed part, the applicable components bitmap (its length is
+    // defined in hdr info) and the version string must all be in the header
+    if (!hdr_fits(pFwPkgHdr, subOffset, sizeof(pldm_fw_dev_id_records_fixed_len_t))) {
+      printf("ERROR: DevRec[%d] exceeds header size(0x%x)\n", i,
+             pFwPkgHdr->phdrInfo->headerSize);
+      return -1;
+    }
     pDevIdRec->pRecords = (pldm_fw_dev_id_records_fixed_len_t *)(pFwPkgHdr->rawHdrBuf + subOffset);
     subOffset += sizeof(pldm_fw_dev_id_records_fixed_len_t);
     pDevIdRec->pApplicableComponents = (uint8_t *)(pFwPkgHdr->rawHdrBuf + subOffset);
-    // length of pApplicableComponents field is defined in hdr info,
     subOffset += (pFwPkgHdr->phdrInfo->componentBitmapBitLength/8);
     pDevIdRec->versionString = (uint8_t *)(pFwPkgHdr->rawHdrBuf + subOffset);
     subOffset += pDevIdRec->pRecords->compImgSetVersionStringLength;
+    if (!hdr_fits(pFwPkgHdr, subOffset, 0) ||
+        !hdr_fits(pFwPkgHdr, *pOffset, pDevIdRec->pRecords->recordLength)) {
+      printf("ERROR: DevRec[%d] exceeds header size(0x%x)\n", i,
+             pFwPkgHdr->phdrInfo->headerSize);
+      return -1;
+    }
 
     // allocate a look up table of pointers to each Record Descriptor
     pDevIdRec->pRecordDes =
@@ -631,8 +679,16 @@ init_device_id_records(pldm_fw_pkg_hdr_t* pFwPkgHdr, int *pOffset)
     }
     for (int j=0; j<pDevIdRec->pRecords->descriptorCnt; ++j)
     {
-      pDevIdRec->pRecordDes[j] = (record_descriptors_t *)(pFwPkgHdr->rawHdrBuf + subOffset);
-      subOffset += (offsetof(record_descriptors_t, data) + pDevIdRec->pRecordDes[j]->length);
+      record_descriptors_t *pDes = (record_descriptors_t *)(pFwPkgHdr->rawHdrBuf + subOffset);
+
+      if (!hdr_fits(pFwPkgHdr, subOffset, offsetof(record_descriptors_t, data)) ||
+          !hdr_fits(pFwPkgHdr, subOffset, offsetof(record_descriptors_t, data) + pDes->length)) {
+        printf("ERROR: DevRec[%d] descriptor[%d] exceeds header size(0x%x)\n",
+               i, j, pFwPkgHdr->phdrInfo->headerSize);
+        return -1;
+      }
+      pDevIdRec->pRecordDes[j] = pDes;
+      subOffset += (offsetof(record_descriptors_t, data) + pDes->length);
     }
 
 
@@ -663,6 +719,11 @@ init_component_img_info(pldm_fw_pkg_hdr_t* pFwPkgHdr, int *pOffset)
 {
   int i;
 
+  if (!hdr_fits(pFwPkgHdr, *pOffset, sizeof(pFwPkgHdr->componentImageCnt))) {
+    printf("ERROR: component count exceeds header size(0x%x)\n",
+           pFwPkgHdr->phdrInfo->headerSize);
+    return -1;
+  }
   pFwPkgHdr->componentImageCnt = pFwPkgHdr->rawHdrBuf[*pOffset];
   *pOffset += sizeof(pFwPkgHdr->componentImageCnt);
   DBG_PRINT("\n\n Number of Component in package (componentImageCnt) =%d\n",
@@ -680,6 +741,13 @@ init_component_img_info(pldm_fw_pkg_hdr_t* pFwPkgHdr, int *pOffset)
   for (i=0; i<pFwPkgHdr->componentImageCnt; ++i)
   {
     pFwPkgHdr->pCompImgInfo[i] = (pldm_component_img_info_t *)(pFwPkgHdr->rawHdrBuf + *pOffset);
+    if (!hdr_fits(pFwPkgHdr, *pOffset, offsetof(pldm_component_img_info_t, versionString)) ||
+        !hdr_fits(pFwPkgHdr, *pOffset, offsetof(pldm_component_img_info_t, versionString) +
+                  pFwPkgHdr->pCompImgInfo[i]->versionStringLength)) {
+      printf("ERROR: Component[%d] info exceeds header size(0x%x)\n", i,
+             pFwPkgHdr->phdrInfo->headerSize);
+      return -1;
+    }
     printComponentImgInfo(pFwPkgHdr, i);
 
     // move pointer to next Component image, taking int account of variable
@@ -692,6 +760,52 @@ init_component_img_info(pldm_fw_pkg_hdr_t* pFwPkgHdr, int *pOffset)
 }
 
 
+// check each component image lies within the package, and compute its
+// CRC32 a chunk at a time, dropping each chunk from the mapping once
+// done so that large packages do not stay resident
+static int
+init_component_img_crc(pldm_fw_pkg_hdr_t* pFwPkgHdr)
+{
+  long page = sysconf(_SC_PAGESIZE);
+  int i;
+
+  pFwPkgHdr->pCompCrc = calloc(pFwPkgHdr->componentImageCnt, sizeof(uint32_t));
+  if (pFwPkgHdr->componentImageCnt && !pFwPkgHdr->pCompCrc) {
+    printf("ERROR: pFwPkgHdr->pCompCrc malloc failed\n");
+    return -1;
+  }
+
+  posix_madvise(pFwPkgHdr->rawHdrBuf, pFwPkgHdr->pkgSize, POSIX_MADV_SEQUENTIAL);
+  for (i=0; i<pFwPkgHdr->componentImageCnt; ++i) {
+    pldm_component_img_info_t *pComp = pFwPkgHdr->pCompImgInfo[i];
+    uint64_t end = (uint64_t)pComp->locationOffset + pComp->size;
+    uint32_t off, len;
+    uLong crc = crc32(0, NULL, 0);
+
+    if (end > pFwPkgHdr->pkgSize) {
+      printf("ERROR: component[%d] (0x%x+0x%x) exceeds package size(0x%zx)\n",
+             i, pComp->locationOffset, pComp->size, pFwPkgHdr->pkgSize);
+      return -1;
+    }
+    for (off = pComp->locationOffset; off < end; off += len) {
+      unsigned char *p = pFwPkgHdr->rawHdrBuf + off;
+      uintptr_t start = ((uintptr_t)p + page - 1) & ~(uintptr_t)(page - 1);
+
+      len = end - off < PLDM_CRC_CHUNK ? end - off : PLDM_CRC_CHUNK;
+      crc = crc32(crc, p, len);
+      if ((uintptr_t)p + len > start) {
+        madvise((void *)start, ((uintptr_t)p + len - start) & ~(uintptr_t)(page - 1),
+                MADV_DONTNEED);
+      }
+    }
+    pFwPkgHdr->pCompCrc[i] = crc;
+    printf("Component[%d] CRC32=0x%x\n", i, pFwPkgHdr->pCompCrc[i]);
+  }
+  posix_madvise(pFwPkgHdr->rawHdrBuf, pFwPkgHdr->pkgSize, POSIX_MADV_NORMAL);
+  return 0;
+}
+
+
 // free up all pointers allocated in pldm_fw_pkg_hdr_t *pFwPkgHdr
 void
 free_pldm_pkg_data(pldm_fw_pkg_hdr_t **pFwPkgHdr)
@@ -716,8 +830,14 @@ free_pldm_pkg_data(pldm_fw_pkg_hdr_t **pFwPkgHdr)
   if ((*pFwPkgHdr)->pCompImgInfo) {
     free((*pFwPkgHdr)->pCompImgInfo);
   }
+  if ((*pFwPkgHdr)->pCompCrc) {
+    free((*pFwPkgHdr)->pCompCrc);
+  }
   if ((*pFwPkgHdr)->rawHdrBuf) {
-    free((*pFwPkgHdr)->rawHdrBuf);
+    munmap((*pFwPkgHdr)->rawHdrBuf, (*pFwPkgHdr)->pkgSize);
+  }
+  if ((*pFwPkgHdr)->pkgFd >= 0) {
+    close((*pFwPkgHdr)->pkgFd);
   }
   free(*pFwPkgHdr);
   return;
@@ -731,7 +851,7 @@ pldm_parse_fw_pkg(char *path) {
   int offset = 0;
 
   // firmware package header
-  pldm_fw_pkg_hdr_t *pFwPkgHdr;
+  pldm_fw_pkg_hdr_t *pFwPkgHdr = NULL;
 
   // initialize pFwPkgHdr access pointer as fw package header contains
   // multiple variable size fields
@@ -756,15 +876,30 @@ pldm_parse_fw_pkg(char *path) {
   }
 
   // pkg header checksum
-  pFwPkgHdr->pkgHdrChksum = *(uint32_t *)(pFwPkgHdr->rawHdrBuf+ offset);
-  offset += sizeof(uint32_t);
+  if (!hdr_fits(pFwPkgHdr, offset, sizeof(uint32_t))) {
+    printf("ERROR: package header checksum exceeds header size(0x%x)\n",
+           pFwPkgHdr->phdrInfo->headerSize);
+    goto error_exit;
+  }
+  memcpy(&pFwPkgHdr->pkgHdrChksum, pFwPkgHdr->rawHdrBuf + offset, sizeof(uint32_t));
   printf("\n\nPDLM Firmware Package Checksum=0x%x\n", pFwPkgHdr->pkgHdrChksum);
+  if (crc32(0, pFwPkgHdr->rawHdrBuf, offset) != pFwPkgHdr->pkgHdrChksum) {
+    printf("ERROR: package header checksum mismatch (computed 0x%lx)\n",
+           crc32(0, pFwPkgHdr->rawHdrBuf, offset));
+    goto error_exit;
+  }
+  offset += sizeof(uint32_t);
 
   if (pFwPkgHdr->phdrInfo->headerSize != offset) {
     printf("ERROR: header size(0x%x) and processed data (0x%x) mismatch\n",
             pFwPkgHdr->phdrInfo->headerSize, offset);
   }
 
+  // component images
+  ret = init_component_img_crc(pFwPkgHdr);
+  if (ret < 0) {
+    goto error_exit;
+  }
 
   return pFwPkgHdr;
 
@@ -774,54 +909,125 @@ error_exit:
   return 0;
 }
 
-static
-int handlePldmReqFwData(pldm_fw_pkg_hdr_t *pkgHdr, pldm_cmd_req *pCmd, pldm_response *pldmRes)
+// report transfer progress at most once a second, and at the end
+static void
+pldmReportXferProgress(pldm_fw_pkg_hdr_t *pkgHdr, uint32_t done, uint32_t size)
 {
-  PLDM_RequestFWData_t *pReqDataCmd = (PLDM_RequestFWData_t *)pCmd->payload;
-  // for now assumes  it's always component 0
-  unsigned char *pComponent =
-       (unsigned char*)(pkgHdr->rawHdrBuf + pkgHdr->pCompImgInfo[0]->locationOffset);
-  uint32_t componentSize = pkgHdr->pCompImgInfo[0]->size;
+  struct timespec ts;
 
-  // calculate how much FW data is left to transfer and if any padding is needed
-  int compBytesLeft = componentSize - pReqDataCmd->offset;
-  int numPaddingNeeded = pReqDataCmd->length > compBytesLeft ?
-                   (pReqDataCmd->length - compBytesLeft) : 0;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  if (done < size && ts.tv_sec == pkgHdr->xfer.lastProgress) {
+    return;
+  }
+  pkgHdr->xfer.lastProgress = ts.tv_sec;
+  printf("\rComponent[%d] transferred %u/%u bytes (%u%%)%s",
+         pkgHdr->xfer.comp, done, size,
+         size ? (uint32_t)((uint64_t)done * 100 / size) : 100,
+         done < size ? "" : "\n");
+  fflush(stdout);
+}
+
+// whether the package file is still the one which was parsed
+static bool
+pldmPkgUnchanged(pldm_fw_pkg_hdr_t *pkgHdr)
+{
+  struct stat buf;
 
+  if (fstat(pkgHdr->pkgFd, &buf) < 0) {
+    return false;
+  }
+  return (size_t)buf.st_size == pkgHdr->pkgSize &&
+         buf.st_mtim.tv_sec == pkgHdr->pkgMtime.tv_sec &&
+         buf.st_mtim.tv_nsec == pkgHdr->pkgMtime.tv_nsec;
+}
 
-  printf("\r%s offset = 0x%x, length = 0x%x, compBytesLeft=%d, numPadding=%d",
-         __FUNCTION__, pReqDataCmd->offset, pReqDataCmd->length, compBytesLeft,
-         numPaddingNeeded);
-  fflush(stdout);
+static
+int handlePldmReqFwData(pldm_fw_pkg_hdr_t *pkgHdr, pldm_cmd_req *pCmd, pldm_response *pldmRes)
+{
+  PLDM_RequestFWData_t *pReqDataCmd = (PLDM_RequestFWData_t *)pCmd->payload;
+  pldm_fw_xfer_t *xfer = &pkgHdr->xfer;
+  pldm_component_img_info_t *pCompInfo;
+  unsigned char *pData;
+  uint32_t componentSize, offset, length, dataLen;
 
   memcpy(pldmRes->common, pCmd->common, PLDM_COMMON_REQ_LEN);
   // clear Req bit in PLDM response header
   pldmRes->common[PLDM_IID_OFFSET] &= PLDM_RESP_MASK;
-  // hard code success for now, need to check length in the future
-  pldmRes->common[PLDM_CC_OFFSET] = CC_SUCCESS;
+  pldmRes->resp_size = PLDM_COMMON_RES_LEN;
 
+  if (xfer->comp >= pkgHdr->componentImageCnt) {
+    pldmRes->common[PLDM_CC_OFFSET] = CC_COMMAND_NOT_EXPECTED;
+    return 0;
+  }
+  pCompInfo = pkgHdr->pCompImgInfo[xfer->comp];
+  componentSize = pCompInfo->size;
+  offset = pReqDataCmd->offset;
+  length = pReqDataCmd->length;
+
+  if (length > PLDM_MAX_XFER_SIZE) {
+    pldmRes->common[PLDM_CC_OFFSET] = CC_INVALID_TRANSFER_LENTH;
+    return 0;
+  }
+  // the FD may read up to one transfer past the end, as padding
+  if ((uint64_t)offset + length > (uint64_t)componentSize + PLDM_MAX_XFER_SIZE) {
+    pldmRes->common[PLDM_CC_OFFSET] = CC_DATA_OUT_OF_RANGE;
+    return 0;
+  }
 
-  if (numPaddingNeeded > 0) {
-    printf("%s %d bytes padding added\n", __FUNCTION__, numPaddingNeeded);
-    memcpy(pldmRes->response, pComponent + pReqDataCmd->offset, compBytesLeft);
-    memset(pldmRes->response + compBytesLeft, 0, numPaddingNeeded);
+  // the data is read from the package file rather than the mapping,
+  // which would raise SIGBUS if the file was truncated meanwhile;
+  // anything past the end of the component is padded with zeroes
+  pData = pldmRes->response;
+  if (offset >= componentSize) {
+    dataLen = 0;
   } else {
-    memcpy(pldmRes->response, pComponent + pReqDataCmd->offset, pReqDataCmd->length);
+    dataLen = length > componentSize - offset ? componentSize - offset : length;
+  }
+  if (!pldmPkgUnchanged(pkgHdr) ||
+      pread(pkgHdr->pkgFd, pData, dataLen,
+            (off_t)pCompInfo->locationOffset + offset) != (ssize_t)dataLen) {
+    printf("\nError, the package changed on disk during the update, "
+           "aborting\n");
+    pldmRes->common[PLDM_CC_OFFSET] = CC_NO_PACKAGE_DATA;
+    return -1;
+  }
+  memset(pldmRes->response + dataLen, 0, length - dataLen);
+  pldmRes->common[PLDM_CC_OFFSET] = CC_SUCCESS;
+  pldmRes->resp_size = PLDM_COMMON_RES_LEN + length;
+
+  // checksum what the FD received, retried requests are sent again as is
+  if (offset == xfer->nextOffset) {
+    xfer->crc = crc32(xfer->crc, pData, dataLen);
+    xfer->nextOffset += dataLen;
+  } else if (offset > xfer->nextOffset) {
+    xfer->inOrder = false;
+  }
+  if (dataLen) {
+    pldmReportXferProgress(pkgHdr, offset + dataLen, componentSize);
   }
-  pldmRes->resp_size = PLDM_COMMON_RES_LEN + pReqDataCmd->length;
 
   return 0;
 }
 
 static
-int handlePldmFwTransferComplete(pldm_cmd_req *pCmd, pldm_response *pRes)
+int handlePldmFwTransferComplete(pldm_fw_pkg_hdr_t *pkgHdr, pldm_cmd_req *pCmd,
+                                 pldm_response *pRes)
 {
   PLDM_TransferComplete_t *pReqDataCmd = (PLDM_TransferComplete_t *)pCmd->payload;
+  pldm_fw_xfer_t *xfer = &pkgHdr->xfer;
   int ret = 0;
 
   if (pReqDataCmd->transferResult != 0) {
     printf("Error, transfer failed, err=%d\n", pReqDataCmd->transferResult);
     ret = -1;
+  } else if (xfer->comp < pkgHdr->componentImageCnt && xfer->inOrder &&
+             xfer->nextOffset == pkgHdr->pCompImgInfo[xfer->comp]->size &&
+             xfer->crc != pkgHdr->pCompCrc[xfer->comp]) {
+    // the FD was sent something other than the parsed component
+    printf("Error, component[%d] CRC32 0x%x of the transferred data, "
+           "expected 0x%x\n", xfer->comp, xfer->crc,
+           pkgHdr->pCompCrc[xfer->comp]);
+    ret = -1;
   }
 
   memcpy(pRes->common, pCmd->common, PLDM_COMMON_REQ_LEN);
@@ -886,7 +1092,7 @@ int pldmFwUpdateCmdHandler(pldm_fw_pkg_hdr_t *pkgHdr, pldm_cmd_req *pCmd, pldm_r
     case CMD_TRANSFER_COMPLETE:
       printf("handle CMD_TRANSFER_COMPLETE\n");
       dbgPrintCdb(pCmd);
-      ret = handlePldmFwTransferComplete(pCmd, pRes);
+      ret = handlePldmFwTransferComplete(pkgHdr, pCmd, pRes);
       break;
     case CMD_VERIFY_COMPLETE:
       printf("handle CMD_VERIFY_COMPLETE\n");
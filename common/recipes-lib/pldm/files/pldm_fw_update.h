@@ -19,6 +19,8 @@
 #ifndef _PLDM_FW_UPDATE_H_
 #define _PLDM_FW_UPDATE_H_
 
+#include <stdbool.h>
+#include <time.h>
 #include "pldm_base.h"
 // defines data structure specified in DSP0267 v1.0.1 PLDM Firmware Update spec
 
@@ -203,11 +205,23 @@ typedef struct {
 } __attribute__((packed)) pldm_component_img_info_t;
 
 
+// state of the component image being transferred to the FD
+typedef struct {
+  uint8_t  comp;            // index of the component being updated
+  uint32_t nextOffset;      // end of the data sent in order so far
+  uint32_t crc;             // CRC32 of the data sent in order so far
+  bool     inOrder;         // all data was requested in order
+  time_t   lastProgress;    // when progress was last reported
+} __attribute__((packed)) pldm_fw_xfer_t;
+
 // defines PLDM firmwar package header structure,
 //  figure 5 on DSP0267 1.0.0
 //  detailed layout in Table 3
 typedef struct {
-  unsigned char *rawHdrBuf; // unparsed hdr buffer data bytes
+  unsigned char *rawHdrBuf; // whole package, mapped read-only
+  size_t pkgSize;
+  int pkgFd;                // kept open to serve and fstat() the package
+  struct timespec pkgMtime;
 
   // Use pointers for acccessing/interpreting hdr buffer above
 
@@ -224,6 +238,12 @@ typedef struct {
 
   // package header checksum area
   uint32_t pkgHdrChksum;
+
+  // CRC32 of each component image, computed when the package is parsed
+  uint32_t *pCompCrc;
+
+  // set by pldmCreateUpdateComponentCmd, used by RequestFirmwareData
+  pldm_fw_xfer_t xfer;
 } __attribute__((packed)) pldm_fw_pkg_hdr_t;
 
 #define PLDM_MAX_XFER_SIZE (MAX_PLDM_MSG_SIZE - PLDM_COMMON_RES_LEN)
@@ -0,0 +1,248 @@
+/*
+ * Runs the PSU update engine against a simulated Delta PSU.
+ *
+ * The simulated bootloader NAKs every access while it is busy with a
+ * block (3 ms) or a page commit (40 ms), the way the real one is assumed
+ * to. Every write it has to NAK is counted as a violation.
+ */
+#include <assert.h>
+#include <stdarg.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include "psu-update.h"
+
+#define SIM_FD        42
+#define SIM_PAGES     2
+#define SIM_BLKS      8
+#define SIM_BLK_US    3000
+#define SIM_PAGE_US   40000
+#define SIM_BOOT_US   300000
+
+i2c_info_t psu[] = {
+  {-1, 1, 0x50, 0x58, NULL},
+};
+
+static struct {
+  uint64_t busy_until;
+  uint64_t boot_at;
+  uint8_t mode;
+  uint8_t err;
+  uint8_t ram[SIM_BLKS][16];
+  uint8_t flash[SIM_PAGES][SIM_BLKS][16];
+  int pages;
+  int blocks;
+  int violations;
+  int crc_sent;
+  int fail_writes;  // NAK the next n writes
+  int paused;       // PSUs whose monitoring is stopped
+  int pauses;
+} sim;
+
+int
+psu_i2c_open(uint8_t bus, uint8_t addr) {
+  return SIM_FD;
+}
+
+int
+get_mfr_model(uint8_t num, uint8_t *block) {
+  strcpy((char *)block, DELTA_MODEL);
+  return 0;
+}
+
+int
+run_command(const char *cmd) {
+  return 0;
+}
+
+void
+sensord_operation(uint8_t num, uint8_t action) {
+  if (action == STOP) {
+    sim.paused++;
+    sim.pauses++;
+  } else if (action == START) {
+    sim.paused--;
+  }
+}
+
+void
+obmc_log_by_prio(int prio, const char *fmt, ...) {
+}
+
+void
+obmc_log_with_errno(int prio, const char *fmt, ...) {
+}
+
+int
+i2c_rdwr_msg_transfer(int file, __u8 addr, __u8 *tbuf, __u8 tcount,
+                      __u8 *rbuf, __u8 rcount) {
+  if (sim.fail_writes > 0) {
+    sim.fail_writes--;
+    return -1;
+  }
+  return 0;
+}
+
+static int
+sim_write_block(uint8_t cmd, const uint8_t *block, int len) {
+  uint64_t now = psu_now_us();
+
+  if (now < sim.busy_until || sim.fail_writes > 0) {
+    if (sim.fail_writes > 0) {
+      sim.fail_writes--;
+    } else {
+      sim.violations++;
+    }
+    return -1;
+  }
+  switch (cmd) {
+    case DATA_TO_RAM:
+      assert(len == 19 && block[0] == 0x20 && block[1] < SIM_BLKS);
+      memcpy(sim.ram[block[1]], &block[3], 16);
+      sim.blocks++;
+      sim.busy_until = now + SIM_BLK_US;
+      break;
+    case DATA_TO_FLASH:
+      assert(len == 3 && block[1] < SIM_PAGES);
+      memcpy(sim.flash[block[1]], sim.ram, sizeof(sim.ram));
+      sim.pages++;
+      sim.busy_until = now + SIM_PAGE_US;
+      break;
+    case CRC_CHECK:
+      sim.crc_sent++;
+      break;
+  }
+  return 0;
+}
+
+int
+ioctl(int fd, unsigned long req, ...) {
+  struct i2c_smbus_ioctl_data *args;
+  uint64_t now = psu_now_us();
+  va_list ap;
+
+  va_start(ap, req);
+  args = va_arg(ap, struct i2c_smbus_ioctl_data *);
+  va_end(ap);
+  if (fd != SIM_FD) {
+    // stdio asking about the terminal
+    return syscall(SYS_ioctl, fd, req, args);
+  }
+  if (req == I2C_PEC) {
+    return 0;
+  }
+  assert(req == I2C_SMBUS);
+
+  if (args->size == I2C_SMBUS_BLOCK_DATA && args->read_write == I2C_SMBUS_WRITE) {
+    return sim_write_block(args->command, &args->data->block[1], args->data->block[0]);
+  }
+  if (args->size == I2C_SMBUS_WORD_DATA && args->command == BOOT_FLAG) {
+    if ((args->data->word >> 8) == BOOT_MODE) {
+      sim.boot_at = now + SIM_BOOT_US;
+    } else {
+      sim.mode = 0;
+    }
+    return 0;
+  }
+  if (args->size == I2C_SMBUS_BYTE_DATA && args->command == BOOT_FLAG) {
+    if (now < sim.busy_until) {
+      return -1;
+    }
+    if (sim.boot_at && now >= sim.boot_at) {
+      sim.mode = 0x0d;
+      sim.boot_at = 0;
+    }
+    args->data->byte = sim.mode | sim.err;
+    return 0;
+  }
+  return 0;
+}
+
+static void
+make_image(const char *path, uint8_t *data) {
+  uint8_t hdr[DELTA_HDR_LENGTH] = {0};
+  FILE *fp;
+  int i;
+
+  hdr[4] = SIM_PAGES - 1;     // page_end
+  hdr[6] = 16;                // byte_per_blk
+  hdr[8] = SIM_BLKS;          // blk_per_page
+  hdr[10] = 0x20;             // secondary MCU
+  hdr[11] = 1;
+  hdr[15] = strlen(DELTA_MODEL);
+  memcpy(&hdr[16], DELTA_MODEL, strlen(DELTA_MODEL));
+  for (i = 0; i < SIM_PAGES * SIM_BLKS * 16; i++) {
+    data[i] = i * 13;
+  }
+  fp = fopen(path, "wb");
+  assert(fp != NULL);
+  assert(fwrite(hdr, 1, sizeof(hdr), fp) == sizeof(hdr));
+  assert(fwrite(data, 1, SIM_PAGES * SIM_BLKS * 16, fp) == SIM_PAGES * SIM_BLKS * 16);
+  fclose(fp);
+}
+
+void
+test_delta_update(const char *path, const uint8_t *data) {
+  psu_update_stats_t stats;
+  uint8_t num = 0;
+  uint64_t start;
+
+  memset(&sim, 0, sizeof(sim));
+  start = psu_now_us();
+  assert(do_update_psus(&num, 1, path, "delta", &stats) == 0);
+  assert(sim.blocks == SIM_PAGES * SIM_BLKS && sim.pages == SIM_PAGES);
+  assert(memcmp(sim.flash, data, sizeof(sim.flash)) == 0);
+  assert(sim.crc_sent == 1);
+  assert(sim.violations == 0);
+  assert(stats.blocks == SIM_PAGES * SIM_BLKS);
+  // the fixed delays (5 ms per block, 90 ms per page) are a minimum
+  assert(psu_now_us() - start >= SIM_PAGES * (SIM_BLKS * 5000 + 90000));
+  assert(sim.pauses == 1 && sim.paused == 0);
+  printf("PASSED: Image is transferred without writing to a busy PSU\n");
+}
+
+void
+test_delta_error(const char *path) {
+  uint8_t num = 0;
+
+  memset(&sim, 0, sizeof(sim));
+  sim.err = 0x20;
+  assert(do_update_psus(&num, 1, path, "delta", NULL) != 0);
+  assert(sim.blocks == 1);
+  // monitoring comes back even though the update failed
+  assert(sim.pauses == 1 && sim.paused == 0);
+  printf("PASSED: Transmission error stops the update\n");
+}
+
+void
+test_send_retry(void) {
+  psu_update_t u = {0};
+  psu_block_t blk = {0};
+  uint64_t start;
+
+  u.fd = SIM_FD;
+  u.vendor = &psu_vendors[0];
+  blk.fd = SIM_FD;
+  blk.raw = true;
+  blk.len = 2;
+  blk.max_us = 30000000;
+  memset(&sim, 0, sizeof(sim));
+  sim.fail_writes = 1;
+  start = psu_now_us();
+  assert(psu_send(&u, &blk) == 0);
+  // the retry must not wait for max_us
+  assert(psu_now_us() - start < 1000000);
+  printf("PASSED: Failed writes are retried without waiting max_us\n");
+}
+
+int
+main(int argc, char *argv[]) {
+  const char *path = "/tmp/psu-update-test.bin";
+  uint8_t data[SIM_PAGES * SIM_BLKS * 16];
+
+  make_image(path, data);
+  test_delta_update(path, data);
+  test_delta_error(path);
+  test_send_retry();
+  remove(path);
+  return 0;
+}
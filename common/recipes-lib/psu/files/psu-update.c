@@ -0,0 +1,443 @@
+/*
+ * Copyright 2021-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <openbmc/log.h>
+#include "psu-update.h"
+
+#define PSU_POLL_US       1000
+#define PSU_POLL_MAX_US   100000
+#define PSU_SEND_RETRY    3
+#define PSU_RETRY_US      100000
+#define MAX_PSU_BUS       16
+
+// PSUs whose sensor monitoring is paused, restored on abort
+static const uint8_t *paused_nums;
+static int paused_cnt;
+
+static void
+exithandler(int signum) {
+  printf("\nPSU update abort!\n");
+  syslog(LOG_WARNING, "PSU update abort!");
+  if (paused_cnt > 0) {
+    sensord_operation_batch(paused_nums, paused_cnt, START);
+  }
+  run_command("rm /var/run/psu-util.pid");
+  exit(0);
+}
+
+/*
+ * Platforms which can leave the other PSUs monitored while several are
+ * updated override this; by default each PSU is paused on its own.
+ */
+void __attribute__((weak))
+sensord_operation_batch(const uint8_t *nums, int count, uint8_t action) {
+  int i;
+
+  for (i = 0; i < count; i++) {
+    sensord_operation(nums[i], action);
+  }
+}
+
+uint64_t
+psu_now_us(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * Wait until the PSU is ready for the next block. The PSU is never asked
+ * before min_us. Past that, the PSU status is polled, starting a bit
+ * before the response time seen for the previous blocks of the same
+ * class. If the PSU never reports ready, we go on after max_us as the
+ * fixed delays used to do, unless the block is strict.
+ *
+ * Blocks with min_us == max_us keep a fixed delay; the status is read
+ * once afterwards only to catch errors reported by the PSU.
+ */
+int
+psu_wait(psu_update_t *u, const psu_block_t *blk) {
+  uint64_t start = psu_now_us(), elapsed;
+  uint32_t est = u->est_us[blk->pace];
+  uint32_t delay, interval;
+  int ret;
+
+  if (u->vendor->poll == NULL) {
+    usleep(blk->max_us);
+    return 0;
+  }
+  if (blk->min_us >= blk->max_us) {
+    usleep(blk->max_us);
+    u->stats.polls++;
+    ret = u->vendor->poll(u, blk);
+    if (ret == PSU_FAILED || (ret == PSU_BUSY && blk->strict)) {
+      return -1;
+    }
+    return 0;
+  }
+
+  delay = est * 3 / 4;
+  if (delay < blk->min_us) {
+    delay = blk->min_us;
+  }
+  if (delay > blk->max_us) {
+    delay = blk->max_us;
+  }
+  if (delay) {
+    usleep(delay);
+  }
+
+  interval = est / 8;
+  if (interval < PSU_POLL_US) {
+    interval = PSU_POLL_US;
+  }
+
+  while (1) {
+    ret = u->vendor->poll(u, blk);
+    u->stats.polls++;
+    elapsed = psu_now_us() - start;
+    if (ret == PSU_READY) {
+      u->est_us[blk->pace] = est ? (est * 7 + elapsed) / 8 : elapsed;
+      return 0;
+    }
+    if (ret == PSU_FAILED) {
+      return -1;
+    }
+    if (elapsed >= blk->max_us) {
+      u->stats.timeouts++;
+      if (blk->strict) {
+        OBMC_WARN("PSU%d not ready after %u ms\n", u->num + 1, blk->max_us / 1000);
+        return -1;
+      }
+      return 0;
+    }
+    if (interval > blk->max_us - elapsed) {
+      interval = blk->max_us - elapsed;
+    }
+    usleep(interval);
+    if (interval < PSU_POLL_MAX_US) {
+      interval *= 2;
+    }
+  }
+}
+
+void
+psu_record(psu_update_t *u, uint64_t start_us) {
+  uint32_t us = psu_now_us() - start_us;
+  uint32_t ms = us / 1000;
+  int n = 0;
+
+  while (n < PSU_HIST_BUCKETS - 1 && ms >= (1U << n)) {
+    n++;
+  }
+  u->stats.hist[n]++;
+  u->stats.blocks++;
+  u->stats.total_us += us;
+  if (us > u->stats.max_us) {
+    u->stats.max_us = us;
+  }
+}
+
+/* Send one block and wait until the PSU has taken it */
+int
+psu_send(psu_update_t *u, psu_block_t *blk) {
+  uint64_t start = psu_now_us();
+  int retry, ret = -1;
+
+  for (retry = 0; retry < PSU_SEND_RETRY; retry++) {
+    if (blk->raw) {
+      ret = i2c_rdwr_msg_transfer(blk->fd, blk->addr << 1, blk->data, blk->len, NULL, 0);
+    } else {
+      ret = i2c_smbus_write_block_data(blk->fd, blk->cmd, blk->len, blk->data);
+    }
+    if (ret < 0) {
+      // the PSU may still be busy with the previous block
+      usleep(blk->max_us < PSU_RETRY_US ? blk->max_us : PSU_RETRY_US);
+      continue;
+    }
+    ret = psu_wait(u, blk);
+    break;
+  }
+  if (ret < 0) {
+    OBMC_WARN("PSU%d: sending block failed\n", u->num + 1);
+    return -1;
+  }
+
+  if (blk->progress) {
+    psu_record(u, start);
+  }
+  return 0;
+}
+
+void
+psu_progress(psu_update_t *u, uint32_t done, uint32_t total) {
+  int pct = total ? (100 * done) / total : 100;
+
+  if (u->quiet) {
+    if (pct / 10 != u->last_pct / 10) {
+      printf("PSU%d: %d%%\n", u->num + 1, pct);
+    }
+  } else {
+    printf("-- (%d/%d) (%d%%/100%%) --\r", done, total, pct);
+    fflush(stdout);
+  }
+  u->last_pct = pct;
+}
+
+static void
+print_update_stats(uint8_t num, const psu_update_stats_t *stats) {
+  int i;
+
+  if (stats->blocks == 0) {
+    return;
+  }
+
+  printf("PSU%d: %u blocks in %llu ms, max %u ms, %u polls, %u timeouts\n",
+         num + 1, stats->blocks, (unsigned long long)stats->total_us / 1000,
+         stats->max_us / 1000, stats->polls, stats->timeouts);
+  for (i = 0; i < PSU_HIST_BUCKETS; i++) {
+    if (stats->hist[i] == 0) {
+      continue;
+    }
+    if (i < PSU_HIST_BUCKETS - 1) {
+      printf("  < %5u ms: %u\n", 1U << i, stats->hist[i]);
+    } else {
+      printf("  >=%5u ms: %u\n", 1U << (i - 1), stats->hist[i]);
+    }
+  }
+}
+
+static const psu_vendor_t *
+find_vendor(uint8_t num, const char *vendor) {
+  uint8_t block[I2C_SMBUS_BLOCK_MAX + 1] = {0};
+  int i;
+
+  if (vendor != NULL) {
+    for (i = 0; i < psu_vendor_cnt; i++) {
+      if (!strncasecmp(vendor, psu_vendors[i].name, strlen(psu_vendors[i].name))) {
+        return &psu_vendors[i];
+      }
+    }
+    printf("Unsupported vendor: %s\n", vendor);
+    return NULL;
+  }
+
+  if (get_mfr_model(num, block) < 0) {
+    printf("Cannot Get PSU Model\n");
+    return NULL;
+  }
+  for (i = 0; i < psu_vendor_cnt; i++) {
+    if (!strncmp((char *)block, psu_vendors[i].model, strlen(psu_vendors[i].model))) {
+      return &psu_vendors[i];
+    }
+  }
+  printf("Unsupported device: %s\n", block);
+  return NULL;
+}
+
+static int
+update_psu(uint8_t num, const char *file_path, const char *vendor,
+           bool quiet, psu_update_stats_t *stats) {
+  psu_update_t *u;
+  psu_block_t blk;
+  int ret = UPDATE_SKIP;
+
+  u = calloc(1, sizeof(*u));
+  if (u == NULL) {
+    return -1;
+  }
+  u->num = num;
+  u->quiet = quiet;
+  u->boot_fd = -1;
+
+  psu[num].fd = psu_i2c_open(psu[num].bus, psu[num].pmbus_addr);
+  u->fd = psu[num].fd;
+  if (u->fd < 0) {
+    ERR_PRINT("Fail to open i2c");
+    goto exit;
+  }
+
+  u->vendor = find_vendor(num, vendor);
+  if (u->vendor == NULL) {
+    goto exit;
+  }
+
+  if (u->vendor->parse(u, file_path) < 0) {
+    goto exit;
+  }
+  if (vendor == NULL && u->model_id != u->vendor->id) {
+    printf("PSU and image doesn't match!\n");
+    goto exit;
+  }
+
+  if (u->vendor->start && (ret = u->vendor->start(u, file_path)) != 0) {
+    goto exit;
+  }
+
+  if (u->vendor->transmit) {
+    ret = u->vendor->transmit(u, file_path);
+  } else {
+    while ((ret = u->vendor->next(u, &blk)) > 0) {
+      if (psu_send(u, &blk) < 0) {
+        ret = -1;
+        break;
+      }
+      if (blk.progress) {
+        psu_progress(u, ++u->done, u->total);
+      }
+    }
+    if (!u->quiet) {
+      printf("\n");
+    }
+  }
+  if (ret < 0) {
+    goto exit;
+  }
+
+  if (u->vendor->finish && (ret = u->vendor->finish(u)) < 0) {
+    goto exit;
+  }
+  print_update_stats(num, &u->stats);
+
+exit:
+  if (stats) {
+    *stats = u->stats;
+  }
+  if (u->boot_fd >= 0) {
+    close(u->boot_fd);
+  }
+  if (u->fp) {
+    fclose(u->fp);
+  }
+  free(u->image);
+  if (psu[num].fd >= 0) {
+    close(psu[num].fd);
+  }
+  free(u);
+  return ret;
+}
+
+int
+do_update_psu(uint8_t num, const char *file_path, const char *vendor) {
+  return do_update_psus(&num, 1, file_path, vendor, NULL);
+}
+
+typedef struct {
+  pthread_t tid;
+  uint8_t bus;
+  const uint8_t *nums;
+  int count;
+  const char *file_path;
+  const char *vendor;
+  int *rets;
+  psu_update_stats_t *stats;
+} bus_worker_t;
+
+/* PSUs sharing a bus are updated one after another */
+static void *
+update_bus(void *arg) {
+  bus_worker_t *w = (bus_worker_t *)arg;
+  int i;
+
+  for (i = 0; i < w->count; i++) {
+    if (psu[w->nums[i]].bus != w->bus) {
+      continue;
+    }
+    w->rets[i] = update_psu(w->nums[i], w->file_path, w->vendor, w->count > 1,
+                            w->stats ? &w->stats[i] : NULL);
+    if (w->count > 1) {
+      printf("PSU%d update %s\n", w->nums[i] + 1,
+             w->rets[i] == 0 ? "done" : (w->rets[i] == UPDATE_SKIP ? "skipped" : "failed"));
+    }
+  }
+  return NULL;
+}
+
+int
+do_update_psus(const uint8_t *nums, int count, const char *file_path,
+               const char *vendor, psu_update_stats_t *stats) {
+  bus_worker_t workers[MAX_PSU_BUS];
+  int rets[count];
+  int i, j, nworkers = 0, nthreads = 0, ret = 0;
+
+  signal(SIGHUP, exithandler);
+  signal(SIGINT, exithandler);
+  signal(SIGTERM, exithandler);
+  signal(SIGQUIT, exithandler);
+
+  for (i = 0; i < count; i++) {
+    rets[i] = UPDATE_SKIP;
+    for (j = 0; j < nworkers; j++) {
+      if (workers[j].bus == psu[nums[i]].bus)
+        break;
+    }
+    if (j < nworkers) {
+      continue;
+    }
+    if (nworkers >= MAX_PSU_BUS) {
+      OBMC_WARN("Too many buses, PSU%d is not updated\n", nums[i] + 1);
+      rets[i] = -1;
+      continue;
+    }
+    workers[nworkers].bus = psu[nums[i]].bus;
+    workers[nworkers].nums = nums;
+    workers[nworkers].count = count;
+    workers[nworkers].file_path = file_path;
+    workers[nworkers].vendor = vendor;
+    workers[nworkers].rets = rets;
+    workers[nworkers].stats = stats;
+    nworkers++;
+  }
+
+  paused_nums = nums;
+  paused_cnt = count;
+  sensord_operation_batch(nums, count, STOP);
+
+  for (j = 1; j < nworkers; j++, nthreads++) {
+    if (pthread_create(&workers[j].tid, NULL, update_bus, &workers[j])) {
+      OBMC_WARN("Failed to start the update of bus %d\n", workers[j].bus);
+      break;
+    }
+  }
+  for (j = nthreads + 1; j < nworkers; j++) {
+    update_bus(&workers[j]);
+  }
+  if (nworkers > 0) {
+    update_bus(&workers[0]);
+  }
+  for (j = 1; j <= nthreads; j++) {
+    pthread_join(workers[j].tid, NULL);
+  }
+
+  for (i = 0; i < count; i++) {
+    if (rets[i] != 0 && (ret == 0 || ret == UPDATE_SKIP)) {
+      ret = rets[i];
+    }
+  }
+
+  // resume monitoring even on failure, sensord then reports the broken PSU
+  paused_cnt = 0;
+  sensord_operation_batch(nums, count, START);
+  run_command("rm /var/run/psu-util.pid");
+
+  return ret;
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright 2021-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * Internal interface between the PSU update engine (psu-update.c) and the
+ * vendor modules (psu-vendors.c). A vendor module only describes how the
+ * image is cut into blocks, how they are framed and how to ask the PSU
+ * whether it is ready for the next one; sending, pacing, progress and
+ * timing are done by the engine.
+ */
+#ifndef __PSU_UPDATE_H__
+#define __PSU_UPDATE_H__
+
+#include <stdbool.h>
+#include <openbmc/obmc-i2c.h>
+#include "psu.h"
+
+extern i2c_info_t psu[];
+
+extern void sensord_operation(uint8_t num, uint8_t action);
+extern void sensord_operation_batch(const uint8_t *nums, int count, uint8_t action);
+
+/*
+ * Pacing classes, each keeps its own estimate of the PSU response time.
+ * Only blocks with min_us < max_us use it: the bootloader entry of Delta
+ * and Liteon PSUs and the Murata records. Delta and Liteon data blocks
+ * and page commits keep the fixed delays of the vendor tools.
+ */
+enum {
+  PACE_BLOCK,
+  PACE_PAGE,
+  PACE_MODE,
+  PACE_CLASSES
+};
+
+/* Result of a status poll */
+enum {
+  PSU_FAILED = -1,
+  PSU_READY = 0,
+  PSU_BUSY = 1,
+};
+
+typedef struct _psu_update_t psu_update_t;
+
+typedef struct _psu_block_t {
+  int fd;
+  uint8_t addr;     // 7-bit address, used for raw writes
+  uint8_t cmd;      // SMBus block write command
+  bool raw;         // data is already framed, send it as a plain write
+  uint8_t len;
+  uint8_t data[I2C_SMBUS_BLOCK_MAX + 8];
+  uint8_t pace;     // PACE_*
+  uint8_t state;    // vendor specific, passed back to poll()
+  bool progress;    // counts towards the progress and the histogram
+  bool strict;      // fail instead of going on when max_us expires
+  uint32_t min_us;  // never poll earlier than this
+  uint32_t max_us;  // worst case, the PSU is assumed ready after this
+} psu_block_t;
+
+typedef struct _psu_vendor_t {
+  const char *name;   // vendor argument of psu-util --update
+  const char *model;  // MFR_MODEL reported by the PSU
+  int id;
+  const void *priv;
+
+  /* Check the image header. Return 0 and set model_id, or -1. */
+  int (*parse)(psu_update_t*, const char *path);
+  /* Load the image, unlock the PSU and enter the bootloader (optional). */
+  int (*start)(psu_update_t*, const char *path);
+  /* Fill the next block. Return 1, 0 at the end of the image, -1. */
+  int (*next)(psu_update_t*, psu_block_t*);
+  /* Return PSU_READY, PSU_BUSY or PSU_FAILED (optional). */
+  int (*poll)(psu_update_t*, const psu_block_t*);
+  /* Send the checksum and reset the PSU (optional). */
+  int (*finish)(psu_update_t*);
+  /* Formats which carry their own command sequence replace next(). */
+  int (*transmit)(psu_update_t*, const char *path);
+} psu_vendor_t;
+
+struct _psu_update_t {
+  uint8_t num;
+  int fd;
+  int boot_fd;
+  bool quiet;
+  int model_id;
+  const psu_vendor_t *vendor;
+
+  delta_hdr_t delta;
+  murata_hdr_t murata;
+
+  uint8_t *image;
+  int image_len;
+  int offset;
+  uint16_t page;
+  uint16_t blk;
+  FILE *fp;
+
+  uint32_t total;
+  uint32_t done;
+  int last_pct;
+  uint32_t est_us[PACE_CLASSES];
+  psu_update_stats_t stats;
+};
+
+extern const psu_vendor_t psu_vendors[];
+extern const int psu_vendor_cnt;
+
+int psu_i2c_open(uint8_t bus, uint8_t addr);
+uint64_t psu_now_us(void);
+int psu_wait(psu_update_t *u, const psu_block_t *blk);
+int psu_send(psu_update_t *u, psu_block_t *blk);
+void psu_record(psu_update_t *u, uint64_t start_us);
+void psu_progress(psu_update_t *u, uint32_t done, uint32_t total);
+
+#endif
@@ -0,0 +1,899 @@
+/*
+ * Copyright 2021-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * Firmware image formats and bootloader protocols of the supported PSUs.
+ * Delta, Liteon and the 2K Murata share one block protocol and only differ
+ * in the image ID and the worst case response times.
+ */
+#include <limits.h>
+#include <openbmc/log.h>
+#include "psu-update.h"
+
+#define MS(n) ((n) * 1000)
+
+/* Worst case delays of the Delta block protocol, per MCU */
+typedef struct _delta_proto_t {
+  uint32_t pri_blk_us;
+  uint32_t sec_blk_us;
+  bool obmc_log;
+} delta_proto_t;
+
+static const delta_proto_t delta_proto = {MS(25), MS(5), false};
+static const delta_proto_t murata2k_proto = {MS(60), MS(10), true};
+
+static int
+ascii_to_hex(int ascii) {
+  ascii = ascii & 0xFF;
+
+  if (ascii >= 0x30 && ascii <= 0x39) {
+    return (ascii - 0x30);      /* 0-9 */
+  } else if (ascii >= 0x41 && ascii <= 0x46) {
+    return (ascii - 0x41 + 10); /* A-F */
+  } else if (ascii >= 0x61 && ascii <= 0x66) {
+    return (ascii - 0x61 + 10); /* a-f */
+  } else {
+    return -1;
+  }
+}
+
+static uint8_t
+hex_to_byte(uint8_t hbyte, uint8_t lbyte) {
+  return (ascii_to_hex(hbyte) << 4) | ascii_to_hex(lbyte);
+}
+
+static int
+check_file_len(const char *file_path) {
+  struct stat st;
+
+  if (stat(file_path, &st) != 0) {
+    return -1;
+  }
+
+  if (st.st_size > INT_MAX) {
+    errno = EFBIG;
+    return -1; /* integer overflow */
+  }
+
+  return (int)st.st_size;
+}
+
+static int
+check_file_line_cnt(const char *file_path) {
+  FILE *fp = fopen(file_path, "rb");
+  int c, cnt = 0;
+
+  if (fp == NULL) {
+    return -1;
+  }
+  while ((c = fgetc(fp)) != EOF) {
+    if (c == '\n') {
+        cnt++;
+    }
+  }
+  fclose(fp);
+
+  return cnt;
+}
+
+uint8_t
+pec_calc(uint8_t incrc, uint8_t indata) {
+  uint8_t i, crc8;
+
+  crc8 = incrc ^ indata;
+  for (i = 0; i < 8; i++) {
+    if ((crc8 & 0x80) != 0) {
+      crc8 <<= 1;
+      crc8 ^= 0x07;
+    } else {
+      crc8 <<= 1;
+    }
+  }
+
+  return crc8;
+}
+
+/* Read the image after the header of hdr_len bytes */
+static int
+load_image(psu_update_t *u, const char *path, int hdr_len) {
+  FILE *fp;
+  int fw_len;
+
+  fw_len = check_file_len(path);
+  if (fw_len < 0) {
+    OBMC_ERROR(errno, "failed to get %s size", path);
+    return -1;
+  } else if (fw_len <= hdr_len) {
+    OBMC_WARN("%s size is too small (%d < %d)\n", path, fw_len, hdr_len);
+    return -1;
+  }
+
+  fw_len -= hdr_len;
+  u->image = malloc(fw_len);
+  if (u->image == NULL) {
+    OBMC_ERROR(errno, "failed to allocate %d bytes", fw_len);
+    return -1;
+  }
+
+  fp = fopen(path, "rb");
+  if (fp == NULL) {
+    OBMC_ERROR(errno, "failed to open %s", path);
+    return -1;
+  }
+  if (fseek(fp, hdr_len, SEEK_SET) != 0) {
+    OBMC_ERROR(errno, "fseek %s failed", path);
+    fclose(fp);
+    return -1;
+  }
+  if (fread(u->image, 1, fw_len, fp) != fw_len) {
+    OBMC_WARN("failed to read %d items from %s\n", fw_len, path);
+    fclose(fp);
+    return -1;
+  }
+  fclose(fp);
+
+  u->image_len = fw_len;
+  return 0;
+}
+
+static int
+delta_hdr_read(const char *file_path, delta_hdr_t *hdr) {
+  int i, fd_file = -1;
+  int index = 0;
+  uint8_t hdr_buf[DELTA_HDR_LENGTH];
+
+  fd_file = open(file_path, O_RDONLY, 0666);
+  if (fd_file < 0) {
+    OBMC_ERROR(errno, "Open file %s failed", file_path);
+    return -1;
+  }
+  if (read(fd_file, hdr_buf, DELTA_HDR_LENGTH) < DELTA_HDR_LENGTH) {
+    OBMC_ERROR(errno, "Read file %s failed", file_path);
+    close(fd_file);
+    return -1;
+  }
+  close(fd_file);
+
+  memset(hdr, 0, sizeof(*hdr));
+  hdr->crc[0] = hdr_buf[index++];
+  hdr->crc[1] = hdr_buf[index++];
+  hdr->page_start = hdr_buf[index++];
+  hdr->page_start |= hdr_buf[index++] << 8;
+  hdr->page_end = hdr_buf[index++];
+  hdr->page_end |= hdr_buf[index++] << 8;
+  hdr->byte_per_blk = hdr_buf[index++];
+  hdr->byte_per_blk |= hdr_buf[index++] << 8;
+  hdr->blk_per_page = hdr_buf[index++];
+  hdr->blk_per_page |= hdr_buf[index++] << 8;
+  hdr->uc = hdr_buf[index++];
+  hdr->app_fw_major = hdr_buf[index++];
+  hdr->app_fw_minor = hdr_buf[index++];
+  hdr->bl_fw_major = hdr_buf[index++];
+  hdr->bl_fw_minor = hdr_buf[index++];
+  hdr->fw_id_len = hdr_buf[index++];
+
+  if (hdr->fw_id_len >= sizeof(hdr->fw_id) ||
+      index + hdr->fw_id_len >= DELTA_HDR_LENGTH) {
+    OBMC_WARN("Error FWID length: %d!\n", hdr->fw_id_len);
+    return -1;
+  }
+  for (i = 0; i < hdr->fw_id_len; i++) {
+    hdr->fw_id[i] = hdr_buf[index++];
+  }
+  hdr->compatibility = hdr_buf[index];
+
+  return 0;
+}
+
+static int
+delta_img_hdr_parse(psu_update_t *u, const char *file_path) {
+  delta_hdr_t *hdr = &u->delta;
+
+  if (delta_hdr_read(file_path, hdr) < 0) {
+    return -1;
+  }
+
+  if (!strncmp((char *)hdr->fw_id, DELTA_MODEL, strlen(DELTA_MODEL))) {
+    u->model_id = DELTA_1500;
+    printf("Vendor: Delta\n");
+  } else if (!strncmp((char *)hdr->fw_id, DELTA_MODEL_2K, strlen(DELTA_MODEL_2K))) {
+    u->model_id = DELTA_2000;
+    printf("Vendor: Delta\n");
+  } else if (!strncmp((char *)hdr->fw_id, LITEON_MODEL, strlen(LITEON_MODEL))) {
+    u->model_id = LITEON_1500;
+    printf("Vendor: Liteon\n");
+  } else {
+    printf("Get Image Header Fail!\n");
+    return -1;
+  }
+
+  printf("Model: %s\n", hdr->fw_id);
+  printf("HW Compatibility: %d\n", hdr->compatibility);
+  if (hdr->uc == 0x10) {
+    printf("MCU: primary\n");
+  } else if (hdr->uc == 0x20) {
+    printf("MCU: secondary\n");
+  } else {
+    printf("MCU: unknown number 0x%x\n", hdr->uc);
+    return -1;
+  }
+  printf("Ver: %d.%d\n", hdr->app_fw_major, hdr->app_fw_minor);
+
+  return 0;
+}
+
+static int
+murata2k_img_hdr_parse(psu_update_t *u, const char *file_path) {
+  delta_hdr_t *hdr = &u->delta;
+
+  if (delta_hdr_read(file_path, hdr) < 0) {
+    return -1;
+  }
+
+  if (MURATA2K_FWID_LENGTH != hdr->fw_id_len) {
+    OBMC_WARN("Error FWID length: %d!\n", hdr->fw_id_len);
+    return -1;
+  }
+
+  if (!strncmp((char *)hdr->fw_id, MURATA_FWID_2K, strlen(MURATA_FWID_2K))) {
+    u->model_id = MURATA_2000;
+    OBMC_INFO("Vendor: Murata\n");
+  } else {
+    OBMC_WARN("Get image header fail, error FW ID: %s!\n", hdr->fw_id);
+    return -1;
+  }
+
+  OBMC_INFO("FW ID: %s\n", hdr->fw_id);
+  OBMC_INFO("HW Compatibility: %d\n", hdr->compatibility);
+  if (hdr->uc == 0x10) {
+    OBMC_INFO("MCU: primary\n");
+  } else if (hdr->uc == 0x20) {
+    OBMC_INFO("MCU: secondary\n");
+  } else {
+    OBMC_WARN("MCU: unknown number 0x%x\n", hdr->uc);
+    return -1;
+  }
+  OBMC_INFO("Ver: %d.%d\n", hdr->app_fw_major, hdr->app_fw_minor);
+
+  return 0;
+}
+
+static void
+delta_log(psu_update_t *u, const char *msg) {
+  const delta_proto_t *proto = u->vendor->priv;
+
+  if (proto->obmc_log) {
+    OBMC_INFO("%s\n", msg);
+  } else {
+    printf("%s\n", msg);
+  }
+}
+
+static int
+delta_boot_flag(psu_update_t *u, uint16_t mode) {
+  uint16_t word = (mode << 8) | u->delta.uc;
+
+  delta_log(u, mode == BOOT_MODE ? "-- Bootloader Mode --" : "-- Reset PSU --");
+  return i2c_smbus_write_word_data(u->fd, BOOT_FLAG, word);
+}
+
+/*
+ * The bootloader NAKs while it is busy and reports transmission errors in
+ * bit 5 of BOOT_FLAG. The low nibble tells the mode it is in.
+ */
+static int
+delta_poll(psu_update_t *u, const psu_block_t *blk) {
+  int flag = i2c_smbus_read_byte_data(u->fd, BOOT_FLAG);
+
+  if (flag < 0) {
+    return PSU_BUSY;
+  }
+  if (blk->pace == PACE_MODE) {
+    return ((flag & 0xf) == blk->state) ? PSU_READY : PSU_BUSY;
+  }
+  if (flag & 0x20) {
+    OBMC_WARN("-- FW transmission error --\n");
+    return PSU_FAILED;
+  }
+  return PSU_READY;
+}
+
+static int
+delta_start(psu_update_t *u, const char *path) {
+  delta_hdr_t *hdr = &u->delta;
+  uint8_t block[sizeof(hdr->fw_id) + 2];
+  psu_block_t mode = {0};
+  uint8_t i, j;
+
+  if (hdr->byte_per_blk != 16) {
+    printf("Image block size %d invalid!\n", hdr->byte_per_blk);
+    return UPDATE_SKIP;
+  }
+
+  if (ioctl(u->fd, I2C_PEC, 1) < 0) {
+    OBMC_ERROR(errno, "psu%d ioctl error!", u->num + 1);
+    return UPDATE_SKIP;
+  }
+
+  if (load_image(u, path, DELTA_HDR_LENGTH) < 0) {
+    return -1;
+  }
+  u->page = hdr->page_start;
+  u->blk = 0;
+  u->offset = 0;
+  u->total = hdr->blk_per_page * (hdr->page_end - hdr->page_start + 1);
+
+  /* unlock */
+  block[0] = hdr->uc;
+  block[hdr->fw_id_len + 1] = hdr->compatibility;
+  for (i = 1, j = hdr->fw_id_len - 1; i <= hdr->fw_id_len; i++, j--) {
+    block[i] = hdr->fw_id[j];
+  }
+  i2c_smbus_write_block_data(u->fd, UNLOCK_UPGRADE, hdr->fw_id_len + 2, block);
+  msleep(20);
+
+  /* the bootloader of each MCU reports its own mode once it is up */
+  delta_boot_flag(u, BOOT_MODE);
+  mode.pace = PACE_MODE;
+  mode.state = (hdr->uc == 0x10) ? 0x0c : 0x0d;
+  mode.min_us = MS(200);
+  mode.max_us = MS(2500);
+  psu_wait(u, &mode);
+
+  if (hdr->uc == 0x10) {
+    delta_log(u, "-- Transmit Primary Firmware --");
+  } else if (hdr->uc == 0x20) {
+    delta_log(u, "-- Transmit Secondary Firmware --");
+  }
+  return 0;
+}
+
+/*
+ * Blocks of 16 bytes go to RAM with DATA_TO_RAM, and every blk_per_page
+ * blocks the page is written to flash with DATA_TO_FLASH. A BOOT_FLAG read
+ * that goes through is not known to mean that the block was taken, so
+ * the fixed delays of the vendor tools stay the minimum and the status is
+ * only checked for transmission errors.
+ */
+static int
+delta_next(psu_update_t *u, psu_block_t *blk) {
+  const delta_proto_t *proto = u->vendor->priv;
+  delta_hdr_t *hdr = &u->delta;
+
+  if (u->page > hdr->page_end) {
+    return 0;
+  }
+
+  memset(blk, 0, sizeof(*blk));
+  blk->fd = u->fd;
+  blk->data[0] = hdr->uc;
+  if (u->blk < hdr->blk_per_page) {
+    if (u->offset + 16 > u->image_len) {
+      OBMC_WARN("Image is shorter than its header says\n");
+      return -1;
+    }
+    /* data[1] - Block Num LO, data[2] - Block Num HI */
+    blk->cmd = DATA_TO_RAM;
+    blk->data[1] = u->blk & 0xff;
+    blk->data[2] = 0;
+    memcpy(&blk->data[3], &u->image[u->offset], 16);
+    blk->len = 19;
+    blk->pace = PACE_BLOCK;
+    blk->progress = true;
+    blk->max_us = (hdr->uc == 0x10) ? proto->pri_blk_us : proto->sec_blk_us;
+    blk->min_us = blk->max_us;
+    u->offset += 16;
+    u->blk++;
+  } else {
+    blk->cmd = DATA_TO_FLASH;
+    blk->data[1] = u->page & 0xff;
+    blk->data[2] = (u->page >> 8) & 0xff;
+    blk->len = 3;
+    blk->pace = PACE_PAGE;
+    blk->min_us = MS(90);
+    blk->max_us = MS(90);
+    u->page++;
+    u->blk = 0;
+  }
+
+  return 1;
+}
+
+static int
+delta_finish(psu_update_t *u) {
+  delta_hdr_t *hdr = &u->delta;
+  uint8_t block[] = {hdr->uc, hdr->crc[0], hdr->crc[1]};
+
+  delta_log(u, "-- Transmit CRC --");
+  i2c_smbus_write_block_data(u->fd, CRC_CHECK, sizeof(block), block);
+  msleep(1500);
+
+  delta_boot_flag(u, NORMAL_MODE);
+  if (hdr->uc == 0x10) {
+    msleep(4000);
+  } else if (hdr->uc == 0x20) {
+    msleep(2000);
+  }
+#ifdef DEBUG
+  int ret = i2c_smbus_read_byte_data(u->fd, BOOT_FLAG);
+  if ((ret & 0x7) == 0x4) {
+    if (ret & 0x80) {
+      printf("-- Primary FW Identifier Error --\n");
+      return -1;
+    } else if (ret & 0x40) {
+      printf("-- Primary CRC16 Application Checksum Wrong --\n");
+      return -1;
+    }
+  } else if ((ret & 0x7) == 0x5) {
+    if (ret & 0x80) {
+      printf("-- Secondary FW Identifier Error --\n");
+      return -1;
+    } else if (ret & 0x40) {
+      printf("-- Secondary CRC16 Application Checksum Wrong --\n");
+      return -1;
+    }
+  }
+#endif
+  delta_log(u, "-- Upgrade Done --");
+  return 0;
+}
+
+static int
+belpower_img_hdr_parse(psu_update_t *u, const char *file_path) {
+  FILE* fp;
+  int i = 1, j = 0;
+  uint8_t hdr_buf[128];
+  uint8_t hdr_str[128] = {0};
+
+  fp = fopen(file_path, "rb");
+  if (fp == NULL) {
+    OBMC_ERROR(errno, "%s open failed", file_path);
+    return -1;
+  }
+
+  if (fgets((char *)hdr_buf, sizeof(hdr_buf), fp) == NULL) {
+    OBMC_ERROR(errno, "fgets %s failed", file_path);
+    fclose(fp);
+    return -1;
+  }
+
+  fclose(fp);
+
+  if (hdr_buf[0] == 'H') {
+    while (i < strlen((char *)hdr_buf) - 4) {
+      hdr_str[j++] = hex_to_byte(hdr_buf[i], hdr_buf[i+1]);
+      i = i + 2;
+    }
+    hdr_str[j] = '\0';
+  }
+  if (strncmp(((char *)hdr_str)+8, BEL_MODEL, 16) != 0) {
+    printf("Get Image Header Fail!\n");
+    return -1;
+  }
+
+  printf("Vendor: Belpower\n");
+  printf("Model: %s\n", BEL_MODEL);
+  u->model_id = BELPOWER_1500_NAC;
+  return 0;
+}
+
+/*
+ * Belpower images are scripts of PMBus transactions with the delays and
+ * the expected read results included, so they are run as they are. The
+ * script gives no status register to poll, the delays are kept.
+ */
+static int
+belpower_fw_transmit(psu_update_t *u, const char *file_path) {
+  FILE* fp;
+  uint8_t addr = psu[u->num].pmbus_addr << 1;
+  uint8_t file_buf[128];
+  uint8_t byte_buf[128];
+  uint8_t primary_cmd[3] = {0xC7, 0x00, 0x39};
+  uint8_t read_cmd[1] = {0xC7};
+  uint8_t word_receive[2];
+  uint8_t byte;
+  uint8_t command = 0;
+  uint8_t progress = 0;
+  uint8_t retry = 3;
+  uint16_t delay = 0;
+  uint64_t start;
+  char error_text[64] = {0};
+  int ret = 0, i = 0, j = 0;
+  bool success = true;
+
+  fp = fopen(file_path, "rb");
+  if (fp == NULL) {
+    OBMC_ERROR(errno, "%s open failed", file_path);
+    return -1;
+  }
+
+  printf("-- Transmit Firmware --\n");
+  while (!feof(fp)) {
+    if (fgets((char *)file_buf, sizeof(file_buf), fp) == NULL) {
+      OBMC_ERROR(errno, "fgets %s failed", file_path);
+      fclose(fp);
+      return -1;
+    }
+
+    while (i < strlen((char *)file_buf) - 4) {
+      if (i == 0) {
+        command = file_buf[i++];
+      }
+      byte_buf[j++] = hex_to_byte(file_buf[i], file_buf[i+1]);
+      i = i + 2;
+    }
+    byte_buf[j] = '\0';
+
+    switch (command) {
+      case 'H':
+        break;
+      case 'L':
+        /* Skip if previous command was unsuccessful */
+        if (!success) {
+          break;
+        }
+        /* Log text */
+        if (strstr((char *)byte_buf, "bootloader") ||
+            strstr((char *)byte_buf, "application")) {
+          printf("\n");
+          printf("%s", byte_buf);
+        }
+        break;
+      case 'T':
+        /* Skip if previous command was unsuccessful */
+        if (!success) {
+          break;
+        }
+        delay = ((uint16_t) byte_buf[1]) << 8 | (uint16_t) byte_buf[0];
+        break;
+      case 'X':
+        /* Skip if previous command was successful */
+        if (success) {
+          break;
+        }
+        /* Exit with error message */
+        if (strcmp((char *)byte_buf, error_text)) {
+          memcpy (error_text, byte_buf, sizeof(error_text));
+          printf("\n");
+          printf("%s\n", error_text);
+        };
+        if (strstr(error_text, "Could not enter primary bootloader")) {
+          while (retry) {
+            printf("Retry enter primary bootloader\n");
+            ret = i2c_rdwr_msg_transfer(u->fd, addr,
+                                primary_cmd, sizeof(primary_cmd), NULL, 0);
+            sleep(5);
+            ret |= i2c_rdwr_msg_transfer(u->fd, addr,
+                          read_cmd, 1, word_receive, 2);
+            if (ret == 0 && word_receive[0] == 0x0
+                         && word_receive[1] == 0x1) {
+              success = true;
+              retry = 0;
+            } else {
+              retry--;
+            }
+          }
+        }
+        break;
+      case 'M':
+        /* Check MD5, Skip...*/
+        break;
+      case 'W':
+        /* Skip if previous command was unsuccessful */
+        if (!success) {
+          break;
+        }
+        start = psu_now_us();
+        /* Send command and check result if necessary */
+        if (byte_buf[0] == 1) { /* Read */
+          if (byte_buf[1] == 1) { /* Read byte */
+            ret = i2c_rdwr_msg_transfer(u->fd, addr,
+                                &byte_buf[2], byte_buf[0], &byte, byte_buf[1]);
+            printf("\n");
+            printf("read byte:0x%.2x\n", byte);
+            if (ret == 0 && byte == byte_buf[3]) {
+              success = true;
+            } else {
+              success = false;
+            }
+          } else if (byte_buf[1] == 2) { /* Read word */
+            ret = i2c_rdwr_msg_transfer(u->fd, addr,
+                        &byte_buf[2], byte_buf[0], word_receive, byte_buf[1]);
+            if (ret == 0 && word_receive[0] == byte_buf[3]
+                         && word_receive[1] == byte_buf[4]) {
+              success = true;
+            } else {
+              success = false;
+            }
+          }
+        } else { /* Write */
+          ret = i2c_rdwr_msg_transfer(u->fd, addr,
+                                        &byte_buf[2], byte_buf[0], NULL, 0);
+          if (!ret) {
+            success = true;
+          } else {
+            success = false;
+          }
+        }
+        if (success && delay != 0) {
+          msleep(delay);
+        }
+        psu_record(u, start);
+        break;
+      case 'P':
+        /* Skip if previous command was unsuccessful */
+        if (!success) {
+          break;
+        }
+        progress = byte_buf[0];
+        break;
+      default:
+        /* Unrecognized command: exit */
+        break;
+    }
+    psu_progress(u, progress, 100);
+    i = 0;
+    j = 0;
+    retry = 3;
+  }
+  fclose(fp);
+  printf("\n");
+  printf("-- Upgrade Done --\n");
+
+  return 0;
+}
+
+static int
+murata_img_hdr_parse(psu_update_t *u, const char *file_path) {
+  FILE* fp;
+  int line = 0;
+  uint8_t hdr_buf[128];
+  uint8_t model_shift = 8;
+  uint8_t revision_shift = 11;
+  uint8_t target_shift = 9;
+  uint8_t unlock_shift = 9;
+  uint32_t unlock = 0;
+
+  fp = fopen(file_path, "rb");
+  if (fp == NULL) {
+    OBMC_ERROR(errno, "%s open failed", file_path);
+    return -1;
+  }
+
+  for (line = 0; line < 6; line++) {
+    if (fgets((char *)hdr_buf, sizeof(hdr_buf), fp) == NULL) {
+      OBMC_ERROR(errno, "fgets %s failed", file_path);
+      fclose(fp);
+      return -1;
+    }
+
+    switch (line) {
+      case 1:
+        if (!strncmp(((char *)hdr_buf)+model_shift, MURATA_MODEL,
+                                             strlen(MURATA_MODEL))) {
+          printf("Vendor: Murata\n");
+          printf("Model: %s\n", MURATA_MODEL);
+        } else {
+          printf("Get Image Header Fail!\n");
+          fclose(fp);
+          return -1;
+        }
+        break;
+      case 2:
+        if (!strncmp((char *)hdr_buf, "revision = ", revision_shift)) {
+          printf("Ver: %c%c.%c%c\n",
+                  hdr_buf[strlen((char *)hdr_buf) - 8],
+                  hdr_buf[strlen((char *)hdr_buf) - 7],
+                  hdr_buf[strlen((char *)hdr_buf) - 5],
+                  hdr_buf[strlen((char *)hdr_buf) - 4]);
+        } else {
+          printf("Get Image Header Fail!\n");
+          fclose(fp);
+          return -1;
+        }
+        break;
+      case 3:
+        if (!strncmp(((char *)hdr_buf)+target_shift, "primary", strlen("primary"))) {
+          u->murata.uc = 0x50;
+        } else if (!strncmp(((char *)hdr_buf)+target_shift,
+                                        "secondary", strlen("secondary"))) {
+          u->murata.uc = 0x53;
+        } else {
+          printf("Get Image Header Fail!\n");
+          fclose(fp);
+          return -1;
+        }
+        printf("MCU: %s", &hdr_buf[target_shift]);
+        break;
+      case 5:
+        if (!strncmp((char *)hdr_buf, "unlock = ", unlock_shift)) {
+          unlock = strtoul(((char *)hdr_buf)+unlock_shift, NULL, 0);
+          memcpy(&u->murata.unlock, &unlock, sizeof(u->murata.unlock));
+        } else {
+          printf("Get Image Header Fail!\n");
+          fclose(fp);
+          return -1;
+        }
+        break;
+      default:
+        break;
+    }
+  }
+  fclose(fp);
+  u->murata.boot_addr = 0x60;
+  u->model_id = MURATA_1500;
+
+  return 0;
+}
+
+static uint8_t
+murata_upgrade_status(psu_update_t *u) {
+  uint8_t byte = 0xfa;
+  uint8_t byte_receive = 0;
+
+  i2c_rdwr_msg_transfer(u->boot_fd, u->murata.boot_addr << 1,
+                        &byte, 1, &byte_receive, 1);
+  return byte_receive;
+}
+
+static int
+murata_poll(psu_update_t *u, const psu_block_t *blk) {
+  return (murata_upgrade_status(u) == 0x55) ? PSU_BUSY : PSU_READY;
+}
+
+static int
+murata_start(psu_update_t *u, const char *file_path) {
+  uint8_t addr = psu[u->num].pmbus_addr << 1;
+  uint8_t pec = 0;
+  uint8_t file_buf[128];
+  int i, lines;
+
+  uint8_t block[] = {0xfa,
+                     u->murata.unlock[3], u->murata.unlock[2],
+                     u->murata.unlock[1], u->murata.unlock[0], 0};
+
+  pec = pec_calc(pec, addr);
+  for (i = 0; i < 5; i++) {
+    pec = pec_calc(pec, block[i]);
+  }
+  block[5] = pec;
+  i2c_rdwr_msg_transfer(u->fd, addr, block, sizeof(block), NULL, 0);
+  sleep(1);
+
+  lines = check_file_line_cnt(file_path);
+  u->fp = fopen(file_path, "rb");
+  if (lines < 0 || u->fp == NULL) {
+    OBMC_ERROR(errno, "fopen %s failed", file_path);
+    return -1;
+  }
+  u->total = (lines > 7) ? lines - 7 : 0;
+
+  /* When entering bootloader mode, Murata PSU PMBUS address change to 0x60 */
+  u->boot_fd = psu_i2c_open(psu[u->num].bus, u->murata.boot_addr);
+  if (u->boot_fd < 0) {
+    OBMC_ERROR(errno, "failed to open i2c %u-00%02x",
+               psu[u->num].bus, u->murata.boot_addr);
+    return -1;
+  }
+
+  /* FW header information, then the [data] tag */
+  for (i = 0; i < 7; i++) {
+    if (fgets((char *)file_buf, sizeof(file_buf), u->fp) == NULL) {
+      OBMC_ERROR(errno, "fgets %s failed", file_path);
+      return -1;
+    }
+  }
+  if (!strncmp((char *)file_buf, "[data]", strlen("[data]"))) {
+    if (u->murata.uc == 0x50) {
+      printf("-- Transmit Primary Firmware --\n");
+    } else if (u->murata.uc == 0x53){
+      printf("-- Transmit Secondary Firmware --\n");
+    }
+  }
+
+  return 0;
+}
+
+/* Every line of the image is one record ":LLAAAATT<data>CC" */
+static int
+murata_next(psu_update_t *u, psu_block_t *blk) {
+  uint8_t file_buf[128];
+  uint8_t byte_buf[128];
+  int i = 1, j = 0;
+
+  if (fgets((char *)file_buf, sizeof(file_buf), u->fp) == NULL) {
+    return 0;
+  }
+
+  while (i + 1 < strlen((char *)file_buf) - 1 && j < sizeof(byte_buf) - 1) {
+    byte_buf[j++] = hex_to_byte(file_buf[i], file_buf[i+1]);
+    i = i + 2;
+  }
+  if (j < 5 || byte_buf[0] + 5 > sizeof(blk->data) - 2) {
+    OBMC_WARN("Invalid record: %s\n", file_buf);
+    return -1;
+  }
+
+  memset(blk, 0, sizeof(*blk));
+  blk->fd = u->boot_fd;
+  blk->addr = u->murata.boot_addr;
+  blk->raw = true;
+  blk->data[0] = 0xfa;
+  blk->data[1] = 0x44;
+  memcpy(&blk->data[2], byte_buf, byte_buf[0] + 5);
+  blk->len = byte_buf[0] + 7;
+  blk->pace = PACE_BLOCK;
+  blk->progress = true;
+  blk->strict = true;
+  blk->max_us = MS(30000);
+
+  return 1;
+}
+
+static int
+murata_finish(psu_update_t *u) {
+  uint8_t eof[] = {0xfa, 0x44, 0x00, 0x00, 0x00, 0x01, 0xff};
+  uint8_t reset[] = {0xf8, 0xaf};
+
+  i2c_rdwr_msg_transfer(u->boot_fd, u->murata.boot_addr << 1,
+                        eof, sizeof(eof), NULL, 0);
+  printf("-- Transmit EOF --\n");
+  sleep(1);
+  if (murata_upgrade_status(u) == 0xaa) {
+    i2c_rdwr_msg_transfer(u->boot_fd, u->murata.boot_addr << 1,
+                          reset, sizeof(reset), NULL, 0);
+    printf("-- Reset PSU --\n");
+  }
+
+  printf("-- Upgrade Done --\n");
+  return 0;
+}
+
+const psu_vendor_t psu_vendors[] = {
+  {
+    .name = "delta", .model = DELTA_MODEL, .id = DELTA_1500, .priv = &delta_proto,
+    .parse = delta_img_hdr_parse, .start = delta_start, .next = delta_next,
+    .poll = delta_poll, .finish = delta_finish,
+  },
+  {
+    .name = "2k-delta", .model = DELTA_MODEL_2K, .id = DELTA_2000, .priv = &delta_proto,
+    .parse = delta_img_hdr_parse, .start = delta_start, .next = delta_next,
+    .poll = delta_poll, .finish = delta_finish,
+  },
+  {
+    .name = "liteon", .model = LITEON_MODEL, .id = LITEON_1500, .priv = &delta_proto,
+    .parse = delta_img_hdr_parse, .start = delta_start, .next = delta_next,
+    .poll = delta_poll, .finish = delta_finish,
+  },
+  {
+    .name = "belpower", .model = BEL_MODEL, .id = BELPOWER_1500_NAC,
+    .parse = belpower_img_hdr_parse, .transmit = belpower_fw_transmit,
+  },
+  {
+    .name = "murata", .model = MURATA_MODEL, .id = MURATA_1500,
+    .parse = murata_img_hdr_parse, .start = murata_start, .next = murata_next,
+    .poll = murata_poll, .finish = murata_finish,
+  },
+  {
+    .name = "2k-murata", .model = MURATA_MODEL_2K, .id = MURATA_2000, .priv = &murata2k_proto,
+    .parse = murata2k_img_hdr_parse, .start = delta_start, .next = delta_next,
+    .poll = delta_poll, .finish = delta_finish,
+  },
+};
+
+const int psu_vendor_cnt = sizeof(psu_vendors) / sizeof(psu_vendors[0]);
@@ -70,6 +70,8 @@ extern "C" {
 #define MURATA2K_FWID_LENGTH     11
 #define MURATA2K_BYTE_PER_BLK    16
 
+#define PSU_HIST_BUCKETS    16
+
 typedef struct _i2c_info_t {
   int fd;
   uint8_t bus;
@@ -155,6 +157,21 @@ typedef struct _murata2k_hdr_t {
   uint8_t compatibility;
 } murata2k_hdr_t;
 
+/*
+ * Timing of the blocks sent during one PSU update. A block is counted
+ * from the start of its write until the PSU reports it is ready for the
+ * next one. Bucket n of the histogram counts blocks that took less than
+ * 2^n ms, the last bucket counts the rest.
+ */
+typedef struct _psu_update_stats_t {
+  uint32_t blocks;
+  uint32_t polls;
+  uint32_t timeouts;
+  uint64_t total_us;
+  uint32_t max_us;
+  uint32_t hist[PSU_HIST_BUCKETS];
+} psu_update_stats_t;
+
 enum {
   STOP,
   START
@@ -200,6 +217,8 @@ enum {
 int is_psu_prsnt(uint8_t num, uint8_t *status);
 int get_mfr_model(uint8_t num, uint8_t *block);
 int do_update_psu(uint8_t num, const char *file, const char *vendor);
+int do_update_psus(const uint8_t *nums, int count, const char *file,
+                   const char *vendor, psu_update_stats_t *stats);
 int get_eeprom_info(uint8_t mum);
 int get_psu_info(uint8_t num);
 int get_blackbox_info(uint8_t num, const char *option);
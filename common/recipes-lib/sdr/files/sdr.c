@@ -555,22 +555,23 @@ _sdr_get_snr_thresh(uint8_t fru, sdr_full_t *sdr, uint8_t snr_num,
   return 0;
 }
 
-int
-sdr_get_snr_thresh(uint8_t fru, uint8_t snr_num, thresh_sensor_t *snr) {
+/*
+ * Loads the SDR table of the FRU and finds out whether the thresholds come
+ * from the threshold file. Both only depend on the FRU, so they are done
+ * once however many sensors are looked up afterwards.
+ */
+static int
+sdr_thresh_init(uint8_t fru, sensor_info_t *sinfo, bool *have_sdr, bool *from_file) {
 
   int ret = 0;
-  sdr_full_t *sdr;
 #ifdef DEBUG
   int cnt = 0;
 #endif /* DEBUG */
   int retry = 0;
   char fpath[64] = {0};
   char initpath[64] = {0};
-  char initflag[64] = {0};
   char fru_name[16];
 
-  sensor_info_t sinfo[MAX_SENSOR_NUM + 1] = {0};
-
   ret = pal_sensor_sdr_init(fru, sinfo);
 
   while (ret == ERR_NOT_READY) {
@@ -586,36 +587,45 @@ sdr_get_snr_thresh(uint8_t fru, uint8_t snr_num, thresh_sensor_t *snr) {
     msleep(50);
     ret = pal_sensor_sdr_init(fru, sinfo);
   }
-
-  if (ret < 0) {
-    sdr = NULL;
-  } else {
-    sdr = &sinfo[snr_num].sdr;
-  }
-
-  /* Set all the threshold options set in the flag */
-  snr->flag = GETMASK(SENSOR_VALID) | GETMASK(UCR_THRESH) |
-    GETMASK(UNC_THRESH) | GETMASK(UNR_THRESH) | GETMASK(LCR_THRESH) |
-    GETMASK(LNC_THRESH) | GETMASK(LNR_THRESH);
+  *have_sdr = (ret >= 0);
 
   ret = pal_get_fru_name(fru, fru_name);
   if (ret < 0) {
     printf("%s: Fail to get fru%d name\n", __func__, fru);
     return -1;
   }
-  
+
+  *from_file = false;
   sprintf(initpath, INIT_THRESHOLD_BIN, fru_name);
   if (0 == access(initpath, F_OK)) { // init done
     sprintf(fpath, THRESHOLD_BIN, fru_name);
     if (0 == access(fpath, F_OK)) {
-      ret = pal_get_thresh_from_file(fru, snr_num, snr);
-      if (0 != ret) {
-        syslog(LOG_WARNING, "%s: Fail to get threshold from file for slot%d", __func__, fru);
-        return -1;
-      }
+      *from_file = true;
+    }
+  }
 
-      return ret;
-    } 
+  return 0;
+}
+
+static int
+sdr_thresh_lookup(uint8_t fru, sdr_full_t *sdr, bool from_file,
+                  uint8_t snr_num, thresh_sensor_t *snr) {
+
+  int ret = 0;
+
+  /* Set all the threshold options set in the flag */
+  snr->flag = GETMASK(SENSOR_VALID) | GETMASK(UCR_THRESH) |
+    GETMASK(UNC_THRESH) | GETMASK(UNR_THRESH) | GETMASK(LCR_THRESH) |
+    GETMASK(LNC_THRESH) | GETMASK(LNR_THRESH);
+
+  if (from_file) {
+    ret = pal_get_thresh_from_file(fru, snr_num, snr);
+    if (0 != ret) {
+      syslog(LOG_WARNING, "%s: Fail to get threshold from file for slot%d", __func__, fru);
+      return -1;
+    }
+
+    return ret;
   }
 
   if (sdr != NULL) {
@@ -664,3 +674,44 @@ sdr_get_snr_thresh(uint8_t fru, uint8_t snr_num, thresh_sensor_t *snr) {
 
   return ret;
 }
+
+int
+sdr_get_snr_thresh(uint8_t fru, uint8_t snr_num, thresh_sensor_t *snr) {
+
+  int ret;
+  bool have_sdr = false, from_file = false;
+  sensor_info_t sinfo[MAX_SENSOR_NUM + 1] = {0};
+
+  ret = sdr_thresh_init(fru, sinfo, &have_sdr, &from_file);
+  if (ret < 0) {
+    return ret;
+  }
+
+  return sdr_thresh_lookup(fru, have_sdr ? &sinfo[snr_num].sdr : NULL,
+                           from_file, snr_num, snr);
+}
+
+int
+sdr_get_fru_snr_thresh(uint8_t fru, const uint8_t *snr_list, int snr_cnt,
+                       thresh_sensor_t *snr, int *snr_ret) {
+
+  int i, ret;
+  bool have_sdr = false, from_file = false;
+  sensor_info_t *sinfo;
+
+  sinfo = (sensor_info_t *)calloc(MAX_SENSOR_NUM + 1, sizeof(sensor_info_t));
+  if (sinfo == NULL) {
+    return -1;
+  }
+
+  ret = sdr_thresh_init(fru, sinfo, &have_sdr, &from_file);
+  if (ret == 0) {
+    for (i = 0; i < snr_cnt; i++) {
+      snr_ret[i] = sdr_thresh_lookup(fru, have_sdr ? &sinfo[snr_list[i]].sdr : NULL,
+                                     from_file, snr_list[i], &snr[i]);
+    }
+  }
+
+  free(sinfo);
+  return ret;
+}
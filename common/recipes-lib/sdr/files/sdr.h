@@ -39,6 +39,13 @@ extern "C" {
 int sdr_get_sensor_name(uint8_t fru, uint8_t snr_num, char *name);
 int sdr_get_sensor_units(uint8_t fru, uint8_t snr_num, char *units);
 int sdr_get_snr_thresh(uint8_t fru, uint8_t snr_num, thresh_sensor_t *snr);
+/*
+ * Thresholds of several sensors of one FRU, the SDR is only loaded once.
+ * Returns < 0 if the FRU failed as a whole, otherwise the result of each
+ * sensor is in snr_ret.
+ */
+int sdr_get_fru_snr_thresh(uint8_t fru, const uint8_t *snr_list, int snr_cnt,
+                           thresh_sensor_t *snr, int *snr_ret);
 
 #define FORMAT_CONV(X) ((int)(X*100 + 0.5)*0.01)  //take the second decimal place
 
@@ -20,10 +20,16 @@
 #include "sensor-correction.h"
 #include <assert.h>
 #include <jansson.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
 #include <stdbool.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/inotify.h>
 #ifndef __TEST__
 #include <syslog.h>
 #endif
@@ -50,6 +56,18 @@
 
 #define MAX_NUM_CONDITIONS 32
 #define MAX_NUM_TABLES     32
+#define MAX_NUM_FRUS       256
+#define MAX_NUM_SENSORS    256
+
+/* Where kv keeps the regular and persistent keys, watched so that the
+ * condition keys need not be read on every correction. */
+#ifdef __TEST__
+#define KV_CACHE_STORE     "./test/tmp"
+#define KV_PERSIST_STORE   "./test/persist"
+#else
+#define KV_CACHE_STORE     "/tmp/cache_store"
+#define KV_PERSIST_STORE   "/mnt/data/kv_store"
+#endif
 
 typedef struct {
   char cond_value[MAX_VALUE_LEN];
@@ -64,7 +82,7 @@ typedef struct {
 typedef struct {
   char name[32];
   size_t num;
-  correction_element_t *corr_table;
+  correction_element_t *corr_table;   /* sorted by cond_value */
 } correction_table_t;
 
 typedef enum {
@@ -83,11 +101,28 @@ typedef struct {
   char    cond_key[MAX_KEY_LEN];
   size_t  value_map_size;
   value_map_element_t value_map[MAX_NUM_CONDITIONS];
+  bool    interpolate;
+  int     cond_wd;                    /* inotify watch, -1 if none */
+  const char *cond_key_file;          /* cond_key relative to the watch */
+  size_t  cur_table;                  /* table for the cached key value */
 } sensor_correction_t;
 
 static sensor_correction_t *g_sensors = NULL;
 static size_t g_sensors_count = 0;
 
+/* (fru, sensor id) -> correction, second level allocated per FRU */
+static sensor_correction_t **g_index[MAX_NUM_FRUS];
+
+/* sensor_correction_init() loads the configuration once per process */
+static pthread_mutex_t g_init_lock = PTHREAD_MUTEX_INITIALIZER;
+static char g_init_file[PATH_MAX];
+static bool g_loaded = false;
+
+static int g_inotify_fd = -1;
+/* Cleared when the condition keys are no longer watched, e.g. in a
+ * forked child which does not have the watcher thread. */
+static bool g_cond_cached = false;
+
 static int get_table(value_map_element_t *value_map, size_t num, char *value, size_t *idx)
 {
   size_t i;
@@ -103,15 +138,147 @@ static int get_table(value_map_element_t *value_map, size_t num, char *value, si
 
 static sensor_correction_t *get_correction(uint8_t fru, uint8_t sensor_id)
 {
+  if (!g_index[fru]) {
+    return NULL;
+  }
+  return g_index[fru][sensor_id];
+}
+
+static int cmp_correction(const void *a, const void *b)
+{
+  float va = ((const correction_element_t *)a)->cond_value;
+  float vb = ((const correction_element_t *)b)->cond_value;
+  return (va > vb) - (va < vb);
+}
+
+static float get_table_correction(correction_table_t *table, bool interpolate, float cond_value)
+{
+  correction_element_t *t = table->corr_table, *lo, *hi;
+  size_t l = 0, h = table->num;
+
+  /* Find the first entry above cond_value */
+  while (l < h) {
+    size_t m = (l + h) / 2;
+    if (cond_value < t[m].cond_value) {
+      h = m;
+    } else {
+      l = m + 1;
+    }
+  }
+  if (l == 0) {
+    return t[0].correction;
+  }
+  if (l == table->num || !interpolate) {
+    return t[l - 1].correction;
+  }
+  lo = &t[l - 1];
+  hi = &t[l];
+  return lo->correction + (hi->correction - lo->correction) *
+    (cond_value - lo->cond_value) / (hi->cond_value - lo->cond_value);
+}
+
+static size_t read_cond_table(sensor_correction_t *snr)
+{
+  char value[MAX_VALUE_LEN] = {0};
+  unsigned int flags = snr->cond_key_type == KEY_PERSISTENT ? KV_FPERSIST : 0;
+  size_t table_idx;
+
+  if (kv_get(snr->cond_key, value, NULL, flags) ||
+      get_table(snr->value_map, snr->value_map_size, value, &table_idx)) {
+    table_idx = snr->default_table;
+  }
+  return table_idx;
+}
+
+static void refresh_cond_table(sensor_correction_t *snr)
+{
+  __atomic_store_n(&snr->cur_table, read_cond_table(snr), __ATOMIC_RELAXED);
+}
+
+static void *cond_watcher(void *arg)
+{
+  char buf[sizeof(struct inotify_event) + NAME_MAX + 1]
+    __attribute__((aligned(__alignof__(struct inotify_event))));
+  ssize_t len;
+  char *p;
   size_t i;
-  for(i = 0; i < g_sensors_count; i++) {
-    if (g_sensors[i].fru == fru && g_sensors[i].id == sensor_id) {
-      return &g_sensors[i];
+
+  (void)arg;
+  for (;;) {
+    len = read(g_inotify_fd, buf, sizeof(buf));
+    if (len < 0 && errno == EINTR) {
+      continue;
+    }
+    if (len <= 0) {
+      break;
+    }
+    for (p = buf; p < buf + len;) {
+      struct inotify_event *ev = (struct inotify_event *)p;
+      for (i = 0; i < g_sensors_count; i++) {
+        sensor_correction_t *snr = &g_sensors[i];
+        /* Events were lost on overflow, so re-read all keys */
+        if (ev->mask & IN_Q_OVERFLOW ||
+            (ev->wd == snr->cond_wd && ev->len &&
+             !strcmp(ev->name, snr->cond_key_file))) {
+          refresh_cond_table(snr);
+        }
+      }
+      p += sizeof(struct inotify_event) + ev->len;
     }
   }
+  INFO("Sensor correction: stopped watching condition keys\n");
+  __atomic_store_n(&g_cond_cached, false, __ATOMIC_RELAXED);
   return NULL;
 }
 
+static void cond_atfork_child(void)
+{
+  g_cond_cached = false;
+}
+
+/* Cache the table picked by each condition key, and refresh it from a
+ * watcher thread when kv writes or removes the key. */
+static void watch_cond_keys(void)
+{
+  char dir[PATH_MAX];
+  pthread_t tid;
+  size_t i;
+
+  g_inotify_fd = inotify_init1(IN_CLOEXEC);
+  if (g_inotify_fd < 0) {
+    return;
+  }
+  for (i = 0; i < g_sensors_count; i++) {
+    sensor_correction_t *snr = &g_sensors[i];
+    const char *slash = strrchr(snr->cond_key, '/');
+
+    /* kv creates the directory of the key when reading it */
+    read_cond_table(snr);
+    snr->cond_key_file = slash ? slash + 1 : snr->cond_key;
+    snprintf(dir, sizeof(dir), "%s/%.*s", snr->cond_key_type == KEY_PERSISTENT ?
+        KV_PERSIST_STORE : KV_CACHE_STORE,
+        (int)(snr->cond_key_file - snr->cond_key), snr->cond_key);
+    snr->cond_wd = inotify_add_watch(g_inotify_fd, dir,
+        IN_CLOSE_WRITE | IN_DELETE | IN_MOVED_TO | IN_MOVED_FROM);
+    if (snr->cond_wd < 0) {
+      DEBUG("Could not watch %s\n", dir);
+      goto bail;
+    }
+    refresh_cond_table(snr);
+  }
+  g_cond_cached = true;
+  if (pthread_create(&tid, NULL, cond_watcher, NULL)) {
+    g_cond_cached = false;
+    goto bail;
+  }
+  pthread_detach(tid);
+  pthread_atfork(NULL, NULL, cond_atfork_child);
+  return;
+bail:
+  close(g_inotify_fd);
+  g_inotify_fd = -1;
+}
+
 static int load_table(json_t *obj, correction_table_t *tbl)
 {
   size_t i;
@@ -145,6 +312,7 @@ static int load_table(json_t *obj, correction_table_t *tbl)
     tbl->corr_table[i].cond_value = get_float(cond_value_o);
     tbl->corr_table[i].correction = get_float(correction_o);
   }
+  qsort(tbl->corr_table, tbl->num, sizeof(correction_element_t), cmp_correction);
   return 0;
 }
 
@@ -158,7 +326,7 @@ static int search_table(const char *table_name, sensor_correction_t *snr, size_t
       return 0;
     }
   }
-  DEBUG("Could not get index for %s\n", value);
+  DEBUG("Could not get index for %s\n", table_name);
   return -1;
 }
 
@@ -215,6 +383,7 @@ static int load_conditional_sensor_correction(json_t *obj, sensor_correction_t *
   }
   strncpy(snr->cond_key, json_string_value(tmp), sizeof(snr->cond_key) - 1);
   snr->cond_key[sizeof(snr->cond_key) - 1] = '\0';
+  snr->cond_wd = -1;
 
   tmp = json_object_get(obj, "key_type");
   snr->cond_key_type = KEY_REGULAR;
@@ -287,6 +456,9 @@ static int load_sensor_correction(json_t *obj, sensor_correction_t *snr)
     return -1;
   }
 
+  tmp2 = json_object_get(tmp, "interpolate");
+  snr->interpolate = tmp2 && json_is_true(tmp2);
+
   tmp2 = json_object_get(tmp, "type");
   if (!tmp2 || !json_is_string(tmp2)) {
     DEBUG("Getting correction type failed!\n");
@@ -300,7 +472,7 @@ static int load_sensor_correction(json_t *obj, sensor_correction_t *snr)
   return ret;
 }
 
-int sensor_correction_init(const char *file)
+static int load_corrections(const char *file)
 {
   json_t *conf, *tmp;
   json_error_t error;
@@ -318,11 +490,13 @@ int sensor_correction_init(const char *file)
   tmp = json_object_get(conf, "sensors");
   if (!tmp || !json_is_array(tmp)) {
     DEBUG("Failed to get sensors");
+    json_decref(conf);
     return -1;
   }
   g_sensors_count = json_array_size(tmp);
   if (!g_sensors_count) {
     DEBUG("No sensors found in configuration");
+    json_decref(conf);
     return 0;
   }
   g_sensors = calloc(g_sensors_count, sizeof(sensor_correction_t));
@@ -343,9 +517,29 @@ int sensor_correction_init(const char *file)
       goto bail;
     }
   }
+
+  for (i = 0; i < g_sensors_count; i++) {
+    sensor_correction_t *snr = &g_sensors[i];
+    if (!g_index[snr->fru]) {
+      g_index[snr->fru] = calloc(MAX_NUM_SENSORS, sizeof(sensor_correction_t *));
+      if (!g_index[snr->fru]) {
+        DEBUG("Allocation failure!\n");
+        goto bail;
+      }
+    }
+    /* The first entry for a sensor wins, as with the linear search */
+    if (!g_index[snr->fru][snr->id]) {
+      g_index[snr->fru][snr->id] = snr;
+    }
+  }
+  watch_cond_keys();
   json_decref(conf);
   return 0;
 bail:
+  for (i = 0; i < MAX_NUM_FRUS; i++) {
+    free(g_index[i]);
+    g_index[i] = NULL;
+  }
   free(g_sensors);
   json_decref(conf);
   g_sensors = NULL;
@@ -353,70 +547,52 @@ bail:
   return -1;
 }
 
-int sensor_correction_apply(uint8_t fru, uint8_t sensor_id, float cond_value, float *sensor_reading)
+/* Safe to call from several threads: the first successful call loads
+ * the configuration, later calls for the same file return 0. */
+int sensor_correction_init(const char *file)
 {
-  char value[MAX_VALUE_LEN] = {0};
-  size_t table_idx = 0;
-  correction_table_t *table;
-  size_t i;
-  float correction;
-  unsigned int flags;
+  int ret;
 
-  sensor_correction_t *snr = get_correction(fru, sensor_id);
-  if (!snr) {
-    /* No correction defined for this sensor. Return success without
-     * manipulating it */
-    return 0;
-  }
-  flags = snr->cond_key_type == KEY_PERSISTENT ? KV_FPERSIST : 0;
-  if (kv_get(snr->cond_key, value, NULL, flags) ||
-      get_table(snr->value_map, snr->value_map_size, value, &table_idx)) {
-    table_idx = snr->default_table;
-  }
-  table = &snr->tables[table_idx];
-  correction = table->corr_table[0].correction;
-  for (i = 0; i < table->num; i++) {
-    if (cond_value < table->corr_table[i].cond_value) {
-      break;
+  pthread_mutex_lock(&g_init_lock);
+  if (g_loaded) {
+    ret = strcmp(g_init_file, file) ? -1 : 0;
+    if (ret) {
+      INFO("Sensor correction: %s already loaded, ignoring %s\n", g_init_file, file);
+    }
+  } else if (strlen(file) >= sizeof(g_init_file)) {
+    ret = -1;
+  } else {
+    ret = load_corrections(file);
+    if (!ret) {
+      strcpy(g_init_file, file);
+      __atomic_store_n(&g_loaded, true, __ATOMIC_RELEASE);
     }
-    correction = table->corr_table[i].correction;
   }
-  *sensor_reading = *sensor_reading - correction;
-  return 0;
+  pthread_mutex_unlock(&g_init_lock);
+  return ret;
 }
 
-#ifdef __TEST__
-int main(int argc, char *argv[])
+int sensor_correction_apply(uint8_t fru, uint8_t sensor_id, float cond_value, float *sensor_reading)
 {
-  float value;
-  float orig_value;
-  float cond_value;
-  uint8_t fru = 1;
-  uint8_t id  = 163;
-
-  if (argc < 4) {
-    printf("USAGE: %s JSON_FILE COND_VALUE SENSOR_VLAUE [SENSOR_ID FRU_ID]\n", argv[0]);
-    return -1;
-  }
-  if (sensor_correction_init(argv[1])) {
-    printf("Failed to load: %s\n", argv[1]);
-    return -1;
-  }
+  size_t table_idx;
+  sensor_correction_t *snr;
 
-  cond_value = atof(argv[2]);
-  orig_value = value = atof(argv[3]);
-  if (argc >= 5) {
-    id = atoi(argv[4]);
+  /* Nothing to correct until the configuration is loaded */
+  if (!__atomic_load_n(&g_loaded, __ATOMIC_ACQUIRE)) {
+    return 0;
   }
-  if (argc >= 6) {
-    fru = atoi(argv[5]);
+  snr = get_correction(fru, sensor_id);
+  if (!snr) {
+    /* No correction defined for this sensor. Return success without
+     * manipulating it */
+    return 0;
   }
-
-  if (sensor_correction_apply(fru, id, cond_value, &value)) {
-    printf("sensor correction failed!\n");
-    return -1;
+  if (__atomic_load_n(&g_cond_cached, __ATOMIC_RELAXED)) {
+    table_idx = __atomic_load_n(&snr->cur_table, __ATOMIC_RELAXED);
+  } else {
+    table_idx = read_cond_table(snr);
   }
-  printf("sensor value (%4.3f) post correction: %4.3f\n", orig_value, value);
+  *sensor_reading = *sensor_reading -
+    get_table_correction(&snr->tables[table_idx], snr->interpolate, cond_value);
   return 0;
 }
-#endif
@@ -0,0 +1,224 @@
+/*
+ *
+ * Copyright 2021-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <openbmc/kv.h>
+#include <openbmc/cmock.h>
+#include "sensor-correction.h"
+
+/* The __TEST__ build watches this directory for the regular keys */
+#define TEST_KV_DIR   "./test/tmp"
+#define TEST_CONF     "./sensor-correction-test.json"
+#define TEST_KEY      "test_cond"
+
+static int kv_reads;
+
+/* Regular keys are plain files, like kv keeps them */
+int kv_get(const char *key, char *value, size_t *len, unsigned int flags)
+{
+  char path[128];
+  FILE *fp;
+  size_t n;
+
+  (void)flags;
+  __atomic_fetch_add(&kv_reads, 1, __ATOMIC_RELAXED);
+  snprintf(path, sizeof(path), TEST_KV_DIR "/%s", key);
+  fp = fopen(path, "r");
+  if (!fp) {
+    return -1;
+  }
+  n = fread(value, 1, MAX_VALUE_LEN - 1, fp);
+  value[n] = '\0';
+  fclose(fp);
+  if (len) {
+    *len = n;
+  }
+  return 0;
+}
+
+static void set_key(const char *value)
+{
+  FILE *fp = fopen(TEST_KV_DIR "/" TEST_KEY, "w");
+
+  ASSERT(fp != NULL, "Write the condition key");
+  fputs(value, fp);
+  fclose(fp);
+}
+
+static float corrected(uint8_t id, float cond_value)
+{
+  float value = 100.0;
+  int ret = sensor_correction_apply(1, id, cond_value, &value);
+
+  ASSERT_EQ(ret, 0, "Apply correction");
+  return 100.0 - value;
+}
+
+/* ASSERT() evaluates its condition twice, so results are stored first */
+#define ASSERT_CORR(id, cond_value, expected, txt) do { \
+  float _c = corrected(id, cond_value);                  \
+  ASSERT_EQ_FLT(_c, expected, txt);                      \
+} while (0)
+
+/* The watcher refreshes the cached table shortly after the key changes */
+static bool wait_correction(uint8_t id, float cond_value, float expected)
+{
+  struct timespec ts = {0, 10 * 1000 * 1000};
+  int i;
+
+  for (i = 0; i < 200; i++) {
+    float c = corrected(id, cond_value);
+    if (c < expected + 0.001 && c > expected - 0.001) {
+      return true;
+    }
+    nanosleep(&ts, NULL);
+  }
+  return false;
+}
+
+static void load(void)
+{
+  int ret = sensor_correction_init(TEST_CONF);
+
+  ASSERT_EQ(ret, 0, "Load the test configuration");
+}
+
+DEFINE_TEST(test_key_refresh)
+{
+  bool ok;
+
+  load();
+  ok = wait_correction(1, 15, 1);
+  ASSERT(ok, "Table A is used");
+
+  set_key("B");
+  ok = wait_correction(1, 15, 10);
+  ASSERT(ok, "Table B is used after the key changed");
+
+  unlink(TEST_KV_DIR "/" TEST_KEY);
+  ok = wait_correction(1, 15, 1);
+  ASSERT(ok, "Default table is used without the key");
+
+  set_key("A");
+  ok = wait_correction(1, 15, 1);
+  ASSERT(ok, "Table A is used again");
+}
+
+DEFINE_TEST(test_cached_key)
+{
+  int reads;
+
+  load();
+  reads = __atomic_load_n(&kv_reads, __ATOMIC_RELAXED);
+  corrected(1, 15);
+  corrected(2, 15);
+  ASSERT_EQ(__atomic_load_n(&kv_reads, __ATOMIC_RELAXED), reads,
+      "The condition key is not read on every correction");
+}
+
+DEFINE_TEST(test_interpolate)
+{
+  load();
+  ASSERT_CORR(2, 5, 2, "Below the table");
+  ASSERT_CORR(2, 10, 2, "First entry");
+  ASSERT_CORR(2, 15, 3, "Half way");
+  ASSERT_CORR(2, 17.5, 3.5, "Three quarters");
+  ASSERT_CORR(2, 20, 4, "Last entry");
+  ASSERT_CORR(2, 25, 4, "Above the table");
+}
+
+DEFINE_TEST(test_table_lookup)
+{
+  load();
+  /* The table is listed unsorted in the configuration */
+  ASSERT_CORR(1, 5, 1, "Below the table");
+  ASSERT_CORR(1, 10, 1, "First entry");
+  ASSERT_CORR(1, 15, 1, "Between the first two entries");
+  ASSERT_CORR(1, 20, 2, "Middle entry");
+  ASSERT_CORR(1, 29.9, 2, "Just below the last entry");
+  ASSERT_CORR(1, 30, 3, "Last entry");
+  ASSERT_CORR(1, 100, 3, "Above the table");
+  ASSERT_CORR(1, 1000, 3, "Far above the table");
+  ASSERT_CORR(3, 15, 0, "No correction for other sensors");
+}
+
+DEFINE_TEST(test_init_once)
+{
+  int reads, ret;
+
+  load();
+  reads = __atomic_load_n(&kv_reads, __ATOMIC_RELAXED);
+  load();
+  ASSERT_EQ(__atomic_load_n(&kv_reads, __ATOMIC_RELAXED), reads,
+      "Only the first init loads the configuration");
+  ret = sensor_correction_init("./other.json");
+  ASSERT_NEQ(ret, 0, "Another configuration is refused once loaded");
+}
+
+/* Without arguments run the tests, otherwise correct one reading */
+int main(int argc, char *argv[])
+{
+  float value;
+  float orig_value;
+  float cond_value;
+  uint8_t fru = 1;
+  uint8_t id  = 163;
+
+  if (argc == 1) {
+    if (chdir(dirname(argv[0])) != 0) {
+      printf("Cannot chdir into %s\n", dirname(argv[0]));
+      return -1;
+    }
+    mkdir("./test", 0755);
+    mkdir(TEST_KV_DIR, 0755);
+    set_key("A");
+    CALL_TESTS();
+    return 0;
+  }
+  if (argc < 4) {
+    printf("USAGE: %s [JSON_FILE COND_VALUE SENSOR_VLAUE [SENSOR_ID FRU_ID]]\n", argv[0]);
+    return -1;
+  }
+  if (sensor_correction_init(argv[1])) {
+    printf("Failed to load: %s\n", argv[1]);
+    return -1;
+  }
+
+  cond_value = atof(argv[2]);
+  orig_value = value = atof(argv[3]);
+  if (argc >= 5) {
+    id = atoi(argv[4]);
+  }
+  if (argc >= 6) {
+    fru = atoi(argv[5]);
+  }
+
+  if (sensor_correction_apply(fru, id, cond_value, &value)) {
+    printf("sensor correction failed!\n");
+    return -1;
+  }
+  printf("sensor value (%4.3f) post correction: %4.3f\n", orig_value, value);
+  return 0;
+}
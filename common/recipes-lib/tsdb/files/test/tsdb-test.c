@@ -0,0 +1,468 @@
+/*
+ * Copyright 2021-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <openbmc/cmock.h>
+#include "tsdb.h"
+
+typedef struct {
+  int cnt;
+  uint32_t ts[4096];
+  float vals[4096][TSDB_MAX_COLS];
+} points_t;
+
+typedef struct {
+  tsdb_outbox_t ob;
+  const char *dir;
+  uint32_t now;
+} sink_t;
+
+static int collect(uint32_t ts, const float *vals, int ncols, void *arg)
+{
+  points_t *p = (points_t *)arg;
+
+  if (p->cnt < 4096) {
+    p->ts[p->cnt] = ts;
+    memcpy(p->vals[p->cnt], vals, ncols * sizeof(float));
+    p->cnt++;
+  }
+  return 0;
+}
+
+static void to_outbox(const tsdb_block_t *blk, void *arg)
+{
+  sink_t *sk = (sink_t *)arg;
+  int ret;
+
+  ret = tsdb_outbox_push(&sk->ob, blk, sk->now);
+  ASSERT_EQ(ret, 0, "Outbox full");
+  if (tsdb_outbox_due(&sk->ob, sk->now))
+    tsdb_outbox_flush(&sk->ob, sk->dir);
+}
+
+static off_t file_size(const char *dir, const char *name)
+{
+  char path[128];
+  struct stat st;
+
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  if (stat(path, &st) < 0)
+    return -1;
+  return st.st_size;
+}
+
+static char *make_dir(void)
+{
+  static char dir[64];
+  char *ret;
+
+  strcpy(dir, "/tmp/tsdb-test.XXXXXX");
+  ret = mkdtemp(dir);
+  ASSERT(ret != NULL, "mkdtemp");
+  return dir;
+}
+
+static void remove_dir(const char *dir)
+{
+  char cmd[128];
+  int ret;
+
+  snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+  ret = system(cmd);
+  ASSERT_EQ(ret, 0, "rm");
+}
+
+DEFINE_TEST(test_codec_roundtrip)
+{
+  static points_t p;
+  tsdb_enc_t enc;
+  tsdb_dec_t dec;
+  float v, out;
+  uint32_t ts;
+  int i, n = 0, ret;
+
+  tsdb_enc_init(&enc, 1, TSDB_TIER_RAW, 1);
+  for (i = 0; i < 4096; i++) {
+    // Mostly regular intervals with a few slow reads
+    ts = 1000 + i * 3 + (i % 50 == 0 ? 2 : 0) + (i > 100 ? 5000 : 0);
+    v = 25.0 + (i / 20) * 0.5;
+    if (tsdb_enc_append(&enc, ts, &v) == TSDB_EFULL)
+      break;
+    p.ts[n] = ts;
+    p.vals[n][0] = v;
+    n++;
+  }
+  ASSERT(n > 300, "Poor compression");
+  ASSERT_EQ(tsdb_dec_init(&dec, tsdb_enc_seal(&enc)), 0, "Bad block");
+  for (i = 0; i < n; i++) {
+    ret = tsdb_dec_next(&dec, &ts, &out);
+    ASSERT_EQ(ret, 1, "Missing point");
+    ASSERT_EQ(ts, p.ts[i], "Wrong timestamp");
+    ASSERT_EQ(out, p.vals[i][0], "Wrong value");
+  }
+  ret = tsdb_dec_next(&dec, &ts, &out);
+  ASSERT_EQ(ret, 0, "Extra point");
+}
+
+DEFINE_TEST(test_codec_multi_column)
+{
+  float in[4] = {1.5, -3.25, 1e6, 0}, out[4];
+  tsdb_enc_t enc;
+  tsdb_dec_t dec;
+  uint32_t ts;
+  int i, ret;
+
+  tsdb_enc_init(&enc, 1, TSDB_TIER_5MIN, 4);
+  for (i = 0; i < 20; i++) {
+    in[3] = i;
+    in[1] = -in[1];
+    ret = tsdb_enc_append(&enc, i * 300, in);
+    ASSERT_EQ(ret, 0, "Append");
+  }
+  ASSERT_EQ(tsdb_dec_init(&dec, tsdb_enc_seal(&enc)), 0, "Bad block");
+  for (i = 0; i < 20; i++) {
+    ret = tsdb_dec_next(&dec, &ts, out);
+    ASSERT_EQ(ret, 1, "Missing point");
+    ASSERT_EQ(ts, (uint32_t)i * 300, "Wrong timestamp");
+    ASSERT_EQ(out[0], 1.5, "Wrong avg");
+    ASSERT_EQ(out[1], (i & 1) ? -3.25 : 3.25, "Wrong min");
+    ASSERT_EQ(out[3], i, "Wrong count");
+  }
+}
+
+DEFINE_TEST(test_codec_corruption)
+{
+  tsdb_enc_t enc;
+  tsdb_dec_t dec;
+  tsdb_block_t blk;
+  float v = 42;
+
+  tsdb_enc_init(&enc, 1, TSDB_TIER_RAW, 1);
+  tsdb_enc_append(&enc, 10, &v);
+  tsdb_enc_append(&enc, 20, &v);
+  blk = *tsdb_enc_seal(&enc);
+  blk.data[0] ^= 0x10;
+  ASSERT_EQ(tsdb_dec_init(&dec, &blk), -1, "Corruption not detected");
+}
+
+DEFINE_TEST(test_series_query_tiers)
+{
+  static points_t p;
+  static tsdb_series_t s;
+  static sink_t sk;
+  uint32_t id = tsdb_series_id("slot1_sensor1");
+  uint32_t t0 = 1600000000 - 1600000000 % 3600;
+  uint32_t ts;
+  float v;
+  int i;
+
+  memset(&sk, 0, sizeof(sk));
+  sk.dir = make_dir();
+  tsdb_series_init(&s, id);
+  ASSERT(tsdb_series_valid(&s, id), "Invalid series");
+
+  // Two days of a reading every 10 seconds
+  for (i = 0; i < 2 * 8640; i++) {
+    ts = t0 + i * 10;
+    v = (i % 360) / 10.0;
+    sk.now = ts;
+    tsdb_series_add(&s, ts, v, to_outbox, &sk);
+  }
+
+  // The last hour of raw points is still there, in order
+  p.cnt = 0;
+  tsdb_series_query(&s, &sk.ob, sk.dir, id, TSDB_TIER_RAW, ts - 3599, ts, collect, &p);
+  ASSERT_EQ(p.cnt, 360, "Wrong raw count");
+  for (i = 0; i < p.cnt; i++)
+    ASSERT_EQ(p.ts[i], ts - 3590 + i * 10, "Wrong raw timestamp");
+
+  // Hourly points cover the two days
+  p.cnt = 0;
+  tsdb_series_query(&s, &sk.ob, sk.dir, id, TSDB_TIER_HOUR, t0, ts, collect, &p);
+  ASSERT_EQ(p.cnt, 48, "Wrong hourly count");
+  for (i = 0; i < p.cnt; i++) {
+    ASSERT_EQ(p.ts[i], t0 + i * 3600, "Wrong hourly timestamp");
+    ASSERT_EQ(p.vals[i][TSDB_COL_COUNT], 360, "Wrong hourly samples");
+    ASSERT_EQ_FLT(p.vals[i][TSDB_COL_AVG], 17.95, "Wrong hourly avg");
+    ASSERT_EQ(p.vals[i][TSDB_COL_MAX], 35.9f, "Wrong hourly max");
+  }
+
+  // 5 minute points come from the files, the outbox and memory alike
+  p.cnt = 0;
+  tsdb_series_query(&s, &sk.ob, sk.dir, id, TSDB_TIER_5MIN, t0, ts, collect, &p);
+  ASSERT_EQ(p.cnt, 2 * 288, "Wrong 5 minute count");
+
+  // Only what reached the files after a flush
+  tsdb_outbox_flush(&sk.ob, sk.dir);
+  p.cnt = 0;
+  tsdb_store_query(sk.dir, id, TSDB_TIER_5MIN, t0, ts, collect, &p);
+  ASSERT(p.cnt > 0 && p.cnt < 2 * 288, "Wrong stored 5 minute count");
+  for (i = 1; i < p.cnt; i++)
+    ASSERT_EQ(p.ts[i], p.ts[i - 1] + 300, "Gap in stored points");
+
+  // Nothing of other series
+  p.cnt = 0;
+  tsdb_store_query(sk.dir, id + 1, TSDB_TIER_RAW, t0, ts, collect, &p);
+  ASSERT_EQ(p.cnt, 0, "Points of another series");
+
+  remove_dir(sk.dir);
+}
+
+DEFINE_TEST(test_store_torn_tail_and_tombstone)
+{
+  static points_t p;
+  tsdb_enc_t enc;
+  const tsdb_block_t *blk;
+  char path[128];
+  uint32_t id = 7;
+  const char *dir = make_dir();
+  float v = 1;
+  int fd, i, ret;
+
+  for (i = 0; i < 3; i++) {
+    tsdb_enc_init(&enc, id, TSDB_TIER_RAW, 1);
+    tsdb_enc_append(&enc, 100 + i * 10, &v);
+    tsdb_enc_append(&enc, 105 + i * 10, &v);
+    blk = tsdb_enc_seal(&enc);
+    ret = tsdb_store_append(dir, TSDB_TIER_RAW, blk, 1);
+    ASSERT_EQ(ret, 0, "Append");
+  }
+
+  // Half a block left behind by a power loss
+  snprintf(path, sizeof(path), "%s/raw.0", dir);
+  fd = open(path, O_WRONLY | O_APPEND);
+  ASSERT(fd >= 0, "open");
+  ret = write(fd, blk, 100);
+  ASSERT_EQ(ret, 100, "write");
+  close(fd);
+
+  p.cnt = 0;
+  tsdb_store_query(dir, id, TSDB_TIER_RAW, 0, 1000, collect, &p);
+  ASSERT_EQ(p.cnt, 6, "Torn tail not skipped");
+
+  // The next append goes after the last whole block
+  ret = tsdb_store_append(dir, TSDB_TIER_RAW, blk, 0);
+  ASSERT_EQ(ret, -1, "Empty append");
+  tsdb_enc_init(&enc, id, TSDB_TIER_RAW, 1);
+  tsdb_enc_append(&enc, 200, &v);
+  ret = tsdb_store_append(dir, TSDB_TIER_RAW, tsdb_enc_seal(&enc), 1);
+  ASSERT_EQ(ret, 0, "Append");
+  p.cnt = 0;
+  tsdb_store_query(dir, id, TSDB_TIER_RAW, 0, 1000, collect, &p);
+  ASSERT_EQ(p.cnt, 7, "Block after torn tail lost");
+
+  ret = tsdb_store_tombstone(dir, id, 115);
+  ASSERT_EQ(ret, 0, "Tombstone");
+  p.cnt = 0;
+  tsdb_store_query(dir, id, TSDB_TIER_RAW, 0, 1000, collect, &p);
+  ASSERT_EQ(p.cnt, 3, "Cleared points returned");
+  ASSERT_EQ(p.ts[0], 120, "Wrong first point");
+
+  remove_dir(dir);
+}
+
+DEFINE_TEST(test_store_index)
+{
+  static points_t p, q;
+  tsdb_enc_t enc;
+  uint32_t id, t;
+  const char *dir = make_dir();
+  char path[128];
+  float v = 3;
+  int i, ret;
+
+  // Blocks of a few series interleaved, as the outbox writes them
+  for (t = 0; t < 40; t++) {
+    for (id = 1; id <= 4; id++) {
+      tsdb_enc_init(&enc, id, TSDB_TIER_RAW, 1);
+      tsdb_enc_append(&enc, 1000 + t * 100, &v);
+      tsdb_enc_append(&enc, 1050 + t * 100, &v);
+      ret = tsdb_store_append(dir, TSDB_TIER_RAW, tsdb_enc_seal(&enc), 1);
+      ASSERT_EQ(ret, 0, "Append");
+    }
+  }
+  ASSERT_EQ(file_size(dir, "raw.0.idx"), 160 * 12, "Wrong index size");
+
+  p.cnt = 0;
+  tsdb_store_query(dir, 3, TSDB_TIER_RAW, 2000, 2999, collect, &p);
+  ASSERT_EQ(p.cnt, 20, "Wrong indexed count");
+  for (i = 0; i < p.cnt; i++)
+    ASSERT_EQ(p.ts[i], 2000 + (i / 2) * 100 + (i % 2) * 50, "Wrong timestamp");
+
+  // The same without the index
+  snprintf(path, sizeof(path), "%s/raw.0.idx", dir);
+  unlink(path);
+  q.cnt = 0;
+  tsdb_store_query(dir, 3, TSDB_TIER_RAW, 2000, 2999, collect, &q);
+  ASSERT_EQ(q.cnt, p.cnt, "Wrong scanned count");
+  ASSERT_EQ(memcmp(q.ts, p.ts, p.cnt * sizeof(p.ts[0])), 0, "Wrong scanned points");
+
+  // A lost index is rebuilt by the next append
+  tsdb_enc_init(&enc, 3, TSDB_TIER_RAW, 1);
+  tsdb_enc_append(&enc, 5000, &v);
+  ret = tsdb_store_append(dir, TSDB_TIER_RAW, tsdb_enc_seal(&enc), 1);
+  ASSERT_EQ(ret, 0, "Append");
+  ASSERT_EQ(file_size(dir, "raw.0.idx"), 161 * 12, "Index not rebuilt");
+  p.cnt = 0;
+  tsdb_store_query(dir, 3, TSDB_TIER_RAW, 0, 9999, collect, &p);
+  ASSERT_EQ(p.cnt, 81, "Wrong count after rebuild");
+
+  remove_dir(dir);
+}
+
+DEFINE_TEST(test_outbox_due)
+{
+  static tsdb_outbox_t ob;
+  tsdb_enc_t enc;
+  float v = 1;
+  int i, ret;
+
+  memset(&ob, 0, sizeof(ob));
+  tsdb_enc_init(&enc, 1, TSDB_TIER_RAW, 1);
+  tsdb_enc_append(&enc, 10, &v);
+  tsdb_enc_seal(&enc);
+
+  ret = tsdb_outbox_push(&ob, &enc.blk, 100);
+  ASSERT_EQ(ret, 0, "Push");
+  ASSERT(!tsdb_outbox_due(&ob, 100 + TSDB_FLUSH_INTERVAL - 1), "Due too early");
+  ASSERT(tsdb_outbox_due(&ob, 100 + TSDB_FLUSH_INTERVAL), "Not due in time");
+
+  for (i = 1; i < TSDB_FLUSH_BLOCKS; i++)
+    tsdb_outbox_push(&ob, &enc.blk, 100);
+  ASSERT(tsdb_outbox_due(&ob, 100), "Not due when full");
+  for (; i < TSDB_OUTBOX_BLOCKS; i++)
+    tsdb_outbox_push(&ob, &enc.blk, 100);
+  ret = tsdb_outbox_push(&ob, &enc.blk, 100);
+  ASSERT_EQ(ret, -1, "Pushed past the end");
+
+  // Blocks pushed while the outbox was written stay
+  tsdb_outbox_drop(&ob, TSDB_OUTBOX_BLOCKS - 2, 200);
+  ASSERT_EQ(ob.cnt, 2, "Wrong count after drop");
+  ASSERT_EQ(ob.first, 200, "Wrong first after drop");
+}
+
+DEFINE_TEST(test_checkpoint_recover)
+{
+  static points_t p;
+  static tsdb_series_t s;
+  static sink_t sk;
+  uint32_t id = tsdb_series_id("slot1_sensor2");
+  uint32_t t0 = 1600000000, ts = t0;
+  int i, ret;
+
+  memset(&sk, 0, sizeof(sk));
+  sk.dir = make_dir();
+  tsdb_series_init(&s, id);
+  // Start the interval at t0, whatever the phase of the series
+  tsdb_series_checkpoint(&s, t0 - TSDB_CHECKPOINT_INTERVAL, to_outbox, &sk);
+  tsdb_series_checkpoint(&s, t0, to_outbox, &sk);
+  ASSERT_EQ(sk.ob.cnt, 0, "Empty blocks checkpointed");
+
+  // Not enough to fill a block before the checkpoint is due
+  for (i = 0; ts < t0 + TSDB_CHECKPOINT_INTERVAL; i++) {
+    ts = t0 + i * 10;
+    sk.now = ts;
+    tsdb_series_add(&s, ts, 20, to_outbox, &sk);
+    tsdb_series_checkpoint(&s, ts, to_outbox, &sk);
+  }
+  // No hourly point yet
+  ASSERT_EQ(sk.ob.cnt, 2, "Wrong checkpointed blocks");
+  // Nothing changed since
+  tsdb_series_checkpoint(&s, ts + TSDB_CHECKPOINT_INTERVAL, to_outbox, &sk);
+  ASSERT_EQ(sk.ob.cnt, 2, "Unchanged block checkpointed");
+
+  // Copies are not returned twice
+  p.cnt = 0;
+  tsdb_series_query(&s, &sk.ob, sk.dir, id, TSDB_TIER_RAW, t0, ts, collect, &p);
+  ASSERT_EQ(p.cnt, i, "Wrong live count");
+
+  ret = tsdb_outbox_flush(&sk.ob, sk.dir);
+  ASSERT_EQ(ret, 0, "Flush");
+  ASSERT_EQ(file_size(sk.dir, "checkpoint"), 2 * TSDB_BLOCK_SIZE, "Wrong checkpoint size");
+  p.cnt = 0;
+  tsdb_store_query(sk.dir, id, TSDB_TIER_RAW, t0, ts, collect, &p);
+  ASSERT_EQ(p.cnt, 0, "Checkpoint in the segments");
+
+  // Later checkpoints of the series reuse its slots
+  for (i = 0; i < 2; i++) {
+    ts += TSDB_CHECKPOINT_INTERVAL;
+    tsdb_series_add(&s, ts, 21, to_outbox, &sk);
+    tsdb_series_checkpoint(&s, ts, to_outbox, &sk);
+  }
+  tsdb_outbox_flush(&sk.ob, sk.dir);
+  ASSERT_EQ(file_size(sk.dir, "checkpoint"), 3 * TSDB_BLOCK_SIZE, "Wrong checkpoint slots");
+
+  // After a reboot the memory is gone, the checkpoint is not
+  ret = tsdb_checkpoint_recover(sk.dir);
+  ASSERT_EQ(ret, 0, "Recover");
+  ASSERT_EQ(file_size(sk.dir, "checkpoint"), 0, "Checkpoint not emptied");
+  p.cnt = 0;
+  tsdb_store_query(sk.dir, id, TSDB_TIER_RAW, t0, ts, collect, &p);
+  ASSERT(p.cnt > TSDB_CHECKPOINT_INTERVAL / 10, "Raw points lost");
+  ASSERT_EQ(p.ts[p.cnt - 1], ts, "Last raw point lost");
+  p.cnt = 0;
+  tsdb_store_query(sk.dir, id, TSDB_TIER_5MIN, t0, ts, collect, &p);
+  ASSERT(p.cnt >= TSDB_CHECKPOINT_INTERVAL / 300, "5 minute points lost");
+
+  ret = tsdb_checkpoint_recover(sk.dir);
+  ASSERT_EQ(ret, 0, "Recover again");
+  remove_dir(sk.dir);
+}
+
+static void count_blocks(const tsdb_block_t *blk, void *arg)
+{
+  (*(int *)arg)++;
+}
+
+DEFINE_TEST(test_checkpoint_stagger)
+{
+  static tsdb_series_t s[64];
+  uint32_t t0 = 1600000000, ts;
+  char key[32];
+  int i, n, max = 0, total = 0;
+
+  for (i = 0; i < 64; i++) {
+    snprintf(key, sizeof(key), "slot%d_sensor%d", i / 16 + 1, i % 16);
+    tsdb_series_init(&s[i], tsdb_series_id(key));
+  }
+  // Every series is polled in the same sweeps, every 10 seconds
+  for (ts = t0; ts < t0 + 2 * TSDB_CHECKPOINT_INTERVAL; ts += 10) {
+    n = 0;
+    for (i = 0; i < 64; i++) {
+      tsdb_series_add(&s[i], ts, 20 + i, NULL, NULL);
+      tsdb_series_checkpoint(&s[i], ts, count_blocks, &n);
+    }
+    if (n > max)
+      max = n;
+    total += n;
+  }
+  ASSERT(total >= 64 * 2, "Series not checkpointed");
+  // Without the phase all 128 blocks come in one sweep
+  ASSERT(max <= 16, "Checkpoints not spread over the interval");
+}
+
+int main(int argc, char *argv[])
+{
+  CALL_TESTS();
+  return 0;
+}
@@ -0,0 +1,1198 @@
+/*
+ * Copyright 2021-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include "tsdb.h"
+
+#define TSDB_MAGIC          0x5344    // "DS"
+#define TSDB_VERSION        1
+#define TSDB_SERIES_MAGIC   0x54534443
+#define TSDB_DATA_BITS      (sizeof(((tsdb_block_t *)0)->data) * 8)
+#define TSDB_READ_BLOCKS    64
+#define TSDB_MAX_SEGMENTS   64
+
+typedef struct {
+  uint32_t series;
+  uint32_t ts;
+} tsdb_tombstone_t;
+
+// One per block of a segment, in the same order
+typedef struct {
+  uint32_t series;
+  uint32_t t_first;
+  uint32_t t_last;
+} tsdb_index_t;
+
+// Segments each tier may use, 2MB each. An hour of raw points of a few
+// hundred sensors, days of 5 minute and a month of hourly points.
+static const int tier_segments[TSDB_TIER_MAX] = {8, 8, 8};
+static const uint32_t tier_period[TSDB_TIER_MAX] = {0, 300, 3600};
+static const char *tier_names[TSDB_TIER_MAX] = {"raw", "5min", "hour"};
+
+uint32_t
+tsdb_series_id(const char *key)
+{
+  uint32_t h = 2166136261u;
+
+  // FNV-1a
+  while (*key) {
+    h ^= (uint8_t)*key++;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+const char *
+tsdb_tier_name(int tier)
+{
+  return (tier >= 0 && tier < TSDB_TIER_MAX) ? tier_names[tier] : NULL;
+}
+
+uint32_t
+tsdb_tier_period(int tier)
+{
+  return (tier >= 0 && tier < TSDB_TIER_MAX) ? tier_period[tier] : 0;
+}
+
+static uint32_t
+crc32(uint32_t crc, const uint8_t *buf, size_t len)
+{
+  int i;
+
+  crc = ~crc;
+  while (len--) {
+    crc ^= *buf++;
+    for (i = 0; i < 8; i++)
+      crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+  }
+  return ~crc;
+}
+
+static uint32_t
+block_crc(const tsdb_block_t *blk)
+{
+  tsdb_block_hdr_t hdr = blk->hdr;
+  uint32_t crc;
+
+  hdr.crc = 0;
+  crc = crc32(0, (const uint8_t *)&hdr, sizeof(hdr));
+  return crc32(crc, blk->data, (blk->hdr.nbits + 7) / 8);
+}
+
+static inline uint32_t
+float_bits(float f)
+{
+  uint32_t u;
+  memcpy(&u, &f, sizeof(u));
+  return u;
+}
+
+static inline float
+bits_float(uint32_t u)
+{
+  float f;
+  memcpy(&f, &u, sizeof(f));
+  return f;
+}
+
+static bool
+put_bits(tsdb_block_t *blk, uint32_t *pos, uint32_t val, int n)
+{
+  uint8_t mask;
+
+  if (*pos + n > TSDB_DATA_BITS)
+    return false;
+  while (n--) {
+    mask = 0x80 >> (*pos & 7);
+    if ((val >> n) & 1)
+      blk->data[*pos >> 3] |= mask;
+    else
+      blk->data[*pos >> 3] &= ~mask;
+    (*pos)++;
+  }
+  return true;
+}
+
+static bool
+get_bits(tsdb_dec_t *dec, int n, uint32_t *val)
+{
+  uint32_t v = 0;
+
+  if (dec->pos + n > dec->blk->hdr.nbits)
+    return false;
+  while (n--) {
+    v = (v << 1) | ((dec->blk->data[dec->pos >> 3] >> (7 - (dec->pos & 7))) & 1);
+    dec->pos++;
+  }
+  *val = v;
+  return true;
+}
+
+void
+tsdb_enc_init(tsdb_enc_t *enc, uint32_t series, int tier, int ncols)
+{
+  memset(enc, 0, sizeof(*enc));
+  enc->blk.hdr.magic = TSDB_MAGIC;
+  enc->blk.hdr.version = TSDB_VERSION;
+  enc->blk.hdr.ncols = ncols;
+  enc->blk.hdr.tier = tier;
+  enc->blk.hdr.series = series;
+}
+
+/*
+ * Delta of delta buckets of the timestamps:
+ * '0' no change, '10' 7 bits, '110' 9 bits, '1110' 12 bits, '1111' 32 bits.
+ */
+static bool
+put_dod(tsdb_block_t *blk, uint32_t *pos, int32_t dod)
+{
+  if (dod == 0)
+    return put_bits(blk, pos, 0, 1);
+  if (dod >= -63 && dod <= 64)
+    return put_bits(blk, pos, 2, 2) && put_bits(blk, pos, dod + 63, 7);
+  if (dod >= -255 && dod <= 256)
+    return put_bits(blk, pos, 6, 3) && put_bits(blk, pos, dod + 255, 9);
+  if (dod >= -2047 && dod <= 2048)
+    return put_bits(blk, pos, 14, 4) && put_bits(blk, pos, dod + 2047, 12);
+  return put_bits(blk, pos, 15, 4) && put_bits(blk, pos, (uint32_t)dod, 32);
+}
+
+static bool
+get_dod(tsdb_dec_t *dec, int32_t *dod)
+{
+  static const int widths[] = {7, 9, 12};
+  static const int32_t bias[] = {63, 255, 2047};
+  uint32_t bit, v;
+  int i;
+
+  for (i = 0; i < 4; i++) {
+    if (!get_bits(dec, 1, &bit))
+      return false;
+    if (!bit)
+      break;
+  }
+  if (i == 0) {
+    *dod = 0;
+  } else if (i < 4) {
+    if (!get_bits(dec, widths[i - 1], &v))
+      return false;
+    *dod = (int32_t)v - bias[i - 1];
+  } else {
+    if (!get_bits(dec, 32, &v))
+      return false;
+    *dod = (int32_t)v;
+  }
+  return true;
+}
+
+/*
+ * Values: '0' same as before, '10' meaningful bits within the previous
+ * window, '11' 5 bits leading zeros, 5 bits length - 1 and the bits.
+ */
+static bool
+put_value(tsdb_block_t *blk, uint32_t *pos, uint32_t x, uint8_t *lead, uint8_t *len)
+{
+  int l, t, n;
+
+  if (x == 0)
+    return put_bits(blk, pos, 0, 1);
+
+  l = __builtin_clz(x);
+  t = __builtin_ctz(x);
+  if (*len && l >= *lead && t >= 32 - *lead - *len) {
+    return put_bits(blk, pos, 2, 2) &&
+           put_bits(blk, pos, x >> (32 - *lead - *len), *len);
+  }
+
+  n = 32 - l - t;
+  *lead = l;
+  *len = n;
+  return put_bits(blk, pos, 3, 2) && put_bits(blk, pos, l, 5) &&
+         put_bits(blk, pos, n - 1, 5) && put_bits(blk, pos, x >> t, n);
+}
+
+static bool
+get_value(tsdb_dec_t *dec, int col, uint32_t *x)
+{
+  uint32_t bit, v;
+
+  if (!get_bits(dec, 1, &bit))
+    return false;
+  if (!bit) {
+    *x = 0;
+    return true;
+  }
+  if (!get_bits(dec, 1, &bit))
+    return false;
+  if (bit) {
+    if (!get_bits(dec, 5, &v))
+      return false;
+    dec->lead[col] = v;
+    if (!get_bits(dec, 5, &v))
+      return false;
+    dec->len[col] = v + 1;
+    if (dec->lead[col] + dec->len[col] > 32)
+      return false;
+  } else if (dec->len[col] == 0) {
+    return false;
+  }
+  if (!get_bits(dec, dec->len[col], &v))
+    return false;
+  *x = v << (32 - dec->lead[col] - dec->len[col]);
+  return true;
+}
+
+int
+tsdb_enc_append(tsdb_enc_t *enc, uint32_t ts, const float *vals)
+{
+  tsdb_block_hdr_t *hdr = &enc->blk.hdr;
+  uint8_t lead[TSDB_MAX_COLS], len[TSDB_MAX_COLS];
+  uint32_t pos = hdr->nbits;
+  int32_t delta = 0;
+  int i;
+
+  if (hdr->count == UINT16_MAX)
+    return TSDB_EFULL;
+
+  memcpy(lead, enc->lead, sizeof(lead));
+  memcpy(len, enc->len, sizeof(len));
+
+  if (hdr->count == 0) {
+    for (i = 0; i < hdr->ncols; i++) {
+      if (!put_bits(&enc->blk, &pos, float_bits(vals[i]), 32))
+        return TSDB_EFULL;
+    }
+  } else {
+    // Time only moves forward within a series
+    if ((int32_t)(ts - enc->t_prev) < 0)
+      ts = enc->t_prev;
+    delta = ts - enc->t_prev;
+    if (!put_dod(&enc->blk, &pos, delta - enc->d_prev))
+      return TSDB_EFULL;
+    for (i = 0; i < hdr->ncols; i++) {
+      if (!put_value(&enc->blk, &pos, float_bits(vals[i]) ^ enc->v_prev[i],
+                     &lead[i], &len[i]))
+        return TSDB_EFULL;
+    }
+  }
+
+  if (hdr->count == 0)
+    hdr->t_first = ts;
+  hdr->t_last = ts;
+  hdr->count++;
+  hdr->nbits = pos;
+  enc->t_prev = ts;
+  enc->d_prev = delta;
+  for (i = 0; i < hdr->ncols; i++)
+    enc->v_prev[i] = float_bits(vals[i]);
+  memcpy(enc->lead, lead, sizeof(lead));
+  memcpy(enc->len, len, sizeof(len));
+  return 0;
+}
+
+const tsdb_block_t *
+tsdb_enc_seal(tsdb_enc_t *enc)
+{
+  enc->blk.hdr.crc = block_crc(&enc->blk);
+  return &enc->blk;
+}
+
+int
+tsdb_dec_init(tsdb_dec_t *dec, const tsdb_block_t *blk)
+{
+  const tsdb_block_hdr_t *hdr = &blk->hdr;
+
+  if (hdr->magic != TSDB_MAGIC || hdr->version != TSDB_VERSION ||
+      hdr->ncols == 0 || hdr->ncols > TSDB_MAX_COLS ||
+      hdr->nbits > TSDB_DATA_BITS || hdr->crc != block_crc(blk))
+    return -1;
+
+  memset(dec, 0, sizeof(*dec));
+  dec->blk = blk;
+  return 0;
+}
+
+int
+tsdb_dec_next(tsdb_dec_t *dec, uint32_t *ts, float *vals)
+{
+  const tsdb_block_hdr_t *hdr = &dec->blk->hdr;
+  int32_t dod;
+  uint32_t x;
+  int i;
+
+  if (dec->idx >= hdr->count)
+    return 0;
+
+  if (dec->idx == 0) {
+    dec->t_prev = hdr->t_first;
+    for (i = 0; i < hdr->ncols; i++) {
+      if (!get_bits(dec, 32, &dec->v_prev[i]))
+        return -1;
+    }
+  } else {
+    if (!get_dod(dec, &dod))
+      return -1;
+    dec->d_prev += dod;
+    dec->t_prev += dec->d_prev;
+    for (i = 0; i < hdr->ncols; i++) {
+      if (!get_value(dec, i, &x))
+        return -1;
+      dec->v_prev[i] ^= x;
+    }
+  }
+
+  dec->idx++;
+  *ts = dec->t_prev;
+  for (i = 0; i < hdr->ncols; i++)
+    vals[i] = bits_float(dec->v_prev[i]);
+  return 1;
+}
+
+void
+tsdb_series_init(tsdb_series_t *s, uint32_t series)
+{
+  int i;
+
+  memset(s, 0, sizeof(*s));
+  s->magic = TSDB_SERIES_MAGIC;
+  s->series = series;
+  tsdb_enc_init(&s->raw, series, TSDB_TIER_RAW, 1);
+  for (i = 0; i < TSDB_TIER_MAX - 1; i++)
+    tsdb_enc_init(&s->agg[i], series, i + 1, 4);
+}
+
+bool
+tsdb_series_valid(const tsdb_series_t *s, uint32_t series)
+{
+  return s->magic == TSDB_SERIES_MAGIC && s->series == series &&
+         s->ring_cnt <= TSDB_RAM_BLOCKS && s->ring_next < TSDB_RAM_BLOCKS;
+}
+
+// Append, sealing the block and starting the next one when it is full.
+static void
+enc_append_roll(tsdb_enc_t *enc, uint32_t ts, const float *vals,
+                tsdb_series_t *s, tsdb_sink_fn sink, void *arg)
+{
+  const tsdb_block_t *blk;
+
+  if (tsdb_enc_append(enc, ts, vals) != TSDB_EFULL)
+    return;
+
+  blk = tsdb_enc_seal(enc);
+  if (blk->hdr.tier == TSDB_TIER_RAW) {
+    s->ring[s->ring_next] = *blk;
+    s->ring_next = (s->ring_next + 1) % TSDB_RAM_BLOCKS;
+    if (s->ring_cnt < TSDB_RAM_BLOCKS)
+      s->ring_cnt++;
+  }
+  if (sink)
+    sink(blk, arg);
+
+  tsdb_enc_init(enc, blk->hdr.series, blk->hdr.tier, blk->hdr.ncols);
+  tsdb_enc_append(enc, ts, vals);
+}
+
+static void
+bucket_point(const tsdb_bucket_t *b, float *vals)
+{
+  vals[TSDB_COL_AVG] = b->sum / b->count;
+  vals[TSDB_COL_MIN] = b->min;
+  vals[TSDB_COL_MAX] = b->max;
+  vals[TSDB_COL_COUNT] = b->count;
+}
+
+void
+tsdb_series_add(tsdb_series_t *s, uint32_t ts, float value,
+                tsdb_sink_fn sink, void *arg)
+{
+  tsdb_bucket_t *b;
+  uint32_t start;
+  float vals[TSDB_MAX_COLS];
+  int i;
+
+  enc_append_roll(&s->raw, ts, &value, s, sink, arg);
+
+  for (i = 0; i < TSDB_TIER_MAX - 1; i++) {
+    b = &s->bucket[i];
+    start = ts - ts % tier_period[i + 1];
+    if (b->start != 0 && b->start == start) {
+      b->sum += value;
+      b->count++;
+      if (value < b->min)
+        b->min = value;
+      if (value > b->max)
+        b->max = value;
+      continue;
+    }
+    if (b->start != 0 && b->count) {
+      bucket_point(b, vals);
+      enc_append_roll(&s->agg[i], b->start, vals, s, sink, arg);
+    }
+    b->start = start;
+    b->count = 1;
+    b->sum = b->min = b->max = value;
+  }
+}
+
+void
+tsdb_series_checkpoint(tsdb_series_t *s, uint32_t now,
+                       tsdb_sink_fn sink, void *arg)
+{
+  tsdb_block_t blk;
+  tsdb_enc_t *enc;
+  int tier;
+
+  /*
+   * Series start out together after boot. Phase their checkpoints by the
+   * series id, so they are spread over the interval instead of all
+   * landing in the outbox in the same sweep.
+   */
+  if (s->checkpointed == 0) {
+    s->checkpointed = now - s->series % TSDB_CHECKPOINT_INTERVAL;
+    if (s->checkpointed == 0)
+      s->checkpointed = 1;
+    return;
+  }
+  if ((uint32_t)(now - s->checkpointed) < TSDB_CHECKPOINT_INTERVAL)
+    return;
+  s->checkpointed = now;
+
+  for (tier = 0; tier < TSDB_TIER_MAX; tier++) {
+    enc = tier == TSDB_TIER_RAW ? &s->raw : &s->agg[tier - 1];
+    if (enc->blk.hdr.count == 0 ||
+        (enc->blk.hdr.t_first == s->ckpt_first[tier] &&
+         enc->blk.hdr.count == s->ckpt_count[tier]))
+      continue;
+    blk = enc->blk;
+    blk.hdr.flags |= TSDB_BLK_CHECKPOINT;
+    blk.hdr.crc = block_crc(&blk);
+    sink(&blk, arg);
+    s->ckpt_first[tier] = blk.hdr.t_first;
+    s->ckpt_count[tier] = blk.hdr.count;
+  }
+}
+
+typedef struct {
+  uint32_t series;
+  int tier;
+  uint32_t start;
+  uint32_t end;
+  tsdb_point_fn cb;
+  void *arg;
+  bool emitted;
+  uint32_t last_first;    // t_first of the last block passed on
+  bool stop;
+} query_t;
+
+static bool
+block_wanted(query_t *q, const tsdb_block_hdr_t *hdr)
+{
+  if (hdr->magic != TSDB_MAGIC || hdr->series != q->series ||
+      hdr->tier != q->tier || hdr->count == 0 ||
+      (hdr->flags & TSDB_BLK_CHECKPOINT))
+    return false;
+  if (hdr->t_last < q->start || hdr->t_first > q->end)
+    return false;
+  // The same block can be in memory, in the outbox and in a file
+  if (q->emitted && hdr->t_first <= q->last_first)
+    return false;
+  return true;
+}
+
+static void
+query_block(query_t *q, const tsdb_block_t *blk)
+{
+  float vals[TSDB_MAX_COLS];
+  tsdb_dec_t dec;
+  uint32_t ts;
+
+  if (q->stop || !block_wanted(q, &blk->hdr))
+    return;
+  if (tsdb_dec_init(&dec, blk) < 0) {
+    syslog(LOG_WARNING, "%s: corrupted %s block of series 0x%08x", __func__,
+           tier_names[q->tier], q->series);
+    return;
+  }
+  q->emitted = true;
+  q->last_first = blk->hdr.t_first;
+
+  // Only the blocks which overlap the range are decoded
+  while (tsdb_dec_next(&dec, &ts, vals) > 0) {
+    if (ts < q->start)
+      continue;
+    if (ts > q->end)
+      break;
+    if (q->cb(ts, vals, blk->hdr.ncols, q->arg)) {
+      q->stop = true;
+      break;
+    }
+  }
+}
+
+static int
+seg_path(char *path, size_t size, const char *dir, int tier, unsigned seq)
+{
+  return snprintf(path, size, "%s/%s.%u", dir, tier_names[tier], seq);
+}
+
+static int
+idx_path(char *path, size_t size, const char *dir, int tier, unsigned seq)
+{
+  return snprintf(path, size, "%s/%s.%u.idx", dir, tier_names[tier], seq);
+}
+
+static int
+seg_cmp(const void *a, const void *b)
+{
+  unsigned x = *(const unsigned *)a, y = *(const unsigned *)b;
+  return x < y ? -1 : x > y;
+}
+
+// Sequence numbers of the segments of a tier, sorted.
+static int
+seg_list(const char *dir, int tier, unsigned *seqs, int max)
+{
+  char prefix[16], *end;
+  struct dirent *ent;
+  size_t plen;
+  unsigned long seq;
+  DIR *d;
+  int n = 0;
+
+  d = opendir(dir);
+  if (d == NULL)
+    return 0;
+  plen = snprintf(prefix, sizeof(prefix), "%s.", tier_names[tier]);
+  while ((ent = readdir(d)) != NULL && n < max) {
+    if (strncmp(ent->d_name, prefix, plen))
+      continue;
+    seq = strtoul(ent->d_name + plen, &end, 10);
+    if (*end != '\0' || end == ent->d_name + plen)
+      continue;
+    seqs[n++] = seq;
+  }
+  closedir(d);
+  qsort(seqs, n, sizeof(*seqs), seg_cmp);
+  return n;
+}
+
+static uint32_t
+tombstone_get(const char *dir, uint32_t series)
+{
+  tsdb_tombstone_t t[64];
+  char path[128];
+  uint32_t ts = 0;
+  ssize_t n;
+  int fd, i;
+
+  snprintf(path, sizeof(path), "%s/tombstones", dir);
+  fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return 0;
+  while ((n = read(fd, t, sizeof(t))) > 0) {
+    for (i = 0; i < n / (ssize_t)sizeof(t[0]); i++) {
+      if (t[i].series == series && t[i].ts > ts)
+        ts = t[i].ts;
+    }
+  }
+  close(fd);
+  return ts;
+}
+
+/*
+ * The index of a segment, at most nblk entries. An index which is
+ * missing or shorter than the segment only covers the first blocks.
+ */
+static tsdb_index_t *
+idx_read(const char *path, uint32_t nblk, uint32_t *nidx)
+{
+  tsdb_index_t *idx = NULL;
+  struct stat st;
+  size_t len;
+  int fd;
+
+  *nidx = 0;
+  fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+  if (fstat(fd, &st) == 0) {
+    *nidx = st.st_size / sizeof(*idx);
+    if (*nidx > nblk)
+      *nidx = nblk;
+  }
+  len = *nidx * sizeof(*idx);
+  if (len && (idx = (tsdb_index_t *)malloc(len)) != NULL &&
+      read(fd, idx, len) != (ssize_t)len) {
+    free(idx);
+    idx = NULL;
+  }
+  if (idx == NULL)
+    *nidx = 0;
+  close(fd);
+  return idx;
+}
+
+static void
+seg_scan(query_t *q, int fd, const tsdb_index_t *idx, uint32_t nidx,
+         tsdb_block_t *blks)
+{
+  uint32_t i;
+  ssize_t n;
+  int j;
+
+  // Only the blocks of the series within the range are read
+  for (i = 0; i < nidx && !q->stop; i++) {
+    if (idx[i].series != q->series || idx[i].t_last < q->start ||
+        idx[i].t_first > q->end)
+      continue;
+    if (pread(fd, blks, sizeof(*blks), (off_t)i * sizeof(*blks)) == sizeof(*blks))
+      query_block(q, blks);
+  }
+
+  // and all of those which are not indexed
+  if (lseek(fd, (off_t)nidx * sizeof(*blks), SEEK_SET) < 0)
+    return;
+  while (!q->stop &&
+         (n = read(fd, blks, TSDB_READ_BLOCKS * sizeof(*blks))) > 0) {
+    for (j = 0; j < n / (ssize_t)sizeof(*blks); j++)
+      query_block(q, &blks[j]);
+  }
+}
+
+static void
+store_scan(const char *dir, query_t *q)
+{
+  tsdb_block_t *blks;
+  tsdb_index_t *idx;
+  unsigned seqs[TSDB_MAX_SEGMENTS];
+  char path[128];
+  struct stat st;
+  uint32_t nidx;
+  int nseg, fd, i;
+
+  blks = (tsdb_block_t *)malloc(TSDB_READ_BLOCKS * sizeof(*blks));
+  if (blks == NULL)
+    return;
+
+  nseg = seg_list(dir, q->tier, seqs, TSDB_MAX_SEGMENTS);
+  for (i = 0; i < nseg && !q->stop; i++) {
+    seg_path(path, sizeof(path), dir, q->tier, seqs[i]);
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+      continue;
+    if (fstat(fd, &st) < 0) {
+      close(fd);
+      continue;
+    }
+    idx_path(path, sizeof(path), dir, q->tier, seqs[i]);
+    idx = idx_read(path, st.st_size / sizeof(*blks), &nidx);
+    seg_scan(q, fd, idx, nidx, blks);
+    free(idx);
+    close(fd);
+  }
+  free(blks);
+}
+
+static void
+query_setup(query_t *q, const char *dir, uint32_t series, int tier,
+            uint32_t start, uint32_t end, tsdb_point_fn cb, void *arg)
+{
+  uint32_t cleared;
+
+  memset(q, 0, sizeof(*q));
+  q->series = series;
+  q->tier = tier;
+  q->start = start;
+  q->end = end;
+  q->cb = cb;
+  q->arg = arg;
+
+  cleared = tombstone_get(dir, series);
+  if (cleared >= q->start)
+    q->start = cleared + 1;
+}
+
+int
+tsdb_store_query(const char *dir, uint32_t series, int tier,
+                 uint32_t start, uint32_t end,
+                 tsdb_point_fn cb, void *arg)
+{
+  query_t q;
+
+  if (tier < 0 || tier >= TSDB_TIER_MAX)
+    return -1;
+  query_setup(&q, dir, series, tier, start, end, cb, arg);
+  store_scan(dir, &q);
+  return 0;
+}
+
+int
+tsdb_series_query(const tsdb_series_t *s, const tsdb_outbox_t *ob,
+                  const char *dir, uint32_t series, int tier,
+                  uint32_t start, uint32_t end,
+                  tsdb_point_fn cb, void *arg)
+{
+  tsdb_enc_t open_blk;
+  float vals[TSDB_MAX_COLS];
+  const tsdb_bucket_t *b;
+  query_t q;
+  uint32_t i;
+
+  if (tier < 0 || tier >= TSDB_TIER_MAX)
+    return -1;
+  query_setup(&q, dir, series, tier, start, end, cb, arg);
+
+  // Oldest first: files, outbox, sealed blocks in memory, open block
+  store_scan(dir, &q);
+  if (ob) {
+    for (i = 0; i < ob->cnt && i < TSDB_OUTBOX_BLOCKS; i++)
+      query_block(&q, &ob->blk[i]);
+  }
+  if (s == NULL)
+    return 0;
+
+  if (tier == TSDB_TIER_RAW) {
+    for (i = 0; i < s->ring_cnt; i++) {
+      uint32_t idx = (s->ring_next + TSDB_RAM_BLOCKS - s->ring_cnt + i) % TSDB_RAM_BLOCKS;
+      query_block(&q, &s->ring[idx]);
+    }
+    open_blk = s->raw;
+  } else {
+    open_blk = s->agg[tier - 1];
+  }
+  query_block(&q, tsdb_enc_seal(&open_blk));
+
+  // The bucket which is still being filled
+  b = tier == TSDB_TIER_RAW ? NULL : &s->bucket[tier - 1];
+  if (!q.stop && b && b->start && b->count &&
+      b->start >= q.start && b->start <= q.end) {
+    bucket_point(b, vals);
+    cb(b->start, vals, 4, arg);
+  }
+  return 0;
+}
+
+static int
+store_lock(const char *dir, const char *name)
+{
+  char path[128];
+  int fd;
+
+  if (mkdir(dir, 0755) < 0 && errno != EEXIST) {
+    syslog(LOG_WARNING, "%s: cannot create %s, errno = %d", __func__, dir, errno);
+    return -1;
+  }
+  snprintf(path, sizeof(path), "%s/.%s.lock", dir, name);
+  fd = open(path, O_CREAT | O_RDWR, 0644);
+  if (fd < 0)
+    return -1;
+  if (flock(fd, LOCK_EX) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static void
+store_unlock(int fd)
+{
+  flock(fd, LOCK_UN);
+  close(fd);
+}
+
+static int
+write_all(int fd, const void *buf, size_t len)
+{
+  const uint8_t *p = (const uint8_t *)buf;
+  ssize_t n;
+
+  while (len) {
+    n = write(fd, p, len);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    p += n;
+    len -= n;
+  }
+  return 0;
+}
+
+/*
+ * Appends the index entries of blocks written at block nblk of the
+ * segment. An index which does not match the segment, after a crash or
+ * a torn write, is rebuilt from the block headers first.
+ */
+static int
+idx_append(const char *path, int seg_fd, uint32_t nblk,
+           const tsdb_block_t *blks, int n)
+{
+  tsdb_block_hdr_t hdr;
+  tsdb_index_t e;
+  struct stat st;
+  uint32_t i;
+  int fd, ret = -1;
+
+  fd = open(path, O_CREAT | O_RDWR, 0644);
+  if (fd < 0)
+    return -1;
+  if (fstat(fd, &st) < 0)
+    goto exit;
+
+  if (st.st_size != (off_t)(nblk * sizeof(e))) {
+    if (ftruncate(fd, 0) < 0)
+      goto exit;
+    for (i = 0; i < nblk; i++) {
+      memset(&hdr, 0, sizeof(hdr));
+      if (pread(seg_fd, &hdr, sizeof(hdr), (off_t)i * sizeof(*blks)) < 0)
+        goto exit;
+      e.series = hdr.series;
+      e.t_first = hdr.t_first;
+      e.t_last = hdr.t_last;
+      if (write_all(fd, &e, sizeof(e)) < 0)
+        goto exit;
+    }
+  }
+
+  if (lseek(fd, 0, SEEK_END) < 0)
+    goto exit;
+  for (i = 0; i < (uint32_t)n; i++) {
+    e.series = blks[i].hdr.series;
+    e.t_first = blks[i].hdr.t_first;
+    e.t_last = blks[i].hdr.t_last;
+    if (write_all(fd, &e, sizeof(e)) < 0)
+      goto exit;
+  }
+  // Queries trust what is in the index
+  ret = fsync(fd);
+exit:
+  close(fd);
+  return ret;
+}
+
+/*
+ * Appends whole blocks to the newest segment of the tier with a single
+ * write, starting a new segment when it would grow past
+ * TSDB_SEGMENT_SIZE, and drops the oldest segments over the tier's share.
+ */
+int
+tsdb_store_append(const char *dir, int tier, const tsdb_block_t *blks, int n)
+{
+  unsigned seqs[TSDB_MAX_SEGMENTS];
+  char path[128];
+  struct stat st;
+  int lock, fd, nseg, i;
+  unsigned seq = 0;
+  uint32_t nblk = 0;
+  size_t len = n * sizeof(*blks);
+  int ret = -1;
+
+  if (tier < 0 || tier >= TSDB_TIER_MAX || n <= 0)
+    return -1;
+  lock = store_lock(dir, tier_names[tier]);
+  if (lock < 0)
+    return -1;
+
+  nseg = seg_list(dir, tier, seqs, TSDB_MAX_SEGMENTS);
+  if (nseg > 0) {
+    seq = seqs[nseg - 1];
+    seg_path(path, sizeof(path), dir, tier, seq);
+    if (stat(path, &st) == 0 && st.st_size + len > TSDB_SEGMENT_SIZE)
+      seq++;
+  }
+  seg_path(path, sizeof(path), dir, tier, seq);
+
+  // Read as well, a lost index is rebuilt from the block headers
+  fd = open(path, O_CREAT | O_RDWR, 0644);
+  if (fd < 0) {
+    syslog(LOG_WARNING, "%s: cannot open %s, errno = %d", __func__, path, errno);
+    goto unlock;
+  }
+  // Drop what is left of a torn write
+  if (fstat(fd, &st) == 0) {
+    if (st.st_size % sizeof(*blks))
+      (void)ftruncate(fd, st.st_size - st.st_size % sizeof(*blks));
+    nblk = st.st_size / sizeof(*blks);
+  }
+  if (lseek(fd, 0, SEEK_END) < 0 || write_all(fd, blks, len) < 0 || fsync(fd) < 0) {
+    syslog(LOG_WARNING, "%s: cannot write %s, errno = %d", __func__, path, errno);
+    close(fd);
+    goto unlock;
+  }
+  // Without the index the blocks are still found, only slower
+  idx_path(path, sizeof(path), dir, tier, seq);
+  if (idx_append(path, fd, nblk, blks, n) < 0)
+    syslog(LOG_WARNING, "%s: cannot write %s, errno = %d", __func__, path, errno);
+  close(fd);
+
+  if (nseg == 0 || seq != seqs[nseg - 1])
+    seqs[nseg++] = seq;
+  for (i = 0; i < nseg - tier_segments[tier]; i++) {
+    seg_path(path, sizeof(path), dir, tier, seqs[i]);
+    unlink(path);
+    idx_path(path, sizeof(path), dir, tier, seqs[i]);
+    unlink(path);
+  }
+  ret = 0;
+unlock:
+  store_unlock(lock);
+  return ret;
+}
+
+int
+tsdb_store_tombstone(const char *dir, uint32_t series, uint32_t ts)
+{
+  tsdb_tombstone_t t = {series, ts};
+  char path[128];
+  int lock, fd, ret;
+
+  lock = store_lock(dir, "tombstones");
+  if (lock < 0)
+    return -1;
+  snprintf(path, sizeof(path), "%s/tombstones", dir);
+  fd = open(path, O_CREAT | O_WRONLY | O_APPEND, 0644);
+  if (fd < 0) {
+    store_unlock(lock);
+    return -1;
+  }
+  ret = write_all(fd, &t, sizeof(t));
+  close(fd);
+  store_unlock(lock);
+  return ret;
+}
+
+/*
+ * Checkpointed blocks overwrite the slot of their series and tier in
+ * the checkpoint file, so it only grows with the number of series.
+ */
+int
+tsdb_checkpoint_write(const char *dir, const tsdb_block_t *blks, int n)
+{
+  tsdb_block_t *buf;
+  char path[128];
+  struct stat st;
+  uint32_t nslots;
+  int32_t *slot;
+  ssize_t len;
+  int lock, fd, i, j, k;
+  int ret = -1;
+
+  if (n <= 0)
+    return 0;
+  buf = (tsdb_block_t *)malloc(TSDB_READ_BLOCKS * sizeof(*buf));
+  slot = (int32_t *)malloc(n * sizeof(*slot));
+  if (buf == NULL || slot == NULL)
+    goto free_bail;
+  lock = store_lock(dir, "checkpoint");
+  if (lock < 0)
+    goto free_bail;
+  snprintf(path, sizeof(path), "%s/checkpoint", dir);
+  fd = open(path, O_CREAT | O_RDWR, 0644);
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    syslog(LOG_WARNING, "%s: cannot open %s, errno = %d", __func__, path, errno);
+    goto close_bail;
+  }
+
+  for (i = 0; i < n; i++)
+    slot[i] = -1;
+  nslots = 0;
+  while ((len = read(fd, buf, TSDB_READ_BLOCKS * sizeof(*buf))) >= (ssize_t)sizeof(*buf)) {
+    for (j = 0; j < len / (ssize_t)sizeof(*buf); j++, nslots++) {
+      for (i = 0; i < n; i++) {
+        if (slot[i] < 0 && buf[j].hdr.series == blks[i].hdr.series &&
+            buf[j].hdr.tier == blks[i].hdr.tier)
+          slot[i] = nslots;
+      }
+    }
+  }
+  // New series get a slot at the end, a later copy of the same block wins
+  for (i = 0; i < n; i++) {
+    for (k = 0; k < i && slot[i] < 0; k++) {
+      if (blks[k].hdr.series == blks[i].hdr.series &&
+          blks[k].hdr.tier == blks[i].hdr.tier)
+        slot[i] = slot[k];
+    }
+    if (slot[i] < 0)
+      slot[i] = nslots++;
+  }
+
+  for (i = 0; i < n; i++) {
+    if (pwrite(fd, &blks[i], sizeof(blks[i]), (off_t)slot[i] * sizeof(*buf)) !=
+        sizeof(blks[i]))
+      break;
+  }
+  if (i < n || fsync(fd) < 0) {
+    syslog(LOG_WARNING, "%s: cannot write %s, errno = %d", __func__, path, errno);
+    goto close_bail;
+  }
+  ret = 0;
+close_bail:
+  if (fd >= 0)
+    close(fd);
+  store_unlock(lock);
+free_bail:
+  free(slot);
+  free(buf);
+  return ret;
+}
+
+/*
+ * Moves the checkpointed blocks to the segments as they are, and empties
+ * the checkpoint file. Only the blocks of the last boot are in there,
+ * the ones of this boot will be written once the outbox is flushed.
+ */
+int
+tsdb_checkpoint_recover(const char *dir)
+{
+  tsdb_block_t *blks = NULL, *out = NULL;
+  tsdb_dec_t dec;
+  char path[128];
+  struct stat st;
+  size_t len;
+  int lock, fd, tier, i, n, cnt;
+  int ret = -1;
+
+  lock = store_lock(dir, "checkpoint");
+  if (lock < 0)
+    return -1;
+  snprintf(path, sizeof(path), "%s/checkpoint", dir);
+  fd = open(path, O_RDWR);
+  if (fd < 0) {
+    store_unlock(lock);
+    return errno == ENOENT ? 0 : -1;
+  }
+  if (fstat(fd, &st) < 0)
+    goto exit;
+  cnt = st.st_size / sizeof(*blks);
+  len = cnt * sizeof(*blks);
+  if (cnt && ((blks = (tsdb_block_t *)malloc(len)) == NULL ||
+              (out = (tsdb_block_t *)malloc(len)) == NULL ||
+              read(fd, blks, len) != (ssize_t)len))
+    goto exit;
+
+  ret = 0;
+  for (tier = 0; tier < TSDB_TIER_MAX; tier++) {
+    n = 0;
+    for (i = 0; i < cnt; i++) {
+      if (blks[i].hdr.tier != tier || !(blks[i].hdr.flags & TSDB_BLK_CHECKPOINT) ||
+          blks[i].hdr.count == 0 || tsdb_dec_init(&dec, &blks[i]) < 0)
+        continue;
+      out[n] = blks[i];
+      out[n].hdr.flags &= ~TSDB_BLK_CHECKPOINT;
+      out[n].hdr.crc = block_crc(&out[n]);
+      n++;
+    }
+    if (n && tsdb_store_append(dir, tier, out, n) < 0)
+      ret = -1;
+  }
+  // Anything which could not be moved is dropped, the file is reused
+  if (ftruncate(fd, 0) < 0 || fsync(fd) < 0)
+    ret = -1;
+exit:
+  free(out);
+  free(blks);
+  close(fd);
+  store_unlock(lock);
+  return ret;
+}
+
+int
+tsdb_outbox_push(tsdb_outbox_t *ob, const tsdb_block_t *blk, uint32_t now)
+{
+  if (ob->cnt >= TSDB_OUTBOX_BLOCKS)
+    return -1;
+  if (ob->cnt == 0)
+    ob->first = now;
+  ob->blk[ob->cnt++] = *blk;
+  return 0;
+}
+
+bool
+tsdb_outbox_due(const tsdb_outbox_t *ob, uint32_t now)
+{
+  return ob->cnt >= TSDB_FLUSH_BLOCKS ||
+         (ob->cnt && (uint32_t)(now - ob->first) >= TSDB_FLUSH_INTERVAL);
+}
+
+int
+tsdb_outbox_write(const tsdb_outbox_t *ob, const char *dir)
+{
+  tsdb_block_t *blks;
+  uint32_t i, cnt = ob->cnt < TSDB_OUTBOX_BLOCKS ? ob->cnt : TSDB_OUTBOX_BLOCKS;
+  int tier, n, ret = 0;
+
+  if (cnt == 0)
+    return 0;
+  blks = (tsdb_block_t *)malloc(TSDB_OUTBOX_BLOCKS * sizeof(*blks));
+  if (blks == NULL)
+    return -1;
+
+  for (tier = 0; tier < TSDB_TIER_MAX; tier++) {
+    n = 0;
+    for (i = 0; i < cnt; i++) {
+      if (ob->blk[i].hdr.tier == tier &&
+          !(ob->blk[i].hdr.flags & TSDB_BLK_CHECKPOINT))
+        blks[n++] = ob->blk[i];
+    }
+    if (n && tsdb_store_append(dir, tier, blks, n) < 0)
+      ret = -1;
+  }
+
+  n = 0;
+  for (i = 0; i < cnt; i++) {
+    if (ob->blk[i].hdr.flags & TSDB_BLK_CHECKPOINT)
+      blks[n++] = ob->blk[i];
+  }
+  if (tsdb_checkpoint_write(dir, blks, n) < 0)
+    ret = -1;
+  free(blks);
+  return ret;
+}
+
+void
+tsdb_outbox_drop(tsdb_outbox_t *ob, uint32_t n, uint32_t now)
+{
+  if (n >= ob->cnt || ob->cnt > TSDB_OUTBOX_BLOCKS) {
+    ob->cnt = 0;
+    ob->first = 0;
+    return;
+  }
+  memmove(&ob->blk[0], &ob->blk[n], (ob->cnt - n) * sizeof(ob->blk[0]));
+  ob->cnt -= n;
+  // Not exactly when the oldest one came, but close enough
+  ob->first = now;
+}
+
+int
+tsdb_outbox_flush(tsdb_outbox_t *ob, const char *dir)
+{
+  int ret = tsdb_outbox_write(ob, dir);
+
+  // Nowhere to keep them on failure, they are dropped
+  tsdb_outbox_drop(ob, ob->cnt, 0);
+  return ret;
+}
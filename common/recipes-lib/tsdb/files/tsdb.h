@@ -0,0 +1,208 @@
+/*
+ * Copyright 2021-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * Small time-series store for sensor history.
+ *
+ * Points are compressed into fixed size blocks: timestamps as delta of
+ * deltas, values XORed against the previous value, as described in the
+ * Gorilla paper. Besides the raw points every series keeps 5 minute and
+ * hourly average/min/max/count tiers. Sealed blocks are collected in an
+ * outbox and appended to per-tier segment files in large writes, the
+ * oldest segment is deleted once a tier is full. Every segment has an
+ * index of the series and time range of its blocks, so a query only
+ * reads the blocks it needs.
+ *
+ * Blocks which are still being filled are checkpointed now and then:
+ * a copy goes through the outbox into a checkpoint file which keeps
+ * one slot per series and tier. After a reboot tsdb_checkpoint_recover()
+ * moves them to the segments.
+ *
+ * All state is plain data without pointers, so it can live in shared
+ * memory. Locking is up to the caller.
+ */
+#ifndef __TSDB_H__
+#define __TSDB_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TSDB_BLOCK_SIZE     512
+#define TSDB_MAX_COLS       4
+#define TSDB_RAM_BLOCKS     2     // sealed raw blocks kept in memory
+#define TSDB_OUTBOX_BLOCKS  64
+#define TSDB_FLUSH_BLOCKS   32    // flushed in one append per tier
+#define TSDB_FLUSH_INTERVAL 600   // seconds a block may wait in the outbox
+#define TSDB_CHECKPOINT_INTERVAL 1800
+#define TSDB_SEGMENT_SIZE   (256 * 1024)
+
+enum {
+  TSDB_TIER_RAW = 0,      // value
+  TSDB_TIER_5MIN,         // avg, min, max, count
+  TSDB_TIER_HOUR,
+  TSDB_TIER_MAX,
+};
+
+// Columns of the aggregated tiers
+enum {
+  TSDB_COL_AVG = 0,
+  TSDB_COL_MIN,
+  TSDB_COL_MAX,
+  TSDB_COL_COUNT,
+};
+
+#define TSDB_EFULL  1
+
+// Block flags
+#define TSDB_BLK_CHECKPOINT 0x01  // copy of a block still being filled
+
+typedef struct {
+  uint16_t magic;
+  uint8_t version;
+  uint8_t ncols;
+  uint8_t tier;
+  uint8_t flags;
+  uint16_t count;
+  uint16_t nbits;
+  uint16_t rsvd2;
+  uint32_t series;
+  uint32_t t_first;
+  uint32_t t_last;
+  uint32_t crc;
+} __attribute__((packed)) tsdb_block_hdr_t;
+
+typedef struct {
+  tsdb_block_hdr_t hdr;
+  uint8_t data[TSDB_BLOCK_SIZE - sizeof(tsdb_block_hdr_t)];
+} tsdb_block_t;
+
+typedef struct {
+  tsdb_block_t blk;
+  uint32_t t_prev;
+  int32_t d_prev;
+  uint32_t v_prev[TSDB_MAX_COLS];
+  uint8_t lead[TSDB_MAX_COLS];
+  uint8_t len[TSDB_MAX_COLS];
+} tsdb_enc_t;
+
+typedef struct {
+  const tsdb_block_t *blk;
+  uint32_t pos;
+  uint16_t idx;
+  uint32_t t_prev;
+  int32_t d_prev;
+  uint32_t v_prev[TSDB_MAX_COLS];
+  uint8_t lead[TSDB_MAX_COLS];
+  uint8_t len[TSDB_MAX_COLS];
+} tsdb_dec_t;
+
+typedef struct {
+  uint32_t start;       // 0 while empty
+  uint32_t count;
+  double sum;
+  float min;
+  float max;
+} tsdb_bucket_t;
+
+// State of one series, meant to be mapped from shared memory.
+typedef struct {
+  uint32_t magic;
+  uint32_t series;
+  tsdb_enc_t raw;
+  uint8_t ring_cnt;
+  uint8_t ring_next;
+  tsdb_block_t ring[TSDB_RAM_BLOCKS];
+  tsdb_bucket_t bucket[TSDB_TIER_MAX - 1];
+  tsdb_enc_t agg[TSDB_TIER_MAX - 1];
+  uint32_t checkpointed;            // when, 0 if never
+  uint32_t ckpt_first[TSDB_TIER_MAX];
+  uint16_t ckpt_count[TSDB_TIER_MAX];
+} tsdb_series_t;
+
+// Sealed blocks waiting to be written, shared by all series.
+typedef struct {
+  uint32_t cnt;
+  uint32_t first;       // when the oldest block was added
+  tsdb_block_t blk[TSDB_OUTBOX_BLOCKS];
+  uint32_t recovered;   // checkpoints moved to the segments
+} tsdb_outbox_t;
+
+typedef void (*tsdb_sink_fn)(const tsdb_block_t *blk, void *arg);
+// Return non-zero to stop.
+typedef int (*tsdb_point_fn)(uint32_t ts, const float *vals, int ncols, void *arg);
+
+uint32_t tsdb_series_id(const char *key);
+const char *tsdb_tier_name(int tier);
+uint32_t tsdb_tier_period(int tier);
+
+// Block codec
+void tsdb_enc_init(tsdb_enc_t *enc, uint32_t series, int tier, int ncols);
+int tsdb_enc_append(tsdb_enc_t *enc, uint32_t ts, const float *vals);
+const tsdb_block_t *tsdb_enc_seal(tsdb_enc_t *enc);
+int tsdb_dec_init(tsdb_dec_t *dec, const tsdb_block_t *blk);
+int tsdb_dec_next(tsdb_dec_t *dec, uint32_t *ts, float *vals);
+
+// Series
+void tsdb_series_init(tsdb_series_t *s, uint32_t series);
+bool tsdb_series_valid(const tsdb_series_t *s, uint32_t series);
+void tsdb_series_add(tsdb_series_t *s, uint32_t ts, float value,
+                     tsdb_sink_fn sink, void *arg);
+// Pass copies of the changed open blocks to sink, once per interval,
+// at a phase within the interval that depends on the series id.
+void tsdb_series_checkpoint(tsdb_series_t *s, uint32_t now,
+                            tsdb_sink_fn sink, void *arg);
+/*
+ * Points of the series from the files, the outbox and memory, oldest
+ * first. s and ob may be NULL.
+ */
+int tsdb_series_query(const tsdb_series_t *s, const tsdb_outbox_t *ob,
+                      const char *dir, uint32_t series, int tier,
+                      uint32_t start, uint32_t end,
+                      tsdb_point_fn cb, void *arg);
+
+/*
+ * Outbox. Pushing never touches the files, whoever owns the outbox
+ * writes it once tsdb_outbox_due() says so. tsdb_outbox_write() leaves
+ * the outbox alone, so it can work on a copy without holding the lock,
+ * and tsdb_outbox_drop() removes the blocks written afterwards.
+ */
+int tsdb_outbox_push(tsdb_outbox_t *ob, const tsdb_block_t *blk, uint32_t now);
+bool tsdb_outbox_due(const tsdb_outbox_t *ob, uint32_t now);
+int tsdb_outbox_write(const tsdb_outbox_t *ob, const char *dir);
+void tsdb_outbox_drop(tsdb_outbox_t *ob, uint32_t n, uint32_t now);
+int tsdb_outbox_flush(tsdb_outbox_t *ob, const char *dir);
+
+// Files under dir
+int tsdb_store_append(const char *dir, int tier, const tsdb_block_t *blks, int n);
+int tsdb_store_query(const char *dir, uint32_t series, int tier,
+                     uint32_t start, uint32_t end,
+                     tsdb_point_fn cb, void *arg);
+int tsdb_store_tombstone(const char *dir, uint32_t series, uint32_t ts);
+int tsdb_checkpoint_write(const char *dir, const tsdb_block_t *blks, int n);
+// Once after boot, before anything is checkpointed again.
+int tsdb_checkpoint_recover(const char *dir);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TSDB_H__ */
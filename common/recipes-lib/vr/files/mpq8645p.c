@@ -27,7 +27,6 @@
 #include <unistd.h>
 #include <sys/stat.h>
 #include <openbmc/obmc-pal.h>
-#include <openbmc/kv.h>
 #include "mpq8645p.h"
 
 #define LARGEST_DEVICE_NAME 120
@@ -69,7 +68,7 @@ static int read_attr(const char *attr, unsigned int *value)
   return ret;
 }
 
-static int get_mpq8645p_ver(struct vr_info *info, char *key, char *ver)
+static int get_mpq8645p_ver(struct vr_info *info, char *ver)
 {
   int *hwmon_idxp = (int*)info->private_data;
   int hwmon_idx = *hwmon_idxp;
@@ -82,7 +81,6 @@ static int get_mpq8645p_ver(struct vr_info *info, char *key, char *ver)
     goto exit;
 
   snprintf(ver, MAX_VER_STR_LEN, "MPS 0x%x", val);
-  kv_set(key, ver, 0, 0);
 
 exit:
   return ret;
@@ -123,19 +121,17 @@ error:
   return NULL;
 }
 
-void mpq8645p_free_configs(struct mpq8645p_config *head)
+void mpq8645p_free_configs(void *configs)
 {
   struct mpq8645p_config *tmp, *curr;
 
-  curr = head;
+  curr = (struct mpq8645p_config *)configs;
   while (curr != NULL) {
     tmp = curr;
     curr = curr->next;
     free(tmp->data);
     free(tmp);
   }
-
-  head = NULL;
 }
 
 static int program_mpq8645p(int hwmon_idx, struct config_data *data)
@@ -273,18 +269,7 @@ static int restore_user(int hwmon_idx)
 
 int mpq8645p_get_fw_ver(struct vr_info *info, char *ver_str)
 {
-  char key[MAX_KEY_LEN], tmp_str[MAX_VER_STR_LEN] = {0};
-
-  snprintf(key, sizeof(key), "vr_%02xh_ver", info->addr);
-  if (kv_get(key, tmp_str, NULL, 0)) {
-    if (get_mpq8645p_ver(info, key, ver_str) < 0) {
-      return -1;
-    }
-  } else {
-    snprintf(ver_str, MAX_VER_STR_LEN, "%s", tmp_str);
-  }
-
-  return 0;
+  return get_mpq8645p_ver(info, ver_str) < 0 ? -1 : 0;
 }
 
 void* mpq8645p_parse_file(struct vr_info *info, const char *path)
@@ -371,11 +356,9 @@ exit:
 
 int mpq8645p_fw_update(struct vr_info *info, void *configs)
 {
-  uint8_t addr = info->addr;
   int *hwmon_idxp = (int*)info->private_data;
   int hwmon_idx = *hwmon_idxp;
   int ret = VR_STATUS_SKIP;
-  char buf[64] = {0};
   struct mpq8645p_config *config = (struct mpq8645p_config *)configs;
   struct config_data *data;
 
@@ -398,8 +381,6 @@ int mpq8645p_fw_update(struct vr_info *info, void *configs)
 
   if (ret == 0) {
     restore_user(hwmon_idx);
-    snprintf((char *)buf, sizeof(buf), "/tmp/cache_store/vr_%02xh_ver", addr);
-    unlink((char *)buf);
   }
 
   return ret == VR_STATUS_SKIP? 0: ret;
@@ -45,6 +45,6 @@ int mpq8645p_validate_file(struct vr_info*, const char*);
 int mpq8645p_fw_update(struct vr_info*, void*);
 int mpq8645p_fw_verify(struct vr_info*, void*);
 
-void mpq8645p_free_configs(struct mpq8645p_config*);
+void mpq8645p_free_configs(void*);
 
 #endif
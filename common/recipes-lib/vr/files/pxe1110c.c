@@ -4,8 +4,8 @@
 #include <unistd.h>
 #include <openbmc/obmc-i2c.h>
 #include <openbmc/obmc-pal.h>
-#include <openbmc/kv.h>
 #include "pxe1110c.h"
+#include "vr_prog.h"
 
 extern int i2c_io(int, uint8_t, uint8_t *, uint8_t, uint8_t *, uint8_t);
 
@@ -41,7 +41,7 @@ get_pxe_crc(int fd, uint8_t addr, uint32_t *crc) {
 }
 
 static int
-cache_pxe_crc(uint8_t bus, uint8_t addr, char *key, char *checksum) {
+read_pxe_ver(uint8_t bus, uint8_t addr, char *ver_str) {
   int fd, ret = -1;
   uint8_t tbuf[16], rbuf[16], remain;
 
@@ -68,9 +68,10 @@ cache_pxe_crc(uint8_t bus, uint8_t addr, char *key, char *checksum) {
       break;
     }
 
-    snprintf(checksum, MAX_VALUE_LEN, "Infineon %02X%02X%02X%02X, Remaining Writes: %u",
-             rbuf[3], rbuf[2], rbuf[1], rbuf[0], remain);
-    kv_set(key, checksum, 0, 0);
+    if (snprintf(ver_str, MAX_VER_STR_LEN, "Infineon %02X%02X%02X%02X, Remaining Writes: %u",
+                 rbuf[3], rbuf[2], rbuf[1], rbuf[0], remain) > (MAX_VER_STR_LEN-1)) {
+      ret = -1;
+    }
   } while (0);
 
   tbuf[0] = VR_REG_PAGE;
@@ -85,18 +86,7 @@ cache_pxe_crc(uint8_t bus, uint8_t addr, char *key, char *checksum) {
 
 int
 get_pxe_ver(struct vr_info *info, char *ver_str) {
-  char key[MAX_KEY_LEN], tmp_str[MAX_VALUE_LEN] = {0};
-
-  snprintf(key, sizeof(key), "vr_%02xh_crc", info->addr);
-  if (kv_get(key, tmp_str, NULL, 0)) {
-    if (cache_pxe_crc(info->bus, info->addr, key, tmp_str))
-      return -1;
-  }
-
-  if (snprintf(ver_str, MAX_VER_STR_LEN, "%s", tmp_str) > (MAX_VER_STR_LEN-1))
-    return -1;
-
-  return 0;
+  return read_pxe_ver(info->bus, info->addr, ver_str);
 }
 
 void *
@@ -199,14 +189,16 @@ check_pxe_image(uint32_t crc_exp, uint8_t *data) {
 static int
 program_pxe(uint8_t bus, uint8_t addr, struct pxe_config *config, bool force) {
   int fd, i, ret = -1;
-  uint8_t tbuf[32], rbuf[32], remain = 0, page = 0;
+  uint8_t tbuf[32], rbuf[32], remain = 0;
   uint8_t *data = config->data;
   uint32_t crc = 0;
-  float dsize, next_prog;
+  struct vr_prog prog;
+  struct vr_word words[VR_PXE_TOTAL_RW_SIZE/4];
 
-  if ((fd = i2c_cdev_slave_open(bus, (addr>>1), I2C_SLAVE_FORCE_CLAIM)) < 0) {
+  if (vr_prog_open(&prog, bus, addr)) {
     return -1;
   }
+  fd = prog.fd;
 
   do {
     if ((ret = get_pxe_crc(fd, addr, &crc))) {
@@ -283,36 +275,12 @@ program_pxe(uint8_t bus, uint8_t addr, struct pxe_config *config, bool force) {
     }
 
     // write configuration data
-    dsize = (float)VR_PXE_TOTAL_RW_SIZE/100;
-    next_prog = dsize;
-    for (i = 0; i < VR_PXE_TOTAL_RW_SIZE; i+= 4) {
-      if (page != ((data[i+1] >> 1) & 0x3F)) {
-        page = (data[i+1] >> 1) & 0x3F;
-        tbuf[0] = VR_REG_PAGE;
-        tbuf[1] = page;
-        if ((ret = i2c_io(fd, addr, tbuf, 2, rbuf, 0))) {
-          syslog(LOG_WARNING, "%s: set page to 0x%02X failed", __func__, tbuf[1]);
-          break;
-        }
-      }
-
-      tbuf[0] = data[i];  // offset
-      tbuf[1] = data[i+2];
-      tbuf[2] = data[i+3];
-      if ((ret = i2c_io(fd, addr, tbuf, 3, rbuf, 0))) {
-        syslog(LOG_WARNING, "%s: write data failed, page=%02X offset=%02X data=%02X%02X",
-                            __func__, page, tbuf[0], tbuf[2], tbuf[1]);
-        break;
-      }
-
-      if ((i + 4) >= (int)next_prog) {
-        printf("\rupdated: %d %%  ", (int)(next_prog/dsize));
-        fflush(stdout);
-        next_prog += dsize;
-      }
+    for (i = 0; i < VR_PXE_TOTAL_RW_SIZE; i += 4) {
+      words[i/4].reg = data[i];
+      words[i/4].page = (data[i+1] >> 1) & 0x3F;
+      words[i/4].value = (data[i+3] << 8) | data[i+2];
     }
-    printf("\n");
-    if (ret) {
+    if ((ret = vr_prog_write_words(&prog, words, VR_PXE_TOTAL_RW_SIZE/4, false))) {
       break;
     }
 
@@ -436,7 +404,7 @@ program_pxe(uint8_t bus, uint8_t addr, struct pxe_config *config, bool force) {
   if (i2c_io(fd, addr, tbuf, 2, rbuf, 0)) {
     syslog(LOG_WARNING, "%s: set page to 0x%02X failed", __func__, tbuf[1]);
   }
-  close(fd);
+  vr_prog_close(&prog);
 
   return ret;
 }
@@ -496,9 +464,6 @@ pxe_fw_verify(struct vr_info *info, void *args) {
   if (crc != config->crc_exp) {
     printf("CRC %08X mismatch, expect %08X\n", crc, config->crc_exp);
     ret = -1;
-  } else {
-    snprintf((char *)buf, sizeof(buf), "/tmp/cache_store/vr_%02xh_crc", info->addr);
-    unlink((char *)buf);
   }
 
   return ret;
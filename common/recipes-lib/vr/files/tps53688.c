@@ -4,8 +4,8 @@
 #include <unistd.h>
 #include <openbmc/obmc-i2c.h>
 #include <openbmc/obmc-pal.h>
-#include <openbmc/kv.h>
 #include "tps53688.h"
+#include "vr_prog.h"
 
 extern int i2c_io(int, uint8_t, uint8_t *, uint8_t, uint8_t *, uint8_t);
 
@@ -24,44 +24,27 @@ get_tps_crc(int fd, uint8_t addr, uint16_t *crc) {
   return ret;
 }
 
-static int
-cache_tps_crc(uint8_t bus, uint8_t addr, char *key, char *checksum) {
+int
+get_tps_ver(struct vr_info *info, char *ver_str) {
   int fd, ret = -1;
   uint8_t buf[16];
 
-  if ((fd = i2c_cdev_slave_open(bus, (addr>>1), I2C_SLAVE_FORCE_CLAIM)) < 0) {
+  if ((fd = i2c_cdev_slave_open(info->bus, (info->addr>>1), I2C_SLAVE_FORCE_CLAIM)) < 0) {
     return -1;
   }
 
   do {
-    if ((ret = get_tps_crc(fd, addr, (uint16_t *)buf))) {
+    if ((ret = get_tps_crc(fd, info->addr, (uint16_t *)buf))) {
       break;
     }
 
-    snprintf(checksum, MAX_VALUE_LEN, "Texas Instruments %02X%02X", buf[1], buf[0]);
-    kv_set(key, checksum, 0, 0);
+    snprintf(ver_str, MAX_VER_STR_LEN, "Texas Instruments %02X%02X", buf[1], buf[0]);
   } while (0);
 
   close(fd);
   return ret;
 }
 
-int
-get_tps_ver(struct vr_info *info, char *ver_str) {
-  char key[MAX_KEY_LEN], tmp_str[MAX_VALUE_LEN] = {0};
-
-  snprintf(key, sizeof(key), "vr_%02xh_crc", info->addr);
-  if (kv_get(key, tmp_str, NULL, 0)) {
-    if (cache_tps_crc(info->bus, info->addr, key, tmp_str))
-      return -1;
-  }
-
-  if (snprintf(ver_str, MAX_VER_STR_LEN, "%s", tmp_str) > (MAX_VER_STR_LEN-1))
-    return -1;
-
-  return 0;
-}
-
 void *
 tps_parse_file(struct vr_info *info, const char *path) {
   FILE *fp;
@@ -181,13 +164,14 @@ static int
 program_tps(uint8_t bus, uint8_t addr, struct tps_config *config, bool force) {
   int fd, i, ret = -1;
   uint64_t devid = 0x00;
-  uint32_t offset = 0, dsize;
   uint16_t crc = 0;
   uint8_t tbuf[64], rbuf[64];
+  struct vr_prog prog;
 
-  if ((fd = i2c_cdev_slave_open(bus, (addr>>1), I2C_SLAVE_FORCE_CLAIM)) < 0) {
+  if (vr_prog_open(&prog, bus, addr)) {
     return -1;
   }
+  fd = prog.fd;
 
   do {
     // check device ID
@@ -227,27 +211,15 @@ program_tps(uint8_t bus, uint8_t addr, struct tps_config *config, bool force) {
     }
 
     // write configuration data
-    dsize = VR_TPS_TOTAL_WR_SIZE/10;
-    for (i = 0; i < VR_TPS_NVM_IDX_NUM; i++) {
-      tbuf[0] = VR_TPS_REG_NVM_EXE;
-      memcpy(&tbuf[1], &config->data[offset], VR_TPS_BLK_WR_LEN);
-      if ((ret = i2c_io(fd, addr, tbuf, VR_TPS_BLK_WR_LEN+1, rbuf, 0))) {
-        break;
-      }
-
-      offset += VR_TPS_BLK_WR_LEN;
-      printf("\rupdated: %d %%  ", (offset/dsize)*10);
-      fflush(stdout);
-    }
-    printf("\n");
-    if (ret) {
+    if ((ret = vr_prog_block_write(&prog, VR_TPS_REG_NVM_EXE, config->data,
+                                   VR_TPS_BLK_WR_LEN, VR_TPS_NVM_IDX_NUM))) {
       break;
     }
 
     msleep(200);
   } while (0);
 
-  close(fd);
+  vr_prog_close(&prog);
   return ret;
 }
 
@@ -281,7 +253,6 @@ tps_fw_verify(struct vr_info *info, void *args) {
   struct tps_config *config = (struct tps_config *)args;
   int fd, ret;
   uint16_t crc = 0;
-  uint8_t buf[64];
 
   if (info->addr != config->addr) {
     return VR_STATUS_SKIP;
@@ -302,9 +273,6 @@ tps_fw_verify(struct vr_info *info, void *args) {
   if (crc != config->crc_exp) {
     printf("CRC %04X mismatch, expect %04X\n", crc, config->crc_exp);
     ret = -1;
-  } else {
-    snprintf((char *)buf, sizeof(buf), "/tmp/cache_store/vr_%02xh_crc", info->addr);
-    unlink((char *)buf);
   }
 
   return ret;
@@ -0,0 +1,218 @@
+#include <assert.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include "vr.h"
+#include "vr_prog.h"
+
+/*
+ * A fake PMBus device behind I2C_RDWR. Writes are only committed at a
+ * STOP, the end of the transaction or an I2C_M_STOP message, and a write
+ * followed by a repeated START is dropped, like the devices vr_prog has
+ * to deal with. The adapter reports I2C_M_STOP support if mangling is set.
+ */
+#define FAKE_FD 42
+#define FAKE_ADDR 0xC0
+
+static uint16_t regs[0x40][0x100];
+static uint8_t page;
+static uint8_t blocks[64][32];
+static int nblocks;
+static int xfers;
+static int sleeps;
+static int mangling;
+static int stuck_reg = -1;  // register that ignores writes
+static int fail_xfers;      // fail the next n transactions
+
+int i2c_cdev_slave_open(int bus, uint16_t addr, int flags)
+{
+  assert(addr == (FAKE_ADDR >> 1));
+  return FAKE_FD;
+}
+
+void msleep(int msec)
+{
+  sleeps++;
+}
+
+int ioctl(int fd, unsigned long req, ...)
+{
+  struct i2c_rdwr_ioctl_data *data;
+  struct i2c_msg *msg;
+  uint8_t reg = 0;
+  va_list ap;
+  int i;
+
+  assert(fd == FAKE_FD);
+  if (req == I2C_FUNCS) {
+    va_start(ap, req);
+    *va_arg(ap, unsigned long *) = I2C_FUNC_I2C |
+        (mangling ? I2C_FUNC_PROTOCOL_MANGLING : 0);
+    va_end(ap);
+    return 0;
+  }
+  va_start(ap, req);
+  data = va_arg(ap, struct i2c_rdwr_ioctl_data *);
+  va_end(ap);
+  assert(req == I2C_RDWR);
+
+  xfers++;
+  if (fail_xfers > 0) {
+    fail_xfers--;
+    return -1;
+  }
+  for (i = 0; i < data->nmsgs; i++) {
+    msg = &data->msgs[i];
+    assert(msg->addr == (FAKE_ADDR >> 1));
+    if (msg->flags & I2C_M_RD) {
+      assert(msg->len == 2);
+      msg->buf[0] = regs[page][reg] & 0xFF;
+      msg->buf[1] = regs[page][reg] >> 8;
+      continue;
+    }
+    assert(mangling || !(msg->flags & I2C_M_STOP));
+    reg = msg->buf[0];
+    if (msg->len == 1 || (i + 1 < data->nmsgs && !(msg->flags & I2C_M_STOP))) {
+      continue;
+    }
+    if (reg == VR_REG_PAGE && msg->len == 2) {
+      page = msg->buf[1];
+    } else if (msg->len == 3) {
+      if (reg != stuck_reg)
+        regs[page][reg] = msg->buf[1] | (msg->buf[2] << 8);
+    } else {
+      assert(nblocks < 64 && msg->len - 1 <= 32);
+      memcpy(blocks[nblocks++], &msg->buf[1], msg->len - 1);
+    }
+  }
+  return 0;
+}
+
+static void reset(void)
+{
+  memset(regs, 0, sizeof(regs));
+  page = 0;
+  nblocks = 0;
+  xfers = 0;
+  sleeps = 0;
+  stuck_reg = -1;
+  fail_xfers = 0;
+}
+
+static int make_words(struct vr_word *words)
+{
+  int i, n = 0;
+
+  for (i = 0; i < 30; i++, n++) {
+    words[n].page = (i < 20) ? 0x20 : 0x21;
+    words[n].reg = 0x80 + i;
+    words[n].value = 0x1000 + i * 0x101;
+  }
+  return n;
+}
+
+void test_write_words(void)
+{
+  struct vr_prog prog;
+  struct vr_word words[32];
+  int i, count = make_words(words);
+
+  reset();
+  assert(vr_prog_open(&prog, 1, FAKE_ADDR) == 0);
+  assert(vr_prog_write_words(&prog, words, count, true) == 0);
+  for (i = 0; i < count; i++) {
+    assert(regs[words[i].page][words[i].reg] == words[i].value);
+  }
+  if (mangling) {
+    // per page: page select, one write batch, read-backs (12 + 8, 10)
+    assert(prog.xfers == 7 && xfers == 7 && sleeps == 4);
+  } else {
+    // 2 page selects, 30 writes, 3 read-back batches (12 + 8 + 10)
+    assert(prog.xfers == 35 && xfers == 35 && sleeps == 32);
+  }
+  vr_prog_close(&prog);
+  printf("PASSED: Words are written across pages and verified%s\n",
+         mangling ? ", one batch per page" : "");
+
+  reset();
+  assert(vr_prog_open(&prog, 1, FAKE_ADDR) == 0);
+  assert(vr_prog_write_words(&prog, words, count, false) == 0);
+  for (i = 0; i < count; i++) {
+    assert(regs[words[i].page][words[i].reg] == words[i].value);
+  }
+  assert(xfers == (mangling ? 4 : 32));
+  vr_prog_close(&prog);
+  printf("PASSED: Words are written without verify%s\n",
+         mangling ? ", one batch per page" : "");
+}
+
+void test_verify_mismatch(void)
+{
+  struct vr_prog prog;
+  struct vr_word words[32];
+  int count = make_words(words);
+
+  reset();
+  stuck_reg = words[25].reg;
+  assert(vr_prog_open(&prog, 1, FAKE_ADDR) == 0);
+  assert(vr_prog_write_words(&prog, words, count, true) != 0);
+  vr_prog_close(&prog);
+  printf("PASSED: A dropped write fails the verify\n");
+}
+
+void test_retry(void)
+{
+  struct vr_prog prog;
+  struct vr_word words[32];
+  int count = make_words(words);
+
+  reset();
+  fail_xfers = VR_PROG_RETRY - 1;
+  assert(vr_prog_open(&prog, 1, FAKE_ADDR) == 0);
+  assert(vr_prog_write_words(&prog, words, count, true) == 0);
+  vr_prog_close(&prog);
+
+  reset();
+  fail_xfers = VR_PROG_RETRY;
+  assert(vr_prog_open(&prog, 1, FAKE_ADDR) == 0);
+  assert(vr_prog_write_words(&prog, words, count, true) != 0);
+  vr_prog_close(&prog);
+  printf("PASSED: Failed transactions are retried\n");
+}
+
+void test_block_write(void)
+{
+  struct vr_prog prog;
+  uint8_t data[50 * 32];
+  int i;
+
+  for (i = 0; i < (int)sizeof(data); i++) {
+    data[i] = i * 7;
+  }
+  reset();
+  assert(vr_prog_open(&prog, 1, FAKE_ADDR) == 0);
+  assert(vr_prog_block_write(&prog, 0xDE, data, 32, 50) == 0);
+  assert(nblocks == 50 && xfers == 50);
+  for (i = 0; i < 50; i++) {
+    assert(memcmp(blocks[i], &data[i * 32], 32) == 0);
+  }
+  vr_prog_close(&prog);
+  printf("PASSED: Blocks are written in order, one per transaction\n");
+}
+
+int main(int argc, char *argv[])
+{
+  test_write_words();
+  test_verify_mismatch();
+  test_retry();
+  test_block_write();
+
+  mangling = 1;
+  test_write_words();
+  test_verify_mismatch();
+  test_retry();
+  return 0;
+}
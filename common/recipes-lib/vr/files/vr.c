@@ -18,16 +18,21 @@
  * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 #include <stdio.h>
+#include <stdlib.h>
 #include <fcntl.h>
 #include <syslog.h>
 #include <string.h>
+#include <pthread.h>
+#include <openbmc/kv.h>
 #include <openbmc/obmc-i2c.h>
 #include <openbmc/obmc-pal.h>
 #include "vr.h"
 
 struct vr_info *dev_list = NULL;
 int dev_list_count = 0;
-void *plat_configs = NULL;
+
+static pthread_mutex_t vr_lock = PTHREAD_MUTEX_INITIALIZER;
+static int vr_users = 0;
 
 int vr_device_register(struct vr_info *info, int count)
 {
@@ -44,19 +49,86 @@ void vr_device_unregister()
 
 int vr_probe()
 {
-  return (plat_vr_init() < 0) ? -1 : 0;
+  int ret = 0;
+
+  pthread_mutex_lock(&vr_lock);
+  if (vr_users == 0) {
+    ret = (plat_vr_init() < 0) ? -1 : 0;
+  }
+  if (ret == 0) {
+    vr_users++;
+  }
+  pthread_mutex_unlock(&vr_lock);
+
+  return ret;
 }
 
 void vr_remove()
 {
-  plat_vr_exit();
-  vr_device_unregister();
+  pthread_mutex_lock(&vr_lock);
+  if (vr_users > 0 && --vr_users == 0) {
+    plat_vr_exit();
+    vr_device_unregister();
+  }
+  pthread_mutex_unlock(&vr_lock);
+}
+
+static void vr_cache_key(struct vr_info *info, char *key)
+{
+  snprintf(key, MAX_KEY_LEN, "vr_%u_%02xh_ver", info->bus, info->addr);
+}
+
+int vr_cache_get(struct vr_info *info, char *ver_str)
+{
+  char key[MAX_KEY_LEN], tmp_str[MAX_VALUE_LEN] = {0};
+
+  vr_cache_key(info, key);
+  if (kv_get(key, tmp_str, NULL, 0)) {
+    return -1;
+  }
+
+  if (snprintf(ver_str, MAX_VER_STR_LEN, "%s", tmp_str) > (MAX_VER_STR_LEN-1)) {
+    return -1;
+  }
+
+  return 0;
+}
+
+void vr_cache_set(struct vr_info *info, const char *ver_str)
+{
+  char key[MAX_KEY_LEN];
+
+  vr_cache_key(info, key);
+  kv_set(key, ver_str, 0, 0);
+}
+
+void vr_cache_invalidate(struct vr_info *info)
+{
+  char key[MAX_KEY_LEN];
+
+  vr_cache_key(info, key);
+  kv_del(key, 0);
+}
+
+static struct vr_info *vr_find(const char *vr_name)
+{
+  int i;
+
+  if (!vr_name) {
+    return NULL;
+  }
+
+  for (i = 0; i < dev_list_count; i++) {
+    if (!strcmp(dev_list[i].dev_name, vr_name))
+      return &dev_list[i];
+  }
+
+  return NULL;
 }
 
 int vr_fw_version(int index, const char *vr_name, char *ver_str)
 {
   struct vr_info *info = dev_list;
-  int i;
 
   do {
     if (index >= 0) {
@@ -70,11 +142,7 @@ int vr_fw_version(int index, const char *vr_name, char *ver_str)
         break;
       }
 
-      for (i = 0; i < dev_list_count; i++, info++) {
-        if (!strcmp(info->dev_name, vr_name))
-          break;
-      }
-      if (i >= dev_list_count) {
+      if ((info = vr_find(vr_name)) == NULL) {
         syslog(LOG_WARNING, "%s: device %s not found", __func__, vr_name);
         break;
       }
@@ -84,10 +152,15 @@ int vr_fw_version(int index, const char *vr_name, char *ver_str)
       break;
     }
 
+    if (vr_cache_get(info, ver_str) == 0) {
+      return VR_STATUS_SUCCESS;
+    }
+
     if (info->ops->get_fw_ver(info, ver_str) < 0) {
       syslog(LOG_WARNING, "%s: get VR %s version failed", __func__, info->dev_name);
       break;
     }
+    vr_cache_set(info, ver_str);
 
     return VR_STATUS_SUCCESS;
   } while (0);
@@ -95,10 +168,24 @@ int vr_fw_version(int index, const char *vr_name, char *ver_str)
   return VR_STATUS_FAILURE;
 }
 
+static void vr_free_configs(struct vr_info *info, void *configs)
+{
+  if (configs == NULL) {
+    return;
+  }
+
+  if (info->ops->free_configs) {
+    info->ops->free_configs(configs);
+  } else {
+    free(configs);
+  }
+}
+
 int vr_fw_update(const char *vr_name, const char *path, bool force)
 {
-  struct vr_info *info = dev_list;
-  int ret, i;
+  struct vr_info *info = dev_list, *owner = NULL;
+  void *configs = NULL;
+  int ret, i, status = VR_STATUS_FAILURE;
 
   for (i = 0; i < dev_list_count; i++, info++) {
     if (!vr_name || !strcmp(info->dev_name, vr_name)) {  // traverse all for unspecified vr_name
@@ -109,7 +196,7 @@ int vr_fw_update(const char *vr_name, const char *path, bool force)
         break;
       }
 
-      if (plat_configs == NULL) {
+      if (configs == NULL) {
         if (info->ops->validate_file &&
             info->ops->validate_file(info, path) < 0) {
           if (!vr_name) {
@@ -119,17 +206,22 @@ int vr_fw_update(const char *vr_name, const char *path, bool force)
           break;
         }
 
-        if ((plat_configs = info->ops->parse_file(info, path)) == NULL) {
+        if ((configs = info->ops->parse_file(info, path)) == NULL) {
           if (!vr_name) {
             continue;
           }
           syslog(LOG_WARNING, "%s: parse file failed", __func__);
           break;
         }
+        owner = info;
       }
 
       info->force = force;
-      if ((ret = info->ops->fw_update(info, plat_configs)) < 0) {
+      ret = info->ops->fw_update(info, configs);
+      if (ret != VR_STATUS_SKIP) {
+        vr_cache_invalidate(info);
+      }
+      if (ret < 0) {
         if (!vr_name && (ret == VR_STATUS_SKIP)) {
           continue;
         }
@@ -138,12 +230,13 @@ int vr_fw_update(const char *vr_name, const char *path, bool force)
       }
 
       if (info->ops->fw_verify &&
-          info->ops->fw_verify(info, plat_configs) < 0) {
+          info->ops->fw_verify(info, configs) < 0) {
         syslog(LOG_WARNING, "%s: verify VR %s failed", __func__, info->dev_name);
         break;
       }
 
-      return VR_STATUS_SUCCESS;
+      status = VR_STATUS_SUCCESS;
+      break;
     }
   }
 
@@ -151,7 +244,18 @@ int vr_fw_update(const char *vr_name, const char *path, bool force)
     syslog(LOG_WARNING, "%s: device %s not found", __func__, vr_name);
   }
 
-  return VR_STATUS_FAILURE;
+  if (owner) {
+    vr_free_configs(owner, configs);
+  }
+
+  return status;
+}
+
+int vr_fw_bus(const char *vr_name)
+{
+  struct vr_info *info = vr_find(vr_name);
+
+  return info ? info->bus : -1;
 }
 
 int i2c_io(int fd, uint8_t addr, uint8_t *tbuf, uint8_t tcnt, uint8_t *rbuf, uint8_t rcnt)
@@ -76,6 +76,13 @@ struct vr_ops {
    * 	Retrun -1 if failed, otherwise 0.
    */
   int (*fw_verify)(struct vr_info*, void*);
+
+  /*
+   * free_configs: (Optional)
+   * 	This function shall release the data returned by parse_file.
+   * 	free() is used if not provided.
+   */
+  void (*free_configs)(void*);
 };
 
 struct vr_info {
@@ -89,14 +96,22 @@ struct vr_info {
   void *private_data;
 };
 
-extern void *plat_configs;
-
 int vr_device_register(struct vr_info*, int);
 void vr_device_unregister(void);
 int vr_probe(void);
 void vr_remove(void);
 int vr_fw_version(int, const char*, char*);
 int vr_fw_update(const char*, const char*, bool);
+int vr_fw_bus(const char*);
+
+/*
+ * Version strings are cached in kv by bus and address, so reading the
+ * versions of all VRs does not touch the bus. vr_fw_update() drops the
+ * entry of every VR it programs.
+ */
+int vr_cache_get(struct vr_info*, char*);
+void vr_cache_set(struct vr_info*, const char*);
+void vr_cache_invalidate(struct vr_info*);
 
 extern int plat_vr_init(void);
 extern void plat_vr_exit(void);
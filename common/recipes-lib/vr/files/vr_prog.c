@@ -0,0 +1,242 @@
+/*
+ *
+ * Copyright 2021-present Facebook. All Rights Reserved.
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include <stdio.h>
+#include <syslog.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include <openbmc/obmc-i2c.h>
+#include <openbmc/obmc-pal.h>
+#include "vr.h"
+#include "vr_prog.h"
+
+int
+vr_prog_open(struct vr_prog *prog, uint8_t bus, uint8_t addr) {
+  unsigned long funcs = 0;
+
+  memset(prog, 0, sizeof(*prog));
+  prog->addr = addr;
+  prog->page = -1;
+  prog->fd = i2c_cdev_slave_open(bus, (addr>>1), I2C_SLAVE_FORCE_CLAIM);
+  if (prog->fd < 0) {
+    return -1;
+  }
+  if (!ioctl(prog->fd, I2C_FUNCS, &funcs)) {
+    prog->batch = !!(funcs & I2C_FUNC_PROTOCOL_MANGLING);
+  }
+  return 0;
+}
+
+void
+vr_prog_close(struct vr_prog *prog) {
+  if (prog->fd >= 0) {
+    close(prog->fd);
+    prog->fd = -1;
+  }
+}
+
+static int
+vr_prog_xfer(struct vr_prog *prog, struct i2c_msg *msgs, int nmsgs) {
+  struct i2c_rdwr_ioctl_data data;
+  int retry = VR_PROG_RETRY;
+
+  data.msgs = msgs;
+  data.nmsgs = nmsgs;
+  while (retry > 0) {
+    prog->xfers++;
+    if (ioctl(prog->fd, I2C_RDWR, &data) >= 0) {
+      return 0;
+    }
+    syslog(LOG_WARNING, "%s: i2c rw failed for dev 0x%x", __func__, prog->addr);
+    retry--;
+    msleep(100);
+  }
+
+  return -1;
+}
+
+static void
+vr_prog_msg(struct vr_prog *prog, struct i2c_msg *msg, uint16_t flags,
+            uint8_t *buf, uint16_t len) {
+  msg->addr = prog->addr >> 1;
+  msg->flags = flags;
+  msg->len = len;
+  msg->buf = buf;
+}
+
+static int
+vr_prog_write(struct vr_prog *prog, uint8_t *buf, uint16_t len) {
+  struct i2c_msg msg;
+
+  vr_prog_msg(prog, &msg, 0, buf, len);
+  if (vr_prog_xfer(prog, &msg, 1)) {
+    return -1;
+  }
+  msleep(1);  // delay between writes
+  return 0;
+}
+
+static int
+vr_prog_set_page(struct vr_prog *prog, uint8_t page) {
+  uint8_t buf[2] = {VR_REG_PAGE, page};
+
+  if (prog->page == page) {
+    return 0;
+  }
+  if (vr_prog_write(prog, buf, sizeof(buf))) {
+    prog->page = -1;
+    syslog(LOG_WARNING, "%s: set page to 0x%02X failed", __func__, page);
+    return -1;
+  }
+  prog->page = page;
+  return 0;
+}
+
+static void
+vr_prog_progress(int done, int total) {
+  printf("\rupdated: %d %%  ", done * 100 / total);
+  fflush(stdout);
+}
+
+/*
+ * Write the words of a single page, as one transaction of STOP-separated
+ * writes if the adapter allows it.
+ */
+static int
+vr_prog_write_page(struct vr_prog *prog, const struct vr_word *words, int n) {
+  struct i2c_msg msgs[VR_PROG_MAX_MSGS];
+  uint8_t wbuf[VR_PROG_MAX_MSGS][3];
+  int k;
+
+  for (k = 0; k < n; k++) {
+    wbuf[k][0] = words[k].reg;
+    wbuf[k][1] = words[k].value & 0xFF;
+    wbuf[k][2] = words[k].value >> 8;
+    if (!prog->batch) {
+      if (vr_prog_write(prog, wbuf[k], sizeof(wbuf[k]))) {
+        syslog(LOG_WARNING, "%s: write data failed, page=%02X offset=%02X", __func__,
+               words[k].page, words[k].reg);
+        return -1;
+      }
+      continue;
+    }
+    vr_prog_msg(prog, &msgs[k], I2C_M_STOP, wbuf[k], sizeof(wbuf[k]));
+  }
+
+  if (prog->batch) {
+    if (vr_prog_xfer(prog, msgs, n)) {
+      syslog(LOG_WARNING, "%s: write data failed, page=%02X offset=%02X-%02X", __func__,
+             words[0].page, words[0].reg, words[n-1].reg);
+      return -1;
+    }
+    msleep(1);  // delay between pages
+  }
+  return 0;
+}
+
+/*
+ * Read back the words of a single page, VR_PROG_WORDS per transaction.
+ */
+static int
+vr_prog_verify_page(struct vr_prog *prog, const struct vr_word *words, int n) {
+  struct i2c_msg msgs[VR_PROG_WORDS * 2];
+  uint8_t rreg[VR_PROG_WORDS], rbuf[VR_PROG_WORDS][2];
+  int i, k, m, nmsgs;
+
+  for (i = 0; i < n; i += m) {
+    m = (n - i < VR_PROG_WORDS) ? (n - i) : VR_PROG_WORDS;
+    nmsgs = 0;
+    for (k = 0; k < m; k++) {
+      rreg[k] = words[i+k].reg;
+      vr_prog_msg(prog, &msgs[nmsgs++], 0, &rreg[k], 1);
+      vr_prog_msg(prog, &msgs[nmsgs++], I2C_M_RD, rbuf[k], 2);
+    }
+    if (vr_prog_xfer(prog, msgs, nmsgs)) {
+      syslog(LOG_WARNING, "%s: read back failed, page=%02X offset=%02X", __func__,
+             words[i].page, words[i].reg);
+      return -1;
+    }
+    for (k = 0; k < m; k++) {
+      if (rbuf[k][0] != (words[i+k].value & 0xFF) || rbuf[k][1] != (words[i+k].value >> 8)) {
+        printf("data %02X%02X mismatch, expect %04X, page=%02X offset=%02X\n",
+               rbuf[k][1], rbuf[k][0], words[i+k].value, words[i+k].page, words[i+k].reg);
+        syslog(LOG_WARNING, "%s: read back mismatch, page=%02X offset=%02X", __func__,
+               words[i+k].page, words[i+k].reg);
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+/*
+ * Write 16-bit registers, switching pages as needed. With verify, the
+ * words written on a page are read back before moving to the next one.
+ */
+int
+vr_prog_write_words(struct vr_prog *prog, const struct vr_word *words, int count, bool verify) {
+  int i, n;
+
+  // the driver may have changed the page behind our back
+  prog->page = -1;
+
+  for (i = 0; i < count; i += n) {
+    if (vr_prog_set_page(prog, words[i].page)) {
+      return -1;
+    }
+
+    for (n = 1; n < VR_PROG_MAX_MSGS && (i + n) < count && words[i+n].page == words[i].page; n++);
+    if (vr_prog_write_page(prog, &words[i], n)) {
+      return -1;
+    }
+    if (verify && vr_prog_verify_page(prog, &words[i], n)) {
+      return -1;
+    }
+
+    vr_prog_progress(i + n, count);
+  }
+
+  printf("\n");
+  return 0;
+}
+
+/*
+ * Send count blocks of len bytes to the same register.
+ */
+int
+vr_prog_block_write(struct vr_prog *prog, uint8_t reg, const uint8_t *data, uint8_t len, int count) {
+  uint8_t buf[256];
+  int i;
+
+  for (i = 0; i < count; i++) {
+    buf[0] = reg;
+    memcpy(&buf[1], &data[i * len], len);
+    if (vr_prog_write(prog, buf, len + 1)) {
+      syslog(LOG_WARNING, "%s: block write to 0x%02X failed", __func__, reg);
+      return -1;
+    }
+    vr_prog_progress(i + 1, count);
+  }
+
+  printf("\n");
+  return 0;
+}
@@ -0,0 +1,40 @@
+#ifndef __VR_PROG_H__
+#define __VR_PROG_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Programming engine shared by the PMBus VR drivers. The devices may drop
+ * a write that is followed by a repeated START, so every register write
+ * ends with a STOP. When the adapter can send a STOP in the middle of a
+ * transaction (I2C_FUNC_PROTOCOL_MANGLING), the writes to a page go out
+ * in one I2C_RDWR with I2C_M_STOP on each message and are paced once per
+ * page; otherwise each write is its own transaction, paced as before.
+ * The read-backs of written words are issued VR_PROG_WORDS at a time.
+ */
+
+#define VR_PROG_MAX_MSGS 42  // I2C_RDWR_IOCTL_MAX_MSGS
+#define VR_PROG_WORDS    12  // words verified per transaction
+#define VR_PROG_RETRY    3
+
+struct vr_word {
+  uint8_t page;
+  uint8_t reg;
+  uint16_t value;
+};
+
+struct vr_prog {
+  int fd;
+  uint8_t addr;
+  int page;             // selected page, -1 if unknown
+  bool batch;           // adapter supports I2C_M_STOP
+  unsigned int xfers;   // I2C_RDWR transactions issued
+};
+
+int vr_prog_open(struct vr_prog*, uint8_t bus, uint8_t addr);
+void vr_prog_close(struct vr_prog*);
+int vr_prog_write_words(struct vr_prog*, const struct vr_word*, int count, bool verify);
+int vr_prog_block_write(struct vr_prog*, uint8_t reg, const uint8_t *data, uint8_t len, int count);
+
+#endif
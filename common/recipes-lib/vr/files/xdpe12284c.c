@@ -4,8 +4,8 @@
 #include <unistd.h>
 #include <openbmc/obmc-i2c.h>
 #include <openbmc/obmc-pal.h>
-#include <openbmc/kv.h>
 #include "xdpe12284c.h"
+#include "vr_prog.h"
 
 extern int i2c_io(int, uint8_t, uint8_t *, uint8_t, uint8_t *, uint8_t);
 
@@ -41,7 +41,7 @@ get_xdpe_crc(int fd, uint8_t addr, uint32_t *crc) {
 }
 
 static int
-cache_xdpe_crc(uint8_t bus, uint8_t addr, char *key, char *checksum) {
+read_xdpe_ver(uint8_t bus, uint8_t addr, char *ver_str) {
   int fd, ret = -1;
   uint8_t tbuf[16], rbuf[16], remain;
 
@@ -68,9 +68,10 @@ cache_xdpe_crc(uint8_t bus, uint8_t addr, char *key, char *checksum) {
       break;
     }
 
-    snprintf(checksum, MAX_VALUE_LEN, "Infineon %02X%02X%02X%02X, Remaining Writes: %u",
-             rbuf[3], rbuf[2], rbuf[1], rbuf[0], remain);
-    kv_set(key, checksum, 0, 0);
+    if (snprintf(ver_str, MAX_VER_STR_LEN, "Infineon %02X%02X%02X%02X, Remaining Writes: %u",
+                 rbuf[3], rbuf[2], rbuf[1], rbuf[0], remain) > (MAX_VER_STR_LEN-1)) {
+      ret = -1;
+    }
   } while (0);
 
   tbuf[0] = VR_REG_PAGE;
@@ -85,18 +86,7 @@ cache_xdpe_crc(uint8_t bus, uint8_t addr, char *key, char *checksum) {
 
 int
 get_xdpe_ver(struct vr_info *info, char *ver_str) {
-  char key[MAX_KEY_LEN], tmp_str[MAX_VALUE_LEN] = {0};
-
-  snprintf(key, sizeof(key), "vr_%02xh_crc", info->addr);
-  if (kv_get(key, tmp_str, NULL, 0)) {
-    if (cache_xdpe_crc(info->bus, info->addr, key, tmp_str))
-      return -1;
-  }
-
-  if (snprintf(ver_str, MAX_VER_STR_LEN, "%s", tmp_str) > (MAX_VER_STR_LEN-1))
-    return -1;
-
-  return 0;
+  return read_xdpe_ver(info->bus, info->addr, ver_str);
 }
 
 void *
@@ -208,15 +198,17 @@ check_xdpe_image(uint32_t crc_exp, uint8_t *data) {
 static int
 program_xdpe(uint8_t bus, uint8_t addr, struct xdpe_config *config, bool force) {
   int fd, i, ret = -1;
-  uint8_t tbuf[32], rbuf[32], remain = 0, page = 0;
+  uint8_t tbuf[32], rbuf[32], remain = 0;
   uint8_t *data = config->data;
   uint16_t memptr;
   uint32_t crc = 0;
-  float dsize, next_prog;
+  struct vr_prog prog;
+  struct vr_word words[VR_XDPE_TOTAL_RW_SIZE/4];
 
-  if ((fd = i2c_cdev_slave_open(bus, (addr>>1), I2C_SLAVE_FORCE_CLAIM)) < 0) {
+  if (vr_prog_open(&prog, bus, addr)) {
     return -1;
   }
+  fd = prog.fd;
 
   do {
     if ((ret = get_xdpe_crc(fd, addr, &crc))) {
@@ -319,48 +311,13 @@ program_xdpe(uint8_t bus, uint8_t addr, struct xdpe_config *config, bool force)
     memptr = ((rbuf[1] << 8) | rbuf[0]) & 0x3FF;
     printf("Memory pointer: 0x%X\n", memptr);
 
-    // write configuration data
-    dsize = (float)VR_XDPE_TOTAL_RW_SIZE/100;
-    next_prog = dsize;
-    for (i = 0; i < VR_XDPE_TOTAL_RW_SIZE; i+= 4) {
-      if (page != data[i+1]) {
-        page = data[i+1];
-        tbuf[0] = VR_REG_PAGE;
-        tbuf[1] = page;
-        if ((ret = i2c_io(fd, addr, tbuf, 2, rbuf, 0))) {
-          syslog(LOG_WARNING, "%s: set page to 0x%02X failed", __func__, tbuf[1]);
-          break;
-        }
-      }
-
-      tbuf[0] = data[i];  // offset
-      tbuf[1] = data[i+2];
-      tbuf[2] = data[i+3];
-      if ((ret = i2c_io(fd, addr, tbuf, 3, rbuf, 0))) {
-        syslog(LOG_WARNING, "%s: write data failed, page=%02X offset=%02X data=%02X%02X",
-                            __func__, page, tbuf[0], tbuf[2], tbuf[1]);
-        break;
-      }
-
-      // read back to compare
-      if ((ret = i2c_io(fd, addr, tbuf, 1, rbuf, 2))) {
-        syslog(LOG_WARNING, "%s: read data failed, page=%02X offset=%02X", __func__, page, tbuf[0]);
-        break;
-      }
-
-      if (memcmp(&tbuf[1], rbuf, 2)) {
-        printf("data %02X%02X mismatch, expect %02X%02X\n", tbuf[2], tbuf[1], rbuf[1], rbuf[0]);
-        break;
-      }
-
-      if ((i + 4) >= (int)next_prog) {
-        printf("\rupdated: %d %%  ", (int)((next_prog+dsize/2)/dsize));
-        fflush(stdout);
-        next_prog += dsize;
-      }
+    // write configuration data, reading back each register
+    for (i = 0; i < VR_XDPE_TOTAL_RW_SIZE; i += 4) {
+      words[i/4].reg = data[i];
+      words[i/4].page = data[i+1];
+      words[i/4].value = (data[i+3] << 8) | data[i+2];
     }
-    printf("\n");
-    if (ret) {
+    if ((ret = vr_prog_write_words(&prog, words, VR_XDPE_TOTAL_RW_SIZE/4, true))) {
       break;
     }
 
@@ -468,7 +425,7 @@ program_xdpe(uint8_t bus, uint8_t addr, struct xdpe_config *config, bool force)
   if (i2c_io(fd, addr, tbuf, 2, rbuf, 0)) {
     syslog(LOG_WARNING, "%s: set page to 0x%02X failed", __func__, tbuf[1]);
   }
-  close(fd);
+  vr_prog_close(&prog);
 
   return ret;
 }
@@ -528,9 +485,6 @@ xdpe_fw_verify(struct vr_info *info, void *args) {
   if (crc != config->crc_exp) {
     printf("CRC %08X mismatch, expect %08X\n", crc, config->crc_exp);
     ret = -1;
-  } else {
-    snprintf((char *)buf, sizeof(buf), "/tmp/cache_store/vr_%02xh_crc", info->addr);
-    unlink((char *)buf);
   }
 
   return ret;
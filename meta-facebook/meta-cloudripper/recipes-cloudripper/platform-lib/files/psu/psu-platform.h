@@ -40,5 +40,6 @@ i2c_info_t psu[] = {
 };
 
 extern void sensord_operation(uint8_t num, uint8_t action);
+extern void sensord_operation_batch(const uint8_t *nums, int count, uint8_t action);
 
 #endif /* _DELTA_PSU_PLATFORM_H_ */
@@ -58,6 +58,8 @@
 #include <signal.h>
 #include <syslog.h>
 #include <dirent.h>
+#include <time.h>
+#include <pthread.h>
 #ifdef CONFIG_GALAXY100
 #include <fcntl.h>
 #endif
@@ -141,6 +143,12 @@
 
 #define PATH_CACHE_SIZE 256
 
+#define SYSFS_DEV_CACHE_SIZE 32
+#define SYSFS_NODE_CACHE_SIZE 160
+/* Minimum gap between two accesses on the same i2c bus */
+#define SYSFS_DEV_PACING_US 11000
+#define FAND_MAX_JOBS 16
+
 #define log_error(fmt, args...) \
   syslog(LOG_ERR, "%s" fmt ": %s", __func__, ##args, strerror(errno))
 #define log_warn(fmt, args...) \
@@ -562,27 +570,179 @@ close_dir_out:
   return rc;
 }
 
-// Functions for reading from sysfs stub
-static int read_sysfs_raw_internal(const char *device, char *value, int log)
+/*
+ * Cached sysfs access.
+ *
+ * Every sysfs node touched by the control loop is opened once and then
+ * accessed with pread()/pwrite() at offset 0, which makes the kernel
+ * re-run the attribute's show()/store() method. A descriptor which fails
+ * (e.g. the device was unbound when a FAB was pulled) is closed and the
+ * node is re-opened on the next access.
+ *
+ * Accesses are paced per i2c bus instead of sleeping after every
+ * access: two accesses to devices on the same bus are at least
+ * SYSFS_DEV_PACING_US apart, accesses on different buses are not
+ * delayed and may be issued from different threads. Devices sharing a
+ * bus would still overrun it if each was paced on its own.
+ */
+struct sysfs_dev {
+  char name[PATH_CACHE_SIZE];
+  pthread_mutex_t lock;
+  struct timespec last;
+};
+
+struct sysfs_node {
+  char path[PATH_CACHE_SIZE];
+  int flags;
+  int fd;
+  struct sysfs_dev *dev;
+};
+
+static struct sysfs_dev sysfs_devs[SYSFS_DEV_CACHE_SIZE];
+static int sysfs_dev_num = 0;
+static struct sysfs_node sysfs_nodes[SYSFS_NODE_CACHE_SIZE];
+static int sysfs_node_num = 0;
+static pthread_mutex_t sysfs_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * The pacing domain of a node is the bus of the first path component that
+ * looks like an i2c client ("<bus>-<addr>"), or the node's directory
+ * otherwise.
+ */
+static void sysfs_dev_name(const char *path, char *name, int size)
 {
-  FILE *fp;
-  int rc, err;
+  const char *p = path, *end;
+  unsigned int bus, addr;
+  char c;
+
+  while ((p = strchr(p, '/')) != NULL) {
+    p++;
+    if (sscanf(p, "%u-%4x%c", &bus, &addr, &c) == 3 && c == '/') {
+      snprintf(name, size, "i2c-%u", bus);
+      return;
+    }
+  }
+  end = strrchr(path, '/');
+  if (end == NULL)
+    end = path + strlen(path);
+  snprintf(name, size, "%.*s", (int)(end - path), path);
+}
 
-  fp = fopen(device, "r");
-  if (!fp) {
-    if (log) {
+static struct sysfs_dev *sysfs_dev_get(const char *path)
+{
+  char name[PATH_CACHE_SIZE];
+  struct sysfs_dev *dev;
+  int i;
+
+  sysfs_dev_name(path, name, sizeof(name));
+  for (i = 0; i < sysfs_dev_num; i++) {
+    if (!strcmp(sysfs_devs[i].name, name))
+      return &sysfs_devs[i];
+  }
+  if (sysfs_dev_num >= SYSFS_DEV_CACHE_SIZE)
+    return NULL;
+  dev = &sysfs_devs[sysfs_dev_num++];
+  snprintf(dev->name, sizeof(dev->name), "%s", name);
+  pthread_mutex_init(&dev->lock, NULL);
+  dev->last.tv_sec = 0;
+  dev->last.tv_nsec = 0;
+  return dev;
+}
+
+// Returns the cached node, or NULL if the cache is full.
+static struct sysfs_node *sysfs_node_get(const char *path, int flags)
+{
+  struct sysfs_node *node = NULL;
+  int i;
+
+  pthread_mutex_lock(&sysfs_cache_lock);
+  for (i = 0; i < sysfs_node_num; i++) {
+    if (sysfs_nodes[i].flags == flags && !strcmp(sysfs_nodes[i].path, path)) {
+      node = &sysfs_nodes[i];
+      goto out;
+    }
+  }
+  if (sysfs_node_num < SYSFS_NODE_CACHE_SIZE) {
+    struct sysfs_dev *dev = sysfs_dev_get(path);
+    if (dev != NULL) {
+      node = &sysfs_nodes[sysfs_node_num++];
+      snprintf(node->path, sizeof(node->path), "%s", path);
+      node->flags = flags;
+      node->fd = -1;
+      node->dev = dev;
+    }
+  }
+out:
+  pthread_mutex_unlock(&sysfs_cache_lock);
+  return node;
+}
+
+static void sysfs_dev_pace(struct sysfs_dev *dev)
+{
+  struct timespec now;
+  long elapsed_us;
+
+  if (dev->last.tv_sec == 0 && dev->last.tv_nsec == 0)
+    return;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  elapsed_us = (now.tv_sec - dev->last.tv_sec) * 1000000L +
+               (now.tv_nsec - dev->last.tv_nsec) / 1000L;
+  if (elapsed_us >= 0 && elapsed_us < SYSFS_DEV_PACING_US)
+    usleep(SYSFS_DEV_PACING_US - elapsed_us);
+}
+
+/*
+ * Reads (rw == 0) or writes (rw == 1) a sysfs node through the cache.
+ * Returns the number of bytes transferred or -1 with errno set.
+ */
+static int sysfs_node_xfer(const char *device, char *buf, int len, int rw)
+{
+  struct sysfs_node *node;
+  int flags = rw ? O_WRONLY : O_RDONLY;
+  int fd, rc, err;
+
+  node = sysfs_node_get(device, flags);
+  if (node == NULL) {
+    // Cache full, fall back to a one-shot access.
+    fd = open(device, flags);
+    if (fd < 0)
+      return -1;
+    rc = rw ? pwrite(fd, buf, len, 0) : pread(fd, buf, len, 0);
+    err = errno;
+    close(fd);
+    errno = err;
+    return rc;
+  }
+
+  pthread_mutex_lock(&node->dev->lock);
+  sysfs_dev_pace(node->dev);
+  if (node->fd < 0)
+    node->fd = open(node->path, flags);
+  if (node->fd < 0) {
+    rc = -1;
+  } else {
+    rc = rw ? pwrite(node->fd, buf, len, 0) : pread(node->fd, buf, len, 0);
+    if (rc < 0) {
       err = errno;
-      syslog(LOG_INFO, "failed to open device %s for read: %s",
-             device, strerror(err));
+      close(node->fd);
+      node->fd = -1;
       errno = err;
     }
-    return -1;
   }
+  err = errno;
+  clock_gettime(CLOCK_MONOTONIC, &node->dev->last);
+  pthread_mutex_unlock(&node->dev->lock);
+  errno = err;
+  return rc;
+}
 
-  rc = fscanf(fp, "%s", value);
-  fclose(fp);
+// Functions for reading from sysfs stub
+static int read_sysfs_raw_internal(const char *device, char *value, int log)
+{
+  int rc, err;
 
-  if (rc != 1) {
+  rc = sysfs_node_xfer(device, value, PATH_CACHE_SIZE - 1, 0);
+  if (rc < 0) {
     if (log) {
       err = errno;
       syslog(LOG_INFO, "failed to read device %s: %s",
@@ -592,6 +752,15 @@ static int read_sysfs_raw_internal(const char *device, char *value, int log)
     return -1;
   }
 
+  // Only the first token is of interest.
+  value[rc] = '\0';
+  value[strcspn(value, " \t\r\n")] = '\0';
+  if (value[0] == '\0') {
+    if (log)
+      syslog(LOG_INFO, "failed to read device %s: empty", device);
+    return -1;
+  }
+
   return 0;
 }
 
@@ -626,27 +795,14 @@ static int read_sysfs_int(char *sysfs_path, int *buffer)
 // Functions for writing to system stub
 static int write_sysfs_raw_internal(const char *device, char *value, int log)
 {
-  FILE *fp;
   int rc, err;
 
-  fp = fopen(device, "w");
-  if (!fp) {
-    if (log) {
-      err = errno;
-      syslog(LOG_INFO, "failed to open device %s for write : %s",
-             device, strerror(err));
-      errno = err;
-    }
-    return err;
-  }
-
-  rc = fputs(value, fp);
-  fclose(fp);
-
+  rc = sysfs_node_xfer(device, value, strlen(value), 1);
   if (rc < 0) {
     if (log) {
       err = errno;
-      syslog(LOG_INFO, "failed to write to device %s", device);
+      syslog(LOG_INFO, "failed to write to device %s: %s",
+             device, strerror(err));
       errno = err;
     }
     return -1;
@@ -675,6 +831,45 @@ static int write_sysfs_int(char *sysfs_path, int buffer)
   return write_sysfs_raw(sysfs_path, writeBuf);
 }
 
+/*
+ * Runs fn(0) ... fn(n - 1) concurrently, one thread per index, and
+ * waits for all of them. Indexes whose thread cannot be created are run
+ * in the calling thread.
+ */
+struct fand_job {
+  pthread_t tid;
+  int idx;
+  void (*fn)(int idx);
+};
+
+static void *fand_job_thread(void *arg)
+{
+  struct fand_job *job = (struct fand_job *)arg;
+  job->fn(job->idx);
+  return NULL;
+}
+
+static void run_parallel(void (*fn)(int idx), int n)
+{
+  struct fand_job jobs[FAND_MAX_JOBS];
+  bool started[FAND_MAX_JOBS];
+  int i;
+
+  for (i = 0; i < n && i < FAND_MAX_JOBS; i++) {
+    jobs[i].idx = i;
+    jobs[i].fn = fn;
+    started[i] = pthread_create(&jobs[i].tid, NULL, fand_job_thread, &jobs[i]) == 0;
+  }
+  for (; i < n; i++)
+    fn(i);
+  for (i = 0; i < n && i < FAND_MAX_JOBS; i++) {
+    if (started[i])
+      pthread_join(jobs[i].tid, NULL);
+    else
+      fn(i);
+  }
+}
+
 static int read_temp_sysfs(struct sensor_info_sysfs *sensor)
 {
   int ret;
@@ -731,10 +926,30 @@ static int read_temp_sysfs(struct sensor_info_sysfs *sensor)
     return -1;
   }
 
-  usleep(11000);
   return value;
 }
 
+/*
+ * Temperatures of the current control cycle, filled in by
+ * read_board_temps(). -1 means the sensor is absent or unreadable.
+ */
+static int board_critical_temp[BOARD_INFO_SIZE];
+static int board_alarm_temp[BOARD_INFO_SIZE];
+
+static void read_board_temp_job(int idx)
+{
+  struct galaxy100_board_info_stu_sysfs *info = &galaxy100_board_info[idx];
+
+  board_critical_temp[idx] = info->critical ? read_temp_sysfs(info->critical) : -1;
+  board_alarm_temp[idx] = info->alarm ? read_temp_sysfs(info->alarm) : -1;
+}
+
+// The sensors of each board sit behind different buses, read them concurrently.
+static void read_board_temps(void)
+{
+  run_parallel(read_board_temp_job, BOARD_INFO_SIZE);
+}
+
 static int read_critical_max_temp(void)
 {
   int i;
@@ -744,7 +959,7 @@ static int read_critical_max_temp(void)
   for(i = 0; i < BOARD_INFO_SIZE; i++) {
     info = &galaxy100_board_info[i];
     if(info->critical) {
-      temp = read_temp_sysfs(info->critical);
+      temp = board_critical_temp[i];
       if(temp != -1) {
         info->critical->temp = temp;
         if(temp > max_temp)
@@ -766,7 +981,7 @@ static int read_alarm_max_temp(void)
   for(i = 0; i < BOARD_INFO_SIZE; i++) {
     info = &galaxy100_board_info[i];
     if(info->alarm) {
-      temp = read_temp_sysfs(info->alarm);
+      temp = board_alarm_temp[i];
       if(temp != -1) {
         info->alarm->temp = temp;
         if(temp > max_temp)
@@ -831,8 +1046,6 @@ static int galaxy100_set_fan_sysfs(int fan, int value)
               channel->prefix, "fantray1_pwm", value);
     return -1;
   }
-  usleep(11000);
-
   snprintf(fullpath, PATH_CACHE_SIZE, "%s/%s", channel->prefix, "fantray2_pwm");
   ret = write_sysfs_int(fullpath, value);
   if(ret < 0) {
@@ -840,8 +1053,6 @@ static int galaxy100_set_fan_sysfs(int fan, int value)
               channel->prefix, "fantray2_pwm", value);
     return -1;
   }
-  usleep(11000);
-
   snprintf(fullpath, PATH_CACHE_SIZE, "%s/%s", channel->prefix, "fantray3_pwm");
   ret = write_sysfs_int(fullpath, value);
   if(ret < 0) {
@@ -849,8 +1060,6 @@ static int galaxy100_set_fan_sysfs(int fan, int value)
               channel->prefix, "fantray3_pwm", value);
     return -1;
   }
-  usleep(11000);
-
   return 0;
 }
 
@@ -874,8 +1083,6 @@ static int galaxy100_fab_is_present_sysfs(int fan)
     return -1;
   }
 
-  usleep(11000);
-
   if (ret != 0) {
     syslog(LOG_ERR, "%s: FAB-%d not present", __func__, fan + 1);
     return 0;
@@ -899,7 +1106,6 @@ static int galaxy100_lc_present_detect(void)
     lc_1base = i + 1;
     snprintf(buf, PATH_CACHE_SIZE, "/sys/bus/i2c/drivers/cmmcpld/13-003e/lc%d_present", lc_1base);
     rc = read_sysfs_int(buf, &ret);
-    usleep(11000);
     if (rc == 0)
     {
       if (ret != 0) {
@@ -949,8 +1155,6 @@ static int galaxy100_scm_present_detect(void)
                i - 3);
 
     rc = read_sysfs_int(buf, &ret);
-    usleep(11000);
-
     if (rc == 0)
     {
       if((ret >> i) & 0x1 == 0x1) {
@@ -984,8 +1188,6 @@ static int galaxy100_cmm_is_master(void)
     log_error("failed to read cmm status reg %#x", GALAXY100_CMM_STATUS_REG);
     return -1;
   }
-  usleep(11000);
-
   // In new function, it's a bit tricky.
   // Readvalue : 0 --> We are master --> Function returns 1
   // Readvalue : 1 --> We are slave  --> Function returns 0
@@ -1046,7 +1248,6 @@ static int galaxy100_fan_is_okey_sysfs(int fan)
     log_error("failed to read fan1 status %s", fullpath);
     error++;
   } else {
-    usleep(11000);
     if(ret & 0x1) {
       if(info->fan1.present == 1)
         printf("FCB-%d fantray 1 is removed\n", fan + 1);
@@ -1080,7 +1281,6 @@ static int galaxy100_fan_is_okey_sysfs(int fan)
     log_error("failed to read fan2 status %s", fullpath);
     error++;
   } else {
-    usleep(11000);
     if(ret & 0x1) {
       if(info->fan2.present == 1)
         printf("FCB-%d fantray 2 is removed\n", fan + 1);
@@ -1114,7 +1314,6 @@ static int galaxy100_fan_is_okey_sysfs(int fan)
     log_error("failed to read fan3 status %s", fullpath);
     error++;
   } else {
-    usleep(11000);
     if(ret & 0x1) {
       if(info->fan3.present == 1)
         printf("FCB-%d fantray 3 is removed\n", fan + 1);
@@ -1205,7 +1404,6 @@ static int galaxy100_write_fan_led_sysfs(int fan, const char *color)
         snprintf(fullpath, PATH_CACHE_SIZE, "%s/fantray%d_led_ctrl",
                  channel->prefix, fan_1base);
         write_sysfs_int(fullpath, value);
-        usleep(11000);
         // Finally, read back, and make sure the value is there.
         rc = read_sysfs_int(fullpath, &ret);
         if ((rc < 0) || (ret != value)) {
@@ -1370,6 +1568,30 @@ int write_fan_speed(const int fan, const int value) {
 
 
 
+/*
+ * Every fan tray has its own fancpld, so all trays are programmed and
+ * checked concurrently.
+ */
+static int fan_job_value;
+static int fan_job_result[FANS];
+
+static void write_fan_speed_job(int fan)
+{
+  fan_job_result[fan] = write_fan_speed(fan + fan_offset, fan_job_value);
+}
+
+static void write_fan_speed_all(const int value)
+{
+  fan_job_value = value;
+  run_parallel(write_fan_speed_job, total_fans);
+}
+
+static void fan_speed_okay_job(int fan)
+{
+  fan_job_result[fan] = fan_speed_okay(fan + fan_offset, fan_job_value,
+                                       FAN_FAILURE_OFFSET);
+}
+
 /* Set up fan LEDs */
 
 int write_fan_led(const int fan, const char *color) {
@@ -1552,8 +1774,8 @@ int main(int argc, char **argv) {
       continue;
     }
 
-    usleep(11000);
     /* Read sensors */
+    read_board_temps();
     critical_temp = read_critical_max_temp();
     alarm_temp = read_alarm_max_temp();
 
@@ -1608,9 +1830,7 @@ int main(int argc, char **argv) {
              old_speed,
              fan_speed);
       fan_speed_changes++;
-      for (fan = 0; fan < total_fans; fan++) {
-        write_fan_speed(fan + fan_offset, fan_speed);
-      }
+      write_fan_speed_all(fan_speed);
     }
     /*
      * Wait for some change.  Typical I2C temperature sensors
@@ -1627,12 +1847,14 @@ int main(int argc, char **argv) {
 
     /* Check fan RPMs */
 
+    fan_job_value = fan_speed;
+    run_parallel(fan_speed_okay_job, total_fans);
     for (fan = 0; fan < total_fans; fan++) {
       /*
        * Make sure that we're within some percentage
        * of the requested speed.
        */
-      if (fan_speed_okay(fan + fan_offset, fan_speed, FAN_FAILURE_OFFSET)) {
+      if (fan_job_result[fan]) {
         if (fan_bad[fan] >= FAN_FAILURE_THRESHOLD) {
           write_fan_led(fan + fan_offset, FAN_LED_BLUE);
           syslog(LOG_CRIT,
@@ -1721,9 +1943,7 @@ int main(int argc, char **argv) {
         } else {
           failed_speed = fan_max;
         }
-        for (fan = 0; fan < total_fans; fan++) {
-          write_fan_speed(fan + fan_offset, failed_speed);
-        }
+        write_fan_speed_all(failed_speed);
       }
 
       /*
@@ -1735,9 +1955,7 @@ int main(int argc, char **argv) {
     } else if(prev_fans_bad != 0 && fan_failure == 0){
       old_temp = GALAXY100_RAISING_TEMP_HIGH;
       fan_speed = fan_medium;
-      for (fan = 0; fan < total_fans; fan++) {
-        write_fan_speed(fan + fan_offset, fan_speed);
-      }
+      write_fan_speed_all(fan_speed);
     }
     /* Suppress multiple warnings for similar number of fan failures. */
     prev_fans_bad = fan_failure;
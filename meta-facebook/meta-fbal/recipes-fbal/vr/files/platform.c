@@ -137,8 +137,5 @@ int plat_vr_init(void) {
 }
 
 void plat_vr_exit(void) {
-  if (plat_configs) {
-    free(plat_configs);
-  }
   return;
 }
@@ -33,6 +33,7 @@ struct vr_ops mpq8645p_ops = {
   .validate_file = mpq8645p_validate_file,
   .fw_update = mpq8645p_fw_update,
   .fw_verify = mpq8645p_fw_verify,
+  .free_configs = mpq8645p_free_configs,
 };
 
 struct vr_info fbep_vr_list[] = {
@@ -147,6 +148,4 @@ void plat_vr_exit()
 
   for (i = 0; i < list_cnt; i++)
     free(fbep_vr_list[i].private_data);
-
-  mpq8645p_free_configs(plat_configs);
 }
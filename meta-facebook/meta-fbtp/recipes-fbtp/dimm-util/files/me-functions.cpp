@@ -229,6 +229,68 @@ util_read_spd_byte(uint8_t fru_id, uint8_t cpu, uint8_t dimm, uint8_t offset)
   return rbuf[min_resp_len - 2];
 }
 
+// read len bytes off SPD bus in one ME transaction,
+// input:  cpu/dimm/offset/len
+int
+util_read_spd_block(uint8_t fru_id, uint8_t cpu, uint8_t dimm, uint8_t offset,
+                    uint8_t len, uint8_t *buf)
+{
+// 7 bytes IPMB header + 3 bytes INTEL ID + payload + 1 byte checksum
+  constexpr size_t hdr_len = (7 + INTEL_ID_LEN);
+
+  uint8_t tbuf[256] = {0};
+  uint8_t rbuf[256] = {0};
+  uint8_t tlen = 0;
+  uint8_t rlen = 0;
+  int addr_msb = 0;
+  int addr_lsb = 0;
+
+  ipmb_req_t *req = (ipmb_req_t*)tbuf;
+
+  if (len == 0 || len > SPD_BLOCK_MAX)
+    return -1;
+
+  // calculate DIMM msb_addr
+  //   msb_addr is 0 for dimms 0-3,  1 for 4-7
+  if (dimm >= (MAX_DIMM_NUM_FBTP/2))
+    addr_msb = 1;
+  addr_lsb = dev_addr[dimm % (MAX_DIMM_NUM_FBTP/2)];
+
+  req->res_slave_addr = ME_SLAVE_ADDR;
+  req->netfn_lun = NETFN_NM_REQ << 2;
+  req->hdr_cksum = req->res_slave_addr +
+                   req->netfn_lun;
+  req->hdr_cksum = ZERO_CKSUM_CONST - req->hdr_cksum;
+
+  req->req_slave_addr = BMC_SLAVE_ADDR;
+  req->seq_lun = 0x00;
+
+  req->cmd = CMD_NM_READ_MEM_SM_BUS;
+
+  tlen = 6;  // length so far with all fields above
+
+  /* Intel's IANA */
+  tbuf[tlen++] = MANU_INTEL_0;
+  tbuf[tlen++] = MANU_INTEL_1;
+  tbuf[tlen++] = MANU_INTEL_2;
+
+  tbuf[tlen++] = cpu;
+  tbuf[tlen++] = addr_msb;
+  tbuf[tlen++] = addr_lsb;
+  tbuf[tlen++] = offset;
+  tbuf[tlen++] = len - 1;  // read count is 0 based
+
+  // Invoke IPMB library handler
+  lib_ipmb_handle(ME_BUS_ADDR, tbuf, tlen+1, rbuf, &rlen);
+
+  if (rlen < hdr_len + len + 1) {
+    return -1;
+  }
+
+  memcpy(buf, &rbuf[hdr_len], len);
+  return 0;
+}
+
 int
 util_check_me_status(uint8_t fru_id) {
 // 7 bytes IPMB header + 2 byte payload + 1 byte checksum
@@ -219,6 +219,64 @@ util_read_spd_byte(uint8_t slot_id, uint8_t cpu, uint8_t dimm, uint8_t offset)
   return rbuf[MIN_RESP_LEN - 1];
 }
 
+// read len bytes off SPD bus in one ME transaction,
+// input:  cpu/dimm/offset/len
+int
+util_read_spd_block(uint8_t slot_id, uint8_t cpu, uint8_t dimm, uint8_t offset,
+                    uint8_t len, uint8_t *buf)
+{
+// same layout as the single byte read, with len bytes of payload
+#define BLOCK_RESP_HDR_LEN (MIN_RESP_LEN - 1)
+
+  int ret;
+  uint8_t tbuf[256] = {MANU_FACEBOOK_0, MANU_FACEBOOK_1, MANU_FACEBOOK_2}; // IANA ID
+  uint8_t rbuf[256] = {0};
+  uint8_t tlen = 0;
+  uint8_t rlen = 0;
+  int addr_msb = 0;
+  int addr_lsb = 0;
+
+  if (len == 0 || len > SPD_BLOCK_MAX)
+    return -1;
+
+  // calculate DIMM msb_addr & lsb_addr
+  //   msb_addr is 0 for dimms 0-3,  1 for 4-7
+  if (dimm >= (MAX_DIMM_NUM_FBY2/2))
+    addr_msb = 1;
+  // assumes MAX_DIMM_NUM is multiple of 2
+  addr_lsb = dev_addr[dimm % (MAX_DIMM_NUM_FBY2/2)];
+
+  tlen = 3;
+  tbuf[tlen++] = BIC_INTF_ME;
+
+  tbuf[tlen++] = NETFN_NM_REQ << 2;  //BIC requires NETFN<<2
+  tbuf[tlen++] = CMD_NM_READ_MEM_SM_BUS;
+
+  /* Intel's IANA */
+  tbuf[tlen++] = MANU_INTEL_0;
+  tbuf[tlen++] = MANU_INTEL_1;
+  tbuf[tlen++] = MANU_INTEL_2;
+
+  tbuf[tlen++] = cpu;
+  tbuf[tlen++] = addr_msb;
+  tbuf[tlen++] = addr_lsb;
+  tbuf[tlen++] = offset;
+  tbuf[tlen++] = len - 1;  // read count is 0 based
+
+  ret = bic_ipmb_wrapper(slot_id, NETFN_OEM_1S_REQ, CMD_OEM_1S_MSG_OUT, tbuf,
+    tlen, rbuf, &rlen);
+  if (ret) {
+    return -1;
+  }
+
+  if (rlen < BLOCK_RESP_HDR_LEN + len) {
+    return -1;
+  }
+
+  memcpy(buf, &rbuf[BLOCK_RESP_HDR_LEN], len);
+  return 0;
+}
+
 int
 util_check_me_status(uint8_t slot_id) {
 #define MAX_CMD_RETRY 2
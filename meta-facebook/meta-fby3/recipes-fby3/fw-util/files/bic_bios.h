@@ -14,6 +14,9 @@ class BiosComponent : public Component {
   public:
     BiosComponent(std::string fru, std::string comp, uint8_t _slot_id, uint8_t _fw_comp)
       : Component(fru, comp), slot_id(_slot_id), fw_comp(_fw_comp), server(_slot_id, fru) {}
+    std::vector<std::string> update_resources() override {
+      return server.update_resources();
+    }
     int update(std::string image) override;
     int update(int fd, bool force) override;
     int fupdate(std::string image) override;
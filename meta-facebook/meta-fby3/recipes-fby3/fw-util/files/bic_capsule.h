@@ -17,6 +17,9 @@ class CapsuleComponent : public Component {
   public:
     CapsuleComponent(string fru, string comp, uint8_t _slot_id, uint8_t _fw_comp)
       : Component(fru, comp), slot_id(_slot_id), fw_comp(_fw_comp), server(_slot_id, fru) {}
+    std::vector<std::string> update_resources() override {
+      return server.update_resources();
+    }
     int update(string image);
     int fupdate(string image);
     int print_version();
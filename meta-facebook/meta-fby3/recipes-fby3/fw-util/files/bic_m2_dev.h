@@ -19,6 +19,9 @@ class M2DevComponent : public Component {
   public:
     M2DevComponent(string fru, string comp, uint8_t _slot_id, string _name, uint8_t _fw_comp)
       : Component(fru, comp), slot_id(_slot_id), fw_comp(_fw_comp), name(_name), server(_slot_id, fru), expansion(_slot_id, fru, _name, _fw_comp) {}
+    std::vector<std::string> update_resources() override {
+      return server.update_resources();
+    }
     int update_internal(string image, bool force);
     int fupdate(string image);
     int update(string image);
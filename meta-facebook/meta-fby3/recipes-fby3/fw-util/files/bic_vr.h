@@ -14,6 +14,9 @@ class VrComponent : public Component {
   public:
     VrComponent(std::string fru, std::string comp, uint8_t _slot_id, uint8_t _fw_comp)
       : Component(fru, comp), slot_id(_slot_id), fw_comp(_fw_comp), server(_slot_id, fru){}
+    std::vector<std::string> update_resources() override {
+      return server.update_resources();
+    }
     int print_version();
     int update(std::string image);
     void get_version(json& j);
@@ -30,6 +33,9 @@ class VrExtComponent : public Component {
   public:
     VrExtComponent(std::string fru, std::string comp, uint8_t _slot_id, std::string _name, int8_t _fw_comp)
       : Component(fru, comp), slot_id(_slot_id), fw_comp(_fw_comp), name(_name), server(_slot_id, fru), expansion(_slot_id, fru, _name, _fw_comp) {}
+    std::vector<std::string> update_resources() override {
+      return server.update_resources();
+    }
     int print_version();
     int update(std::string image);
     void get_version(json& j);
@@ -35,6 +35,10 @@ class BmcCpldComponent : public Component {
     int update(string image);
     int fupdate(string image);
     void get_version(json& j);
+    // the CPLD is programmed from the BMC side, over its own bus
+    std::vector<std::string> update_resources() override {
+      return {"fru:" + fru(), "i2c:" + std::to_string(bus)};
+    }
 };
 
 #endif
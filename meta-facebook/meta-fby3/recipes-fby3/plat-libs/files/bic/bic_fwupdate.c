@@ -28,6 +28,8 @@
 #include <fcntl.h>
 #include <syslog.h>
 #include <errno.h>
+#include <time.h>
+#include <pthread.h>
 #include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -63,6 +65,60 @@
 
 #define IPMB_BRIDGE_OVERHEAD 9
 
+// bootloader ACK/NAK of the TI serial boot protocol
+#define BIC_UPDATE_ACK 0xCC
+#define BIC_UPDATE_NAK 0x33
+
+// how long the BIC may take to acknowledge each phase
+#define BIC_ACK_TIMEOUT_MS        1000
+#define BIC_ERASE_ACK_TIMEOUT_MS  5000
+// the run command used to follow the last block after a fixed 500 ms, the
+// status poll never waits longer than that
+#define BIC_PROGRAM_FALLBACK_MS   500
+#define BIC_POLL_MAX_INTERVAL_MS  16
+#define BIC_STATUS_POLL_MAX_MS    128
+
+// image chunks are read and checksummed ahead of the transfer
+#define BIC_FW_PREFETCH_DEPTH     4
+#define BIC_FW_MIN_CHUNK          32
+#define BIC_FW_CHUNK_RETRY        3
+#define BIC_FW_GROW_AFTER         16
+
+enum {
+  BIC_XFER_OK    = 0,
+  BIC_XFER_RETRY = 1,
+};
+
+typedef struct {
+  uint8_t data[256];
+  uint16_t len;
+  uint8_t cksum;
+} bic_fw_block_t;
+
+// progress of one BIC image transfer
+typedef struct {
+  uint32_t total_bytes;
+  uint32_t sent_bytes;
+  uint32_t chunks;
+  uint32_t retries;
+  uint16_t chunk_size;
+  uint32_t elapsed_ms;
+  uint32_t bytes_per_sec;
+} bic_fw_xfer_stats_t;
+
+typedef struct {
+  int fd;
+  uint16_t block_size;
+  bic_fw_block_t blocks[BIC_FW_PREFETCH_DEPTH];
+  int head;
+  int count;
+  bool eof;
+  bool error;
+  bool stop;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+} bic_fw_prefetch_t;
+
 enum {
   FEXP_BIC_I2C_WRITE   = 0x20,
   FEXP_BIC_I2C_READ    = 0x21,
@@ -117,6 +173,30 @@ get_checksum(uint8_t *buf, uint8_t len) {
   return result;
 }
 
+static long long
+get_time_ms(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void
+xfer_stats_update(bic_fw_xfer_stats_t *stats, uint32_t sent, uint32_t retried,
+                  uint16_t chunk_size, long long start_ms) {
+  uint32_t elapsed;
+
+  stats->sent_bytes += sent;
+  stats->chunks += (sent > 0) ? 1 : 0;
+  stats->retries += retried;
+  stats->chunk_size = chunk_size;
+  elapsed = (uint32_t)(get_time_ms() - start_ms);
+  stats->elapsed_ms = elapsed;
+  if ( elapsed > 0 ) {
+    stats->bytes_per_sec = (uint32_t)((uint64_t)stats->sent_bytes * 1000 / elapsed);
+  }
+}
+
 static int
 enable_bic_update_with_param(uint8_t slot_id, uint8_t intf) {
   uint8_t tbuf[16] = {0x00};
@@ -307,58 +387,79 @@ send_start_bic_update(uint8_t slot_id, int i2cfd, int size, uint8_t intf) {
   return ret;
 }
 
+// Poll the ACK of the last bootloader command until the BIC answers instead
+// of sleeping for a worst-case delay. Returns BIC_XFER_RETRY on NAK, so the
+// caller can resend the command.
 static int
-read_bic_update_ack_status(uint8_t slot_id, int i2cfd, uint8_t intf) {
+poll_bic_update_ack(uint8_t slot_id, int i2cfd, uint8_t intf, int timeout_ms) {
   uint8_t tbuf[32] = {0x00};
   uint8_t rbuf[32] = {0x00};
   uint8_t tlen = 0;
   uint8_t rlen = 0;
+  int interval = 1;
+  long long deadline = get_time_ms() + timeout_ms;
   int ret = -1;
 
-  if ( intf == NONE_INTF ) {
-    uint8_t exp_data[2] = {0x00, 0xCC};
-    tlen = 0;
-    rlen = 2;
-    msleep(10);
-    ret = i2c_io(i2cfd, tbuf, tlen, rbuf, rlen);
-    if ( ret || (memcmp(rbuf, exp_data, sizeof(exp_data)) != 0) ) {
-      printf("%s() response %x:%x, ret=%d\n", __func__, rbuf[0], rbuf[1], ret);
-      ret = -1;
-    }
-  } else if (intf == RREXP1_BIC_I2C_READ || intf == RREXP2_BIC_I2C_READ) {
-    memcpy(tbuf, (uint8_t *)&IANA_ID, 3);
-    tbuf[3] = REXP_BIC_INTF;
-    tbuf[4] = NETFN_OEM_1S_REQ << 2;
-    tbuf[5] = CMD_OEM_1S_MSG_OUT;
-    memcpy(&tbuf[6], (uint8_t *)&IANA_ID, 3);
-    tbuf[9] = intf;
-    tlen = 12;
-    rlen = 0;
+  while (1) {
+    if ( intf == NONE_INTF ) {
+      tlen = 0;
+      rlen = 2;
+      memset(rbuf, 0, sizeof(rbuf));
+      ret = i2c_io(i2cfd, tbuf, tlen, rbuf, rlen);
+      if ( ret == 0 && rbuf[0] == 0x00 && rbuf[1] == BIC_UPDATE_ACK ) {
+        return BIC_XFER_OK;
+      }
+      if ( ret == 0 && rbuf[0] == 0x00 && rbuf[1] == BIC_UPDATE_NAK ) {
+        return BIC_XFER_RETRY;
+      }
+      // 0x00 0x00 means the bootloader is still busy
+    } else if (intf == RREXP1_BIC_I2C_READ || intf == RREXP2_BIC_I2C_READ) {
+      memcpy(tbuf, (uint8_t *)&IANA_ID, 3);
+      tbuf[3] = REXP_BIC_INTF;
+      tbuf[4] = NETFN_OEM_1S_REQ << 2;
+      tbuf[5] = CMD_OEM_1S_MSG_OUT;
+      memcpy(&tbuf[6], (uint8_t *)&IANA_ID, 3);
+      tbuf[9] = intf;
+      tlen = 12;
+      rlen = 0;
 
-    ret = bic_ipmb_wrapper(slot_id, NETFN_OEM_1S_REQ, CMD_OEM_1S_MSG_OUT, tbuf, tlen, rbuf, &rlen);
-    if ( rlen <= 0 ) {
-      printf("%s() invalid lenth %d", __func__, rlen);
-      ret = -1;
-    }
-  } else {
-    memcpy(tbuf, (uint8_t *)&IANA_ID, 3);
-    tbuf[3] = intf;
-    tlen = 6;
-    rlen = 0;
+      ret = bic_ipmb_wrapper(slot_id, NETFN_OEM_1S_REQ, CMD_OEM_1S_MSG_OUT, tbuf, tlen, rbuf, &rlen);
+      if ( ret == 0 && rlen > 0 ) {
+        return BIC_XFER_OK;
+      }
+    } else {
+      memcpy(tbuf, (uint8_t *)&IANA_ID, 3);
+      tbuf[3] = intf;
+      tlen = 6;
+      rlen = 0;
 #ifdef DEBUG
-    print_data(__func__, NETFN_OEM_1S_REQ, CMD_OEM_1S_MSG_OUT, tbuf, tlen);
+      print_data(__func__, NETFN_OEM_1S_REQ, CMD_OEM_1S_MSG_OUT, tbuf, tlen);
 #endif
-    ret = bic_ipmb_wrapper(slot_id, NETFN_OEM_1S_REQ, CMD_OEM_1S_MSG_OUT, tbuf, tlen, rbuf, &rlen);
-    if ( rlen <= 0 ) {
-      printf("%s() invalid lenth %d", __func__, rlen);
-      ret = -1;
-    }
+      ret = bic_ipmb_wrapper(slot_id, NETFN_OEM_1S_REQ, CMD_OEM_1S_MSG_OUT, tbuf, tlen, rbuf, &rlen);
 #ifdef DEBUG
-    print_data(__func__, NETFN_OEM_1S_REQ, CMD_OEM_1S_MSG_OUT, rbuf, rlen);
+      print_data(__func__, NETFN_OEM_1S_REQ, CMD_OEM_1S_MSG_OUT, rbuf, rlen);
 #endif
+      if ( ret == 0 && rlen > 0 ) {
+        return BIC_XFER_OK;
+      }
+    }
+
+    if ( get_time_ms() >= deadline ) {
+      break;
+    }
+    msleep(interval);
+    if ( interval < BIC_POLL_MAX_INTERVAL_MS ) {
+      interval <<= 1;
+    }
   }
 
-  return ret;
+  printf("%s() response %x:%x, ret=%d, rlen=%d\n", __func__, rbuf[0], rbuf[1], ret, rlen);
+  return -1;
+}
+
+static int
+read_bic_update_ack_status(uint8_t slot_id, int i2cfd, uint8_t intf, int timeout_ms) {
+  return (poll_bic_update_ack(slot_id, i2cfd, intf, timeout_ms) == BIC_XFER_OK) ? 0 : -1;
 }
 
 static int
@@ -426,8 +527,9 @@ send_complete_signal(uint8_t slot_id, int i2cfd, uint8_t intf) {
   return ret;
 }
 
+// verbose is off while polling, a busy bootloader fails the status read
 static int
-read_bic_update_status(int i2cfd) {
+read_bic_update_status(int i2cfd, bool verbose) {
   const uint8_t exp_data[5] = {0x00, 0xCC, 0x03, 0x40, 0x40};
   uint8_t tbuf[16] = {0};
   uint8_t rbuf[16] = {0};
@@ -442,7 +544,9 @@ read_bic_update_status(int i2cfd) {
   rlen = 0;
   ret = i2c_io(i2cfd, tbuf, tlen, rbuf, rlen);
   if ( ret < 0 ) {
-    printf("%s() failed to get status\n", __func__);
+    if ( verbose ) {
+      printf("%s() failed to get status\n", __func__);
+    }
     goto exit;
   }
 
@@ -450,12 +554,17 @@ read_bic_update_status(int i2cfd) {
   rlen = 5;
   ret = i2c_io(i2cfd, tbuf, tlen, rbuf, rlen);
   if ( ret < 0 ) {
-    printf("%s() failed to get status ack\n", __func__);
+    if ( verbose ) {
+      printf("%s() failed to get status ack\n", __func__);
+    }
     goto exit;
   }
 
   if ( memcmp(rbuf, exp_data, sizeof(exp_data)) != 0 ) {
-    printf("%s() status: %x:%x:%x:%x:%x\n", __func__, rbuf[0], rbuf[1], rbuf[2], rbuf[3], rbuf[4]);
+    if ( verbose ) {
+      printf("%s() status: %x:%x:%x:%x:%x\n", __func__, rbuf[0], rbuf[1], rbuf[2], rbuf[3], rbuf[4]);
+    }
+    ret = -1;
     goto exit;
   }
 
@@ -464,7 +573,9 @@ read_bic_update_status(int i2cfd) {
   rlen = 0;
   ret = i2c_io(i2cfd, tbuf, tlen, rbuf, rlen);
   if ( ret < 0) {
-    printf("%s() failed to send an ack\n", __func__);
+    if ( verbose ) {
+      printf("%s() failed to send an ack\n", __func__);
+    }
     goto exit;
   }
 
@@ -473,7 +584,7 @@ exit:
 }
 
 static int
-send_bic_image_data(uint8_t slot_id, int i2cfd, uint16_t len, uint8_t *buf, uint8_t intf) {
+send_bic_image_data(uint8_t slot_id, int i2cfd, uint16_t len, uint8_t *buf, uint8_t cksum, uint8_t intf) {
   uint8_t data[3] = {0x00};
   uint8_t tbuf[256] = {0x00};
   uint8_t rbuf[16]  = {0x00};
@@ -482,7 +593,7 @@ send_bic_image_data(uint8_t slot_id, int i2cfd, uint16_t len, uint8_t *buf, uint
   int ret = -1;
 
   data[0] = len + 3;
-  data[1] = get_checksum(buf, len) + BIC_CMD_DATA;
+  data[1] = cksum + BIC_CMD_DATA;
   data[2] = BIC_CMD_DATA;
 
   if ( intf == NONE_INTF ) {
@@ -540,14 +651,106 @@ send_bic_image_data(uint8_t slot_id, int i2cfd, uint16_t len, uint8_t *buf, uint
   return ret;
 }
 
+// Reader thread: fill the prefetch ring with image blocks and their checksums
+// while the previous blocks are on the wire.
+static void *
+bic_fw_prefetch_thread(void *arg) {
+  bic_fw_prefetch_t *pf = (bic_fw_prefetch_t *)arg;
+  bic_fw_block_t *blk;
+  int slot;
+  int len;
+
+  while (1) {
+    pthread_mutex_lock(&pf->lock);
+    while ( pf->count == BIC_FW_PREFETCH_DEPTH && !pf->stop ) {
+      pthread_cond_wait(&pf->cond, &pf->lock);
+    }
+    if ( pf->stop ) {
+      pthread_mutex_unlock(&pf->lock);
+      break;
+    }
+    slot = (pf->head + pf->count) % BIC_FW_PREFETCH_DEPTH;
+    pthread_mutex_unlock(&pf->lock);
+
+    // the slot isn't visible to the sender until count is bumped
+    blk = &pf->blocks[slot];
+    blk->len = 0;
+    while ( blk->len < pf->block_size ) {
+      len = read(pf->fd, &blk->data[blk->len], pf->block_size - blk->len);
+      if ( len < 0 && errno == EINTR ) {
+        continue;
+      }
+      if ( len <= 0 ) {
+        break;
+      }
+      blk->len += len;
+    }
+    if ( blk->len > 0 ) {
+      blk->cksum = get_checksum(blk->data, blk->len);
+    }
+
+    pthread_mutex_lock(&pf->lock);
+    if ( len < 0 ) {
+      pf->error = true;
+    }
+    if ( blk->len > 0 ) {
+      pf->count++;
+    }
+    if ( blk->len < pf->block_size ) {
+      pf->eof = true;
+    }
+    pthread_cond_broadcast(&pf->cond);
+    pthread_mutex_unlock(&pf->lock);
+    if ( pf->eof || pf->error ) {
+      break;
+    }
+  }
+
+  return NULL;
+}
+
+static int
+send_bic_image_chunk(uint8_t slot_id, int i2cfd, uint8_t *buf, uint16_t len, uint8_t cksum, uint8_t intf) {
+  int ret;
+
+  if ( intf != NONE_INTF ) {
+    // The bridge BIC fails the command when its write didn't go through,
+    // but also on an IPMB timeout after the data may have reached the
+    // bootloader. Data is never resent on this path, the update fails.
+    ret = send_bic_image_data(slot_id, i2cfd, len, buf, cksum, intf);
+    return (ret < 0) ? -1 : BIC_XFER_OK;
+  }
+
+  ret = read_bic_update_status(i2cfd, true);
+  if ( ret < 0 ) {
+    return ret;
+  }
+
+  ret = send_bic_image_data(slot_id, i2cfd, len, buf, cksum, NONE_INTF);
+  if ( ret < 0 ) {
+    return BIC_XFER_RETRY;
+  }
+
+  return poll_bic_update_ack(slot_id, i2cfd, NONE_INTF, BIC_ACK_TIMEOUT_MS);
+}
+
 static int
 send_bic_runtime_image_data(uint8_t slot_id, int fd, int i2cfd, int file_size, uint8_t bytes_per_read, uint8_t intf) {
-  uint8_t buf[256] = {0};
-  uint8_t read_bytes = 0;
+  bic_fw_prefetch_t pf;
+  bic_fw_block_t *blk;
+  pthread_t tid;
+  uint16_t chunk = bytes_per_read & ~0x3;
+  uint16_t len, off;
+  uint8_t cksum;
   int ret = -1;
   int dsize = 0;
   int last_offset = 0;
-  int offset = 0;;
+  int offset = 0;
+  int retry = 0;
+  int good_chunks = 0;
+  bic_fw_xfer_stats_t stats = {0};
+  long long start_ms;
+  bool done = false;
 
   dsize = file_size / 20;
 
@@ -557,48 +760,116 @@ send_bic_runtime_image_data(uint8_t slot_id, int fd, int i2cfd, int file_size, u
     return -1;
   }
 
-  while (1) {
-    memset(buf, 0, sizeof(buf));
-    read_bytes = read(fd, buf, bytes_per_read);
-    if ( read_bytes <= 0 ) {
+  memset(&pf, 0, sizeof(pf));
+  pf.fd = fd;
+  pf.block_size = bytes_per_read;
+  pthread_mutex_init(&pf.lock, NULL);
+  pthread_cond_init(&pf.cond, NULL);
+  if ( pthread_create(&tid, NULL, bic_fw_prefetch_thread, &pf) != 0 ) {
+    syslog(LOG_WARNING, "%s() Cannot create the prefetch thread", __func__);
+    return -1;
+  }
+
+  stats.total_bytes = file_size;
+  stats.chunk_size = chunk;
+  start_ms = get_time_ms();
+  xfer_stats_update(&stats, 0, 0, chunk, start_ms);
+
+  while ( !done ) {
+    pthread_mutex_lock(&pf.lock);
+    while ( pf.count == 0 && !pf.eof && !pf.error ) {
+      pthread_cond_wait(&pf.cond, &pf.lock);
+    }
+    if ( pf.count == 0 ) {
+      ret = pf.error ? -1 : ret;
+      pthread_mutex_unlock(&pf.lock);
       //no more bytes can be read
       break;
     }
-
-    offset += read_bytes;
-    if ( (last_offset + dsize) <= offset) {
-      printf("updated bic: %d %%\n", (offset/dsize)*5);
-      fflush(stdout);
-      last_offset += dsize;
-    }
-
-    if ( intf != NONE_INTF ) {
-      ret = send_bic_image_data(slot_id, i2cfd, read_bytes, buf, intf);
-      if ( ret < 0 ) {
-        return ret;
+    blk = &pf.blocks[pf.head];
+    pthread_mutex_unlock(&pf.lock);
+
+    // a block goes out whole unless NAKs shrank the chunk size
+    for ( off = 0; off < blk->len; ) {
+      len = (blk->len - off < chunk) ? (blk->len - off) : chunk;
+      cksum = (off == 0 && len == blk->len) ? blk->cksum : get_checksum(&blk->data[off], len);
+      ret = send_bic_image_chunk(slot_id, i2cfd, &blk->data[off], len, cksum, intf);
+      if ( ret == BIC_XFER_RETRY && retry < BIC_FW_CHUNK_RETRY ) {
+        retry++;
+        good_chunks = 0;
+        if ( chunk / 2 >= BIC_FW_MIN_CHUNK ) {
+          chunk = (chunk / 2) & ~0x3;
+        }
+        syslog(LOG_WARNING, "%s() slot%d offset %d rejected, retry with %d bytes", __func__, slot_id, offset, chunk);
+        xfer_stats_update(&stats, 0, 1, chunk, start_ms);
+        continue;
       }
-    } else {
-
-      ret = read_bic_update_status(i2cfd);
-      if ( ret < 0 ) {
-        return ret;
+      if ( ret != BIC_XFER_OK ) {
+        ret = -1;
+        done = true;
+        break;
       }
 
-      ret = send_bic_image_data(slot_id, i2cfd, read_bytes, buf, NONE_INTF);
-      if ( ret < 0 ) {
-        return ret;
+      retry = 0;
+      off += len;
+      offset += len;
+      if ( ++good_chunks >= BIC_FW_GROW_AFTER && chunk < (bytes_per_read & ~0x3) ) {
+        chunk = ((chunk * 2) < bytes_per_read) ? (chunk * 2) : (bytes_per_read & ~0x3);
+        good_chunks = 0;
       }
+      xfer_stats_update(&stats, len, 0, chunk, start_ms);
 
-      ret = read_bic_update_ack_status(slot_id, i2cfd, NONE_INTF);
-      if ( ret < 0 ) {
-        return ret;
+      if ( dsize > 0 && (last_offset + dsize) <= offset ) {
+        printf("updated bic: %d %%\n", (offset/dsize)*5);
+        fflush(stdout);
+        last_offset += dsize;
       }
     }
+
+    pthread_mutex_lock(&pf.lock);
+    pf.head = (pf.head + 1) % BIC_FW_PREFETCH_DEPTH;
+    pf.count--;
+    pthread_cond_broadcast(&pf.cond);
+    pthread_mutex_unlock(&pf.lock);
+  }
+
+  pthread_mutex_lock(&pf.lock);
+  pf.stop = true;
+  pthread_cond_broadcast(&pf.cond);
+  pthread_mutex_unlock(&pf.lock);
+  pthread_join(tid, NULL);
+  pthread_cond_destroy(&pf.cond);
+  pthread_mutex_destroy(&pf.lock);
+
+  if ( ret == 0 ) {
+    printf("sent %u bytes in %u.%03u s, %u B/s, %u retries\n", stats.sent_bytes,
+           stats.elapsed_ms / 1000, stats.elapsed_ms % 1000, stats.bytes_per_sec, stats.retries);
   }
 
   return ret;
 }
 
+// Wait until the bootloader reports that the last block is programmed.
+// The bootloader doesn't answer while it programs, so poll quietly with a
+// growing interval. A status that isn't ready by timeout_ms is not an
+// error: the old fixed delay has passed by then, so carry on as it did.
+static void
+wait_bic_update_status(uint8_t slot_id, int i2cfd, int timeout_ms) {
+  long long deadline = get_time_ms() + timeout_ms;
+  int interval = 1;
+
+  while ( read_bic_update_status(i2cfd, false) < 0 ) {
+    if ( get_time_ms() >= deadline ) {
+      syslog(LOG_WARNING, "%s() slot%d status not ready after %d ms, continue", __func__, slot_id, timeout_ms);
+      return;
+    }
+    msleep(interval);
+    if ( interval < BIC_STATUS_POLL_MAX_MS ) {
+      interval <<= 1;
+    }
+  }
+}
+
 static int
 update_bic(uint8_t slot_id, int fd, int file_size) {
   int ret = -1;
@@ -682,10 +953,8 @@ update_bic(uint8_t slot_id, int fd, int file_size) {
     goto exit;
   }
 
-  msleep(600);
-
-  //step7 - check the response
-  ret = read_bic_update_ack_status(slot_id, i2cfd, NONE_INTF);
+  //step7 - check the response, the BIC erases the flash before acknowledging
+  ret = read_bic_update_ack_status(slot_id, i2cfd, NONE_INTF, BIC_ERASE_ACK_TIMEOUT_MS);
   if ( ret < 0 ) {
     printf("Failed to get the response of the command\n");
     goto exit;
@@ -698,7 +967,8 @@ update_bic(uint8_t slot_id, int fd, int file_size) {
     goto exit;
   }
 
-  msleep(500);
+  //wait for the last block to be programmed
+  wait_bic_update_status(slot_id, i2cfd, BIC_PROGRAM_FALLBACK_MS);
 
   //step9 - run the new image
   ret = send_complete_signal(slot_id, i2cfd, NONE_INTF);
@@ -707,7 +977,7 @@ update_bic(uint8_t slot_id, int fd, int file_size) {
   }
 
   //step10 - check the response
-  ret = read_bic_update_ack_status(slot_id, i2cfd, NONE_INTF);
+  ret = read_bic_update_ack_status(slot_id, i2cfd, NONE_INTF, BIC_ACK_TIMEOUT_MS);
   if ( ret < 0 ) {
     printf("Failed to get the response of the command\n");
     goto exit;
@@ -840,11 +1110,8 @@ update_remote_bic(uint8_t slot_id, uint8_t intf, int fd, int file_size) {
     goto exit;
   }
 
-  //wait for it ready
-  msleep(500);
-
   //step4 - check the response of the signal
-  ret = read_bic_update_ack_status(slot_id, 0, bic_read);
+  ret = read_bic_update_ack_status(slot_id, 0, bic_read, BIC_ERASE_ACK_TIMEOUT_MS);
   if ( ret < 0 ) {
     syslog(LOG_WARNING, "Check remote bic update status, Fail, ret = %d\n", ret);
     goto exit;
@@ -865,7 +1132,7 @@ update_remote_bic(uint8_t slot_id, uint8_t intf, int fd, int file_size) {
   }
 
   //step7 - check the response of the signal
-  ret = read_bic_update_ack_status(slot_id, 0, bic_read);
+  ret = read_bic_update_ack_status(slot_id, 0, bic_read, BIC_ACK_TIMEOUT_MS);
   if ( ret < 0 ) {
     syslog(LOG_WARNING, "Get the bic status, Fail, ret = %d\n", ret);
   }
@@ -106,6 +106,70 @@ bic_get_sensor_reading(uint8_t slot_id, uint8_t sensor_num, ipmi_sensor_reading_
   return bic_ipmb_send(slot_id, NETFN_SENSOR_REQ, CMD_SENSOR_GET_SENSOR_READING, &sensor_num, 1, (uint8_t *)sensor, &rlen, intf);
 }
 
+// OEM - Get All Sensor Reading
+// Netfn: 0x38, Cmd: 0x6C
+// Request:  IANA ID[3], first sensor number
+// Response: IANA ID[3], more pages, next sensor number, bic_snr_snapshot_rec_t[]
+// Only BIC firmware which implements the command may be sent it, the caller
+// is expected to check the BIC version first. A reply which isn't shaped
+// like a snapshot is rejected rather than parsed as sensor data.
+int
+bic_get_all_sensor_reading(uint8_t slot_id, bic_snr_snapshot_t *snap, uint8_t intf) {
+  uint8_t tbuf[4] = {0};
+  uint8_t rbuf[MAX_IPMB_RES_LEN] = {0};
+  uint8_t rlen = 0;
+  uint8_t next_snr = 0;
+  bic_snr_snapshot_rec_t *rec = NULL;
+  int i, cnt;
+  int last;
+  int ret;
+
+  memset(snap, 0, sizeof(*snap));
+  memcpy(tbuf, (uint8_t *)&IANA_ID, 3);
+
+  while (1) {
+    tbuf[3] = next_snr;
+    ret = bic_ipmb_send(slot_id, NETFN_OEM_1S_REQ, BIC_CMD_OEM_GET_ALL_SNR_READING, tbuf, sizeof(tbuf), rbuf, &rlen, intf);
+    if ( ret < 0 || rlen < 5 ) {
+      return BIC_STATUS_FAILURE;
+    }
+
+    if ( memcmp(rbuf, (uint8_t *)&IANA_ID, 3) != 0 || rbuf[3] > 1 ||
+         ((rlen - 5) % sizeof(bic_snr_snapshot_rec_t)) != 0 ) {
+      syslog(LOG_WARNING, "%s() slot%d intf 0x%x: malformed response, rlen %d", __func__, slot_id, intf, rlen);
+      return BIC_STATUS_FAILURE;
+    }
+
+    cnt = (rlen - 5) / sizeof(bic_snr_snapshot_rec_t);
+    rec = (bic_snr_snapshot_rec_t *)&rbuf[5];
+    last = (int)next_snr - 1;
+    for (i = 0; i < cnt; i++) {
+      // records come in ascending sensor number order, starting at next_snr
+      if ( (int)rec[i].snr_num <= last ) {
+        syslog(LOG_WARNING, "%s() slot%d intf 0x%x: unordered sensor 0x%x", __func__, slot_id, intf, rec[i].snr_num);
+        return BIC_STATUS_FAILURE;
+      }
+      last = rec[i].snr_num;
+      snap->count++;
+      snap->present[rec[i].snr_num] = 1;
+      snap->reading[rec[i].snr_num] = rec[i].reading;
+    }
+
+    if ( rbuf[3] == 0 ) {
+      break;
+    }
+
+    // the next page must move forward, otherwise we would loop forever
+    if ( (int)rbuf[4] <= last || rbuf[4] <= next_snr ) {
+      syslog(LOG_WARNING, "%s() slot%d intf 0x%x: invalid next sensor 0x%x", __func__, slot_id, intf, rbuf[4]);
+      return BIC_STATUS_FAILURE;
+    }
+    next_snr = rbuf[4];
+  }
+
+  return BIC_STATUS_SUCCESS;
+}
+
 // APP - Get Device ID
 // Netfn: 0x06, Cmd: 0x01
 int
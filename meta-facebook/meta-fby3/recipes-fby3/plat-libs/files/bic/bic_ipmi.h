@@ -59,6 +59,21 @@ enum {
 
 #define MAX_READ_RETRY 5
 
+#define BIC_MAX_SNR_NUM 0xFF
+
+// One sensor record of the Get All Sensor Reading response
+typedef struct {
+  uint8_t snr_num;
+  ipmi_sensor_reading_t reading;
+} __attribute__((packed)) bic_snr_snapshot_rec_t;
+
+// Readings of every sensor a BIC reported in one snapshot, indexed by sensor number
+typedef struct {
+  uint16_t count;
+  uint8_t present[BIC_MAX_SNR_NUM + 1];
+  ipmi_sensor_reading_t reading[BIC_MAX_SNR_NUM + 1];
+} bic_snr_snapshot_t;
+
 int bic_get_dev_id(uint8_t slot_id, ipmi_dev_id_t *dev_id, uint8_t intf);
 int bic_get_self_test_result(uint8_t slot_id, uint8_t *self_test_result, uint8_t intf);
 int bic_get_fruid_info(uint8_t slot_id, uint8_t fru_id, ipmi_fruid_info_t *info, uint8_t intf);
@@ -78,6 +93,7 @@ int bic_get_vr_ver(uint8_t slot_id, uint8_t intf, uint8_t bus, uint8_t addr, cha
 int bic_get_vr_ver_cache(uint8_t slot_id, uint8_t intf, uint8_t bus, uint8_t addr, char *ver_str);
 int bic_get_exp_cpld_ver(uint8_t slot_id, uint8_t comp, uint8_t *ver, uint8_t bus, uint8_t addr, uint8_t intf);
 int bic_get_sensor_reading(uint8_t slot_id, uint8_t sensor_num, ipmi_sensor_reading_t *sensor, uint8_t intf);
+int bic_get_all_sensor_reading(uint8_t slot_id, bic_snr_snapshot_t *snap, uint8_t intf);
 int bic_is_m2_exp_prsnt(uint8_t slot_id);
 int bic_is_m2_exp_prsnt_cache(uint8_t slot_id);
 int me_recovery(uint8_t slot_id, uint8_t command);
@@ -50,6 +50,7 @@ enum {
   BIC_CMD_OEM_BIC_VR_MONITOR          = 0x69,
   BIC_CMD_OEM_GET_DBG_UART            = 0x6A,
   BIC_CMD_OEM_GET_DBG_PRSNT           = 0x6B,
+  BIC_CMD_OEM_GET_ALL_SNR_READING     = 0x6C,
   BIC_CMD_OEM_INA233_ALERT_CTRL       = 0x71,
   BIC_CMD_OEM_GET_BOARD_ID            = 0xA0,
   BIC_CMD_OEM_GET_MB_INDEX            = 0xF0,
@@ -2,6 +2,8 @@
 #include <math.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <syslog.h>
@@ -1495,10 +1497,16 @@ pal_get_tach_cnt(void) {
   return UNKNOWN_FAN_CNT;
 }
 
+static void
+frontIO_correction_init(void) {
+  sensor_correction_init("/etc/sensor-frontIO-correction.json");
+}
+
 static void
 apply_frontIO_correction(uint8_t fru, uint8_t snr_num, float *value, uint8_t bmc_location) {
+  // sensor-util reads several FRUs at once
+  static pthread_once_t inited = PTHREAD_ONCE_INIT;
   int pwm = 0;
-  static bool inited = false;
   float pwm_val = 0;
   float avg_pwm = 0;
   uint8_t cnt = 0;
@@ -1514,10 +1522,7 @@ apply_frontIO_correction(uint8_t fru, uint8_t snr_num, float *value, uint8_t bmc
 
   if ( cnt > 0 ) {
     avg_pwm = avg_pwm / (float)cnt;
-    if ( inited == false ) {
-      inited = true;
-      sensor_correction_init("/etc/sensor-frontIO-correction.json");
-    }
+    pthread_once(&inited, frontIO_correction_init);
     sensor_correction_apply(fru, snr_num, avg_pwm, value);
   } else {
     syslog(LOG_WARNING, "Failed to apply frontIO correction");
@@ -2114,6 +2119,312 @@ skip_bic_sensor_list(uint8_t fru, uint8_t sensor_num, const uint8_t bmc_location
   return PAL_EOK;
 }
 
+// A BIC sensor snapshot is fetched with one Get All Sensor Reading request per
+// (node, interface) and then serves every sensor read of the same poll cycle.
+#define BIC_SNR_SNAPSHOT_TTL_MS    1000
+// How often the BIC version is checked again, and how long to stay on
+// per-sensor reads after the bulk request failed.
+#define BIC_SNR_SNAPSHOT_PROBE_MS  (300 * 1000)
+// No BIC release of this type implements Get All Sensor Reading
+#define BIC_SNR_SNAPSHOT_VER_NONE  0xFFFF
+
+enum {
+  SNAPSHOT_INTF_SB = 0,
+  SNAPSHOT_INTF_1OU,
+  SNAPSHOT_INTF_2OU,
+  SNAPSHOT_INTF_BB,
+  SNAPSHOT_INTF_EXP,
+  SNAPSHOT_INTF_CNT,
+};
+
+// First firmware version (major << 8 | minor) of each BIC type which
+// implements Get All Sensor Reading. Older BICs are never sent the request,
+// since its opcode may mean something else to them. Types left at NONE are
+// read per sensor without ever probing their version.
+static const uint16_t bic_snr_snapshot_min_ver[SNAPSHOT_INTF_CNT] = {
+  [SNAPSHOT_INTF_SB]  = BIC_SNR_SNAPSHOT_VER_NONE,
+  [SNAPSHOT_INTF_1OU] = BIC_SNR_SNAPSHOT_VER_NONE,
+  [SNAPSHOT_INTF_2OU] = BIC_SNR_SNAPSHOT_VER_NONE,
+  [SNAPSHOT_INTF_BB]  = BIC_SNR_SNAPSHOT_VER_NONE,
+  [SNAPSHOT_INTF_EXP] = BIC_SNR_SNAPSHOT_VER_NONE,
+};
+
+enum {
+  SNR_FMT_NA = 0,
+  SNR_FMT_UNSIGNED,
+  SNR_FMT_1S_COMP,
+  SNR_FMT_2S_COMP,
+};
+
+// Linearization coefficients of one sensor table, y = (m * x + b) * r
+typedef struct {
+  pthread_mutex_t lock;
+  bool ready;
+  uint8_t fmt[MAX_SENSOR_NUM + 1];
+  float m[MAX_SENSOR_NUM + 1];
+  float b[MAX_SENSOR_NUM + 1];
+  float r[MAX_SENSOR_NUM + 1];
+} bic_snr_coef_t;
+
+typedef struct {
+  pthread_mutex_t lock;
+  bool valid;
+  bool supported;
+  uint16_t bic_ver;
+  long long refresh_ms;
+  long long probe_ms;
+  bic_snr_snapshot_t snap;
+  bool linear[MAX_SENSOR_NUM + 1];
+  float value[MAX_SENSOR_NUM + 1];
+} bic_snr_snapshot_cache_t;
+
+static bic_snr_coef_t g_snr_coef[MAX_NUM_FRUS+MAX_NUM_EXPS];
+static bic_snr_snapshot_cache_t g_snr_snapshot[MAX_NODES+MAX_NUM_EXPS][SNAPSHOT_INTF_CNT];
+static pthread_once_t g_snr_snapshot_once = PTHREAD_ONCE_INIT;
+
+static void
+bic_snr_snapshot_init(void) {
+  int i, j;
+
+  for (i = 0; i < MAX_NODES+MAX_NUM_EXPS; i++) {
+    for (j = 0; j < SNAPSHOT_INTF_CNT; j++) {
+      pthread_mutex_init(&g_snr_snapshot[i][j].lock, NULL);
+    }
+  }
+  for (i = 0; i < MAX_NUM_FRUS+MAX_NUM_EXPS; i++) {
+    pthread_mutex_init(&g_snr_coef[i].lock, NULL);
+  }
+}
+
+static long long
+bic_snr_snapshot_now_ms(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int
+bic_snr_snapshot_intf_idx(uint8_t intf) {
+  switch (intf) {
+    case NONE_INTF:
+      return SNAPSHOT_INTF_SB;
+    case FEXP_BIC_INTF:
+      return SNAPSHOT_INTF_1OU;
+    case REXP_BIC_INTF:
+      return SNAPSHOT_INTF_2OU;
+    case BB_BIC_INTF:
+      return SNAPSHOT_INTF_BB;
+    case RREXP_BIC_INTF1:
+    case RREXP_BIC_INTF2:
+      return SNAPSHOT_INTF_EXP;
+  }
+  return -1;
+}
+
+// Firmware version of the BIC behind intf, as major << 8 | minor
+static int
+bic_snr_snapshot_bic_ver(uint8_t slot, uint8_t intf, uint16_t *ver) {
+  uint8_t comp;
+  uint8_t res[MAX_IPMB_RES_LEN] = {0};
+
+  switch (intf) {
+    case NONE_INTF:
+      comp = FW_BIC;
+      break;
+    case FEXP_BIC_INTF:
+      comp = FW_1OU_BIC;
+      break;
+    case REXP_BIC_INTF:
+      comp = FW_2OU_BIC;
+      break;
+    case BB_BIC_INTF:
+      comp = FW_BB_BIC;
+      break;
+    case RREXP_BIC_INTF1:
+      comp = FW_GPV3_TOP_BIC;
+      break;
+    case RREXP_BIC_INTF2:
+      comp = FW_GPV3_BOT_BIC;
+      break;
+    default:
+      return -1;
+  }
+
+  if ( bic_get_fw_ver(slot, comp, res) != BIC_STATUS_SUCCESS ) {
+    return -1;
+  }
+  *ver = (res[0] << 8) | res[1];
+  return 0;
+}
+
+// Decode the SDR M/B/exponent fields of a sensor table once, so that a whole
+// snapshot can be linearized in a single pass. Called with coef->lock held.
+static void
+bic_snr_coef_init(bic_snr_coef_t *coef, sensor_info_t *sinfo) {
+  sdr_full_t *sdr;
+  int8_t b_exp, r_exp;
+  int i;
+
+  for (i = 0; i <= MAX_SENSOR_NUM; i++) {
+    sdr = &sinfo[i].sdr;
+    coef->fmt[i] = SNR_FMT_NA;
+    coef->m[i] = 1;
+    coef->b[i] = 0;
+    coef->r[i] = 1;
+    // non-linear/non-analog sensors keep going through the per-sensor path
+    if ( sdr->type != 1 ) {
+      continue;
+    }
+
+    switch (sdr->sensor_units1 & 0xC0) {
+      case 0x00:
+        coef->fmt[i] = SNR_FMT_UNSIGNED;
+        break;
+      case 0x40:
+        coef->fmt[i] = SNR_FMT_1S_COMP;
+        break;
+      case 0x80:
+        coef->fmt[i] = SNR_FMT_2S_COMP;
+        break;
+      default:
+        continue;
+    }
+
+    // exponents are 2's complement 4-bit number
+    b_exp = sdr->rb_exp & 0xF;
+    if (b_exp > 7) {
+      b_exp = (~b_exp + 1) & 0xF;
+      b_exp = -b_exp;
+    }
+    r_exp = (sdr->rb_exp >> 4) & 0xF;
+    if (r_exp > 7) {
+      r_exp = (~r_exp + 1) & 0xF;
+      r_exp = -r_exp;
+    }
+
+    coef->m[i] = ((sdr->m_tolerance >> 6) << 8) | sdr->m_val;
+    coef->b[i] = (((sdr->b_accuracy >> 6) << 8) | sdr->b_val) * pow(10, b_exp);
+    coef->r[i] = pow(10, r_exp);
+  }
+  coef->ready = true;
+}
+
+// Called with cache->lock and coef->lock held
+static void
+bic_snr_snapshot_linearize(const bic_snr_coef_t *coef, bic_snr_snapshot_cache_t *cache) {
+  int x[MAX_SENSOR_NUM + 1];
+  uint8_t raw;
+  int i;
+
+  for (i = 0; i <= MAX_SENSOR_NUM; i++) {
+    raw = cache->snap.reading[i].value;
+    switch (coef->fmt[i]) {
+      case SNR_FMT_1S_COMP:
+        x[i] = (raw & 0x80) ? (0-(~raw)) : raw;
+        break;
+      case SNR_FMT_2S_COMP:
+        x[i] = (int8_t)raw;
+        break;
+      default:
+        x[i] = raw;
+        break;
+    }
+  }
+
+  // branch-free over the whole table so the compiler can vectorize it
+  for (i = 0; i <= MAX_SENSOR_NUM; i++) {
+    cache->value[i] = (coef->m[i] * x[i] + coef->b[i]) * coef->r[i];
+    cache->linear[i] = (coef->fmt[i] != SNR_FMT_NA);
+  }
+}
+
+// Get a BIC sensor reading from the snapshot of its (node, interface), refreshing
+// the snapshot when it's stale. It falls back to a per-sensor read if the BIC
+// firmware doesn't provide snapshots, or didn't report this sensor in one.
+// *linearized is set when *value already holds the converted reading.
+static int
+pal_bic_get_sensor_reading(uint8_t fru, uint8_t slot, uint8_t node, uint8_t sensor_num, uint8_t intf,
+                           ipmi_sensor_reading_t *sensor, float *value, bool *linearized) {
+  bic_snr_snapshot_cache_t *cache;
+  bic_snr_coef_t *coef;
+  uint8_t sidx = (fru == FRU_2U_TOP || fru == FRU_2U_BOT) ? (MAX_NUM_FRUS+fru-FRU_EXP_BASE) : (fru-1);
+  uint16_t ver = 0;
+  long long now;
+  int idx;
+  bool hit = false;
+
+  *linearized = false;
+  idx = bic_snr_snapshot_intf_idx(intf);
+  if ( idx < 0 || node < 1 || node > (MAX_NODES+MAX_NUM_EXPS) ) {
+    return bic_get_sensor_reading(slot, sensor_num, sensor, intf);
+  }
+  // no BIC of this type can serve a snapshot, don't probe its version
+  if ( bic_snr_snapshot_min_ver[idx] == BIC_SNR_SNAPSHOT_VER_NONE ) {
+    return bic_get_sensor_reading(slot, sensor_num, sensor, intf);
+  }
+
+  pthread_once(&g_snr_snapshot_once, bic_snr_snapshot_init);
+  cache = &g_snr_snapshot[node-1][idx];
+  coef = &g_snr_coef[sidx];
+
+  pthread_mutex_lock(&cache->lock);
+  now = bic_snr_snapshot_now_ms();
+  if ( pal_is_fw_update_ongoing(slot) == true ) {
+    // the BIC may come back with another firmware, check it again afterwards
+    cache->valid = false;
+    cache->supported = false;
+    cache->probe_ms = 0;
+  } else if ( now >= cache->probe_ms ) {
+    cache->probe_ms = now + BIC_SNR_SNAPSHOT_PROBE_MS;
+    cache->valid = false;
+    cache->supported = false;
+    if ( bic_snr_snapshot_bic_ver(slot, intf, &ver) == 0 ) {
+      if ( ver != cache->bic_ver ) {
+        // the SDR of a new BIC firmware may scale its sensors differently
+        pthread_mutex_lock(&coef->lock);
+        coef->ready = false;
+        pthread_mutex_unlock(&coef->lock);
+        cache->bic_ver = ver;
+      }
+      cache->supported = (ver >= bic_snr_snapshot_min_ver[idx]);
+    }
+  }
+
+  if ( cache->supported && (!cache->valid || (now - cache->refresh_ms) >= BIC_SNR_SNAPSHOT_TTL_MS) ) {
+    cache->valid = false;
+    if ( bic_get_all_sensor_reading(slot, &cache->snap, intf) < 0 ) {
+      syslog(LOG_INFO, "%s() fru%d intf 0x%x: sensor snapshot is unavailable, use per-sensor reads", __func__, fru, intf);
+      cache->supported = false;
+      cache->probe_ms = now + BIC_SNR_SNAPSHOT_PROBE_MS;
+    } else {
+      pthread_mutex_lock(&coef->lock);
+      if ( !coef->ready ) {
+        bic_snr_coef_init(coef, g_sinfo[sidx]);
+      }
+      bic_snr_snapshot_linearize(coef, cache);
+      pthread_mutex_unlock(&coef->lock);
+      cache->refresh_ms = now;
+      cache->valid = true;
+    }
+  }
+
+  if ( cache->valid && cache->snap.present[sensor_num] ) {
+    *sensor = cache->snap.reading[sensor_num];
+    if ( cache->linear[sensor_num] ) {
+      *value = cache->value[sensor_num];
+      *linearized = true;
+    }
+    hit = true;
+  }
+  pthread_mutex_unlock(&cache->lock);
+
+  if ( hit ) {
+    return 0;
+  }
+  return bic_get_sensor_reading(slot, sensor_num, sensor, intf);
+}
+
 static int
 pal_bic_sensor_read_raw(uint8_t fru, uint8_t sensor_num, float *value, uint8_t bmc_location, const uint8_t config_status){
 #define BIC_SENSOR_READ_NA 0x20
@@ -2121,6 +2432,7 @@ pal_bic_sensor_read_raw(uint8_t fru, uint8_t sensor_num, float *value, uint8_t b
   uint8_t power_status = 0;
   ipmi_sensor_reading_t sensor = {0};
   sdr_full_t *sdr = NULL;
+  bool linearized = false;
   char path[128];
   uint8_t slot = (fru == FRU_2U_TOP || fru == FRU_2U_BOT) ? FRU_SLOT1 : fru;
   uint8_t node = (fru == FRU_2U_TOP || fru == FRU_2U_BOT) ? (fru-FRU_EXP_BASE+MAX_NODES) : fru;
@@ -2158,26 +2470,26 @@ pal_bic_sensor_read_raw(uint8_t fru, uint8_t sensor_num, float *value, uint8_t b
   }
 
   if (fru == FRU_2U_TOP) {
-    ret = bic_get_sensor_reading(slot, sensor_num, &sensor, RREXP_BIC_INTF1);
+    ret = pal_bic_get_sensor_reading(fru, slot, node, sensor_num, RREXP_BIC_INTF1, &sensor, value, &linearized);
   } else if (fru == FRU_2U_BOT) {
-    ret = bic_get_sensor_reading(slot, sensor_num, &sensor, RREXP_BIC_INTF2);
+    ret = pal_bic_get_sensor_reading(fru, slot, node, sensor_num, RREXP_BIC_INTF2, &sensor, value, &linearized);
   } else {
     //check snr number first. If it not holds, it will move on
     if ( (sensor_num >= 0x0) && (sensor_num <= 0x42) ) { //server board
-      ret = bic_get_sensor_reading(fru, sensor_num, &sensor, NONE_INTF);
+      ret = pal_bic_get_sensor_reading(fru, slot, node, sensor_num, NONE_INTF, &sensor, value, &linearized);
     } else if ( (sensor_num >= 0x50 && sensor_num <= 0x7F) && (bmc_location != NIC_BMC) && //1OU
         ((config_status & PRESENT_1OU) == PRESENT_1OU) ) {
-      ret = bic_get_sensor_reading(fru, sensor_num, &sensor, FEXP_BIC_INTF);
+      ret = pal_bic_get_sensor_reading(fru, slot, node, sensor_num, FEXP_BIC_INTF, &sensor, value, &linearized);
     } else if ( ((sensor_num >= 0x80 && sensor_num <= 0xCE) ||     //2OU
                 (sensor_num >= 0x49 && sensor_num <= 0x4D)) &&    //Many sensors are defined in GPv3.
                 ((config_status & PRESENT_2OU) == PRESENT_2OU) ) { //The range from 0x80 to 0xCE is not enough for adding new sensors.
                                                                   //So, we take 0x49 ~ 0x4D here
-      ret = bic_get_sensor_reading(fru, sensor_num, &sensor, REXP_BIC_INTF);
+      ret = pal_bic_get_sensor_reading(fru, slot, node, sensor_num, REXP_BIC_INTF, &sensor, value, &linearized);
     } else if ( sensor_num == 0x43 && (config_status & PRESENT_2OU) == PRESENT_2OU ) { // DP Riser
-      ret = bic_get_sensor_reading(fru, sensor_num, &sensor, NONE_INTF);
+      ret = pal_bic_get_sensor_reading(fru, slot, node, sensor_num, NONE_INTF, &sensor, value, &linearized);
     } else if ( (sensor_num >= 0xD1 && sensor_num <= 0xEC) ) { //BB
       if ( bic_is_crit_act_ongoing(FRU_SLOT1) == true ) return READING_NA;
-      ret = bic_get_sensor_reading(fru, sensor_num, &sensor, BB_BIC_INTF);
+      ret = pal_bic_get_sensor_reading(fru, slot, node, sensor_num, BB_BIC_INTF, &sensor, value, &linearized);
     } else {
       return READING_NA;
     }
@@ -2204,6 +2516,10 @@ pal_bic_sensor_read_raw(uint8_t fru, uint8_t sensor_num, float *value, uint8_t b
     return 0;
   }
 
+  if ( linearized ) {
+    goto correct_value;
+  }
+
   // y = (mx + b * 10^b_exp) * 10^r_exp
   int x;
   uint8_t m_lsb, m_msb;
@@ -2246,6 +2562,7 @@ pal_bic_sensor_read_raw(uint8_t fru, uint8_t sensor_num, float *value, uint8_t b
   //syslog(LOG_WARNING, "%s() snr#0x%x raw:%x m=%x b=%x b_exp=%x r_exp=%x s_units1=%x", __func__, sensor_num, x, m, b, b_exp, r_exp, sdr->sensor_units1);
   *value = ((m * x) + (b * pow(10, b_exp))) * (pow(10, r_exp));
 
+correct_value:
   //correct the value
   switch (sensor_num) {
     case BIC_SENSOR_FIO_TEMP:
@@ -21,35 +21,46 @@
  * it's set to empty intentionally. Each platform needs to override the
  * file if platform specific settings are required.
  */
+#include <stdbool.h>
 #include "psu.h"
 
+#define PSU_CNT 4
+
+/*
+ * Monitor everything but the PSUs being updated with a private sensord
+ * while they are updated, then hand back to the sensord service.
+ */
 void
-sensord_operation(uint8_t num, uint8_t action) {
+sensord_operation_batch(const uint8_t *nums, int count, uint8_t action) {
+  char cmd[128] = "/usr/local/bin/sensord scm smb pim1 pim2 pim3 pim4 pim5 pim6 pim7 pim8";
+  bool updating[PSU_CNT] = {false};
+  int i;
 
   if (action == STOP) {
-    syslog(LOG_WARNING, "Stop monitor PSU%d sensor to update", num + 1);
+    for (i = 0; i < count; i++) {
+      syslog(LOG_WARNING, "Stop monitor PSU%d sensor to update", nums[i] + 1);
+      if (nums[i] < PSU_CNT) {
+        updating[nums[i]] = true;
+      }
+    }
     run_command("sv stop sensord > /dev/null");
-    switch (num) {
-      case 0:
-        run_command("/usr/local/bin/sensord scm smb pim1 pim2 pim3 pim4 "
-                    "pim5 pim6 pim7 pim8 psu2 psu3 psu4 > /dev/null 2>&1 &");
-        break;
-      case 1:
-        run_command("/usr/local/bin/sensord scm smb pim1 pim2 pim3 pim4 "
-                    "pim5 pim6 pim7 pim8 psu1 psu3 psu4 > /dev/null 2>&1 &");
-        break;
-      case 2:
-        run_command("/usr/local/bin/sensord scm smb pim1 pim2 pim3 pim4 "
-                    "pim5 pim6 pim7 pim8 psu1 psu2 psu4 > /dev/null 2>&1 &");
-        break;
-      case 3:
-        run_command("/usr/local/bin/sensord scm smb pim1 pim2 pim3 pim4 "
-                    "pim5 pim6 pim7 pim8 psu1 psu2 psu3 > /dev/null 2>&1 &");
-        break;
+    for (i = 0; i < PSU_CNT; i++) {
+      if (!updating[i]) {
+        snprintf(cmd + strlen(cmd), sizeof(cmd) - strlen(cmd), " psu%d", i + 1);
+      }
     }
+    strncat(cmd, " > /dev/null 2>&1 &", sizeof(cmd) - strlen(cmd) - 1);
+    run_command(cmd);
   } else if (action == START) {
     run_command("killall sensord");
     run_command("sv start sensord > /dev/nul");
-    syslog(LOG_WARNING, "Start monitor PSU%d sensor", num + 1);
+    for (i = 0; i < count; i++) {
+      syslog(LOG_WARNING, "Start monitor PSU%d sensor", nums[i] + 1);
+    }
   }
-}
\ No newline at end of file
+}
+
+void
+sensord_operation(uint8_t num, uint8_t action) {
+  sensord_operation_batch(&num, 1, action);
+}
@@ -2846,12 +2846,19 @@ get_fan_speed(uint8_t snr_num, float *rpm) {
   return 0;
 }
 
+static void inlet_correction_init(void) {
+  if (sensor_correction_init("/etc/sensor-correction-conf.json")) {
+    syslog(LOG_ERR, "sensor_correction_init fail!");
+  }
+}
+
 static void apply_inlet_correction(float *value) {
   float rpm[16] = {0};
   float avg_rpm = 0;
   uint8_t i;
   uint8_t cnt = 0;
-  static bool inited = false;
+  // sensor-util reads several FRUs at once
+  static pthread_once_t inited = PTHREAD_ONCE_INIT;
 
   /* Get RPM value */
   for (i = SMB_SENSOR_FAN1_FRONT_TACH; i <= SMB_SENSOR_FAN8_REAR_TACH; i++) {
@@ -2863,12 +2870,7 @@ static void apply_inlet_correction(float *value) {
   if (cnt) {
     avg_rpm = avg_rpm / (float)cnt;
 
-    if (!inited) {
-      if (sensor_correction_init("/etc/sensor-correction-conf.json")) {
-        syslog(LOG_ERR, "sensor_correction_init fail!");
-      }
-      inited = true;
-    }
+    pthread_once(&inited, inlet_correction_init);
     sensor_correction_apply(FRU_SCM,
                             SCM_SENSOR_INLET_REMOTE_TEMP, avg_rpm, value);
   }
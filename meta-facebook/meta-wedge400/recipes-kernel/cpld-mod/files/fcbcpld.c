@@ -884,6 +884,19 @@ static const i2c_dev_attr_st fcbcpld_attr_table[] = {
 
 static i2c_dev_data_st fcbcpld_data;
 
+/* Latched interrupt status is read live */
+static const int fcbcpld_volatile_regs[] = {
+  0x07, 0x09, 0x11, 0x13, 0x2a, 0x3a, 0x4a, 0x5a,
+};
+
+static const i2c_dev_shadow_cfg_st fcbcpld_shadow = {
+  .isc_first_reg = 0x0,
+  .isc_n_regs = 0x5b,
+  .isc_valid_ms = 1000,
+  .isc_volatile_regs = fcbcpld_volatile_regs,
+  .isc_n_volatile_regs = ARRAY_SIZE(fcbcpld_volatile_regs),
+};
+
 /*
  * FCBCPLD i2c addresses.
  */
@@ -913,8 +926,15 @@ static int fcbcpld_probe(struct i2c_client *client,
                          const struct i2c_device_id *id)
 {
   int n_attrs = sizeof(fcbcpld_attr_table) / sizeof(fcbcpld_attr_table[0]);
-  return i2c_dev_sysfs_data_init(client, &fcbcpld_data,
-                                 fcbcpld_attr_table, n_attrs);
+  int ret;
+
+  ret = i2c_dev_sysfs_data_init(client, &fcbcpld_data,
+                                fcbcpld_attr_table, n_attrs);
+  if (ret == 0 &&
+      i2c_dev_sysfs_shadow_init(client, &fcbcpld_data, &fcbcpld_shadow)) {
+    dev_warn(&client->dev, "register shadow not available\n");
+  }
+  return ret;
 }
 
 static int fcbcpld_remove(struct i2c_client *client)
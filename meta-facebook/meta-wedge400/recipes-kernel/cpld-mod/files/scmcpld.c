@@ -570,6 +570,19 @@ static const i2c_dev_attr_st scmcpld_attr_table[] = {
 
 static i2c_dev_data_st scmcpld_data;
 
+/* Watchdog and interrupt sources are read live */
+static const int scmcpld_volatile_regs[] = {
+  0x0c, 0x21,
+};
+
+static const i2c_dev_shadow_cfg_st scmcpld_shadow = {
+  .isc_first_reg = 0x0,
+  .isc_n_regs = 0x3b,
+  .isc_valid_ms = 1000,
+  .isc_volatile_regs = scmcpld_volatile_regs,
+  .isc_n_volatile_regs = ARRAY_SIZE(scmcpld_volatile_regs),
+};
+
 /*
  * SCMCPLD i2c addresses.
  */
@@ -599,8 +612,15 @@ static int scmcpld_probe(struct i2c_client *client,
                          const struct i2c_device_id *id)
 {
   int n_attrs = sizeof(scmcpld_attr_table) / sizeof(scmcpld_attr_table[0]);
-  return i2c_dev_sysfs_data_init(client, &scmcpld_data,
-                                 scmcpld_attr_table, n_attrs);
+  int ret;
+
+  ret = i2c_dev_sysfs_data_init(client, &scmcpld_data,
+                                scmcpld_attr_table, n_attrs);
+  if (ret == 0 &&
+      i2c_dev_sysfs_shadow_init(client, &scmcpld_data, &scmcpld_shadow)) {
+    dev_warn(&client->dev, "register shadow not available\n");
+  }
+  return ret;
 }
 
 static int scmcpld_remove(struct i2c_client *client)
@@ -2910,6 +2910,23 @@ static const i2c_dev_attr_st smb_syscpld_attr_table_gb[] = {
 
 static i2c_dev_data_st smb_syscpld_data;
 
+/*
+ * Interrupt sources, latched interrupt status and inputs, such as PSU
+ * status, power good and DOM FPGA init done, are read live
+ */
+static const int smb_syscpld_volatile_regs[] = {
+  0x03, 0x10, 0x11, 0x12, 0x30, 0x31, 0x32, 0x43, 0x44, 0x45, 0x47,
+  0x4a, 0x4d, 0x50,
+};
+
+static const i2c_dev_shadow_cfg_st smb_syscpld_shadow = {
+  .isc_first_reg = 0x0,
+  .isc_n_regs = 0x53,
+  .isc_valid_ms = 1000,
+  .isc_volatile_regs = smb_syscpld_volatile_regs,
+  .isc_n_volatile_regs = ARRAY_SIZE(smb_syscpld_volatile_regs),
+};
+
 /*
  * SMB SYSCPLD i2c addresses.
  */
@@ -2938,6 +2955,8 @@ static int smb_syscpld_detect(struct i2c_client *client,
 static int smb_syscpld_probe(struct i2c_client *client,
                              const struct i2c_device_id *id)
 {
+  int ret;
+
   // get board_type from cpld register
   // reg 0x00 [5:4] 
   //   0x00 : Wedge400
@@ -2945,15 +2964,21 @@ static int smb_syscpld_probe(struct i2c_client *client,
   uint32_t board_type = i2c_smbus_read_byte_data(client,0x00);
   if((board_type & 0x30) == 0x00){
     int n_attrs = sizeof(smb_syscpld_attr_table_th3) / sizeof(smb_syscpld_attr_table_th3[0]);
-    return i2c_dev_sysfs_data_init(client, &smb_syscpld_data,
+    ret = i2c_dev_sysfs_data_init(client, &smb_syscpld_data,
                                   smb_syscpld_attr_table_th3, n_attrs);
   }else if((board_type & 0x30) == 0x10){
     int n_attrs = sizeof(smb_syscpld_attr_table_gb) / sizeof(smb_syscpld_attr_table_gb[0]);
-    return i2c_dev_sysfs_data_init(client, &smb_syscpld_data,
+    ret = i2c_dev_sysfs_data_init(client, &smb_syscpld_data,
                                   smb_syscpld_attr_table_gb, n_attrs);
   }else{
     return -ENODEV;
   }
+
+  if (ret == 0 &&
+      i2c_dev_sysfs_shadow_init(client, &smb_syscpld_data, &smb_syscpld_shadow)) {
+    dev_warn(&client->dev, "register shadow not available\n");
+  }
+  return ret;
 }
 
 static int smb_syscpld_remove(struct i2c_client *client)